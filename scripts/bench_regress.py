@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+
+"""
+Compare a freshly recorded sherpa-bench JSON report against a stored
+baseline and fail on regression.
+
+It is normally driven by the `bench-regress` CMake target:
+
+    cmake --build build --target bench-regress
+
+which runs sherpa-bench with --benchmark_out_format=json and then this
+script. The first run records the baseline; later runs compare the
+real time and the allocs/alloc_bytes counters of every benchmark against
+it and exit non-zero if any of them regressed by more than the
+tolerance. After an intentional performance change, refresh the baseline
+with --update.
+"""
+import argparse
+import json
+import shutil
+import sys
+
+# Metrics compared for every benchmark. Counters are absent from
+# benchmarks that do not report them; those are skipped.
+METRICS = ["real_time", "allocs", "alloc_bytes"]
+
+# Multipliers to normalize google-benchmark time units to nanoseconds.
+TIME_UNITS = {"ns": 1, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def get_args():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument(
+        "--current",
+        type=str,
+        required=True,
+        help="Path to the JSON report of the run to check",
+    )
+    parser.add_argument(
+        "--baseline",
+        type=str,
+        required=True,
+        help="Path to the stored baseline JSON report. Created from "
+        "--current if it does not exist yet.",
+    )
+    parser.add_argument(
+        "--tolerance",
+        type=float,
+        default=0.10,
+        help="Maximum tolerated relative increase per metric, "
+        "e.g. 0.10 for 10%%",
+    )
+    parser.add_argument(
+        "--update",
+        action="store_true",
+        help="Overwrite the baseline with the current report and exit",
+    )
+    return parser.parse_args()
+
+
+def load_benchmarks(path):
+    """Return a dict mapping benchmark name to its metrics, with times
+    normalized to nanoseconds."""
+    with open(path) as f:
+        report = json.load(f)
+
+    ans = {}
+    for b in report.get("benchmarks", []):
+        if b.get("run_type") == "aggregate":
+            continue
+        metrics = {}
+        scale = TIME_UNITS[b.get("time_unit", "ns")]
+        for m in METRICS:
+            if m in b:
+                value = b[m]
+                if m == "real_time":
+                    value *= scale
+                metrics[m] = value
+        ans[b["name"]] = metrics
+    return ans
+
+
+def main():
+    args = get_args()
+
+    if args.update:
+        shutil.copyfile(args.current, args.baseline)
+        print(f"Baseline updated: {args.baseline}")
+        return 0
+
+    try:
+        baseline = load_benchmarks(args.baseline)
+    except FileNotFoundError:
+        shutil.copyfile(args.current, args.baseline)
+        print(
+            f"No baseline found; recorded {args.baseline} from this run. "
+            "Later runs are compared against it."
+        )
+        return 0
+
+    current = load_benchmarks(args.current)
+
+    regressions = []
+    notes = []
+    for name, base_metrics in sorted(baseline.items()):
+        if name not in current:
+            notes.append(f"{name}: missing from the current run")
+            continue
+        cur_metrics = current[name]
+        for m, base_value in base_metrics.items():
+            if m not in cur_metrics or base_value <= 0:
+                continue
+            ratio = cur_metrics[m] / base_value - 1
+            line = (
+                f"{name} {m}: {base_value:.6g} -> "
+                f"{cur_metrics[m]:.6g} ({ratio:+.1%})"
+            )
+            if ratio > args.tolerance:
+                regressions.append(line)
+            elif ratio < -args.tolerance:
+                notes.append(line + ", consider refreshing the baseline")
+
+    for name in sorted(set(current) - set(baseline)):
+        notes.append(f"{name}: not in the baseline; run with --update")
+
+    for line in notes:
+        print(f"note: {line}")
+
+    if regressions:
+        print(
+            f"{len(regressions)} regression(s) beyond the "
+            f"{args.tolerance:.0%} tolerance:",
+            file=sys.stderr,
+        )
+        for line in regressions:
+            print(f"  {line}", file=sys.stderr)
+        return 1
+
+    print(f"No regression beyond the {args.tolerance:.0%} tolerance")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
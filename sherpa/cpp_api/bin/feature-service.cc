@@ -0,0 +1,79 @@
+// sherpa/cpp_api/bin/feature-service.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include <thread>  // NOLINT
+
+#include "sherpa/cpp_api/feature-config.h"
+#include "sherpa/cpp_api/parse-options.h"
+#include "sherpa/csrc/feature-service.h"
+#include "sherpa/csrc/log.h"
+#include "torch/script.h"
+
+static constexpr const char *kUsageMessage = R"(
+Host-wide fbank computation service over shared memory.
+
+Run one instance per host. Recognizer processes started with
+--feature-service=<prefix> (e.g., one sherpa-offline per GPU) send
+their wave samples here instead of each running its own feature
+extraction threads, so the CPU feature capacity of the host is pooled.
+
+Pass the same feature options (--num-mel-bins etc.) the recognizer
+processes use; the service computes raw fbank only, sample scaling and
+normalization stay in the clients.
+
+Usage:
+
+  ./bin/sherpa-feature-service \
+    --shm-name-prefix=/sherpa-features \
+    --num-workers=16 \
+    --num-mel-bins=80
+)";
+
+int main(int argc, char *argv[]) {
+  // see
+  // https://pytorch.org/docs/stable/notes/cpu_threading_torchscript_inference.html
+  torch::set_num_threads(1);
+  torch::set_num_interop_threads(1);
+  torch::NoGradGuard no_grad;
+
+  std::string shm_name_prefix = "/sherpa-features";
+  int32_t num_workers = -1;
+  int32_t ring_mb = 16;
+
+  sherpa::ParseOptions po(kUsageMessage);
+  po.Register("shm-name-prefix", &shm_name_prefix,
+              "Name prefix of the shm objects the service and its "
+              "clients communicate through. Clients pass the same value "
+              "via --feature-service.");
+  po.Register("num-workers", &num_workers,
+              "Number of feature extraction threads. -1 means the "
+              "number of CPU cores.");
+  po.Register("ring-mb", &ring_mb,
+              "Capacity in MB of each per-client response ring. An "
+              "utterance whose features do not fit is dropped.");
+
+  sherpa::FeatureConfig feat_config;
+  feat_config.Register(&po);
+
+  po.Read(argc, argv);
+  if (po.NumArgs() != 0) {
+    po.PrintUsage();
+    exit(EXIT_FAILURE);
+  }
+
+  if (num_workers < 0) {
+    num_workers = std::thread::hardware_concurrency();
+  }
+  SHERPA_CHECK_GT(num_workers, 0);
+  SHERPA_CHECK_GT(ring_mb, 0);
+
+  SHERPA_LOG(INFO) << "feat_config: " << feat_config.ToString();
+
+  sherpa::FeatureService service(shm_name_prefix, feat_config.fbank_opts,
+                                 num_workers,
+                                 static_cast<uint32_t>(ring_mb) * 1024 * 1024);
+  service.Run();
+
+  return 0;
+}
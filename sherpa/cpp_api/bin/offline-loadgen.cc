@@ -0,0 +1,278 @@
+/**
+ * Copyright      2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>   // NOLINT
+#include <sstream>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "sherpa/cpp_api/offline-recognizer.h"
+#include "sherpa/cpp_api/parse-options.h"
+#include "sherpa/csrc/fbank-features.h"
+#include "sherpa/csrc/log.h"
+#include "sherpa/csrc/text-utils.h"
+#include "torch/script.h"
+
+static constexpr const char *kUsageMessage = R"(
+Benchmark the offline recognizer API directly, without any networking.
+
+It decodes a set of wave files over every combination of the given batch
+sizes and client thread counts, and prints one JSON object per
+configuration with RTF, p50/p95/p99 batch latency and peak RSS, so runs
+are reproducible and comparable.
+
+Usage:
+
+  ./bin/sherpa-loadgen \
+    --nn-model=/path/to/cpu_jit.pt \
+    --tokens=/path/to/tokens.txt \
+    --batch-sizes=1,4,8 \
+    --client-threads=1,2 \
+    foo.wav bar.wav baz.wav
+
+or with a manifest containing one wave filename per line:
+
+  ./bin/sherpa-loadgen \
+    --nn-model=/path/to/cpu_jit.pt \
+    --tokens=/path/to/tokens.txt \
+    --manifest=wavs.txt
+)";
+
+namespace {
+
+// `latencies` must be sorted ascending; p is in [0, 100].
+double Percentile(const std::vector<double> &latencies, double p) {
+  if (latencies.empty()) {
+    return 0;
+  }
+  auto i = static_cast<size_t>(p / 100 * latencies.size());
+  i = std::min(i, latencies.size() - 1);
+  return latencies[i];
+}
+
+// Peak resident set size of this process in bytes, or 0 where it is
+// not available. Note that it is a high-water mark: it only grows, so
+// later configurations inherit the peak of earlier ones.
+int64_t PeakRssBytes() {
+#ifndef _WIN32
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return usage.ru_maxrss;  // bytes on macOS
+#else
+  return usage.ru_maxrss * 1024;  // kilobytes on Linux
+#endif
+#else
+  return 0;
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  // see
+  // https://pytorch.org/docs/stable/notes/cpu_threading_torchscript_inference.html
+  torch::set_num_threads(1);
+  torch::set_num_interop_threads(1);
+  torch::NoGradGuard no_grad;
+
+  torch::jit::getExecutorMode() = false;
+  torch::jit::getProfilingMode() = false;
+  torch::jit::setGraphExecutorOptimize(false);
+
+  float expected_sample_rate = 16000;
+  std::string manifest;
+  std::string batch_sizes = "1,4,8";
+  std::string client_threads = "1";
+
+  sherpa::ParseOptions po(kUsageMessage);
+  sherpa::OfflineRecognizerConfig config;
+  config.Register(&po);
+
+  po.Register("manifest", &manifest,
+              "If not empty, path to a text file with one wave filename "
+              "per line. Otherwise the wave filenames are taken from the "
+              "positional arguments.");
+
+  po.Register("batch-sizes", &batch_sizes,
+              "Comma-separated list of batch sizes to sweep, e.g., 1,4,8");
+
+  po.Register("client-threads", &client_threads,
+              "Comma-separated list of client thread counts to sweep. "
+              "Each client thread assembles and decodes its own batches "
+              "concurrently, like the workers of the websocket servers.");
+
+  po.Read(argc, argv);
+  config.Validate();
+
+  SHERPA_CHECK_EQ(config.feat_config.fbank_opts.frame_opts.samp_freq,
+                  expected_sample_rate)
+      << "The model was trained using training data with sample rate 16000. "
+      << "We don't support resample yet";
+
+  std::vector<std::string> filenames;
+  if (!manifest.empty()) {
+    std::ifstream is(manifest);
+    if (!is) {
+      SHERPA_LOG(FATAL) << "Failed to open --manifest=" << manifest;
+    }
+    std::string line;
+    while (std::getline(is, line)) {
+      if (!line.empty()) {
+        filenames.push_back(line);
+      }
+    }
+  } else {
+    for (int32_t i = 1; i <= po.NumArgs(); ++i) {
+      filenames.push_back(po.GetArg(i));
+    }
+  }
+
+  if (filenames.empty()) {
+    po.PrintUsage();
+    exit(EXIT_FAILURE);
+  }
+
+  // Load all waves up front so I/O never pollutes the measurements.
+  std::vector<torch::Tensor> waves;
+  waves.reserve(filenames.size());
+  double audio_seconds = 0;
+  for (const auto &filename : filenames) {
+    auto wave = sherpa::ReadWave(filename, expected_sample_rate);
+    audio_seconds += wave.second;
+    waves.push_back(wave.first);
+  }
+
+  SHERPA_LOG(INFO) << config.ToString();
+  SHERPA_LOG(INFO) << "Loaded " << waves.size() << " waves, " << audio_seconds
+                   << " seconds of audio";
+
+  sherpa::OfflineRecognizer recognizer(config);
+
+  std::ostringstream json;
+  json << "[\n";
+  bool first_entry = true;
+
+  for (int32_t num_threads : sherpa::SplitStringToIntegers(client_threads)) {
+    SHERPA_CHECK_GT(num_threads, 0);
+    for (int32_t batch_size : sherpa::SplitStringToIntegers(batch_sizes)) {
+      SHERPA_CHECK_GT(batch_size, 0);
+
+      // One warmup batch so lazy kernel selection and allocator growth
+      // are not billed to the first measured batch.
+      {
+        std::vector<std::unique_ptr<sherpa::OfflineStream>> ss;
+        std::vector<sherpa::OfflineStream *> p_ss;
+        for (int32_t i = 0;
+             i != std::min<int32_t>(batch_size, waves.size()); ++i) {
+          auto s = recognizer.CreateStream();
+          s->AcceptSamples(waves[i].data_ptr<float>(), waves[i].numel());
+          ss.push_back(std::move(s));
+          p_ss.push_back(ss.back().get());
+        }
+        recognizer.DecodeStreams(p_ss.data(), p_ss.size());
+      }
+
+      std::atomic<int32_t> next{0};
+      std::mutex latency_mutex;
+      std::vector<double> latencies;  // one entry per batch, in seconds
+
+      auto worker = [&]() {
+        while (true) {
+          int32_t begin = next.fetch_add(batch_size);
+          if (begin >= static_cast<int32_t>(waves.size())) {
+            return;
+          }
+          int32_t end = std::min<int32_t>(begin + batch_size, waves.size());
+
+          auto batch_begin = std::chrono::steady_clock::now();
+
+          std::vector<std::unique_ptr<sherpa::OfflineStream>> ss;
+          std::vector<sherpa::OfflineStream *> p_ss;
+          for (int32_t i = begin; i != end; ++i) {
+            auto s = recognizer.CreateStream();
+            s->AcceptSamples(waves[i].data_ptr<float>(), waves[i].numel());
+            ss.push_back(std::move(s));
+            p_ss.push_back(ss.back().get());
+          }
+          recognizer.DecodeStreams(p_ss.data(), p_ss.size());
+
+          double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - batch_begin)
+                               .count();
+
+          std::lock_guard<std::mutex> lock(latency_mutex);
+          latencies.push_back(elapsed);
+        }
+      };
+
+      auto sweep_begin = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (int32_t i = 0; i != num_threads; ++i) {
+        threads.emplace_back(worker);
+      }
+      for (auto &t : threads) {
+        t.join();
+      }
+      double wall_seconds = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - sweep_begin)
+                                .count();
+
+      std::sort(latencies.begin(), latencies.end());
+
+      if (!first_entry) {
+        json << ",\n";
+      }
+      first_entry = false;
+
+      json << "  {"
+           << "\"batch_size\": " << batch_size << ", "
+           << "\"client_threads\": " << num_threads << ", "
+           << "\"num_waves\": " << waves.size() << ", "
+           << "\"audio_seconds\": " << audio_seconds << ", "
+           << "\"wall_seconds\": " << wall_seconds << ", "
+           << "\"rtf\": " << wall_seconds / audio_seconds << ", "
+           << "\"latency_ms\": {"
+           << "\"p50\": " << Percentile(latencies, 50) * 1000 << ", "
+           << "\"p95\": " << Percentile(latencies, 95) * 1000 << ", "
+           << "\"p99\": " << Percentile(latencies, 99) * 1000 << "}, "
+           << "\"peak_rss_bytes\": " << PeakRssBytes() << "}";
+
+      SHERPA_LOG(INFO) << "batch_size " << batch_size << ", client_threads "
+                       << num_threads << ": RTF "
+                       << wall_seconds / audio_seconds;
+    }
+  }
+  json << "\n]\n";
+
+  std::cout << json.str();
+
+  return 0;
+}
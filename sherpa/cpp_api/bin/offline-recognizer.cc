@@ -17,10 +17,27 @@
  */
 #include "sherpa/cpp_api/offline-recognizer.h"
 
+#include <atomic>
+#include <cmath>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>   // NOLINT
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
 #include "kaldi_native_io/csrc/kaldi-table.h"
 #include "kaldi_native_io/csrc/text-utils.h"
 #include "kaldi_native_io/csrc/wave-reader.h"
+#include "nlohmann/json.hpp"
 #include "sherpa/cpp_api/parse-options.h"
+#include "sherpa/cpp_api/result-archive.h"
 #include "sherpa/csrc/log.h"
 #include "torch/script.h"
 
@@ -61,6 +78,19 @@ Usage:
     scp:feats.scp \
     ark,scp,t:results.ark,results.scp
 
+(5) Decode a jsonl manifest with resumable output
+
+  ./bin/sherpa-offline \
+    --nn-model=/path/to/cpu_jit.pt \
+    --tokens=/path/to/tokens.txt \
+    --use-gpu=false \
+    --manifest-in=cuts.jsonl \
+    --manifest-out=results.jsonl
+
+  Each line of cuts.jsonl is a json object such as
+  {"path": "foo.wav", "start": 1.5, "duration": 3.0}. Rerunning the
+  command skips entries already present in results.jsonl.
+
 Caution: Models from icefall use normalized audio samples, i.e., samples in
 the range [-1, 1), to compute features,
 while Kaldi uses samples in the range [-32768, 32767] to compute features.
@@ -75,6 +105,232 @@ See:
 for more details.
 )";
 
+// One line of the input manifest; see --manifest-in.
+struct ManifestEntry {
+  std::string key;
+  std::string path;
+  float start = 0;        // segment start in seconds
+  float duration = -1;    // segment duration in seconds; -1 means until
+                          // the end of the file
+};
+
+/** Decode a jsonl manifest with checkpointed output.
+ *
+ * Each manifest line is a json object with a "path" field and optional
+ * "start"/"duration" fields (in seconds) selecting a segment, plus an
+ * optional "key". Results are appended to `manifest_out` as one json
+ * line per entry and flushed after every batch, so a killed job can be
+ * rerun with the same arguments and resumes where it left off: entries
+ * whose key already appears in `manifest_out` are skipped.
+ *
+ * Consecutive entries with the same path are grouped, the file is read
+ * and featurized once, and each segment gets a slice of the feature
+ * matrix, so decoding many segments of one file does not re-read it.
+ *
+ * The same I/O-thread/bounded-queue pipeline as for command-line wave
+ * files is used, so file reading overlaps decoding.
+ */
+static void DecodeManifest(sherpa::OfflineRecognizer *recognizer,
+                           float frame_shift_ms,
+                           const std::string &manifest_in,
+                           const std::string &manifest_out,
+                           int32_t batch_size, int32_t num_io_threads,
+                           sherpa::ResultArchiveWriter *archive_writer) {
+  using json = nlohmann::json;
+
+  // Keys already present in the output; their entries are skipped.
+  std::unordered_set<std::string> done;
+  {
+    std::ifstream is(manifest_out);
+    std::string line;
+    while (std::getline(is, line)) {
+      if (line.empty()) {
+        continue;
+      }
+      done.insert(json::parse(line).at("key").get<std::string>());
+    }
+  }
+
+  auto make_key = [](const ManifestEntry &e) {
+    std::ostringstream os;
+    os << e.path << ":" << e.start << ":" << e.duration;
+    return os.str();
+  };
+
+  // Group consecutive entries with the same path so each file is read
+  // and featurized once.
+  std::vector<std::vector<ManifestEntry>> groups;
+  int32_t num_skipped = 0;
+  {
+    std::ifstream is(manifest_in);
+    if (!is) {
+      SHERPA_LOG(FATAL) << "Failed to open " << manifest_in;
+    }
+
+    std::string line;
+    while (std::getline(is, line)) {
+      if (line.empty()) {
+        continue;
+      }
+
+      json j = json::parse(line);
+      ManifestEntry e;
+      e.path = j.at("path").get<std::string>();
+      e.start = j.value("start", 0.0f);
+      e.duration = j.value("duration", -1.0f);
+      e.key = j.value("key", "");
+      if (e.key.empty()) {
+        e.key = make_key(e);
+      }
+
+      if (done.count(e.key)) {
+        ++num_skipped;
+        continue;
+      }
+
+      if (groups.empty() || groups.back().back().path != e.path) {
+        groups.emplace_back();
+      }
+      groups.back().push_back(std::move(e));
+    }
+  }
+
+  if (num_skipped > 0) {
+    SHERPA_LOG(INFO) << "Resuming: " << num_skipped
+                     << " entries already decoded in " << manifest_out;
+  }
+
+  struct PreparedSegment {
+    ManifestEntry entry;
+    std::unique_ptr<sherpa::OfflineStream> stream;
+  };
+
+  std::mutex mutex;
+  std::condition_variable producer_cv;
+  std::condition_variable consumer_cv;
+  std::deque<PreparedSegment> queue;
+  const size_t queue_capacity = 4 * static_cast<size_t>(batch_size);
+  std::atomic<size_t> next_group{0};
+  int32_t num_active_producers = num_io_threads;
+
+  float frame_shift_s = frame_shift_ms / 1000.0f;
+
+  auto producer = [&]() {
+    torch::NoGradGuard no_grad;
+
+    while (true) {
+      size_t g = next_group.fetch_add(1);
+      if (g >= groups.size()) {
+        break;
+      }
+
+      // Read and featurize the file once for all its segments.
+      auto full = recognizer->CreateStream();
+      full->AcceptWaveFile(groups[g][0].path);
+      torch::Tensor features = full->GetFeatures();
+
+      for (auto &e : groups[g]) {
+        std::unique_ptr<sherpa::OfflineStream> s;
+        if (e.start == 0 && e.duration < 0 && groups[g].size() == 1) {
+          s = std::move(full);
+        } else if (features.dim() != 2) {
+          // Models consuming raw waveforms: slice the samples instead
+          // of feature frames. The decoded-audio cache inside
+          // AcceptWaveFile() makes this hit the PCM decoded for `full`
+          // above, so the file is still read only once.
+          s = recognizer->CreateStream();
+          s->AcceptWaveFile(e.path, e.start, e.duration);
+        } else {
+          int32_t num_frames = features.size(0);
+          int32_t first = std::min<int32_t>(e.start / frame_shift_s,
+                                            num_frames);
+          int32_t n = e.duration < 0
+                          ? num_frames - first
+                          : std::min<int32_t>(
+                                std::ceil(e.duration / frame_shift_s),
+                                num_frames - first);
+
+          auto piece = features.narrow(0, first, n).contiguous();
+          s = recognizer->CreateStream();
+          s->AcceptFeatures(piece.data_ptr<float>(), piece.size(0),
+                            piece.size(1));
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        producer_cv.wait(lock, [&] { return queue.size() < queue_capacity; });
+        queue.push_back({e, std::move(s)});
+        consumer_cv.notify_one();
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--num_active_producers == 0) {
+      consumer_cv.notify_one();
+    }
+  };
+
+  std::vector<std::thread> io_threads;
+  io_threads.reserve(num_io_threads);
+  for (int32_t i = 0; i != num_io_threads; ++i) {
+    io_threads.emplace_back(producer);
+  }
+
+  std::ofstream os(manifest_out, std::ios::app);
+  if (!os) {
+    SHERPA_LOG(FATAL) << "Failed to open " << manifest_out << " for writing";
+  }
+
+  while (true) {
+    std::vector<PreparedSegment> batch;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      consumer_cv.wait(lock, [&] {
+        return !queue.empty() || num_active_producers == 0;
+      });
+      if (queue.empty()) {
+        break;  // all producers are done
+      }
+
+      while (!queue.empty() &&
+             static_cast<int32_t>(batch.size()) < batch_size) {
+        batch.push_back(std::move(queue.front()));
+        queue.pop_front();
+      }
+    }
+    producer_cv.notify_all();
+
+    std::vector<sherpa::OfflineStream *> p_ss(batch.size());
+    for (size_t i = 0; i != batch.size(); ++i) {
+      p_ss[i] = batch[i].stream.get();
+    }
+    recognizer->DecodeStreams(p_ss.data(), p_ss.size());
+
+    for (const auto &b : batch) {
+      json j;
+      j["key"] = b.entry.key;
+      j["path"] = b.entry.path;
+      j["start"] = b.entry.start;
+      j["duration"] = b.entry.duration;
+      j["text"] = b.stream->GetResult().text;
+      os << j.dump() << "\n";
+
+      if (archive_writer) {
+        archive_writer->Write(b.entry.key, b.stream->GetResult());
+      }
+    }
+    // Flushing after every batch is the checkpoint: a killed job loses
+    // at most the batch in flight.
+    os.flush();
+    if (archive_writer) {
+      archive_writer->Flush();
+    }
+  }
+
+  for (auto &t : io_threads) {
+    t.join();
+  }
+}
+
 int main(int argc, char *argv[]) {
   // see
   // https://pytorch.org/docs/stable/notes/cpu_threading_torchscript_inference.html
@@ -91,6 +347,10 @@ int main(int argc, char *argv[]) {
   bool use_wav_scp = false;    // true to use wav.scp as input
   bool use_feats_scp = false;  // true to use feats.scp as input
   int32_t batch_size = 10;
+  int32_t num_io_threads = 1;
+  std::string manifest_in;
+  std::string manifest_out;
+  std::string result_archive;
 
   sherpa::ParseOptions po(kUsageMessage);
   sherpa::OfflineRecognizerConfig config;
@@ -105,18 +365,54 @@ int main(int argc, char *argv[]) {
               "scp:feats.scp ark,scp,t:results.ark,results.scp");
 
   po.Register("batch-size", &batch_size,
-              "Used only when --use-wav-scp=true or --use-feats-scp=true. "
+              "Used when --use-wav-scp=true or --use-feats-scp=true, or "
+              "when several wave files are given on the command line. "
               "It specifies the batch size to use for decoding");
 
+  po.Register("num-io-threads", &num_io_threads,
+              "Used when several wave files are given on the command "
+              "line or with --manifest-in. Number of threads reading and "
+              "featurizing the files while earlier batches are being "
+              "decoded.");
+
+  po.Register("manifest-in", &manifest_in,
+              "If non-empty, read the inputs from this jsonl manifest "
+              "instead of the command line. Each line is a json object "
+              "with a \"path\" field and optional \"start\"/\"duration\" "
+              "fields in seconds selecting a segment of the file, plus "
+              "an optional \"key\". Requires --manifest-out.");
+
+  po.Register("manifest-out", &manifest_out,
+              "Used only with --manifest-in. Results are appended to this "
+              "jsonl file, one line per manifest entry, flushed after "
+              "every batch. Entries whose key is already present are "
+              "skipped, so a killed job can be resumed by rerunning it "
+              "with the same arguments.");
+
+  po.Register("result-archive", &result_archive,
+              "If non-empty, append the full JSON result of every "
+              "utterance to this packed archive file, keyed by the wave "
+              "file name, or by the manifest key with --manifest-in. Use "
+              "sherpa-result-archive to inspect it. It avoids writing "
+              "one small file per utterance in large batch jobs.");
+
   po.Read(argc, argv);
 
-  if (po.NumArgs() < 1) {
+  if (po.NumArgs() < 1 && manifest_in.empty()) {
     po.PrintUsage();
     exit(EXIT_FAILURE);
   }
 
   config.Validate();
 
+  if (config.lazy_text) {
+    // Every output of this tool is text, so deferring its construction
+    // would only move the cost, not save it.
+    SHERPA_LOG(WARNING) << "Ignoring --lazy-text: this tool always needs "
+                           "the text of the results";
+    config.lazy_text = false;
+  }
+
   SHERPA_CHECK_EQ(config.feat_config.fbank_opts.frame_opts.samp_freq,
                   expected_sample_rate)
       << "The model was trained using training data with sample rate 16000. "
@@ -125,6 +421,27 @@ int main(int argc, char *argv[]) {
   SHERPA_LOG(INFO) << config.ToString();
   sherpa::OfflineRecognizer recognizer(config);
 
+  std::unique_ptr<sherpa::ResultArchiveWriter> archive_writer;
+  if (!result_archive.empty()) {
+    archive_writer = std::make_unique<sherpa::ResultArchiveWriter>(
+        result_archive);
+  }
+
+  if (!manifest_in.empty()) {
+    if (manifest_out.empty()) {
+      SHERPA_LOG(FATAL) << "Please provide --manifest-out when using "
+                        << "--manifest-in";
+    }
+    SHERPA_CHECK_GT(num_io_threads, 0);
+    SHERPA_CHECK_GT(batch_size, 0);
+
+    DecodeManifest(&recognizer,
+                   config.feat_config.fbank_opts.frame_opts.frame_shift_ms,
+                   manifest_in, manifest_out, batch_size, num_io_threads,
+                   archive_writer.get());
+    return 0;
+  }
+
   if (use_wav_scp) {
     SHERPA_CHECK_EQ(po.NumArgs(), 2)
         << "Please use something like:\n"
@@ -295,25 +612,110 @@ int main(int argc, char *argv[]) {
     std::cerr << "\nfilename: " << po.GetArg(1) << "\ntext: " << r.text
               << "\ntoken IDs: " << r.tokens
               << "\ntimestamps (after subsampling): " << r.timestamps << "\n";
+
+    if (archive_writer) {
+      archive_writer->Write(po.GetArg(1), r);
+      archive_writer->Flush();
+    }
   } else {
-    std::vector<std::unique_ptr<sherpa::OfflineStream>> ss;
-    std::vector<sherpa::OfflineStream *> p_ss;
-    for (int32_t i = 1; i <= po.NumArgs(); ++i) {
-      auto s = recognizer.CreateStream();
-      s->AcceptWaveFile(po.GetArg(i));
-      ss.push_back(std::move(s));
-      p_ss.push_back(ss.back().get());
+    // Multi-file pipeline: --num-io-threads workers read and featurize
+    // the wave files and push the prepared streams into a bounded
+    // queue; this thread consumes them in batches of --batch-size and
+    // prints each result as soon as its batch finishes. File reading
+    // and feature extraction overlap decoding, and memory is bounded by
+    // the queue capacity instead of the total input size. Batches of
+    // similar-length utterances are formed inside DecodeStreams() when
+    // --max-padding-ratio is set.
+    SHERPA_CHECK_GT(num_io_threads, 0);
+    SHERPA_CHECK_GT(batch_size, 0);
+
+    struct PreparedStream {
+      int32_t arg_index;
+      std::unique_ptr<sherpa::OfflineStream> stream;
+    };
+
+    std::mutex mutex;
+    std::condition_variable producer_cv;
+    std::condition_variable consumer_cv;
+    std::deque<PreparedStream> queue;
+    const size_t queue_capacity = 4 * static_cast<size_t>(batch_size);
+    std::atomic<int32_t> next_arg{1};
+    int32_t num_active_producers = num_io_threads;
+
+    auto producer = [&]() {
+      torch::NoGradGuard no_grad;
+
+      while (true) {
+        int32_t i = next_arg.fetch_add(1);
+        if (i > po.NumArgs()) {
+          break;
+        }
+
+        auto s = recognizer.CreateStream();
+        s->AcceptWaveFile(po.GetArg(i));
+
+        std::unique_lock<std::mutex> lock(mutex);
+        producer_cv.wait(lock, [&] { return queue.size() < queue_capacity; });
+        queue.push_back({i, std::move(s)});
+        consumer_cv.notify_one();
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--num_active_producers == 0) {
+        consumer_cv.notify_one();
+      }
+    };
+
+    std::vector<std::thread> io_threads;
+    io_threads.reserve(num_io_threads);
+    for (int32_t i = 0; i != num_io_threads; ++i) {
+      io_threads.emplace_back(producer);
     }
-    recognizer.DecodeStreams(p_ss.data(), p_ss.size());
-    std::ostringstream os;
-    for (int32_t i = 0; i < po.NumArgs(); ++i) {
-      const auto &r = ss[i]->GetResult();
-      os << "filename: " << po.GetArg(i + 1) << "\n"
-         << "result: " << r.text << "\n"
-         << r.AsJsonString() << "\n\n";
+
+    while (true) {
+      std::vector<PreparedStream> batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        consumer_cv.wait(lock, [&] {
+          return !queue.empty() || num_active_producers == 0;
+        });
+        if (queue.empty()) {
+          break;  // all producers are done
+        }
+
+        while (!queue.empty() &&
+               static_cast<int32_t>(batch.size()) < batch_size) {
+          batch.push_back(std::move(queue.front()));
+          queue.pop_front();
+        }
+      }
+      producer_cv.notify_all();
+
+      std::vector<sherpa::OfflineStream *> p_ss(batch.size());
+      for (size_t i = 0; i != batch.size(); ++i) {
+        p_ss[i] = batch[i].stream.get();
+      }
+      recognizer.DecodeStreams(p_ss.data(), p_ss.size());
+
+      for (const auto &b : batch) {
+        const auto &r = b.stream->GetResult();
+        std::cout << "filename: " << po.GetArg(b.arg_index) << "\n"
+                  << "result: " << r.text << "\n"
+                  << r.AsJsonString() << "\n\n";
+
+        if (archive_writer) {
+          archive_writer->Write(po.GetArg(b.arg_index), r);
+        }
+      }
+      std::cout.flush();
+      if (archive_writer) {
+        archive_writer->Flush();
+      }
     }
 
-    SHERPA_LOG(INFO) << "\n" << os.str();
+    for (auto &t : io_threads) {
+      t.join();
+    }
   }
 
   return 0;
@@ -17,6 +17,11 @@
  */
 #include <signal.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
 #include "portaudio.h"  // NOLINT
 #include "sherpa/cpp_api/online-recognizer.h"
 #include "sherpa/cpp_api/online-stream.h"
@@ -107,6 +112,76 @@ class Microphone {
   }
 };
 
+// Single-producer single-consumer lock-free ring of audio samples.
+//
+// The PortAudio callback (the producer) runs on a real-time audio
+// thread, so it must not lock, allocate, or run feature extraction; it
+// only does a bounded memcpy in here. The decode loop (the consumer)
+// drains the ring and feeds the recognizer. head_ and tail_ are
+// monotonically increasing sample counts; the buffer index is their
+// lower bits.
+class CaptureRing {
+ public:
+  // capacity is rounded up to a power of two (in samples).
+  explicit CaptureRing(int32_t capacity) {
+    int32_t n = 1;
+    while (n < capacity) {
+      n <<= 1;
+    }
+    buffer_.resize(n);
+    mask_ = n - 1;
+  }
+
+  // Called only from the audio callback. Samples that do not fit are
+  // dropped (and counted) instead of blocking the audio thread; the
+  // ring holds several seconds, so that happens only if the decode
+  // loop has stalled.
+  void Write(const float *samples, int32_t n) {
+    int64_t head = head_.load(std::memory_order_acquire);
+    int64_t tail = tail_.load(std::memory_order_relaxed);
+    int32_t free_samples =
+        static_cast<int32_t>(buffer_.size() - (tail - head));
+    int32_t todo = std::min(n, free_samples);
+
+    int32_t pos = static_cast<int32_t>(tail & mask_);
+    int32_t first = std::min(todo, static_cast<int32_t>(buffer_.size()) - pos);
+    std::memcpy(&buffer_[pos], samples, first * sizeof(float));
+    std::memcpy(&buffer_[0], samples + first, (todo - first) * sizeof(float));
+
+    tail_.store(tail + todo, std::memory_order_release);
+    if (todo != n) {
+      dropped_.fetch_add(n - todo, std::memory_order_relaxed);
+    }
+  }
+
+  // Called only from the decode loop. Returns the number of samples
+  // copied into out, at most max_samples.
+  int32_t Read(float *out, int32_t max_samples) {
+    int64_t head = head_.load(std::memory_order_relaxed);
+    int64_t tail = tail_.load(std::memory_order_acquire);
+    int32_t todo = std::min(max_samples, static_cast<int32_t>(tail - head));
+
+    int32_t pos = static_cast<int32_t>(head & mask_);
+    int32_t first = std::min(todo, static_cast<int32_t>(buffer_.size()) - pos);
+    std::memcpy(out, &buffer_[pos], first * sizeof(float));
+    std::memcpy(out + first, &buffer_[0], (todo - first) * sizeof(float));
+
+    head_.store(head + todo, std::memory_order_release);
+    return todo;
+  }
+
+  int64_t NumDropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::vector<float> buffer_;
+  int32_t mask_;
+  std::atomic<int64_t> head_{0};  // next sample to read
+  std::atomic<int64_t> tail_{0};  // next sample to write
+  std::atomic<int64_t> dropped_{0};
+};
+
 bool stop = false;
 
 static int RecordCallback(const void *input_buffer, void * /*output_buffer*/,
@@ -114,12 +189,9 @@ static int RecordCallback(const void *input_buffer, void * /*output_buffer*/,
                           const PaStreamCallbackTimeInfo * /*time_info*/,
                           PaStreamCallbackFlags /*status_flags*/,
                           void *user_data) {
-  auto s = reinterpret_cast<sherpa::OnlineStream *>(user_data);
-  auto samples =
-      torch::from_blob(static_cast<float *>(const_cast<void *>(input_buffer)),
-                       {static_cast<int>(frames_per_buffer)}, torch::kFloat);
-
-  s->AcceptWaveform(16000, samples);
+  auto ring = reinterpret_cast<CaptureRing *>(user_data);
+  ring->Write(static_cast<const float *>(input_buffer),
+              static_cast<int32_t>(frames_per_buffer));
 
   return stop ? paComplete : paContinue;
 }
@@ -146,6 +218,13 @@ int main(int argc, char *argv[]) {
   sherpa::OnlineRecognizerConfig config;
   config.Register(&po);
 
+  int32_t frames_per_callback = 0;
+  po.Register("frames-per-callback", &frames_per_callback,
+              "Number of sample frames PortAudio delivers per capture "
+              "callback. Smaller values reduce the buffering latency "
+              "before audio reaches the recognizer (64 is 4 ms at "
+              "16 kHz); 0 lets PortAudio choose.");
+
   po.Read(argc, argv);
   if (argc == 0 || po.NumArgs() != 0) {
     po.PrintUsage();
@@ -153,6 +232,11 @@ int main(int argc, char *argv[]) {
   }
 
   config.Validate();
+  if (frames_per_callback < 0) {
+    std::cerr << "Invalid --frames-per-callback: " << frames_per_callback
+              << "\n";
+    exit(EXIT_FAILURE);
+  }
 
   float sample_rate = 16000;
   if (config.feat_config.fbank_opts.frame_opts.samp_freq != sample_rate) {
@@ -166,6 +250,10 @@ int main(int argc, char *argv[]) {
 
   auto s = recognizer.CreateStream();
 
+  // 8 seconds of capture slack between the audio thread and the decode
+  // loop; far more than a decode iteration ever takes.
+  CaptureRing ring(8 * static_cast<int32_t>(sample_rate));
+
   PaDeviceIndex num_devices = Pa_GetDeviceCount();
   fprintf(stderr, "num devices: %d\n", num_devices);
 
@@ -191,11 +279,10 @@ int main(int argc, char *argv[]) {
   PaStream *stream;
   PaError err =
       Pa_OpenStream(&stream, &param, nullptr, /* &outputParameters, */
-                    sample_rate,
-                    0,          // frames per buffer
+                    sample_rate, frames_per_callback,
                     paClipOff,  // we won't output out of range samples
                                 // so don't bother clipping them
-                    RecordCallback, s.get());
+                    RecordCallback, &ring);
   if (err != paNoError) {
     fprintf(stderr, "portaudio error: %s\n", Pa_GetErrorText(err));
     exit(EXIT_FAILURE);
@@ -209,8 +296,22 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  // The decode loop drains the capture ring, runs feature extraction
+  // and decodes; the audio callback itself only copies samples. It
+  // sleeps only when there is neither audio to drain nor a chunk ready
+  // to decode, so captured audio reaches AcceptWaveform with at most a
+  // few milliseconds of loop slack on top of the callback size.
+  std::vector<float> chunk(static_cast<int32_t>(sample_rate));
   int32_t result_len = 0;
   while (!stop) {
+    int32_t num_samples =
+        ring.Read(chunk.data(), static_cast<int32_t>(chunk.size()));
+    if (num_samples > 0) {
+      auto samples =
+          torch::from_blob(chunk.data(), {num_samples}, torch::kFloat);
+      s->AcceptWaveform(sample_rate, samples.clone());
+    }
+
     if (recognizer.IsReady(s.get())) {
       recognizer.DecodeStream(s.get());
       auto result = recognizer.GetResult(s.get()).text;
@@ -218,9 +319,14 @@ int main(int argc, char *argv[]) {
         result_len = result.size();
         fprintf(stderr, "%s\n", result.c_str());
       }
+    } else if (num_samples == 0) {
+      Pa_Sleep(2);  // sleep for 2ms
     }
+  }
 
-    Pa_Sleep(20);  // sleep for 20ms
+  if (ring.NumDropped() > 0) {
+    fprintf(stderr, "Dropped %ld captured samples\n",
+            static_cast<long>(ring.NumDropped()));  // NOLINT
   }
 
   err = Pa_CloseStream(stream);
@@ -0,0 +1,65 @@
+// sherpa/cpp_api/bin/result-archive-tool.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include <iostream>
+#include <string>
+
+#include "sherpa/cpp_api/parse-options.h"
+#include "sherpa/cpp_api/result-archive.h"
+
+static constexpr const char *kUsageMessage = R"(
+Inspect a result archive written with --result-archive.
+
+Usage:
+(1) List the keys in an archive
+
+  ./bin/sherpa-result-archive --list-keys=true results.sra
+
+(2) Dump every record as jsonl to stdout, one {"key": ..., "result": ...}
+    object per line
+
+  ./bin/sherpa-result-archive results.sra
+
+(3) Print the JSON results for the given keys
+
+  ./bin/sherpa-result-archive results.sra foo.wav bar.wav
+)";
+
+int main(int argc, char *argv[]) {
+  bool list_keys = false;
+
+  sherpa::ParseOptions po(kUsageMessage);
+  po.Register("list-keys", &list_keys,
+              "If true, print only the keys, one per line.");
+
+  po.Read(argc, argv);
+  if (po.NumArgs() < 1) {
+    po.PrintUsage();
+    exit(EXIT_FAILURE);
+  }
+
+  sherpa::ResultArchiveReader reader(po.GetArg(1));
+
+  if (list_keys) {
+    for (const auto &key : reader.Keys()) {
+      std::cout << key << "\n";
+    }
+    return 0;
+  }
+
+  if (po.NumArgs() > 1) {
+    for (int32_t i = 2; i <= po.NumArgs(); ++i) {
+      // Get() exits with an error message if the key is missing
+      std::cout << reader.Get(po.GetArg(i)) << "\n";
+    }
+    return 0;
+  }
+
+  for (const auto &key : reader.Keys()) {
+    std::cout << "{\"key\": \"" << key << "\", \"result\": "
+              << reader.Get(key) << "}\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,125 @@
+// sherpa/cpp_api/bin/slow-batch-replay.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include <chrono>  // NOLINT
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#include "sherpa/cpp_api/online-recognizer.h"
+#include "sherpa/cpp_api/parse-options.h"
+#include "sherpa/csrc/log.h"
+#include "torch/csrc/jit/serialization/pickle.h"
+#include "torch/script.h"
+
+static constexpr const char *kUsageMessage = R"(
+Re-execute a slow-batch capture of the online websocket server against
+the model, for profiling.
+
+The server writes a capture whenever a decode misses its tick deadline;
+see --capture-slow-batches-file of sherpa-online-websocket-server. This
+tool loads one capture, prints its batch composition and runs the exact
+feature batch through the model repeatedly, so the pathological forward
+can be studied in isolation (e.g., under nsys or perf) without the
+serving traffic around it.
+
+Usage:
+
+  ./bin/sherpa-slow-batch-replay \
+    --nn-model=/path/to/cpu_jit.pt \
+    --tokens=/path/to/tokens.txt \
+    --use-gpu=true \
+    --num-iterations=50 \
+    capture.3.pt
+
+Pass the model options of the server that wrote the capture; a capture
+from an --extra-models stream must be replayed against that model.
+)";
+
+int main(int argc, char *argv[]) {
+  // see
+  // https://pytorch.org/docs/stable/notes/cpu_threading_torchscript_inference.html
+  torch::set_num_threads(1);
+  torch::set_num_interop_threads(1);
+  torch::NoGradGuard no_grad;
+
+  torch::jit::getExecutorMode() = false;
+  torch::jit::getProfilingMode() = false;
+  torch::jit::setGraphExecutorOptimize(false);
+
+  int32_t num_iterations = 30;
+
+  sherpa::ParseOptions po(kUsageMessage);
+  po.Register("num-iterations", &num_iterations,
+              "Number of times the captured batch is re-executed; the "
+              "reported time is the average over them.");
+
+  sherpa::OnlineRecognizerConfig config;
+  config.Register(&po);
+
+  po.Read(argc, argv);
+  if (po.NumArgs() != 1) {
+    po.PrintUsage();
+    exit(EXIT_FAILURE);
+  }
+
+  config.Validate();
+  SHERPA_CHECK_GT(num_iterations, 0);
+
+  std::ifstream is(po.GetArg(1), std::ios::binary);
+  if (!is) {
+    SHERPA_LOG(FATAL) << "Failed to open " << po.GetArg(1);
+  }
+  std::vector<char> data((std::istreambuf_iterator<char>(is)),
+                         std::istreambuf_iterator<char>());
+
+  // The record layout is written by
+  // OnlineWebsocketDecoder::SaveSlowBatch().
+  auto record = torch::jit::pickle_load(data).toTuple();
+  torch::Tensor features = record->elements()[0].toTensor();
+  double decode_seconds = record->elements()[1].toDouble();
+  double deadline_seconds = record->elements()[2].toDouble();
+  int64_t replica = record->elements()[3].toInt();
+  auto slots = record->elements()[4].toList();
+
+  std::ostringstream os;
+  os << "Captured batch: " << features.size(0) << " stream(s) of "
+     << features.size(1) << " frames x " << features.size(2)
+     << " mel bins, decoded on replica " << replica << " in "
+     << decode_seconds << "s (deadline: " << deadline_seconds << "s)\n";
+  for (size_t i = 0; i != slots.size(); ++i) {
+    const auto &fields = slots.get(i).toTuple()->elements();
+    os << "  slot " << i << ": model " << fields[0].toInt()
+       << ", processed frames " << fields[1].toInt()
+       << (fields[2].toBool() ? ", bulk" : "") << ", state bytes "
+       << fields[3].toInt() << "\n";
+  }
+  std::cerr << os.str();
+
+  sherpa::OnlineRecognizer recognizer(config);
+
+  // The warmup of the constructor has already compiled the kernels for
+  // this batch size if it is listed in --warmup-batch-sizes; one extra
+  // untimed run covers the case where it is not.
+  recognizer.RunForward(features);
+
+  auto begin = std::chrono::steady_clock::now();
+  for (int32_t i = 0; i != num_iterations; ++i) {
+    recognizer.RunForward(features);
+  }
+  double average =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - begin)
+          .count() /
+      num_iterations;
+
+  std::cerr << "Average forward time over " << num_iterations
+            << " iteration(s): " << average << "s"
+            << (average > deadline_seconds ? " -- still over the deadline"
+                                           : "")
+            << "\n";
+
+  return 0;
+}
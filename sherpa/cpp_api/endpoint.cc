@@ -100,4 +100,31 @@ bool Endpoint::IsEndpoint(int num_frames_decoded, int trailing_silence_frames,
   return false;
 }
 
+void Endpoint::IsEndpointBatch(const int32_t *num_frames_decoded,
+                               const int32_t *trailing_silence_frames,
+                               int32_t n, float frame_shift_in_seconds,
+                               bool *is_endpoint) const {
+  const EndpointRule &r1 = config_.rule1;
+  const EndpointRule &r2 = config_.rule2;
+  const EndpointRule &r3 = config_.rule3;
+
+  for (int32_t i = 0; i != n; ++i) {
+    float utterance_length = num_frames_decoded[i] * frame_shift_in_seconds;
+    float trailing_silence = trailing_silence_frames[i] * frame_shift_in_seconds;
+    bool contain_nonsilence = utterance_length > trailing_silence;
+
+    bool a1 = (contain_nonsilence || !r1.must_contain_nonsilence) &&
+              trailing_silence >= r1.min_trailing_silence &&
+              utterance_length >= r1.min_utterance_length;
+    bool a2 = (contain_nonsilence || !r2.must_contain_nonsilence) &&
+              trailing_silence >= r2.min_trailing_silence &&
+              utterance_length >= r2.min_utterance_length;
+    bool a3 = (contain_nonsilence || !r3.must_contain_nonsilence) &&
+              trailing_silence >= r3.min_trailing_silence &&
+              utterance_length >= r3.min_utterance_length;
+
+    is_endpoint[i] = a1 || a2 || a3;
+  }
+}
+
 }  // namespace sherpa
@@ -45,6 +45,37 @@ void FeatureConfig::Register(ParseOptions *po) {
                "false to use samples in the range [-32768, 32767]. "
                "Note: kaldi uses un-normalized samples.");
 
+  po->Register("async-feature-computation", &async_feature_computation,
+               "true to compute features on a background thread per stream "
+               "so that AcceptWaveform() never blocks the calling thread. "
+               "Only relevant for streaming recognition.");
+
+  po->Register("feature-cache-dir", &feature_cache_dir,
+               "If non-empty, cache computed fbank features for wave files "
+               "in this directory and reuse them on the next run. The "
+               "directory must exist. Only used for offline recognition.");
+
+  po->Register("feature-service", &feature_service,
+               "If non-empty, shm name prefix of a host-wide feature "
+               "service, e.g., /sherpa-features. Wave samples are sent "
+               "to a sherpa-feature-service process on this host instead "
+               "of computing fbank locally, so all recognizer processes "
+               "on the machine share one feature extraction pool. The "
+               "service must be started with the same feature options. "
+               "Only used for offline recognition.");
+
+  po->Register("streaming-cmvn", &streaming_cmvn,
+               "true to apply streaming cepstral mean and variance "
+               "normalization to the features of each stream, using "
+               "per-stream exponential moving statistics. Applied on the "
+               "device to the batched features. Only used for streaming "
+               "recognition.");
+
+  po->Register("streaming-cmvn-decay", &streaming_cmvn_decay,
+               "Used only with --streaming-cmvn. Per-frame decay of the "
+               "exponential moving statistics; values closer to 1 average "
+               "over a longer history.");
+
   po->Register(
       "nemo-normalize", &nemo_normalize,
       "See "
@@ -58,6 +89,12 @@ std::string FeatureConfig::ToString() const {
   os << "FeatureConfig(";
   os << "fbank_opts=" << fbank_opts.ToString() << ", ";
   os << "normalize_samples=" << (normalize_samples ? "True" : "False") << ", ";
+  os << "async_feature_computation="
+     << (async_feature_computation ? "True" : "False") << ", ";
+  os << "feature_cache_dir=\"" << feature_cache_dir << "\", ";
+  os << "feature_service=\"" << feature_service << "\", ";
+  os << "streaming_cmvn=" << (streaming_cmvn ? "True" : "False") << ", ";
+  os << "streaming_cmvn_decay=" << streaming_cmvn_decay << ", ";
   os << "nemo_normalize=\"" << nemo_normalize << "\")";
   return os.str();
 }
@@ -31,6 +31,46 @@ struct FeatureConfig {
   // load a Wav2Vec 2.0 model.
   bool return_waveform = false;
 
+  // If true, each OnlineStream computes its features on a background
+  // worker thread: AcceptWaveform() only enqueues the samples and
+  // returns immediately, so the caller's I/O thread never blocks on
+  // feature extraction. The websocket servers already off-load feature
+  // computation to their own worker pool, so this is mainly useful when
+  // you call AcceptWaveform() directly from a latency-sensitive thread.
+  bool async_feature_computation = false;
+
+  // If non-empty, OfflineStream::AcceptWaveFile() caches computed fbank
+  // matrices in this directory, keyed by a hash of the wave file content
+  // and of the feature settings. Decoding the same corpus again loads
+  // the precomputed features instead of re-running feature extraction.
+  // The directory must exist. It is ignored when return_waveform is
+  // true.
+  std::string feature_cache_dir;
+
+  // If non-empty, shm name prefix of a host-wide feature service, e.g.,
+  // "/sherpa-features"; OfflineStream then sends wave samples to a
+  // sherpa-feature-service process on this host instead of computing
+  // fbank itself, so all recognizer processes on the machine share one
+  // feature extraction pool. The service must be started with the same
+  // feature options. Only used for offline recognition; see
+  // sherpa/csrc/feature-service.h.
+  std::string feature_service;
+
+  // If true, apply streaming cepstral mean and variance normalization
+  // to the features of each OnlineStream. Every stream keeps
+  // exponential moving mean/variance statistics of its own features;
+  // the normalization is applied to the batched feature tensor on the
+  // device as one fused scale-shift inside DecodeStreams(), so no extra
+  // CPU pass over the features is needed. Only used for streaming
+  // recognition.
+  bool streaming_cmvn = false;
+
+  // Used only with streaming_cmvn. Per-frame decay of the exponential
+  // moving statistics; values closer to 1 average over a longer
+  // history. With frame_shift_ms = 10, the default corresponds to a
+  // time constant of roughly 10 seconds.
+  float streaming_cmvn_decay = 0.999;
+
   // For models from NeMo
   // Possible values:
   // - per_feature
@@ -5,6 +5,7 @@
 #ifndef SHERPA_CPP_API_OFFLINE_RECOGNIZER_CTC_IMPL_H_
 #define SHERPA_CPP_API_OFFLINE_RECOGNIZER_CTC_IMPL_H_
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <utility>
@@ -13,38 +14,38 @@
 #include "sherpa/cpp_api/feature-config.h"
 #include "sherpa/cpp_api/offline-recognizer-impl.h"
 #include "sherpa/csrc/log.h"
+#include "sherpa/csrc/mmap-read-adapter.h"
 #include "sherpa/csrc/offline-conformer-ctc-model.h"
 #include "sherpa/csrc/offline-ctc-decoder.h"
 #include "sherpa/csrc/offline-ctc-model.h"
 #include "sherpa/csrc/offline-ctc-one-best-decoder.h"
+#include "sherpa/csrc/offline-ctc-prefix-beam-search-decoder.h"
 #include "sherpa/csrc/offline-nemo-enc-dec-ctc-model-bpe.h"
 #include "sherpa/csrc/offline-wav2vec2-ctc-model.h"
 #include "sherpa/csrc/offline-wenet-conformer-ctc-model.h"
 #include "sherpa/csrc/symbol-table.h"
+#include "sherpa/csrc/text-utils.h"
 
 namespace sherpa {
 
-static OfflineRecognitionResult Convert(const OfflineCtcDecoderResult &src,
-                                        const SymbolTable &sym_table,
-                                        int32_t frame_shift_ms,
-                                        int32_t subsampling_factor) {
+static OfflineRecognitionResult Convert(
+    const OfflineCtcDecoderResult &src,
+    std::shared_ptr<const SymbolTable> sym_table, int32_t frame_shift_ms,
+    int32_t subsampling_factor, bool lazy_text) {
   OfflineRecognitionResult r;
-  r.tokens.reserve(src.tokens.size());
-  r.timestamps.reserve(src.timestamps.size());
-
-  std::string text;
-  for (auto i : src.tokens) {
-    auto sym = sym_table[i];
-    text.append(sym);
+  r.token_ids = src.tokens;
+  r.symbol_table = std::move(sym_table);
 
-    r.tokens.push_back(std::move(sym));
+  r.frame_shift_s = frame_shift_ms / 1000. * subsampling_factor;
+  r.timestamps.reserve(src.timestamps.size());
+  for (auto t : src.timestamps) {
+    r.timestamps.push_back(r.frame_shift_s * t);
   }
-  r.text = std::move(text);
 
-  float frame_shift_s = frame_shift_ms / 1000. * subsampling_factor;
-  for (auto t : src.timestamps) {
-    float time = frame_shift_s * t;
-    r.timestamps.push_back(time);
+  // text and tokens derive from the token ids; with --lazy-text the
+  // string work is skipped entirely and left to MaterializeText().
+  if (!lazy_text) {
+    r.MaterializeText();
   }
 
   return r;
@@ -54,7 +55,7 @@ class OfflineRecognizerCtcImpl : public OfflineRecognizerImpl {
  public:
   explicit OfflineRecognizerCtcImpl(const OfflineRecognizerConfig &config)
       : config_(config),
-        symbol_table_(config.tokens),
+        symbol_table_(std::make_shared<SymbolTable>(config.tokens)),
         fbank_(config.feat_config.fbank_opts),
         device_(torch::kCPU) {
     config.ctc_decoder_config.Validate();
@@ -63,7 +64,7 @@ class OfflineRecognizerCtcImpl : public OfflineRecognizerImpl {
       device_ = torch::Device("cuda:0");
     }
 
-    torch::jit::Module m = torch::jit::load(config.nn_model, torch::kCPU);
+    torch::jit::Module m = LoadModule(config.nn_model, torch::kCPU);
     // We currently support: icefall, wenet, torchaudio.
     std::string class_name = m.type()->name()->name();
     if (class_name == "ASRModel") {
@@ -82,7 +83,10 @@ class OfflineRecognizerCtcImpl : public OfflineRecognizerImpl {
       model_ =
           std::make_unique<OfflineWav2Vec2CtcModel>(config.nn_model, device_);
       config_.feat_config.return_waveform = true;
-      symbol_table_.Replace(symbol_table_["|"], " ", "|");
+      return_waveform_ = true;
+      // This happens in the constructor, before any result can hold a
+      // reference to the table, so sharing it afterwards is safe.
+      symbol_table_->Replace((*symbol_table_)["|"], " ", "|");
       // See Section 4.2 of
       // https://arxiv.org/pdf/2006.11477.pdf
       config_.feat_config.fbank_opts.frame_opts.frame_shift_ms = 20;
@@ -127,8 +131,13 @@ class OfflineRecognizerCtcImpl : public OfflineRecognizerImpl {
 
     WarmUp();
 
-    decoder_ = std::make_unique<OfflineCtcOneBestDecoder>(
-        config.ctc_decoder_config, device_, model_->VocabSize());
+    if (config.ctc_decoder_config.decoding_method == "prefix_beam_search") {
+      decoder_ = std::make_unique<OfflineCtcPrefixBeamSearchDecoder>(
+          config.ctc_decoder_config.num_active_paths);
+    } else {
+      decoder_ = std::make_unique<OfflineCtcOneBestDecoder>(
+          config.ctc_decoder_config, device_, model_->VocabSize());
+    }
   }
 
   std::unique_ptr<OfflineStream> CreateStream() override {
@@ -136,6 +145,48 @@ class OfflineRecognizerCtcImpl : public OfflineRecognizerImpl {
   }
 
   void DecodeStreams(OfflineStream **ss, int32_t n) override {
+    if (n <= 1 || config_.max_padding_ratio >= 1) {
+      DecodeStreamsInternal(ss, n);
+      return;
+    }
+
+    // Length bucketing: sort the streams by length and cut the batch
+    // whenever padding would exceed --max-padding-ratio of the encoder
+    // input. The rows counted here are whatever the stream stores: fbank
+    // frames for most models, but raw samples for wav2vec 2.0, so its
+    // buckets resolve at sample granularity -- padding waste there is
+    // paid per sample (16k rows a second instead of 100), which makes
+    // mixed-length waveform batches far more expensive than mixed-length
+    // fbank batches. Results are written to the streams, so the caller
+    // is unaffected by the reordering.
+    std::vector<OfflineStream *> sorted(ss, ss + n);
+    std::sort(sorted.begin(), sorted.end(),
+              [](OfflineStream *a, OfflineStream *b) {
+                return a->GetFeatures().size(0) < b->GetFeatures().size(0);
+              });
+
+    int32_t begin = 0;
+    int64_t sum_len = 0;
+    for (int32_t i = 0; i != n; ++i) {
+      int64_t len = sorted[i]->GetFeatures().size(0);
+      sum_len += len;
+      int32_t count = i - begin + 1;
+
+      // Lengths are sorted, so `len` is the longest in the current bucket.
+      float padding_ratio =
+          1.0f - static_cast<float>(sum_len) / (static_cast<float>(len) *
+                                                count);
+      if (count > 1 && padding_ratio > config_.max_padding_ratio) {
+        DecodeStreamsInternal(sorted.data() + begin, count - 1);
+        begin = i;
+        sum_len = len;
+      }
+    }
+
+    DecodeStreamsInternal(sorted.data() + begin, n - begin);
+  }
+
+  void DecodeStreamsInternal(OfflineStream **ss, int32_t n) {
     torch::NoGradGuard no_grad;
 
     std::vector<torch::Tensor> features_vec(n);
@@ -173,7 +224,7 @@ class OfflineRecognizerCtcImpl : public OfflineRecognizerImpl {
       ss[i]->SetResult(
           Convert(results[i], symbol_table_,
                   config_.feat_config.fbank_opts.frame_opts.frame_shift_ms,
-                  model_->SubsamplingFactor()));
+                  model_->SubsamplingFactor(), config_.lazy_text));
     }
   }
 
@@ -184,20 +235,28 @@ class OfflineRecognizerCtcImpl : public OfflineRecognizerImpl {
     float sample_rate = fbank_.GetFrameOptions().samp_freq;
     std::vector<float> samples(2 * sample_rate, 0);
     s->AcceptSamples(samples.data(), samples.size());
-    auto features = s->GetFeatures();
-    auto features_length = torch::tensor({features.size(0)});
-    features = features.unsqueeze(0);
+    auto features = s->GetFeatures().unsqueeze(0).to(device_);
 
-    features = features.to(device_);
-    features_length = features_length.to(device_);
+    // Run one forward for every batch size production traffic will use,
+    // so the first real batch of each size does not trigger lazy kernel
+    // selection or allocator growth.
+    for (auto n : SplitStringToIntegers(config_.warmup_batch_sizes)) {
+      auto batch = features.repeat({n, 1, 1});
+      auto batch_length =
+          torch::full({n}, features.size(1), torch::kLong).to(device_);
 
-    model_->WarmUp(features, features_length);
+      model_->WarmUp(batch, batch_length);
+    }
     SHERPA_LOG(INFO) << "WarmUp ended";
   }
 
  private:
   OfflineRecognizerConfig config_;
-  SymbolTable symbol_table_;
+
+  // Held via shared_ptr so every result can carry a reference to it;
+  // see OfflineRecognitionResult::symbol_table.
+  std::shared_ptr<SymbolTable> symbol_table_;
+
   std::unique_ptr<OfflineCtcModel> model_;
   std::unique_ptr<OfflineCtcDecoder> decoder_;
   kaldifeat::Fbank fbank_;
@@ -5,6 +5,9 @@
 #ifndef SHERPA_CPP_API_OFFLINE_RECOGNIZER_TRANSDUCER_IMPL_H_
 #define SHERPA_CPP_API_OFFLINE_RECOGNIZER_TRANSDUCER_IMPL_H_
 
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cmath>
 #include <memory>
 #include <string>
 #include <utility>
@@ -12,54 +15,106 @@
 
 #include "sherpa/cpp_api/feature-config.h"
 #include "sherpa/cpp_api/offline-recognizer-impl.h"
+#include "sherpa/csrc/ngram-lm.h"
+#include "sherpa/csrc/nvtx.h"
 #include "sherpa/csrc/offline-conformer-transducer-model.h"
 #include "sherpa/csrc/offline-transducer-decoder.h"
 #include "sherpa/csrc/offline-transducer-fast-beam-search-decoder.h"
 #include "sherpa/csrc/offline-transducer-greedy-search-decoder.h"
 #include "sherpa/csrc/offline-transducer-model.h"
 #include "sherpa/csrc/offline-transducer-modified-beam-search-decoder.h"
+#ifdef SHERPA_ENABLE_TRT
+#include "sherpa/csrc/offline-trt-transducer-model.h"
+#endif
+#include "sherpa/csrc/pinned-staging.h"
 #include "sherpa/csrc/symbol-table.h"
+#include "sherpa/csrc/text-utils.h"
 
 namespace sherpa {
 
 static OfflineRecognitionResult Convert(
-    const OfflineTransducerDecoderResult &src, const SymbolTable &sym_table,
-    int32_t frame_shift_ms, int32_t subsampling_factor) {
+    const OfflineTransducerDecoderResult &src,
+    std::shared_ptr<const SymbolTable> sym_table, int32_t frame_shift_ms,
+    int32_t subsampling_factor, bool lazy_text) {
   OfflineRecognitionResult r;
-  r.tokens.reserve(src.tokens.size());
-  r.timestamps.reserve(src.timestamps.size());
+  r.token_ids = src.tokens;
+  r.symbol_table = std::move(sym_table);
 
-  std::string text;
-  for (auto i : src.tokens) {
-    auto sym = sym_table[i];
-    text.append(sym);
+  r.frame_shift_s = frame_shift_ms / 1000. * subsampling_factor;
+  r.timestamps.reserve(src.timestamps.size());
+  for (auto t : src.timestamps) {
+    r.timestamps.push_back(r.frame_shift_s * t);
+  }
 
-    r.tokens.push_back(std::move(sym));
+  if (!src.token_log_probs.empty()) {
+    r.token_confidences.reserve(src.token_log_probs.size());
+    float sum = 0;
+    for (auto p : src.token_log_probs) {
+      float c = std::exp(p);
+      r.token_confidences.push_back(c);
+      sum += c;
+    }
+    r.confidence = sum / src.token_log_probs.size();
   }
-  r.text = std::move(text);
 
-  float frame_shift_s = frame_shift_ms / 1000. * subsampling_factor;
-  for (auto t : src.timestamps) {
-    float time = frame_shift_s * t;
-    r.timestamps.push_back(time);
+  // text, tokens and the word-level segmentation all derive from the
+  // token ids; with --lazy-text the string work is skipped entirely and
+  // left to MaterializeText().
+  if (!lazy_text) {
+    r.MaterializeText();
   }
 
   return r;
 }
 
+/** Return the fbank options to use for the given config.
+ *
+ * When the GPU is used, the fbank computer is placed on it as well, so
+ * raw waves are uploaded once and the features stay device-resident
+ * straight into RunEncoder instead of being computed on the CPU while
+ * the GPU waits.
+ */
+static kaldifeat::FbankOptions GetFbankOptions(
+    const OfflineRecognizerConfig &config) {
+  auto opts = config.feat_config.fbank_opts;
+  if (config.use_gpu) {
+    opts.device = torch::Device("cuda:0");
+  }
+  return opts;
+}
+
 class OfflineRecognizerTransducerImpl : public OfflineRecognizerImpl {
  public:
   explicit OfflineRecognizerTransducerImpl(
       const OfflineRecognizerConfig &config)
       : config_(config),
-        symbol_table_(config.tokens),
-        fbank_(config.feat_config.fbank_opts),
+        symbol_table_(std::make_shared<SymbolTable>(config.tokens)),
+        fbank_(GetFbankOptions(config)),
         device_(torch::kCPU) {
     if (config.use_gpu) {
       device_ = torch::Device("cuda:0");
     }
-    model_ = std::make_unique<OfflineConformerTransducerModel>(config.nn_model,
-                                                               device_);
+    if (!config.encoder_trt_engine.empty()) {
+#ifdef SHERPA_ENABLE_TRT
+      model_ = std::make_unique<OfflineTrtTransducerModel>(
+          config.encoder_trt_engine, config.nn_model, device_);
+#else
+      SHERPA_LOG(FATAL) << "--encoder-trt-engine requires a sherpa build "
+                           "with -DSHERPA_ENABLE_TRT=ON";
+#endif
+    } else {
+      auto model = std::make_unique<OfflineConformerTransducerModel>(
+          config.nn_model, device_);
+      if (!config.quantized_decoder_joiner_model.empty()) {
+        model->LoadQuantizedDecoderJoiner(
+            config.quantized_decoder_joiner_model);
+      }
+      model_ = std::move(model);
+    }
+
+    if (config.use_cpu_bf16) {
+      model_->UseBf16();
+    }
 
     WarmUp();
 
@@ -67,8 +122,14 @@ class OfflineRecognizerTransducerImpl : public OfflineRecognizerImpl {
       decoder_ =
           std::make_unique<OfflineTransducerGreedySearchDecoder>(model_.get());
     } else if (config.decoding_method == "modified_beam_search") {
+      if (!config.ngram_lm_arpa.empty()) {
+        ngram_lm_ = std::make_unique<NgramLm>(
+            NgramLm::CompileArpaCached(config.ngram_lm_arpa, *symbol_table_));
+      }
+
       decoder_ = std::make_unique<OfflineTransducerModifiedBeamSearchDecoder>(
-          model_.get(), config.num_active_paths);
+          model_.get(), config.num_active_paths, config.score_gap,
+          ngram_lm_.get(), config.ngram_lm_scale);
     } else if (config.decoding_method == "fast_beam_search") {
       config.fast_beam_search_config.Validate();
 
@@ -88,34 +149,149 @@ class OfflineRecognizerTransducerImpl : public OfflineRecognizerImpl {
   void DecodeStreams(OfflineStream **ss, int32_t n) override {
     torch::NoGradGuard no_grad;
 
-    std::vector<torch::Tensor> features_vec(n);
-    std::vector<int64_t> features_length_vec(n);
+    // Streams with a precomputed encoder output have no features, so
+    // length bucketing does not apply to them.
+    if (n <= 1 || config_.max_padding_ratio >= 1 ||
+        ss[0]->GetEncoderOut().defined()) {
+      DecodeStreamsInternal(ss, n);
+      return;
+    }
+
+    // Length bucketing: sort the streams by feature length and cut the
+    // batch whenever padding would exceed --max-padding-ratio of the
+    // encoder input, so short utterances are not padded to the length of
+    // the longest one in the batch. Results are written to the streams,
+    // so the caller is unaffected by the reordering.
+    std::vector<OfflineStream *> sorted(ss, ss + n);
+    std::sort(sorted.begin(), sorted.end(),
+              [](OfflineStream *a, OfflineStream *b) {
+                return a->GetFeatures().size(0) < b->GetFeatures().size(0);
+              });
+
+    int32_t begin = 0;
+    int64_t sum_len = 0;
     for (int32_t i = 0; i != n; ++i) {
-      const auto &f = ss[i]->GetFeatures();
-      features_vec[i] = f;
-      features_length_vec[i] = f.size(0);
+      int64_t len = sorted[i]->GetFeatures().size(0);
+      sum_len += len;
+      int32_t count = i - begin + 1;
+
+      // Lengths are sorted, so `len` is the longest in the current bucket.
+      float padding_ratio =
+          1.0f - static_cast<float>(sum_len) / (static_cast<float>(len) *
+                                                count);
+      if (count > 1 && padding_ratio > config_.max_padding_ratio) {
+        DecodeStreamsInternal(sorted.data() + begin, count - 1);
+        begin = i;
+        sum_len = len;
+      }
     }
 
-    auto features = torch::nn::utils::rnn::pad_sequence(
-                        features_vec, /*batch_first*/ true,
-                        /*padding_value*/ -23.025850929940457f)
-                        .to(device_);
+    DecodeStreamsInternal(sorted.data() + begin, n - begin);
+  }
 
-    auto features_length = torch::tensor(features_length_vec).to(device_);
+  void DecodeStreamsInternal(OfflineStream **ss, int32_t n) {
+    // The clocks tick even when --collect-timings is false; they cost a
+    // few nanoseconds per batch, which keeps the code free of branches
+    // around every stage.
+    auto batch_begin = std::chrono::steady_clock::now();
+    auto features_done = batch_begin;
+    auto encoder_done = batch_begin;
 
     torch::Tensor encoder_out;
     torch::Tensor encoder_out_length;
 
-    std::tie(encoder_out, encoder_out_length) =
-        model_->RunEncoder(features, features_length);
-    encoder_out_length = encoder_out_length.cpu();
+    if (ss[0]->GetEncoderOut().defined()) {
+      // A second decoding pass: every stream carries a precomputed
+      // encoder output, so the encoder is skipped entirely.
+      std::vector<torch::Tensor> encoder_out_vec(n);
+      std::vector<int64_t> encoder_out_length_vec(n);
+      for (int32_t i = 0; i != n; ++i) {
+        const auto &e = ss[i]->GetEncoderOut();
+        SHERPA_CHECK(e.defined())
+            << "Either all or none of the streams of a batch may have a "
+            << "precomputed encoder output";
+        encoder_out_vec[i] = e;
+        encoder_out_length_vec[i] = e.size(0);
+      }
 
-    auto results = decoder_->Decode(encoder_out, encoder_out_length);
+      encoder_out = torch::nn::utils::rnn::pad_sequence(
+                        encoder_out_vec, /*batch_first*/ true,
+                        /*padding_value*/ 0)
+                        .to(device_);
+      encoder_out_length = torch::tensor(encoder_out_length_vec);
+
+      features_done = encoder_done = std::chrono::steady_clock::now();
+    } else {
+      torch::Tensor features;
+      torch::Tensor features_length;
+
+      {
+        ScopedNvtxRange gather_range("GatherFeatures", n);
+
+        std::vector<torch::Tensor> features_vec(n);
+        std::vector<int64_t> features_length_vec(n);
+        for (int32_t i = 0; i != n; ++i) {
+          const auto &f = ss[i]->GetFeatures();
+          features_vec[i] = f;
+          features_length_vec[i] = f.size(0);
+        }
+
+        features = torch::nn::utils::rnn::pad_sequence(
+                       features_vec, /*batch_first*/ true,
+                       /*padding_value*/ -23.025850929940457f)
+                       .to(device_);
+
+        features_length = torch::tensor(features_length_vec).to(device_);
+      }
+
+      features_done = std::chrono::steady_clock::now();
+
+      ScopedNvtxRange encoder_range("RunEncoder", n);
+      std::tie(encoder_out, encoder_out_length) =
+          model_->RunEncoder(features, features_length);
+      // One async copy into pinned memory plus one stream wait, instead
+      // of .cpu()'s synchronous trip through pageable memory. The wait
+      // synchronizes with the device, so encoder_done really covers the
+      // whole encoder forward.
+      static thread_local PinnedStagingBuffer length_staging;
+      encoder_out_length = length_staging.Stage(encoder_out_length);
+
+      encoder_done = std::chrono::steady_clock::now();
+    }
+
+    std::vector<OfflineTransducerDecoderResult> results;
+    {
+      ScopedNvtxRange decode_range("Decode", n);
+      results = decoder_->Decode(encoder_out, encoder_out_length);
+    }
+
+    auto search_done = std::chrono::steady_clock::now();
     for (int32_t i = 0; i != n; ++i) {
       auto ans =
           Convert(results[i], symbol_table_,
                   config_.feat_config.fbank_opts.frame_opts.frame_shift_ms,
-                  model_->SubsamplingFactor());
+                  model_->SubsamplingFactor(), config_.lazy_text);
+
+      if (config_.return_encoder_out) {
+        // Keep only the valid frames so the tensor can be fed straight
+        // back via SetEncoderOut()
+        ans.encoder_out = encoder_out[i].narrow(
+            0, 0, encoder_out_length[i].item<int64_t>());
+      }
+
+      if (config_.collect_timings) {
+        // Batch-level numbers: every utterance of the batch carries the
+        // same stage times.
+        using FloatSeconds = std::chrono::duration<float>;
+        ans.timings.features =
+            FloatSeconds(features_done - batch_begin).count();
+        ans.timings.encoder = FloatSeconds(encoder_done - features_done)
+                                  .count();
+        ans.timings.search = FloatSeconds(search_done - encoder_done).count();
+        ans.timings.total = FloatSeconds(std::chrono::steady_clock::now() -
+                                         batch_begin)
+                                .count();
+      }
 
       ss[i]->SetResult(ans);
     }
@@ -128,20 +304,33 @@ class OfflineRecognizerTransducerImpl : public OfflineRecognizerImpl {
     float sample_rate = fbank_.GetFrameOptions().samp_freq;
     std::vector<float> samples(2 * sample_rate, 0);
     s->AcceptSamples(samples.data(), samples.size());
-    auto features = s->GetFeatures();
-    auto features_length = torch::tensor({features.size(0)});
-    features = features.unsqueeze(0);
+    auto features = s->GetFeatures().unsqueeze(0).to(device_);
 
-    features = features.to(device_);
-    features_length = features_length.to(device_);
+    // Run one forward through the encoder, decoder and joiner for every
+    // batch size production traffic will use, so the first real batch of
+    // each size does not trigger lazy kernel selection or allocator
+    // growth.
+    for (auto n : SplitStringToIntegers(config_.warmup_batch_sizes)) {
+      auto batch = features.repeat({n, 1, 1});
+      auto batch_length =
+          torch::full({n}, features.size(1), torch::kLong).to(device_);
 
-    model_->WarmUp(features, features_length);
+      model_->WarmUp(batch, batch_length);
+    }
     SHERPA_LOG(INFO) << "WarmUp ended";
   }
 
  private:
   OfflineRecognizerConfig config_;
-  SymbolTable symbol_table_;
+
+  // Held via shared_ptr so every result can carry a reference to it;
+  // see OfflineRecognitionResult::symbol_table.
+  std::shared_ptr<SymbolTable> symbol_table_;
+
+  // Used only for modified_beam_search with --ngram-lm-arpa. Declared
+  // before decoder_, which keeps a raw pointer to it.
+  std::unique_ptr<NgramLm> ngram_lm_;
+
   std::unique_ptr<OfflineTransducerModel> model_;
   std::unique_ptr<OfflineTransducerDecoder> decoder_;
   kaldifeat::Fbank fbank_;
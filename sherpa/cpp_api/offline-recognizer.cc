@@ -4,7 +4,12 @@
 
 #include "sherpa/cpp_api/offline-recognizer.h"
 
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <thread>  // NOLINT
 #include <utility>
+#include <vector>
 
 #include "sherpa/cpp_api/feature-config.h"
 #include "sherpa/cpp_api/offline-recognizer-ctc-impl.h"
@@ -12,11 +17,25 @@
 #include "sherpa/cpp_api/offline-recognizer-transducer-impl.h"
 #include "sherpa/csrc/file-utils.h"
 #include "sherpa/csrc/log.h"
+#include "sherpa/csrc/mmap-read-adapter.h"
+#include "sherpa/csrc/text-utils.h"
 #include "torch/script.h"
 
 namespace sherpa {
 
 void OfflineCtcDecoderConfig::Register(ParseOptions *po) {
+  // The names are prefixed with "ctc-" since --decoding-method and
+  // --num-active-paths are taken by OfflineRecognizerConfig.
+  po->Register("ctc-decoding-method", &decoding_method,
+               "Used only for CTC models. Possible values are: one_best "
+               "(decode with k2, supports HLG), and prefix_beam_search "
+               "(vectorized search directly on the log-probs; cheaper "
+               "for large vocabularies, no HLG).");
+
+  po->Register("ctc-num-active-paths", &num_active_paths,
+               "Beam size per utterance. "
+               "Used only when --ctc-decoding-method is prefix_beam_search");
+
   po->Register("modified", &modified,
                "Used only for decoding with a CTC topology. "
                "true to use a modified CTC topology; useful when "
@@ -57,9 +76,28 @@ void OfflineCtcDecoderConfig::Register(ParseOptions *po) {
       "in that it will try not to exceed that but may "
       "not always succeed. You can use a very large "
       "number if no constraint is needed. ");
+
+  po->Register("ctc-top-k", &top_k,
+               "Used only when --ctc-decoding-method is one_best. "
+               "If positive, the posteriors of every frame are pruned to "
+               "their top-k highest-scoring tokens (the blank is always "
+               "kept) before the FSA intersection. Useful for models "
+               "with a large vocabulary. 0 disables the pruning.");
 }
 
 void OfflineCtcDecoderConfig::Validate() const {
+  if (decoding_method != "one_best" &&
+      decoding_method != "prefix_beam_search") {
+    SHERPA_LOG(FATAL) << "Unsupported --ctc-decoding-method: "
+                      << decoding_method;
+  }
+
+  if (decoding_method == "prefix_beam_search") {
+    SHERPA_CHECK(hlg.empty())
+        << "--hlg is supported only when --ctc-decoding-method is one_best";
+    SHERPA_CHECK_GT(num_active_paths, 0);
+  }
+
   if (!hlg.empty()) {
     AssertFileExists(hlg);
   }
@@ -68,19 +106,23 @@ void OfflineCtcDecoderConfig::Validate() const {
   SHERPA_CHECK_GT(output_beam, 0);
   SHERPA_CHECK_GE(min_active_states, 0);
   SHERPA_CHECK_GE(max_active_states, 0);
+  SHERPA_CHECK_GE(top_k, 0);
 }
 
 std::string OfflineCtcDecoderConfig::ToString() const {
   std::ostringstream os;
 
   os << "OfflineCtcDecoderConfig(";
+  os << "decoding_method=" << '\"' << decoding_method << '\"' << ", ";
+  os << "num_active_paths=" << num_active_paths << ", ";
   os << "modified=" << (modified ? "True" : "False") << ", ";
   os << "hlg=" << '\"' << hlg << '\"' << ", ";
   os << "lm_scale=" << lm_scale << ", ";
   os << "search_beam=" << search_beam << ", ";
   os << "output_beam=" << output_beam << ", ";
   os << "min_active_states=" << min_active_states << ", ";
-  os << "max_active_states=" << max_active_states << ")";
+  os << "max_active_states=" << max_active_states << ", ";
+  os << "top_k=" << top_k << ")";
 
   return os.str();
 }
@@ -92,6 +134,21 @@ void OfflineRecognizerConfig::Register(ParseOptions *po) {
 
   po->Register("nn-model", &nn_model, "Path to the torchscript model");
 
+  po->Register("quantized-decoder-joiner-model",
+               &quantized_decoder_joiner_model,
+               "If non-empty, path to a torchscript file with int8 "
+               "quantized decoder/joiner modules that replace the fp32 "
+               "ones of --nn-model. Supported only on CPU and only for "
+               "transducer models.");
+
+  po->Register("encoder-trt-engine", &encoder_trt_engine,
+               "If non-empty, path to a serialized TensorRT engine (.trt "
+               "or .engine) that replaces the encoder of --nn-model; the "
+               "decoder and joiner keep running as TorchScript. Requires "
+               "--use-gpu=true and a sherpa build with "
+               "-DSHERPA_ENABLE_TRT=ON. Supported only for transducer "
+               "models.");
+
   po->Register("tokens", &tokens, "Path to tokens.txt.");
 
   po->Register("use-gpu", &use_gpu,
@@ -99,6 +156,14 @@ void OfflineRecognizerConfig::Register(ParseOptions *po) {
                "If true, it uses the first device. You can use the environment "
                "variable CUDA_VISIBLE_DEVICES to select which device to use.");
 
+  po->Register("use-cpu-bf16", &use_cpu_bf16,
+               "true to convert the encoder to bfloat16 for CPU "
+               "execution. On CPUs with native bf16 matmul support it "
+               "roughly halves the encoder time with negligible WER "
+               "impact; the decoder, joiner and search keep running in "
+               "fp32. Requires --use-gpu=false. Supported only for "
+               "transducer models.");
+
   po->Register("decoding-method", &decoding_method,
                "Decoding method to use. Possible values are: greedy_search, "
                "modified_beam_search, and fast_beam_search");
@@ -106,6 +171,68 @@ void OfflineRecognizerConfig::Register(ParseOptions *po) {
   po->Register("num-active-paths", &num_active_paths,
                "Number of active paths for modified_beam_search. "
                "Used only when --decoding-method is modified_beam_search");
+
+  po->Register("score-gap", &score_gap,
+               "Used only when --decoding-method is modified_beam_search. "
+               "Hypotheses whose log-prob is more than this below the best "
+               "one are pruned at insertion time. Values <= 0 disable gap "
+               "pruning.");
+
+  po->Register("ngram-lm-arpa", &ngram_lm_arpa,
+               "Used only when --decoding-method is modified_beam_search. "
+               "If non-empty, path to a token-level ARPA LM for shallow "
+               "fusion. It is compiled once into a memory-mapped binary "
+               "trie next to the ARPA file.");
+
+  po->Register("ngram-lm-scale", &ngram_lm_scale,
+               "Used only with --ngram-lm-arpa. Weight of the LM scores "
+               "in the fused path score.");
+
+  po->Register("max-padding-ratio", &max_padding_ratio,
+               "Maximum fraction of the encoder input that may consist of "
+               "padding when several utterances are batched together. "
+               "Batches exceeding it are split into sub-batches of "
+               "similar-length utterances. 1 disables length bucketing.");
+
+  po->Register("warmup-batch-sizes", &warmup_batch_sizes,
+               "Comma-separated list of batch sizes to run warmup with, "
+               "e.g., 1,8,16,32. Warm up every batch size production "
+               "traffic will use, so the first real batch of each size "
+               "does not pay for lazy kernel selection and allocator "
+               "growth.");
+
+  po->Register("return-encoder-out", &return_encoder_out,
+               "true to store the encoder output of each utterance on its "
+               "recognition result, so a later decoding pass can feed it "
+               "back and skip the encoder entirely. Used only for "
+               "transducer models.");
+
+  po->Register("collect-timings", &collect_timings,
+               "true to time each decoding stage and store the result on "
+               "the recognition results. Meant for production debugging.");
+
+  po->Register("lazy-text", &lazy_text,
+               "true to skip building text, tokens and words when "
+               "decoding; results then carry only the token ids and the "
+               "numeric fields. Call MaterializeText() on a result when "
+               "the strings are needed after all.");
+
+  po->Register("total-threads", &total_threads,
+               "If non-zero, total CPU thread budget, partitioned between "
+               "the libtorch intra-op pool and the threads running "
+               "feature extraction and search. -1 means the number of CPU "
+               "cores. 0 leaves the libtorch thread settings untouched.");
+
+  po->Register("max-segment-duration", &max_segment_duration,
+               "If positive, streams longer than this many seconds are "
+               "split into overlapping windows of this length, decoded "
+               "as one normal batch and merged back into a single "
+               "result, so arbitrarily long audio decodes with bounded "
+               "encoder memory. 0 disables the splitting.");
+
+  po->Register("segment-overlap", &segment_overlap,
+               "Used only with --max-segment-duration. Overlap in "
+               "seconds between consecutive windows of a split stream.");
 }
 
 void OfflineRecognizerConfig::Validate() const {
@@ -114,6 +241,40 @@ void OfflineRecognizerConfig::Validate() const {
   }
   AssertFileExists(nn_model);
 
+  if (!quantized_decoder_joiner_model.empty()) {
+    AssertFileExists(quantized_decoder_joiner_model);
+
+    if (use_gpu) {
+      SHERPA_LOG(FATAL) << "--quantized-decoder-joiner-model is supported "
+                           "only on CPU; leave --use-gpu=false";
+    }
+  }
+
+  if (use_cpu_bf16 && use_gpu) {
+    SHERPA_LOG(FATAL) << "--use-cpu-bf16 is supported only on CPU; leave "
+                         "--use-gpu=false (use fp16 on GPU instead)";
+  }
+
+  if (!encoder_trt_engine.empty()) {
+    AssertFileExists(encoder_trt_engine);
+
+    if (!use_gpu) {
+      SHERPA_LOG(FATAL) << "--encoder-trt-engine requires --use-gpu=true";
+    }
+
+    auto ends_with = [this](const std::string &suffix) -> bool {
+      return encoder_trt_engine.size() >= suffix.size() &&
+             encoder_trt_engine.compare(
+                 encoder_trt_engine.size() - suffix.size(), suffix.size(),
+                 suffix) == 0;
+    };
+    if (!ends_with(".trt") && !ends_with(".engine")) {
+      SHERPA_LOG(FATAL) << "--encoder-trt-engine expects a serialized "
+                           "TensorRT engine (.trt or .engine); given: "
+                        << encoder_trt_engine;
+    }
+  }
+
   if (tokens.empty()) {
     SHERPA_LOG(FATAL) << "Please provide --tokens";
   }
@@ -134,6 +295,36 @@ void OfflineRecognizerConfig::Validate() const {
   if (decoding_method == "modified_beam_search") {
     SHERPA_CHECK_GT(num_active_paths, 0);
   }
+
+  if (!ngram_lm_arpa.empty()) {
+    if (decoding_method != "modified_beam_search") {
+      SHERPA_LOG(FATAL) << "--ngram-lm-arpa requires "
+                           "--decoding-method=modified_beam_search";
+    }
+    AssertFileExists(ngram_lm_arpa);
+  }
+
+  SHERPA_CHECK_GT(max_padding_ratio, 0);
+  SHERPA_CHECK_LE(max_padding_ratio, 1);
+
+  auto batch_sizes = SplitStringToIntegers(warmup_batch_sizes);
+  if (batch_sizes.empty()) {
+    SHERPA_LOG(FATAL) << "Please provide at least one batch size in "
+                      << "--warmup-batch-sizes";
+  }
+  for (auto n : batch_sizes) {
+    SHERPA_CHECK_GT(n, 0);
+  }
+
+  SHERPA_CHECK_GE(total_threads, -1);
+
+  SHERPA_CHECK_GE(max_segment_duration, 0);
+  if (max_segment_duration > 0) {
+    SHERPA_CHECK_GT(segment_overlap, 0);
+    // The windows must advance and the half-overlap cuts must leave a
+    // non-empty keep region in every window.
+    SHERPA_CHECK_GT(max_segment_duration, segment_overlap);
+  }
 }
 
 std::string OfflineRecognizerConfig::ToString() const {
@@ -143,10 +334,26 @@ std::string OfflineRecognizerConfig::ToString() const {
   os << "ctc_decoder_config=" << ctc_decoder_config.ToString() << ", ";
   os << "feat_config=" << feat_config.ToString() << ", ";
   os << "nn_model=\"" << nn_model << "\", ";
+  os << "encoder_trt_engine=\"" << encoder_trt_engine << "\", ";
+  os << "quantized_decoder_joiner_model=\"" << quantized_decoder_joiner_model
+     << "\", ";
   os << "tokens=\"" << tokens << "\", ";
   os << "use_gpu=" << (use_gpu ? "True" : "False") << ", ";
+  os << "use_cpu_bf16=" << (use_cpu_bf16 ? "True" : "False") << ", ";
   os << "decoding_method=\"" << decoding_method << "\", ";
-  os << "num_active_paths=" << num_active_paths << ")";
+  os << "num_active_paths=" << num_active_paths << ", ";
+  os << "score_gap=" << score_gap << ", ";
+  os << "ngram_lm_arpa=\"" << ngram_lm_arpa << "\", ";
+  os << "ngram_lm_scale=" << ngram_lm_scale << ", ";
+  os << "max_padding_ratio=" << max_padding_ratio << ", ";
+  os << "warmup_batch_sizes=\"" << warmup_batch_sizes << "\", ";
+  os << "return_encoder_out=" << (return_encoder_out ? "True" : "False")
+     << ", ";
+  os << "collect_timings=" << (collect_timings ? "True" : "False") << ", ";
+  os << "lazy_text=" << (lazy_text ? "True" : "False") << ", ";
+  os << "total_threads=" << total_threads << ", ";
+  os << "max_segment_duration=" << max_segment_duration << ", ";
+  os << "segment_overlap=" << segment_overlap << ")";
 
   return os.str();
 }
@@ -159,9 +366,50 @@ std::ostream &operator<<(std::ostream &os,
 
 OfflineRecognizer::~OfflineRecognizer() = default;
 
-OfflineRecognizer::OfflineRecognizer(const OfflineRecognizerConfig &config) {
+// Partition --total-threads between the libtorch intra-op pool and the
+// work that runs outside of torch ops (feature extraction and search,
+// which run on the calling threads). Without this, an application that
+// spawns N worker threads next to the default libtorch pool ends up
+// with cores x N runnable threads and context-switch storms during CPU
+// decoding.
+//
+// The inter-op pool is left alone: libtorch allows configuring it only
+// once per process, so that stays the application's decision (our
+// binaries set it to 1 at startup).
+static void ConfigureThreadBudget(int32_t total_threads, bool use_gpu) {
+  if (total_threads == 0) {
+    return;
+  }
+
+  if (total_threads < 0) {
+    total_threads =
+        std::max<int32_t>(std::thread::hardware_concurrency(), 1);
+  }
+
+  int32_t intra_op_threads = 1;
+  if (!use_gpu) {
+    // Reserve about a quarter of the budget, at least one thread, for
+    // feature extraction and search; the rest goes to the intra-op
+    // pool running the network.
+    int32_t reserved = std::max<int32_t>(1, total_threads / 4);
+    intra_op_threads = std::max<int32_t>(1, total_threads - reserved);
+  }
+  // With a GPU the network does not use the intra-op pool, so one
+  // intra-op thread keeps idle spinners from competing with the
+  // feature and search threads.
+
+  torch::set_num_threads(intra_op_threads);
+
+  SHERPA_LOG(INFO) << "Thread budget: " << total_threads
+                   << ", torch intra-op threads: " << intra_op_threads;
+}
+
+OfflineRecognizer::OfflineRecognizer(const OfflineRecognizerConfig &config)
+    : config_(config) {
+  ConfigureThreadBudget(config.total_threads, config.use_gpu);
+
   if (!config.nn_model.empty()) {
-    torch::jit::Module m = torch::jit::load(config.nn_model, torch::kCPU);
+    torch::jit::Module m = LoadModule(config.nn_model, torch::kCPU);
     if (!m.hasattr("joiner")) {
       // CTC models do not have a joint network
       impl_ = std::make_unique<OfflineRecognizerCtcImpl>(config);
@@ -177,8 +425,173 @@ std::unique_ptr<OfflineStream> OfflineRecognizer::CreateStream() {
   return impl_->CreateStream();
 }
 
+namespace {
+
+// One window of an over-long stream; see
+// OfflineRecognizer::DecodeStreams().
+struct Segment {
+  std::unique_ptr<OfflineStream> stream;
+  int32_t parent;  // index into ss[] of the stream it was cut from
+  float offset;    // start of the window within the stream, in seconds
+};
+
+}  // namespace
+
+// Merge the per-window results of one split stream into a single
+// result. Every cut falls in the middle of an overlap: a token is
+// taken from the window in whose half of the overlap its timestamp
+// falls, which is the window where it sits furthest from a boundary
+// and therefore saw the most context. Text and words are rederived
+// from the merged tokens.
+static OfflineRecognitionResult MergeSegmentResults(
+    const std::vector<const OfflineRecognitionResult *> &parts,
+    const std::vector<float> &offsets, float max_segment_duration,
+    float segment_overlap) {
+  OfflineRecognitionResult ans;
+  ans.symbol_table = parts[0]->symbol_table;
+  ans.frame_shift_s = parts[0]->frame_shift_s;
+  float half = segment_overlap / 2;
+
+  // The merge works on the token ids, which are filled even with
+  // --lazy-text; text, tokens and words are rederived from the merged
+  // ids below.
+  for (size_t k = 0; k != parts.size(); ++k) {
+    const auto &r = *parts[k];
+
+    // Keep [begin, end), relative to the window start. Only the last
+    // window may be shorter than max_segment_duration, so the end cut
+    // of the other windows is well defined.
+    float begin = (k == 0) ? 0 : half;
+    float end = (k + 1 == parts.size())
+                    ? std::numeric_limits<float>::infinity()
+                    : max_segment_duration - half;
+
+    for (size_t i = 0; i != r.token_ids.size(); ++i) {
+      float t = r.timestamps[i];
+      if (t < begin || t >= end) {
+        continue;
+      }
+
+      ans.token_ids.push_back(r.token_ids[i]);
+      ans.timestamps.push_back(t + offsets[k]);
+      if (!r.token_confidences.empty()) {
+        ans.token_confidences.push_back(r.token_confidences[i]);
+      }
+    }
+  }
+
+  // With --lazy-text none of the windows carry strings and the merged
+  // result stays lazy as well.
+  bool materialized = false;
+  for (const auto *p : parts) {
+    materialized = materialized || !p->tokens.empty();
+  }
+  if (materialized) {
+    ans.MaterializeText();
+  }
+
+  if (!ans.token_confidences.empty()) {
+    float sum = 0;
+    for (auto c : ans.token_confidences) {
+      sum += c;
+    }
+    ans.confidence = sum / ans.token_confidences.size();
+  }
+
+  // The stage timings are batch-level, so the windows of one stream --
+  // possibly decoded across several sub-batches -- cannot be summed
+  // meaningfully; keep the numbers of the first window.
+  ans.timings = parts[0]->timings;
+
+  return ans;
+}
+
 void OfflineRecognizer::DecodeStreams(OfflineStream **ss, int32_t n) {
-  impl_->DecodeStreams(ss, n);
+  float max_dur = config_.max_segment_duration;
+  if (max_dur <= 0) {
+    impl_->DecodeStreams(ss, n);
+    return;
+  }
+
+  const auto &frame_opts = config_.feat_config.fbank_opts.frame_opts;
+
+  // Windows of the over-long streams, plus the streams decoded whole.
+  // All of them form one batch, so the windows of a 2-hour recording
+  // are decoded in parallel and length bucketing still applies.
+  std::vector<OfflineStream *> batch;
+  std::vector<Segment> segments;
+
+  for (int32_t i = 0; i != n; ++i) {
+    const auto &f = ss[i]->GetFeatures();
+
+    // Streams carrying raw waveform (e.g., for Wav2Vec2.0) hold a 1-D
+    // sample tensor; regular streams hold a 2-D feature matrix whose
+    // rows advance by one frame shift.
+    bool is_waveform = (f.dim() == 1);
+    float seconds_per_row = is_waveform
+                                ? 1.0f / frame_opts.samp_freq
+                                : frame_opts.frame_shift_ms / 1000.0f;
+
+    int64_t num_rows = f.size(0);
+    int64_t window = max_dur / seconds_per_row;
+
+    if (ss[i]->GetEncoderOut().defined() || num_rows <= window) {
+      batch.push_back(ss[i]);
+      continue;
+    }
+
+    int64_t step = std::max<int64_t>(
+        window - static_cast<int64_t>(config_.segment_overlap /
+                                      seconds_per_row),
+        1);
+
+    for (int64_t start = 0;; start += step) {
+      int64_t len = std::min<int64_t>(window, num_rows - start);
+      auto chunk = f.narrow(0, start, len).contiguous();
+
+      auto s = impl_->CreateStream();
+      if (is_waveform) {
+        if (!config_.feat_config.normalize_samples) {
+          // AcceptSamples() scales unnormalized input once more
+          chunk = chunk / 32767;
+        }
+        s->AcceptSamples(chunk.data_ptr<float>(), len);
+      } else {
+        s->AcceptFeatures(chunk.data_ptr<float>(), len, f.size(1));
+      }
+
+      batch.push_back(s.get());
+      segments.push_back(
+          {std::move(s), i, static_cast<float>(start) * seconds_per_row});
+
+      if (start + len >= num_rows) {
+        break;
+      }
+    }
+  }
+
+  if (segments.empty()) {
+    impl_->DecodeStreams(ss, n);
+    return;
+  }
+
+  impl_->DecodeStreams(batch.data(), batch.size());
+
+  // The windows of one stream are contiguous in `segments` and in
+  // temporal order.
+  for (size_t k = 0; k != segments.size();) {
+    int32_t parent = segments[k].parent;
+
+    std::vector<const OfflineRecognitionResult *> parts;
+    std::vector<float> offsets;
+    for (; k != segments.size() && segments[k].parent == parent; ++k) {
+      parts.push_back(&segments[k].stream->GetResult());
+      offsets.push_back(segments[k].offset);
+    }
+
+    ss[parent]->SetResult(
+        MergeSegmentResults(parts, offsets, max_dur, config_.segment_overlap));
+  }
 }
 
 }  // namespace sherpa
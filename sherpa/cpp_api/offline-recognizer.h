@@ -16,6 +16,16 @@
 namespace sherpa {
 
 struct OfflineCtcDecoderConfig {
+  // "one_best" to decode with k2 (CTC topology or HLG intersection).
+  // "prefix_beam_search" to decode with a vectorized CTC prefix beam
+  // search directly on the log-probs; it supports neither HLG nor
+  // --modified and is the cheaper choice for models with a large
+  // vocabulary, e.g., Wav2Vec2.0.
+  std::string decoding_method = "one_best";
+
+  // Used only for prefix_beam_search; beam size per utterance.
+  int32_t num_active_paths = 4;
+
   // Used only for decoding with a CTC topology
   // true to use a modified CTC topology.
   // false to use a standard CTC topology.
@@ -30,6 +40,16 @@ struct OfflineCtcDecoderConfig {
   int32_t min_active_states = 30;
   int32_t max_active_states = 10000;
 
+  // Used only for one_best. If positive, the posteriors of every frame
+  // are pruned to their top_k highest-scoring tokens (the blank is
+  // always kept) before the FSA intersection; the remaining entries
+  // are floored so far below the beam that they never spawn active
+  // states. For models with a large vocabulary, e.g., 10k BPE pieces,
+  // only a handful of tokens per frame carry any mass, so this cuts
+  // the intersection cost sharply at negligible accuracy cost.
+  // 0 disables the pruning.
+  int32_t top_k = 0;
+
   void Register(ParseOptions *po);
   void Validate() const;
   std::string ToString() const;
@@ -47,6 +67,21 @@ struct OfflineRecognizerConfig {
   /// Path to the torchscript model
   std::string nn_model;
 
+  /// If non-empty, path to a torchscript file with int8 quantized
+  /// decoder/joiner modules that replace the fp32 ones of nn_model.
+  /// The encoder keeps running in fp32. Supported only on CPU and only
+  /// for transducer models. See
+  /// OfflineConformerTransducerModel::LoadQuantizedDecoderJoiner() for
+  /// how to produce the file.
+  std::string quantized_decoder_joiner_model;
+
+  /// If non-empty, path to a serialized TensorRT engine (.trt or
+  /// .engine) that replaces the encoder of nn_model; the decoder and
+  /// joiner keep running as TorchScript. Requires use_gpu and a sherpa
+  /// build with -DSHERPA_ENABLE_TRT=ON. Supported only for transducer
+  /// models. See triton/tensorrt for how to build the engine.
+  std::string encoder_trt_engine;
+
   /// Path to tokens.txt
   std::string tokens;
 
@@ -59,11 +94,94 @@ struct OfflineRecognizerConfig {
   /// GPU for computation
   bool use_gpu = false;
 
+  /// true to convert the encoder to bfloat16 for CPU execution. On CPUs
+  /// with native bf16 matmul support it roughly halves the encoder time
+  /// with negligible WER impact; features are converted internally and
+  /// the encoder output is cast back to fp32, so the decoder, joiner
+  /// and search are unaffected. Requires use_gpu false. Supported only
+  /// for transducer models. It composes with
+  /// quantized_decoder_joiner_model.
+  bool use_cpu_bf16 = false;
+
   std::string decoding_method = "greedy_search";
 
   /// used only for modified_beam_search
   int32_t num_active_paths = 4;
 
+  /// used only for modified_beam_search. Hypotheses whose log-prob is
+  /// more than this below the best one are pruned at insertion time.
+  /// Values <= 0 disable gap pruning (the default).
+  float score_gap = 0;
+
+  /// used only for modified_beam_search. If non-empty, path to a
+  /// token-level ARPA LM used for shallow fusion. It is compiled once
+  /// into a memory-mapped binary trie next to the ARPA file, so all
+  /// processes on a machine share one page-cached LM image; see
+  /// sherpa/csrc/ngram-lm.h.
+  std::string ngram_lm_arpa;
+
+  /// used only with --ngram-lm-arpa. Weight of the LM scores in the
+  /// fused path score.
+  float ngram_lm_scale = 0.1;
+
+  /// Maximum fraction of the encoder input that may consist of padding
+  /// when several utterances are batched together. If a batch given to
+  /// DecodeStreams() would exceed it, the batch is split into sub-batches
+  /// of similar-length utterances that are decoded separately.
+  /// 1 disables length bucketing (the default).
+  float max_padding_ratio = 1;
+
+  /// Comma-separated list of batch sizes to run warmup with, e.g.,
+  /// "1,8,16,32". Warm up every batch size production traffic will use,
+  /// so the first real batch of each size does not pay for lazy kernel
+  /// selection and allocator growth.
+  std::string warmup_batch_sizes = "1";
+
+  /// true to store the encoder output of each utterance on its
+  /// OfflineRecognitionResult, so a later decoding pass can feed it back
+  /// via OfflineStream::SetEncoderOut() and skip the encoder entirely.
+  /// Used only for transducer models.
+  bool return_encoder_out = false;
+
+  /// true to time each decoding stage (feature assembly, encoder
+  /// forward, search) with wall clocks and store the result on
+  /// OfflineRecognitionResult::timings. Meant for production debugging.
+  /// Stage boundaries fall where the code already synchronizes with the
+  /// device, so the numbers are the wall times seen by the caller.
+  bool collect_timings = false;
+
+  /// true to skip building text, tokens and words when decoding:
+  /// results then carry only the token ids and the numeric fields, plus
+  /// a reference to the symbol table, so pipelines that consume token
+  /// ids directly pay for no symbol-table lookups or string
+  /// construction. Call OfflineRecognitionResult::MaterializeText()
+  /// when the strings are needed after all.
+  bool lazy_text = false;
+
+  /// If non-zero, total CPU thread budget for this process, partitioned
+  /// between the libtorch intra-op pool and the threads running feature
+  /// extraction and search. Keeps applications that spawn their own
+  /// worker threads from oversubscribing the cores with the default
+  /// libtorch pool. -1 means the number of CPU cores. 0 (the default)
+  /// leaves the libtorch thread settings untouched.
+  int32_t total_threads = 0;
+
+  /// If positive, streams longer than this many seconds are split into
+  /// overlapping windows of this length before decoding. The windows
+  /// are decoded together as one normal batch -- in parallel and with
+  /// length bucketing applied -- and the per-window results are merged
+  /// back into a single result for the original stream, so arbitrarily
+  /// long audio decodes with bounded encoder memory.
+  /// 0 disables the splitting (the default).
+  float max_segment_duration = 0;
+
+  /// Used only with max_segment_duration. Overlap in seconds between
+  /// consecutive windows of a split stream. Each cut falls in the
+  /// middle of an overlap, so every merged token comes from a window
+  /// where it sat at least half an overlap away from a boundary and saw
+  /// that much acoustic context on both sides.
+  float segment_overlap = 4;
+
   void Register(ParseOptions *po);
 
   void Validate() const;
@@ -104,6 +222,7 @@ class OfflineRecognizer {
 
  private:
   std::unique_ptr<OfflineRecognizerImpl> impl_;
+  OfflineRecognizerConfig config_;
 };
 
 }  // namespace sherpa
@@ -3,36 +3,195 @@
 // Copyright (c)  2022  Xiaomi Corporation
 #include "sherpa/cpp_api/offline-stream.h"
 
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <memory>
+#include <mutex>  // NOLINT
+#include <sstream>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
 
-#include "nlohmann/json.hpp"
 #include "sherpa/cpp_api/feature-config.h"
 #include "sherpa/csrc/fbank-features.h"
+#include "sherpa/csrc/feature-service.h"
+#include "sherpa/csrc/json-writer.h"
 #include "sherpa/csrc/log.h"
+#include "sherpa/csrc/symbol-table.h"
 
 namespace sherpa {
 
+void OfflineRecognitionResult::MaterializeText() {
+  if (!tokens.empty() || token_ids.empty()) {
+    return;
+  }
+
+  SHERPA_CHECK(symbol_table != nullptr)
+      << "MaterializeText() needs the symbol table of the recognizer "
+         "that produced this result";
+
+  tokens.reserve(token_ids.size());
+  for (auto i : token_ids) {
+    auto sym = (*symbol_table)[i];
+    text.append(sym);
+
+    tokens.push_back(std::move(sym));
+  }
+
+  // Word-level segmentation: a token starting with a space (the BPE
+  // word marker is replaced with a space when the symbol table is
+  // loaded) begins a new word. Done here so the server emits word
+  // timings without a second pass over the tokens in Python.
+  if (timestamps.size() != tokens.size()) {
+    return;
+  }
+
+  for (size_t i = 0; i != tokens.size(); ++i) {
+    const std::string &sym = tokens[i];
+    bool starts_word = (i == 0) || (!sym.empty() && sym[0] == ' ');
+    if (starts_word) {
+      if (!words.empty()) {
+        word_end_times.push_back(timestamps[i]);
+      }
+      words.emplace_back();
+      word_start_times.push_back(timestamps[i]);
+    }
+    words.back().append(!sym.empty() && sym[0] == ' ' ? sym.substr(1) : sym);
+  }
+  // The end of the last word is approximated by the start of its last
+  // token plus one subsampled frame.
+  word_end_times.push_back(timestamps.back() + frame_shift_s);
+}
+
 std::string OfflineRecognitionResult::AsJsonString() const {
-  using json = nlohmann::json;
-  json j;
-  j["text"] = text;
-  j["tokens"] = tokens;
+  // The float arrays stay string-wrapped (e.g., "[0.12,0.34]"): that
+  // was originally a trick to force fixed decimals through
+  // nlohmann::json, but clients parse it now.
+  auto *w = GetThreadLocalJsonWriter();
+  w->Reset();
+  w->StartObject();
+  w->Key("text");
+  w->Write(text);
+  w->Key("tokens");
+  w->Write(tokens);
+  w->Key("timestamps");
+  w->WriteQuoted(timestamps, 3);
+
+  if (!token_confidences.empty()) {
+    w->Key("token_confidences");
+    w->WriteQuoted(token_confidences, 3);
+    w->Key("confidence");
+    w->Write(confidence, 4);
+  }
 
-  std::ostringstream os;
-  os << "[";
-  std::string sep = "";
-  for (auto t : timestamps) {
-    os << sep << std::fixed << std::setprecision(2) << t;
-    sep = ",";
+  if (!words.empty()) {
+    w->Key("words");
+    w->Write(words);
+    w->Key("word_start_times");
+    w->WriteQuoted(word_start_times, 3);
+    w->Key("word_end_times");
+    w->WriteQuoted(word_end_times, 3);
   }
-  os << "]";
 
-  // NOTE: We don't use j["timestamps"] = timestamps;
-  // because we need to control the number of decimal points to keep
-  j["timestamps"] = os.str();
+  if (timings.total > 0) {
+    w->Key("timings");
+    w->StartObject();
+    w->Key("queue_wait");
+    w->Write(timings.queue_wait, 6);
+    w->Key("features");
+    w->Write(timings.features, 6);
+    w->Key("encoder");
+    w->Write(timings.encoder, 6);
+    w->Key("search");
+    w->Write(timings.search, 6);
+    w->Key("serialization");
+    w->Write(timings.serialization, 6);
+    w->Key("total");
+    w->Write(timings.total, 6);
+    w->EndObject();
+  }
+
+  w->EndObject();
+  return w->Str();
+}
+
+// Process-wide cache of decoded wave files, so that many streams
+// referencing segments of one file decode its PCM only once.
+//
+// Entries are weak: the cache itself keeps nothing alive. A stream
+// created from a wave file holds a shared_ptr to the decoded buffer for
+// its whole lifetime, so the entry stays resolvable as long as at least
+// one such stream exists -- exactly the window in which a segment-heavy
+// pipeline creates its sibling streams -- and the memory is released as
+// soon as the last of them is destroyed.
+static std::shared_ptr<torch::Tensor> GetDecodedAudio(
+    const std::string &wave_file, float expected_sample_rate) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::weak_ptr<torch::Tensor>> cache;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(wave_file);
+    if (it != cache.end()) {
+      if (auto p = it->second.lock()) {
+        return p;
+      }
+      cache.erase(it);
+    }
+  }
+
+  // Decode outside the lock so concurrent streams reading different
+  // files do not serialize. Two threads racing on the same file may
+  // both decode it; the first one to insert wins and the extra buffer
+  // is dropped.
+  auto samples = std::make_shared<torch::Tensor>(
+      ReadWave(wave_file, expected_sample_rate).first);
 
-  return j.dump();
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = cache.find(wave_file);
+  if (it != cache.end()) {
+    if (auto p = it->second.lock()) {
+      return p;
+    }
+  }
+  cache[wave_file] = samples;
+  return samples;
+}
+
+// Process-wide feature service clients, keyed by the shm name prefix.
+// Each client owns one SPSC ring pair, so all streams of a process
+// share one client (and one in-flight request) per service.
+static FeatureServiceClient *GetFeatureServiceClient(
+    const std::string &prefix) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::unique_ptr<FeatureServiceClient>>
+      clients;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &client = clients[prefix];
+  if (!client) {
+    client = std::make_unique<FeatureServiceClient>(prefix);
+  }
+  return client.get();
+}
+
+// Magic bytes at the start of a cached feature file; bump the digit when
+// the on-disk layout changes.
+static constexpr const char *kFeatureCacheMagic = "SFC1";
+
+// 64-bit FNV-1a. Used to derive the cache file name from the wave file
+// content and the feature settings.
+static uint64_t Fnv1a(const char *data, size_t n,
+                      uint64_t h = 14695981039346656037ULL) {
+  for (size_t i = 0; i != n; ++i) {
+    h = (h ^ static_cast<uint8_t>(data[i])) * 1099511628211ULL;
+  }
+  return h;
 }
 
 class OfflineStream::OfflineStreamImpl {
@@ -45,19 +204,53 @@ class OfflineStream::OfflineStreamImpl {
     }
   }
 
-  void AcceptWaveFile(const std::string &wave_file) {
-    torch::Tensor samples =
-        ReadWave(wave_file, fbank_->GetFrameOptions().samp_freq).first;
+  void AcceptWaveFile(const std::string &wave_file, float start,
+                      float duration) {
+    bool whole_file = (start == 0 && duration < 0);
+
+    // The on-disk feature cache is keyed by the whole file; segments
+    // always go through the in-memory audio cache below instead.
+    std::string cache_path;
+    if (whole_file && !feat_config_.feature_cache_dir.empty() &&
+        !feat_config_.return_waveform) {
+      cache_path = FeatureCachePath(wave_file);
+      if (LoadCachedFeatures(cache_path)) {
+        return;
+      }
+    }
+
+    float samp_freq = fbank_->GetFrameOptions().samp_freq;
+
+    // Keep the shared buffer alive for the lifetime of this stream so
+    // sibling streams reading other segments of the file hit the cache.
+    pcm_ = GetDecodedAudio(wave_file, samp_freq);
+
+    torch::Tensor samples = *pcm_;
+    if (!whole_file) {
+      int64_t num_samples = samples.numel();
+      int64_t first = std::min<int64_t>(start * samp_freq, num_samples);
+      int64_t n = duration < 0
+                      ? num_samples - first
+                      : std::min<int64_t>(duration * samp_freq,
+                                          num_samples - first);
+      samples = samples.narrow(0, first, n);
+    }
+
     if (!feat_config_.normalize_samples) {
-      samples.mul_(32767);
+      // Out of place: the decoded buffer is shared with other streams.
+      samples = samples * 32767;
     }
 
     if (feat_config_.return_waveform) {
       // We return audio samples directly, e.g., for Wav2Vec2.0
       features_ = samples;
     } else {
-      features_ = ComputeFeatures(*fbank_, {samples})[0];
+      features_ = ComputeFbank(samples);
       features_ = Normalize(features_);
+
+      if (!cache_path.empty()) {
+        SaveCachedFeatures(cache_path);
+      }
     }
   }
 
@@ -73,11 +266,78 @@ class OfflineStream::OfflineStreamImpl {
       // We return audio samples directly, e.g., for Wav2Vec2.0
       features_ = tensor.clone();
     } else {
-      features_ = ComputeFeatures(*fbank_, {tensor})[0];
+      features_ = ComputeFbank(tensor);
       features_ = Normalize(features_);
     }
   }
 
+  void AcceptSamplesChunk(const float *samples, int32_t n) {
+    pending_.insert(pending_.end(), samples, samples + n);
+
+    if (feat_config_.return_waveform) {
+      // The "features" are the samples themselves; they are assembled
+      // in FinishAcceptingSamples().
+      return;
+    }
+
+    const auto &frame_opts = fbank_->GetFrameOptions();
+    int32_t window = frame_opts.WindowSize();
+    int32_t shift = frame_opts.WindowShift();
+    int32_t num_pending = static_cast<int32_t>(pending_.size());
+    if (num_pending < window) {
+      return;
+    }
+
+    // Number of complete frames in pending_ and the samples they span.
+    // Frame k covers [k * shift, k * shift + window), the same framing
+    // (snip_edges) ComputeFeatures() uses, so computing the frames
+    // chunk by chunk yields the features of the whole utterance.
+    int32_t num_frames = (num_pending - window) / shift + 1;
+    int32_t span = window + (num_frames - 1) * shift;
+
+    chunk_features_.push_back(ComputeChunk(pending_.data(), span));
+
+    // The next frame starts at num_frames * shift; keep the samples
+    // from there on (the tail of the last window overlaps them).
+    pending_.erase(pending_.begin(), pending_.begin() + num_frames * shift);
+  }
+
+  void FinishAcceptingSamples() {
+    if (feat_config_.return_waveform) {
+      // We return audio samples directly, e.g., for Wav2Vec2.0
+      features_ = torch::from_blob(pending_.data(),
+                                   {static_cast<int64_t>(pending_.size())},
+                                   torch::kFloat)
+                      .clone();
+      if (!feat_config_.normalize_samples) {
+        features_.mul_(32767);
+      }
+    } else {
+      const auto &frame_opts = fbank_->GetFrameOptions();
+      int32_t num_pending = static_cast<int32_t>(pending_.size());
+      if (num_pending >= frame_opts.WindowSize()) {
+        chunk_features_.push_back(ComputeChunk(pending_.data(), num_pending));
+      }
+
+      if (chunk_features_.empty()) {
+        features_ = torch::empty(
+            {0, fbank_->GetOptions().mel_opts.num_bins}, torch::kFloat);
+      } else if (chunk_features_.size() == 1) {
+        features_ = std::move(chunk_features_[0]);
+      } else {
+        features_ = torch::cat(chunk_features_, /*dim*/ 0);
+      }
+      chunk_features_.clear();
+
+      // Per-utterance normalization needs all frames, so it runs here
+      // and not per chunk.
+      features_ = Normalize(features_);
+    }
+
+    pending_.clear();
+    pending_.shrink_to_fit();
+  }
+
   void AcceptFeatures(const float *features, int32_t num_frames,
                       int32_t num_channels) {
     features_ = torch::from_blob(const_cast<float *>(features),
@@ -87,21 +347,62 @@ class OfflineStream::OfflineStreamImpl {
 
   const torch::Tensor &GetFeatures() const { return features_; }
 
+  void SetEncoderOut(torch::Tensor encoder_out) {
+    encoder_out_ = std::move(encoder_out);
+  }
+
+  const torch::Tensor &GetEncoderOut() const { return encoder_out_; }
+
   void SetResult(const OfflineRecognitionResult &r) { result_ = r; }
 
   const OfflineRecognitionResult &GetResult() const { return result_; }
 
+  OfflineRecognitionResult &GetResult() { return result_; }
+
  private:
+  // Compute the features of n samples from AcceptSamplesChunk()'s
+  // pending buffer. The samples are copied first: the scaling for
+  // unnormalized models must not touch the buffer, whose tail is
+  // reprocessed with the next chunk.
+  torch::Tensor ComputeChunk(const float *samples, int32_t n) const {
+    torch::Tensor tensor =
+        torch::from_blob(const_cast<float *>(samples), {n}, torch::kFloat)
+            .clone();
+
+    if (!feat_config_.normalize_samples) {
+      tensor.mul_(32767);
+    }
+
+    return ComputeFbank(tensor);
+  }
+
+  // Compute the fbank features of one utterance, either locally or --
+  // with --feature-service -- through the shared per-host feature
+  // service.
+  torch::Tensor ComputeFbank(const torch::Tensor &samples) const {
+    if (!feat_config_.feature_service.empty()) {
+      return GetFeatureServiceClient(feat_config_.feature_service)
+          ->Compute(samples);
+    }
+
+    return ComputeFeatures(*fbank_, {samples})[0];
+  }
+
   torch::Tensor Normalize(torch::Tensor features) const {
     if (feat_config_.nemo_normalize.empty()) {
       return features;
     }
 
     if (feat_config_.nemo_normalize == "per_feature") {
-      torch::Tensor mean = features.mean(0 /*dim*/, true /*keepdim*/);
-      torch::Tensor std = features.std(0 /*dim*/, true /*keepdim*/);
+      // A single fused reduction computes both moments, and the
+      // pointwise updates run in place: features comes fresh out of
+      // ComputeFeatures(), so nobody sees the unnormalized values.
+      torch::Tensor std, mean;
+      std::tie(std, mean) = torch::std_mean(features, 0 /*dim*/,
+                                            true /*unbiased*/,
+                                            true /*keepdim*/);
 
-      return (features - mean) / (std + 1e-5f);
+      return features.sub_(mean).div_(std.add_(1e-5f));
     }
 
     SHERPA_LOG(FATAL) << "Unsupported nemo_normalize: "
@@ -109,9 +410,122 @@ class OfflineStream::OfflineStreamImpl {
     return {};  // unreachable code; to make the compiler happy
   }
 
+  // Return the cache file path for the given wave file. The name is a
+  // hash of the wave file content and of every setting that affects the
+  // computed features, so a changed file or a changed configuration
+  // never hits a stale entry.
+  std::string FeatureCachePath(const std::string &wave_file) const {
+    std::ifstream is(wave_file, std::ios::binary);
+    if (!is) {
+      SHERPA_LOG(FATAL) << "Failed to open " << wave_file;
+    }
+    std::ostringstream content;
+    content << is.rdbuf();
+    const std::string &bytes = content.str();
+
+    const auto &frame_opts = fbank_->GetFrameOptions();
+    std::ostringstream conf;
+    conf << frame_opts.samp_freq << ":" << frame_opts.frame_length_ms << ":"
+         << frame_opts.frame_shift_ms << ":" << frame_opts.dither << ":"
+         << fbank_->GetOptions().mel_opts.num_bins << ":"
+         << feat_config_.normalize_samples << ":"
+         << feat_config_.nemo_normalize;
+    const std::string &conf_str = conf.str();
+
+    uint64_t h = Fnv1a(bytes.data(), bytes.size());
+    h = Fnv1a(conf_str.data(), conf_str.size(), h);
+
+    std::ostringstream os;
+    os << feat_config_.feature_cache_dir << "/" << std::hex << h << ".feat";
+    return os.str();
+  }
+
+  // Load cached features into features_. Return false if there is no
+  // usable cache entry; the caller then recomputes the features.
+  bool LoadCachedFeatures(const std::string &cache_path) {
+    std::ifstream is(cache_path, std::ios::binary);
+    if (!is) {
+      return false;
+    }
+
+    char magic[4];
+    int32_t num_frames = 0;
+    int32_t num_channels = 0;
+    is.read(magic, 4);
+    is.read(reinterpret_cast<char *>(&num_frames), sizeof(num_frames));
+    is.read(reinterpret_cast<char *>(&num_channels), sizeof(num_channels));
+    if (!is.good() || std::memcmp(magic, kFeatureCacheMagic, 4) != 0 ||
+        num_frames < 0 || num_channels <= 0) {
+      SHERPA_LOG(WARNING) << "Ignoring corrupt feature cache entry "
+                          << cache_path;
+      return false;
+    }
+
+    auto features = torch::empty({num_frames, num_channels}, torch::kFloat);
+    is.read(reinterpret_cast<char *>(features.data_ptr<float>()),
+            features.numel() * sizeof(float));
+    if (!is.good()) {
+      SHERPA_LOG(WARNING) << "Ignoring truncated feature cache entry "
+                          << cache_path;
+      return false;
+    }
+
+    features_ = features;
+    return true;
+  }
+
+  // Save features_ to the cache. The data is written to a temporary file
+  // first and then renamed, so concurrent streams caching the same wave
+  // file never observe a partially written entry.
+  void SaveCachedFeatures(const std::string &cache_path) const {
+    auto features = features_.to(torch::kCPU).contiguous();
+
+    std::ostringstream tmp_os;
+    tmp_os << cache_path << "." << std::hex
+           << reinterpret_cast<uintptr_t>(this) << "-"
+           << std::chrono::steady_clock::now().time_since_epoch().count()
+           << ".tmp";
+    std::string tmp_path = tmp_os.str();
+
+    {
+      std::ofstream os(tmp_path, std::ios::binary);
+      int32_t num_frames = features.size(0);
+      int32_t num_channels = features.size(1);
+      os.write(kFeatureCacheMagic, 4);
+      os.write(reinterpret_cast<const char *>(&num_frames),
+               sizeof(num_frames));
+      os.write(reinterpret_cast<const char *>(&num_channels),
+               sizeof(num_channels));
+      os.write(reinterpret_cast<const char *>(features.data_ptr<float>()),
+               features.numel() * sizeof(float));
+      if (!os) {
+        SHERPA_LOG(WARNING) << "Failed to write feature cache entry "
+                            << tmp_path;
+        return;
+      }
+    }
+
+    if (std::rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+      SHERPA_LOG(WARNING) << "Failed to rename " << tmp_path << " to "
+                          << cache_path;
+      std::remove(tmp_path.c_str());
+    }
+  }
+
  private:
   torch::Tensor features_;
+  // State of AcceptSamplesChunk(): the samples not yet covered by a
+  // computed frame, and the per-chunk feature matrices waiting to be
+  // concatenated by FinishAcceptingSamples().
+  std::vector<float> pending_;
+  std::vector<torch::Tensor> chunk_features_;
+  // Decoded PCM of the wave file this stream was created from; shared
+  // with other streams reading segments of the same file. See
+  // GetDecodedAudio().
+  std::shared_ptr<torch::Tensor> pcm_;
   OfflineRecognitionResult result_;
+  // Precomputed encoder output; undefined unless SetEncoderOut() is called
+  torch::Tensor encoder_out_;
   kaldifeat::Fbank *fbank_ = nullptr;  // not owned
   FeatureConfig feat_config_;
 };
@@ -122,14 +536,23 @@ OfflineStream::OfflineStream(kaldifeat::Fbank *fbank,
                              const FeatureConfig &feat_config)
     : impl_(std::make_unique<OfflineStreamImpl>(fbank, feat_config)) {}
 
-void OfflineStream::AcceptWaveFile(const std::string &filename) {
-  impl_->AcceptWaveFile(filename);
+void OfflineStream::AcceptWaveFile(const std::string &filename, float start,
+                                   float duration) {
+  impl_->AcceptWaveFile(filename, start, duration);
 }
 
 void OfflineStream::AcceptSamples(const float *samples, int32_t n) {
   impl_->AcceptSamples(samples, n);
 }
 
+void OfflineStream::AcceptSamplesChunk(const float *samples, int32_t n) {
+  impl_->AcceptSamplesChunk(samples, n);
+}
+
+void OfflineStream::FinishAcceptingSamples() {
+  impl_->FinishAcceptingSamples();
+}
+
 void OfflineStream::AcceptFeatures(const float *features, int32_t num_frames,
                                    int32_t num_channels) {
   impl_->AcceptFeatures(features, num_frames, num_channels);
@@ -139,6 +562,14 @@ const torch::Tensor &OfflineStream::GetFeatures() const {
   return impl_->GetFeatures();
 }
 
+void OfflineStream::SetEncoderOut(torch::Tensor encoder_out) {
+  impl_->SetEncoderOut(std::move(encoder_out));
+}
+
+const torch::Tensor &OfflineStream::GetEncoderOut() const {
+  return impl_->GetEncoderOut();
+}
+
 /** Set the recognition result for this stream. */
 void OfflineStream::SetResult(const OfflineRecognitionResult &r) {
   impl_->SetResult(r);
@@ -149,4 +580,8 @@ const OfflineRecognitionResult &OfflineStream::GetResult() const {
   return impl_->GetResult();
 }
 
+OfflineRecognitionResult &OfflineStream::GetResult() {
+  return impl_->GetResult();
+}
+
 }  // namespace sherpa
@@ -14,6 +14,8 @@
 
 namespace sherpa {
 
+class SymbolTable;
+
 struct OfflineRecognitionResult {
   // Recognition results.
   // For English, it consists of space separated words.
@@ -24,10 +26,64 @@ struct OfflineRecognitionResult {
   // For instance, for BPE-based models it consists of a list of BPE tokens.
   std::vector<std::string> tokens;
 
-  /// timestamps.size() == tokens.size()
-  /// timestamps[i] records the time in seconds when tokens[i] is decoded.
+  /// The decoded token IDs; tokens[i] is the symbol of token_ids[i].
+  /// Always filled, even when decoding with lazy_text=true.
+  std::vector<int32_t> token_ids;
+
+  /// The symbol table of the model that produced this result, shared by
+  /// all results of one recognizer. Used by MaterializeText().
+  std::shared_ptr<const SymbolTable> symbol_table;
+
+  /// timestamps.size() == token_ids.size()
+  /// timestamps[i] records the time in seconds when token_ids[i] is decoded.
   std::vector<float> timestamps;
 
+  /// Seconds covered by one timestamp step, i.e., the model frame shift
+  /// times the subsampling factor. Used by MaterializeText() to
+  /// approximate the end of the last word.
+  float frame_shift_s = 0;
+
+  /// token_confidences.size() == tokens.size() when decoding with
+  /// fast_beam_search; empty otherwise. token_confidences[i] is a
+  /// confidence in [0, 1] for tokens[i], derived from the best-path arc
+  /// scores of the decoding lattice of the same decoding pass.
+  std::vector<float> token_confidences;
+
+  /// Average of token_confidences; 0 when they are not available.
+  float confidence = 0;
+
+  /// Word-level segmentation of the result, derived from the BPE word
+  /// markers of the tokens. words[i] is the i-th word;
+  /// word_start_times[i] and word_end_times[i] are its start and end in
+  /// seconds. Filled only for models whose tokens carry word markers;
+  /// empty otherwise.
+  std::vector<std::string> words;
+  std::vector<float> word_start_times;
+  std::vector<float> word_end_times;
+
+  /// The encoder output of this utterance, a 2-D tensor of shape
+  /// (T, encoder_out_dim) containing only valid frames (no padding).
+  /// It is defined only when decoding with return_encoder_out=true; feed
+  /// it back via OfflineStream::SetEncoderOut() to rerun the search
+  /// without paying for the encoder again.
+  torch::Tensor encoder_out;
+
+  /// Per-stage wall times for the batch this utterance was decoded in.
+  /// All fields are in seconds and 0 unless decoding with
+  /// collect_timings=true. The stages are batch-level: every utterance
+  /// of a batch carries the same numbers.
+  struct StageTimings {
+    float queue_wait = 0;     // time spent queued before decoding started;
+                              // filled only by the websocket server
+    float features = 0;       // feature gather, padding and copy to device
+    float encoder = 0;        // encoder forward
+    float search = 0;         // decoder search
+    float serialization = 0;  // result serialization; filled only by the
+                              // websocket server
+    float total = 0;          // end-to-end inside DecodeStreams()
+  };
+  StageTimings timings;
+
   /** Return a json string.
    *
    * The returned string contains:
@@ -39,8 +95,22 @@ struct OfflineRecognitionResult {
    *     "start_frame": x,
    *     "is_final": true|false
    *   }
+   *
+   * If decoding ran with collect_timings=true, it also contains a
+   * "timings" object with the per-stage wall times in seconds.
    */
   std::string AsJsonString() const;
+
+  /** Build text, tokens and the word-level segmentation from token_ids.
+   *
+   * With lazy_text=false (the default) the recognizer calls this right
+   * after decoding, so results arrive fully materialized. With
+   * lazy_text=true only token_ids and the numeric fields are filled, so
+   * pipelines that consume token ids directly skip all symbol-table
+   * lookups and string construction; call this method before reading
+   * text, tokens or words (or AsJsonString()). A second call is a no-op.
+   */
+  void MaterializeText();
 };
 
 class OfflineStream {
@@ -53,13 +123,24 @@ class OfflineStream {
    */
   OfflineStream(kaldifeat::Fbank *fbank, const FeatureConfig &feat_config);
 
-  /** Create a stream from a WAVE file.
+  /** Create a stream from a WAVE file, or from a segment of one.
+   *
+   * The decoded PCM is kept in a process-wide cache keyed by the file
+   * path: when several streams reference the same file -- e.g., many
+   * diarization segments of one recording -- the file is read and
+   * decoded only once and each stream gets a zero-copy view of its
+   * slice. A cached buffer stays alive as long as at least one stream
+   * created from it is alive.
    *
    * @param wave_file Path to the WAVE file. Its sample frequency should
    *                  match the one from the feature extractor. Only
    *                  WAVEs with a single channel are supported.
+   * @param start Start of the segment in seconds.
+   * @param duration Duration of the segment in seconds. -1 means until
+   *                 the end of the file.
    */
-  void AcceptWaveFile(const std::string &wave_file);
+  void AcceptWaveFile(const std::string &wave_file, float start = 0,
+                      float duration = -1);
 
   /** Create a stream from audio samples.
    *
@@ -73,6 +154,30 @@ class OfflineStream {
    */
   void AcceptSamples(const float *samples, int32_t n);
 
+  /** Incremental variant of AcceptSamples().
+   *
+   * Feed the utterance in chunks as they become available, e.g., while
+   * it is still being uploaded, and call FinishAcceptingSamples() after
+   * the last chunk. Features of complete frames are computed as soon as
+   * the samples covering them have arrived, so at the end of the
+   * utterance only the remaining tail is left to process instead of the
+   * whole recording. The frames are cut exactly as AcceptSamples()
+   * would cut them, so the resulting features are identical.
+   *
+   * @param samples Pointer to the chunk's audio samples, normalized to
+   *                the range [-1, 1] (see AcceptSamples()).
+   * @param n  Number of audio samples in the chunk.
+   */
+  void AcceptSamplesChunk(const float *samples, int32_t n);
+
+  /** Signal that the last chunk has been fed via AcceptSamplesChunk().
+   *
+   * It processes the remaining tail of samples and applies the
+   * per-utterance normalization, if any. The stream is then ready for
+   * decoding.
+   */
+  void FinishAcceptingSamples();
+
   /** Create a stream from features.
    *
    * @param feature Pointer to the 2-D feature matrix of shape
@@ -92,12 +197,36 @@ class OfflineStream {
    */
   const torch::Tensor &GetFeatures() const;
 
+  /** Provide a precomputed encoder output for this stream.
+   *
+   * When every stream of a batch has one, DecodeStreams() skips
+   * RunEncoder() and feeds the tensors straight to the search. This is
+   * meant for a second decoding pass, e.g., rerunning an utterance
+   * decoded with greedy search through modified_beam_search: decode the
+   * first pass with return_encoder_out=true and pass
+   * OfflineRecognitionResult::encoder_out back in here.
+   *
+   * @param encoder_out A 2-D tensor of shape (T, encoder_out_dim).
+   */
+  void SetEncoderOut(torch::Tensor encoder_out);
+
+  /** Get the precomputed encoder output of this stream.
+   *
+   * @return Return an undefined tensor if SetEncoderOut() has not been
+   *         called.
+   */
+  const torch::Tensor &GetEncoderOut() const;
+
   /** Set the recognition result for this stream. */
   void SetResult(const OfflineRecognitionResult &r);
 
   /** Get the recognition result of this stream */
   const OfflineRecognitionResult &GetResult() const;
 
+  // Mutable variant; lets callers of a recognizer configured with
+  // lazy_text=true run MaterializeText() on the stored result.
+  OfflineRecognitionResult &GetResult();
+
  private:
   class OfflineStreamImpl;
   std::unique_ptr<OfflineStreamImpl> impl_;
@@ -4,15 +4,40 @@
 
 #include "sherpa/cpp_api/online-recognizer.h"
 
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <future>  // NOLINT
+#include <iostream>
 #include <locale>
+#include <map>
 #include <memory>
+#include <mutex>  // NOLINT
+#include <sstream>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
-#include "nlohmann/json.hpp"
+#ifdef SHERPA_WITH_CUDA
+#include "c10/cuda/CUDACachingAllocator.h"
+#include "c10/cuda/CUDAGuard.h"
+#include "c10/cuda/CUDAStream.h"
+#endif
+#include "sherpa/csrc/context-graph.h"
 #include "sherpa/csrc/file-utils.h"
+#include "sherpa/csrc/json-writer.h"
+#include "sherpa/csrc/latency-budget.h"
 #include "sherpa/csrc/log.h"
+#include "sherpa/csrc/nvtx.h"
 #include "sherpa/csrc/online-conformer-transducer-model.h"
 #include "sherpa/csrc/online-conv-emformer-transducer-model.h"
+#include "sherpa/csrc/online-ctc-greedy-search-decoder.h"
 #include "sherpa/csrc/online-emformer-transducer-model.h"
 #include "sherpa/csrc/online-lstm-transducer-model.h"
 #include "sherpa/csrc/online-transducer-decoder.h"
@@ -20,37 +45,39 @@
 #include "sherpa/csrc/online-transducer-greedy-search-decoder.h"
 #include "sherpa/csrc/online-transducer-model.h"
 #include "sherpa/csrc/online-transducer-modified-beam-search-decoder.h"
+#include "sherpa/csrc/online-wenet-conformer-ctc-model.h"
 #include "sherpa/csrc/online-zipformer-transducer-model.h"
 #include "sherpa/csrc/online-zipformer2-transducer-model.h"
+#include "sherpa/csrc/prof.h"
 #include "sherpa/csrc/symbol-table.h"
+#include "sherpa/csrc/text-utils.h"
+#include "sherpa/csrc/trace.h"
 
 namespace sherpa {
 
 std::string OnlineRecognitionResult::AsJsonString() const {
-  using json = nlohmann::json;
-  json j;
-  j["text"] = text;
-  j["start_time"] = start_time;
-  j["tokens"] = tokens;
-
-  // std::ostringstream os;
-  // os << "[";
-  // std::string sep = "";
-  // for (auto t : timestamps) {
-  //   os << sep << std::fixed << std::setprecision(2) << t;
-  //   sep = ",";
-  // }
-  // os << "]";
-
-  // NOTE: We don't use j["timestamps"] = timestamps;
-  // because we need to control the number of decimal points to keep
-  j["timestamps"] = timestamps;  // os.str();
+  auto *w = GetThreadLocalJsonWriter();
+  w->Reset();
+  w->StartObject();
+  w->Key("text");
+  w->Write(text);
+  w->Key("start_time");
+  w->Write(start_time, 3);
+  w->Key("tokens");
+  w->Write(tokens);
+  // 3 decimals keep millisecond resolution, already much finer than the
+  // frame shift the timestamps are quantized to.
+  w->Key("timestamps");
+  w->Write(timestamps, 3);
 
   // TODO(fangjun): The key in the json object should be kept
   // in sync with sherpa/bin/pruned_transducer_statelessX/streaming_server.py
-  j["segment"] = segment;  // TODO(fangjun): Support endpointing
-  j["final"] = is_final;
-  return j.dump();
+  w->Key("segment");
+  w->Write(segment);  // TODO(fangjun): Support endpointing
+  w->Key("final");
+  w->Write(is_final);
+  w->EndObject();
+  return w->Str();
 }
 
 void OnlineRecognizerConfig::Register(ParseOptions *po) {
@@ -73,13 +100,62 @@ void OnlineRecognizerConfig::Register(ParseOptions *po) {
 
   po->Register("use-gpu", &use_gpu,
                "true to use GPU for computation. false to use CPU.\n"
-               "If true, it uses the first device. You can use the environment "
-               "variable CUDA_VISIBLE_DEVICES to select which device to use.");
+               "You can use the environment variable CUDA_VISIBLE_DEVICES "
+               "to control which devices are visible and --gpu-id to select "
+               "one of them.");
+
+  po->Register("gpu-id", &gpu_id,
+               "The device to use for computation. Used only "
+               "when --use-gpu is true.");
+
+  po->Register("num-cuda-streams", &num_cuda_streams,
+               "Number of CUDA streams used for decoding. Used only "
+               "when --use-gpu is true. If it is larger than 1, concurrent "
+               "calls to DecodeStreams() are issued on different CUDA "
+               "streams so that copies and computation of overlapping "
+               "batches can run in parallel.");
+
+  po->Register("use-fp16", &use_fp16,
+               "true to run the neural network in half precision (fp16). "
+               "Used only when --use-gpu is true. Supported only for "
+               "streaming Zipformer models.");
+
+  po->Register("use-cuda-graph", &use_cuda_graph,
+               "true to capture the encoder forward into CUDA Graphs, "
+               "one per batch size, and replay them on later ticks. "
+               "Used only when --use-gpu is true. Supported only for "
+               "streaming Zipformer models.");
+
+  po->Register("warm-cache-dir", &warm_cache_dir,
+               "If non-empty, cache a ready-to-run copy of the model in "
+               "this directory on the first start and load it directly on "
+               "later starts. Used only with --nn-model.");
+
+  po->Register("warmup-batch-sizes", &warmup_batch_sizes,
+               "Comma-separated list of batch sizes to run warmup with, "
+               "e.g., 1,8,16,32. Warm up every batch size production "
+               "traffic will use, so the first real batch of each size "
+               "does not pay for lazy kernel selection and allocator "
+               "growth.");
+
+  po->Register("profile-model", &profile_model,
+               "true to run a calibration pass at startup that times the "
+               "encoder, decoder and joiner for every batch size in "
+               "--warmup-batch-sizes on the warm model and prints one "
+               "JSON capability report (ms per batch size, bytes per "
+               "stream state, max sustainable streams at real time) to "
+               "stdout.");
 
   po->Register("use-endpoint", &use_endpoint,
                "true to enable Endpoint, false to disable Endpoint, "
                "default is false.\n");
 
+  po->Register("enable-timestamps", &enable_timestamps,
+               "false to skip per-token timestamp tracking; results then "
+               "carry empty timestamps. Streams can override it "
+               "individually, e.g., via the websocket 'timestamps: off' "
+               "message.");
+
   po->Register("decoding-method", &decoding_method,
                "Decoding method to use. Possible values are: greedy_search, "
                "modified_beam_search, and fast_beam_search. "
@@ -89,6 +165,53 @@ void OnlineRecognizerConfig::Register(ParseOptions *po) {
                "Number of active paths for modified_beam_search. "
                "Used only when --decoding-method is modified_beam_search");
 
+  po->Register("score-gap", &score_gap,
+               "Used only when --decoding-method is modified_beam_search. "
+               "Hypotheses whose log-prob is more than this below the best "
+               "one are pruned at insertion time. Values <= 0 disable gap "
+               "pruning.");
+
+  po->Register("context-phrases-file", &context_phrases_file,
+               "Used only when --decoding-method is modified_beam_search. "
+               "If non-empty, path to a file of context phrases for "
+               "hotword biasing, one phrase per line, written as space "
+               "separated tokens from the --tokens file, e.g., BPE "
+               "pieces.");
+
+  po->Register("context-score", &context_score,
+               "Used only with --context-phrases-file. Per-token bonus in "
+               "log space applied while a hypothesis is inside a context "
+               "phrase.");
+
+  po->Register("blank-skip-threshold", &blank_skip_threshold,
+               "Used only when --decoding-method is greedy_search. "
+               "Frames whose blank posterior exceeds this value for every "
+               "stream of a batch are skipped. Values >= 1 disable "
+               "skipping. A typical value is 0.98.");
+
+  po->Register("max-chunks-per-tick", &max_chunks_per_tick,
+               "Maximum number of chunks decoded per stream in one "
+               "DecodeStreams() call. A stream only has more than one "
+               "chunk buffered when decoding is falling behind the "
+               "incoming audio, so values > 1 let an overloaded server "
+               "catch up by paying the per-tick fixed cost once for "
+               "several chunks. 1 disables the catch-up.");
+
+  po->Register("max-encoder-batch", &max_encoder_batch,
+               "Maximum number of streams per encoder forward. A "
+               "DecodeStreams() call with more streams is split into "
+               "sequential sub-batches of (nearly) equal size, so one "
+               "oversized batch cannot hold the GPU for longer than a "
+               "sub-batch forward. 0 disables the cap.");
+
+  po->Register("encoder-time-budget-ms", &encoder_time_budget_ms,
+               "Per-call encoder time budget in milliseconds. If it is "
+               "larger than 0, the forward of every --warmup-batch-sizes "
+               "entry is timed during warmup and the largest calibrated "
+               "batch size whose forward fits the budget becomes an "
+               "additional cap on --max-encoder-batch. 0 disables the "
+               "calibration.");
+
   po->Register("decode-left-context", &left_context,
                "Used only for streaming Conformer, i.e, models from "
                "pruned_transducer_statelessX, "
@@ -147,6 +270,48 @@ void OnlineRecognizerConfig::Validate() const {
   if (decoding_method == "modified_beam_search") {
     SHERPA_CHECK_GT(num_active_paths, 0);
   }
+
+  if (!context_phrases_file.empty()) {
+    if (decoding_method != "modified_beam_search") {
+      SHERPA_LOG(FATAL) << "--context-phrases-file requires "
+                           "--decoding-method=modified_beam_search";
+    }
+    AssertFileExists(context_phrases_file);
+    SHERPA_CHECK_GT(context_score, 0);
+  }
+
+  if (decoding_method == "greedy_search") {
+    SHERPA_CHECK_GT(blank_skip_threshold, 0);
+  }
+
+  SHERPA_CHECK_GE(max_chunks_per_tick, 1);
+  SHERPA_CHECK_GE(max_encoder_batch, 0);
+  SHERPA_CHECK_GE(encoder_time_budget_ms, 0);
+
+  if (use_gpu) {
+    SHERPA_CHECK_GE(gpu_id, 0);
+  }
+
+  if (use_fp16 && !use_gpu) {
+    SHERPA_LOG(FATAL) << "--use-fp16 requires --use-gpu=true";
+  }
+
+  if (use_cuda_graph && !use_gpu) {
+    SHERPA_LOG(FATAL) << "--use-cuda-graph requires --use-gpu=true";
+  }
+
+  if (!warm_cache_dir.empty() && nn_model.empty()) {
+    SHERPA_LOG(FATAL) << "--warm-cache-dir is supported only with --nn-model";
+  }
+
+  auto batch_sizes = SplitStringToIntegers(warmup_batch_sizes);
+  if (batch_sizes.empty()) {
+    SHERPA_LOG(FATAL) << "Please provide at least one batch size in "
+                      << "--warmup-batch-sizes";
+  }
+  for (auto n : batch_sizes) {
+    SHERPA_CHECK_GT(n, 0);
+  }
 }
 
 std::string OnlineRecognizerConfig::ToString() const {
@@ -162,9 +327,25 @@ std::string OnlineRecognizerConfig::ToString() const {
   os << "decoder_model=\"" << decoder_model << "\", ";
   os << "joiner_model=\"" << joiner_model << "\", ";
   os << "use_gpu=" << (use_gpu ? "True" : "False") << "\", ";
+  os << "gpu_id=" << gpu_id << ", ";
+  os << "num_cuda_streams=" << num_cuda_streams << ", ";
+  os << "use_fp16=" << (use_fp16 ? "True" : "False") << "\", ";
+  os << "use_cuda_graph=" << (use_cuda_graph ? "True" : "False") << "\", ";
+  os << "warm_cache_dir=\"" << warm_cache_dir << "\", ";
+  os << "warmup_batch_sizes=\"" << warmup_batch_sizes << "\", ";
+  os << "profile_model=" << (profile_model ? "True" : "False") << ", ";
   os << "use_endpoint=" << (use_endpoint ? "True" : "False") << "\", ";
+  os << "enable_timestamps=" << (enable_timestamps ? "True" : "False")
+     << ", ";
   os << "decoding_method=\"" << decoding_method << "\", ";
   os << "num_active_paths=" << num_active_paths << ", ";
+  os << "score_gap=" << score_gap << ", ";
+  os << "context_phrases_file=\"" << context_phrases_file << "\", ";
+  os << "context_score=" << context_score << ", ";
+  os << "blank_skip_threshold=" << blank_skip_threshold << ", ";
+  os << "max_chunks_per_tick=" << max_chunks_per_tick << ", ";
+  os << "max_encoder_batch=" << max_encoder_batch << ", ";
+  os << "encoder_time_budget_ms=" << encoder_time_budget_ms << ", ";
   os << "left_context=" << left_context << ", ";
   os << "right_context=" << right_context << ", ";
   os << "chunk_size=" << chunk_size << ")";
@@ -174,19 +355,17 @@ std::string OnlineRecognizerConfig::ToString() const {
 static OnlineRecognitionResult Convert(const OnlineTransducerDecoderResult &src,
                                        const SymbolTable &sym_table,
                                        int32_t frame_shift_ms,
-                                       int32_t subsampling_factor) {
+                                       int32_t subsampling_factor,
+                                       const std::string &text) {
   OnlineRecognitionResult r;
   r.tokens.reserve(src.tokens.size());
   r.timestamps.reserve(src.timestamps.size());
+  r.token_ids = src.tokens;
 
-  std::string text;
   for (auto i : src.tokens) {
-    auto sym = sym_table[i];
-    text.append(sym);
-
-    r.tokens.push_back(std::move(sym));
+    r.tokens.push_back(sym_table[i]);
   }
-  r.text = std::move(text);
+  r.text = text;
 
   float frame_shift_s = frame_shift_ms / 1000. * subsampling_factor;
   for (auto t : src.timestamps) {
@@ -196,14 +375,108 @@ static OnlineRecognitionResult Convert(const OnlineTransducerDecoderResult &src,
   return r;
 }
 
+// 64-bit FNV-1a over a byte range; used for the warm model cache key.
+static uint64_t Fnv1a(const char *data, size_t n,
+                      uint64_t h = 14695981039346656037ULL) {
+  for (size_t i = 0; i != n; ++i) {
+    h ^= static_cast<uint8_t>(data[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// Recursively deep-copy every tensor contained in the given IValue.
+// Encoder states are tensors, tuples or lists of tensors depending on
+// the model type, so all three are handled.
+static torch::IValue CloneIValue(const torch::IValue &ivalue) {
+  if (ivalue.isTensor()) {
+    return ivalue.toTensor().clone();
+  }
+
+  if (ivalue.isTuple()) {
+    auto tuple = ivalue.toTuple();
+    std::vector<torch::IValue> elements;
+    elements.reserve(tuple->elements().size());
+    for (const auto &e : tuple->elements()) {
+      elements.push_back(CloneIValue(e));
+    }
+    return torch::ivalue::Tuple::create(std::move(elements));
+  }
+
+  if (ivalue.isList()) {
+    auto list = ivalue.toList();
+    c10::impl::GenericList ans(list.elementType());
+    ans.reserve(list.size());
+    for (size_t i = 0; i != list.size(); ++i) {
+      ans.push_back(CloneIValue(list.get(i)));
+    }
+    return ans;
+  }
+
+  return ivalue;
+}
+
+// Recursively sum the data bytes of every tensor contained in the given
+// IValue; used to size the encoder state of one stream.
+static int64_t IValueBytes(const torch::IValue &ivalue) {
+  if (ivalue.isTensor()) {
+    const auto &t = ivalue.toTensor();
+    return t.numel() * t.element_size();
+  }
+
+  int64_t ans = 0;
+  if (ivalue.isTuple()) {
+    for (const auto &e : ivalue.toTuple()->elements()) {
+      ans += IValueBytes(e);
+    }
+  } else if (ivalue.isList()) {
+    auto list = ivalue.toList();
+    for (size_t i = 0; i != list.size(); ++i) {
+      ans += IValueBytes(list.get(i));
+    }
+  }
+
+  return ans;
+}
+
 class OnlineRecognizer::OnlineRecognizerImpl {
  public:
   explicit OnlineRecognizerImpl(const OnlineRecognizerConfig &config)
       : config_(config),
-        symbol_table_(config.tokens),
         endpoint_(std::make_unique<Endpoint>(config.endpoint_config)) {
+    // Startup is dominated by a few long, independent phases; log how
+    // long each one takes so cold-start regressions can be attributed.
+    auto last_phase_end = std::chrono::steady_clock::now();
+    auto log_phase = [&last_phase_end](const char *phase) {
+      auto now = std::chrono::steady_clock::now();
+      SHERPA_LOG(INFO) << "Startup phase '" << phase << "' took "
+                       << std::chrono::duration<float>(now - last_phase_end)
+                              .count()
+                       << " s";
+      last_phase_end = now;
+    };
+
+    // Parsing a large BPE token table takes hundreds of milliseconds;
+    // do it on a side thread while TorchScript deserializes the model
+    // and the warmup runs. Joined before the decoder is built, the
+    // first consumer (context phrases).
+    auto symbol_table_future = std::async(
+        std::launch::async,
+        [&config]() { return SymbolTable(config.tokens); });
+
     if (config.use_gpu) {
-      device_ = torch::Device("cuda:0");
+      device_ = torch::Device(torch::kCUDA, config.gpu_id);
+
+#ifdef SHERPA_WITH_CUDA
+      if (config.num_cuda_streams > 1) {
+        cuda_streams_.reserve(config.num_cuda_streams);
+        for (int32_t i = 0; i != config.num_cuda_streams; ++i) {
+          cuda_streams_.push_back(
+              c10::cuda::getStreamFromPool(/*isHighPriority*/ false,
+                                           device_.index()));
+        }
+      }
+#endif
     }
 
     std::string class_name;
@@ -227,40 +500,74 @@ class OnlineRecognizer::OnlineRecognizerImpl {
             device_);
       }
     } else {
-      torch::jit::Module m = torch::jit::load(config.nn_model, torch::kCPU);
-      auto encoder = m.attr("encoder").toModule();
-      class_name = encoder.type()->name()->name();
+      std::string nn_model = config.nn_model;
+
+      std::string warm_cache_path;
+      bool has_warm_cache = false;
+      if (!config.warm_cache_dir.empty()) {
+        warm_cache_path = WarmCachePath();
+        has_warm_cache =
+            !warm_cache_path.empty() && FileExists(warm_cache_path);
+        if (has_warm_cache) {
+          SHERPA_LOG(INFO) << "Loading warm model cache " << warm_cache_path;
+          nn_model = warm_cache_path;
+        }
+      }
 
-      if (class_name == "Emformer") {
-        if (encoder.find_method("infer")) {
-          // Emformer from torchaudio
-          model_ = std::make_unique<OnlineConvEmformerTransducerModel>(
-              config.nn_model, device_);
-        } else {
-          // ConvEmformer from icefall
-          model_ = std::make_unique<OnlineEmformerTransducerModel>(
-              config.nn_model, device_);
+      torch::jit::Module m = torch::jit::load(nn_model, torch::kCPU);
+      class_name = m.type()->name()->name();
+      if (class_name == "ASRModel") {
+        // A streaming CTC Conformer exported by wenet, see
+        // https://github.com/wenet-e2e/wenet/blob/main/wenet/transformer/asr_model.py#L42
+        //
+        // --decode-chunk-size and --decode-left-context select the chunk
+        // geometry; both are in frames after subsampling.
+        SHERPA_CHECK_GT(config.chunk_size, 0);
+        is_ctc_ = true;
+        model_ = std::make_unique<OnlineWenetConformerCtcModel>(
+            nn_model, config.chunk_size,
+            config.left_context > 0 ? config.left_context / config.chunk_size
+                                    : -1,
+            device_);
+      } else {
+        auto encoder = m.attr("encoder").toModule();
+        class_name = encoder.type()->name()->name();
+
+        if (class_name == "Emformer") {
+          if (encoder.find_method("infer")) {
+            // Emformer from torchaudio
+            model_ = std::make_unique<OnlineConvEmformerTransducerModel>(
+                nn_model, device_);
+          } else {
+            // ConvEmformer from icefall
+            model_ = std::make_unique<OnlineEmformerTransducerModel>(nn_model,
+                                                                     device_);
+          }
+        } else if (class_name == "Conformer") {
+          int32_t left_context = config.left_context;
+          int32_t right_context = config.right_context;
+          int32_t chunk_size = config.chunk_size;
+          SHERPA_CHECK_GT(left_context, 0);
+          SHERPA_CHECK_GE(right_context, 0);
+          SHERPA_CHECK_GT(chunk_size, 0);
+
+          model_ = std::make_unique<OnlineConformerTransducerModel>(
+              nn_model, left_context, right_context, chunk_size, device_);
+        } else if (class_name == "Zipformer") {
+          // For OnlineZipformerTransducerModel
+          // model generated by torch.jit.script()
+          model_ = std::make_unique<OnlineZipformerTransducerModel>(nn_model,
+                                                                    device_);
+        } else if (class_name == "StreamingEncoderModel") {
+          // For OnlineZipformer2TransducerModel
+          // model generated by torch.jit.script()
+          model_ = std::make_unique<OnlineZipformer2TransducerModel>(nn_model,
+                                                                     device_);
         }
-      } else if (class_name == "Conformer") {
-        int32_t left_context = config.left_context;
-        int32_t right_context = config.right_context;
-        int32_t chunk_size = config.chunk_size;
-        SHERPA_CHECK_GT(left_context, 0);
-        SHERPA_CHECK_GE(right_context, 0);
-        SHERPA_CHECK_GT(chunk_size, 0);
-
-        model_ = std::make_unique<OnlineConformerTransducerModel>(
-            config.nn_model, left_context, right_context, chunk_size, device_);
-      } else if (class_name == "Zipformer") {
-        // For OnlineZipformerTransducerModel
-        // model generated by torch.jit.script()
-        model_ = std::make_unique<OnlineZipformerTransducerModel>(
-            config.nn_model, device_);
-      } else if (class_name == "StreamingEncoderModel") {
-        // For OnlineZipformer2TransducerModel
-        // model generated by torch.jit.script()
-        model_ = std::make_unique<OnlineZipformer2TransducerModel>(
-            config.nn_model, device_);
+      }
+
+      if (model_ && !warm_cache_path.empty() && !has_warm_cache) {
+        SaveWarmCache(std::move(m), warm_cache_path);
       }
     }
 
@@ -280,18 +587,50 @@ class OnlineRecognizer::OnlineRecognizerImpl {
          << "\n"
          << "zipformer"
          << "\n"
+         << "and streaming CTC Conformer models exported by wenet"
+         << "\n"
          << "Given: " << class_name << "\n";
       SHERPA_LOG(FATAL) << os.str();
     }
 
+    if (config.use_fp16) {
+      model_->UseFp16();
+    }
+
+    if (config.use_cuda_graph) {
+      model_->UseCudaGraph();
+    }
+
+    log_phase("load model");
+
     WarmUp();
+    log_phase("warmup");
+
+    symbol_table_ = symbol_table_future.get();
+    // Usually fully overlapped with the phases above, so ~0 s here.
+    log_phase("load symbol table");
 
-    if (config.decoding_method == "greedy_search") {
-      decoder_ =
-          std::make_unique<OnlineTransducerGreedySearchDecoder>(model_.get());
+    if (is_ctc_) {
+      if (config.decoding_method != "greedy_search") {
+        SHERPA_LOG(FATAL) << "Streaming CTC models support only "
+                             "--decoding-method=greedy_search. Given: "
+                          << config.decoding_method;
+      }
+
+      decoder_ = std::make_unique<OnlineCtcGreedySearchDecoder>();
+    } else if (config.decoding_method == "greedy_search") {
+      decoder_ = std::make_unique<OnlineTransducerGreedySearchDecoder>(
+          model_.get(), config.blank_skip_threshold);
     } else if (config.decoding_method == "modified_beam_search") {
+      if (!config.context_phrases_file.empty()) {
+        context_graph_ = std::make_unique<ContextGraph>(
+            ReadContextPhrases(config.context_phrases_file),
+            config.context_score);
+      }
+
       decoder_ = std::make_unique<OnlineTransducerModifiedBeamSearchDecoder>(
-          model_.get(), config.num_active_paths);
+          model_.get(), config.num_active_paths, config.score_gap,
+          context_graph_.get());
     } else if (config.decoding_method == "fast_beam_search") {
       config.fast_beam_search_config.Validate();
 
@@ -301,31 +640,231 @@ class OnlineRecognizer::OnlineRecognizerImpl {
       TORCH_CHECK(false,
                   "Unsupported decoding method: ", config.decoding_method);
     }
+
+    // The init states are a constant of the loaded model; compute them
+    // once so that every new stream gets a cheap device-side clone
+    // instead of running the TorchScript state-init method per stream.
+    init_states_ = model_->GetEncoderInitStates();
+    state_bytes_per_stream_ = IValueBytes(init_states_);
+    log_phase("build decoder and init states");
+
+    if (config.profile_model) {
+      ProfileModel();
+    }
   }
 
   std::unique_ptr<OnlineStream> CreateStream() {
-    auto s = std::make_unique<OnlineStream>(config_.feat_config.fbank_opts);
+    auto s = std::make_unique<OnlineStream>(
+        config_.feat_config.fbank_opts,
+        config_.feat_config.async_feature_computation);
+    s->SetChunkGeometry(model_->ChunkSize(), model_->ChunkShift());
+    s->SetEnableTimestamps(config_.enable_timestamps);
 
     auto r = decoder_->GetEmptyResult();
     s->SetResult(r);
 
-    auto state = model_->GetEncoderInitStates();
-    s->SetState(state);
+    // Streams own their state, so they get a clone of the cached init
+    // states rather than a reference to them.
+    s->SetState(CloneIValue(init_states_));
 
     return s;
   }
 
+  void ResetStream(OnlineStream *s) {
+    s->Reset();
+
+    auto r = decoder_->GetEmptyResult();
+    s->SetResult(r);
+
+    s->SetState(CloneIValue(init_states_));
+  }
+
+  void ResetStreamsForNextUtterance(OnlineStream **ss, int32_t n) {
+    for (int32_t i = 0; i != n; ++i) {
+      // The cached init states are only read here: each stream copies
+      // the values into the state tensors it already holds.
+      ss[i]->ResetForNextUtterance(init_states_);
+      ss[i]->SetResult(decoder_->GetEmptyResult());
+    }
+  }
+
   bool IsReady(OnlineStream *s) {
-    // TODO(fangjun): Pass chunk_size to OnlineStream on creation
-    int32_t chunk_size = model_->ChunkSize();
-    return s->NumFramesReady() - s->GetNumProcessedFrames() >= chunk_size;
+    return s->IsChunkReady(s->GetNumProcessedFrames() / model_->ChunkShift());
   }
 
-  void DecodeStreams(OnlineStream **ss, int32_t n) {
-    torch::NoGradGuard no_grad;
+  // A device-side processed_frames tensor reused across ticks, together
+  // with a host mirror of its content. When the buffer is handed the
+  // same streams in the same order as last time -- the steady state of
+  // the websocket server -- the new values are exactly the mirrored ones
+  // plus one chunk shift, so the tensor is brought up to date with a
+  // single in-place add instead of building a fresh host vector, tensor
+  // and H2D copy on every tick.
+  struct ProcessedFramesBuffer {
+    torch::Tensor tensor;         // (N,), torch::kLong, on the device
+    std::vector<int32_t> values;  // host mirror of `tensor`
+  };
+
+  // Intermediate data of one decode tick as it moves through the
+  // GatherFeatures -> RunNetwork -> UpdateStreams pipeline stages.
+  struct DecodeContext {
+    std::vector<OnlineTransducerDecoderResult> results;
+
+    torch::Tensor features;         // (N, chunk_size, feature_dim), device
+    torch::Tensor features_length;  // (N,), on device
+    ProcessedFramesBuffer processed_frames;
+    torch::IValue stacked_states;
+    torch::IValue state_buffer;
+#ifdef SHERPA_WITH_CUDA
+    torch::Tensor staging;
+#endif
 
+    torch::Tensor encoder_out;
+    torch::Tensor encoder_out_lens;
+    std::vector<torch::IValue> next_states;
+
+    // When set, the stage timings of this chunk are accumulated into
+    // it; see the stats overload of DecodeStreams().
+    OnlineDecodeStats *stats = nullptr;
+  };
+
+  // Effective cap on the number of streams per encoder forward: the
+  // smaller of --max-encoder-batch and the cap calibrated from
+  // --encoder-time-budget-ms during warmup. 0 means no cap.
+  int32_t EncoderBatchCap() const {
+    int32_t cap = config_.max_encoder_batch;
+    if (calibrated_encoder_batch_cap_ > 0 &&
+        (cap == 0 || calibrated_encoder_batch_cap_ < cap)) {
+      cap = calibrated_encoder_batch_cap_;
+    }
+    return cap;
+  }
+
+  void DecodeStreams(OnlineStream **ss, int32_t n,
+                     OnlineDecodeStats *stats = nullptr) {
     SHERPA_CHECK_GT(n, 0);
 
+    if (stats) {
+      *stats = OnlineDecodeStats();
+    }
+
+    // Cap the encoder batch size; see --max-encoder-batch and
+    // --encoder-time-budget-ms. An oversized ready-set is split into
+    // the fewest sub-batches that respect the cap, with sizes as equal
+    // as possible so no single forward runs longer than the others.
+    int32_t cap = EncoderBatchCap();
+    if (cap > 0 && n > cap) {
+      int32_t num_splits = (n + cap - 1) / cap;
+      int32_t base = n / num_splits;
+      int32_t remainder = n % num_splits;
+
+      int32_t offset = 0;
+      for (int32_t i = 0; i != num_splits; ++i) {
+        int32_t this_size = base + (i < remainder ? 1 : 0);
+        DecodeStreamsInternal(ss + offset, this_size, stats);
+        offset += this_size;
+      }
+      return;
+    }
+
+    DecodeStreamsInternal(ss, n, stats);
+  }
+
+  // The decode path is an explicit 3-stage pipeline. The stages of one
+  // call run back to back, but the CPU-only GatherFeatures() of the next
+  // tick (on another worker thread, on its own CUDA stream) overlaps the
+  // device-side RunNetwork() of the current one, so the CPU-side cost is
+  // hidden behind GPU compute at steady state.
+  void DecodeStreamsInternal(OnlineStream **ss, int32_t n,
+                             OnlineDecodeStats *stats = nullptr) {
+    torch::NoGradGuard no_grad;
+
+    // One span per decode call on row 0 of the trace, so the per-stream
+    // events of the sampled streams line up against the batch ticks.
+    int64_t trace_begin_us =
+        TraceRing::Get().Enabled() ? TraceRing::NowMicros() : 0;
+
+#ifdef SHERPA_WITH_CUDA
+    // Round-robin the CUDA streams over batches so that overlapping calls
+    // from different worker threads do not serialize on the default stream.
+    // The guard is restored when this function returns; we synchronize the
+    // chosen stream before handing the updated states back to the streams.
+    c10::optional<c10::cuda::CUDAStreamGuard> stream_guard;
+    if (!cuda_streams_.empty()) {
+      uint32_t i = next_cuda_stream_.fetch_add(1, std::memory_order_relaxed);
+      stream_guard.emplace(cuda_streams_[i % cuda_streams_.size()]);
+    }
+#endif
+
+    DecodeOneChunk(ss, n, stats);
+
+    // Catch-up mode: a stream only has further chunks buffered when
+    // decoding is falling behind the incoming audio. Draining up to
+    // --max-chunks-per-tick chunks per call amortizes the per-tick
+    // fixed cost over several chunks, so an overloaded server degrades
+    // into burstier latency instead of an ever-growing backlog. Extra
+    // chunks are decoded only while every stream of the batch has one
+    // ready, which keeps the batch in lockstep.
+    for (int32_t k = 1; k < config_.max_chunks_per_tick; ++k) {
+      bool all_ready = true;
+      for (int32_t i = 0; all_ready && i != n; ++i) {
+        all_ready = IsReady(ss[i]);
+      }
+      if (!all_ready) {
+        break;
+      }
+
+      DecodeOneChunk(ss, n, stats);
+    }
+
+    if (trace_begin_us) {
+      TraceRing::Get().AddEvent("DecodeStreams", /*tid=*/0, trace_begin_us,
+                                TraceRing::NowMicros() - trace_begin_us);
+    }
+  }
+
+  // Decode exactly one chunk of every stream through the 3-stage
+  // pipeline. Called by DecodeStreams(), possibly several times per
+  // tick; see --max-chunks-per-tick.
+  void DecodeOneChunk(OnlineStream **ss, int32_t n,
+                      OnlineDecodeStats *stats = nullptr) {
+    DecodeContext ctx;
+    ctx.stats = stats;
+    GatherFeatures(ss, n, &ctx);
+    RunNetwork(&ctx);
+
+#ifdef SHERPA_WITH_CUDA
+    if (!cuda_streams_.empty()) {
+      // Make sure all pending work on this stream, including the state
+      // update, has finished before another batch picks up these streams
+      // on a different CUDA stream.
+      c10::cuda::getCurrentCUDAStream(device_.index()).synchronize();
+    }
+#endif
+
+    UpdateStreams(ss, n, &ctx);
+
+#ifdef SHERPA_WITH_CUDA
+    if (ctx.staging.defined()) {
+      // The decoder above copies results back to the host, which
+      // synchronizes with the device, so the upload from this buffer has
+      // completed and it can be reused by the next batch.
+      ReleaseStagingBuffer(std::move(ctx.staging));
+    }
+#endif
+
+    // At this point the encoder has consumed the stacked states, so the
+    // buffer can be recycled for the next batch of this size.
+    ReleaseStateBuffer(n, std::move(ctx.state_buffer));
+    ReleaseProcessedFramesBuffer(n, std::move(ctx.processed_frames));
+  }
+
+  // Stage 1 (CPU only): collect chunk features, states and bookkeeping
+  // from the streams and move everything needed by the network onto the
+  // device.
+  void GatherFeatures(OnlineStream **ss, int32_t n, DecodeContext *ctx) {
+    ScopedNvtxRange nvtx_range("GatherFeatures", n);
+    SHERPA_LATENCY_BUDGET(GatherFeatures, 2000);
+
     auto device = model_->Device();
     int32_t chunk_size = model_->ChunkSize();
     int32_t chunk_shift = model_->ChunkShift();
@@ -333,63 +872,329 @@ class OnlineRecognizer::OnlineRecognizerImpl {
     std::vector<torch::Tensor> all_features(n);
     std::vector<torch::IValue> all_states(n);
     std::vector<int32_t> all_processed_frames(n);
-    std::vector<OnlineTransducerDecoderResult> all_results(n);
+    ctx->results.resize(n);
     for (int32_t i = 0; i != n; ++i) {
       OnlineStream *s = ss[i];
 
       SHERPA_CHECK(IsReady(s));
       int32_t num_processed_frames = s->GetNumProcessedFrames();
 
-      std::vector<torch::Tensor> features_vec(chunk_size);
-      for (int32_t k = 0; k != chunk_size; ++k) {
-        features_vec[k] = s->GetFrame(num_processed_frames + k);
+      // A single 2-D view of shape (chunk_size, feature_dim); the frames
+      // were prefetched into the stream's contiguous buffer when the
+      // samples arrived, so this is one lock acquisition and no feature
+      // extractor calls.
+      all_features[i] = s->GetChunk(num_processed_frames / chunk_shift);
+      all_states[i] = s->GetState();
+      all_processed_frames[i] = num_processed_frames;
+      ctx->results[i] = s->GetResult();
+    }  // for (int32_t i = 0; i != n; ++i) {
+
+    int32_t feature_dim = all_features[0].size(1);
+
+#ifdef SHERPA_WITH_CUDA
+    if (device.is_cuda()) {
+      // Stack into a reusable pinned staging buffer so that the H2D copy
+      // is asynchronous and can overlap computation already queued on the
+      // device.
+      ctx->staging = AcquireStagingBuffer(
+          static_cast<int64_t>(n) * chunk_size * feature_dim);
+      torch::Tensor pinned =
+          ctx->staging
+              .narrow(0, 0,
+                      static_cast<int64_t>(n) * chunk_size * feature_dim)
+              .view({n, chunk_size, feature_dim});
+      torch::stack_out(pinned, all_features, /*dim*/ 0);
+      ctx->features = pinned.to(device, /*non_blocking*/ true);
+    } else
+#endif
+    {
+      if (n == 1 && !config_.feat_config.streaming_cmvn) {
+        // Single-stream call, the dominant case on edge deployments:
+        // the chunk is already a contiguous 2-D view of the stream's
+        // feature buffer, so a size-1 batch dim view replaces the
+        // torch::stack copy. Not used with streaming CMVN, which
+        // normalizes ctx->features in place and must not write through
+        // to the stream's buffer.
+        ctx->features = all_features[0].unsqueeze(/*dim*/ 0).to(device);
+      } else {
+        ctx->features = torch::stack(all_features, /*dim*/ 0).to(device);
       }
+    }
+
+    if (config_.feat_config.streaming_cmvn) {
+      ApplyStreamingCmvn(ss, n, ctx);
+    }
+
+    ctx->features_length =
+        torch::full({n}, chunk_size, torch::kLong).to(device);
+
+    // Reuse a batched-state buffer from a previous tick with the same
+    // batch size so StackStates() does not allocate dozens of fresh
+    // tensors on every call.
+    ctx->state_buffer = AcquireStateBuffer(n);
+    {
+      ScopedNvtxRange stack_range("StackStates", n);
+      SHERPA_LATENCY_BUDGET(StackStates, 500);
+      SHERPA_PROF_SCOPE(stack_states);
+      auto begin = std::chrono::steady_clock::now();
+      ctx->stacked_states = model_->StackStates(all_states,
+                                                &ctx->state_buffer);
+      if (ctx->stats) {
+        ctx->stats->stack_states_seconds +=
+            std::chrono::duration<float>(std::chrono::steady_clock::now() -
+                                         begin)
+                .count();
+      }
+    }
+    // Reuse a device-side processed_frames tensor from a previous tick
+    // with the same batch size; see ProcessedFramesBuffer.
+    ctx->processed_frames = AcquireProcessedFramesBuffer(n);
+    auto &pf = ctx->processed_frames;
+
+    bool advanced_in_lockstep = static_cast<int32_t>(pf.values.size()) == n;
+    for (int32_t i = 0; advanced_in_lockstep && i != n; ++i) {
+      advanced_in_lockstep =
+          all_processed_frames[i] == pf.values[i] + chunk_shift;
+    }
+
+    if (advanced_in_lockstep) {
+      pf.tensor.add_(chunk_shift);
+    } else if (pf.tensor.defined()) {
+      pf.tensor.copy_(torch::tensor(all_processed_frames, torch::kLong),
+                      /*non_blocking*/ true);
+    } else {
+      pf.tensor = torch::tensor(all_processed_frames, torch::kLong).to(device);
+    }
+    pf.values = std::move(all_processed_frames);
+  }
+
+  // Streaming CMVN: update the exponential moving feature statistics of
+  // every stream from the current chunk and normalize the batched
+  // features with one fused scale-shift on the device. See
+  // FeatureConfig::streaming_cmvn.
+  void ApplyStreamingCmvn(OnlineStream **ss, int32_t n, DecodeContext *ctx) {
+    auto &features = ctx->features;  // (N, T, C), on the device
+    int32_t num_frames = features.size(1);
+
+    // First and second moments of the chunk, one batched reduction:
+    // chunk_stats[i][0] is the mean, chunk_stats[i][1] the mean square
+    // of the features of stream i.
+    auto chunk_stats = torch::stack(
+        {features.mean(/*dim*/ 1), features.square().mean(/*dim*/ 1)},
+        /*dim*/ 1);  // (N, 2, C)
+
+    // The per-frame decay folded into a single per-chunk factor.
+    float decay = std::pow(config_.feat_config.streaming_cmvn_decay,
+                           num_frames);
+
+    std::vector<torch::Tensor> all_stats(n);
+    for (int32_t i = 0; i != n; ++i) {
+      torch::Tensor &stats = ss[i]->GetCmvnStats();
+      if (!stats.defined()) {
+        // First chunk of the stream: the chunk statistics are the best
+        // estimate available.
+        stats = chunk_stats.index({i}).clone();
+      } else {
+        stats.mul_(decay).add_(chunk_stats.index({i}), 1 - decay);
+      }
+      all_stats[i] = stats;
+    }
+
+    auto stats = torch::stack(all_stats, /*dim*/ 0);  // (N, 2, C)
+    using torch::indexing::Slice;
+    auto mean = stats.index({Slice(), 0}).unsqueeze(1);  // (N, 1, C)
+    auto inv_std = (stats.index({Slice(), 1}).unsqueeze(1) - mean.square())
+                       .clamp_min(1e-5f)
+                       .rsqrt();
+
+    features.sub_(mean).mul_(inv_std);
+  }
+
+  // Stage 2 (device): encoder forward, search, and state unstacking.
+  void RunNetwork(DecodeContext *ctx) {
+    auto n = static_cast<int32_t>(ctx->results.size());
+    torch::IValue next_states;
+
+    {
+      ScopedNvtxRange encoder_range("RunEncoder", n);
+      auto begin = std::chrono::steady_clock::now();
+      std::tie(ctx->encoder_out, ctx->encoder_out_lens, next_states) =
+          model_->RunEncoder(ctx->features, ctx->features_length,
+                             ctx->processed_frames.tensor,
+                             ctx->stacked_states);
+      if (ctx->stats) {
+        ctx->stats->encoder_seconds +=
+            std::chrono::duration<float>(std::chrono::steady_clock::now() -
+                                         begin)
+                .count();
+      }
+    }
+
+    {
+      ScopedNvtxRange decode_range("Decode", n);
+      auto begin = std::chrono::steady_clock::now();
+      decoder_->Decode(ctx->encoder_out, &ctx->results);
+      if (ctx->stats) {
+        ctx->stats->search_seconds +=
+            std::chrono::duration<float>(std::chrono::steady_clock::now() -
+                                         begin)
+                .count();
+      }
+    }
+
+    {
+      ScopedNvtxRange unstack_range("UnStackStates", n);
+      SHERPA_LATENCY_BUDGET(UnStackStates, 500);
+      ctx->next_states = model_->UnStackStates(next_states);
+    }
+  }
+
+  // Stage 3 (CPU only): hand the updated results and states back to the
+  // streams.
+  void UpdateStreams(OnlineStream **ss, int32_t n, DecodeContext *ctx) {
+    SHERPA_LATENCY_BUDGET(UpdateStreams, 1000);
+    int32_t chunk_shift = model_->ChunkShift();
+
+    for (int32_t i = 0; i != n; ++i) {
+      OnlineStream *s = ss[i];
+      ctx->results[i].num_processed_frames += chunk_shift;
+      s->SetResult(ctx->results[i]);
+      s->SetState(std::move(ctx->next_states[i]));
+      s->GetNumProcessedFrames() += chunk_shift;  // TODO(fangjun): Remove it
+    }
+  }
+
+  void DecodeStreamsSpeculative(OnlineStream **ss, int32_t n,
+                                std::vector<OnlineRecognitionResult> *ans) {
+    ScopedNvtxRange nvtx_range("DecodeStreamsSpeculative", n);
+
+    auto device = model_->Device();
+    int32_t chunk_size = model_->ChunkSize();
+
+    std::vector<torch::Tensor> all_features(n);
+    std::vector<torch::IValue> all_states(n);
+    std::vector<int32_t> all_processed_frames(n);
+    std::vector<OnlineTransducerDecoderResult> results(n);
 
-      torch::Tensor features = torch::cat(features_vec, /*dim*/ 0);
+    for (int32_t i = 0; i != n; ++i) {
+      OnlineStream *s = ss[i];
+      int32_t num_processed_frames = s->GetNumProcessedFrames();
+      int32_t num_avail = s->NumFramesReady() - num_processed_frames;
+      SHERPA_CHECK_GT(num_avail, 0);
+      num_avail = std::min(num_avail, chunk_size);
+
+      torch::Tensor features = s->GetFrames(num_processed_frames, num_avail);
+      if (num_avail < chunk_size) {
+        // Pad by repeating the last frame: in log-mel space a zero row is
+        // loud wideband energy, while a held frame continues the current
+        // acoustics and disturbs the encoder the least.
+        auto last = features.narrow(0, num_avail - 1, 1)
+                        .expand({chunk_size - num_avail, features.size(1)});
+        features = torch::cat({features, last}, /*dim*/ 0);
+      }
 
-      all_features[i] = std::move(features);
+      all_features[i] = features;
       all_states[i] = s->GetState();
       all_processed_frames[i] = num_processed_frames;
-      all_results[i] = s->GetResult();
-    }  // for (int32_t i = 0; i != n; ++i) {
+      results[i] = s->GetResult();
+    }
 
-    auto batched_features = torch::stack(all_features, /*dim*/ 0);
-    batched_features = batched_features.to(device);
+    auto features = torch::stack(all_features, /*dim*/ 0).to(device);
 
-    torch::Tensor features_length =
-        torch::full({n}, chunk_size, torch::kLong).to(device);
+    if (config_.feat_config.streaming_cmvn) {
+      // Normalize with the current statistics without updating them, so
+      // speculation leaves the CMVN state of every stream untouched.
+      using torch::indexing::Slice;
+      auto chunk_stats = torch::stack(
+          {features.mean(/*dim*/ 1), features.square().mean(/*dim*/ 1)},
+          /*dim*/ 1);  // (N, 2, C)
+
+      std::vector<torch::Tensor> all_stats(n);
+      for (int32_t i = 0; i != n; ++i) {
+        const torch::Tensor &stats = ss[i]->GetCmvnStats();
+        all_stats[i] = stats.defined() ? stats : chunk_stats.index({i});
+      }
 
-    torch::IValue stacked_states = model_->StackStates(all_states);
-    torch::Tensor processed_frames =
+      auto stats = torch::stack(all_stats, /*dim*/ 0);  // (N, 2, C)
+      auto mean = stats.index({Slice(), 0}).unsqueeze(1);
+      auto inv_std = (stats.index({Slice(), 1}).unsqueeze(1) - mean.square())
+                         .clamp_min(1e-5f)
+                         .rsqrt();
+      features.sub_(mean).mul_(inv_std);
+    }
+
+    auto features_length =
+        torch::full({n}, chunk_size, torch::kLong).to(device);
+    auto processed_frames =
         torch::tensor(all_processed_frames, torch::kLong).to(device);
 
+    torch::IValue state_buffer = AcquireStateBuffer(n);
+    torch::IValue stacked_states =
+        model_->StackStates(all_states, &state_buffer);
+
     torch::Tensor encoder_out;
     torch::Tensor encoder_out_lens;
     torch::IValue next_states;
-
     std::tie(encoder_out, encoder_out_lens, next_states) = model_->RunEncoder(
-        batched_features, features_length, processed_frames, stacked_states);
+        features, features_length, processed_frames, stacked_states);
+
+    decoder_->Decode(encoder_out, &results);
 
-    decoder_->Decode(encoder_out, &all_results);
+    // next_states is the state delta of the padded chunk; it is dropped
+    // on the floor and nothing is written back to the streams, so the
+    // real decode of this audio later starts from exactly the same state
+    // as if this call had never happened.
+    ReleaseStateBuffer(n, std::move(state_buffer));
 
-    std::vector<torch::IValue> unstacked_states =
-        model_->UnStackStates(next_states);
+    float frame_shift_ms =
+        config_.feat_config.fbank_opts.frame_opts.frame_shift_ms;
 
+    ans->resize(n);
     for (int32_t i = 0; i != n; ++i) {
-      OnlineStream *s = ss[i];
-      all_results[i].num_processed_frames += chunk_shift;
-      s->SetResult(all_results[i]);
-      s->SetState(std::move(unstacked_states[i]));
-      s->GetNumProcessedFrames() += chunk_shift;  // TODO(fangjun): Remove it
+      auto r = results[i];
+      decoder_->StripLeadingBlanks(&r);
+
+      // Convert the tokens from scratch instead of through the stream's
+      // incremental conversion cache: the cache belongs to the committed
+      // results and must not learn about speculative tokens.
+      std::string text;
+      for (auto t : r.tokens) {
+        text.append(symbol_table_[t]);
+      }
+
+      (*ans)[i] = Convert(r, symbol_table_, frame_shift_ms,
+                          model_->SubsamplingFactor(), text);
+      (*ans)[i].segment = ss[i]->GetWavSegment();
+      (*ans)[i].start_time = ss[i]->GetStartFrame() * frame_shift_ms / 1000.;
     }
   }
 
   OnlineRecognitionResult GetResult(OnlineStream *s) {
     auto r = s->GetResult();  // we use a copy here as we will change it below
     decoder_->StripLeadingBlanks(&r);
+
+    // Convert only tokens that were appended since the last call; the
+    // already-converted prefix and its text live in the stored result.
+    // Each token ID maps to a fixed UTF-8 string in the symbol table
+    // (the BPE word marker is replaced by a space at load time), so
+    // per-token appending yields exactly the same text as a full
+    // re-conversion.
+    auto &cache = s->GetResult();
+    if (cache.converted_tokens.size() > r.tokens.size() ||
+        !std::equal(cache.converted_tokens.begin(),
+                    cache.converted_tokens.end(), r.tokens.begin())) {
+      // Beam search switched to a hypothesis with a different prefix.
+      cache.converted_tokens.clear();
+      cache.converted_text.clear();
+    }
+    for (size_t i = cache.converted_tokens.size(); i != r.tokens.size(); ++i) {
+      cache.converted_text.append(symbol_table_[r.tokens[i]]);
+      cache.converted_tokens.push_back(r.tokens[i]);
+    }
+
     auto ans = Convert(r, symbol_table_,
                        config_.feat_config.fbank_opts.frame_opts.frame_shift_ms,
-                       model_->SubsamplingFactor());
+                       model_->SubsamplingFactor(), cache.converted_text);
 
     if (!IsReady(s) && s->IsLastFrame(s->NumFramesReady() - 1)) {
       ans.is_final = true;
@@ -417,19 +1222,277 @@ class OnlineRecognizer::OnlineRecognizerImpl {
         config_.feat_config.fbank_opts.frame_opts.frame_shift_ms / 1000.0);
   }
 
+  void IsEndpointBatch(OnlineStream **ss, int32_t n, bool *is_endpoint) const {
+    int32_t subsampling_factor = model_->SubsamplingFactor();
+
+    std::vector<int32_t> num_frames_decoded(n);
+    std::vector<int32_t> trailing_silence_frames(n);
+    for (int32_t i = 0; i != n; ++i) {
+      num_frames_decoded[i] =
+          ss[i]->GetNumProcessedFrames() - ss[i]->GetStartFrame();
+      trailing_silence_frames[i] =
+          ss[i]->GetNumTrailingBlankFrames() * subsampling_factor;
+    }
+
+    endpoint_->IsEndpointBatch(
+        num_frames_decoded.data(), trailing_silence_frames.data(), n,
+        config_.feat_config.fbank_opts.frame_opts.frame_shift_ms / 1000.0,
+        is_endpoint);
+  }
+
+  float GetTrailingSilence(OnlineStream *s) const {
+    return s->GetNumTrailingBlankFrames() * model_->SubsamplingFactor() *
+           config_.feat_config.fbank_opts.frame_opts.frame_shift_ms / 1000.0;
+  }
+
+  float ChunkDurationSeconds() const {
+    return model_->ChunkShift() *
+           config_.feat_config.fbank_opts.frame_opts.frame_shift_ms / 1000.0f;
+  }
+
+  bool SkipChunkIfSilent(OnlineStream *s, float threshold) {
+    int32_t chunk_shift = model_->ChunkShift();
+    int32_t chunk_index = s->GetNumProcessedFrames() / chunk_shift;
+    torch::Tensor chunk = s->GetChunk(chunk_index);
+
+    if (chunk.mean().item<float>() >= threshold) {
+      return false;
+    }
+
+    // Advance the frame bookkeeping exactly as a decoded chunk would, so
+    // the timestamps of tokens decoded after the stream wakes up and the
+    // endpoint detection are unaffected by the skip.
+    int32_t num_out_frames = chunk_shift / model_->SubsamplingFactor();
+    auto r = s->GetResult();
+    r.frame_offset += num_out_frames;
+    r.num_trailing_blanks += num_out_frames;
+    r.num_processed_frames += chunk_shift;
+    s->SetResult(r);
+    s->GetNumProcessedFrames() += chunk_shift;
+
+    return true;
+  }
+
   const OnlineRecognizerConfig &GetConfig() const { return config_; }
 
+  void SetNumActivePaths(int32_t n) { decoder_->SetNumActivePaths(n); }
+
  private:
+  /** Return a batched-state buffer previously released for batch size `n`,
+   * or an uninitialized IValue if none is available. See
+   * OnlineTransducerModel::StackStates(states, buffer).
+   */
+  torch::IValue AcquireStateBuffer(int32_t n) {
+    std::lock_guard<std::mutex> lock(state_buffer_mutex_);
+    auto it = state_buffers_.find(n);
+    if (it == state_buffers_.end() || it->second.empty()) {
+      return torch::IValue();
+    }
+
+    torch::IValue buffer = std::move(it->second.back());
+    it->second.pop_back();
+    return buffer;
+  }
+
+  void ReleaseStateBuffer(int32_t n, torch::IValue buffer) {
+    if (buffer.isNone()) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(state_buffer_mutex_);
+    state_buffers_[n].push_back(std::move(buffer));
+  }
+
+  /** Return a processed_frames buffer previously released for batch size
+   * `n`, or an empty one if none is available.
+   */
+  ProcessedFramesBuffer AcquireProcessedFramesBuffer(int32_t n) {
+    std::lock_guard<std::mutex> lock(processed_frames_mutex_);
+    auto it = processed_frames_buffers_.find(n);
+    if (it == processed_frames_buffers_.end() || it->second.empty()) {
+      return {};
+    }
+
+    ProcessedFramesBuffer buffer = std::move(it->second.back());
+    it->second.pop_back();
+    return buffer;
+  }
+
+  void ReleaseProcessedFramesBuffer(int32_t n, ProcessedFramesBuffer buffer) {
+    if (!buffer.tensor.defined()) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(processed_frames_mutex_);
+    processed_frames_buffers_[n].push_back(std::move(buffer));
+  }
+
+#ifdef SHERPA_WITH_CUDA
+  /** Return a 1-D pinned CPU float tensor with at least `numel` elements.
+   *
+   * A buffer released by a previous batch is reused when it is large
+   * enough; otherwise a new one is allocated. Buffers are never shrunk,
+   * so after warmup the pool is sized by the largest batch seen.
+   */
+  torch::Tensor AcquireStagingBuffer(int64_t numel) {
+    {
+      std::lock_guard<std::mutex> lock(staging_mutex_);
+      for (auto it = staging_buffers_.begin(); it != staging_buffers_.end();
+           ++it) {
+        if (it->numel() >= numel) {
+          torch::Tensor buf = std::move(*it);
+          staging_buffers_.erase(it);
+          return buf;
+        }
+      }
+    }
+
+    return torch::empty(
+        {numel},
+        torch::TensorOptions().dtype(torch::kFloat).pinned_memory(true));
+  }
+
+  void ReleaseStagingBuffer(torch::Tensor buf) {
+    std::lock_guard<std::mutex> lock(staging_mutex_);
+    staging_buffers_.push_back(std::move(buf));
+  }
+#endif
+
+  /** Path of the warm model cache entry for config_.nn_model.
+   *
+   * The key covers the model path, its size and modification time and
+   * whether the cached copy is in half precision, so a changed model
+   * file never hits a stale entry. Returns an empty string if the model
+   * file cannot be stat'ed.
+   */
+  std::string WarmCachePath() const {
+    struct stat st;
+    if (stat(config_.nn_model.c_str(), &st) != 0) {
+      SHERPA_LOG(WARNING) << "Failed to stat " << config_.nn_model
+                          << "; the warm cache is not used";
+      return "";
+    }
+
+    std::ostringstream os;
+    os << config_.nn_model << ":" << st.st_size << ":" << st.st_mtime << ":"
+       << config_.use_fp16;
+    std::string key = os.str();
+
+    std::ostringstream path;
+    path << config_.warm_cache_dir << "/" << std::hex
+         << Fnv1a(key.data(), key.size()) << ".pt";
+    return path.str();
+  }
+
+  /** Save a ready-to-run copy of the model to the warm cache.
+   *
+   * The copy is in eval mode and, with use_fp16, its weights are
+   * already converted to half precision, so the cached file is half the
+   * size and later starts skip both the conversion and half of the
+   * deserialization I/O.
+   *
+   * The file is written to a temporary name first and then renamed, so
+   * concurrent server starts sharing a cache directory never observe a
+   * partially written entry. Failures only cost us the cache.
+   */
+  void SaveWarmCache(torch::jit::Module m, const std::string &path) const {
+    m.eval();
+    if (config_.use_fp16) {
+      m.to(torch::kHalf);
+    }
+
+    std::ostringstream os;
+    os << path << "." << reinterpret_cast<uintptr_t>(this) << "-"
+       << std::chrono::steady_clock::now().time_since_epoch().count()
+       << ".tmp";
+    std::string tmp = os.str();
+
+    try {
+      m.save(tmp);
+    } catch (const c10::Error &e) {
+      SHERPA_LOG(WARNING) << "Failed to save warm model cache " << tmp << ": "
+                          << e.what();
+      std::remove(tmp.c_str());
+      return;
+    }
+
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+      SHERPA_LOG(WARNING) << "Failed to rename " << tmp << " to " << path;
+      std::remove(tmp.c_str());
+    } else {
+      SHERPA_LOG(INFO) << "Saved warm model cache " << path;
+    }
+  }
+
   void WarmUp() {
     SHERPA_LOG(INFO) << "WarmUp begins";
-    torch::Tensor features =
-        torch::rand({1, model_->ChunkSize(),
-                     config_.feat_config.fbank_opts.mel_opts.num_bins},
-                    device_);
-    torch::Tensor features_length =
-        torch::full({features.size(0)}, model_->ChunkSize(), torch::kLong)
-            .to(device_);
-    model_->WarmUp(features, features_length);
+
+    // With --encoder-time-budget-ms, every batch size is run a second
+    // time once it is warm and that forward is timed; see
+    // CalibrateEncoderBatchCap(). The first (cold) forward is not
+    // representative: it pays exactly the lazy-initialization costs the
+    // warmup exists to absorb.
+    bool calibrate_time = config_.encoder_time_budget_ms > 0;
+    std::map<int32_t, double> forward_seconds;
+
+    // Run one forward through the encoder, decoder and joiner for every
+    // batch size production traffic will use, so the first real batch of
+    // each size does not trigger lazy kernel selection or allocator
+    // growth.
+    for (auto n : SplitStringToIntegers(config_.warmup_batch_sizes)) {
+      torch::Tensor features =
+          torch::rand({n, model_->ChunkSize(),
+                       config_.feat_config.fbank_opts.mel_opts.num_bins},
+                      device_);
+      torch::Tensor features_length =
+          torch::full({features.size(0)}, model_->ChunkSize(), torch::kLong)
+              .to(device_);
+
+#ifdef SHERPA_WITH_CUDA
+      if (device_.is_cuda()) {
+        // Calibrate the activation footprint of this batch size while we
+        // are at it: the peak allocation of the warmup forward is the
+        // worst case a real batch of this size can reach, since warmup
+        // runs full chunks. See EstimateActivationBytes().
+        namespace alloc = c10::cuda::CUDACachingAllocator;
+        constexpr auto kAggregate = 0;  // StatType::AGGREGATE
+
+        alloc::resetPeakStats(device_.index());
+        int64_t before = alloc::getDeviceStats(device_.index())
+                             .allocated_bytes[kAggregate]
+                             .current;
+        model_->WarmUp(features, features_length);
+        int64_t peak = alloc::getDeviceStats(device_.index())
+                           .allocated_bytes[kAggregate]
+                           .peak;
+        activation_bytes_[n] = std::max<int64_t>(peak - before, 0);
+
+        if (calibrate_time) {
+          c10::cuda::getCurrentCUDAStream(device_.index()).synchronize();
+          auto begin = std::chrono::steady_clock::now();
+          model_->WarmUp(features, features_length);
+          c10::cuda::getCurrentCUDAStream(device_.index()).synchronize();
+          forward_seconds[n] = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - begin)
+                                   .count();
+        }
+        continue;
+      }
+#endif
+      model_->WarmUp(features, features_length);
+
+      if (calibrate_time) {
+        auto begin = std::chrono::steady_clock::now();
+        model_->WarmUp(features, features_length);
+        forward_seconds[n] = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - begin)
+                                 .count();
+      }
+    }
+
+    if (calibrate_time) {
+      CalibrateEncoderBatchCap(forward_seconds);
+    }
 
 #if 0
     // We don't use the following code since we want to set `model_->vocab_size`
@@ -447,13 +1510,303 @@ class OnlineRecognizer::OnlineRecognizerImpl {
     SHERPA_LOG(INFO) << "WarmUp ended";
   }
 
+  // Turn the warm forward times measured during warmup into a cap on
+  // the encoder batch size: the largest calibrated batch size whose
+  // forward fits --encoder-time-budget-ms. Batches larger than the cap
+  // are split by DecodeStreams(); see EncoderBatchCap().
+  void CalibrateEncoderBatchCap(
+      const std::map<int32_t, double> &forward_seconds) {
+    if (forward_seconds.empty()) {
+      return;
+    }
+
+    double budget = config_.encoder_time_budget_ms / 1000.0;
+
+    int32_t cap = 0;
+    for (const auto &p : forward_seconds) {
+      if (p.second <= budget) {
+        cap = p.first;
+      }
+    }
+
+    if (cap == 0) {
+      // Even the smallest calibrated batch size exceeds the budget.
+      // Splitting further cannot help, so keep the smallest one and let
+      // the operator know the budget is not achievable.
+      cap = forward_seconds.begin()->first;
+      SHERPA_LOG(WARNING)
+          << "A warm forward of batch size " << cap << " takes "
+          << forward_seconds.begin()->second * 1000 << " ms, more than "
+          << "--encoder-time-budget-ms=" << config_.encoder_time_budget_ms
+          << ". Capping encoder batches at " << cap << " anyway.";
+    }
+
+    calibrated_encoder_batch_cap_ = cap;
+    SHERPA_LOG(INFO) << "Encoder batch cap calibrated to " << cap
+                     << " for a budget of " << config_.encoder_time_budget_ms
+                     << " ms per forward";
+  }
+
+  // The calibration pass behind --profile-model. Times the encoder,
+  // decoder and joiner separately for every batch size of
+  // --warmup-batch-sizes -- the model is warm by now, so the numbers
+  // are representative -- and prints one JSON capability report to
+  // stdout: ms per stage and batch size, the activation and per-stream
+  // state footprints, and the number of streams each batch size
+  // sustains at real time. Capacity planning for a new model export
+  // then reads this report instead of a day of manual benchmarking.
+  void ProfileModel() {
+    torch::NoGradGuard no_grad;
+    constexpr int32_t kIters = 10;
+
+    auto sync = [this]() {
+#ifdef SHERPA_WITH_CUDA
+      if (device_.is_cuda()) {
+        c10::cuda::getCurrentCUDAStream(device_.index()).synchronize();
+      }
+#endif
+    };
+
+    // Average warm time of kIters runs of one stage, in seconds.
+    auto time_stage = [&sync](auto &&stage) -> double {
+      sync();
+      auto begin = std::chrono::steady_clock::now();
+      for (int32_t i = 0; i != kIters; ++i) {
+        stage();
+      }
+      sync();
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           begin)
+                 .count() /
+             kIters;
+    };
+
+    // Audio seconds consumed per encoder forward: a stream advances by
+    // ChunkShift() feature frames of frame_shift_ms each.
+    float chunk_seconds =
+        model_->ChunkShift() *
+        config_.feat_config.fbank_opts.frame_opts.frame_shift_ms / 1000.0f;
+
+    auto *w = GetThreadLocalJsonWriter();
+    w->Reset();
+    w->StartObject();
+    w->Key("model");
+    w->Write(config_.nn_model.empty() ? config_.encoder_model
+                                      : config_.nn_model);
+    w->Key("device");
+    w->Write(device_.str());
+    w->Key("chunk_seconds");
+    w->Write(chunk_seconds, 4);
+    w->Key("state_bytes_per_stream");
+    w->Write(state_bytes_per_stream_);
+    w->Key("batch_sizes");
+    w->StartArray();
+
+    for (auto n : SplitStringToIntegers(config_.warmup_batch_sizes)) {
+      torch::Tensor features =
+          torch::rand({n, model_->ChunkSize(),
+                       config_.feat_config.fbank_opts.mel_opts.num_bins},
+                      device_);
+      torch::Tensor features_length =
+          torch::full({n}, model_->ChunkSize(), torch::kLong).to(device_);
+      torch::Tensor num_processed_frames = torch::zeros_like(features_length);
+      torch::IValue states = model_->StackStates(
+          std::vector<torch::IValue>(n, init_states_));
+
+      torch::Tensor encoder_out;
+      double encoder_seconds = time_stage([&]() {
+        torch::Tensor encoder_out_length;
+        torch::IValue next_states;
+        std::tie(encoder_out, encoder_out_length, next_states) =
+            model_->RunEncoder(features, features_length,
+                               num_processed_frames, states);
+      });
+
+      // CTC models have no decoder network or joiner to profile.
+      double decoder_seconds = 0;
+      double joiner_seconds = 0;
+      if (!is_ctc_) {
+        torch::Tensor decoder_input =
+            torch::zeros({n, model_->ContextSize()}, torch::kLong)
+                .to(device_);
+
+        torch::Tensor decoder_out;
+        decoder_seconds = time_stage([&]() {
+          decoder_out = model_->RunDecoder(decoder_input).squeeze(1);
+        });
+
+        auto cur_encoder_out =
+            encoder_out.index({torch::indexing::Slice(), 0});
+        joiner_seconds = time_stage(
+            [&]() { model_->RunJoiner(cur_encoder_out, decoder_out); });
+      }
+
+      double total_seconds = encoder_seconds + decoder_seconds +
+                             joiner_seconds;
+
+      w->StartObject();
+      w->Key("batch_size");
+      w->Write(n);
+      w->Key("encoder_ms");
+      w->Write(static_cast<float>(encoder_seconds * 1000), 3);
+      w->Key("decoder_ms");
+      w->Write(static_cast<float>(decoder_seconds * 1000), 3);
+      w->Key("joiner_ms");
+      w->Write(static_cast<float>(joiner_seconds * 1000), 3);
+      w->Key("total_ms");
+      w->Write(static_cast<float>(total_seconds * 1000), 3);
+
+      auto it = activation_bytes_.find(n);
+      if (it != activation_bytes_.end()) {
+        w->Key("activation_bytes");
+        w->Write(it->second);
+      }
+
+      // One forward of this batch size covers n * chunk_seconds of
+      // audio, so rtf < 1 means the batch keeps up with real time and
+      // 1 / rtf such batches -- i.e., max_streams_at_rtf1 streams --
+      // saturate the device.
+      float rtf = total_seconds / (n * chunk_seconds);
+      w->Key("rtf");
+      w->Write(rtf, 4);
+      w->Key("max_streams_at_rtf1");
+      w->Write(static_cast<int32_t>(n * chunk_seconds / total_seconds));
+      w->EndObject();
+    }
+
+    w->EndArray();
+    w->EndObject();
+
+    std::cout << w->Str() << "\n";
+  }
+
+  void RunForward(const torch::Tensor &features) {
+    torch::Tensor f = features.to(device_);
+    torch::Tensor features_length =
+        torch::full({f.size(0)}, f.size(1), torch::kLong).to(device_);
+    model_->WarmUp(f, features_length);
+
+#ifdef SHERPA_WITH_CUDA
+    if (device_.is_cuda()) {
+      c10::cuda::getCurrentCUDAStream(device_.index()).synchronize();
+    }
+#endif
+  }
+
+  int64_t GetStateBytesPerStream() const { return state_bytes_per_stream_; }
+
+  int64_t EstimateActivationBytes(int32_t batch_size) const {
+    if (batch_size <= 0 || activation_bytes_.empty()) {
+      return 0;
+    }
+
+    // Round up to the next calibrated batch size; past the largest one,
+    // scale it linearly as a conservative extrapolation.
+    auto it = activation_bytes_.lower_bound(batch_size);
+    if (it != activation_bytes_.end()) {
+      return it->second;
+    }
+
+    const auto &largest = *activation_bytes_.rbegin();
+    return largest.second * batch_size / largest.first;
+  }
+
+ private:
+  // Read the context phrases for hotword biasing: one phrase per line,
+  // space separated tokens from the --tokens file. The BPE word marker
+  // is accepted both in its original form and as the leading space it
+  // is replaced with when the symbol table is loaded.
+  std::vector<std::vector<int32_t>> ReadContextPhrases(
+      const std::string &filename) const {
+    std::ifstream is(filename);
+    std::vector<std::vector<int32_t>> phrases;
+
+    std::string line;
+    while (std::getline(is, line)) {
+      std::istringstream iss(line);
+      std::vector<int32_t> phrase;
+
+      std::string sym;
+      while (iss >> sym) {
+        if (!symbol_table_.contains(sym) && sym.size() >= 3) {
+          // For BPE-based models, ▁ was replaced with a space when the
+          // symbol table was loaded.
+          // Unicode 9601, hex 0x2581, utf8 0xe29681
+          const uint8_t *p = reinterpret_cast<const uint8_t *>(sym.c_str());
+          if (p[0] == 0xe2 && p[1] == 0x96 && p[2] == 0x81) {
+            sym = sym.replace(0, 3, " ");
+          }
+        }
+
+        SHERPA_CHECK(symbol_table_.contains(sym))
+            << "Unknown token '" << sym << "' in context phrase: " << line;
+        phrase.push_back(symbol_table_[sym]);
+      }
+
+      if (!phrase.empty()) {
+        phrases.push_back(std::move(phrase));
+      }
+    }
+
+    SHERPA_CHECK(!phrases.empty())
+        << "No context phrases found in " << filename;
+
+    return phrases;
+  }
+
  private:
   OnlineRecognizerConfig config_;
   torch::Device device_{"cpu"};
+#ifdef SHERPA_WITH_CUDA
+  std::vector<c10::cuda::CUDAStream> cuda_streams_;
+  std::atomic<uint32_t> next_cuda_stream_{0};
+
+  // Pool of pinned CPU buffers used to stage features for H2D copies.
+  // Protected by staging_mutex_ since DecodeStreams() may be called
+  // concurrently from several worker threads.
+  std::mutex staging_mutex_;
+  std::vector<torch::Tensor> staging_buffers_;
+#endif
+  // Used only for modified_beam_search with --context-phrases-file.
+  // Declared before decoder_, which keeps a raw pointer to it.
+  std::unique_ptr<ContextGraph> context_graph_;
+
   std::unique_ptr<OnlineTransducerModel> model_;
   std::unique_ptr<OnlineTransducerDecoder> decoder_;
+  // true if model_ is a streaming CTC model; see OnlineCtcModel.
+  bool is_ctc_ = false;
   SymbolTable symbol_table_;
   std::unique_ptr<Endpoint> endpoint_;
+
+  // Encoder init states computed once at construction; see
+  // CreateStream(). Treated as read-only afterwards.
+  torch::IValue init_states_;
+
+  // Data bytes of init_states_, i.e., the device footprint of one
+  // stream's encoder state; see GetStateBytesPerStream().
+  int64_t state_bytes_per_stream_ = 0;
+
+  // Peak allocation of a warmup forward, keyed by batch size; written
+  // only during WarmUp() and read-only afterwards. Empty on CPU. See
+  // EstimateActivationBytes().
+  std::map<int32_t, int64_t> activation_bytes_;
+
+  // Largest calibrated batch size whose warm forward fits
+  // --encoder-time-budget-ms; written only during WarmUp() and
+  // read-only afterwards. 0 when the calibration is disabled. See
+  // EncoderBatchCap().
+  int32_t calibrated_encoder_batch_cap_ = 0;
+
+  // Reusable batched-state buffers keyed by batch size. Protected by
+  // state_buffer_mutex_ since DecodeStreams() may be called concurrently.
+  std::mutex state_buffer_mutex_;
+  std::unordered_map<int32_t, std::vector<torch::IValue>> state_buffers_;
+
+  // Reusable device-side processed_frames tensors keyed by batch size;
+  // see ProcessedFramesBuffer. Protected by processed_frames_mutex_.
+  std::mutex processed_frames_mutex_;
+  std::unordered_map<int32_t, std::vector<ProcessedFramesBuffer>>
+      processed_frames_buffers_;
 };
 
 OnlineRecognizer::OnlineRecognizer(const OnlineRecognizerConfig &config)
@@ -465,17 +1818,47 @@ std::unique_ptr<OnlineStream> OnlineRecognizer::CreateStream() {
   return impl_->CreateStream();
 }
 
+void OnlineRecognizer::ResetStream(OnlineStream *s) { impl_->ResetStream(s); }
+
+void OnlineRecognizer::ResetStreamsForNextUtterance(OnlineStream **ss,
+                                                    int32_t n) {
+  impl_->ResetStreamsForNextUtterance(ss, n);
+}
+
 bool OnlineRecognizer::IsReady(OnlineStream *s) { return impl_->IsReady(s); }
 
 bool OnlineRecognizer::IsEndpoint(OnlineStream *s) {
   return impl_->IsEndpoint(s);
 }
 
+void OnlineRecognizer::IsEndpointBatch(OnlineStream **ss, int32_t n,
+                                       bool *is_endpoint) {
+  impl_->IsEndpointBatch(ss, n, is_endpoint);
+}
+
+float OnlineRecognizer::GetTrailingSilence(OnlineStream *s) const {
+  return impl_->GetTrailingSilence(s);
+}
+
+float OnlineRecognizer::ChunkDurationSeconds() const {
+  return impl_->ChunkDurationSeconds();
+}
+
+bool OnlineRecognizer::SkipChunkIfSilent(OnlineStream *s, float threshold) {
+  return impl_->SkipChunkIfSilent(s, threshold);
+}
+
 void OnlineRecognizer::DecodeStreams(OnlineStream **ss, int32_t n) {
   torch::NoGradGuard no_grad;
   impl_->DecodeStreams(ss, n);
 }
 
+void OnlineRecognizer::DecodeStreams(OnlineStream **ss, int32_t n,
+                                     OnlineDecodeStats *stats) {
+  torch::NoGradGuard no_grad;
+  impl_->DecodeStreams(ss, n, stats);
+}
+
 OnlineRecognitionResult OnlineRecognizer::GetResult(OnlineStream *s) {
   return impl_->GetResult(s);
 }
@@ -484,4 +1867,47 @@ const OnlineRecognizerConfig &OnlineRecognizer::GetConfig() const {
   return impl_->GetConfig();
 }
 
+void OnlineRecognizer::SetNumActivePaths(int32_t n) {
+  impl_->SetNumActivePaths(n);
+}
+
+void OnlineRecognizer::DecodeStreamsSpeculative(
+    OnlineStream **ss, int32_t n,
+    std::vector<OnlineRecognitionResult> *results) {
+  torch::NoGradGuard no_grad;
+  impl_->DecodeStreamsSpeculative(ss, n, results);
+}
+
+void OnlineRecognizer::RunForward(const torch::Tensor &features) {
+  torch::NoGradGuard no_grad;
+  impl_->RunForward(features);
+}
+
+int64_t OnlineRecognizer::GetStateBytesPerStream() const {
+  return impl_->GetStateBytesPerStream();
+}
+
+int64_t OnlineRecognizer::EstimateActivationBytes(int32_t batch_size) const {
+  return impl_->EstimateActivationBytes(batch_size);
+}
+
+bool OnlineRecognizer::GetCudaMemoryStats(int32_t device,
+                                          int64_t *allocated_bytes,
+                                          int64_t *reserved_bytes) {
+#ifdef SHERPA_WITH_CUDA
+  namespace alloc = c10::cuda::CUDACachingAllocator;
+  constexpr auto kAggregate = 0;  // StatType::AGGREGATE
+
+  const auto stats = alloc::getDeviceStats(device);
+  *allocated_bytes = stats.allocated_bytes[kAggregate].current;
+  *reserved_bytes = stats.reserved_bytes[kAggregate].current;
+  return true;
+#else
+  (void)device;
+  (void)allocated_bytes;
+  (void)reserved_bytes;
+  return false;
+#endif
+}
+
 }  // namespace sherpa
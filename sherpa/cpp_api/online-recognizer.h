@@ -37,20 +37,114 @@ struct OnlineRecognizerConfig {
 
   /// true to use GPU for neural network computation and decoding.
   /// false to use CPU.
-  /// You can use CUDA_VISIBLE_DEVICES to control which device to use.
-  /// We always use GPU 0 in the code. This also implies it supports only
-  /// 1 GPU at present.
+  /// You can use CUDA_VISIBLE_DEVICES to control which devices are
+  /// visible and gpu_id to select one of them.
   /// Note: You have to use a CUDA version of PyTorch in order to use
   /// GPU for computation
   bool use_gpu = false;
 
+  /// The device to use for neural network computation and decoding.
+  /// Used only when use_gpu is true. To use several GPUs in one process,
+  /// create one recognizer per device, each with its own gpu_id.
+  int32_t gpu_id = 0;
+
   bool use_endpoint = false;
 
+  /// false to skip per-token timestamp tracking: the decoders do no
+  /// timestamp work and OnlineRecognitionResult::timestamps stays
+  /// empty. Streams can override it individually via
+  /// OnlineStream::SetEnableTimestamps(); the websocket server maps the
+  /// "timestamps: off" message of a connection onto that.
+  bool enable_timestamps = true;
+
+  /// true to run the neural network in half precision (fp16). Used only
+  /// when use_gpu is true. Supported only for streaming Zipformer
+  /// models; the joiner output is converted back to fp32 so that the
+  /// search is unaffected.
+  bool use_fp16 = false;
+
+  /// true to capture the encoder forward into CUDA Graphs, one per batch
+  /// size, and replay them on later ticks with the same batch size. This
+  /// eliminates the kernel launch overhead, which dominates the per-tick
+  /// cost for small batches. Used only when use_gpu is true. Supported
+  /// only for streaming Zipformer models.
+  bool use_cuda_graph = false;
+
+  /// If non-empty, directory used to cache a ready-to-run copy of
+  /// nn_model: eval mode, with the weights already converted to half
+  /// precision when use_fp16 is true. The copy is saved on the first
+  /// start and loaded directly on later starts, cutting startup time.
+  /// The cache key includes the model path, size and modification time,
+  /// so a changed model file never hits a stale entry.
+  std::string warm_cache_dir;
+
+  /// Comma-separated list of batch sizes to run warmup with, e.g.,
+  /// "1,8,16,32". Warm up every batch size production traffic will use,
+  /// so the first real batch of each size does not pay for lazy kernel
+  /// selection and allocator growth.
+  std::string warmup_batch_sizes = "1";
+
+  /// True to run a calibration pass at startup that times the encoder,
+  /// decoder and joiner across warmup_batch_sizes on the warm model and
+  /// prints one JSON capability report (ms per batch size, bytes per
+  /// stream state, max sustainable streams at real time) to stdout.
+  bool profile_model = false;
+
+  /// Number of CUDA streams used for decoding. Used only when use_gpu
+  /// is true. If it is larger than 1, concurrent calls to DecodeStreams()
+  /// are issued on different CUDA streams so that H2D copies and encoder
+  /// computation of overlapping batches can run in parallel.
+  int32_t num_cuda_streams = 1;
+
   std::string decoding_method = "greedy_search";
 
   /// used only for modified_beam_search
   int32_t num_active_paths = 4;
 
+  /// used only for modified_beam_search. Hypotheses whose log-prob is
+  /// more than this below the best one are pruned at insertion time.
+  /// Values <= 0 disable gap pruning (the default).
+  float score_gap = 0;
+
+  /// used only for modified_beam_search. If non-empty, path to a file
+  /// of context phrases for hotword biasing, one phrase per line,
+  /// written as space separated tokens from the --tokens file, e.g.,
+  /// BPE pieces. The phrases are compiled once into a context graph;
+  /// see sherpa/csrc/context-graph.h.
+  std::string context_phrases_file;
+
+  /// used only for modified_beam_search with --context-phrases-file.
+  /// Per-token bonus in log space applied while a hypothesis is inside
+  /// a context phrase.
+  float context_score = 1.5;
+
+  /// used only for greedy_search. Frames whose blank posterior exceeds
+  /// this value for every stream of a batch are skipped without running
+  /// the per-frame emit logic. Values >= 1 disable skipping.
+  float blank_skip_threshold = 1;
+
+  /// Maximum number of chunks decoded per stream in one DecodeStreams()
+  /// call. A stream only has more than one chunk buffered when decoding
+  /// is falling behind the incoming audio, so values > 1 let an
+  /// overloaded server catch up by paying the per-tick fixed cost once
+  /// for several chunks, trading burstier latency for throughput.
+  /// 1 (the default) keeps the strict one-chunk-per-tick behavior.
+  int32_t max_chunks_per_tick = 1;
+
+  /// Maximum number of streams per encoder forward. A DecodeStreams()
+  /// call with more streams than this is split into sequential
+  /// sub-batches of (nearly) equal size, so one oversized batch cannot
+  /// hold the GPU for longer than a sub-batch forward and the per-call
+  /// time stays predictable. 0 (the default) disables the cap.
+  int32_t max_encoder_batch = 0;
+
+  /// Per-call encoder time budget in milliseconds. If it is larger
+  /// than 0, the forward of every --warmup-batch-sizes entry is timed
+  /// during warmup and the largest calibrated batch size whose forward
+  /// fits the budget becomes an additional cap on max_encoder_batch.
+  /// 0 (the default) disables the calibration.
+  float encoder_time_budget_ms = 0;
+
   // For OnlineConformerTransducerModel, i.e., for models from
   // pruned_transducer_stateless{2,3,4,5} in icefall
   // In number of frames after subsampling
@@ -74,6 +168,19 @@ struct OnlineRecognizerConfig {
   std::string ToString() const;
 };
 
+/** Wall-clock breakdown of one DecodeStreams() call; see the stats
+ * overload of DecodeStreams(). When --max-chunks-per-tick lets a call
+ * decode several chunks, the stages are summed over the chunks. On
+ * CUDA the encoder value covers launching the forward (the device wait
+ * is attributed to the search, which consumes its output), so the
+ * numbers locate a slow stage rather than profile the device.
+ */
+struct OnlineDecodeStats {
+  float stack_states_seconds = 0;
+  float encoder_seconds = 0;
+  float search_seconds = 0;
+};
+
 class OnlineRecognizer {
  public:
   /** Construct an instance of OnlineRecognizer.
@@ -89,6 +196,31 @@ class OnlineRecognizer {
   // Create a stream for decoding.
   std::unique_ptr<OnlineStream> CreateStream();
 
+  /** Reset a stream so it can be reused for a new session.
+   *
+   * The stream afterwards behaves like one freshly returned from
+   * CreateStream(): it has an empty decoding result and a fresh encoder
+   * state, but keeps its allocated buffers. It is meant for servers that
+   * pool streams across connections instead of creating and destroying
+   * one per session.
+   */
+  void ResetStream(OnlineStream *s);
+
+  /** Reset streams at an utterance boundary, in place.
+   *
+   * Unlike ResetStream(), the feature pipelines keep their position, so
+   * the streams continue decoding into the next utterance; see
+   * OnlineStream::ResetForNextUtterance(). A single encoder state
+   * initialization serves all n streams -- each one copies the values
+   * into the state tensors it already holds -- so resetting a batch of
+   * streams at an endpoint costs one TorchScript call instead of one
+   * per stream. Every stream gets a fresh empty decoding result.
+   *
+   * @param ss Pointer to an array of streams of size n.
+   * @param n Number of streams.
+   */
+  void ResetStreamsForNextUtterance(OnlineStream **ss, int32_t n);
+
   /**
    * Return true if the given stream has enough frames for decoding.
    * Return false otherwise
@@ -101,6 +233,54 @@ class OnlineRecognizer {
    */
   bool IsEndpoint(OnlineStream *s);
 
+  /** Batched variant of IsEndpoint().
+   *
+   * It gathers the frame counters of all n streams into flat arrays and
+   * evaluates the endpointing rules in one pass; see
+   * Endpoint::IsEndpointBatch(). Servers ticking hundreds of streams
+   * should prefer this over a per-stream IsEndpoint() loop.
+   *
+   * @param ss Pointer to an array of streams of size n.
+   * @param n Number of streams.
+   * @param is_endpoint Output array of size n; is_endpoint[i] is true if
+   *                    ss[i] hit an endpoint.
+   */
+  void IsEndpointBatch(OnlineStream **ss, int32_t n, bool *is_endpoint);
+
+  /** Return the duration in seconds of the trailing silence decoded so
+   * far for this stream, i.e., the time since the last non-blank token.
+   */
+  float GetTrailingSilence(OnlineStream *s) const;
+
+  /** Return the duration in seconds of the audio consumed by one decode
+   * chunk, i.e., the chunk shift of the model in feature frames times
+   * the frame shift.
+   *
+   * A server decoding streams in real time has to finish each decode
+   * cycle within this budget, or it falls behind the incoming audio;
+   * see OnlineWebsocketDecoder for how it is used as a tick deadline.
+   */
+  float ChunkDurationSeconds() const;
+
+  /** Consume the next ready chunk of this stream without running the
+   * network, provided it looks like silence.
+   *
+   * It is meant for parking long-silent streams: servers can drain the
+   * silence of such streams here, at the cost of one feature-energy
+   * check, instead of spending encoder batch slots on it. The frame
+   * bookkeeping (including token timestamp offsets) is kept consistent
+   * and the encoder state is left untouched, so decoding simply resumes
+   * when audio arrives.
+   *
+   * @param threshold A chunk is considered silence if its average
+   *                  log-mel feature energy is below this value.
+   *
+   * @return Return true if the chunk was silence and has been consumed.
+   *         Return false, consuming nothing, if the chunk should be
+   *         decoded normally.
+   */
+  bool SkipChunkIfSilent(OnlineStream *s, float threshold);
+
   /** Decode a single stream. */
   void DecodeStream(OnlineStream *s) {
     OnlineStream *ss[1] = {s};
@@ -114,8 +294,110 @@ class OnlineRecognizer {
    */
   void DecodeStreams(OnlineStream **ss, int32_t n);
 
+  /** Like DecodeStreams(ss, n), but also report where the call spent
+   * its time. Servers use it to attach a stage breakdown to their
+   * deadline-miss postmortems.
+   *
+   * @param stats Output; overwritten with the breakdown of this call.
+   */
+  void DecodeStreams(OnlineStream **ss, int32_t n, OnlineDecodeStats *stats);
+
   OnlineRecognitionResult GetResult(OnlineStream *s);
 
+  /** Speculatively decode the buffered audio of streams whose next
+   * chunk is not complete yet.
+   *
+   * The available frames past the last decoded chunk are padded to a
+   * full chunk (by repeating the last frame) and run through the
+   * encoder and the search, but nothing is committed: the encoder
+   * state, the stored result and the frame counters of every stream
+   * are left untouched, so the later real decode of this audio starts
+   * from exactly the same state as without this call.
+   *
+   * It exists to cut time-to-first-token: a server can decode partial
+   * chunks for display-only results while a batch has spare capacity,
+   * instead of letting the client wait out the full chunk length; see
+   * --speculative-partial-chunks of the online websocket server. The
+   * caller must ensure the streams are not decoded concurrently, like
+   * for DecodeStreams().
+   *
+   * @param ss Pointer to an array of streams of size n. Each stream
+   *           must have at least one feature frame past its processed
+   *           frames and must not be chunk-ready.
+   * @param n Number of streams.
+   * @param results Output; resized to n. results[i] is the display-only
+   *                result of ss[i].
+   */
+  void DecodeStreamsSpeculative(OnlineStream **ss, int32_t n,
+                                std::vector<OnlineRecognitionResult> *results);
+
+  /** Change the beam size of the search at runtime.
+   *
+   * Effective only with --decoding-method=modified_beam_search; the
+   * other search methods ignore it. The new width takes effect from the
+   * next decoded batch, so servers can narrow the beam while their
+   * decode queues back up and widen it again when load drops; see
+   * --adaptive-beam of the online websocket server.
+   *
+   * @param n The new beam size. Values < 1 are clamped to 1.
+   */
+  void SetNumActivePaths(int32_t n);
+
+  /** Run one full forward (encoder, decoder and joiner) with the given
+   * feature batch, like the warmup does, and wait for it to finish.
+   *
+   * Nothing is committed anywhere: no stream is involved and no result
+   * is produced. It exists so captured decode inputs can be re-executed
+   * against the model under a profiler; see
+   * --capture-slow-batches-file of the online websocket server and the
+   * sherpa-slow-batch-replay binary. The device is synchronized before
+   * returning, so wall time measured around this call is meaningful.
+   *
+   * @param features A 3-D tensor of shape (N, chunk_size, feature_dim);
+   *                 chunk_size must be the chunk size of the model. It
+   *                 may live on any device; it is moved as needed.
+   */
+  void RunForward(const torch::Tensor &features);
+
+  /** Return the number of bytes of device memory the encoder state of
+   * one stream occupies.
+   *
+   * It is computed from the init states of the loaded model at
+   * construction, so it is a constant of the model; servers can
+   * multiply it by their stream count to estimate the state part of
+   * their GPU footprint. See --gpu-memory-budget-mb of the online
+   * websocket server.
+   */
+  int64_t GetStateBytesPerStream() const;
+
+  /** Estimate the peak activation memory in bytes of a DecodeStreams()
+   * call with the given batch size.
+   *
+   * The estimate is calibrated during warmup: the forward of every
+   * --warmup-batch-sizes entry is measured against the CUDA caching
+   * allocator, so it reflects this model on this device with full
+   * chunks, i.e., the worst case of a real batch. A batch size between
+   * two calibrated ones rounds up to the larger; beyond the largest
+   * calibrated size the estimate is scaled linearly.
+   *
+   * @return The estimate in bytes. Returns 0 on CPU, where the OS
+   *         paging makes a budget moot.
+   */
+  int64_t EstimateActivationBytes(int32_t batch_size) const;
+
+  /** Fill the current stats of the CUDA caching allocator of `device`.
+   *
+   * @param device The CUDA device ordinal.
+   * @param allocated_bytes Output. Bytes handed out to live tensors.
+   * @param reserved_bytes Output. Bytes held from the driver, i.e.,
+   *                       allocated plus the cached free blocks.
+   *
+   * @return Return true on success. Return false, leaving the outputs
+   *         untouched, when sherpa is built without CUDA.
+   */
+  static bool GetCudaMemoryStats(int32_t device, int64_t *allocated_bytes,
+                                 int64_t *reserved_bytes);
+
  private:
   class OnlineRecognizerImpl;
   std::unique_ptr<OnlineRecognizerImpl> impl_;
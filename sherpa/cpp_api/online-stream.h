@@ -28,6 +28,11 @@ struct OnlineRecognitionResult {
   /// timestamps[i] records the time in seconds when tokens[i] is decoded.
   std::vector<float> timestamps;
 
+  /// Decoded results at the token-ID level; token_ids[i] is the ID of
+  /// tokens[i]. Useful for compact result serialization when the
+  /// consumer already has the symbol table.
+  std::vector<int32_t> token_ids;
+
   /// ID of this segment
   int32_t segment = 0;
 
@@ -57,12 +62,24 @@ struct OnlineTransducerDecoderResult;
 
 class OnlineStream {
  public:
-  explicit OnlineStream(const kaldifeat::FbankOptions &opts);
+  /**
+   * @param opts Options for computing fbank features.
+   * @param async_feature_computation If true, features are computed on a
+   *                                  background worker thread owned by this
+   *                                  stream and AcceptWaveform() returns
+   *                                  as soon as the samples are enqueued.
+   */
+  explicit OnlineStream(const kaldifeat::FbankOptions &opts,
+                        bool async_feature_computation = false);
   ~OnlineStream();
 
   /** This would be called from the application, when you get
    * more wave data.
    *
+   * If the stream was created with async_feature_computation == true,
+   * this function only enqueues the samples and never blocks on feature
+   * extraction.
+   *
    * @param sampling_rate Sampling rate of the input waveform. If it is
    *                      different from the sampling rate expected by the
    *                      model, we will do resampling inside sherpa.
@@ -94,10 +111,94 @@ class OnlineStream {
    *
    * @param frame  The frame number. It starts from 0.
    *
-   * @return Return a 2-D array of shape [1, feature_dim]
+   * @return Return a 2-D array of shape [1, feature_dim]. Like
+   *         GetFrames(), it is a view into the stream's contiguous
+   *         frame buffer, valid until the next GetFrame()/GetFrames()
+   *         call on this stream.
    */
   torch::Tensor GetFrame(int32_t frame);
 
+  /**Get a whole chunk of consecutive frames as one tensor.
+   *
+   * Frames are staged into a contiguous buffer inside the stream, so this
+   * is much cheaper than calling GetFrame() once per frame and
+   * concatenating the results.
+   *
+   * @param first  The index of the first frame. It starts from 0.
+   * @param n  Number of frames to get.
+   *
+   * @return Return a 2-D array of shape [n, feature_dim]. It is a view
+   *         into an internal buffer that is valid until the next call to
+   *         GetFrames() on this stream.
+   */
+  torch::Tensor GetFrames(int32_t first, int32_t n);
+
+  /** Set the chunk geometry used by IsChunkReady() and GetChunk().
+   *
+   * It is called by the recognizer when the stream is created; chunk_size
+   * and chunk_shift come from the model.
+   *
+   * @param chunk_size Number of feature frames per chunk.
+   * @param chunk_shift Number of feature frames between the starts of two
+   *                    consecutive chunks.
+   */
+  void SetChunkGeometry(int32_t chunk_size, int32_t chunk_shift);
+
+  /// Return the chunk size set by SetChunkGeometry(); 0 if unset.
+  int32_t ChunkSize() const;
+
+  /// Return the chunk shift set by SetChunkGeometry(); 0 if unset.
+  int32_t ChunkShift() const;
+
+  /** Return true if all frames of the given chunk are ready.
+   *
+   * @param chunk_index The index of the chunk. It starts from 0.
+   */
+  bool IsChunkReady(int32_t chunk_index) const;
+
+  /**Get a whole chunk of frames as one tensor.
+   *
+   * Chunk i consists of frames [i * chunk_shift, i * chunk_shift +
+   * chunk_size). Frames are prefetched into a contiguous buffer as soon
+   * as enough samples arrive, so this takes a single lock acquisition
+   * and normally returns a view without touching the feature extractor.
+   *
+   * You must call SetChunkGeometry() before using this function.
+   *
+   * @param chunk_index The index of the chunk. It starts from 0.
+   *
+   * @return Return a 2-D array of shape [chunk_size, feature_dim]. It is
+   *         a view into an internal buffer that is valid until the next
+   *         call to GetChunk() or GetFrames() on this stream.
+   */
+  torch::Tensor GetChunk(int32_t chunk_index);
+
+  /** Enable the waveform-energy silence gate.
+   *
+   * When enabled, every block of samples passed to AcceptWaveform() is
+   * classified as silence or speech from its average per-sample power --
+   * a single vectorized pass over samples that are touched anyway -- and
+   * the stream keeps track of how long the current trailing run of
+   * silent blocks is. Servers use TrailingSilenceSeconds() to park
+   * long-silent streams (see SkipChunkIfSilent() in OnlineRecognizer)
+   * so silence does not occupy encoder batch slots.
+   *
+   * The gate only marks silence; no audio is dropped.
+   *
+   * @param threshold A block is classified as silence if its average
+   *                  per-sample power (samples are in [-1, 1]) is below
+   *                  this value. Pass a value <= 0 to disable the gate.
+   */
+  void SetSilenceGateThreshold(float threshold);
+
+  /** Return the duration in seconds of the trailing run of sample
+   * blocks that the silence gate classified as silence.
+   *
+   * Returns 0 if the gate is disabled or the last block contained
+   * speech.
+   */
+  float TrailingSilenceSeconds() const;
+
   /**
    * Get the state of the encoder network corresponding to this stream.
    *
@@ -112,6 +213,89 @@ class OnlineStream {
    */
   void SetState(torch::IValue state);
 
+  /** Move every tensor held by this stream to the given device.
+   *
+   * It is used to rebalance load between GPU replicas: a live stream can
+   * be drained from one recognizer, migrated, and resumed on another
+   * without losing audio. Features always stay on the CPU; only the
+   * encoder state and the cached decoder output are moved.
+   *
+   * @param device The device the stream is migrated to.
+   */
+  void MigrateStates(torch::Device device);
+
+  /** Move the encoder state of this stream to pinned host memory.
+   *
+   * Per-stream zipformer states are several MB of fp32 on the device;
+   * at hundreds of streams they dominate GPU memory. Streams that are
+   * parked in silence do not need their state resident, so servers
+   * offload it here and call OnloadState() when audio arrives; see
+   * --offload-parked-states of the online websocket server. Pinned
+   * memory keeps the restore a fast asynchronous DMA copy.
+   *
+   * It is a no-op if the state is already offloaded or lives on the
+   * CPU. Assigning a new state via SetState() discards the offload
+   * bookkeeping.
+   *
+   * @param use_fp16 true to additionally cast fp32 state tensors to
+   *                 fp16 while offloaded, halving the host memory and
+   *                 the PCIe traffic of both transfers. The state is
+   *                 cast back to fp32 on restore; the round trip loses
+   *                 precision the encoder comfortably tolerates for
+   *                 states that summarize long-gone audio.
+   */
+  void OffloadState(bool use_fp16);
+
+  /** Move an offloaded encoder state back to the device it came from,
+   * restoring fp32. It is a no-op if the state is not offloaded.
+   */
+  void OnloadState();
+
+  /** Return true if the encoder state is currently offloaded to the
+   * host; see OffloadState().
+   */
+  bool IsStateOffloaded() const;
+
+  /** Reset the stream at an utterance boundary, in place.
+   *
+   * Unlike Reset(), the feature pipeline is untouched: pending samples,
+   * buffered frames and the processed-frame position all survive, so
+   * decoding continues at the current position into the next utterance.
+   * Only the decoding state is cleared -- hypotheses, the cached
+   * decoder output and the trailing-blank counter -- and the segment
+   * counter is advanced.
+   *
+   * The encoder state is re-armed by copying `init_state` into the
+   * tensors the stream already holds, so an endpoint-triggered reset
+   * costs a few batched device copies instead of fresh allocations.
+   * `init_state` is only read; the same value can re-arm many streams
+   * (see OnlineRecognizer::ResetStreamsForNextUtterance()). If its
+   * structure does not match the current state -- e.g., the stream has
+   * no state yet or the state is offloaded -- the stream adopts
+   * `init_state` wholesale instead.
+   *
+   * Note: Like Reset(), this leaves the stream without an empty
+   * decoding result. Use the recognizer-level wrapper, which re-arms
+   * it, instead of calling this directly.
+   *
+   * @param init_state A fresh encoder state, e.g., from
+   *                   OnlineTransducerModel::GetEncoderInitStates().
+   */
+  void ResetForNextUtterance(torch::IValue init_state);
+
+  /** Reset the stream so it can be reused for a new session.
+   *
+   * All per-session state -- the feature extractor, pending samples,
+   * encoder state and decoding results -- is cleared, while the frame
+   * buffer keeps its allocated storage, so recycled streams do not pay
+   * for the allocations again.
+   *
+   * Note: A reset stream has no encoder state and no empty decoding
+   * result. Use OnlineRecognizer::ResetStream(), which re-arms both,
+   * instead of calling this directly.
+   */
+  void Reset();
+
   // Return a reference to the number of processed frames so far.
   // Initially, it is 0. It is always less than NumFramesReady().
   //
@@ -121,6 +305,21 @@ class OnlineStream {
   void SetResult(const OnlineTransducerDecoderResult &r);
   const OnlineTransducerDecoderResult &GetResult() const;
 
+  // Mutable variant; used by OnlineRecognizer::GetResult() to update
+  // the cached text conversion kept inside the result.
+  OnlineTransducerDecoderResult &GetResult();
+
+  /** Enable or disable per-token timestamp tracking for this stream.
+   *
+   * When disabled, the decoders do no timestamp work for this stream
+   * and OnlineRecognitionResult::timestamps stays empty. The default
+   * comes from OnlineRecognizerConfig::enable_timestamps; the websocket
+   * server overrides it per connection via the "timestamps: off"
+   * message. The setting survives endpoint and utterance resets.
+   */
+  void SetEnableTimestamps(bool enable);
+  bool EnableTimestamps() const;
+
   // TODO(fangjun): Make it return a struct
   //
   // Used for greedy_search.
@@ -142,6 +341,16 @@ class OnlineStream {
   // Its shape is [1, decoder_dim]
   torch::Tensor &GetDecoderOut();
 
+  // Used only with streaming CMVN; see FeatureConfig::streaming_cmvn.
+  //
+  // Return a reference to the exponential moving feature statistics of
+  // this stream: a 2-D tensor of shape [2, feature_dim] holding the
+  // running mean (row 0) and mean square (row 1) of the features, kept
+  // on the device. It is undefined until the first chunk is decoded.
+  //
+  // The returned reference is valid as long as this object is alive.
+  torch::Tensor &GetCmvnStats();
+
   // Used only for greedy search
   //
   // Get number of trailing blank frames decoded so far
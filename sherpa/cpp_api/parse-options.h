@@ -101,6 +101,14 @@ class ParseOptions {
   /// registering all options.  This is usually used internally after the
   /// standard --config option is used, but it may also be called from a
   /// program.
+  ///
+  /// Two line formats are accepted and may be mixed in one file:
+  ///   --x=y            the traditional Kaldi form
+  ///   x = y            INI style
+  /// plus INI style [section] headers, which prefix the following keys
+  /// with "section." (matching options registered with a prefix).
+  /// '#' starts a comment.  Values given on the command line override
+  /// values from the config file.
   void ReadConfigFile(const std::string &filename);
 
   /// Number of positional parameters (c.f. argc-1).
@@ -167,13 +175,18 @@ class ParseOptions {
   float ToFloat(const std::string &str) const;
   double ToDouble(const std::string &str) const;
 
-  // maps for option variables
-  std::unordered_map<std::string, bool *> bool_map_;
-  std::unordered_map<std::string, int32_t *> int_map_;
-  std::unordered_map<std::string, uint32_t *> uint_map_;
-  std::unordered_map<std::string, float *> float_map_;
-  std::unordered_map<std::string, double *> double_map_;
-  std::unordered_map<std::string, std::string *> string_map_;
+  /// Type of a registered option variable; tells how to interpret
+  /// OptionInfo::ptr
+  enum class OptionType { kBool, kInt, kUint, kFloat, kDouble, kString };
+
+  struct OptionInfo {
+    OptionType type;
+    void *ptr;  // not owned; points to the registered variable
+  };
+
+  /// Registry for all option variables. A single hash lookup resolves
+  /// both whether an option exists and its type.
+  std::unordered_map<std::string, OptionInfo> registry_;
 
   /**
      Structure for options' documentation
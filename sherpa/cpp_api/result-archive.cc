@@ -0,0 +1,150 @@
+// sherpa/cpp_api/result-archive.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#include "sherpa/cpp_api/result-archive.h"
+
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "sherpa/csrc/log.h"
+
+namespace sherpa {
+
+// Magic bytes at the start of an archive; bump the digit when the
+// on-disk layout changes.
+static constexpr const char *kArchiveMagic = "SRA1";
+
+// Per-record header. Lengths are stored in the native byte order; the
+// archive is not meant to be moved between machines of different
+// endianness.
+struct RecordHeader {
+  uint8_t flags;  // reserved for payload compression; 0 means raw
+  uint32_t key_len;
+  uint32_t payload_len;
+};
+
+static void WriteHeader(std::ofstream *os, const RecordHeader &h) {
+  os->write(reinterpret_cast<const char *>(&h.flags), sizeof(h.flags));
+  os->write(reinterpret_cast<const char *>(&h.key_len), sizeof(h.key_len));
+  os->write(reinterpret_cast<const char *>(&h.payload_len),
+            sizeof(h.payload_len));
+}
+
+static bool ReadHeader(std::ifstream *is, RecordHeader *h) {
+  is->read(reinterpret_cast<char *>(&h->flags), sizeof(h->flags));
+  is->read(reinterpret_cast<char *>(&h->key_len), sizeof(h->key_len));
+  is->read(reinterpret_cast<char *>(&h->payload_len), sizeof(h->payload_len));
+  return is->good();
+}
+
+ResultArchiveWriter::ResultArchiveWriter(const std::string &filename) {
+  bool empty = true;
+  {
+    std::ifstream is(filename, std::ios::binary);
+    empty = !is || is.peek() == std::ifstream::traits_type::eof();
+  }
+
+  os_.open(filename, std::ios::binary | std::ios::app);
+  if (!os_) {
+    SHERPA_LOG(FATAL) << "Failed to open " << filename << " for writing";
+  }
+
+  if (empty) {
+    os_.write(kArchiveMagic, 4);
+  }
+}
+
+void ResultArchiveWriter::Write(const std::string &key,
+                                const OfflineRecognitionResult &result) {
+  Write(key, result.AsJsonString());
+}
+
+void ResultArchiveWriter::Write(const std::string &key,
+                                const std::string &payload) {
+  RecordHeader h;
+  h.flags = 0;
+  h.key_len = key.size();
+  h.payload_len = payload.size();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  WriteHeader(&os_, h);
+  os_.write(key.data(), key.size());
+  os_.write(payload.data(), payload.size());
+  if (!os_) {
+    SHERPA_LOG(FATAL) << "Failed to append to the result archive";
+  }
+}
+
+void ResultArchiveWriter::Flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  os_.flush();
+}
+
+ResultArchiveReader::ResultArchiveReader(const std::string &filename) {
+  is_.open(filename, std::ios::binary);
+  if (!is_) {
+    SHERPA_LOG(FATAL) << "Failed to open " << filename;
+  }
+
+  is_.seekg(0, std::ios::end);
+  int64_t file_size = is_.tellg();
+  is_.seekg(0);
+
+  char magic[4];
+  is_.read(magic, 4);
+  if (!is_.good() || std::memcmp(magic, kArchiveMagic, 4) != 0) {
+    SHERPA_LOG(FATAL) << filename << " is not a result archive";
+  }
+
+  // Index the archive by scanning record headers only; payloads are
+  // skipped with seekg. A truncated trailing record -- from a killed
+  // writer -- is detected against the file size and ignored.
+  while (true) {
+    RecordHeader h;
+    if (!ReadHeader(&is_, &h)) {
+      break;
+    }
+
+    std::string key(h.key_len, '\0');
+    is_.read(&key[0], h.key_len);
+    if (!is_.good()) {
+      break;
+    }
+
+    int64_t payload_offset = is_.tellg();
+    if (payload_offset + h.payload_len > file_size) {
+      break;
+    }
+    is_.seekg(h.payload_len, std::ios::cur);
+
+    auto r = index_.emplace(key, std::make_pair(payload_offset,
+                                                h.payload_len));
+    if (r.second) {
+      keys_.push_back(std::move(key));
+    } else {
+      // Duplicate key, e.g., from a resumed job: the last record wins.
+      r.first->second = std::make_pair(payload_offset, h.payload_len);
+    }
+  }
+
+  is_.clear();
+}
+
+std::string ResultArchiveReader::Get(const std::string &key) {
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    SHERPA_LOG(FATAL) << "No such key in the result archive: " << key;
+  }
+
+  std::string payload(it->second.second, '\0');
+  is_.clear();
+  is_.seekg(it->second.first);
+  is_.read(&payload[0], payload.size());
+  if (!is_.good()) {
+    SHERPA_LOG(FATAL) << "Failed to read the record for key: " << key;
+  }
+  return payload;
+}
+
+}  // namespace sherpa
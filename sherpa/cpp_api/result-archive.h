@@ -0,0 +1,103 @@
+// sherpa/cpp_api/result-archive.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_CPP_API_RESULT_ARCHIVE_H_
+#define SHERPA_CPP_API_RESULT_ARCHIVE_H_
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "sherpa/cpp_api/offline-stream.h"
+
+namespace sherpa {
+
+/** Append recognition results to a single packed archive file.
+ *
+ * Batch jobs that write one small JSON file per utterance produce
+ * millions of files; the archive replaces them with one appendable
+ * file of length-prefixed records, each holding a key and the JSON
+ * serialization of an OfflineRecognitionResult.
+ *
+ * Each record starts with a fixed-size header (a flags byte plus the
+ * key and payload lengths), so a reader can index the whole archive by
+ * scanning headers and seeking past payloads without parsing any JSON.
+ * The flags byte is reserved for per-record payload compression; all
+ * records are currently written uncompressed.
+ *
+ * Appending is crash-safe in the same sense as a log file: a killed
+ * job loses at most a partially written trailing record, which readers
+ * detect and ignore. Write() is thread-safe.
+ */
+class ResultArchiveWriter {
+ public:
+  /** Open an archive for appending; the file is created if needed.
+   *
+   * @param filename Path to the archive file.
+   */
+  explicit ResultArchiveWriter(const std::string &filename);
+
+  /** Append one result.
+   *
+   * @param key Identifier of the utterance, e.g., a wave file path or
+   *            a manifest key. Keys are not required to be unique; on
+   *            read, the last record with a given key wins.
+   * @param result The result; it is stored as its AsJsonString().
+   */
+  void Write(const std::string &key, const OfflineRecognitionResult &result);
+
+  /** Append one result with an already serialized payload. */
+  void Write(const std::string &key, const std::string &payload);
+
+  /** Flush buffered records to the file. */
+  void Flush();
+
+ private:
+  std::mutex mutex_;
+  std::ofstream os_;
+};
+
+/** Read an archive written by ResultArchiveWriter.
+ *
+ * The constructor builds an in-memory index from keys to file offsets
+ * by scanning only the record headers; payloads are read lazily by
+ * Get().
+ */
+class ResultArchiveReader {
+ public:
+  /** Open an archive and index it.
+   *
+   * @param filename Path to the archive file.
+   */
+  explicit ResultArchiveReader(const std::string &filename);
+
+  /// Return the number of distinct keys in the archive.
+  int32_t NumRecords() const { return keys_.size(); }
+
+  /// Return true if the archive contains the given key.
+  bool Contains(const std::string &key) const { return index_.count(key); }
+
+  /// Return all keys in the order their records were first appended.
+  const std::vector<std::string> &Keys() const { return keys_; }
+
+  /** Return the JSON payload stored for the given key.
+   *
+   * It is a fatal error if the key is not in the archive; check with
+   * Contains() first.
+   */
+  std::string Get(const std::string &key);
+
+ private:
+  std::ifstream is_;
+  std::vector<std::string> keys_;
+  // key -> (payload offset, payload length)
+  std::unordered_map<std::string, std::pair<int64_t, uint32_t>> index_;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CPP_API_RESULT_ARCHIVE_H_
@@ -0,0 +1,49 @@
+// sherpa/cpp_api/test-result-archive.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/cpp_api/result-archive.h"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+int main() {
+  std::string filename = "test-result-archive.sra";
+  std::remove(filename.c_str());
+
+  sherpa::OfflineRecognitionResult r;
+  r.text = "hello world";
+  r.tokens = {"hello", "world"};
+  r.timestamps = {0.5, 1.2};
+
+  {
+    std::cout << "===test write===\n";
+    sherpa::ResultArchiveWriter writer(filename);
+    writer.Write("utt-1", r);
+    r.text = "foo bar";
+    writer.Write("utt-2", r);
+    writer.Flush();
+  }
+
+  {
+    std::cout << "===test append and overwrite===\n";
+    sherpa::ResultArchiveWriter writer(filename);
+    r.text = "foo bar baz";
+    writer.Write("utt-2", r);
+    writer.Flush();
+  }
+
+  {
+    std::cout << "===test read===\n";
+    sherpa::ResultArchiveReader reader(filename);
+    std::cout << "num records: " << reader.NumRecords() << "\n";
+    for (const auto &key : reader.Keys()) {
+      std::cout << key << ": " << reader.Get(key) << "\n";
+    }
+    std::cout << "contains utt-3: " << reader.Contains("utt-3") << "\n";
+  }
+
+  std::remove(filename.c_str());
+  return 0;
+}
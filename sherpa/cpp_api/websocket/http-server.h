@@ -19,9 +19,12 @@
 #ifndef SHERPA_CPP_API_WEBSOCKET_HTTP_SERVER_H_
 #define SHERPA_CPP_API_WEBSOCKET_HTTP_SERVER_H_
 
+#include <cstdint>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <unordered_map>
+#include <utility>
 
 namespace sherpa {
 
@@ -42,6 +45,39 @@ static std::string ReadFile(const std::string &filename) {
   return ans;
 }
 
+/** Compute an entity tag for the given content (64-bit FNV-1a).
+ *
+ * @param content The content to hash.
+ * @return Return the ETag, including the surrounding double quotes, so
+ *         it can be compared directly with an If-None-Match header.
+ */
+static std::string ComputeEtag(const std::string &content) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (unsigned char c : content) {
+    h ^= c;
+    h *= 0x100000001b3ULL;
+  }
+
+  std::ostringstream os;
+  os << '"' << std::hex << h << '"';
+  return os.str();
+}
+
+/** A static file cached in memory; see HttpServer. */
+struct HttpAsset {
+  std::string content;
+
+  // Content of the pre-compressed sibling file, e.g., index.html.gz,
+  // if it exists in the doc root. It is served verbatim, with
+  // "Content-Encoding: gzip", to clients that accept gzip. Empty if
+  // there is no pre-compressed sibling.
+  std::string gzipped;
+
+  // Entity tag of `content`, computed once at startup. Clients sending
+  // a matching If-None-Match header get a 304 without a body.
+  std::string etag;
+};
+
 static const char *kKnownFiles[] = {
     // Please sort it alphabetically
     "/css/bootstrap.min.css",
@@ -65,13 +101,27 @@ static const char *kKnownFiles[] = {
 
 /** A very simple http server.
  *
- * It serves only static files, e.g., html, js., css, etc.
+ * It serves only static files, e.g., html, js., css, etc. All files are
+ * loaded into memory once at startup, together with their ETag and an
+ * optional pre-compressed `.gz` sibling, so serving a request never
+ * touches the disk and never compresses on the fly.
  */
 class HttpServer {
  public:
   explicit HttpServer(const std::string &root) {
     for (const auto filename : kKnownFiles) {
-      content_.emplace(filename, ReadFile(root + filename));
+      HttpAsset asset;
+      asset.content = ReadFile(root + filename);
+      asset.etag = ComputeEtag(asset.content);
+
+      std::ifstream gz(root + filename + ".gz",
+                       std::ios::in | std::ios::binary);
+      if (gz) {
+        asset.gzipped.assign((std::istreambuf_iterator<char>(gz)),
+                             std::istreambuf_iterator<char>());
+      }
+
+      assets_.emplace(filename, std::move(asset));
     }
 
     error_content_ = R"(
@@ -91,16 +141,31 @@ class HttpServer {
    * @return Return true if the given file is found; return false otherwise.
    */
   bool ProcessRequest(const std::string &filename, std::string *content) const {
-    auto it = content_.find(filename);
-    if (it == content_.end()) {
+    auto it = assets_.find(filename);
+    if (it == assets_.end()) {
       *content = error_content_;
       return false;
     }
 
-    *content = it->second;
+    *content = it->second.content;
     return true;
   }
 
+  /** Look up a cached asset.
+   *
+   * Unlike ProcessRequest(), it gives the caller access to the ETag and
+   * the pre-compressed variant, so it can answer conditional requests
+   * with a 304 and gzip-accepting clients with the compressed copy.
+   *
+   * @param filename The filename the client is requesting.
+   * @return Return a pointer to the asset, valid as long as this object
+   *         is alive, or nullptr if the file is unknown.
+   */
+  const HttpAsset *Find(const std::string &filename) const {
+    auto it = assets_.find(filename);
+    return it == assets_.end() ? nullptr : &it->second;
+  }
+
   /** Return a string for 404. */
   const std::string &GetErrorContent() const { return error_content_; }
 
@@ -108,8 +173,8 @@ class HttpServer {
   /**Return this string to the client for 404 page.*/
   std::string error_content_;
 
-  /** Map filename to its content.*/
-  std::unordered_map<std::string, std::string> content_;
+  /** Map filename to its cached asset.*/
+  std::unordered_map<std::string, HttpAsset> assets_;
 };
 
 }  // namespace sherpa
@@ -79,11 +79,18 @@ class Client {
  public:
   Client(asio::io_context &io,  // NOLINT
          const std::string &ip, int16_t port, const std::string &wave_filename,
-         float num_seconds_per_message)
+         float num_seconds_per_message, bool use_int16)
       : io_(io),
         uri_(/*secure*/ false, ip, port, /*resource*/ "/"),
         samples_(ReadWave(wave_filename, kSampleRate)),
-        samples_per_message_(num_seconds_per_message * kSampleRate) {
+        samples_per_message_(num_seconds_per_message * kSampleRate),
+        use_int16_(use_int16) {
+    if (use_int16_) {
+      // Send 2 bytes per sample instead of 4; the server converts back
+      // to float. The wave file stores int16, so the round trip through
+      // ReadWave() is exact.
+      samples_ = (samples_ * 32768).to(torch::kShort);
+    }
     c_.clear_access_channels(websocketpp::log::alevel::all);
     c_.set_access_channels(websocketpp::log::alevel::connect);
     c_.set_access_channels(websocketpp::log::alevel::disconnect);
@@ -116,10 +123,19 @@ class Client {
 
   void OnOpen(connection_hdl hdl) {
     int32_t num_samples = samples_.numel();
-    int32_t num_bytes = num_samples * sizeof(float);
+    int32_t num_bytes = num_samples * BytesPerSample();
 
-    SHERPA_LOG(INFO) << "Sending " << num_bytes << " bytes\n";
     websocketpp::lib::error_code ec;
+    if (use_int16_) {
+      c_.send(hdl, "format: int16", websocketpp::frame::opcode::text, ec);
+      if (ec) {
+        SHERPA_LOG(ERROR) << "Failed to negotiate int16 because: "
+                          << ec.message();
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    SHERPA_LOG(INFO) << "Sending " << num_bytes << " bytes\n";
     c_.send(hdl, &num_bytes, sizeof(int32_t),
             websocketpp::frame::opcode::binary, ec);
     if (ec) {
@@ -160,9 +176,9 @@ class Client {
       SHERPA_LOG(INFO) << "Sending " << num_sent_messages_ << "/"
                        << num_messages << "\n";
       c_.send(hdl,
-              samples_.data_ptr<float>() +
-                  num_sent_messages_ * samples_per_message_,
-              samples_per_message_ * sizeof(float),
+              SampleBytes() + static_cast<int64_t>(num_sent_messages_) *
+                                  samples_per_message_ * BytesPerSample(),
+              samples_per_message_ * BytesPerSample(),
               websocketpp::frame::opcode::binary, ec);
 
       if (ec) {
@@ -179,9 +195,9 @@ class Client {
       int32_t remaining_samples = num_samples % samples_per_message_;
       if (remaining_samples) {
         c_.send(hdl,
-                samples_.data_ptr<float>() +
-                    num_sent_messages_ * samples_per_message_,
-                remaining_samples * sizeof(float),
+                SampleBytes() + static_cast<int64_t>(num_sent_messages_) *
+                                    samples_per_message_ * BytesPerSample(),
+                remaining_samples * BytesPerSample(),
                 websocketpp::frame::opcode::binary, ec);
 
         if (ec) {
@@ -195,6 +211,14 @@ class Client {
     }
   }
 
+  int32_t BytesPerSample() const {
+    return use_int16_ ? sizeof(int16_t) : sizeof(float);
+  }
+
+  const char *SampleBytes() const {
+    return reinterpret_cast<const char *>(samples_.data_ptr());
+  }
+
  private:
   client c_;
   asio::io_context &io_;
@@ -203,12 +227,14 @@ class Client {
 
   int32_t samples_per_message_;
   int32_t num_sent_messages_ = 0;
+  bool use_int16_;
 };
 
 int32_t main(int32_t argc, char *argv[]) {
   std::string server_ip = "127.0.0.1";
   int32_t server_port = 6006;
   float num_seconds_per_message = 10;
+  bool use_int16 = false;
 
   sherpa::ParseOptions po(kUsageMessage);
 
@@ -217,6 +243,10 @@ int32_t main(int32_t argc, char *argv[]) {
   po.Register("num-seconds-per-message", &num_seconds_per_message,
               "The number of samples per message equals to "
               "num_seconds_per_message*sample_rate");
+  po.Register("use-int16", &use_int16,
+              "True to send the samples as int16 instead of float32, "
+              "halving the upload bandwidth. The server converts them "
+              "back to float.");
 
   po.Read(argc, argv);
   SHERPA_CHECK_GT(num_seconds_per_message, 0);
@@ -245,7 +275,7 @@ int32_t main(int32_t argc, char *argv[]) {
   asio::io_context io_conn;  // for network connections
 
   Client c(io_conn, server_ip, server_port, wave_filename,
-           num_seconds_per_message);
+           num_seconds_per_message, use_int16);
 
   io_conn.run();  // will exit when the above connection is closed
 
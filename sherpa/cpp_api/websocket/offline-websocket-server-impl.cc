@@ -5,12 +5,19 @@
 #include "sherpa/cpp_api/websocket/offline-websocket-server-impl.h"
 
 #include <algorithm>
+#include <array>
+#include <chrono>  // NOLINT
+#include <cstdio>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
+#include "sherpa/csrc/allocator-stats.h"
 #include "sherpa/csrc/file-utils.h"
 #include "sherpa/csrc/log.h"
+#include "sherpa/csrc/metrics.h"
+#include "sherpa/csrc/prof.h"
 
 namespace sherpa {
 
@@ -29,6 +36,31 @@ void OfflineWebsocketDecoderConfig::Register(ParseOptions *po) {
       "Max utterance length in seconds. If we receive an utterance "
       "longer than this value, we will reject the connection. "
       "If you have enough memory, you can select a large value for it.");
+
+  po->Register(
+      "result-archive", &result_archive,
+      "If non-empty, append the full JSON result of every decoded "
+      "utterance to this packed archive file instead of relying on "
+      "per-utterance files written by clients. Use "
+      "sherpa-result-archive to inspect it.");
+
+  po->Register(
+      "sort-by-length", &sort_by_length,
+      "True to queue utterances into length buckets and fill each "
+      "batch from a single bucket, so short utterances are not padded "
+      "to the length of a long one that happened to arrive in the same "
+      "FIFO window. See also --length-bucket-width and "
+      "--max-bucket-wait.");
+
+  po->Register("length-bucket-width", &length_bucket_width,
+               "Width in seconds of each length bucket. Used only with "
+               "--sort-by-length.");
+
+  po->Register(
+      "max-bucket-wait", &max_bucket_wait,
+      "An utterance that has waited longer than this many seconds gets "
+      "its bucket decoded next even if a fuller bucket exists, so "
+      "sparse buckets do not starve. Used only with --sort-by-length.");
 }
 
 void OfflineWebsocketDecoderConfig::Validate() const {
@@ -37,73 +69,231 @@ void OfflineWebsocketDecoderConfig::Validate() const {
   SHERPA_CHECK_GT(max_batch_size, 0);
 
   SHERPA_CHECK_GT(max_utterance_length, 0);
+
+  if (sort_by_length) {
+    SHERPA_CHECK_GT(length_bucket_width, 0);
+    SHERPA_CHECK_GT(max_bucket_wait, 0);
+  }
 }
 
 OfflineWebsocketDecoder::OfflineWebsocketDecoder(
     const OfflineWebsocketDecoderConfig &config, OfflineWebsocketServer *server)
-    : config_(config), server_(server), recognizer_(config.recognizer_config) {}
+    : config_(config), server_(server), recognizer_(config.recognizer_config) {
+  if (!config.result_archive.empty()) {
+    archive_writer_ =
+        std::make_unique<ResultArchiveWriter>(config.result_archive);
+  }
+
+  if (config.sort_by_length) {
+    auto num_buckets = static_cast<int32_t>(config.max_utterance_length /
+                                            config.length_bucket_width) +
+                       1;
+    buckets_.resize(num_buckets);
+  }
+}
+
+int32_t OfflineWebsocketDecoder::BucketOf(const ConnectionData &d) const {
+  float sample_rate = config_.recognizer_config.feat_config.fbank_opts
+                          .frame_opts.samp_freq;
+  float duration =
+      d.expected_byte_size / d.BytesPerSample() / sample_rate;
+
+  auto i = static_cast<int32_t>(duration / config_.length_bucket_width);
+  return std::min(i, static_cast<int32_t>(buckets_.size()) - 1);
+}
+
+void OfflineWebsocketDecoder::Push(connection_hdl hdl,
+                                   std::unique_ptr<ConnectionData> d) {
+  d->enqueue_time = std::chrono::steady_clock::now();
 
-void OfflineWebsocketDecoder::Push(connection_hdl hdl, ConnectionDataPtr d) {
   std::lock_guard<std::mutex> lock(mutex_);
-  streams_.push_back({hdl, d});
+  if (config_.sort_by_length) {
+    auto &q = buckets_[BucketOf(*d)];
+    q.push_back({hdl, std::move(d)});
+  } else {
+    streams_.push_back({hdl, std::move(d)});
+  }
 }
 
-void OfflineWebsocketDecoder::Decode() {
-  std::unique_lock<std::mutex> lock(mutex_);
-  if (streams_.empty()) {
+void OfflineWebsocketDecoder::CollectBatchLocked(
+    std::vector<std::pair<connection_hdl, std::unique_ptr<ConnectionData>>>
+        *batch) {
+  int32_t max_batch_size = config_.max_batch_size;
+
+  if (!config_.sort_by_length) {
+    while (!streams_.empty() &&
+           static_cast<int32_t>(batch->size()) < max_batch_size) {
+      batch->push_back(std::move(streams_.front()));
+      streams_.pop_front();
+    }
     return;
   }
 
-  int32_t size =
-      std::min(static_cast<int32_t>(streams_.size()), config_.max_batch_size);
-
-  // We first lock the mutex for streams_, take items from it, and then
-  // unlock the mutex; in doing so we don't need to lock the mutex to
-  // access hdl and connection_data later.
-  std::vector<connection_hdl> handles(size);
-
-  // Store connection_data here to prevent the data from being freed
-  // while we are still using it.
-  std::vector<ConnectionDataPtr> connection_data(size);
-
-  std::vector<const float *> samples(size);
-  std::vector<int32_t> samples_length(size);
-  std::vector<std::unique_ptr<OfflineStream>> ss(size);
-  std::vector<OfflineStream *> p_ss(size);
-
-  for (int32_t i = 0; i != size; ++i) {
-    auto &p = streams_.front();
-    handles[i] = p.first;
-    connection_data[i] = p.second;
-    streams_.pop_front();
-
-    auto samples =
-        reinterpret_cast<const float *>(&connection_data[i]->data[0]);
-    auto num_samples = connection_data[i]->expected_byte_size / sizeof(float);
-    auto s = recognizer_.CreateStream();
-    s->AcceptSamples(samples, num_samples);
-
-    ss[i] = std::move(s);
-    p_ss[i] = ss[i].get();
+  // Prefer the fullest bucket so batches are both length-homogeneous
+  // and well occupied; an utterance that has waited longer than
+  // --max-bucket-wait overrides that and gets its bucket decoded now.
+  auto now = std::chrono::steady_clock::now();
+  int32_t num_buckets = static_cast<int32_t>(buckets_.size());
+
+  int32_t fullest = -1;
+  size_t fullest_size = 0;
+
+  int32_t aged = -1;
+  auto oldest = now;
+
+  for (int32_t i = 0; i != num_buckets; ++i) {
+    if (buckets_[i].empty()) {
+      continue;
+    }
+
+    if (buckets_[i].size() > fullest_size) {
+      fullest_size = buckets_[i].size();
+      fullest = i;
+    }
+
+    const auto &t = buckets_[i].front().second->enqueue_time;
+    if (t < oldest) {
+      oldest = t;
+      aged = i;
+    }
+  }
+
+  if (fullest == -1) {
+    return;  // every bucket is empty
   }
 
-  lock.unlock();
+  int32_t chosen = fullest;
+  if (aged != -1 && std::chrono::duration<float>(now - oldest).count() >=
+                        config_.max_bucket_wait) {
+    chosen = aged;
+  }
+
+  auto take_from = [&](int32_t i) {
+    if (i < 0 || i >= num_buckets) {
+      return;
+    }
+    auto &q = buckets_[i];
+    while (!q.empty() &&
+           static_cast<int32_t>(batch->size()) < max_batch_size) {
+      batch->push_back(std::move(q.front()));
+      q.pop_front();
+    }
+  };
+
+  // Top up a partial batch from the nearest buckets, shorter ones
+  // first: a shorter utterance only pads up to the chosen bucket, while
+  // a longer one would raise the padded length of the whole batch.
+  take_from(chosen);
+  for (int32_t d = 1;
+       d != num_buckets && static_cast<int32_t>(batch->size()) < max_batch_size;
+       ++d) {
+    take_from(chosen - d);
+    take_from(chosen + d);
+  }
+}
+
+void OfflineWebsocketDecoder::Decode() {
+  // Keep decoding until the queue is drained. Utterances that are queued
+  // while a batch is being decoded are admitted into the very next
+  // encoder invocation of this worker, instead of waiting for another
+  // worker to be scheduled; this keeps batch occupancy close to
+  // max_batch_size under mixed-length traffic.
+  while (true) {
+    // We first lock the mutex for the queue, take a batch from it, and
+    // then unlock the mutex; in doing so we don't need to lock the
+    // mutex to access hdl and connection_data later.
+    std::vector<std::pair<connection_hdl, std::unique_ptr<ConnectionData>>>
+        batch;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      CollectBatchLocked(&batch);
+    }
+
+    if (batch.empty()) {
+      return;
+    }
+
+    int32_t size = static_cast<int32_t>(batch.size());
+
+    std::vector<connection_hdl> handles(size);
+
+    // This worker is the sole owner of the queued utterances from here
+    // on; they are freed when this iteration ends.
+    std::vector<std::unique_ptr<ConnectionData>> connection_data(size);
+
+    std::vector<std::unique_ptr<OfflineStream>> ss(size);
+    std::vector<OfflineStream *> p_ss(size);
+
+    for (int32_t i = 0; i != size; ++i) {
+      handles[i] = batch[i].first;
+      connection_data[i] = std::move(batch[i].second);
+
+      // The stream was built, and almost all of its features computed,
+      // while the utterance was still being uploaded; see OnMessage().
+      ss[i] = std::move(connection_data[i]->stream);
+      p_ss[i] = ss[i].get();
+    }
+
+    auto dequeue_time = std::chrono::steady_clock::now();
+
+    // Note: DecodeStreams is thread-safe
+    recognizer_.DecodeStreams(p_ss.data(), size);
+
+    // The server always replies with text, so results of a recognizer
+    // configured with --lazy-text are materialized here. A no-op with
+    // the default eager configuration.
+    for (int32_t i = 0; i != size; ++i) {
+      ss[i]->GetResult().MaterializeText();
+    }
+
+    bool collect_timings = config_.recognizer_config.collect_timings;
+
+    if (archive_writer_) {
+      for (int32_t i = 0; i != size; ++i) {
+        archive_writer_->Write(std::to_string(num_decoded_.fetch_add(1)),
+                               ss[i]->GetResult());
+      }
+      archive_writer_->Flush();
+    }
+
+    for (int32_t i = 0; i != size; ++i) {
+      connection_hdl hdl = handles[i];
+
+      std::string text;
+      if (collect_timings) {
+        // With --collect-timings the reply is the full JSON result, so
+        // the client sees the stage breakdown. Serialize once to time
+        // it, then again with the number filled in; the doubled cost is
+        // opt-in.
+        auto r = ss[i]->GetResult();
+        r.timings.queue_wait =
+            std::chrono::duration<float>(dequeue_time -
+                                         connection_data[i]->enqueue_time)
+                .count();
+
+        auto serialize_begin = std::chrono::steady_clock::now();
+        text = r.AsJsonString();
+        r.timings.serialization =
+            std::chrono::duration<float>(std::chrono::steady_clock::now() -
+                                         serialize_begin)
+                .count();
+
+        text = r.AsJsonString();
+      } else {
+        text = ss[i]->GetResult().text;
+      }
 
-  // Note: DecodeStreams is thread-safe
-  recognizer_.DecodeStreams(p_ss.data(), size);
-
-  for (int32_t i = 0; i != size; ++i) {
-    connection_hdl hdl = handles[i];
-    asio::post(server_->GetConnectionContext(),
-               [this, hdl, text = ss[i]->GetResult().text]() {
-                 websocketpp::lib::error_code ec;
-                 server_->GetServer().send(
-                     hdl, text, websocketpp::frame::opcode::text, ec);
-                 if (ec) {
-                   server_->GetServer().get_alog().write(
-                       websocketpp::log::alevel::app, ec.message());
-                 }
-               });
+      asio::post(server_->GetConnectionContext(),
+                 [this, hdl, text = std::move(text)]() {
+                   websocketpp::lib::error_code ec;
+                   server_->GetServer().send(
+                       hdl, text, websocketpp::frame::opcode::text, ec);
+                   if (ec) {
+                     server_->GetServer().get_alog().write(
+                         websocketpp::log::alevel::app, ec.message());
+                   }
+                 });
+    }
   }
 }
 void OfflineWebsocketServerConfig::Register(ParseOptions *po) {
@@ -114,6 +304,23 @@ void OfflineWebsocketServerConfig::Register(ParseOptions *po) {
   po->Register("log-file", &log_file,
                "Path to the log file. Logs are "
                "appended to this file");
+
+  po->Register("tcp-nodelay", &tcp_nodelay,
+               "true to disable Nagle's algorithm (TCP_NODELAY) on "
+               "accepted connections, so small frames (headers, results) "
+               "go out right away instead of waiting up to a delayed-ACK "
+               "interval in the kernel.");
+
+  po->Register("reuse-port", &reuse_port,
+               "true to bind the websocket port with SO_REUSEPORT, so "
+               "several server processes can share one port and the "
+               "kernel load balances new connections across them.");
+
+  po->Register("uds-path", &uds_path,
+               "If not empty, path of a unix domain socket the server "
+               "additionally listens on. Colocated clients (e.g., a "
+               "gateway on the same host) then bypass the TCP stack "
+               "entirely. The socket file is re-created at startup.");
 }
 
 void OfflineWebsocketServerConfig::Validate() const {
@@ -138,7 +345,9 @@ OfflineWebsocketServer::OfflineWebsocketServer(
       config_(config),
       log_(config.log_file, std::ios::app),
       tee_(std::cout, log_),
-      decoder_(decoder_config, this) {
+      decoder_(decoder_config, this),
+      opus_pool_(decoder_config.recognizer_config.feat_config.fbank_opts
+                     .frame_opts.samp_freq) {
   SetupLog();
 
   server_.init_asio(&io_conn_);
@@ -154,6 +363,17 @@ OfflineWebsocketServer::OfflineWebsocketServer(
         OnMessage(hdl, msg);
       });
 
+  if (config.tcp_nodelay) {
+    // See --tcp-nodelay; the handler runs once per accepted socket,
+    // before the websocket handshake. Errors are ignored on purpose: a
+    // unix-socket connection has no Nagle to disable.
+    server_.set_socket_init_handler(
+        [](connection_hdl /*hdl*/, asio::ip::tcp::socket &s) {
+          asio::error_code ec;
+          s.set_option(asio::ip::tcp::no_delay(true), ec);
+        });
+  }
+
   auto sample_rate = decoder_config.recognizer_config.feat_config.fbank_opts
                          .frame_opts.samp_freq;
 
@@ -163,6 +383,11 @@ OfflineWebsocketServer::OfflineWebsocketServer(
   SHERPA_LOG(INFO) << "max_utterance_length: "
                    << decoder_config.max_utterance_length << " s,"
                    << "max_byte_size_: " << max_byte_size_;
+
+  // Allocator A/B runs are meaningless without knowing which malloc a
+  // given log belongs to; see SHERPA_MALLOC and sherpa_malloc_* on
+  // /metrics.
+  SHERPA_LOG(INFO) << "malloc implementation: " << AllocatorName();
 }
 
 void OfflineWebsocketServer::SetupLog() {
@@ -197,10 +422,44 @@ void OfflineWebsocketServer::OnHttp(connection_hdl hdl) {
   std::string filename = con->get_resource();
   if (filename == "/") filename = "/index.html";
 
+  if (filename == "/metrics") {
+    // All registered serving metrics, in the Prometheus text format.
+    // The allocator gauges are refreshed per scrape; everything else is
+    // updated at the source.
+    UpdateAllocatorMetrics();
+    con->set_status(websocketpp::http::status_code::ok);
+    con->append_header("Content-Type", "text/plain; version=0.0.4");
+    con->set_body(MetricsRegistry::Get().Render() + RenderProfSites());
+    return;
+  }
+
   std::string content;
   bool found = false;
   if (filename != "/streaming_record.html") {
-    found = http_server_.ProcessRequest(filename, &content);
+    if (const HttpAsset *asset = http_server_.Find(filename)) {
+      con->append_header("ETag", asset->etag);
+
+      if (con->get_request_header("If-None-Match") == asset->etag) {
+        // The client already has this version cached; skip the body.
+        con->set_status(websocketpp::http::status_code::not_modified);
+        return;
+      }
+
+      if (!asset->gzipped.empty() &&
+          con->get_request_header("Accept-Encoding").find("gzip") !=
+              std::string::npos) {
+        // Serve the pre-compressed copy; nothing is compressed on the fly.
+        con->append_header("Content-Encoding", "gzip");
+        con->set_status(websocketpp::http::status_code::ok);
+        con->set_body(asset->gzipped);
+        return;
+      }
+
+      con->set_status(websocketpp::http::status_code::ok);
+      con->set_body(asset->content);
+      return;
+    }
+    content = http_server_.GetErrorContent();
   } else {
     content = R"(
 <!doctype html><html><head>
@@ -223,6 +482,72 @@ Go back to <a href="/upload.html">/upload.html</a> or
   con->set_body(std::move(content));
 }
 
+// Decode one Opus packet and feed the samples to the connection's
+// stream, advancing cur. Return false if the packet is corrupt or
+// decodes to more samples than the header announced.
+static bool DecodeOpusPacket(ConnectionData *c, const int8_t *packet,
+                             size_t num_bytes) {
+  // 5760 samples is the longest legal Opus frame (120 ms at 48 kHz).
+  std::array<float, 5760> scratch;
+  int32_t max_samples =
+      std::min<int32_t>((c->expected_byte_size - c->cur) / 4,
+                        static_cast<int32_t>(scratch.size()));
+
+  int32_t n = c->opus->Decode(reinterpret_cast<const uint8_t *>(packet),
+                              num_bytes, scratch.data(), max_samples);
+  if (n < 0) {
+    return false;
+  }
+
+  c->stream->AcceptSamplesChunk(scratch.data(), n);
+  c->cur += n * 4;
+  return true;
+}
+
+// Feed raw PCM bytes (float32, or int16 if negotiated) of one websocket
+// frame to the connection's stream, advancing cur. Bytes that do not
+// complete a sample are carried over to the next frame.
+static void FeedPcm(ConnectionData *c, const int8_t *p, size_t num_bytes) {
+  c->cur += static_cast<int32_t>(num_bytes);
+
+  std::vector<int8_t> buf;
+  if (!c->carry.empty()) {
+    buf.swap(c->carry);
+    buf.insert(buf.end(), p, p + num_bytes);
+    p = buf.data();
+    num_bytes = buf.size();
+  }
+
+  size_t bytes_per_sample = c->BytesPerSample();
+  size_t num_samples = num_bytes / bytes_per_sample;
+  size_t used = num_samples * bytes_per_sample;
+
+  if (num_samples != 0) {
+    if (c->int16) {
+      // One vectorized int16 -> float pass per received frame, into the
+      // connection's reusable scratch buffer so steady-state frames
+      // allocate nothing; see ConnectionData::scratch.
+      if (c->scratch.size() < num_samples) {
+        c->scratch.resize(num_samples);
+      }
+      auto src =
+          torch::from_blob(const_cast<int8_t *>(p),
+                           {static_cast<int64_t>(num_samples)}, torch::kShort);
+      auto dst = torch::from_blob(c->scratch.data(),
+                                  {static_cast<int64_t>(num_samples)},
+                                  torch::kFloat);
+      dst.copy_(src).div_(32768);
+      c->stream->AcceptSamplesChunk(c->scratch.data(),
+                                    static_cast<int32_t>(num_samples));
+    } else {
+      c->stream->AcceptSamplesChunk(reinterpret_cast<const float *>(p),
+                                    static_cast<int32_t>(num_samples));
+    }
+  }
+
+  c->carry.assign(p + used, p + num_bytes);
+}
+
 void OfflineWebsocketServer::OnMessage(connection_hdl hdl,
                                        server::message_ptr msg) {
   std::unique_lock<std::mutex> lock(mutex_);
@@ -236,6 +561,27 @@ void OfflineWebsocketServer::OnMessage(connection_hdl hdl,
         // The client will not send any more data. We can close the
         // connection now.
         Close(hdl, websocketpp::close::status::normal, "Done");
+      } else if (payload == "codec: opus") {
+        if (!OpusDecoderPool::Available()) {
+          Close(hdl, websocketpp::close::status::unsupported_data,
+                "This server was not built with Opus support. "
+                "Rebuild it with -DSHERPA_ENABLE_OPUS=ON");
+          break;
+        }
+        if (connection_data->expected_byte_size != 0) {
+          Close(hdl, websocketpp::close::status::normal,
+                "The codec cannot change in the middle of an utterance");
+          break;
+        }
+        connection_data->opus = opus_pool_.Acquire();
+      } else if (payload == "format: int16") {
+        if (connection_data->expected_byte_size != 0) {
+          Close(hdl, websocketpp::close::status::normal,
+                "The sample format cannot change in the middle of an "
+                "utterance");
+          break;
+        }
+        connection_data->int16 = true;
       } else {
         Close(hdl, websocketpp::close::status::normal,
               std::string("Invalid payload: ") + payload);
@@ -256,10 +602,12 @@ void OfflineWebsocketServer::OnMessage(connection_hdl hdl,
         connection_data->expected_byte_size =
             *reinterpret_cast<const int32_t *>(p);
 
-        if (connection_data->expected_byte_size > max_byte_size_) {
-          float num_samples =
-              connection_data->expected_byte_size / sizeof(float);
-
+        // max_byte_size_ assumes float samples, so compare in samples;
+        // an int16 utterance carries twice as many per byte.
+        int32_t num_samples = connection_data->expected_byte_size /
+                              connection_data->BytesPerSample();
+        if (num_samples >
+            max_byte_size_ / static_cast<int32_t>(sizeof(float))) {
           auto sample_rate = decoder_.GetConfig()
                                  .recognizer_config.feat_config.fbank_opts
                                  .frame_opts.samp_freq;
@@ -276,25 +624,57 @@ void OfflineWebsocketServer::OnMessage(connection_hdl hdl,
           break;
         }
 
-        connection_data->data.resize(connection_data->expected_byte_size);
-        std::copy(payload.begin() + 4, payload.end(),
-                  connection_data->data.data());
-        connection_data->cur = payload.size() - 4;
+        // Feature extraction starts right here, while the rest of the
+        // utterance is still in flight; see ConnectionData::stream.
+        connection_data->stream = decoder_.CreateStream();
+
+        if (connection_data->opus) {
+          if (payload.size() > 4 &&
+              !DecodeOpusPacket(connection_data.get(), p + 4,
+                                payload.size() - 4)) {
+            Close(hdl, websocketpp::close::status::invalid_payload,
+                  "Failed to decode an Opus packet");
+            break;
+          }
+        } else if (payload.size() > 4) {
+          // The client may merge the header and the first samples into
+          // one frame; see the protocol.
+          FeedPcm(connection_data.get(), p + 4, payload.size() - 4);
+        }
+      } else if (connection_data->opus) {
+        if (!DecodeOpusPacket(connection_data.get(), p, payload.size())) {
+          Close(hdl, websocketpp::close::status::invalid_payload,
+                "Failed to decode an Opus packet");
+          break;
+        }
       } else {
-        std::copy(payload.begin(), payload.end(),
-                  connection_data->data.data() + connection_data->cur);
-        connection_data->cur += payload.size();
+        FeedPcm(connection_data.get(), p, payload.size());
       }
 
       if (connection_data->expected_byte_size == connection_data->cur) {
-        auto d = std::make_shared<ConnectionData>(std::move(*connection_data));
+        // Only the tail of the utterance (and the per-utterance
+        // normalization, if any) is left to process here; the bulk of
+        // the features was computed while the audio was arriving.
+        connection_data->stream->FinishAcceptingSamples();
+
+        // The queued copy is owned by exactly one party at a time (the
+        // queue, then the decoding worker), so it is handed off as a
+        // unique_ptr; only the live object in connections_ stays
+        // reference counted.
+        auto d = std::make_unique<ConnectionData>(std::move(*connection_data));
         // Clear it so that we can handle the next audio file from the client.
         // The client can send multiple audio files for recognition without
         // the need to create another connection.
         connection_data->expected_byte_size = 0;
         connection_data->cur = 0;
 
-        decoder_.Push(hdl, d);
+        // The negotiated codec outlives the utterance: the borrowed
+        // decoder goes back to the connection, not into the queue. The
+        // conversion scratch buffer is recycled the same way.
+        connection_data->opus = std::move(d->opus);
+        connection_data->scratch = std::move(d->scratch);
+
+        decoder_.Push(hdl, std::move(d));
 
         connection_data->Clear();
 
@@ -327,10 +707,89 @@ void OfflineWebsocketServer::Close(connection_hdl hdl,
   server_.get_alog().write(websocketpp::log::alevel::app, os.str());
 }
 
+void OfflineWebsocketServer::StartTcpAccept() {
+  auto con = server_.get_connection();
+  tcp_acceptor_->async_accept(con->get_raw_socket(),
+                              [this, con](const asio::error_code &ec) {
+                                if (ec == asio::error::operation_aborted) {
+                                  return;
+                                }
+                                if (!ec) {
+                                  con->start();
+                                }
+                                StartTcpAccept();
+                              });
+}
+
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+void OfflineWebsocketServer::StartUnixAccept() {
+  uds_acceptor_->async_accept(
+      *uds_socket_, [this](const asio::error_code &ec) {
+        if (ec == asio::error::operation_aborted) {
+          return;
+        }
+
+        if (!ec) {
+          // Transplant the accepted descriptor into a fresh websocketpp
+          // connection. The transport's socket type is TCP, but at the
+          // descriptor level both are stream sockets, so reads and
+          // writes behave identically; only TCP-specific options are
+          // skipped for it (see the socket init handler).
+          asio::error_code sec;
+          auto fd = uds_socket_->release(sec);
+          if (!sec) {
+            auto con = server_.get_connection();
+            con->get_raw_socket().assign(asio::ip::tcp::v4(), fd, sec);
+            if (!sec) {
+              con->start();
+            }
+          }
+        }
+
+        StartUnixAccept();
+      });
+}
+#endif
+
 void OfflineWebsocketServer::Run(uint16_t port) {
-  server_.set_reuse_addr(true);
-  server_.listen(asio::ip::tcp::v4(), port);
-  server_.start_accept();
+  if (config_.reuse_port) {
+#ifdef SO_REUSEPORT
+    // The endpoint's built-in acceptor cannot set SO_REUSEPORT between
+    // open and bind, so the server binds the listener itself and hands
+    // the accepted sockets to websocketpp connections.
+    asio::ip::tcp::endpoint ep(asio::ip::tcp::v4(), port);
+    tcp_acceptor_ = std::make_unique<asio::ip::tcp::acceptor>(io_conn_);
+    tcp_acceptor_->open(ep.protocol());
+    tcp_acceptor_->set_option(asio::socket_base::reuse_address(true));
+    tcp_acceptor_->set_option(
+        asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+    tcp_acceptor_->bind(ep);
+    tcp_acceptor_->listen(asio::socket_base::max_listen_connections);
+    StartTcpAccept();
+#else
+    SHERPA_LOG(FATAL) << "--reuse-port is not supported on this platform";
+#endif
+  } else {
+    server_.set_reuse_addr(true);
+    server_.listen(asio::ip::tcp::v4(), port);
+    server_.start_accept();
+  }
+
+  if (!config_.uds_path.empty()) {
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+    // A stale socket file from a previous run would make bind() fail.
+    std::remove(config_.uds_path.c_str());
+    uds_acceptor_ = std::make_unique<asio::local::stream_protocol::acceptor>(
+        io_conn_, asio::local::stream_protocol::endpoint(config_.uds_path));
+    uds_socket_ =
+        std::make_unique<asio::local::stream_protocol::socket>(io_conn_);
+    StartUnixAccept();
+    SHERPA_LOG(INFO) << "Listening on unix domain socket "
+                     << config_.uds_path;
+#else
+    SHERPA_LOG(FATAL) << "--uds-path is not supported on this platform";
+#endif
+  }
 }
 
 }  // namespace sherpa
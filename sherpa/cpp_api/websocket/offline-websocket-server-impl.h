@@ -5,6 +5,8 @@
 #ifndef SHERPA_CPP_API_WEBSOCKET_OFFLINE_WEBSOCKET_SERVER_IMPL_H_
 #define SHERPA_CPP_API_WEBSOCKET_OFFLINE_WEBSOCKET_SERVER_IMPL_H_
 
+#include <atomic>
+#include <chrono>  // NOLINT
 #include <deque>
 #include <map>
 #include <memory>
@@ -15,7 +17,9 @@
 #include "asio.hpp"
 #include "sherpa/cpp_api/offline-recognizer.h"
 #include "sherpa/cpp_api/parse-options.h"
+#include "sherpa/cpp_api/result-archive.h"
 #include "sherpa/cpp_api/websocket/http-server.h"
+#include "sherpa/cpp_api/websocket/opus-stream-decoder.h"
 #include "sherpa/cpp_api/websocket/tee-stream.h"
 #include "websocketpp/config/asio_no_tls.hpp"  // TODO(fangjun): support TLS
 #include "websocketpp/server.hpp"
@@ -32,15 +36,55 @@ struct ConnectionData {
   // Number of bytes received so far
   int32_t cur = 0;
 
-  // It saves the received contents from the client
-  std::vector<int8_t> data;
+  // The stream of the utterance being uploaded. It is created when the
+  // 4-byte header arrives and fed incrementally as audio frames come
+  // in (see OfflineStream::AcceptSamplesChunk), so feature extraction
+  // overlaps the upload and only the tail of the utterance remains to
+  // be processed when the last byte arrives; the raw audio itself is
+  // never buffered.
+  std::unique_ptr<OfflineStream> stream;
+
+  // Bytes of a sample that was split across websocket frames (at most
+  // 3); they are prepended to the next frame before feeding `stream`.
+  std::vector<int8_t> carry;
+
+  // When this utterance entered the decoding queue. Used only with
+  // --collect-timings to report the queue wait on the result.
+  std::chrono::steady_clock::time_point enqueue_time;
+
+  // Borrowed from the server's decoder pool when the connection has
+  // negotiated the opus codec; nullptr for raw PCM. It stays with the
+  // connection across utterances, since the codec stays negotiated.
+  std::unique_ptr<OpusStreamDecoder> opus;
+
+  // True if the connection sends int16 samples instead of float32; see
+  // the "format: int16" negotiation in the protocol. Each received
+  // frame is converted to float in one vectorized pass before it is
+  // fed to `stream`.
+  bool int16 = false;
+
+  // Reusable buffer for the int16 -> float conversion. It is kept with
+  // the connection across utterances (Clear() leaves it alone), so once
+  // it reaches the size of the largest received frame the conversion
+  // allocates nothing.
+  std::vector<float> scratch;
+
+  int32_t BytesPerSample() const { return int16 ? 2 : 4; }
 
   void Clear() {
     expected_byte_size = 0;
     cur = 0;
-    data.clear();
+    stream.reset();
+    carry.clear();
   }
 };
+
+// Only the live per-connection object is reference counted: it is truly
+// shared between the connections_ map and whatever handler is running.
+// A completed utterance has exactly one owner at a time, so it travels
+// through the decoding queue as a unique_ptr instead (see
+// OfflineWebsocketDecoder::Push); the hand-offs are plain pointer moves
+// with no atomic refcount traffic.
 using ConnectionDataPtr = std::shared_ptr<ConnectionData>;
 
 struct OfflineWebsocketDecoderConfig {
@@ -50,6 +94,28 @@ struct OfflineWebsocketDecoderConfig {
 
   float max_utterance_length = 300;  // seconds
 
+  // If non-empty, the full JSON result of every decoded utterance is
+  // appended to this packed archive file. See
+  // sherpa/cpp_api/result-archive.h
+  std::string result_archive;
+
+  // When true, the decoding queue is split into utterance-length
+  // buckets and each batch is filled from one bucket (and its nearest
+  // neighbors), so every utterance is padded to roughly the longest one
+  // of its own length class instead of the longest one that happened to
+  // arrive in the same FIFO window. See also --length-bucket-width and
+  // --max-bucket-wait.
+  bool sort_by_length = false;
+
+  // Width in seconds of each length bucket. Used only with
+  // --sort-by-length.
+  float length_bucket_width = 5;
+
+  // An utterance that has waited longer than this many seconds gets its
+  // bucket decoded next even if a fuller bucket exists, so sparse
+  // buckets do not starve. Used only with --sort-by-length.
+  float max_bucket_wait = 2;
+
   void Register(ParseOptions *po);
   void Validate() const;
 };
@@ -69,9 +135,17 @@ class OfflineWebsocketDecoder {
    *
    * @param hdl A handle to the connection. We can use it to send the result
    *            back to the client once it finishes decoding.
-   * @param d  The received data
+   * @param d  The received data. Ownership is transferred to the queue
+   *            and later to the worker that decodes the utterance.
    */
-  void Push(connection_hdl hdl, ConnectionDataPtr d);
+  void Push(connection_hdl hdl, std::unique_ptr<ConnectionData> d);
+
+  /** Create a stream for an utterance about to be uploaded; the server
+   * feeds it chunk by chunk as the audio arrives.
+   */
+  std::unique_ptr<OfflineStream> CreateStream() {
+    return recognizer_.CreateStream();
+  }
 
   /** It is called by one of the work thread.
    */
@@ -80,6 +154,17 @@ class OfflineWebsocketDecoder {
   const OfflineWebsocketDecoderConfig &GetConfig() const { return config_; }
 
  private:
+  // Return the index into buckets_ for an utterance, derived from its
+  // duration and --length-bucket-width.
+  int32_t BucketOf(const ConnectionData &d) const;
+
+  // Collect up to --max-batch-size queued utterances into `batch`,
+  // either in FIFO order or, with --sort-by-length, from length
+  // buckets. Called with mutex_ held.
+  void CollectBatchLocked(
+      std::vector<std::pair<connection_hdl, std::unique_ptr<ConnectionData>>>
+          *batch);
+
   OfflineWebsocketDecoderConfig config_;
 
   /** When we have received all the data from the client, we put it into
@@ -91,10 +176,23 @@ class OfflineWebsocketDecoder {
    * wait and take whatever we have for decoding.
    */
   std::mutex mutex_;
-  std::deque<std::pair<connection_hdl, ConnectionDataPtr>> streams_;
+  std::deque<std::pair<connection_hdl, std::unique_ptr<ConnectionData>>>
+      streams_;
+
+  // Used instead of streams_ with --sort-by-length: buckets_[i] queues
+  // utterances of duration [i, i + 1) * length_bucket_width seconds;
+  // the last bucket also takes everything longer. Protected by mutex_.
+  std::vector<
+      std::deque<std::pair<connection_hdl, std::unique_ptr<ConnectionData>>>>
+      buckets_;
 
   OfflineWebsocketServer *server_;  // Not owned
   OfflineRecognizer recognizer_;
+
+  // Set only if --result-archive is given. Keys are sequence numbers
+  // assigned in decoding order; the writer itself is thread-safe.
+  std::unique_ptr<ResultArchiveWriter> archive_writer_;
+  std::atomic<int64_t> num_decoded_{0};
 };
 
 struct OfflineWebsocketServerConfig {
@@ -102,6 +200,24 @@ struct OfflineWebsocketServerConfig {
   std::string doc_root = "../sherpa/bin/web";  // root for the http server
   std::string log_file = "./log.txt";
 
+  // true to disable Nagle's algorithm (TCP_NODELAY) on accepted
+  // connections, so small frames (headers, results) go out right away
+  // instead of waiting up to a delayed-ACK interval in the kernel.
+  bool tcp_nodelay = true;
+
+  // true to bind the listening socket with SO_REUSEPORT, so several
+  // server processes can listen on the same port and the kernel load
+  // balances new connections across them. The server then runs its own
+  // acceptor (the endpoint's built-in one cannot set the option before
+  // binding) and hands accepted sockets to websocketpp.
+  bool reuse_port = false;
+
+  // If not empty, path of a unix domain socket the server additionally
+  // listens on, for colocated clients (e.g., a gateway on the same
+  // host) that would otherwise pay the full TCP stack for a localhost
+  // hop. Any stale socket file is removed at startup.
+  std::string uds_path;
+
   void Register(sherpa::ParseOptions *po);
   void Validate() const;
 };
@@ -162,12 +278,43 @@ class OfflineWebsocketServer {
   //  (d) Step (2) and step (3) can be merged into one step to send bandwidth.
   //  (e) Only audio samples are sent. For instance, if we want to decode
   //      a WAVE file, the header of the WAVE is not sent.
+  //  (f) Before step (2) the client may send a text message
+  //      "codec: opus" to switch the connection to compressed audio
+  //      (requires a server built with -DSHERPA_ENABLE_OPUS=ON; the
+  //      server closes the connection otherwise). The 4-byte header
+  //      then announces the number of *decoded* bytes, i.e.,
+  //      num_samples * 4, and each following binary message carries
+  //      exactly one Opus packet of mono audio at the sampling rate the
+  //      model expects. The codec stays in effect for subsequent
+  //      utterances on the same connection.
+  //  (g) Before step (2) the client may send a text message
+  //      "format: int16" to send raw samples as little-endian int16
+  //      instead of float32, halving the upload bandwidth. The 4-byte
+  //      header then announces num_samples * 2 bytes. The format stays
+  //      in effect for subsequent utterances on the same connection; it
+  //      does not combine with "codec: opus", which always decodes to
+  //      float on the server.
   void OnMessage(connection_hdl hdl, server::message_ptr msg);
 
   // Close a websocket connection with given code and reason
   void Close(connection_hdl hdl, websocketpp::close::status::value code,
              const std::string &reason);
 
+  // Accept loop of the TCP listener the server binds itself; used only
+  // with --reuse-port (the endpoint's built-in acceptor cannot set
+  // SO_REUSEPORT before binding). Accepted sockets are handed to
+  // websocketpp connections, which then run exactly as if the endpoint
+  // had accepted them.
+  void StartTcpAccept();
+
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+  // Accept loop of the unix domain socket listener; see --uds-path. An
+  // accepted descriptor is transplanted into a websocketpp connection:
+  // at the descriptor level a unix stream socket behaves like a TCP
+  // one, so the transport works unchanged.
+  void StartUnixAccept();
+#endif
+
  private:
   asio::io_context &io_conn_;
   asio::io_context &io_work_;
@@ -184,7 +331,17 @@ class OfflineWebsocketServer {
   sherpa::TeeStream tee_;
 
   OfflineWebsocketDecoder decoder_;
+  OpusDecoderPool opus_pool_;
   int32_t max_byte_size_;
+
+  // The listeners the server binds itself; see --reuse-port and
+  // --uds-path. Both hand their accepted sockets to websocketpp
+  // connections.
+  std::unique_ptr<asio::ip::tcp::acceptor> tcp_acceptor_;
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+  std::unique_ptr<asio::local::stream_protocol::acceptor> uds_acceptor_;
+  std::unique_ptr<asio::local::stream_protocol::socket> uds_socket_;
+#endif
 };
 
 }  // namespace sherpa
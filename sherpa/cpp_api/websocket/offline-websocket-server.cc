@@ -61,6 +61,17 @@ int32_t main(int32_t argc, char *argv[]) {
               "Number of threads to use for neural network "
               "computation and decoding.");
 
+  // If non-zero, a single shared thread pool replaces the fixed
+  // io/work split
+  int32_t num_threads = 0;
+
+  po.Register("num-threads", &num_threads,
+              "If greater than 0, use one shared thread pool of this size "
+              "for both network I/O and decoding, so threads can flex "
+              "between the two under bursty traffic. If -1, size the "
+              "shared pool by the number of CPU cores. If 0 (default), "
+              "use the fixed --num-io-threads/--num-work-threads split.");
+
   po.Register("port", &port, "The port on which the server will listen.");
 
   config.Register(&po);
@@ -82,30 +93,53 @@ int32_t main(int32_t argc, char *argv[]) {
   config.Validate();
   decoder_config.Validate();
 
-  asio::io_context io_conn;  // for network connections
-  asio::io_context io_work;  // for neural network and decoding
+  asio::io_context io_shared;  // used when --num-threads is non-zero
+  asio::io_context io_conn;    // for network connections
+  asio::io_context io_work;    // for neural network and decoding
+
+  // With a shared pool, both the connection handlers and the decoding
+  // tasks are posted to the same io_context, so any thread of the pool
+  // picks up whatever work is pending: under bursty traffic the pool is
+  // not partitioned into idle work threads and saturated I/O threads.
+  bool use_shared_pool = num_threads != 0;
+  if (use_shared_pool && num_threads < 0) {
+    num_threads = std::max<int32_t>(std::thread::hardware_concurrency(), 2);
+  }
 
-  sherpa::OfflineWebsocketServer server(io_conn, io_work, config,
-                                        decoder_config);
+  sherpa::OfflineWebsocketServer server(
+      use_shared_pool ? io_shared : io_conn,
+      use_shared_pool ? io_shared : io_work, config, decoder_config);
   server.Run(port);
 
   SHERPA_LOG(INFO) << "Listening on: " << port << "\n";
-  SHERPA_LOG(INFO) << "Number of I/O threads: " << num_io_threads << "\n";
-  SHERPA_LOG(INFO) << "Number of work threads: " << num_work_threads << "\n";
+  if (use_shared_pool) {
+    SHERPA_LOG(INFO) << "Number of shared threads: " << num_threads << "\n";
+  } else {
+    SHERPA_LOG(INFO) << "Number of I/O threads: " << num_io_threads << "\n";
+    SHERPA_LOG(INFO) << "Number of work threads: " << num_work_threads << "\n";
+  }
 
   // give some work to do for the io_work pool
   auto work_guard = asio::make_work_guard(io_work);
 
   std::vector<std::thread> io_threads;
+  std::vector<std::thread> work_threads;
 
-  // decrement since the main thread is also used for network communications
-  for (int32_t i = 0; i < num_io_threads - 1; ++i) {
-    io_threads.emplace_back([&io_conn]() { io_conn.run(); });
-  }
+  if (use_shared_pool) {
+    // decrement since the main thread also runs the shared pool below
+    for (int32_t i = 0; i < num_threads - 1; ++i) {
+      work_threads.emplace_back([&io_shared]() { io_shared.run(); });
+    }
+  } else {
+    // decrement since the main thread is also used for network
+    // communications
+    for (int32_t i = 0; i < num_io_threads - 1; ++i) {
+      io_threads.emplace_back([&io_conn]() { io_conn.run(); });
+    }
 
-  std::vector<std::thread> work_threads;
-  for (int32_t i = 0; i < num_work_threads; ++i) {
-    work_threads.emplace_back([&io_work]() { io_work.run(); });
+    for (int32_t i = 0; i < num_work_threads; ++i) {
+      work_threads.emplace_back([&io_work]() { io_work.run(); });
+    }
   }
 
   // Print a message telling users how to access the HTTP service
@@ -127,7 +161,11 @@ int32_t main(int32_t argc, char *argv[]) {
   }
   SHERPA_LOG(INFO) << os.str();
 
-  io_conn.run();
+  if (use_shared_pool) {
+    io_shared.run();
+  } else {
+    io_conn.run();
+  }
 
   for (auto &t : io_threads) {
     t.join();
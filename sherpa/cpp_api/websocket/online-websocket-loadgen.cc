@@ -0,0 +1,425 @@
+// sherpa/cpp_api/websocket/online-websocket-loadgen.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "kaldi_native_io/csrc/kaldi-io.h"
+#include "kaldi_native_io/csrc/wave-reader.h"
+#include "nlohmann/json.hpp"
+#include "sherpa/cpp_api/parse-options.h"
+#include "sherpa/csrc/log.h"
+#include "torch/script.h"
+#include "websocketpp/client.hpp"
+#include "websocketpp/config/asio_no_tls_client.hpp"
+#include "websocketpp/uri.hpp"
+
+using json = nlohmann::json;
+using client = websocketpp::client<websocketpp::config::asio_client>;
+
+using message_ptr = client::message_ptr;
+using websocketpp::connection_hdl;
+
+static constexpr const char *kUsageMessage = R"(
+Load generator for the sherpa online websocket server.
+
+It sustains --num-sessions concurrent streaming sessions from a wav
+corpus with open-loop pacing: audio chunks are sent on an absolute
+schedule derived from --rtf, never slowed down by server responses, so
+an overloaded server shows up as latency instead of reduced offered
+load. At the end it prints percentile reports of the partial-result
+latency (result arrival minus the last audio send) and of the
+final-result latency (final result minus the "Done" message).
+
+Usage:
+
+./bin/sherpa-online-loadgen --help
+
+./bin/sherpa-online-loadgen \
+  --server-ip=127.0.0.1 \
+  --server-port=6006 \
+  --num-sessions=200 \
+  --rtf=1.0 \
+  /path/to/foo.wav [bar.wav [...]]
+)";
+
+/** Read wave samples from a file.
+ *
+ * If the file has multiple channels, only the first channel is returned.
+ * Samples are normalized to the range [-1, 1).
+ *
+ * @param filename Path to the wave file. Only "*.wav" format is supported.
+ * @param expected_sample_rate  Expected sample rate of the wave file. It aborts
+ *                              if the sample rate of the given file is not
+ *                              equal to this value.
+ *
+ * @return Return a 1-D torch.float32 tensor containing audio samples
+ * in the range [-1, 1)
+ */
+static torch::Tensor ReadWave(const std::string &filename,
+                              float expected_sample_rate) {
+  bool binary = true;
+  kaldiio::Input ki(filename, &binary);
+  kaldiio::WaveHolder wh;
+  if (!wh.Read(ki.Stream())) {
+    std::cerr << "Failed to read " << filename;
+    exit(EXIT_FAILURE);
+  }
+  auto &wave_data = wh.Value();
+  if (wave_data.SampFreq() != expected_sample_rate) {
+    std::cerr << filename << "is expected to have sample rate "
+              << expected_sample_rate << ". Given " << wave_data.SampFreq();
+    exit(EXIT_FAILURE);
+  }
+
+  auto &d = wave_data.Data();
+
+  if (d.NumRows() > 1) {
+    std::cerr << "Only the first channel from " << filename << " is used";
+  }
+
+  auto tensor = torch::from_blob(const_cast<float *>(d.RowData(0)),
+                                 {d.NumCols()}, torch::kFloat);
+
+  return tensor / 32768;
+}
+
+// Latency samples collected from all sessions. Sessions run on several
+// I/O threads, so every access takes the mutex; a few microseconds per
+// result are negligible next to the network round trip being measured.
+struct LatencyStats {
+  std::mutex mutex;
+
+  std::vector<double> partial_ms;  // result arrival - last audio send
+  std::vector<double> final_ms;    // final result - "Done" sent
+  std::vector<double> send_lag_ms;  // actual send time - scheduled time
+
+  int64_t num_utterances = 0;
+  int64_t num_failures = 0;
+
+  void AddPartial(double ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    partial_ms.push_back(ms);
+  }
+
+  void AddFinal(double ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    final_ms.push_back(ms);
+    ++num_utterances;
+  }
+
+  void AddSendLag(double ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    send_lag_ms.push_back(ms);
+  }
+
+  void AddFailure() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++num_failures;
+  }
+};
+
+// Return the given percentile (0 to 100) of v. v must be sorted.
+static double Percentile(const std::vector<double> &v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  auto idx = static_cast<size_t>(p / 100 * (v.size() - 1) + 0.5);
+  return v[idx];
+}
+
+static void PrintPercentiles(const char *name, std::vector<double> *v) {
+  std::sort(v->begin(), v->end());
+  fprintf(stderr, "%-20s n=%-8zu p50=%8.1f p90=%8.1f p95=%8.1f "
+          "p99=%8.1f max=%8.1f (ms)\n",
+          name, v->size(), Percentile(*v, 50), Percentile(*v, 90),
+          Percentile(*v, 95), Percentile(*v, 99), Percentile(*v, 100));
+}
+
+// One streaming session. It plays utterances from the corpus one after
+// another, one websocket connection per utterance (the server closes
+// the connection after the final result), until --num-rounds utterances
+// are done.
+//
+// Pacing is open loop: chunk k of an utterance is sent at
+// utterance start + k * seconds_per_message / rtf, driven by a timer
+// with absolute deadlines. If the loadgen itself falls behind, the lag
+// is recorded (see send_lag in the report) but the schedule is not
+// stretched, so the offered load stays constant.
+class Session : public std::enable_shared_from_this<Session> {
+ public:
+  Session(client *c, asio::io_context *io,
+          const std::vector<torch::Tensor> *corpus,
+          const websocketpp::uri &uri, int32_t first_wave, int32_t num_rounds,
+          int32_t samples_per_message, float seconds_per_message, float rtf,
+          LatencyStats *stats)
+      : c_(c),
+        timer_(*io),
+        corpus_(corpus),
+        uri_(uri),
+        wave_index_(first_wave),
+        num_rounds_(num_rounds),
+        samples_per_message_(samples_per_message),
+        message_interval_(std::chrono::microseconds(
+            static_cast<int64_t>(seconds_per_message / rtf * 1e6))),
+        stats_(stats) {}
+
+  // Begin the first utterance after the given ramp delay, so a large
+  // session count does not connect as one thundering herd.
+  void StartAfter(float delay_seconds) {
+    timer_.expires_after(std::chrono::microseconds(
+        static_cast<int64_t>(delay_seconds * 1e6)));
+    auto self = shared_from_this();
+    timer_.async_wait([self](const asio::error_code &) {
+      self->StartUtterance();
+    });
+  }
+
+ private:
+  void StartUtterance() {
+    if (num_rounds_ == 0) {
+      return;  // this session is done; the last connection has closed
+    }
+    --num_rounds_;
+
+    samples_ = (*corpus_)[wave_index_ % corpus_->size()];
+    ++wave_index_;
+    num_sent_messages_ = 0;
+    done_time_us_ = 0;
+
+    websocketpp::lib::error_code ec;
+    client::connection_ptr con = c_->get_connection(uri_.str(), ec);
+    if (ec) {
+      SHERPA_LOG(ERROR) << "Could not create connection to " << uri_.str()
+                        << " because: " << ec.message() << "\n";
+      exit(EXIT_FAILURE);
+    }
+
+    auto self = shared_from_this();
+    con->set_open_handler([self](connection_hdl hdl) { self->OnOpen(hdl); });
+    con->set_message_handler([self](connection_hdl hdl, message_ptr msg) {
+      self->OnMessage(hdl, msg);
+    });
+    con->set_close_handler(
+        [self](connection_hdl) { self->StartUtterance(); });
+    con->set_fail_handler([self](connection_hdl) {
+      self->stats_->AddFailure();
+      self->StartUtterance();
+    });
+
+    c_->connect(con);
+  }
+
+  void OnOpen(connection_hdl hdl) {
+    utterance_start_ = std::chrono::steady_clock::now();
+    ScheduleNextChunk(hdl);
+  }
+
+  void ScheduleNextChunk(connection_hdl hdl) {
+    timer_.expires_at(utterance_start_ +
+                      num_sent_messages_ * message_interval_);
+    auto self = shared_from_this();
+    timer_.async_wait([self, hdl](const asio::error_code &ec) {
+      if (!ec) {
+        self->SendChunk(hdl);
+      }
+    });
+  }
+
+  void SendChunk(connection_hdl hdl) {
+    auto now = std::chrono::steady_clock::now();
+    auto deadline = utterance_start_ + num_sent_messages_ * message_interval_;
+    stats_->AddSendLag(
+        std::chrono::duration<double, std::milli>(now - deadline).count());
+
+    int32_t num_samples = samples_.numel();
+    int32_t begin = num_sent_messages_ * samples_per_message_;
+    int32_t this_message =
+        std::min(samples_per_message_, num_samples - begin);
+
+    websocketpp::lib::error_code ec;
+    c_->send(hdl, samples_.data_ptr<float>() + begin,
+             this_message * sizeof(float), websocketpp::frame::opcode::binary,
+             ec);
+    if (ec) {
+      SHERPA_LOG(INFO) << "Failed to send audio samples because "
+                       << ec.message();
+      stats_->AddFailure();
+      return;
+    }
+    last_send_time_us_ = NowMicros();
+    ++num_sent_messages_;
+
+    if (num_sent_messages_ * samples_per_message_ >= num_samples) {
+      c_->send(hdl, "Done", websocketpp::frame::opcode::text, ec);
+      done_time_us_ = NowMicros();
+    } else {
+      ScheduleNextChunk(hdl);
+    }
+  }
+
+  void OnMessage(connection_hdl hdl, message_ptr msg) {
+    auto now_us = NowMicros();
+    auto result = json::parse(msg->get_payload());
+
+    if (result["final"]) {
+      // The final result answers the "Done" message; everything else
+      // answers the most recent audio chunk.
+      if (done_time_us_ != 0) {
+        stats_->AddFinal((now_us - done_time_us_) / 1000.0);
+      }
+      websocketpp::lib::error_code ec;
+      c_->close(hdl, websocketpp::close::status::normal, "done", ec);
+    } else {
+      stats_->AddPartial((now_us - last_send_time_us_) / 1000.0);
+    }
+  }
+
+  static int64_t NowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+ private:
+  client *c_;  // not owned
+  asio::steady_timer timer_;
+  const std::vector<torch::Tensor> *corpus_;  // not owned
+  websocketpp::uri uri_;
+
+  int32_t wave_index_;
+  int32_t num_rounds_;
+  int32_t samples_per_message_;
+  std::chrono::steady_clock::duration message_interval_;
+  LatencyStats *stats_;  // not owned
+
+  torch::Tensor samples_;  // wave of the current utterance
+  int32_t num_sent_messages_ = 0;
+  std::chrono::steady_clock::time_point utterance_start_;
+
+  // Written by the timer chain and read by the message handler, which
+  // may run on different I/O threads.
+  std::atomic<int64_t> last_send_time_us_{0};
+  std::atomic<int64_t> done_time_us_{0};
+};
+
+int32_t main(int32_t argc, char *argv[]) {
+  std::string server_ip = "127.0.0.1";
+  int32_t server_port = 6006;
+  int32_t num_sessions = 10;
+  int32_t num_rounds = 1;
+  float seconds_per_message = 0.2;
+  float rtf = 1.0;
+  float ramp_seconds = 0;
+  int32_t num_threads = 1;
+  // Sample rate of the input waves. No resampling is made.
+  int32_t sample_rate = 16000;
+
+  sherpa::ParseOptions po(kUsageMessage);
+
+  po.Register("server-ip", &server_ip, "IP address of the websocket server");
+  po.Register("server-port", &server_port, "Port of the websocket server");
+  po.Register("num-sessions", &num_sessions,
+              "Number of concurrent streaming sessions to sustain.");
+  po.Register("num-rounds", &num_rounds,
+              "Number of utterances each session plays, cycling through "
+              "the given wave files.");
+  po.Register("num-seconds-per-message", &seconds_per_message,
+              "The number of samples per message equals to "
+              "seconds_per_message*sample_rate");
+  po.Register("rtf", &rtf,
+              "Pacing factor relative to real time. 1 sends audio at "
+              "recording speed; 2 sends it twice as fast. The schedule "
+              "is open loop: it never slows down for a lagging server.");
+  po.Register("ramp-seconds", &ramp_seconds,
+              "Session starts are spread uniformly over this many "
+              "seconds, so the measurement is not dominated by a "
+              "connection thundering herd.");
+  po.Register("num-threads", &num_threads,
+              "Number of I/O threads driving the connections. A few "
+              "hundred sessions per thread is a good starting point.");
+  po.Register("samplerate", &sample_rate,
+              "Sample rate of the recorded audio (expecting wav, no "
+              "resampling is done)");
+
+  po.Read(argc, argv);
+  SHERPA_CHECK_GT(seconds_per_message, 0);
+  SHERPA_CHECK_GT(num_sessions, 0);
+  SHERPA_CHECK_GT(num_rounds, 0);
+  SHERPA_CHECK_GT(rtf, 0);
+  SHERPA_CHECK_GE(ramp_seconds, 0);
+  SHERPA_CHECK_GT(num_threads, 0);
+
+  int32_t samples_per_message =
+      static_cast<int32_t>(seconds_per_message * sample_rate);
+  SHERPA_CHECK_GT(samples_per_message, 0)
+      << "seconds_per_message: " << seconds_per_message
+      << ", sample_rate: " << sample_rate;
+
+  if (!websocketpp::uri_helper::ipv4_literal(server_ip.begin(),
+                                             server_ip.end())) {
+    SHERPA_LOG(FATAL) << "Invalid server IP: " << server_ip;
+  }
+
+  if (server_port <= 0 || server_port > 65535) {
+    SHERPA_LOG(FATAL) << "Invalid server port: " << server_port;
+  }
+
+  if (po.NumArgs() < 1) {
+    po.PrintUsage();
+    exit(EXIT_FAILURE);
+  }
+
+  std::vector<torch::Tensor> corpus;
+  corpus.reserve(po.NumArgs());
+  for (int32_t i = 1; i <= po.NumArgs(); ++i) {
+    corpus.push_back(ReadWave(po.GetArg(i), sample_rate));
+  }
+
+  asio::io_context io;
+  client c;
+  c.clear_access_channels(websocketpp::log::alevel::all);
+  c.init_asio(&io);
+
+  websocketpp::uri uri(/*secure*/ false, server_ip, server_port,
+                       /*resource*/ "/");
+
+  LatencyStats stats;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int32_t i = 0; i != num_sessions; ++i) {
+    auto session = std::make_shared<Session>(
+        &c, &io, &corpus, uri, /*first_wave*/ i, num_rounds,
+        samples_per_message, seconds_per_message, rtf, &stats);
+    session->StartAfter(ramp_seconds * i / num_sessions);
+  }
+
+  std::vector<std::thread> threads;
+  for (int32_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back([&io]() { io.run(); });
+  }
+  io.run();  // will exit when the last session has finished
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  auto elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start);
+
+  fprintf(stderr, "\nsessions: %d, utterances: %ld, failures: %ld, "
+          "wall time: %.1f s\n",
+          num_sessions, static_cast<long>(stats.num_utterances),  // NOLINT
+          static_cast<long>(stats.num_failures),  // NOLINT
+          elapsed.count());
+  PrintPercentiles("partial_latency", &stats.partial_ms);
+  PrintPercentiles("final_latency", &stats.final_ms);
+  PrintPercentiles("send_lag", &stats.send_lag_ms);
+
+  return 0;
+}
@@ -4,13 +4,156 @@
 
 #include "sherpa/cpp_api/websocket/online-websocket-server-impl.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <thread>  // NOLINT
+#include <utility>
 #include <vector>
 
+#include "sherpa/csrc/allocator-stats.h"
 #include "sherpa/csrc/file-utils.h"
+#include "sherpa/csrc/json-writer.h"
 #include "sherpa/csrc/log.h"
+#include "sherpa/csrc/prof.h"
+#include "sherpa/csrc/trace.h"
 
 namespace sherpa {
 
+// Send a frame on the given endpoint (plain or TLS); errors go to the
+// endpoint's application log.
+//
+// The message is built explicitly so the permessage-deflate flag can be
+// set per frame; `compress` has an effect only on connections whose
+// client negotiated the extension. Compression runs right here, on the
+// calling thread -- results are flushed from a handler on the
+// connection context, so deflate stays off the decode threads.
+template <typename Endpoint>
+static void SendOnEndpoint(Endpoint *ep, connection_hdl hdl,
+                           const std::string &payload,
+                           websocketpp::frame::opcode::value opcode,
+                           bool compress = false) {
+  websocketpp::lib::error_code ec;
+  auto con = ep->get_con_from_hdl(hdl, ec);
+  if (con) {
+    auto msg = con->get_message(opcode, payload.size());
+    msg->append_payload(payload);
+    msg->set_compressed(compress);
+    ec = con->send(msg);
+  }
+  if (ec) {
+    ep->get_alog().write(websocketpp::log::alevel::app, ec.message());
+  }
+}
+
+// Close a connection on the given endpoint (plain or TLS); errors go to
+// the endpoint's application log.
+template <typename Endpoint>
+static void CloseOnEndpoint(Endpoint *ep, connection_hdl hdl,
+                            websocketpp::close::status::value code,
+                            const std::string &reason) {
+  websocketpp::lib::error_code ec;
+  ep->close(hdl, code, reason, ec);
+  if (ec) {
+    ep->get_alog().write(websocketpp::log::alevel::app, ec.message());
+  }
+}
+
+// Serialize a result into the binary frame format documented at
+// OnlineWebsocketDecoderConfig::binary_results. The output size is known
+// up front, so the payload is built with a single allocation.
+static std::string SerializeResult(const OnlineRecognitionResult &r) {
+  int32_t num_tokens = static_cast<int32_t>(r.token_ids.size());
+  uint8_t is_final = r.is_final;
+
+  std::string ans(13 + num_tokens * 8, '\0');
+  char *p = &ans[0];
+  auto put = [&p](const void *src, size_t n) {
+    std::memcpy(p, src, n);
+    p += n;
+  };
+
+  put(&r.segment, sizeof(r.segment));
+  put(&r.start_time, sizeof(r.start_time));
+  put(&is_final, sizeof(is_final));
+  put(&num_tokens, sizeof(num_tokens));
+  put(r.token_ids.data(), num_tokens * sizeof(int32_t));
+  put(r.timestamps.data(), num_tokens * sizeof(float));
+
+  return ans;
+}
+
+// Serialize a result as a delta frame against the text last sent on the
+// connection (see OnlineWebsocketDecoderConfig::delta_results), falling
+// back to a full frame when the segment changed, the result is final or
+// the connection is due for a full sync. Updates the connection's
+// last-sent state either way. Deltas are computed against what was last
+// *sent*, so they stay correct even when a speculative partial is later
+// superseded by the real decode of the same audio.
+static std::string SerializeDelta(const OnlineRecognitionResult &r,
+                                  int32_t full_sync_interval,
+                                  Connection *c) {
+  if (r.segment != c->last_sent_segment || r.is_final ||
+      c->deltas_since_sync >= full_sync_interval) {
+    // A final result ends its segment, so the next partial starts from
+    // an empty display again.
+    c->last_sent_text = r.is_final ? "" : r.text;
+    c->last_sent_segment = r.is_final ? -1 : r.segment;
+    c->deltas_since_sync = 0;
+    return r.AsJsonString();
+  }
+
+  const std::string &prev = c->last_sent_text;
+  size_t n = 0;
+  size_t limit = std::min(prev.size(), r.text.size());
+  while (n < limit && prev[n] == r.text[n]) {
+    ++n;
+  }
+  // Never split a UTF-8 code point: back the prefix off to the byte
+  // that starts it.
+  while (n != 0 && (static_cast<uint8_t>(r.text[n]) & 0xc0) == 0x80) {
+    --n;
+  }
+
+  auto *w = GetThreadLocalJsonWriter();
+  w->Reset();
+  w->StartObject();
+  w->Key("delta");
+  w->Write(true);
+  w->Key("segment");
+  w->Write(r.segment);
+  w->Key("prefix");
+  w->Write(static_cast<int64_t>(n));
+  w->Key("retract");
+  w->Write(static_cast<int64_t>(prev.size() - n));
+  w->Key("append");
+  w->Write(r.text.data() + n, r.text.size() - n);
+  w->EndObject();
+
+  c->last_sent_text = r.text;
+  ++c->deltas_since_sync;
+
+  return w->Str();
+}
+
+// Return an unguessable session token (32 hex characters).
+//
+// Caution: It is not thread safe; the caller is expected to hold
+// OnlineWebsocketDecoder::mutex_.
+static std::string GenerateSessionToken() {
+  static std::mt19937_64 gen{std::random_device{}()};
+
+  std::ostringstream os;
+  os << std::hex << std::setfill('0') << std::setw(16) << gen()
+     << std::setw(16) << gen();
+  return os.str();
+}
+
 void OnlineWebsocketDecoderConfig::Register(ParseOptions *po) {
   recognizer_config.Register(po);
 
@@ -19,12 +162,265 @@ void OnlineWebsocketDecoderConfig::Register(ParseOptions *po) {
 
   po->Register("max-batch-size", &max_batch_size,
                "Max batch size for recognition.");
+
+  po->Register("max-wait-ms", &max_wait_ms,
+               "Max duration in milliseconds a ready stream may wait for "
+               "other streams to become ready before we decode a partial "
+               "batch. Larger values give larger batches at the cost of "
+               "extra latency.");
+
+  po->Register("max-chunks-per-tick", &max_chunks_per_tick,
+               "Maximum number of chunks of one stream decoded within a "
+               "single tick. Values > 1 let streams that fell behind "
+               "(buffered backlog) catch up with extra decode rounds "
+               "when the batch has spare slots, so a transient stall "
+               "recovers instead of becoming permanent latency.");
+
+  po->Register("affinity-workers", &affinity_workers,
+               "If positive, per-stream host work (feature extraction) "
+               "runs on this many dedicated threads, with each stream "
+               "hashed to one of them for its whole session, so its "
+               "feature buffers stay warm in that worker's cache. An "
+               "idle worker steals from a backed-up queue. 0 uses the "
+               "shared work pool.");
+
+  po->Register("num-gpus", &num_gpus,
+               "Number of GPUs to use. Used only when --use-gpu is true. "
+               "One recognizer replica is created per device and streams "
+               "are sharded across the replicas.");
+
+  po->Register("extra-models", &extra_models,
+               "If not empty, additional models to serve from this "
+               "process, as comma-separated name=config-file pairs, "
+               "e.g., --extra-models=es=spanish.conf. Each file holds "
+               "options (--nn-model, --tokens, ...) overriding a copy "
+               "of the base recognizer config. Clients select a model "
+               "by sending 'model: <name>' as their first message. "
+               "Every model gets its own batch queues and the decoder "
+               "loop interleaves their batches on the shared "
+               "workers/GPU.");
+
+  po->Register("gpu-memory-budget-mb", &gpu_memory_budget_mb,
+               "If positive, per-GPU budget in MB for the dynamic memory "
+               "of this server: the encoder states of the admitted "
+               "streams plus the worst-case activations of one decode "
+               "batch, calibrated during warmup. Connections that would "
+               "push the estimate of a GPU over the budget are rejected "
+               "with try-again-later instead of risking a CUDA OOM. "
+               "Model weights are not counted; subtract them from the "
+               "device memory when picking the value. Requires "
+               "--use-gpu=true. The allocator ground truth is the "
+               "sherpa_cuda_allocated_bytes gauges on /metrics.");
+
+  po->Register("speculative-partial-chunks", &speculative_partial_chunks,
+               "true to fill the spare capacity of partial batches with "
+               "speculative decodes of incomplete chunks: the buffered "
+               "frames are padded to a full chunk and decoded for a "
+               "display-only partial result, with the state delta "
+               "discarded. First tokens then arrive well before the chunk "
+               "length has elapsed, using only batch slots that would "
+               "have run empty anyway.");
+
+  po->Register("adaptive-beam", &adaptive_beam,
+               "true to adapt the beam size of modified_beam_search to "
+               "the decode load: under sustained queue pressure the beam "
+               "is halved (down to 1), and widened again by one step at a "
+               "time when the pressure is gone, up to --num-active-paths. "
+               "Overload then costs accuracy instead of latency. The "
+               "current width is the sherpa_beam_width gauge on /metrics.");
+
+  po->Register("adaptive-beam-shrink-ticks", &adaptive_beam_shrink_ticks,
+               "Number of consecutive decoder loop iterations the ready "
+               "queues must hold more than one full batch per replica "
+               "before the beam is narrowed. Used only with "
+               "--adaptive-beam.");
+
+  po->Register("adaptive-beam-widen-ticks", &adaptive_beam_widen_ticks,
+               "Number of consecutive decoder loop iterations without "
+               "queue pressure before the beam is widened by one. Keep it "
+               "much larger than --adaptive-beam-shrink-ticks so the beam "
+               "does not oscillate at the overload boundary. Used only "
+               "with --adaptive-beam.");
+
+  po->Register("binary-results", &binary_results,
+               "true to send recognition results as compact binary frames "
+               "(token IDs and timestamps) instead of JSON text frames. "
+               "The content of --tokens is sent to the client as the first "
+               "message of each connection, so it can map token IDs back "
+               "to symbols.");
+
+  po->Register("delta-results", &delta_results,
+               "true to send partial results as deltas against the last "
+               "sent text (keep a prefix, retract some bytes, append a "
+               "string) instead of resending the whole transcript every "
+               "tick. Full results are still sent on segment changes, on "
+               "final results and after every --full-sync-interval delta "
+               "frames. Not supported with --binary-results.");
+
+  po->Register("full-sync-interval", &full_sync_interval,
+               "A full (non-delta) result frame is sent after this many "
+               "consecutive delta frames, so a client that missed a "
+               "frame converges. Used only with --delta-results.");
+
+  po->Register("park-idle-streams-after", &park_idle_streams_after,
+               "If positive, a stream whose trailing silence exceeds this "
+               "many seconds is parked: its silent chunks are consumed "
+               "with a cheap feature-energy check instead of occupying an "
+               "encoder batch slot, until audio arrives. 0 disables "
+               "parking.");
+
+  po->Register("offload-parked-states", &offload_parked_states,
+               "true to offload the encoder state of parked streams to "
+               "pinned host memory, so long-silent streams do not hold "
+               "several MB of device memory each. The state is restored "
+               "when audio arrives. Used only when "
+               "--park-idle-streams-after is positive.");
+
+  po->Register("offload-states-fp16", &offload_states_fp16,
+               "true to keep offloaded states in fp16, halving their host "
+               "memory and transfer cost; they are cast back to fp32 on "
+               "restore. Used only with --offload-parked-states.");
+
+  po->Register("max-resident-parked-states", &max_resident_parked_states,
+               "Number of most recently parked streams whose encoder "
+               "state stays resident on the device, so brief silences do "
+               "not thrash the PCIe bus. Used only with "
+               "--offload-parked-states.");
+
+  po->Register("park-energy-threshold", &park_energy_threshold,
+               "A chunk counts as silence, for parking purposes, if its "
+               "average log-mel feature energy is below this value. Used "
+               "only when --park-idle-streams-after is positive.");
+
+  po->Register("session-resume-timeout", &session_resume_timeout,
+               "If positive, a disconnected session is kept alive with its "
+               "decoding state for this many seconds. A client reconnecting "
+               "within the grace period can send 'resume:<session_token>' "
+               "as its first message to continue the session without "
+               "re-sending audio. 0 disables session resumption.");
+
+  po->Register("enable-canary-stream", &enable_canary_stream,
+               "true to maintain one synthetic internal stream and "
+               "measure its end-to-end tick latency continuously. The "
+               "latency is exported as the sherpa_canary_tick_seconds "
+               "histogram on /metrics, so decoding slowdowns show up "
+               "before clients notice them.");
+
+  po->Register("results-shm-name", &results_shm_name,
+               "If not empty, name of a POSIX shm object (e.g., "
+               "/sherpa-results) the server creates and mirrors every "
+               "serialized result into, for colocated consumers reading "
+               "with sherpa.ShmRingReader instead of a localhost "
+               "websocket. Results are still sent to the clients.");
+
+  po->Register("results-shm-size", &results_shm_size,
+               "Size in bytes of the shm result ring; used only with "
+               "--results-shm-name. When the consumer falls a whole ring "
+               "behind, further results are dropped from the ring and "
+               "counted in sherpa_shm_dropped_results_total.");
+
+  po->Register("drain-state-file", &drain_state_file,
+               "If not empty, path used to hand live sessions over to a "
+               "successor process during a deploy. A GET to /drain stops "
+               "admission, pickles the remaining sessions (session token, "
+               "stream position and encoder state) into this file and "
+               "closes their websockets; a new server started with the "
+               "same path adopts them on startup, so reconnecting clients "
+               "resume by token and keep their encoder context. Requires "
+               "a positive --session-resume-timeout.");
+
+  po->Register("capture-slow-batches-file", &capture_slow_batches_file,
+               "If not empty, path prefix for slow-batch captures: when "
+               "a decode misses the tick deadline, the feature batch and "
+               "the batch composition are pickled to <prefix>.<k>.pt, "
+               "with at most --capture-ring-size files kept. Replay a "
+               "capture with sherpa-slow-batch-replay to reproduce the "
+               "slow batch under a profiler. Capturing costs one host "
+               "copy of the feature batch per decode.");
+
+  po->Register("capture-ring-size", &capture_ring_size,
+               "Number of slow-batch capture files kept; used only with "
+               "--capture-slow-batches-file.");
+
+  po->Register("trace-sample-rate", &trace_sample_rate,
+               "If positive, 1 in this many streams is traced: its audio "
+               "arrivals, batch inclusions and result sends are recorded "
+               "into a bounded in-memory ring and served as Chrome trace "
+               "JSON on /trace, for reconstructing tail-latency outliers "
+               "event by event. 0 disables tracing.");
 }
 
 void OnlineWebsocketDecoderConfig::Validate() const {
   recognizer_config.Validate();
   SHERPA_CHECK_GT(loop_interval_ms, 0);
   SHERPA_CHECK_GT(max_batch_size, 0);
+  SHERPA_CHECK_GE(max_wait_ms, 0);
+  SHERPA_CHECK_GE(max_chunks_per_tick, 1);
+  SHERPA_CHECK_GE(affinity_workers, 0);
+  SHERPA_CHECK_GT(num_gpus, 0);
+
+  if (num_gpus > 1 && !recognizer_config.use_gpu) {
+    SHERPA_LOG(FATAL) << "--num-gpus=" << num_gpus
+                      << " requires --use-gpu=true";
+  }
+
+  if (gpu_memory_budget_mb > 0 && !recognizer_config.use_gpu) {
+    SHERPA_LOG(FATAL) << "--gpu-memory-budget-mb requires --use-gpu=true";
+  }
+
+  if (!capture_slow_batches_file.empty()) {
+    SHERPA_CHECK_GT(capture_ring_size, 0);
+  }
+
+  if (!extra_models.empty() && binary_results) {
+    // The symbol table sent at connection open is the base model's; a
+    // client decoding another model's token IDs with it would produce
+    // garbage.
+    SHERPA_LOG(FATAL) << "--extra-models is not supported together with "
+                      << "--binary-results.";
+  }
+
+  if (delta_results) {
+    if (binary_results) {
+      SHERPA_LOG(FATAL) << "--delta-results is not supported together "
+                        << "with --binary-results.";
+    }
+    SHERPA_CHECK_GT(full_sync_interval, 0);
+  }
+
+  SHERPA_CHECK_GE(park_idle_streams_after, 0);
+  SHERPA_CHECK_GE(session_resume_timeout, 0);
+  SHERPA_CHECK_GE(trace_sample_rate, 0);
+
+  if (offload_parked_states) {
+    if (park_idle_streams_after <= 0) {
+      SHERPA_LOG(FATAL) << "--offload-parked-states requires a positive "
+                        << "--park-idle-streams-after; only parked streams "
+                        << "are offloaded.";
+    }
+    SHERPA_CHECK_GE(max_resident_parked_states, 0);
+  }
+
+  if (adaptive_beam) {
+    if (recognizer_config.decoding_method != "modified_beam_search") {
+      SHERPA_LOG(FATAL) << "--adaptive-beam requires "
+                        << "--decoding-method=modified_beam_search. Given: "
+                        << recognizer_config.decoding_method;
+    }
+    SHERPA_CHECK_GT(adaptive_beam_shrink_ticks, 0);
+    SHERPA_CHECK_GT(adaptive_beam_widen_ticks, 0);
+  }
+
+  if (!drain_state_file.empty() && session_resume_timeout <= 0) {
+    SHERPA_LOG(FATAL) << "--drain-state-file requires a positive "
+                      << "--session-resume-timeout: adopted sessions wait "
+                      << "in the detached set for their clients to "
+                      << "reconnect and resume.";
+  }
+
+  if (!results_shm_name.empty()) {
+    SHERPA_CHECK_GT(results_shm_size, 0);
+  }
 }
 
 void OnlineWebsocketServerConfig::Register(sherpa::ParseOptions *po) {
@@ -36,6 +432,73 @@ void OnlineWebsocketServerConfig::Register(sherpa::ParseOptions *po) {
   po->Register("log-file", &log_file,
                "Path to the log file. Logs are "
                "appended to this file");
+
+  po->Register("max-active-connections", &max_active_connections,
+               "Maximum number of concurrent websocket connections. New "
+               "connections beyond it are closed right away with close "
+               "code try_again_later so the admitted sessions keep meeting "
+               "their latency targets. 0 means no limit.");
+
+  po->Register("certificate", &certificate,
+               "If not empty, path to a PEM file containing the certificate "
+               "chain and the private key. The server then terminates TLS "
+               "itself (serving wss:// and https://) instead of requiring "
+               "a plaintext sidecar. Requires building with "
+               "-DSHERPA_ENABLE_TLS=ON.");
+
+  po->Register("permessage-deflate", &permessage_deflate,
+               "true to compress outgoing result frames with the "
+               "websocket permessage-deflate extension on connections "
+               "that negotiated it. Compression runs on the network "
+               "threads, never on the decode threads. See also "
+               "--deflate-min-bytes.");
+
+  po->Register("deflate-min-bytes", &deflate_min_bytes,
+               "Outgoing frames smaller than this many bytes are sent "
+               "uncompressed, since deflate overhead exceeds the saving "
+               "for short partial results. Used only with "
+               "--permessage-deflate.");
+
+  po->Register("ping-interval", &ping_interval,
+               "If positive, ping every connection once per this many "
+               "seconds and close connections whose previous ping was "
+               "never answered, so dead TCP peers release their stream "
+               "promptly instead of holding decoder state until a kernel "
+               "timeout. 0 disables keep-alive pings.");
+
+  po->Register("max-audio-rate", &max_audio_rate,
+               "If positive, the maximum sustained audio upload rate per "
+               "connection as a multiple of real time (1 = recording "
+               "speed). A connection exceeding it is closed before any "
+               "feature work is done on the offending frame. 0 disables "
+               "rate limiting. See also --audio-burst-seconds.");
+
+  po->Register("audio-burst-seconds", &audio_burst_seconds,
+               "Size of the rate-limiting token bucket in seconds of "
+               "audio: a connection may burst this much at once before "
+               "the sustained --max-audio-rate applies.");
+
+  po->Register("max-audio-duration", &max_audio_duration,
+               "If positive, the maximum total audio a connection may "
+               "send, in seconds; exceeding it closes the connection. "
+               "0 means no limit.");
+
+  po->Register("tcp-nodelay", &tcp_nodelay,
+               "true to disable Nagle's algorithm (TCP_NODELAY) on "
+               "accepted connections. Result frames are small; with "
+               "Nagle on they can wait up to a delayed-ACK interval "
+               "(~40 ms) in the kernel, dwarfing the decoding latency.");
+
+  po->Register("reuse-port", &reuse_port,
+               "true to bind the websocket port with SO_REUSEPORT, so "
+               "several server processes can share one port and the "
+               "kernel load balances new connections across them.");
+
+  po->Register("uds-path", &uds_path,
+               "If not empty, path of a unix domain socket the server "
+               "additionally listens on. Colocated clients (e.g., a "
+               "gateway on the same host) then bypass the TCP stack "
+               "entirely. The socket file is re-created at startup.");
 }
 
 void OnlineWebsocketServerConfig::Validate() const {
@@ -50,31 +513,716 @@ void OnlineWebsocketServerConfig::Validate() const {
                       << doc_root << "/index.html does not exist!\n"
                       << "Make sure that you use sherpa/bin/web/ as --doc-root";
   }
+
+  SHERPA_CHECK_GE(max_active_connections, 0);
+
+  if (permessage_deflate) {
+    SHERPA_CHECK_GE(deflate_min_bytes, 0);
+  }
+
+  SHERPA_CHECK_GE(ping_interval, 0);
+
+  SHERPA_CHECK_GE(max_audio_rate, 0);
+  SHERPA_CHECK_GE(max_audio_duration, 0);
+  if (max_audio_rate > 0) {
+    SHERPA_CHECK_GT(audio_burst_seconds, 0);
+  }
+
+  if (!certificate.empty()) {
+    if (!FileExists(certificate)) {
+      SHERPA_LOG(FATAL) << "--certificate=" << certificate
+                        << " does not exist!";
+    }
+#ifndef SHERPA_ENABLE_TLS
+    SHERPA_LOG(FATAL) << "--certificate requires building sherpa with "
+                      << "-DSHERPA_ENABLE_TLS=ON";
+#endif
+  }
 }
 
 OnlineWebsocketDecoder::OnlineWebsocketDecoder(OnlineWebsocketServer *server)
     : server_(server),
       config_(server->GetConfig().decoder_config),
       timer_(server->GetWorkContext()) {
-  recognizer_ = std::make_unique<OnlineRecognizer>(config_.recognizer_config);
+  num_gpu_replicas_ =
+      config_.recognizer_config.use_gpu ? config_.num_gpus : 1;
+
+  // The models this process serves: the base model from the command
+  // line, plus one per --extra-models entry. Each extra model starts
+  // from a copy of the base recognizer config; its file overrides only
+  // what differs (typically --nn-model and --tokens).
+  std::vector<OnlineRecognizerConfig> models;
+  models.push_back(config_.recognizer_config);
+  model_index_[""] = 0;
+
+  if (!config_.extra_models.empty()) {
+    std::stringstream ss(config_.extra_models);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+      auto pos = item.find('=');
+      if (pos == std::string::npos || pos == 0) {
+        SHERPA_LOG(FATAL) << "Invalid --extra-models entry: '" << item
+                          << "'. Expected name=config-file.";
+      }
+
+      std::string name = item.substr(0, pos);
+      if (model_index_.count(name)) {
+        SHERPA_LOG(FATAL) << "Duplicate model name in --extra-models: "
+                          << name;
+      }
+
+      auto model_config = config_.recognizer_config;
+      ReadConfigFromFile(item.substr(pos + 1), &model_config);
+      model_config.Validate();
+
+      if (model_config.feat_config.fbank_opts.frame_opts.samp_freq !=
+          config_.recognizer_config.feat_config.fbank_opts.frame_opts
+              .samp_freq) {
+        SHERPA_LOG(FATAL) << "Model " << name << " expects a different "
+                          << "sampling rate; every model of one server "
+                          << "must share the audio protocol.";
+      }
+
+      model_index_[name] = static_cast<int32_t>(models.size());
+      models.push_back(model_config);
+    }
+  }
+
+  recognizers_.reserve(models.size() * num_gpu_replicas_);
+  for (const auto &model : models) {
+    for (int32_t i = 0; i != num_gpu_replicas_; ++i) {
+      auto recognizer_config = model;
+      recognizer_config.gpu_id = i;
+      recognizers_.push_back(
+          std::make_shared<OnlineRecognizer>(recognizer_config));
+    }
+  }
+  model_configs_ = std::move(models);
+
+  next_gpu_.resize(model_configs_.size());
+  stream_pool_.resize(recognizers_.size());
+  num_live_streams_.resize(recognizers_.size());
+  ready_connections_.resize(recognizers_.size());
+  bulk_ready_.resize(recognizers_.size());
+  oldest_ready_time_.resize(recognizers_.size());
+
+  auto &metrics = MetricsRegistry::Get();
+  metric_ticks_ = metrics.GetCounter("sherpa_decoder_ticks_total",
+                                     "Number of decoder loop iterations.");
+  metric_partial_batches_ = metrics.GetCounter(
+      "sherpa_partial_batches_total",
+      "Number of batches launched because the front stream had waited "
+      "longer than max-wait-ms, i.e., before the batch was full.");
+  metric_ready_streams_ =
+      metrics.GetGauge("sherpa_ready_streams",
+                       "Number of streams currently queued for decoding.");
+  metric_batch_size_ =
+      metrics.GetHistogram("sherpa_decode_batch_size",
+                           "Number of streams per decoded batch.",
+                           {1, 2, 4, 8, 16, 32, 64});
+  metric_decode_seconds_ = metrics.GetHistogram(
+      "sherpa_decode_seconds",
+      "Wall time of OnlineRecognizer::DecodeStreams() per batch.",
+      {0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1});
+  metric_canary_tick_seconds_ = metrics.GetHistogram(
+      "sherpa_canary_tick_seconds",
+      "End-to-end tick latency (ready to decoded) of the synthetic "
+      "canary stream. Used only with --enable-canary-stream.",
+      {0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1});
+  metric_ready_queue_depth_ = metrics.GetHistogram(
+      "sherpa_ready_queue_depth",
+      "Number of streams queued for decoding, observed once per decoder "
+      "loop iteration.",
+      {1, 2, 4, 8, 16, 32, 64, 128});
+  metric_batch_occupancy_ = metrics.GetHistogram(
+      "sherpa_batch_occupancy",
+      "Streams per decoded batch as a fraction of max-batch-size.",
+      {0.1, 0.25, 0.5, 0.75, 0.9, 1});
+  metric_deadline_misses_ = metrics.GetCounter(
+      "sherpa_deadline_misses_total",
+      "Number of decode cycles whose wall time exceeded the tick "
+      "deadline (the audio duration of one chunk); every miss pushes "
+      "the streams of that batch behind the incoming audio.");
+  metric_tick_lateness_seconds_ = metrics.GetHistogram(
+      "sherpa_tick_lateness_seconds",
+      "How late each decoder tick fired relative to its slot on the "
+      "fixed tick grid. Sustained growth means --loop-interval-ms is "
+      "too short for the load.",
+      {0.0001, 0.0002, 0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05});
+  metric_ticks_skipped_ = metrics.GetCounter(
+      "sherpa_ticks_skipped_total",
+      "Number of tick grid slots skipped entirely because the previous "
+      "iteration overran them; see sherpa_tick_lateness_seconds.");
+  metric_backlog_chunks_ = metrics.GetHistogram(
+      "sherpa_stream_backlog_chunks",
+      "Chunks a stream had buffered when it entered a decode batch; "
+      "values above 1 mean the stream had fallen behind its audio.",
+      {1, 2, 3, 4, 8, 16});
+
+  // The deadline is a property of a model's chunk geometry; with
+  // several models the strictest (shortest) chunk sets it.
+  tick_deadline_seconds_ = recognizers_[0]->ChunkDurationSeconds();
+  for (auto &recognizer : recognizers_) {
+    tick_deadline_seconds_ =
+        std::min(tick_deadline_seconds_, recognizer->ChunkDurationSeconds());
+  }
+
+  if (config_.trace_sample_rate > 0) {
+    TraceRing::Get().Enable();
+  }
+
+  if (!config_.results_shm_name.empty()) {
+    shm_writer_ = std::make_unique<ShmRingWriter>(config_.results_shm_name,
+                                                  config_.results_shm_size);
+    metric_shm_dropped_ = metrics.GetCounter(
+        "sherpa_shm_dropped_results_total",
+        "Number of results dropped from the shm result ring because "
+        "the consumer had fallen a whole ring behind.");
+  }
+
+  if (config_.offload_parked_states) {
+    metric_offloaded_states_ = metrics.GetGauge(
+        "sherpa_offloaded_states",
+        "Number of parked streams whose encoder state currently lives "
+        "in host memory. Used only with --offload-parked-states.");
+  }
+
+  if (config_.speculative_partial_chunks) {
+    metric_speculative_decodes_ = metrics.GetCounter(
+        "sherpa_speculative_decodes_total",
+        "Number of streams whose partial chunk was decoded speculatively "
+        "for a display-only result. Used only with "
+        "--speculative-partial-chunks.");
+  }
+
+  if (config_.recognizer_config.use_gpu) {
+    metric_cuda_allocated_.resize(num_gpu_replicas_);
+    metric_cuda_reserved_.resize(num_gpu_replicas_);
+    for (int32_t gpu = 0; gpu != num_gpu_replicas_; ++gpu) {
+      std::string suffix = std::to_string(gpu);
+      metric_cuda_allocated_[gpu] = metrics.GetGauge(
+          "sherpa_cuda_allocated_bytes_gpu" + suffix,
+          "Bytes handed out to live tensors by the CUDA caching "
+          "allocator on GPU " +
+              suffix + ".");
+      metric_cuda_reserved_[gpu] = metrics.GetGauge(
+          "sherpa_cuda_reserved_bytes_gpu" + suffix,
+          "Bytes held from the driver by the CUDA caching allocator on "
+          "GPU " +
+              suffix + ", i.e., allocated plus cached free blocks.");
+    }
+  }
+
+  if (config_.adaptive_beam) {
+    current_beam_ = config_.recognizer_config.num_active_paths;
+    metric_beam_width_ = metrics.GetGauge(
+        "sherpa_beam_width",
+        "Current beam size of modified_beam_search. Used only with "
+        "--adaptive-beam.");
+    metric_beam_width_->Set(current_beam_);
+  }
+
+  if (!config_.drain_state_file.empty()) {
+    LoadDrainState();
+  }
+
+  for (int32_t i = 0; i != config_.affinity_workers; ++i) {
+    affinity_workers_.push_back(std::make_unique<AffinityWorker>());
+  }
+  for (int32_t i = 0; i != config_.affinity_workers; ++i) {
+    affinity_threads_.emplace_back(
+        [this, i]() { AffinityWorkerLoop(i); });
+  }
 }
 
-std::shared_ptr<Connection> OnlineWebsocketDecoder::GetOrCreateConnection(
+OnlineWebsocketDecoder::~OnlineWebsocketDecoder() {
+  affinity_stop_.store(true, std::memory_order_release);
+  for (auto &worker : affinity_workers_) {
+    worker->cv.notify_one();
+  }
+  for (auto &t : affinity_threads_) {
+    t.join();
+  }
+}
+
+void OnlineWebsocketDecoder::PostStreamWork(
+    const std::shared_ptr<Connection> &c, std::function<void()> task) {
+  if (affinity_workers_.empty()) {
+    asio::post(server_->GetWorkContext(), std::move(task));
+    return;
+  }
+
+  auto &worker = *affinity_workers_[c->affinity];
+  {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(std::move(task));
+  }
+  worker.cv.notify_one();
+}
+
+void OnlineWebsocketDecoder::AffinityWorkerLoop(int32_t index) {
+  auto &me = *affinity_workers_[index];
+
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(me.mutex);
+      // The timeout bounds how stale a backed-up sibling queue can get
+      // before an idle worker notices it; a notify wakes us earlier.
+      me.cv.wait_for(lock, std::chrono::milliseconds(1), [this, &me]() {
+        return !me.tasks.empty() ||
+               affinity_stop_.load(std::memory_order_acquire);
+      });
+
+      if (!me.tasks.empty()) {
+        task = std::move(me.tasks.front());
+        me.tasks.pop_front();
+      }
+    }
+
+    if (!task) {
+      if (affinity_stop_.load(std::memory_order_acquire)) {
+        return;
+      }
+      task = StealStreamWork(index);
+      if (!task) {
+        continue;
+      }
+    }
+
+    task();
+  }
+}
+
+std::function<void()> OnlineWebsocketDecoder::StealStreamWork(int32_t thief) {
+  // Only steal from a queue that is actually backed up: moving a single
+  // waiting task to another core costs the very cache locality the
+  // affinity exists for, so short queues are left to their owner.
+  constexpr size_t kStealThreshold = 4;
+
+  for (size_t i = 0; i != affinity_workers_.size(); ++i) {
+    if (static_cast<int32_t>(i) == thief) {
+      continue;
+    }
+
+    auto &worker = *affinity_workers_[i];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.size() >= kStealThreshold) {
+      auto task = std::move(worker.tasks.front());
+      worker.tasks.pop_front();
+      return task;
+    }
+  }
+
+  return {};
+}
+
+OnlineWebsocketDecoder::ConnectionShard &OnlineWebsocketDecoder::GetShard(
     connection_hdl hdl) {
+  // The handle stays alive for as long as its shard entry exists, so the
+  // hash (and thus the shard) of a given connection is stable.
+  void *key = hdl.lock().get();
+  return connection_shards_[std::hash<void *>()(key) % kNumShards];
+}
+
+std::shared_ptr<Connection> OnlineWebsocketDecoder::GetOrCreateConnection(
+    connection_hdl hdl, const std::string &model) {
+  int32_t model_id = 0;
+  if (!model.empty()) {
+    auto it = model_index_.find(model);
+    if (it == model_index_.end()) {
+      // model_index_ is immutable after the constructor, so this read
+      // needs no lock.
+      return nullptr;
+    }
+    model_id = it->second;
+  }
+
+  auto &shard = GetShard(hdl);
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.connections.find(hdl);
+    if (it != shard.connections.end()) {
+      if (!model.empty() && it->second->model != model_id) {
+        // The stream is already bound to another model's recognizer;
+        // encoder state cannot move between models.
+        return nullptr;
+      }
+      return it->second;
+    }
+  }
+
+  // A new connection: pin it to the model's next GPU (round-robin).
+  // Only this path takes the global mutex_, once per connection; the
+  // lookup above costs one shard lock per message.
+  std::shared_ptr<Connection> c;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int32_t gpu = next_gpu_[model_id];
+    next_gpu_[model_id] = (gpu + 1) % num_gpu_replicas_;
+    int32_t replica = model_id * num_gpu_replicas_ + gpu;
+
+    std::shared_ptr<OnlineStream> s;
+    if (!stream_pool_[replica].empty()) {
+      // Reuse the stream of a closed connection instead of allocating a
+      // fresh one; see stream_pool_.
+      s = std::move(stream_pool_[replica].back());
+      stream_pool_[replica].pop_back();
+      recognizers_[replica]->ResetStream(s.get());
+    } else {
+      s = recognizers_[replica]->CreateStream();
+    }
+
+    c = std::make_shared<Connection>(hdl, s, replica);
+    c->model = model_id;
+    c->recognizer = recognizers_[replica];
+    if (!affinity_workers_.empty()) {
+      // Same key as GetShard(). A resumed session keeps its Connection
+      // (and thus this assignment), so the stream's host work stays on
+      // one worker even across a reconnect.
+      c->affinity = static_cast<int32_t>(std::hash<void *>()(
+                                             hdl.lock().get()) %
+                                         affinity_workers_.size());
+    }
+    ++num_live_streams_[replica];
+    if (config_.session_resume_timeout > 0) {
+      c->session_token = GenerateSessionToken();
+    }
+
+    ++num_sessions_;
+    if (config_.trace_sample_rate > 0 &&
+        num_sessions_ % config_.trace_sample_rate == 0) {
+      // This stream is sampled for tracing; the session number doubles
+      // as its timeline row in the trace dump.
+      c->trace_id = num_sessions_;
+      TraceRing::Get().AddEvent("session_start", c->trace_id,
+                                TraceRing::NowMicros());
+    }
+  }
+
+  {
+    // Handlers of one connection never run concurrently, so no other
+    // thread can have inserted this handle in the meantime.
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.connections.insert({hdl, c});
+    num_connections_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (!c->session_token.empty()) {
+    // Tell the client its token, so it can resume this session after a
+    // network blip; see ResumeConnection().
+    asio::post(server_->GetConnectionContext(),
+               [this, hdl, token = c->session_token]() {
+                 server_->Send(hdl,
+                               "{\"session_token\": \"" + token + "\"}");
+               });
+  }
+
+  return c;
+}
+
+std::shared_ptr<Connection> OnlineWebsocketDecoder::ResumeConnection(
+    connection_hdl hdl, const std::string &token) {
+  std::shared_ptr<Connection> c;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = detached_.find(token);
+    if (it == detached_.end()) {
+      return nullptr;
+    }
+
+    c = it->second.first;
+    detached_.erase(it);
+  }
+
+  // The connection is in no shard until the insertion below, so no other
+  // thread can see the handle while it is being rebound.
+  c->hdl = hdl;
+  c->closed.store(false, std::memory_order_release);
+  c->last_active = std::chrono::steady_clock::now();
+
+  auto &shard = GetShard(hdl);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.connections.insert({hdl, c});
+  num_connections_.fetch_add(1, std::memory_order_relaxed);
+  return c;
+}
+
+void OnlineWebsocketDecoder::RequestDrain() {
+  if (config_.drain_state_file.empty()) {
+    // Nothing to serialize: the admitted streams keep decoding until
+    // their clients hang up.
+    return;
+  }
+
+  drain_requested_.store(true, std::memory_order_release);
+}
+
+void OnlineWebsocketDecoder::RequestReload() {
+  if (reloading_.exchange(true)) {
+    SHERPA_LOG(WARNING) << "A model reload is already in progress; the "
+                        << "request is ignored.";
+    return;
+  }
+
+  std::thread([this]() {
+    for (size_t m = 0; m != model_configs_.size(); ++m) {
+      for (int32_t gpu = 0; gpu != num_gpu_replicas_; ++gpu) {
+        auto recognizer_config = model_configs_[m];
+        recognizer_config.gpu_id = gpu;
+
+        // Loading and warmup run on this background thread; the decode
+        // workers keep serving with the current recognizer meanwhile.
+        // Only the swap itself takes the decoder mutex.
+        auto recognizer =
+            std::make_shared<OnlineRecognizer>(recognizer_config);
+
+        int32_t replica =
+            static_cast<int32_t>(m) * num_gpu_replicas_ + gpu;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (config_.adaptive_beam) {
+          recognizer->SetNumActivePaths(current_beam_);
+        }
+
+        // Pooled streams carry state shaped by the old model; drop them
+        // instead of handing them to the new one.
+        stream_pool_[replica].clear();
+        recognizers_[replica] = std::move(recognizer);
+
+        if (replica == 0 && canary_ && !active_.count(canary_->hdl)) {
+          // Recreate the canary on the next tick, so it measures the
+          // model that now serves the clients.
+          canary_.reset();
+        }
+      }
+    }
+
+    SHERPA_LOG(INFO) << "Model reload complete; new streams use the new "
+                     << "model, in-flight streams finish on the old one.";
+    reloading_.store(false, std::memory_order_release);
+  }).detach();
+}
+
+void OnlineWebsocketDecoder::LoadDrainState() {
+  std::ifstream is(config_.drain_state_file, std::ios::binary);
+  if (!is) {
+    // No predecessor wrote a snapshot; nothing to adopt.
+    return;
+  }
+
+  std::vector<char> data((std::istreambuf_iterator<char>(is)),
+                         std::istreambuf_iterator<char>());
+  is.close();
+
+  // Consume the file so a later restart does not adopt these sessions
+  // a second time.
+  std::remove(config_.drain_state_file.c_str());
+
+  if (data.empty()) {
+    return;
+  }
+
+  torch::IValue ivalue = torch::jit::pickle_load(data);
+
+  auto now = std::chrono::steady_clock::now();
+  auto deadline = now + std::chrono::milliseconds(static_cast<int64_t>(
+                            config_.session_resume_timeout * 1000));
+
   std::lock_guard<std::mutex> lock(mutex_);
-  auto it = connections_.find(hdl);
-  if (it != connections_.end()) {
-    return it->second;
+  int32_t num_adopted = 0;
+  for (const auto &entry : ivalue.toListRef()) {
+    const auto &fields = entry.toTuple()->elements();
+
+    // Adopted sessions always get the base model: the snapshot format
+    // predates --extra-models, and a drained predecessor served the
+    // same base model.
+    int32_t replica = next_gpu_[0];
+    next_gpu_[0] = (next_gpu_[0] + 1) % num_gpu_replicas_;
+
+    std::shared_ptr<OnlineStream> s = recognizers_[replica]->CreateStream();
+    s->SetState(fields[2]);
+    if (config_.recognizer_config.use_gpu) {
+      s->MigrateStates(torch::Device(torch::kCUDA, replica));
+    }
+
+    auto c = std::make_shared<Connection>();
+    c->s = s;
+    c->replica = replica;
+    c->recognizer = recognizers_[replica];
+    c->session_token = fields[0].toStringRef();
+    c->last_active = now;
+
+    detached_[c->session_token] = {c, deadline};
+    ++num_live_streams_[replica];
+    ++num_adopted;
+  }
+
+  SHERPA_LOG(INFO) << "Adopted " << num_adopted << " drained session(s) from "
+                   << config_.drain_state_file;
+}
+
+void OnlineWebsocketDecoder::SaveDrainStateLocked() {
+  // The live sessions, still bound to a websocket; their connections
+  // are closed below so the clients move to the successor.
+  std::vector<std::shared_ptr<Connection>> live;
+  for (auto &shard : connection_shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (auto &p : shard.connections) {
+      live.push_back(p.second);
+    }
+  }
+
+  std::vector<std::shared_ptr<Connection>> sessions = live;
+  for (auto &p : detached_) {
+    // Sessions inside their resume grace period are handed over too;
+    // their clients may reconnect only after the successor is up.
+    sessions.push_back(p.second.first);
+  }
+
+  c10::impl::GenericList entries(c10::AnyType::get());
+  for (auto &c : sessions) {
+    // Pickling requires CPU tensors. An offloaded state is restored
+    // first so the snapshot is fp32; the snapshot is the end of this
+    // process's serving life, so the stream is not migrated back.
+    c->s->OnloadState();
+    c->s->MigrateStates(torch::Device(torch::kCPU));
+    entries.push_back(c10::ivalue::Tuple::create(
+        c->session_token,
+        static_cast<int64_t>(c->s->GetNumProcessedFrames()),
+        c->s->GetState()));
+  }
+
+  auto data = torch::jit::pickle_save(torch::IValue(entries));
+
+  std::ofstream os(config_.drain_state_file,
+                   std::ios::binary | std::ios::trunc);
+  os.write(data.data(), data.size());
+  if (!os) {
+    SHERPA_LOG(ERROR) << "Failed to write " << config_.drain_state_file
+                      << "; the drained sessions cannot be adopted.";
   } else {
-    // create a new connection
-    std::shared_ptr<OnlineStream> s = recognizer_->CreateStream();
-    auto c = std::make_shared<Connection>(hdl, s);
-    connections_.insert({hdl, c});
-    return c;
+    SHERPA_LOG(INFO) << "Saved " << sessions.size() << " session(s) to "
+                     << config_.drain_state_file;
+  }
+
+  static const std::string kReason =
+      "The server is draining. Please reconnect and resume your session.";
+  for (auto &c : live) {
+    asio::post(server_->GetConnectionContext(), [this, hdl = c->hdl]() {
+      server_->Close(hdl, websocketpp::close::status::going_away, kReason);
+    });
+  }
+}
+
+void OnlineWebsocketDecoder::SaveSlowBatch(
+    int32_t replica, OnlineRecognizer *recognizer,
+    const std::vector<std::shared_ptr<Connection>> &batch,
+    const torch::Tensor &features, double decode_seconds) {
+  // One entry per batch slot: which model decoded it, how far the
+  // stream was into its utterance and whether it was a bulk replay.
+  // The encoder states themselves are not captured -- only their size
+  // -- so a capture stays compact; the replay starts from init states,
+  // which reproduces the shapes and thus the kernel selection of the
+  // slow forward.
+  c10::impl::GenericList slots(c10::AnyType::get());
+  for (auto &c : batch) {
+    slots.push_back(c10::ivalue::Tuple::create(
+        static_cast<int64_t>(c->model),
+        static_cast<int64_t>(c->s->GetNumProcessedFrames()), c->bulk,
+        recognizer->GetStateBytesPerStream()));
+  }
+
+  auto record = c10::ivalue::Tuple::create(
+      features, decode_seconds, static_cast<double>(tick_deadline_seconds_),
+      static_cast<int64_t>(replica), slots);
+
+  auto data = torch::jit::pickle_save(torch::IValue(record));
+
+  int64_t seq = capture_seq_.fetch_add(1, std::memory_order_relaxed);
+  std::ostringstream name;
+  name << config_.capture_slow_batches_file << "."
+       << seq % config_.capture_ring_size << ".pt";
+
+  std::ofstream os(name.str(), std::ios::binary | std::ios::trunc);
+  os.write(data.data(), data.size());
+  if (!os) {
+    SHERPA_LOG(WARNING) << "Failed to write slow-batch capture "
+                        << name.str();
+  } else {
+    SHERPA_LOG(INFO) << "Decode took " << decode_seconds
+                     << "s (deadline: " << tick_deadline_seconds_
+                     << "s); captured the batch to " << name.str();
+  }
+}
+
+void OnlineWebsocketDecoder::DumpDeadlineMiss(
+    int32_t replica, const std::vector<OnlineStream *> &batch,
+    const OnlineDecodeStats &stats, double decode_seconds,
+    int64_t alloc_before, int64_t alloc_after) {
+  // Misses come in bursts (an overloaded server misses every tick), and
+  // one specimen per burst is all a postmortem needs; more would only
+  // drown the log.
+  constexpr int64_t kMinIntervalUs = 10 * 1000 * 1000;
+  int64_t now_us = TraceRing::NowMicros();
+  int64_t last = last_miss_dump_us_.load(std::memory_order_relaxed);
+  if (now_us - last < kMinIntervalUs ||
+      !last_miss_dump_us_.compare_exchange_strong(last, now_us,
+                                                  std::memory_order_relaxed)) {
+    return;
+  }
+
+  auto *w = GetThreadLocalJsonWriter();
+  w->Reset();
+  w->StartObject();
+  w->Key("event");
+  w->Write("deadline_miss");
+  w->Key("replica");
+  w->Write(replica);
+  w->Key("batch_size");
+  w->Write(static_cast<int32_t>(batch.size()));
+  w->Key("deadline_ms");
+  w->Write(static_cast<float>(tick_deadline_seconds_ * 1000), 3);
+  w->Key("decode_ms");
+  w->Write(static_cast<float>(decode_seconds * 1000), 3);
+  w->Key("stack_states_ms");
+  w->Write(stats.stack_states_seconds * 1000, 3);
+  w->Key("encoder_ms");
+  w->Write(stats.encoder_seconds * 1000, 3);
+  w->Key("search_ms");
+  w->Write(stats.search_seconds * 1000, 3);
+  if (alloc_before >= 0 && alloc_after >= 0) {
+    w->Key("alloc_delta_bytes");
+    w->Write(alloc_after - alloc_before);
+  }
+
+  // The batch composition: how many feature frames each stream had
+  // buffered and how far it was into its session. A miss caused by one
+  // stream bulk-replaying a long backlog looks very different here from
+  // one caused by a uniformly oversized batch.
+  w->Key("frames_ready");
+  w->StartArray();
+  for (auto *s : batch) {
+    w->Write(s->NumFramesReady());
+  }
+  w->EndArray();
+  w->Key("frames_processed");
+  w->StartArray();
+  for (auto *s : batch) {
+    w->Write(s->GetNumProcessedFrames());
   }
+  w->EndArray();
+  w->EndObject();
+
+  SHERPA_LOG(WARNING) << "Deadline miss postmortem: " << w->Str();
 }
 
 void OnlineWebsocketDecoder::AcceptWaveform(std::shared_ptr<Connection> c) {
+  if (c->trace_id) {
+    TraceRing::Get().AddEvent("audio_arrival", c->trace_id,
+                              TraceRing::NowMicros());
+  }
+
   std::lock_guard<std::mutex> lock(c->mutex);
   float sample_rate =
       config_.recognizer_config.feat_config.fbank_opts.frame_opts.samp_freq;
@@ -82,6 +1230,12 @@ void OnlineWebsocketDecoder::AcceptWaveform(std::shared_ptr<Connection> c) {
     c->s->AcceptWaveform(sample_rate, c->samples.front());
     c->samples.pop_front();
   }
+
+  if (c->recognizer->IsReady(c->s.get())) {
+    // The new samples completed a chunk; hand the connection to the
+    // decoder loop.
+    MarkPendingAudio(c);
+  }
 }
 
 void OnlineWebsocketDecoder::InputFinished(std::shared_ptr<Connection> c) {
@@ -102,11 +1256,249 @@ void OnlineWebsocketDecoder::InputFinished(std::shared_ptr<Connection> c) {
   c->s->AcceptWaveform(sample_rate, tail_padding);
 
   c->s->InputFinished();
+
+  if (c->recognizer->IsReady(c->s.get())) {
+    MarkPendingAudio(c);
+  }
+}
+
+void OnlineWebsocketDecoder::MarkPendingAudio(
+    const std::shared_ptr<Connection> &c) {
+  if (c->pending.exchange(true, std::memory_order_acq_rel)) {
+    // Already queued; the decoder loop will see the new audio when it
+    // examines the connection.
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  pending_connections_.push_back(c);
+}
+
+void OnlineWebsocketDecoder::OnDisconnect(connection_hdl hdl) {
+  std::shared_ptr<Connection> c;
+  {
+    auto &shard = GetShard(hdl);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.connections.find(hdl);
+    if (it == shard.connections.end()) {
+      // The client closed before sending any message, so it never got a
+      // stream.
+      return;
+    }
+    c = it->second;
+    shard.connections.erase(it);
+  }
+  num_connections_.fetch_sub(1, std::memory_order_relaxed);
+
+  // No more messages can arrive for this handle; the flag keeps a
+  // pending entry of this connection out of the decode batches.
+  c->closed.store(true, std::memory_order_release);
+
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  disconnected_connections_.push_back(c);
+}
+
+void OnlineWebsocketDecoder::FeedCanary() {
+  float sample_rate =
+      config_.recognizer_config.feat_config.fbank_opts.frame_opts.samp_freq;
+
+  if (!canary_) {
+    canary_ = std::make_shared<Connection>();
+    canary_->s = recognizers_[0]->CreateStream();
+    canary_->recognizer = recognizers_[0];
+    canary_->is_canary = true;
+  }
+
+  // One loop interval worth of a 440 Hz tone, so the canary progresses
+  // at real-time pace and exercises the same decode path as a client
+  // stream (the tone keeps it from being parked as silence).
+  constexpr float kTwoPi = 6.283185307f;
+  int64_t n = static_cast<int64_t>(sample_rate) * config_.loop_interval_ms /
+              1000;
+  torch::Tensor t =
+      torch::arange(static_cast<float>(canary_samples_fed_),
+                    static_cast<float>(canary_samples_fed_ + n));
+  canary_samples_fed_ += n;
+
+  torch::Tensor samples = 0.1f * torch::sin(kTwoPi * 440.0f / sample_rate * t);
+  canary_->s->AcceptWaveform(sample_rate, samples);
+
+  if (!active_.count(canary_->hdl) &&
+      canary_->recognizer->IsReady(canary_->s.get())) {
+    if (ready_connections_[0].empty() && bulk_ready_[0].empty()) {
+      oldest_ready_time_[0] = std::chrono::steady_clock::now();
+    }
+    canary_ready_time_ = std::chrono::steady_clock::now();
+    ready_connections_[0].push_back(canary_);
+
+    // The canary's handle is an empty connection_hdl; no client handle
+    // can collide with it, so active_ tracks it like any other stream.
+    active_.insert(canary_->hdl);
+  }
+}
+
+bool OnlineWebsocketDecoder::MoveConnection(std::shared_ptr<Connection> c,
+                                            int32_t replica) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  SHERPA_CHECK_GE(replica, 0);
+  SHERPA_CHECK_LT(replica, static_cast<int32_t>(recognizers_.size()));
+
+  if (c->replica == replica) {
+    return true;
+  }
+
+  if (replica / num_gpu_replicas_ != c->model) {
+    // Encoder state is model specific: streams move between GPUs, never
+    // between models.
+    return false;
+  }
+
+  if (c->recognizer != recognizers_[c->replica]) {
+    // The stream still runs on a swapped-out recognizer (see /reload);
+    // it finishes there and is never migrated onto the new model.
+    return false;
+  }
+
+  if (active_.count(c->hdl)) {
+    // The stream is queued or being decoded; its state is in flight, so
+    // it cannot be migrated now.
+    return false;
+  }
+
+  // An offloaded state is restored first, so the migration below starts
+  // from fp32 tensors on the stream's old device and the offload
+  // bookkeeping does not point at a stale device afterwards.
+  c->s->OnloadState();
+
+  torch::Device device =
+      config_.recognizer_config.use_gpu
+          ? torch::Device(torch::kCUDA, replica % num_gpu_replicas_)
+          : torch::Device(torch::kCPU);
+  c->s->MigrateStates(device);
+  --num_live_streams_[c->replica];
+  ++num_live_streams_[replica];
+  c->replica = replica;
+  c->recognizer = recognizers_[replica];
+
+  return true;
+}
+
+void OnlineWebsocketDecoder::ParkConnectionLocked(
+    const std::shared_ptr<Connection> &c) {
+  resident_parked_.push_back(c);
+
+  while (static_cast<int32_t>(resident_parked_.size()) >
+         config_.max_resident_parked_states) {
+    auto victim = std::move(resident_parked_.front());
+    resident_parked_.pop_front();
+
+    if (victim->parked && !victim->s->IsStateOffloaded()) {
+      victim->s->OffloadState(config_.offload_states_fp16);
+      if (victim->s->IsStateOffloaded()) {
+        metric_offloaded_states_->Set(++num_offloaded_states_);
+      }
+    }
+  }
+}
+
+void OnlineWebsocketDecoder::WakeConnectionLocked(
+    const std::shared_ptr<Connection> &c) {
+  for (auto it = resident_parked_.begin(); it != resident_parked_.end();
+       ++it) {
+    if (it->get() == c.get()) {
+      resident_parked_.erase(it);
+      break;
+    }
+  }
+
+  if (c->s->IsStateOffloaded()) {
+    c->s->OnloadState();
+    metric_offloaded_states_->Set(--num_offloaded_states_);
+  }
+}
+
+OnlineWebsocketDecoder::Occupancy OnlineWebsocketDecoder::GetOccupancy() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Occupancy ans;
+  ans.num_streams = num_connections_.load(std::memory_order_relaxed);
+
+  // Only realtime streams feed the overload signal: a bulk backlog is
+  // expected backpressure and must not make the server reject live
+  // connections.
+  int32_t num_realtime_ready = 0;
+  for (const auto &q : ready_connections_) {
+    num_realtime_ready += static_cast<int32_t>(q.size());
+    ans.num_ready_streams += static_cast<int32_t>(q.size());
+  }
+  for (const auto &q : bulk_ready_) {
+    ans.num_ready_streams += static_cast<int32_t>(q.size());
+  }
+
+  ans.overloaded = num_realtime_ready >
+                   2 * config_.max_batch_size *
+                       static_cast<int32_t>(recognizers_.size());
+
+  if (config_.gpu_memory_budget_mb > 0) {
+    // Project the dynamic memory of each GPU with one more stream on
+    // it: the states of the streams it already serves (summed over the
+    // models sharing the device), the state of the candidate stream
+    // (the largest among the models, since the model is not known at
+    // admission time) and the worst-case activations of one full batch.
+    int64_t budget =
+        static_cast<int64_t>(config_.gpu_memory_budget_mb) * 1024 * 1024;
+    for (int32_t gpu = 0; gpu != num_gpu_replicas_; ++gpu) {
+      int64_t projected = 0;
+      int64_t max_state_bytes = 0;
+      for (size_t m = 0; m != model_configs_.size(); ++m) {
+        int32_t r = static_cast<int32_t>(m) * num_gpu_replicas_ + gpu;
+        int64_t state_bytes = recognizers_[r]->GetStateBytesPerStream();
+        projected +=
+            state_bytes * num_live_streams_[r] +
+            recognizers_[r]->EstimateActivationBytes(config_.max_batch_size);
+        max_state_bytes = std::max(max_state_bytes, state_bytes);
+      }
+
+      if (projected + max_state_bytes > budget) {
+        ans.over_memory_budget = true;
+        break;
+      }
+    }
+  }
+
+  return ans;
 }
 
 void OnlineWebsocketDecoder::Run() {
-  timer_.expires_after(std::chrono::milliseconds(config_.loop_interval_ms));
+  // Anchor the tick grid; every later tick is scheduled at an absolute
+  // multiple of the loop interval from here, not relative to when the
+  // previous iteration finished. See ScheduleNextTick().
+  next_tick_time_ = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(config_.loop_interval_ms);
 
+  timer_.expires_at(next_tick_time_);
+  timer_.async_wait(
+      [this](const asio::error_code &ec) { ProcessConnections(ec); });
+}
+
+void OnlineWebsocketDecoder::ScheduleNextTick() {
+  auto interval = std::chrono::milliseconds(config_.loop_interval_ms);
+  auto now = std::chrono::steady_clock::now();
+
+  next_tick_time_ += interval;
+  if (next_tick_time_ <= now) {
+    // Processing overran one or more whole slots. Skip them -- running
+    // the missed ticks late would push the lateness onto every tick
+    // after them -- and resume on the grid.
+    int64_t skipped = 0;
+    while (next_tick_time_ <= now) {
+      next_tick_time_ += interval;
+      ++skipped;
+    }
+    metric_ticks_skipped_->Inc(skipped);
+  }
+
+  timer_.expires_at(next_tick_time_);
   timer_.async_wait(
       [this](const asio::error_code &ec) { ProcessConnections(ec); });
 }
@@ -116,94 +1508,577 @@ void OnlineWebsocketDecoder::ProcessConnections(const asio::error_code &ec) {
     SHERPA_LOG(FATAL) << "The decoder loop is aborted!";
   }
 
-  std::lock_guard<std::mutex> lock(mutex_);
-  std::vector<connection_hdl> to_remove;
-  for (auto &p : connections_) {
-    auto hdl = p.first;
-    auto c = p.second;
-
-    // The order of `if` below matters!
-    if (!server_->Contains(hdl)) {
-      // If the connection is disconnected, we stop processing it
-      to_remove.push_back(hdl);
+  metric_ticks_->Inc();
+  // How late this tick fired relative to the slot it was armed for:
+  // timer wakeup jitter plus any time spent waiting to be dispatched
+  // behind decode work.
+  metric_tick_lateness_seconds_->Observe(
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    next_tick_time_)
+          .count());
+
+  // Swap out the event lists the message and close handlers filled
+  // since the last tick. The loop below examines only these, so a tick
+  // costs O(streams with new audio), not O(connections): idle
+  // connections -- e.g., long-silent telephony legs that stopped
+  // sending audio -- are free, no matter how many are attached.
+  std::vector<std::shared_ptr<Connection>> pending;
+  std::vector<std::shared_ptr<Connection>> disconnected;
+  {
+    std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+    pending.swap(pending_connections_);
+    disconnected.swap(disconnected_connections_);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (drain_requested_.load(std::memory_order_acquire)) {
+    // Draining: no new work is enqueued. Flush the batches that are
+    // already queued; once no stream is in flight, snapshot every
+    // session to --drain-state-file and close the websockets, so the
+    // clients reconnect to the successor process and resume there.
+    for (auto &c : pending) {
+      // No new work is enqueued while draining; unflag the connection
+      // so the pending bookkeeping stays consistent.
+      c->pending.store(false, std::memory_order_release);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    for (auto &c : disconnected) {
+      if (!active_.count(c->hdl)) {
+        // Detach instead of recycling, so the session is part of the
+        // snapshot; --drain-state-file guarantees a positive
+        // --session-resume-timeout.
+        detached_[c->session_token] = {
+            c, now + std::chrono::milliseconds(static_cast<int64_t>(
+                         config_.session_resume_timeout * 1000))};
+      }
+    }
+
+    if (!active_.empty()) {
+      for (int32_t r = 0; r != static_cast<int32_t>(recognizers_.size());
+           ++r) {
+        if (!ready_connections_[r].empty() || !bulk_ready_[r].empty()) {
+          asio::post(server_->GetWorkContext(), [this, r]() { Decode(r); });
+        }
+      }
+    } else if (!drained_) {
+      SaveDrainStateLocked();
+      drained_ = true;
+    }
+
+    ScheduleNextTick();
+    return;
+  }
+
+  if (config_.enable_canary_stream) {
+    FeedCanary();
+  }
+
+  for (auto &c : pending) {
+    // Unflag the connection before the readiness check, so audio that
+    // arrives from here on re-queues it for the next tick.
+    c->pending.store(false, std::memory_order_release);
+
+    if (c->closed.load(std::memory_order_acquire)) {
+      // The websocket closed after the audio arrived; the disconnected
+      // loop below (or an earlier tick) recycles or detaches the
+      // stream, so it must not enter the decode batches.
       continue;
     }
 
+    auto hdl = c->hdl;
+
     if (active_.count(hdl)) {
-      // Another thread is decoding this stream, so skip it
+      // Another thread is decoding this stream. Decode() re-queues it
+      // on release if it is still ready, so skip it
       continue;
     }
 
-    if (!recognizer_->IsReady(c->s.get())) {
+    if (!c->recognizer->IsReady(c->s.get())) {
       // this stream has not enough frames to decode, so skip it
       continue;
     }
 
+    auto *recognizer = c->recognizer.get();
+    if (config_.park_idle_streams_after > 0 &&
+        (c->parked || recognizer->GetTrailingSilence(c->s.get()) >=
+                          config_.park_idle_streams_after)) {
+      // The stream is parked (or about to be): consume its silent
+      // chunks here, with a cheap feature-energy check, instead of
+      // spending encoder batch slots on silence. The first chunk that
+      // contains audio wakes it up and it rejoins the ready queue.
+      while (recognizer->IsReady(c->s.get()) &&
+             recognizer->SkipChunkIfSilent(c->s.get(),
+                                           config_.park_energy_threshold)) {
+      }
+
+      if (recognizer->IsReady(c->s.get())) {
+        if (c->parked && config_.offload_parked_states) {
+          // Restore the encoder state before the stream rejoins the
+          // decode batches.
+          WakeConnectionLocked(c);
+        }
+        c->parked = false;  // audio arrived
+      } else {
+        if (!c->parked && config_.offload_parked_states) {
+          ParkConnectionLocked(c);
+        }
+        c->parked = true;  // still silent, stay out of the batches
+        continue;
+      }
+    }
+
     // TODO(fangun): If the connection is timed out, we need to also
     // add it to `to_remove`
 
-    // this stream has enough frames and is currently not processed by any
-    // threads, so put it into the ready queue
-    ready_connections_.push_back(c);
+    // this stream has enough frames and is currently not processed by
+    // any threads, so put it into the ready queue of its replica; bulk
+    // streams go to the low-priority queue, which Decode() only draws
+    // from once every ready realtime stream has a batch slot.
+    if (ready_connections_[c->replica].empty() &&
+        bulk_ready_[c->replica].empty()) {
+      oldest_ready_time_[c->replica] = std::chrono::steady_clock::now();
+    }
+    if (c->bulk) {
+      bulk_ready_[c->replica].push_back(c);
+    } else {
+      ready_connections_[c->replica].push_back(c);
+    }
 
     // In `Decode()`, it will remove hdl from `active_`
     active_.insert(c->hdl);
   }
 
-  for (auto hdl : to_remove) {
-    connections_.erase(hdl);
+  auto now = std::chrono::steady_clock::now();
+  for (auto &c : disconnected) {
+    if (active_.count(c->hdl)) {
+      // A stream that is still being decoded by a worker thread is
+      // simply dropped; its storage is freed when the worker is done.
+      --num_live_streams_[c->replica];
+      continue;
+    }
+
+    if (config_.offload_parked_states && c->parked) {
+      // Drop it from the device-resident set; a stale entry could
+      // otherwise offload the stream after it has been recycled for a
+      // new connection.
+      resident_parked_.erase(std::remove(resident_parked_.begin(),
+                                         resident_parked_.end(), c),
+                             resident_parked_.end());
+    }
+
+    if (config_.session_resume_timeout > 0) {
+      // Keep the session around so a reconnecting client can resume it;
+      // see ResumeConnection().
+      detached_[c->session_token] = {
+          c, now + std::chrono::milliseconds(static_cast<int64_t>(
+                       config_.session_resume_timeout * 1000))};
+    } else {
+      // Recycle the stream for the next connection of this replica.
+      stream_pool_[c->replica].push_back(c->s);
+      --num_live_streams_[c->replica];
+    }
+  }
+
+  // Detached sessions whose grace period has expired release their
+  // streams into the pool.
+  for (auto it = detached_.begin(); it != detached_.end();) {
+    if (it->second.second <= now) {
+      auto &c = it->second.first;
+      stream_pool_[c->replica].push_back(c->s);
+      --num_live_streams_[c->replica];
+      it = detached_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  // For each replica, decode only when we either have a full batch or the
+  // front of its queue has waited longer than max_wait_ms. Otherwise keep
+  // accumulating ready streams so that the encoder runs with the largest
+  // possible batch size.
+  for (int32_t r = 0; r != static_cast<int32_t>(recognizers_.size()); ++r) {
+    int32_t num_ready_r = static_cast<int32_t>(ready_connections_[r].size() +
+                                               bulk_ready_[r].size());
+    bool batch_is_full = num_ready_r >= config_.max_batch_size;
+
+    bool deadline_expired =
+        num_ready_r != 0 &&
+        std::chrono::steady_clock::now() - oldest_ready_time_[r] >=
+            std::chrono::milliseconds(config_.max_wait_ms);
+
+    if (batch_is_full || deadline_expired) {
+      if (!batch_is_full) {
+        metric_partial_batches_->Inc();
+      }
+      asio::post(server_->GetWorkContext(), [this, r]() { Decode(r); });
+    }
+  }
+
+  // Bulk backlogs are excluded from the pressure signal below: a replay
+  // that queues up simply proceeds more slowly, and narrowing the beam
+  // for it would cost every live stream accuracy indefinitely.
+  int64_t num_ready = 0;
+  int64_t num_ready_total = 0;
+  for (const auto &q : ready_connections_) {
+    num_ready += q.size();
+  }
+  num_ready_total = num_ready;
+  for (const auto &q : bulk_ready_) {
+    num_ready_total += q.size();
+  }
+  metric_ready_streams_->Set(num_ready_total);
+  metric_ready_queue_depth_->Observe(num_ready_total);
+
+  for (int32_t gpu = 0;
+       gpu != static_cast<int32_t>(metric_cuda_allocated_.size()); ++gpu) {
+    // Reading the caching allocator stats is a couple of atomic loads,
+    // cheap enough for every tick.
+    int64_t allocated = 0;
+    int64_t reserved = 0;
+    if (OnlineRecognizer::GetCudaMemoryStats(gpu, &allocated, &reserved)) {
+      metric_cuda_allocated_[gpu]->Set(allocated);
+      metric_cuda_reserved_[gpu]->Set(reserved);
+    }
   }
 
-  if (!ready_connections_.empty()) {
-    asio::post(server_->GetWorkContext(), [this]() { Decode(); });
+  if (config_.adaptive_beam) {
+    // Pressure: the queues hold more than one full batch per replica,
+    // i.e., the workers are not draining streams as fast as they become
+    // ready. Narrowing the beam cuts the per-batch search cost, so the
+    // server sheds the overload by losing a little accuracy instead of
+    // letting every stream fall behind the incoming audio.
+    bool pressured = num_ready > config_.max_batch_size *
+                                     static_cast<int64_t>(recognizers_.size());
+
+    if (pressured) {
+      unpressured_ticks_ = 0;
+      if (++pressured_ticks_ >= config_.adaptive_beam_shrink_ticks &&
+          current_beam_ > 1) {
+        current_beam_ = std::max(current_beam_ / 2, 1);
+        pressured_ticks_ = 0;
+        for (auto &recognizer : recognizers_) {
+          recognizer->SetNumActivePaths(current_beam_);
+        }
+        metric_beam_width_->Set(current_beam_);
+        SHERPA_LOG(INFO) << "Decode queues are backed up; beam narrowed to "
+                         << current_beam_;
+      }
+    } else {
+      pressured_ticks_ = 0;
+      if (++unpressured_ticks_ >= config_.adaptive_beam_widen_ticks &&
+          current_beam_ < config_.recognizer_config.num_active_paths) {
+        ++current_beam_;
+        unpressured_ticks_ = 0;
+        for (auto &recognizer : recognizers_) {
+          recognizer->SetNumActivePaths(current_beam_);
+        }
+        metric_beam_width_->Set(current_beam_);
+        SHERPA_LOG(INFO) << "Load dropped; beam widened to " << current_beam_;
+      }
+    }
   }
 
   // Schedule another call
-  timer_.expires_after(std::chrono::milliseconds(config_.loop_interval_ms));
+  ScheduleNextTick();
+}
 
-  timer_.async_wait(
-      [this](const asio::error_code &ec) { ProcessConnections(ec); });
+void OnlineWebsocketDecoder::CollectSpeculativeCandidatesLocked(
+    int32_t replica, OnlineRecognizer *recognizer, int32_t max_streams,
+    std::vector<std::shared_ptr<Connection>> *candidates) {
+  for (auto &shard : connection_shards_) {
+    if (static_cast<int32_t>(candidates->size()) >= max_streams) {
+      break;
+    }
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (auto &p : shard.connections) {
+      if (static_cast<int32_t>(candidates->size()) >= max_streams) {
+        break;
+      }
+
+      auto &c = p.second;
+      if (c->replica != replica || c->recognizer.get() != recognizer ||
+          c->parked || c->bulk || active_.count(c->hdl)) {
+        // Bulk streams are replays: nobody watches their partials, so
+        // speculating on them would only burn the spare slots. Streams
+        // of another model generation stay out so the batch remains
+        // homogeneous across a hot swap.
+        continue;
+      }
+
+      if (recognizer->IsReady(c->s.get())) {
+        // A complete chunk gets a real decode; speculation would only
+        // waste the slot.
+        continue;
+      }
+
+      int32_t num_frames_ready = c->s->NumFramesReady();
+      if (num_frames_ready <= c->s->GetNumProcessedFrames() ||
+          num_frames_ready <= c->speculated_frames) {
+        // Nothing new to show since the last (real or speculative)
+        // decode.
+        continue;
+      }
+
+      candidates->push_back(c);
+      active_.insert(c->hdl);
+    }
+  }
 }
 
-void OnlineWebsocketDecoder::Decode() {
+void OnlineWebsocketDecoder::Decode(int32_t replica) {
   std::unique_lock<std::mutex> lock(mutex_);
-  if (ready_connections_.empty()) {
+  auto &ready = ready_connections_[replica];
+  auto &bulk = bulk_ready_[replica];
+  if (ready.empty() && bulk.empty()) {
     // There are no connections that are ready for decoding,
     // so we return directly
     return;
   }
 
+  // All streams of a batch must run on one recognizer. After a hot swap
+  // the queues can briefly hold streams of two model generations; the
+  // stream at the front decides which generation this batch serves, and
+  // the other generation keeps its place in the queue for a later batch.
+  OnlineRecognizer *rec =
+      (!ready.empty() ? ready.front() : bulk.front())->recognizer.get();
+
+  // Every ready realtime stream gets a batch slot first; bulk streams
+  // only fill what is left, so a faster-than-realtime replay burst
+  // queues up behind the live traffic instead of delaying it.
   std::vector<std::shared_ptr<Connection>> c_vec;
   std::vector<OnlineStream *> s_vec;
-  while (!ready_connections_.empty() &&
-         static_cast<int32_t>(s_vec.size()) < config_.max_batch_size) {
-    auto c = ready_connections_.front();
-    ready_connections_.pop_front();
+  for (auto it = ready.begin();
+       it != ready.end() &&
+       static_cast<int32_t>(s_vec.size()) < config_.max_batch_size;) {
+    if ((*it)->recognizer.get() != rec) {
+      ++it;
+      continue;
+    }
+
+    c_vec.push_back(*it);
+    s_vec.push_back((*it)->s.get());
+    it = ready.erase(it);
+  }
+  for (auto it = bulk.begin();
+       it != bulk.end() &&
+       static_cast<int32_t>(s_vec.size()) < config_.max_batch_size;) {
+    if ((*it)->recognizer.get() != rec) {
+      ++it;
+      continue;
+    }
+
+    c_vec.push_back(*it);
+    s_vec.push_back((*it)->s.get());
+    it = bulk.erase(it);
+  }
 
-    c_vec.push_back(c);
-    s_vec.push_back(c->s.get());
+  if (static_cast<int32_t>(ready.size() + bulk.size()) >=
+      config_.max_batch_size) {
+    // there are still enough ready connections for a full batch, so we
+    // schedule another call to Decode() and let other threads process them.
+    // A partial remainder stays in the queue until its deadline expires;
+    // ProcessConnections() will schedule it then.
+    asio::post(server_->GetWorkContext(),
+               [this, replica]() { Decode(replica); });
+  } else if (!ready.empty() || !bulk.empty()) {
+    // The remaining streams form a new partial batch; restart their wait
+    // deadline from now.
+    oldest_ready_time_[replica] = std::chrono::steady_clock::now();
   }
 
-  if (!ready_connections_.empty()) {
-    // there are too many ready connections but this thread can only handle
-    // max_batch_size connections at a time, so we schedule another call
-    // to Decode() and let other threads to process the ready connections
-    asio::post(server_->GetWorkContext(), [this]() { Decode(); });
+  // Spare batch slots are filled with speculative decodes of streams
+  // whose next chunk is incomplete; their results are display-only and
+  // no state is committed. The candidates enter active_ here, so no
+  // other worker touches them before they are released below.
+  std::vector<std::shared_ptr<Connection>> spec_vec;
+  if (config_.speculative_partial_chunks &&
+      static_cast<int32_t>(s_vec.size()) < config_.max_batch_size) {
+    CollectSpeculativeCandidatesLocked(
+        replica, rec,
+        config_.max_batch_size - static_cast<int32_t>(s_vec.size()), &spec_vec);
   }
 
   lock.unlock();
-  recognizer_->DecodeStreams(s_vec.data(), s_vec.size());
+  metric_batch_size_->Observe(s_vec.size());
+  metric_batch_occupancy_->Observe(static_cast<double>(s_vec.size()) /
+                                   config_.max_batch_size);
+  for (auto *s : s_vec) {
+    metric_backlog_chunks_->Observe(
+        static_cast<double>(s->NumFramesReady() - s->GetNumProcessedFrames()) /
+        s->ChunkShift());
+  }
+
+  torch::Tensor captured_features;
+  if (!config_.capture_slow_batches_file.empty() && !s_vec.empty()) {
+    // Snapshot the inputs before the decode -- afterwards the chunk
+    // views are stale and the streams have advanced. The chunks must be
+    // cloned since GetChunk() returns views into a buffer the decode
+    // itself overwrites. The copy is dropped again below unless the
+    // decode misses its deadline.
+    std::vector<torch::Tensor> chunks;
+    chunks.reserve(s_vec.size());
+    for (auto *s : s_vec) {
+      chunks.push_back(
+          s->GetChunk(s->GetNumProcessedFrames() / s->ChunkShift()).clone());
+    }
+    captured_features = torch::stack(chunks);
+  }
+
+  int64_t alloc_before = AllocatedBytes();
+  OnlineDecodeStats decode_stats;
+  auto decode_begin = std::chrono::steady_clock::now();
+  int64_t decode_begin_us = TraceRing::NowMicros();
+  rec->DecodeStreams(s_vec.data(), s_vec.size(), &decode_stats);
+  double decode_seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    decode_begin)
+          .count();
+  metric_decode_seconds_->Observe(decode_seconds);
+  if (decode_seconds > tick_deadline_seconds_) {
+    metric_deadline_misses_->Inc();
+    DumpDeadlineMiss(replica, s_vec, decode_stats, decode_seconds,
+                     alloc_before, AllocatedBytes());
+    if (captured_features.defined()) {
+      SaveSlowBatch(replica, rec, c_vec, captured_features, decode_seconds);
+    }
+  }
+
+  // Catch-up rounds for streams that are still behind their audio:
+  // when the batch had spare slots, the replica has capacity to give
+  // this tick, so decoding further buffered chunks now shortens the
+  // backlog instead of spreading it over the ticks to come at one
+  // chunk per tick. Bounded by --max-chunks-per-tick, and never run
+  // for a full batch, so catch-up cannot displace realtime work.
+  if (config_.max_chunks_per_tick > 1 &&
+      static_cast<int32_t>(s_vec.size()) < config_.max_batch_size) {
+    for (int32_t round = 1; round != config_.max_chunks_per_tick; ++round) {
+      std::vector<OnlineStream *> lagging;
+      for (auto *s : s_vec) {
+        if (rec->IsReady(s)) {
+          lagging.push_back(s);
+        }
+      }
+      if (lagging.empty()) {
+        break;
+      }
+
+      rec->DecodeStreams(lagging.data(), lagging.size());
+    }
+  }
+
+  std::vector<OnlineRecognitionResult> spec_results;
+  if (!spec_vec.empty()) {
+    std::vector<OnlineStream *> spec_streams;
+    spec_streams.reserve(spec_vec.size());
+    for (auto &c : spec_vec) {
+      spec_streams.push_back(c->s.get());
+    }
+    rec->DecodeStreamsSpeculative(spec_streams.data(), spec_streams.size(),
+                                  &spec_results);
+    metric_speculative_decodes_->Inc(spec_vec.size());
+  }
+
   lock.lock();
 
+  // Coalesce the result sends of this batch into a single handler on the
+  // connection context, so the event loop runs one flush per tick instead
+  // of one handler per stream. The sends themselves are asynchronous
+  // (websocketpp queues the frames), so one slow client never delays the
+  // results of the other streams nor the next batch tick.
+  std::vector<std::pair<connection_hdl, std::string>> results;
+  results.reserve(c_vec.size());
   for (auto c : c_vec) {
-    auto result = recognizer_->GetResult(c->s.get());
+    if (c->is_canary) {
+      // The canary never leaves the process; its tick latency is the
+      // product. canary_ready_time_ is read under mutex_, which is held
+      // here.
+      metric_canary_tick_seconds_->Observe(
+          std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                        canary_ready_time_)
+              .count());
+      active_.erase(c->hdl);
+      continue;
+    }
 
-    asio::post(server_->GetConnectionContext(),
-               [this, hdl = c->hdl, json = result.AsJsonString()]() {
-                 server_->Send(hdl, json);
-               });
+    auto result = rec->GetResult(c->s.get());
+
+    std::string payload;
+    if (config_.binary_results) {
+      payload = SerializeResult(result);
+    } else if (config_.delta_results) {
+      payload = SerializeDelta(result, config_.full_sync_interval, c.get());
+    } else {
+      payload = result.AsJsonString();
+    }
+    results.emplace_back(c->hdl, std::move(payload));
+    active_.erase(c->hdl);
+
+    if (rec->IsReady(c->s.get())) {
+      // The stream has another chunk buffered -- it fell behind, or
+      // audio arrived during the decode while the tick loop skipped it
+      // as active -- so queue it for the next tick.
+      MarkPendingAudio(c);
+    }
+
+    if (shm_writer_) {
+      // Mirror the already-serialized payload into the shm ring; the
+      // ring is single-producer, so concurrent Decode() calls take
+      // shm_mutex_ for the copy.
+      const std::string &payload = results.back().second;
+      std::lock_guard<std::mutex> shm_lock(shm_mutex_);
+      if (!shm_writer_->Write(payload.data(), payload.size())) {
+        metric_shm_dropped_->Inc();
+      }
+    }
+
+    if (c->trace_id) {
+      // One span per batch this stream was part of, plus an instant when
+      // its result is handed to the connection context for sending.
+      TraceRing::Get().AddEvent(
+          "decode_batch", c->trace_id, decode_begin_us,
+          static_cast<int64_t>(decode_seconds * 1e6));
+      TraceRing::Get().AddEvent("send_result", c->trace_id,
+                                TraceRing::NowMicros());
+    }
+  }
+
+  for (size_t i = 0; i != spec_vec.size(); ++i) {
+    auto &c = spec_vec[i];
+    // A speculative result never goes to the shm ring or the trace: it
+    // is superseded by the real decode of the same audio and is only
+    // meant for the client's display.
+    c->speculated_frames = c->s->NumFramesReady();
+    std::string payload;
+    if (config_.binary_results) {
+      payload = SerializeResult(spec_results[i]);
+    } else if (config_.delta_results) {
+      payload = SerializeDelta(spec_results[i], config_.full_sync_interval,
+                               c.get());
+    } else {
+      payload = spec_results[i].AsJsonString();
+    }
+    results.emplace_back(c->hdl, std::move(payload));
     active_.erase(c->hdl);
+
+    if (rec->IsReady(c->s.get())) {
+      // The chunk completed while it was being speculated on.
+      MarkPendingAudio(c);
+    }
   }
+
+  asio::post(server_->GetConnectionContext(),
+             [this, results = std::move(results)]() {
+               for (const auto &r : results) {
+                 if (config_.binary_results) {
+                   server_->SendBinary(r.first, r.second);
+                 } else {
+                   server_->Send(r.first, r.second);
+                 }
+               }
+             });
 }
 
 OnlineWebsocketServer::OnlineWebsocketServer(
@@ -216,8 +2091,70 @@ OnlineWebsocketServer::OnlineWebsocketServer(
       log_(config.log_file, std::ios::app),
       tee_(std::cout, log_),
       decoder_(this) {
+#ifdef SHERPA_ENABLE_TLS
+  if (!config.certificate.empty()) {
+    // TLS handshakes run on the handlers of io_conn_, which is driven
+    // by the network threads only, so crypto never competes with the
+    // decode workers of io_work_ for cycles.
+    tls_server_ = std::make_unique<tls_server>();
+  }
+#endif
+
   SetupLog();
 
+  // Allocator A/B runs are meaningless without knowing which malloc a
+  // given log belongs to; see SHERPA_MALLOC and sherpa_malloc_* on
+  // /metrics.
+  SHERPA_LOG(INFO) << "malloc implementation: " << AllocatorName();
+
+  if (config.decoder_config.binary_results) {
+    const std::string &tokens = config.decoder_config.recognizer_config.tokens;
+    std::ifstream is(tokens);
+    if (!is) {
+      SHERPA_LOG(FATAL) << "Failed to open " << tokens;
+    }
+    std::ostringstream os;
+    os << is.rdbuf();
+    tokens_ = os.str();
+  }
+
+#ifdef SHERPA_ENABLE_TLS
+  if (tls_server_) {
+    tls_server_->init_asio(&io_conn_);
+
+    tls_server_->set_tls_init_handler(
+        [this](connection_hdl /*hdl*/) { return OnTlsInit(); });
+
+    tls_server_->set_open_handler([this](connection_hdl hdl) { OnOpen(hdl); });
+
+    tls_server_->set_close_handler(
+        [this](connection_hdl hdl) { OnClose(hdl); });
+
+    tls_server_->set_http_handler([this](connection_hdl hdl) { OnHttp(hdl); });
+
+    tls_server_->set_message_handler(
+        [this](connection_hdl hdl, tls_server::message_ptr msg) {
+          OnMessage(hdl, msg);
+        });
+
+    tls_server_->set_pong_handler(
+        [this](connection_hdl hdl, std::string /*payload*/) { OnPong(hdl); });
+
+    if (config.tcp_nodelay) {
+      // See --tcp-nodelay; the handler runs once per accepted socket,
+      // before the websocket handshake. Errors are ignored on purpose:
+      // a unix-socket connection has no Nagle to disable.
+      tls_server_->set_socket_init_handler(
+          [](connection_hdl /*hdl*/,
+             asio::ssl::stream<asio::ip::tcp::socket> &s) {
+            asio::error_code ec;
+            s.lowest_layer().set_option(asio::ip::tcp::no_delay(true), ec);
+          });
+    }
+    return;
+  }
+#endif
+
   server_.init_asio(&io_conn_);
 
   server_.set_open_handler([this](connection_hdl hdl) { OnOpen(hdl); });
@@ -230,16 +2167,253 @@ OnlineWebsocketServer::OnlineWebsocketServer(
       [this](connection_hdl hdl, server::message_ptr msg) {
         OnMessage(hdl, msg);
       });
+
+  server_.set_pong_handler(
+      [this](connection_hdl hdl, std::string /*payload*/) { OnPong(hdl); });
+
+  if (config.tcp_nodelay) {
+    // See --tcp-nodelay; the handler runs once per accepted socket,
+    // before the websocket handshake. Errors are ignored on purpose: a
+    // unix-socket connection has no Nagle to disable.
+    server_.set_socket_init_handler(
+        [](connection_hdl /*hdl*/, asio::ip::tcp::socket &s) {
+          asio::error_code ec;
+          s.set_option(asio::ip::tcp::no_delay(true), ec);
+        });
+  }
+}
+
+#ifdef SHERPA_ENABLE_TLS
+std::shared_ptr<asio::ssl::context> OnlineWebsocketServer::OnTlsInit() {
+  namespace ssl = asio::ssl;
+  auto ctx = std::make_shared<ssl::context>(ssl::context::tls);
+  ctx->set_options(ssl::context::default_workarounds | ssl::context::no_sslv2 |
+                   ssl::context::no_sslv3 | ssl::context::single_dh_use);
+
+  asio::error_code ec;
+  ctx->use_certificate_chain_file(config_.certificate, ec);
+  if (!ec) {
+    ctx->use_private_key_file(config_.certificate, ssl::context::pem, ec);
+  }
+  if (ec) {
+    SHERPA_LOG(FATAL) << "Failed to load --certificate="
+                      << config_.certificate << ": " << ec.message();
+  }
+
+  return ctx;
+}
+#endif
+
+void OnlineWebsocketServer::PingTick() {
+  std::vector<connection_hdl> due;
+  int32_t slot;
+  {
+    std::lock_guard<std::mutex> lock(ping_mutex_);
+    slot = ping_slot_;
+    due.swap(ping_wheel_[slot]);
+  }
+
+  for (auto &hdl : due) {
+    std::shared_ptr<PingState> state;
+    {
+      std::lock_guard<std::mutex> lock(ping_mutex_);
+      auto it = ping_states_.find(hdl);
+      if (it == ping_states_.end()) {
+        continue;  // the connection has closed; drop its wheel entry
+      }
+      state = it->second;
+    }
+
+    if (state->pong_pending.load(std::memory_order_relaxed)) {
+      // The ping sent one interval ago was never answered: the peer is
+      // gone. Closing takes the regular OnClose path, which releases
+      // the stream and its decoder state right away.
+      SHERPA_LOG(INFO) << "Closing unresponsive connection";
+      Close(hdl, websocketpp::close::status::going_away, "ping timeout");
+      continue;
+    }
+
+    state->pong_pending.store(true, std::memory_order_relaxed);
+
+    websocketpp::lib::error_code ec;
+#ifdef SHERPA_ENABLE_TLS
+    if (tls_server_) {
+      tls_server_->ping(hdl, "", ec);
+    } else
+#endif
+    {
+      server_.ping(hdl, "", ec);
+    }
+
+    if (!ec) {
+      // Re-arm into the slot just processed: due again after one full
+      // revolution of the wheel.
+      std::lock_guard<std::mutex> lock(ping_mutex_);
+      ping_wheel_[slot].push_back(hdl);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(ping_mutex_);
+    ping_slot_ = (slot + 1) % kNumPingSlots;
+  }
+
+  ping_timer_->expires_after(std::chrono::microseconds(static_cast<int64_t>(
+      config_.ping_interval / kNumPingSlots * 1e6)));
+  ping_timer_->async_wait([this](const asio::error_code &ec) {
+    if (!ec) {
+      PingTick();
+    }
+  });
+}
+
+void OnlineWebsocketServer::OnPong(connection_hdl hdl) {
+  std::lock_guard<std::mutex> lock(ping_mutex_);
+  auto it = ping_states_.find(hdl);
+  if (it != ping_states_.end()) {
+    it->second->pong_pending.store(false, std::memory_order_relaxed);
+  }
+}
+
+void OnlineWebsocketServer::StartTcpAccept() {
+#ifdef SHERPA_ENABLE_TLS
+  if (tls_server_) {
+    auto con = tls_server_->get_connection();
+    tcp_acceptor_->async_accept(con->get_raw_socket(),
+                                [this, con](const asio::error_code &ec) {
+                                  if (ec == asio::error::operation_aborted) {
+                                    return;
+                                  }
+                                  if (!ec) {
+                                    con->start();
+                                  }
+                                  StartTcpAccept();
+                                });
+    return;
+  }
+#endif
+  auto con = server_.get_connection();
+  tcp_acceptor_->async_accept(con->get_raw_socket(),
+                              [this, con](const asio::error_code &ec) {
+                                if (ec == asio::error::operation_aborted) {
+                                  return;
+                                }
+                                if (!ec) {
+                                  con->start();
+                                }
+                                StartTcpAccept();
+                              });
+}
+
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+void OnlineWebsocketServer::StartUnixAccept() {
+  uds_acceptor_->async_accept(
+      *uds_socket_, [this](const asio::error_code &ec) {
+        if (ec == asio::error::operation_aborted) {
+          return;
+        }
+
+        if (!ec) {
+          // Transplant the accepted descriptor into a fresh websocketpp
+          // connection. The transport's socket type is TCP, but at the
+          // descriptor level both are stream sockets, so reads and
+          // writes behave identically; only TCP-specific options are
+          // skipped for it (see the socket init handler).
+          asio::error_code sec;
+          auto fd = uds_socket_->release(sec);
+          if (!sec) {
+#ifdef SHERPA_ENABLE_TLS
+            if (tls_server_) {
+              auto con = tls_server_->get_connection();
+              con->get_raw_socket().assign(asio::ip::tcp::v4(), fd, sec);
+              if (!sec) {
+                con->start();
+              }
+            } else
+#endif
+            {
+              auto con = server_.get_connection();
+              con->get_raw_socket().assign(asio::ip::tcp::v4(), fd, sec);
+              if (!sec) {
+                con->start();
+              }
+            }
+          }
+        }
+
+        StartUnixAccept();
+      });
 }
+#endif
 
 void OnlineWebsocketServer::Run(uint16_t port) {
-  server_.set_reuse_addr(true);
-  server_.listen(asio::ip::tcp::v4(), port);
-  server_.start_accept();
+  if (config_.ping_interval > 0) {
+    ping_timer_ = std::make_unique<asio::steady_timer>(io_conn_);
+    PingTick();
+  }
+
+  if (config_.reuse_port) {
+#ifdef SO_REUSEPORT
+    // The endpoint's built-in acceptor cannot set SO_REUSEPORT between
+    // open and bind, so the server binds the listener itself and hands
+    // the accepted sockets to websocketpp connections.
+    asio::ip::tcp::endpoint ep(asio::ip::tcp::v4(), port);
+    tcp_acceptor_ = std::make_unique<asio::ip::tcp::acceptor>(io_conn_);
+    tcp_acceptor_->open(ep.protocol());
+    tcp_acceptor_->set_option(asio::socket_base::reuse_address(true));
+    tcp_acceptor_->set_option(
+        asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+    tcp_acceptor_->bind(ep);
+    tcp_acceptor_->listen(asio::socket_base::max_listen_connections);
+    StartTcpAccept();
+#else
+    SHERPA_LOG(FATAL) << "--reuse-port is not supported on this platform";
+#endif
+  } else {
+#ifdef SHERPA_ENABLE_TLS
+    if (tls_server_) {
+      tls_server_->set_reuse_addr(true);
+      tls_server_->listen(asio::ip::tcp::v4(), port);
+      tls_server_->start_accept();
+    } else
+#endif
+    {
+      server_.set_reuse_addr(true);
+      server_.listen(asio::ip::tcp::v4(), port);
+      server_.start_accept();
+    }
+  }
+
+  if (!config_.uds_path.empty()) {
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+    // A stale socket file from a previous run would make bind() fail.
+    std::remove(config_.uds_path.c_str());
+    uds_acceptor_ = std::make_unique<asio::local::stream_protocol::acceptor>(
+        io_conn_, asio::local::stream_protocol::endpoint(config_.uds_path));
+    uds_socket_ =
+        std::make_unique<asio::local::stream_protocol::socket>(io_conn_);
+    StartUnixAccept();
+    SHERPA_LOG(INFO) << "Listening on unix domain socket "
+                     << config_.uds_path;
+#else
+    SHERPA_LOG(FATAL) << "--uds-path is not supported on this platform";
+#endif
+  }
+
   decoder_.Run();
 }
 
 void OnlineWebsocketServer::SetupLog() {
+#ifdef SHERPA_ENABLE_TLS
+  if (tls_server_) {
+    tls_server_->clear_access_channels(websocketpp::log::alevel::all);
+
+    // So that it also prints to std::cout and std::cerr
+    tls_server_->get_alog().set_ostream(&tee_);
+    tls_server_->get_elog().set_ostream(&tee_);
+    return;
+  }
+#endif
   server_.clear_access_channels(websocketpp::log::alevel::all);
   // server_.set_access_channels(websocketpp::log::alevel::connect);
   // server_.set_access_channels(websocketpp::log::alevel::disconnect);
@@ -250,52 +2424,300 @@ void OnlineWebsocketServer::SetupLog() {
 }
 
 void OnlineWebsocketServer::Send(connection_hdl hdl, const std::string &text) {
-  websocketpp::lib::error_code ec;
   if (!Contains(hdl)) {
     return;
   }
 
-  server_.send(hdl, text, websocketpp::frame::opcode::text, ec);
-  if (ec) {
-    server_.get_alog().write(websocketpp::log::alevel::app, ec.message());
+  bool compress =
+      config_.permessage_deflate &&
+      static_cast<int32_t>(text.size()) >= config_.deflate_min_bytes;
+
+#ifdef SHERPA_ENABLE_TLS
+  if (tls_server_) {
+    SendOnEndpoint(tls_server_.get(), hdl, text,
+                   websocketpp::frame::opcode::text, compress);
+    return;
+  }
+#endif
+  SendOnEndpoint(&server_, hdl, text, websocketpp::frame::opcode::text,
+                 compress);
+}
+
+void OnlineWebsocketServer::SendBinary(connection_hdl hdl,
+                                       const std::string &data) {
+  if (!Contains(hdl)) {
+    return;
+  }
+
+  bool compress =
+      config_.permessage_deflate &&
+      static_cast<int32_t>(data.size()) >= config_.deflate_min_bytes;
+
+#ifdef SHERPA_ENABLE_TLS
+  if (tls_server_) {
+    SendOnEndpoint(tls_server_.get(), hdl, data,
+                   websocketpp::frame::opcode::binary, compress);
+    return;
+  }
+#endif
+  SendOnEndpoint(&server_, hdl, data, websocketpp::frame::opcode::binary,
+                 compress);
+}
+
+std::string OnlineWebsocketServer::GetRemoteEndpoint(connection_hdl hdl) {
+#ifdef SHERPA_ENABLE_TLS
+  if (tls_server_) {
+    return tls_server_->get_con_from_hdl(hdl)->get_remote_endpoint();
   }
+#endif
+  return server_.get_con_from_hdl(hdl)->get_remote_endpoint();
+}
+
+OnlineWebsocketServer::ConnectionShard &OnlineWebsocketServer::GetShard(
+    connection_hdl hdl) const {
+  // The handle stays alive for as long as its shard entry exists, so the
+  // hash (and thus the shard) of a given connection is stable.
+  void *key = hdl.lock().get();
+  return connection_shards_[std::hash<void *>()(key) % kNumShards];
 }
 
 void OnlineWebsocketServer::OnOpen(connection_hdl hdl) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  connections_.insert(hdl);
+  if (draining_.load(std::memory_order_relaxed)) {
+    // The server is being replaced (see /drain); new sessions belong to
+    // its successor.
+    SHERPA_LOG(INFO) << "Rejecting new connection: the server is draining";
+    static const std::string kReason =
+        "The server is draining. Please connect to its successor.";
+#ifdef SHERPA_ENABLE_TLS
+    if (tls_server_) {
+      CloseOnEndpoint(tls_server_.get(), hdl,
+                      websocketpp::close::status::going_away, kReason);
+      return;
+    }
+#endif
+    CloseOnEndpoint(&server_, hdl, websocketpp::close::status::going_away,
+                    kReason);
+    return;
+  }
+
+  // Admission control: refuse new sessions while the server is at
+  // capacity, the decoder cannot keep up with the ticks, or one more
+  // stream would exceed the GPU memory budget. Rejecting here keeps
+  // the latency of the admitted streams intact instead of degrading
+  // every stream collectively; the close code tells clients to retry
+  // later, e.g., against another server.
+  bool at_capacity =
+      config_.max_active_connections > 0 &&
+      num_connections_.load(std::memory_order_relaxed) >=
+          config_.max_active_connections;
+
+  auto occupancy = decoder_.GetOccupancy();
+  if (at_capacity || occupancy.overloaded || occupancy.over_memory_budget) {
+    SHERPA_LOG(WARNING) << "Rejecting new connection: the server is "
+                        << (at_capacity ? "at capacity"
+                            : occupancy.over_memory_budget
+                                ? "out of GPU memory budget"
+                                : "overloaded");
+    static const std::string kReason =
+        "The server is overloaded. Please retry later.";
+#ifdef SHERPA_ENABLE_TLS
+    if (tls_server_) {
+      CloseOnEndpoint(tls_server_.get(), hdl,
+                      websocketpp::close::status::try_again_later, kReason);
+      return;
+    }
+#endif
+    CloseOnEndpoint(&server_, hdl,
+                    websocketpp::close::status::try_again_later, kReason);
+    return;
+  }
+
+  auto &shard = GetShard(hdl);
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.connections.insert(hdl);
+  }
+  int32_t num_connections =
+      num_connections_.fetch_add(1, std::memory_order_relaxed) + 1;
 
   std::ostringstream os;
-  os << "New connection: "
-     << server_.get_con_from_hdl(hdl)->get_remote_endpoint() << ". "
-     << "Number of active connections: " << connections_.size() << ".\n";
+  os << "New connection: " << GetRemoteEndpoint(hdl) << ". "
+     << "Number of active connections: " << num_connections << ".\n";
   SHERPA_LOG(INFO) << os.str();
+
+  if (config_.ping_interval > 0) {
+    std::lock_guard<std::mutex> lock(ping_mutex_);
+    ping_states_[hdl] = std::make_shared<PingState>();
+    // The wheel comes back around to the current slot after one full
+    // revolution, so the first ping goes out one interval from now.
+    ping_wheel_[ping_slot_].push_back(hdl);
+  }
+
+  if (!tokens_.empty()) {
+    // With --binary-results the client needs the symbol table exactly
+    // once to map token IDs back to symbols; later frames are binary.
+    Send(hdl, tokens_);
+  }
 }
 
 void OnlineWebsocketServer::OnClose(connection_hdl hdl) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  connections_.erase(hdl);
+  // Tell the decoder right away, so its loop never has to scan for
+  // vanished clients; it recycles or detaches the stream on its next
+  // tick.
+  decoder_.OnDisconnect(hdl);
+
+  if (config_.ping_interval > 0) {
+    // The connection's wheel entry is dropped lazily when its slot
+    // comes around and this lookup fails.
+    std::lock_guard<std::mutex> lock(ping_mutex_);
+    ping_states_.erase(hdl);
+  }
+
+  auto &shard = GetShard(hdl);
+  size_t num_erased = 0;
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    num_erased = shard.connections.erase(hdl);
+  }
+
+  int32_t num_connections = num_connections_.load(std::memory_order_relaxed);
+  if (num_erased) {
+    num_connections =
+        num_connections_.fetch_sub(1, std::memory_order_relaxed) - 1;
+  }
 
-  SHERPA_LOG(INFO) << "Number of active connections: " << connections_.size()
+  SHERPA_LOG(INFO) << "Number of active connections: " << num_connections
                    << "\n";
 }
 
 bool OnlineWebsocketServer::Contains(connection_hdl hdl) const {
-  std::lock_guard<std::mutex> lock(mutex_);
-  return connections_.count(hdl);
+  auto &shard = GetShard(hdl);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.connections.count(hdl);
 }
 
 void OnlineWebsocketServer::OnHttp(connection_hdl hdl) {
-  auto con = server_.get_con_from_hdl(hdl);
+#ifdef SHERPA_ENABLE_TLS
+  if (tls_server_) {
+    HandleHttp(tls_server_->get_con_from_hdl(hdl));
+    return;
+  }
+#endif
+  HandleHttp(server_.get_con_from_hdl(hdl));
+}
 
+template <typename ConPtr>
+void OnlineWebsocketServer::HandleHttp(ConPtr con) {
   std::string filename = con->get_resource();
   if (filename == "/") filename = "/index.html";
 
+  if (filename == "/metrics") {
+    // All registered serving metrics, in the Prometheus text format.
+    // The allocator gauges are refreshed per scrape; everything else is
+    // updated at the source.
+    UpdateAllocatorMetrics();
+    con->set_status(websocketpp::http::status_code::ok);
+    con->append_header("Content-Type", "text/plain; version=0.0.4");
+    con->set_body(MetricsRegistry::Get().Render() + RenderProfSites());
+    return;
+  }
+
+  if (filename == "/trace") {
+    // The buffered trace events of the sampled streams, in the Chrome
+    // trace JSON format; open the download in chrome://tracing or
+    // Perfetto. See --trace-sample-rate.
+    con->set_status(websocketpp::http::status_code::ok);
+    con->append_header("Content-Type", "application/json");
+    con->set_body(TraceRing::Get().RenderChromeTrace());
+    return;
+  }
+
+  if (filename == "/status") {
+    // Current occupancy, for load balancers and monitoring.
+    int32_t num_connections = num_connections_.load(std::memory_order_relaxed);
+    auto occupancy = decoder_.GetOccupancy();
+
+    std::ostringstream os;
+    os << "{"
+       << "\"active_connections\": " << num_connections << ", "
+       << "\"ready_streams\": " << occupancy.num_ready_streams << ", "
+       << "\"max_active_connections\": " << config_.max_active_connections
+       << ", "
+       << "\"overloaded\": " << (occupancy.overloaded ? "true" : "false")
+       << ", "
+       << "\"over_memory_budget\": "
+       << (occupancy.over_memory_budget ? "true" : "false") << ", "
+       << "\"draining\": "
+       << (draining_.load(std::memory_order_relaxed) ? "true" : "false")
+       << "}";
+
+    con->set_status(websocketpp::http::status_code::ok);
+    con->set_body(os.str());
+    return;
+  }
+
+  if (filename == "/drain") {
+    // Stop admitting connections; with --drain-state-file the remaining
+    // sessions are also handed off to disk for the successor process.
+    // See OnlineWebsocketDecoder::RequestDrain().
+    if (!draining_.exchange(true)) {
+      SHERPA_LOG(INFO) << "Draining: new connections are rejected";
+      decoder_.RequestDrain();
+    }
+
+    std::ostringstream os;
+    os << "{"
+       << "\"draining\": true, "
+       << "\"active_connections\": "
+       << num_connections_.load(std::memory_order_relaxed) << "}";
+
+    con->set_status(websocketpp::http::status_code::ok);
+    con->append_header("Content-Type", "application/json");
+    con->set_body(os.str());
+    return;
+  }
+
+  if (filename == "/reload") {
+    // Rebuild every recognizer from the model files on disk in a
+    // background thread and swap them in; in-flight streams finish on
+    // the model they started with. See
+    // OnlineWebsocketDecoder::RequestReload().
+    decoder_.RequestReload();
+
+    con->set_status(websocketpp::http::status_code::ok);
+    con->append_header("Content-Type", "application/json");
+    con->set_body("{\"reloading\": true}");
+    return;
+  }
+
   std::string content;
   bool found = false;
 
   if (filename != "/upload.html" && filename != "/offline_record.html") {
-    found = http_server_.ProcessRequest(filename, &content);
+    if (const HttpAsset *asset = http_server_.Find(filename)) {
+      con->append_header("ETag", asset->etag);
+
+      if (con->get_request_header("If-None-Match") == asset->etag) {
+        // The client already has this version cached; skip the body.
+        con->set_status(websocketpp::http::status_code::not_modified);
+        return;
+      }
+
+      if (!asset->gzipped.empty() &&
+          con->get_request_header("Accept-Encoding").find("gzip") !=
+              std::string::npos) {
+        // Serve the pre-compressed copy; nothing is compressed on the fly.
+        con->append_header("Content-Encoding", "gzip");
+        con->set_status(websocketpp::http::status_code::ok);
+        con->set_body(asset->gzipped);
+        return;
+      }
+
+      con->set_status(websocketpp::http::status_code::ok);
+      con->set_body(asset->content);
+      return;
+    }
+    content = http_server_.GetErrorContent();
   } else {
     content = R"(
 <!doctype html><html><head>
@@ -317,31 +2739,136 @@ Go back to <a href="/streaming_record.html">/streaming_record.html</a>
   con->set_body(std::move(content));
 }
 
-void OnlineWebsocketServer::OnMessage(connection_hdl hdl,
-                                      server::message_ptr msg) {
-  auto c = decoder_.GetOrCreateConnection(hdl);
+bool OnlineWebsocketServer::CheckAudioBudget(connection_hdl hdl,
+                                             Connection *c,
+                                             int32_t num_samples) {
+  float samp_freq = config_.decoder_config.recognizer_config.feat_config
+                        .fbank_opts.frame_opts.samp_freq;
+
+  if (config_.max_audio_duration > 0) {
+    c->total_samples += num_samples;
+    if (c->total_samples >
+        static_cast<int64_t>(config_.max_audio_duration * samp_freq)) {
+      Close(hdl, websocketpp::close::status::policy_violation,
+            "max audio duration exceeded");
+      return false;
+    }
+  }
+
+  if (config_.max_audio_rate > 0) {
+    double capacity = config_.audio_burst_seconds * samp_freq;
+    auto now = std::chrono::steady_clock::now();
+
+    if (c->last_refill == std::chrono::steady_clock::time_point()) {
+      // First frame of the connection: start with a full bucket.
+      c->rate_tokens = capacity;
+    } else {
+      double elapsed = std::chrono::duration<double>(now - c->last_refill)
+                           .count();
+      c->rate_tokens = std::min(
+          capacity,
+          c->rate_tokens + elapsed * config_.max_audio_rate * samp_freq);
+    }
+    c->last_refill = now;
+
+    c->rate_tokens -= num_samples;
+    if (c->rate_tokens < 0) {
+      Close(hdl, websocketpp::close::status::policy_violation,
+            "audio rate limit exceeded");
+      return false;
+    }
+  }
+
+  return true;
+}
 
+template <typename MessagePtr>
+void OnlineWebsocketServer::OnMessage(connection_hdl hdl, MessagePtr msg) {
   const std::string &payload = msg->get_payload();
 
+  if (msg->get_opcode() == websocketpp::frame::opcode::text &&
+      payload.compare(0, 7, "resume:") == 0) {
+    // The client wants to reattach to a session it lost to a network
+    // blip; see --session-resume-timeout. It must be the first message
+    // of the connection: GetOrCreateConnection() below would otherwise
+    // start a fresh session for this handle.
+    auto c = decoder_.ResumeConnection(hdl, payload.substr(7));
+    Send(hdl, c ? "{\"resumed\": true}" : "{\"resumed\": false}");
+    return;
+  }
+
+  if (msg->get_opcode() == websocketpp::frame::opcode::text &&
+      payload.compare(0, 7, "model: ") == 0) {
+    // Select the recognizer for this connection; see --extra-models. It
+    // must precede the first audio frame, since the first message that
+    // is not handled here creates the stream and binds it to a model.
+    if (!decoder_.GetOrCreateConnection(hdl, payload.substr(7))) {
+      Close(hdl, websocketpp::close::status::invalid_payload,
+            "Unknown model (or the model cannot change after the stream "
+            "was created): " +
+                payload.substr(7));
+    }
+    return;
+  }
+
+  auto c = decoder_.GetOrCreateConnection(hdl);
+
   switch (msg->get_opcode()) {
     case websocketpp::frame::opcode::text:
       if (payload == "Done") {
-        asio::post(io_work_, [this, c]() { decoder_.InputFinished(c); });
+        decoder_.PostStreamWork(c, [this, c]() { decoder_.InputFinished(c); });
+      } else if (payload == "format: int16") {
+        // The client sends raw int16 samples from now on, halving its
+        // upload bandwidth; see the offline server for the protocol.
+        c->int16 = true;
+      } else if (payload == "priority: bulk") {
+        // A faster-than-realtime replay: its chunks only use batch
+        // slots the realtime streams leave over. See Connection::bulk.
+        c->bulk = true;
+      } else if (payload == "priority: realtime") {
+        c->bulk = false;  // the default; accepted for symmetry
+      } else if (payload == "timestamps: off") {
+        // The client never reads per-token timestamps, so the decoders
+        // skip the timestamp work for this stream.
+        c->s->SetEnableTimestamps(false);
+      } else if (payload == "timestamps: on") {
+        c->s->SetEnableTimestamps(true);
       }
       break;
     case websocketpp::frame::opcode::binary: {
-      auto p = reinterpret_cast<const float *>(payload.data());
-      int32_t num_samples = payload.size() / sizeof(float);
-      torch::Tensor samples = torch::from_blob(const_cast<float *>(p),
-                                               {num_samples}, torch::kFloat);
-      // Caution(fangjun): We have to make a copy here since the tensor
-      // is referenced inside the fbank computer.
-      // Otherwise, it will cause segfault for the next invocation
-      // of AcceptWaveform since payload is freed after this function returns
-      samples = samples.clone();
+      if (!CheckAudioBudget(
+              hdl, c.get(),
+              payload.size() / (c->int16 ? sizeof(int16_t) : sizeof(float)))) {
+        // The connection was closed; the offending frame is dropped
+        // before any conversion or feature work.
+        break;
+      }
+
+      torch::Tensor samples;
+      if (c->int16) {
+        auto p = reinterpret_cast<const int16_t *>(payload.data());
+        int32_t num_samples = payload.size() / sizeof(int16_t);
+        // to() allocates fresh memory, so this also serves as the copy
+        // the fbank computer needs (see the comment below).
+        samples = torch::from_blob(const_cast<int16_t *>(p), {num_samples},
+                                   torch::kShort)
+                      .to(torch::kFloat)
+                      .div_(32768);
+      } else {
+        auto p = reinterpret_cast<const float *>(payload.data());
+        int32_t num_samples = payload.size() / sizeof(float);
+        samples = torch::from_blob(const_cast<float *>(p), {num_samples},
+                                   torch::kFloat);
+        // Caution(fangjun): We have to make a copy here since the tensor
+        // is referenced inside the fbank computer.
+        // Otherwise, it will cause segfault for the next invocation
+        // of AcceptWaveform since payload is freed after this function
+        // returns
+        samples = samples.clone();
+      }
       c->samples.push_back(samples);
 
-      asio::post(io_work_, [this, c]() { decoder_.AcceptWaveform(c); });
+      decoder_.PostStreamWork(c, [this, c]() { decoder_.AcceptWaveform(c); });
       break;
     }
     default:
@@ -352,19 +2879,19 @@ void OnlineWebsocketServer::OnMessage(connection_hdl hdl,
 void OnlineWebsocketServer::Close(connection_hdl hdl,
                                   websocketpp::close::status::value code,
                                   const std::string &reason) {
-  auto con = server_.get_con_from_hdl(hdl);
-
   std::ostringstream os;
-  os << "Closing " << con->get_remote_endpoint() << " with reason: " << reason
+  os << "Closing " << GetRemoteEndpoint(hdl) << " with reason: " << reason
      << "\n";
 
-  websocketpp::lib::error_code ec;
-  server_.close(hdl, code, reason, ec);
-  if (ec) {
-    os << "Failed to close" << con->get_remote_endpoint() << ". "
-       << ec.message() << "\n";
+#ifdef SHERPA_ENABLE_TLS
+  if (tls_server_) {
+    tls_server_->get_alog().write(websocketpp::log::alevel::app, os.str());
+    CloseOnEndpoint(tls_server_.get(), hdl, code, reason);
+    return;
   }
+#endif
   server_.get_alog().write(websocketpp::log::alevel::app, os.str());
+  CloseOnEndpoint(&server_, hdl, code, reason);
 }
 
 }  // namespace sherpa
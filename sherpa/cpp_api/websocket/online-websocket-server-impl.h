@@ -5,15 +5,22 @@
 #ifndef SHERPA_CPP_API_WEBSOCKET_ONLINE_WEBSOCKET_SERVER_IMPL_H_
 #define SHERPA_CPP_API_WEBSOCKET_ONLINE_WEBSOCKET_SERVER_IMPL_H_
 
+#include <array>
+#include <atomic>
+#include <condition_variable>  // NOLINT
 #include <deque>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>  // NOLINT
 #include <set>
 #include <string>
+#include <thread>  // NOLINT
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "asio.hpp"
 #include "sherpa/cpp_api/online-recognizer.h"
@@ -21,9 +28,39 @@
 #include "sherpa/cpp_api/parse-options.h"
 #include "sherpa/cpp_api/websocket/http-server.h"
 #include "sherpa/cpp_api/websocket/tee-stream.h"
-#include "websocketpp/config/asio_no_tls.hpp"  // TODO(fangjun): support TLS
+#include "sherpa/csrc/metrics.h"
+#include "sherpa/csrc/shm-ring.h"
+#include "websocketpp/config/asio_no_tls.hpp"
+#ifdef SHERPA_ENABLE_TLS
+#include "websocketpp/config/asio.hpp"
+#endif
+#include "websocketpp/extensions/permessage_deflate/enabled.hpp"
 #include "websocketpp/server.hpp"
-using server = websocketpp::server<websocketpp::config::asio>;
+
+// Endpoint configs with the permessage-deflate extension compiled in.
+// Compiling it in only makes negotiation possible; a connection is
+// compressed when the client offers the extension, and outgoing frames
+// are additionally gated by --permessage-deflate and
+// --deflate-min-bytes (see OnlineWebsocketServerConfig), so plain
+// clients and plain deployments behave exactly as before.
+struct asio_with_deflate : public websocketpp::config::asio {
+  struct permessage_deflate_config {};
+
+  using permessage_deflate_type =
+      websocketpp::extensions::permessage_deflate::enabled<
+          permessage_deflate_config>;
+};
+using server = websocketpp::server<asio_with_deflate>;
+#ifdef SHERPA_ENABLE_TLS
+struct asio_tls_with_deflate : public websocketpp::config::asio_tls {
+  struct permessage_deflate_config {};
+
+  using permessage_deflate_type =
+      websocketpp::extensions::permessage_deflate::enabled<
+          permessage_deflate_config>;
+};
+using tls_server = websocketpp::server<asio_tls_with_deflate>;
+#endif
 using connection_hdl = websocketpp::connection_hdl;
 
 namespace sherpa {
@@ -33,6 +70,105 @@ struct Connection {
   connection_hdl hdl;
   std::shared_ptr<OnlineStream> s;
 
+  // The recognizer this stream was created by. The stream keeps
+  // decoding with it even after a hot swap (see /reload) replaced the
+  // recognizers_ entry of its replica: encoder state is tied to the
+  // model that produced it, so in-flight streams finish on the old
+  // model while new streams get the new one. The last stream of a
+  // swapped-out recognizer releases it.
+  std::shared_ptr<OnlineRecognizer> recognizer;
+
+  // Index of the recognizer replica this stream is assigned to. All
+  // processing of the stream happens on this replica (and thus on its
+  // GPU); see OnlineWebsocketDecoderConfig::num_gpus.
+  int32_t replica = 0;
+
+  // Index of the model this stream is decoded with; 0 is the base
+  // model from the command line. Selected by the "model: <name>"
+  // handshake; see OnlineWebsocketDecoderConfig::extra_models.
+  int32_t model = 0;
+
+  // Index of the affinity worker that runs this stream's host-side
+  // work (feature extraction); see --affinity-workers. Assigned by
+  // handle hash when the connection is created and stable for the
+  // session's lifetime, so the stream's feature buffers stay warm in
+  // one worker's cache.
+  int32_t affinity = 0;
+
+  // True if the connection sends int16 samples instead of float32; set
+  // by the "format: int16" text message. The conversion to float
+  // happens in one vectorized pass per received chunk.
+  bool int16 = false;
+
+  // True if the client declared this stream bulk traffic (the
+  // "priority: bulk" handshake): its chunks are decoded only with the
+  // batch slots left after every ready realtime stream got one, so a
+  // faster-than-realtime replay burst cannot crowd live streams out of
+  // the batches. The default is realtime.
+  bool bulk = false;
+
+  // True if the stream is parked: its trailing silence exceeded
+  // --park-idle-streams-after and it is excluded from decode batches
+  // until audio arrives. See OnlineWebsocketDecoder::ProcessConnections.
+  bool parked = false;
+
+  // True only for the synthetic canary stream; see
+  // OnlineWebsocketDecoder::FeedCanary(). Its results are turned into
+  // latency metrics instead of being sent anywhere.
+  bool is_canary = false;
+
+  // Number of feature frames the stream had when its partial chunk was
+  // last decoded speculatively, so the same frames are not speculated
+  // on twice; see --speculative-partial-chunks.
+  int32_t speculated_frames = 0;
+
+  // State of the per-connection audio budget (see --max-audio-rate and
+  // --max-audio-duration): the token bucket balance in samples, the
+  // time it was last refilled (the epoch value means "not initialized
+  // yet") and the total number of samples this connection has sent.
+  // They are touched only by the message handlers of this connection,
+  // which websocketpp serializes, so no locking is needed.
+  double rate_tokens = 0;
+  std::chrono::steady_clock::time_point last_refill;
+  int64_t total_samples = 0;
+
+  // Text of the last result frame sent to this connection and the
+  // segment it belonged to; delta frames are computed against them (see
+  // --delta-results). They are touched only by the decoder tick that
+  // holds the connection in its batch, so they need no extra locking.
+  std::string last_sent_text;
+  int32_t last_sent_segment = -1;
+
+  // Number of delta frames sent since the last full result frame; see
+  // --full-sync-interval.
+  int32_t deltas_since_sync = 0;
+
+  // True once the websocket of this connection has closed; set by
+  // OnlineWebsocketDecoder::OnDisconnect(). The decoder loop skips a
+  // closed connection that is still queued in the pending set, so its
+  // stream is never enqueued after it has been recycled. Cleared again
+  // when a detached session is resumed.
+  std::atomic<bool> closed{false};
+
+  // True while this connection sits in the decoder's pending set, i.e.,
+  // it received audio that completed a chunk and the decoder loop has
+  // not examined it yet. It keeps a connection from being enqueued into
+  // the pending set more than once; see
+  // OnlineWebsocketDecoder::MarkPendingAudio().
+  std::atomic<bool> pending{false};
+
+  // Non-zero if this stream was sampled for tracing (see
+  // --trace-sample-rate); it is the timeline row of the stream's events
+  // in the Chrome trace dump served at /trace.
+  int64_t trace_id = 0;
+
+  // Unguessable token identifying this session. The client receives it
+  // right after the session is created and can present it, within
+  // --session-resume-timeout seconds of a disconnect, to reattach to
+  // this stream without losing any decoding state. See
+  // OnlineWebsocketDecoder::ResumeConnection.
+  std::string session_token;
+
   // The last time we received a message from the client
   // TODO(fangjun): Use it to disconnect from a client if it is inactive
   // for a specified time.
@@ -47,8 +183,12 @@ struct Connection {
   std::deque<torch::Tensor> samples;
 
   Connection() = default;
-  Connection(connection_hdl hdl, std::shared_ptr<OnlineStream> s)
-      : hdl(hdl), s(s), last_active(std::chrono::steady_clock::now()) {}
+  Connection(connection_hdl hdl, std::shared_ptr<OnlineStream> s,
+             int32_t replica)
+      : hdl(hdl),
+        s(s),
+        replica(replica),
+        last_active(std::chrono::steady_clock::now()) {}
 };
 
 struct OnlineWebsocketDecoderConfig {
@@ -59,6 +199,221 @@ struct OnlineWebsocketDecoderConfig {
 
   int32_t max_batch_size = 5;
 
+  // Maximum duration in milliseconds a ready stream may wait for more
+  // streams to become ready before we decode a partial batch.
+  //
+  // A larger value gives larger batches (higher GPU throughput) at the
+  // cost of extra latency for the streams that became ready first.
+  int32_t max_wait_ms = 5;
+
+  // Maximum number of chunks of one stream decoded within a single
+  // tick. With the default of 1 a stream that fell behind -- a decode
+  // stall, a burst of buffered audio after a resume -- catches up at
+  // one extra chunk per tick at best, so a transient stall turns into
+  // permanently added latency. Values > 1 let Decode() run additional
+  // rounds for the lagging streams of a batch, but only when the batch
+  // had spare slots, so catch-up never displaces the realtime work of
+  // other streams.
+  int32_t max_chunks_per_tick = 1;
+
+  // If positive, per-stream host work (feature extraction and sample
+  // bookkeeping) runs on this many dedicated worker threads instead of
+  // the shared work pool, with each stream hashed to one worker for
+  // the lifetime of its session. The stream's feature rings and
+  // buffers then stay warm in that worker's cache instead of migrating
+  // between cores chunk by chunk. An idle worker steals from a worker
+  // whose queue is backed up, so one hot stream cannot starve its
+  // queue neighbors. 0 (the default) keeps using the shared pool.
+  int32_t affinity_workers = 0;
+
+  // Number of GPUs to use. Used only when --use-gpu is true. One
+  // recognizer replica is created per device (devices 0 to num_gpus - 1)
+  // and each stream is pinned to one replica for its whole lifetime;
+  // streams are sharded across the replicas round-robin and each replica
+  // has its own batching queue.
+  int32_t num_gpus = 1;
+
+  // If not empty, additional models to serve from the same process, as
+  // comma-separated name=config-file pairs, e.g.,
+  //
+  //   --extra-models=es=/path/spanish.conf,de=/path/german.conf
+  //
+  // Each config file holds ParseOptions-style lines (--nn-model=...,
+  // --tokens=..., one per line) overriding a copy of the base
+  // recognizer config. A client selects a model by sending
+  // "model: <name>" as the first message of its connection; without the
+  // handshake it gets the base model. Every model has its own batch
+  // queue (per GPU), and the decoder loop schedules the queues onto the
+  // shared worker pool, interleaving the models' batches -- so one GPU
+  // serves several models that would each underutilize a process of
+  // their own. All models must expect the same sampling rate.
+  std::string extra_models;
+
+  // If positive, a per-GPU budget in megabytes for the dynamic memory
+  // of this server: the encoder states of the admitted streams plus the
+  // worst-case activations of one decode batch, both as calibrated by
+  // the recognizer during warmup (see
+  // OnlineRecognizer::EstimateActivationBytes). A connection that would
+  // push the estimate of any GPU over the budget is rejected with
+  // try-again-later, so a traffic spike meeting long-running streams
+  // turns into refusals instead of CUDA OOMs mid-utterance. Model
+  // weights are not budgeted; subtract them (and a safety margin) from
+  // the physical memory of the device when picking the value. Used only
+  // with --use-gpu=true.
+  int32_t gpu_memory_budget_mb = 0;
+
+  // true to fill the spare capacity of partial batches with speculative
+  // decodes: streams that are waiting for their next chunk to complete
+  // get their buffered frames padded to a full chunk and decoded for a
+  // display-only partial result, with the state delta discarded (see
+  // OnlineRecognizer::DecodeStreamsSpeculative). First tokens then show
+  // up well before the chunk length has elapsed, at a cost that is paid
+  // only with batch slots that would have run empty anyway.
+  bool speculative_partial_chunks = false;
+
+  // true to adapt the beam size of modified_beam_search to the decode
+  // load: when the ready queues hold more than one full batch per
+  // replica for --adaptive-beam-shrink-ticks consecutive loop
+  // iterations, the beam is halved (down to 1, a greedy-equivalent
+  // width); after --adaptive-beam-widen-ticks iterations without
+  // pressure it is widened again by one, up to the configured
+  // --num-active-paths. Overload then degrades accuracy gracefully
+  // instead of collapsing the latency of every stream. The current
+  // width is exported as the sherpa_beam_width gauge on /metrics.
+  bool adaptive_beam = false;
+
+  // See adaptive_beam. Shrinking reacts within a few ticks; widening is
+  // deliberately slow so the beam does not oscillate at the overload
+  // boundary.
+  int32_t adaptive_beam_shrink_ticks = 10;
+  int32_t adaptive_beam_widen_ticks = 500;
+
+  // true to send recognition results as compact binary frames instead of
+  // JSON text frames. A binary frame contains (all little endian):
+  //
+  //   int32   segment
+  //   float   start_time (seconds)
+  //   uint8   is_final
+  //   int32   num_tokens
+  //   int32   token_ids[num_tokens]
+  //   float   timestamps[num_tokens] (seconds)
+  //
+  // The content of --tokens is sent to the client as the first (text)
+  // message of each connection, so it can map token IDs back to symbols
+  // without the server serializing them on every tick.
+  bool binary_results = false;
+
+  // true to send partial results as deltas against the text last sent
+  // on the same connection, instead of resending the whole transcript
+  // every tick. A delta frame is the JSON object
+  //
+  //   {"delta": true, "segment": s, "prefix": n,
+  //    "retract": m, "append": "..."}
+  //
+  // meaning: keep the first n bytes of the currently displayed text,
+  // drop the next m bytes (the decoder retracted them), then append the
+  // given string. A frame without the "delta" key is a full result in
+  // the usual format and replaces the display entirely; one is sent
+  // whenever the segment changes, whenever a result is final, and after
+  // every --full-sync-interval delta frames, so a client that missed a
+  // frame converges. Not supported together with --binary-results.
+  bool delta_results = false;
+
+  // See delta_results. A full result frame is sent after this many
+  // consecutive delta frames.
+  int32_t full_sync_interval = 100;
+
+  // If positive, a stream whose trailing silence exceeds this many
+  // seconds is parked: its silent chunks are consumed with a cheap
+  // feature-energy check instead of occupying an encoder batch slot,
+  // and the stream rejoins the decode batches as soon as audio arrives.
+  // Its state is retained while parked. 0 disables parking.
+  float park_idle_streams_after = 0;
+
+  // true to offload the encoder state of parked streams to pinned host
+  // memory (see OnlineStream::OffloadState), so long-silent streams do
+  // not hold several MB of device memory each; per-GPU stream capacity
+  // is then bounded by compute instead of state storage. The
+  // --max-resident-parked-states most recently parked streams keep
+  // their state on the device, so brief silences do not thrash the
+  // PCIe bus. Used only when --park-idle-streams-after is positive.
+  bool offload_parked_states = false;
+
+  // See offload_parked_states. true to keep offloaded states in fp16,
+  // halving their host memory and transfer cost; they are cast back to
+  // fp32 on restore.
+  bool offload_states_fp16 = false;
+
+  // See offload_parked_states. Number of parked streams whose state
+  // stays resident on the device.
+  int32_t max_resident_parked_states = 8;
+
+  // A chunk counts as silence, for parking purposes, if its average
+  // log-mel feature energy is below this value. The right value depends
+  // on the feature frontend and the sample normalization in use.
+  float park_energy_threshold = -15;
+
+  // If positive, a disconnected session is kept alive, with its stream
+  // and decoding state, for this many seconds. A client reconnecting
+  // within the grace period can resume it by sending
+  // "resume:<session_token>" as its first message; no audio has to be
+  // re-sent and nothing is re-decoded. 0 disables session resumption.
+  float session_resume_timeout = 0;
+
+  // true to maintain one synthetic internal stream fed with a generated
+  // tone at real-time pace and to measure its end-to-end tick latency
+  // (ready to decoded) continuously. The latency is exported as the
+  // sherpa_canary_tick_seconds histogram on /metrics, so slowdowns of
+  // the decoding path (thermal throttling, a noisy GPU neighbor) show
+  // up before clients notice them.
+  bool enable_canary_stream = false;
+
+  // If not empty, name of a POSIX shm object (e.g., "/sherpa-results")
+  // the server creates and mirrors every serialized result into, so a
+  // colocated consumer (typically a Python post-processing worker using
+  // sherpa.ShmRingReader) gets them via two memcpys instead of a
+  // localhost websocket. Results are still sent to the clients.
+  std::string results_shm_name;
+
+  // Size in bytes of the shm result ring. When the consumer falls a
+  // whole ring behind, further results are dropped from the ring (and
+  // counted), never delayed.
+  int32_t results_shm_size = 8 * 1024 * 1024;
+
+  // If not empty, path used to hand live sessions over to a successor
+  // process during a deploy. A GET to /drain stops admission, pickles
+  // the remaining sessions (session token, stream position and encoder
+  // state) into this file and closes their websockets; a new server
+  // started with the same path adopts them on startup, so reconnecting
+  // clients resume by token and keep their encoder context across the
+  // restart. Requires a positive --session-resume-timeout, since
+  // adopted sessions wait in the detached set for their clients.
+  std::string drain_state_file;
+
+  // If not empty, path prefix for slow-batch captures: whenever a
+  // decode misses the tick deadline, the exact inputs of that
+  // DecodeStreams() call -- the gathered feature batch and the batch
+  // composition (model, stream position and priority of every slot) --
+  // are pickled to "<prefix>.<k>.pt". At most --capture-ring-size such
+  // files exist and a new capture overwrites the oldest, so a bad night
+  // cannot fill the disk. A captured file is re-executed against the
+  // model under a profiler with sherpa-slow-batch-replay, which closes
+  // the loop between a deadline-miss alert and a reproducible batch.
+  // Capturing costs one host copy of the feature batch per decode,
+  // paid only while this option is set.
+  std::string capture_slow_batches_file;
+
+  // Number of capture files kept; see capture_slow_batches_file.
+  int32_t capture_ring_size = 16;
+
+  // If positive, 1 in this many streams is sampled for tracing: its
+  // audio arrivals, batch inclusions and result sends are recorded into
+  // a bounded in-memory ring (see sherpa/csrc/trace.h) and can be
+  // dumped as Chrome trace JSON from the /trace HTTP endpoint, so a
+  // p99.9 outlier can be reconstructed event by event after the fact.
+  // 0 disables tracing.
+  int32_t trace_sample_rate = 0;
+
   void Register(ParseOptions *po);
   void Validate() const;
 };
@@ -72,7 +427,38 @@ class OnlineWebsocketDecoder {
    */
   explicit OnlineWebsocketDecoder(OnlineWebsocketServer *server);
 
-  std::shared_ptr<Connection> GetOrCreateConnection(connection_hdl hdl);
+  ~OnlineWebsocketDecoder();
+
+  /** Return the connection of the given handle, creating it on its
+   * first message.
+   *
+   * @param model Name of the model the stream should be decoded with
+   *              (see --extra-models); empty selects the base model. It
+   *              matters only for the call that creates the connection.
+   *
+   * @return Return the connection, or nullptr if the model name is
+   *         unknown or names a different model than the one the
+   *         connection was already created with.
+   */
+  std::shared_ptr<Connection> GetOrCreateConnection(
+      connection_hdl hdl, const std::string &model = "");
+
+  /** Reattach a detached session to a new websocket connection.
+   *
+   * Sessions whose connection dropped are kept, together with their
+   * stream and decoding state, for --session-resume-timeout seconds;
+   * see `detached_`. Resuming such a session simply rebinds it to the
+   * new handle, so decoding continues where it stopped.
+   *
+   * @param hdl The handle of the new connection.
+   * @param token The session token the client received when the session
+   *              was created.
+   *
+   * @return Return the resumed connection, or nullptr if the token is
+   *         unknown or the grace period has expired.
+   */
+  std::shared_ptr<Connection> ResumeConnection(connection_hdl hdl,
+                                               const std::string &token);
 
   // Compute features for a stream given audio samples
   void AcceptWaveform(std::shared_ptr<Connection> c);
@@ -80,35 +466,471 @@ class OnlineWebsocketDecoder {
   // signal that there will be no more audio samples for a stream
   void InputFinished(std::shared_ptr<Connection> c);
 
+  /** Run per-stream host work on the stream's affinity worker.
+   *
+   * With --affinity-workers=0 the task goes to the shared work pool
+   * instead. Any worker may safely run a stream's task -- ordering
+   * comes from the per-connection sample queue, which both
+   * AcceptWaveform() and InputFinished() drain under the connection
+   * mutex -- so affinity (and the occasional steal) is purely a cache
+   * locality matter.
+   */
+  void PostStreamWork(const std::shared_ptr<Connection> &c,
+                      std::function<void()> task);
+
+  /** Note that the websocket of the given handle has closed.
+   *
+   * It is called by the server's close handler. The connection leaves
+   * the shard map right away and joins a small disconnected list the
+   * decoder loop drains on its next tick (to recycle or detach the
+   * stream under `mutex_`). Together with MarkPendingAudio() this keeps
+   * the loop event driven: it never has to scan the connection map for
+   * vanished clients.
+   */
+  void OnDisconnect(connection_hdl hdl);
+
+  /** Move a stream to another recognizer replica.
+   *
+   * It migrates the encoder state and the cached decoder output of the
+   * stream to the device of the target replica, so no audio is lost; the
+   * stream simply continues on the other GPU from its next chunk.
+   *
+   * @param c The connection to move.
+   * @param replica Index of the target replica.
+   *
+   * @return Return true if the stream now lives on the given replica.
+   *         Return false if the stream is currently queued or being
+   *         decoded (the caller should retry later), or if the target
+   *         replica runs a different model -- encoder state is model
+   *         specific, so streams move between GPUs, never between
+   *         models.
+   */
+  bool MoveConnection(std::shared_ptr<Connection> c, int32_t replica);
+
+  // A snapshot of the current decoder load; see GetOccupancy().
+  struct Occupancy {
+    int32_t num_streams = 0;        // streams known to the decoder
+    int32_t num_ready_streams = 0;  // streams queued for decoding
+    bool overloaded = false;
+    // true if admitting one more stream would exceed the memory budget
+    // of some GPU; see --gpu-memory-budget-mb.
+    bool over_memory_budget = false;
+  };
+
+  /** Return a snapshot of the current load.
+   *
+   * The decoder is considered overloaded when the ready queues hold more
+   * than two full batches per replica, i.e., the decode workers are not
+   * draining streams as fast as they become ready. The server uses it to
+   * reject new connections instead of letting the latency of every
+   * stream degrade collectively.
+   */
+  Occupancy GetOccupancy() const;
+
+  /** Reload every model in a background thread and swap it in.
+   *
+   * Triggered by a GET to /reload after the model file(s) on disk have
+   * been replaced. Each (model, GPU) recognizer is rebuilt -- and
+   * warmed up; see OnlineRecognizerConfig::warmup_batch_sizes -- off
+   * the serving threads, then swapped in under the decoder mutex: new
+   * streams use the new model right away, while in-flight streams keep
+   * decoding with the recognizer that created their state (see
+   * Connection::recognizer) and release it when they finish. At most
+   * one reload runs at a time; a request while one is in progress is
+   * ignored.
+   */
+  void RequestReload();
+
+  /** Stop feeding new work and hand the live sessions off to disk.
+   *
+   * Used only with --drain-state-file; see that option. Once the
+   * batches already in flight have finished, every session -- live and
+   * detached -- is pickled into the file and the live websockets are
+   * closed, so clients reconnect to the successor process and resume
+   * by token. Without --drain-state-file this is a no-op: the admitted
+   * streams simply keep decoding until their clients hang up.
+   */
+  void RequestDrain();
+
   void Run();
 
  private:
   void ProcessConnections(const asio::error_code &ec);
 
-  /** It is called by one of the worker thread.
+  /** Arm the loop timer for the next slot of the fixed tick grid.
+   *
+   * The grid is anchored on the monotonic clock when Run() is called
+   * and advances by --loop-interval-ms per tick, so the tick rate does
+   * not slip by the processing time of each iteration the way
+   * expires_after() from the end of the tick would. When processing
+   * overran whole intervals, the missed slots are skipped (doing their
+   * work late would only push the lateness onto every later tick) and
+   * counted in sherpa_ticks_skipped_total.
+   */
+  void ScheduleNextTick();
+
+  /** Flag a connection whose buffered audio completed a chunk.
+   *
+   * It enqueues the connection into `pending_connections_` (at most
+   * once; see Connection::pending), so the decoder loop examines only
+   * streams that can actually contribute work. It is called from
+   * AcceptWaveform()/InputFinished() when the new samples made the
+   * stream ready and from Decode() when a stream is released with
+   * another chunk already buffered. With the connection map itself
+   * never scanned, a tick costs O(streams with new audio) instead of
+   * O(connections) -- mostly-idle connections are free.
+   */
+  void MarkPendingAudio(const std::shared_ptr<Connection> &c);
+
+  /** Advance the synthetic canary stream by one loop interval.
+   *
+   * It creates the stream on first use, feeds it generated tone samples
+   * so it progresses at real-time pace, and enqueues it for decoding
+   * like a client stream whenever a chunk is ready; see
+   * OnlineWebsocketDecoderConfig::enable_canary_stream.
+   *
+   * Caution: the caller is expected to hold `mutex_`.
    */
-  void Decode();
+  void FeedCanary();
+
+  /** Decode a batch of streams assigned to the given replica.
+   *
+   * It is called by one of the worker threads.
+   */
+  void Decode(int32_t replica);
+
+  /** Main loop of one affinity worker; see --affinity-workers. */
+  void AffinityWorkerLoop(int32_t index);
+
+  /** Take the oldest task of a backed-up sibling queue.
+   *
+   * Stealing is restricted to queues already holding several tasks, so
+   * a briefly idle worker does not drag a stream's buffers to another
+   * core for no gain.
+   *
+   * @param thief Index of the stealing worker.
+   * @return Return the task, or an empty function if no queue is
+   *         backed up.
+   */
+  std::function<void()> StealStreamWork(int32_t thief);
+
+  /** Note that the given connection is now parked.
+   *
+   * It joins the device-resident set; when that set overflows
+   * --max-resident-parked-states, the least recently parked stream has
+   * its encoder state offloaded to pinned host memory. Used only with
+   * --offload-parked-states.
+   *
+   * Caution: the caller is expected to hold `mutex_`.
+   */
+  void ParkConnectionLocked(const std::shared_ptr<Connection> &c);
+
+  /** Note that the given parked connection received audio again.
+   *
+   * It leaves the device-resident set and, if its state was offloaded,
+   * the state is moved back to the device before the stream rejoins the
+   * decode batches. Used only with --offload-parked-states.
+   *
+   * Caution: the caller is expected to hold `mutex_`.
+   */
+  void WakeConnectionLocked(const std::shared_ptr<Connection> &c);
+
+  /** Collect streams of this replica whose partial chunk is worth a
+   * speculative decode.
+   *
+   * A candidate has buffered frames past its processed frames, is not
+   * chunk-ready (ready streams get a real decode), is not parked and
+   * has received audio since its last speculation. Only streams of the
+   * given recognizer qualify, so the batch stays homogeneous across a
+   * hot swap. At most max_streams candidates are collected and each is
+   * inserted into `active_`, so no other worker touches it until
+   * Decode() releases it.
+   *
+   * Caution: the caller is expected to hold `mutex_`.
+   */
+  void CollectSpeculativeCandidatesLocked(
+      int32_t replica, OnlineRecognizer *recognizer, int32_t max_streams,
+      std::vector<std::shared_ptr<Connection>> *candidates);
+
+  /** Adopt the sessions a draining predecessor saved to
+   * --drain-state-file.
+   *
+   * The file is consumed (deleted) so a later restart does not adopt
+   * stale sessions twice. Each saved session gets a fresh stream with
+   * the saved encoder state and waits in `detached_` for its client to
+   * reconnect and send "resume:<session_token>"; unclaimed sessions
+   * expire after --session-resume-timeout seconds like any detached
+   * session. The feature pipeline itself is not carried over: the
+   * client resumes sending audio from where it stopped and timestamps
+   * restart at the handoff point, while the encoder context is kept.
+   */
+  void LoadDrainState();
+
+  /** Pickle every session into --drain-state-file and close the live
+   * websockets.
+   *
+   * Caution: the caller is expected to hold `mutex_` and must have
+   * waited for `active_` to become empty, so no worker touches a
+   * stream while its state is serialized.
+   */
+  void SaveDrainStateLocked();
+
+  /** Pickle the inputs of a batch that missed the tick deadline into
+   * the capture ring; see --capture-slow-batches-file.
+   *
+   * @param replica The replica that decoded the batch.
+   * @param recognizer The recognizer that decoded it.
+   * @param batch The connections of the batch, in slot order.
+   * @param features The feature batch fed to DecodeStreams(), snapshot
+   *                 before the decode; shape (N, chunk_size, dim).
+   * @param decode_seconds Wall time of the decode.
+   */
+  void SaveSlowBatch(int32_t replica, OnlineRecognizer *recognizer,
+                     const std::vector<std::shared_ptr<Connection>> &batch,
+                     const torch::Tensor &features, double decode_seconds);
+
+  /** Log one structured postmortem line for a tick that missed its
+   * deadline: batch composition (per-stream frame counters), the stage
+   * breakdown of the decode and the net allocation of the tick. Rate
+   * limited to one dump per burst of misses; goes through SHERPA_LOG,
+   * so it rides the async logger when that is enabled.
+   *
+   * @param replica The replica that decoded the batch.
+   * @param batch The streams of the batch, in slot order.
+   * @param stats Stage breakdown reported by DecodeStreams().
+   * @param decode_seconds Wall time of the decode.
+   * @param alloc_before AllocatedBytes() sampled before the decode;
+   *                     -1 when the allocator cannot report it.
+   * @param alloc_after Like alloc_before, sampled after the decode.
+   */
+  void DumpDeadlineMiss(int32_t replica,
+                        const std::vector<OnlineStream *> &batch,
+                        const OnlineDecodeStats &stats, double decode_seconds,
+                        int64_t alloc_before, int64_t alloc_after);
+
+ private:
+  // Connections are sharded by connection-handle hash so that the
+  // per-message lookup in GetOrCreateConnection() never serializes
+  // across connections; only the first message of a connection takes
+  // the global mutex_ (to assign a replica and a stream).
+  static constexpr int32_t kNumShards = 64;
+
+  struct ConnectionShard {
+    std::mutex mutex;
+    std::map<connection_hdl, std::shared_ptr<Connection>,
+             std::owner_less<connection_hdl>>
+        connections;
+  };
+
+  ConnectionShard &GetShard(connection_hdl hdl);
 
  private:
   OnlineWebsocketServer *server_;  // not owned
-  std::unique_ptr<OnlineRecognizer> recognizer_;
+
+  // One recognizer per (model, GPU) pair, indexed by
+  // model * num_gpu_replicas_ + gpu; see
+  // OnlineWebsocketDecoderConfig::num_gpus and extra_models. It has
+  // exactly one entry when running one model on CPU. Every entry has
+  // its own ready queue and stream pool under the same index, so the
+  // decoder loop schedules the models' batches independently and the
+  // worker pool interleaves them on the shared GPU. An entry is
+  // replaced wholesale by a hot swap (see RequestReload()); streams
+  // created before the swap keep a reference to the old recognizer.
+  std::vector<std::shared_ptr<OnlineRecognizer>> recognizers_;
+
+  // The resolved config of every model, in model-index order; a hot
+  // swap rebuilds the recognizers from these (the model files on disk
+  // may have changed, the options have not).
+  std::vector<OnlineRecognizerConfig> model_configs_;
+
+  // True while a background reload is running; see RequestReload().
+  std::atomic<bool> reloading_{false};
+
+  // Model name -> model index; the base model has index 0. See
+  // --extra-models.
+  std::unordered_map<std::string, int32_t> model_index_;
+
+  // Number of recognizer replicas per model (the per-GPU fan-out).
+  int32_t num_gpu_replicas_ = 1;
   OnlineWebsocketDecoderConfig config_;
   asio::steady_timer timer_;
 
-  // It protects `connections_`, `ready_connections_`, and `active_`
-  std::mutex mutex_;
+  // It protects `ready_connections_`, `active_`, `stream_pool_` and
+  // `next_gpu_`. The connection map itself is sharded; see
+  // `connection_shards_`.
+  mutable std::mutex mutex_;
 
-  std::map<connection_hdl, std::shared_ptr<Connection>,
-           std::owner_less<connection_hdl>>
-      connections_;
+  std::array<ConnectionShard, kNumShards> connection_shards_;
+
+  // Number of entries in `connection_shards_`
+  std::atomic<int32_t> num_connections_{0};
+
+  // Per model, the GPU the next new stream of that model is assigned to
+  // (round-robin).
+  std::vector<int32_t> next_gpu_;
+
+  // Number of sessions ever created; used to pick every Nth one for
+  // tracing (see --trace-sample-rate). Protected by `mutex_`.
+  int64_t num_sessions_ = 0;
+
+  // Streams of closed connections, kept per replica for reuse by new
+  // connections. A recycled stream is reset via
+  // OnlineRecognizer::ResetStream() and keeps its allocated buffers, so
+  // high connection churn does not translate into allocator churn. The
+  // pool never holds more streams than the peak number of concurrent
+  // connections of its replica.
+  std::vector<std::vector<std::shared_ptr<OnlineStream>>> stream_pool_;
+
+  // Number of streams per replica that hold encoder state outside the
+  // pool: the attached connections plus the detached sessions awaiting
+  // resumption. Protected by `mutex_`. It feeds the memory-budget
+  // estimate; see --gpu-memory-budget-mb and GetOccupancy().
+  std::vector<int32_t> num_live_streams_;
+
+  // One task queue per affinity worker; see --affinity-workers. A
+  // stream's tasks go to the queue its handle hashes to.
+  struct AffinityWorker {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<AffinityWorker>> affinity_workers_;
+  std::vector<std::thread> affinity_threads_;
+  std::atomic<bool> affinity_stop_{false};
+
+  // It protects `pending_connections_` and `disconnected_connections_`.
+  // It is deliberately separate from `mutex_` (and is only ever taken
+  // with `mutex_` already held or on its own), so message handlers
+  // flagging new audio never wait behind a decoder tick.
+  std::mutex pending_mutex_;
+
+  // Connections that received audio completing a chunk since the last
+  // tick; see MarkPendingAudio(). The decoder loop swaps the list out
+  // and examines only these, instead of scanning every connection.
+  std::vector<std::shared_ptr<Connection>> pending_connections_;
+
+  // Connections whose websocket closed since the last tick; see
+  // OnDisconnect(). The decoder loop recycles or detaches their
+  // streams.
+  std::vector<std::shared_ptr<Connection>> disconnected_connections_;
 
   // Whenever a connection has enough feature frames for decoding, we put
-  // it in this queue
-  std::deque<std::shared_ptr<Connection>> ready_connections_;
+  // it in the queue of its replica
+  std::vector<std::deque<std::shared_ptr<Connection>>> ready_connections_;
+
+  // Ready streams of the bulk class ("priority: bulk"), kept apart from
+  // ready_connections_: Decode() fills a batch from the realtime queue
+  // first and tops it up from this one, so bulk streams get exactly the
+  // capacity the realtime traffic leaves over. A bulk backlog is
+  // expected backpressure (replays simply slow down), so it counts
+  // neither as overload nor as adaptive-beam pressure.
+  std::vector<std::deque<std::shared_ptr<Connection>>> bulk_ready_;
+
+  // Time when each replica's ready queues (realtime and bulk together)
+  // last went from empty to non-empty. We decode a partial batch only
+  // when that entry has waited for more than `config_.max_wait_ms`
+  // milliseconds; otherwise we keep accumulating ready streams until
+  // the batch is full.
+  std::vector<std::chrono::steady_clock::time_point> oldest_ready_time_;
 
   // If we are decoding a stream, we put it in the active_ set so that
   // only one thread can decode a stream at a time.
   std::set<connection_hdl, std::owner_less<connection_hdl>> active_;
+
+  // Serving metrics, exported in Prometheus format on /metrics of the
+  // HTTP port. The metrics themselves live in the process-wide
+  // MetricsRegistry; updating them through these pointers is lock free.
+  Counter *metric_ticks_ = nullptr;            // decoder loop iterations
+  Counter *metric_partial_batches_ = nullptr;  // batches cut by max-wait-ms
+  Gauge *metric_ready_streams_ = nullptr;      // current ready-queue depth
+  Histogram *metric_batch_size_ = nullptr;
+  Histogram *metric_decode_seconds_ = nullptr;
+  Histogram *metric_canary_tick_seconds_ = nullptr;
+  Histogram *metric_ready_queue_depth_ = nullptr;  // ready depth per tick
+  Histogram *metric_batch_occupancy_ = nullptr;  // batch size / max-batch-size
+  Counter *metric_deadline_misses_ = nullptr;  // cycles over the tick deadline
+  Counter *metric_shm_dropped_ = nullptr;  // results dropped from the shm ring
+  // streams decoded speculatively; see --speculative-partial-chunks
+  Counter *metric_speculative_decodes_ = nullptr;
+  // How late each tick fired relative to its slot on the tick grid;
+  // see ScheduleNextTick(). Sustained growth means the loop interval
+  // is too short for the load.
+  Histogram *metric_tick_lateness_seconds_ = nullptr;
+  Counter *metric_ticks_skipped_ = nullptr;  // tick slots overrun entirely
+  // Chunks a stream had buffered when it entered a decode batch; > 1
+  // means the stream had fallen behind its audio.
+  Histogram *metric_backlog_chunks_ = nullptr;
+
+  // CUDA caching allocator stats per GPU, refreshed once per decoder
+  // tick; empty on CPU. They give the ground truth next to the
+  // admission estimate of --gpu-memory-budget-mb.
+  std::vector<Gauge *> metric_cuda_allocated_;
+  std::vector<Gauge *> metric_cuda_reserved_;
+
+  // The shm result ring; see --results-shm-name. The ring is
+  // single-producer, so writes from concurrent Decode() calls are
+  // serialized by `shm_mutex_`.
+  std::unique_ptr<ShmRingWriter> shm_writer_;
+  std::mutex shm_mutex_;
+
+  // The real-time budget of one decode cycle in seconds: the audio
+  // duration of one chunk (OnlineRecognizer::ChunkDurationSeconds()). A
+  // batch that takes longer than this to decode pushes all its streams
+  // behind the incoming audio; such cycles are counted in
+  // metric_deadline_misses_.
+  double tick_deadline_seconds_ = 0;
+
+  // The tick grid slot the loop timer is armed for; see
+  // ScheduleNextTick(). Only touched from the decoder loop.
+  std::chrono::steady_clock::time_point next_tick_time_;
+
+  // The synthetic canary stream and its bookkeeping; see FeedCanary().
+  // Protected by `mutex_`. Used only with --enable-canary-stream.
+  std::shared_ptr<Connection> canary_;
+  int64_t canary_samples_fed_ = 0;
+  std::chrono::steady_clock::time_point canary_ready_time_;
+
+  // Parked streams whose encoder state is still device resident, in
+  // parking order; the front is offloaded first when the set overflows
+  // --max-resident-parked-states. Protected by `mutex_`. Used only
+  // with --offload-parked-states.
+  std::deque<std::shared_ptr<Connection>> resident_parked_;
+  int64_t num_offloaded_states_ = 0;  // protected by mutex_
+  Gauge *metric_offloaded_states_ = nullptr;
+
+  // The current beam size and the hysteresis counters of the adaptive
+  // beam; see --adaptive-beam. Protected by `mutex_`.
+  int32_t current_beam_ = 0;
+  int32_t pressured_ticks_ = 0;
+  int32_t unpressured_ticks_ = 0;
+  Gauge *metric_beam_width_ = nullptr;
+
+  // Sequence number of slow-batch captures; seq % --capture-ring-size
+  // picks the file a capture overwrites. See SaveSlowBatch().
+  std::atomic<int64_t> capture_seq_{0};
+
+  // Time of the last deadline-miss postmortem, in microseconds; used to
+  // rate limit the dumps. See DumpDeadlineMiss().
+  std::atomic<int64_t> last_miss_dump_us_{0};
+
+  // Set by RequestDrain(); checked once per decoder loop iteration.
+  std::atomic<bool> drain_requested_{false};
+
+  // True once the drain snapshot has been written, so a later loop
+  // iteration does not serialize the sessions twice. Protected by
+  // `mutex_`.
+  bool drained_ = false;
+
+  // Sessions whose websocket dropped, keyed by session token and kept
+  // until the stored deadline. A reconnecting client can claim one via
+  // ResumeConnection(); expired entries release their streams into
+  // stream_pool_. Protected by `mutex_`. Used only when
+  // --session-resume-timeout is positive.
+  std::unordered_map<std::string,
+                     std::pair<std::shared_ptr<Connection>,
+                               std::chrono::steady_clock::time_point>>
+      detached_;
 };
 
 struct OnlineWebsocketServerConfig {
@@ -118,6 +940,87 @@ struct OnlineWebsocketServerConfig {
   std::string doc_root = "../sherpa/bin/web";  // root for the http server
   std::string log_file = "./log.txt";
 
+  // If non-empty, path to a PEM file containing the certificate chain
+  // and the private key (the same convention as --certificate of
+  // sherpa/bin/streaming_server.py); the server then terminates TLS
+  // itself instead of requiring a plaintext sidecar. TLS handshakes and
+  // record encryption run on the network threads (io_conn), which are
+  // separate from the decode worker threads (io_work), so crypto never
+  // steals cycles from decoding. Requires building with
+  // -DSHERPA_ENABLE_TLS=ON.
+  std::string certificate;
+
+  // Maximum number of concurrent websocket connections. New connections
+  // beyond it are closed right away with close code try_again_later, so
+  // the sessions that were admitted keep meeting their latency targets.
+  // 0 means no limit. Connections are also rejected, regardless of this
+  // value, while the decoder reports itself overloaded; see
+  // OnlineWebsocketDecoder::GetOccupancy().
+  int32_t max_active_connections = 0;
+
+  // true to compress outgoing result frames with the websocket
+  // permessage-deflate extension on connections whose client negotiated
+  // it. Compression happens inside send(), i.e., on the network
+  // threads (io_conn) that flush the results, so zlib never steals
+  // cycles from the decode worker threads. Long-utterance final results
+  // (tens of KB of JSON) typically shrink 5-10x.
+  bool permessage_deflate = false;
+
+  // See permessage_deflate. Outgoing frames smaller than this many
+  // bytes are sent uncompressed: for a 100-byte partial result the
+  // deflate overhead exceeds the saving.
+  int32_t deflate_min_bytes = 512;
+
+  // If positive, the server pings every connection once per this many
+  // seconds and closes a connection whose previous ping was never
+  // answered, so a dead TCP peer releases its stream (and the decoder
+  // state backing it, which caps stream capacity) within about two
+  // intervals instead of holding it until a kernel timeout fires. The
+  // pings are driven by a hashed timer wheel, one timer for all
+  // connections; see OnlineWebsocketServer::PingTick. 0 disables
+  // keep-alive pings.
+  float ping_interval = 0;
+
+  // If positive, the maximum sustained audio upload rate per
+  // connection, as a multiple of real time: 1 allows recording speed,
+  // 2 allows twice as fast. It is enforced with a per-connection token
+  // bucket checked in O(1) before any sample conversion or feature
+  // work, and a violating connection is closed with close code
+  // policy_violation, so one client blasting audio faster than real
+  // time cannot inflate the queue depth for everyone else. 0 disables
+  // rate limiting.
+  float max_audio_rate = 0;
+
+  // See max_audio_rate. Size of the token bucket in seconds of audio:
+  // a connection may burst this much at once (e.g., audio buffered
+  // during a network blip) before the sustained rate applies.
+  float audio_burst_seconds = 10;
+
+  // If positive, the maximum total audio a connection may send, in
+  // seconds; exceeding it closes the connection with close code
+  // policy_violation. 0 means no limit.
+  float max_audio_duration = 0;
+
+  // true to disable Nagle's algorithm (TCP_NODELAY) on accepted
+  // connections. Partial-result frames are far smaller than one MSS;
+  // with Nagle enabled they can sit in the kernel for up to one
+  // delayed-ACK interval (about 40 ms) -- several times the decoding
+  // latency -- waiting for an ACK that is not coming.
+  bool tcp_nodelay = true;
+
+  // true to bind the listening socket with SO_REUSEPORT, so several
+  // server processes can listen on the same port and the kernel load
+  // balances new connections across them. The server then runs its own
+  // acceptor (the endpoint's built-in one cannot set the option before
+  // binding) and hands accepted sockets to websocketpp.
+  bool reuse_port = false;
+
+  // If not empty, path of a unix domain socket the server additionally
+  // listens on, for colocated clients (e.g., a gateway on the same
+  // host) that would otherwise pay the full TCP stack for a localhost
+  // hop. Any stale socket file is removed at startup.
+  std::string uds_path;
+
   void Register(sherpa::ParseOptions *po);
   void Validate() const;
 };
@@ -137,8 +1040,15 @@ class OnlineWebsocketServer {
 
   void Send(connection_hdl hdl, const std::string &text);
 
+  // Like Send(), but the payload goes out as a binary frame.
+  void SendBinary(connection_hdl hdl, const std::string &data);
+
   bool Contains(connection_hdl hdl) const;
 
+  // Close a websocket connection with given code and reason
+  void Close(connection_hdl hdl, websocketpp::close::status::value code,
+             const std::string &reason);
+
  private:
   void SetupLog();
 
@@ -152,27 +1062,135 @@ class OnlineWebsocketServer {
   // When a HTTP client is connected, it will invoke this method
   void OnHttp(connection_hdl hdl);
 
-  void OnMessage(connection_hdl hdl, server::message_ptr msg);
+  // Shared body of OnHttp(); ConPtr is the connection pointer type of
+  // the plain or the TLS endpoint.
+  template <typename ConPtr>
+  void HandleHttp(ConPtr con);
 
-  // Close a websocket connection with given code and reason
-  void Close(connection_hdl hdl, websocketpp::close::status::value code,
-             const std::string &reason);
+  // MessagePtr is server::message_ptr or tls_server::message_ptr
+  template <typename MessagePtr>
+  void OnMessage(connection_hdl hdl, MessagePtr msg);
+
+  // Return the remote endpoint of the given connection, for logging.
+  std::string GetRemoteEndpoint(connection_hdl hdl);
+
+  // Advance the ping wheel by one slot: ping the connections that are
+  // due, close the ones whose previous ping went unanswered, and
+  // schedule the next tick. See --ping-interval.
+  void PingTick();
+
+  // Invoked by websocketpp when a pong frame arrives; it clears the
+  // connection's pending-ping flag.
+  void OnPong(connection_hdl hdl);
+
+  // Accept loop of the TCP listener the server binds itself; used only
+  // with --reuse-port (the endpoint's built-in acceptor cannot set
+  // SO_REUSEPORT before binding). Accepted sockets are handed to
+  // websocketpp connections, which then run exactly as if the endpoint
+  // had accepted them.
+  void StartTcpAccept();
+
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+  // Accept loop of the unix domain socket listener; see --uds-path. An
+  // accepted descriptor is transplanted into a websocketpp connection:
+  // at the descriptor level a unix stream socket behaves like a TCP
+  // one, so the transport works unchanged.
+  void StartUnixAccept();
+#endif
+
+  // Charge one incoming frame of num_samples samples against the
+  // connection's audio budget (see --max-audio-rate and
+  // --max-audio-duration); O(1). Return false after closing the
+  // connection on a violation -- the caller then drops the frame
+  // before any conversion or feature work.
+  bool CheckAudioBudget(connection_hdl hdl, Connection *c,
+                        int32_t num_samples);
+
+#ifdef SHERPA_ENABLE_TLS
+  // Invoked by websocketpp once per TLS connection; it loads
+  // config_.certificate into a fresh SSL context.
+  std::shared_ptr<asio::ssl::context> OnTlsInit();
+#endif
 
  private:
   OnlineWebsocketServerConfig config_;
   asio::io_context &io_conn_;
   asio::io_context &io_work_;
   HttpServer http_server_;
+
+  // Exactly one of the two endpoints is wired up: `tls_server_` when
+  // --certificate is given (and TLS support is compiled in), `server_`
+  // otherwise.
   server server_;
+#ifdef SHERPA_ENABLE_TLS
+  std::unique_ptr<tls_server> tls_server_;
+#endif
 
   std::ofstream log_;
   sherpa::TeeStream tee_;
 
+  // Content of the --tokens file. Non-empty only with --binary-results;
+  // it is sent to each client right after the connection is opened.
+  std::string tokens_;
+
   OnlineWebsocketDecoder decoder_;
 
-  mutable std::mutex mutex_;
+  // The connection set is sharded by connection-handle hash so that
+  // Send()/Contains() calls for different connections do not serialize
+  // on one global mutex.
+  static constexpr int32_t kNumShards = 64;
+
+  struct ConnectionShard {
+    mutable std::mutex mutex;
+    std::set<connection_hdl, std::owner_less<connection_hdl>> connections;
+  };
+
+  ConnectionShard &GetShard(connection_hdl hdl) const;
+
+  mutable std::array<ConnectionShard, kNumShards> connection_shards_;
+
+  // Number of entries in `connection_shards_`
+  std::atomic<int32_t> num_connections_{0};
+
+  // True once /drain has been hit; OnOpen() then rejects every new
+  // connection so the remaining sessions can be handed off or simply
+  // run out. It is never cleared: a draining server is expected to be
+  // replaced, not revived.
+  std::atomic<bool> draining_{false};
+
+  // Liveness of one pinged connection (see --ping-interval): the flag
+  // is set when a ping goes out and cleared by OnPong(); a ping that
+  // finds it still set means the peer never answered the previous one.
+  struct PingState {
+    std::atomic<bool> pong_pending{false};
+  };
+
+  // The ping timer wheel: one slot is processed per timer tick and a
+  // pinged connection is re-armed into the same slot, so it is visited
+  // once per full revolution, which takes --ping-interval seconds.
+  // Each tick touches only the connections of its slot -- O(1) timers
+  // regardless of the connection count. Entries of closed connections
+  // are dropped lazily when their slot comes around, via the lookup in
+  // `ping_states_`. ping_wheel_, ping_slot_ and ping_states_ are
+  // protected by ping_mutex_.
+  static constexpr int32_t kNumPingSlots = 32;
+
+  std::mutex ping_mutex_;
+  std::map<connection_hdl, std::shared_ptr<PingState>,
+           std::owner_less<connection_hdl>>
+      ping_states_;
+  std::array<std::vector<connection_hdl>, kNumPingSlots> ping_wheel_;
+  int32_t ping_slot_ = 0;
+  std::unique_ptr<asio::steady_timer> ping_timer_;
 
-  std::set<connection_hdl, std::owner_less<connection_hdl>> connections_;
+  // The listeners the server binds itself; see --reuse-port and
+  // --uds-path. Both hand their accepted sockets to websocketpp
+  // connections of the active endpoint.
+  std::unique_ptr<asio::ip::tcp::acceptor> tcp_acceptor_;
+#ifdef ASIO_HAS_LOCAL_SOCKETS
+  std::unique_ptr<asio::local::stream_protocol::acceptor> uds_acceptor_;
+  std::unique_ptr<asio::local::stream_protocol::socket> uds_socket_;
+#endif
 };
 
 }  // namespace sherpa
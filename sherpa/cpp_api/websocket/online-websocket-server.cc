@@ -2,9 +2,12 @@
 //
 // Copyright (c)  2022  Xiaomi Corporation
 
+#include <thread>  // NOLINT
+
 #include "asio.hpp"
 #include "sherpa/cpp_api/websocket/online-websocket-server-impl.h"
 #include "sherpa/csrc/log.h"
+#include "sherpa/csrc/thread-affinity.h"
 #include "torch/all.h"
 
 static constexpr const char *kUsageMessage = R"(
@@ -46,6 +49,18 @@ int32_t main(int32_t argc, char *argv[]) {
   // size of the thread pool for neural network computation and decoding
   int32_t num_work_threads = 5;
 
+  // If non-zero, a single shared thread pool replaces the fixed
+  // io/work split
+  int32_t num_threads = 0;
+
+  // If >= 0, pin all server threads to the CPUs of this NUMA node
+  int32_t numa_node = -1;
+
+  // CPU lists overriding --numa-node for the I/O and the work pool
+  // separately, e.g., "0-7,16-23"
+  std::string io_cpu_affinity;
+  std::string work_cpu_affinity;
+
   po.Register("num-io-threads", &num_io_threads,
               "Number of threads to use for network connections.");
 
@@ -53,6 +68,30 @@ int32_t main(int32_t argc, char *argv[]) {
               "Number of threads to use for neural network "
               "computation and decoding.");
 
+  po.Register("num-threads", &num_threads,
+              "If greater than 0, use one shared thread pool of this size "
+              "for both network I/O and decoding, so threads can flex "
+              "between the two under bursty traffic. If -1, size the "
+              "shared pool by the number of CPU cores. If 0 (default), "
+              "use the fixed --num-io-threads/--num-work-threads split.");
+
+  po.Register("numa-node", &numa_node,
+              "If >= 0, pin every server thread to the CPUs of this NUMA "
+              "node. On multi-socket hosts this keeps the threads and the "
+              "memory they first touch on one node, avoiding cross-node "
+              "traffic. Refined per pool by --io-cpu-affinity and "
+              "--work-cpu-affinity.");
+
+  po.Register("io-cpu-affinity", &io_cpu_affinity,
+              "If non-empty, a CPU list, e.g., 0-7,16-23, to pin the "
+              "network I/O threads to; pick the CPUs of the node the NIC "
+              "is attached to. Overrides --numa-node for the I/O pool.");
+
+  po.Register("work-cpu-affinity", &work_cpu_affinity,
+              "If non-empty, a CPU list, e.g., 8-15,24-31, to pin the "
+              "decoding threads to; pick the CPUs of the node the GPU is "
+              "attached to. Overrides --numa-node for the work pool.");
+
   po.Register("port", &port, "The port on which the server will listen.");
 
   config.Register(&po);
@@ -72,29 +111,80 @@ int32_t main(int32_t argc, char *argv[]) {
 
   config.Validate();
 
-  asio::io_context io_conn;  // for network connections
-  asio::io_context io_work;  // for neural network and decoding
+  asio::io_context io_shared;  // used when --num-threads is non-zero
+  asio::io_context io_conn;    // for network connections
+  asio::io_context io_work;    // for neural network and decoding
+
+  // With a shared pool, both the connection handlers and the decoding
+  // tasks are posted to the same io_context, so any thread of the pool
+  // picks up whatever work is pending: under bursty traffic the pool is
+  // not partitioned into idle work threads and saturated I/O threads.
+  bool use_shared_pool = num_threads != 0;
+  if (use_shared_pool && num_threads < 0) {
+    num_threads = std::max<int32_t>(std::thread::hardware_concurrency(), 2);
+  }
+
+  std::vector<int32_t> io_cpus = sherpa::ParseCpuList(io_cpu_affinity);
+  std::vector<int32_t> work_cpus = sherpa::ParseCpuList(work_cpu_affinity);
+  if (numa_node >= 0) {
+    auto node_cpus = sherpa::CpusOfNumaNode(numa_node);
+    if (io_cpus.empty()) {
+      io_cpus = node_cpus;
+    }
+    if (work_cpus.empty()) {
+      work_cpus = node_cpus;
+    }
+  }
 
-  sherpa::OnlineWebsocketServer server(io_conn, io_work, config);
+  // Pin the main thread before the server is created: the model and
+  // the buffers it allocates are first touched here, so the kernel's
+  // first-touch policy places them on the decode node. The main thread
+  // is re-pinned to the I/O CPUs below, before it joins the I/O pool.
+  sherpa::SetCurrentThreadAffinity(work_cpus);
+
+  sherpa::OnlineWebsocketServer server(
+      use_shared_pool ? io_shared : io_conn,
+      use_shared_pool ? io_shared : io_work, config);
   server.Run(port);
 
   SHERPA_LOG(INFO) << "Listening on: " << port << "\n";
-  // SHERPA_LOG(INFO) << "Number of I/O threads: " << num_io_threads << "\n";
-  SHERPA_LOG(INFO) << "Number of work threads: " << num_work_threads << "\n";
+  if (use_shared_pool) {
+    SHERPA_LOG(INFO) << "Number of shared threads: " << num_threads << "\n";
+  } else {
+    // SHERPA_LOG(INFO) << "Number of I/O threads: " << num_io_threads << "\n";
+    SHERPA_LOG(INFO) << "Number of work threads: " << num_work_threads << "\n";
+  }
 
   // give some work to do for the io_work pool
   auto work_guard = asio::make_work_guard(io_work);
 
   std::vector<std::thread> io_threads;
+  std::vector<std::thread> work_threads;
 
-  // decrement since the main thread is also used for network communications
-  for (int32_t i = 0; i < num_io_threads - 1; ++i) {
-    io_threads.emplace_back([&io_conn]() { io_conn.run(); });
-  }
+  if (use_shared_pool) {
+    // decrement since the main thread also runs the shared pool below
+    for (int32_t i = 0; i < num_threads - 1; ++i) {
+      work_threads.emplace_back([&io_shared, &work_cpus]() {
+        sherpa::SetCurrentThreadAffinity(work_cpus);
+        io_shared.run();
+      });
+    }
+  } else {
+    // decrement since the main thread is also used for network
+    // communications
+    for (int32_t i = 0; i < num_io_threads - 1; ++i) {
+      io_threads.emplace_back([&io_conn, &io_cpus]() {
+        sherpa::SetCurrentThreadAffinity(io_cpus);
+        io_conn.run();
+      });
+    }
 
-  std::vector<std::thread> work_threads;
-  for (int32_t i = 0; i < num_work_threads; ++i) {
-    work_threads.emplace_back([&io_work]() { io_work.run(); });
+    for (int32_t i = 0; i < num_work_threads; ++i) {
+      work_threads.emplace_back([&io_work, &work_cpus]() {
+        sherpa::SetCurrentThreadAffinity(work_cpus);
+        io_work.run();
+      });
+    }
   }
 
   // Print a message telling users how to access the HTTP service
@@ -118,7 +208,13 @@ int32_t main(int32_t argc, char *argv[]) {
 #endif
   SHERPA_LOG(INFO) << os.str();
 
-  io_conn.run();
+  if (use_shared_pool) {
+    io_shared.run();
+  } else {
+    // The main thread handles network connections from here on.
+    sherpa::SetCurrentThreadAffinity(io_cpus);
+    io_conn.run();
+  }
 
   for (auto &t : io_threads) {
     t.join();
@@ -0,0 +1,106 @@
+// sherpa/cpp_api/websocket/opus-stream-decoder.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/cpp_api/websocket/opus-stream-decoder.h"
+
+#include <memory>
+
+#include "sherpa/csrc/log.h"
+
+#ifdef SHERPA_ENABLE_OPUS
+#include "opus/opus.h"
+#endif
+
+namespace sherpa {
+
+OpusStreamDecoder::OpusStreamDecoder(OpusDecoderPool *pool, void *dec)
+    : pool_(pool), dec_(dec) {}
+
+OpusStreamDecoder::~OpusStreamDecoder() { pool_->Release(dec_); }
+
+#ifdef SHERPA_ENABLE_OPUS
+
+int32_t OpusStreamDecoder::Decode(const uint8_t *packet, int32_t num_bytes,
+                                  float *out, int32_t max_samples) {
+  int32_t n = opus_decode_float(reinterpret_cast<OpusDecoder *>(dec_), packet,
+                                num_bytes, out, max_samples,
+                                /*decode_fec*/ 0);
+  if (n < 0) {
+    SHERPA_LOG(WARNING) << "Failed to decode an Opus packet of " << num_bytes
+                        << " bytes: " << opus_strerror(n);
+    return -1;
+  }
+  return n;
+}
+
+OpusDecoderPool::OpusDecoderPool(int32_t sample_rate)
+    : sample_rate_(sample_rate) {
+  SHERPA_CHECK(sample_rate == 8000 || sample_rate == 12000 ||
+               sample_rate == 16000 || sample_rate == 24000 ||
+               sample_rate == 48000)
+      << "Opus cannot decode at " << sample_rate << " Hz";
+}
+
+OpusDecoderPool::~OpusDecoderPool() {
+  for (auto dec : free_) {
+    opus_decoder_destroy(reinterpret_cast<OpusDecoder *>(dec));
+  }
+}
+
+bool OpusDecoderPool::Available() { return true; }
+
+std::unique_ptr<OpusStreamDecoder> OpusDecoderPool::Acquire() {
+  void *dec = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_.empty()) {
+      dec = free_.back();
+      free_.pop_back();
+    }
+  }
+
+  if (dec == nullptr) {
+    int32_t err = OPUS_OK;
+    dec = opus_decoder_create(sample_rate_, /*channels*/ 1, &err);
+    SHERPA_CHECK_EQ(err, OPUS_OK)
+        << "Failed to create an Opus decoder: " << opus_strerror(err);
+  }
+
+  return std::unique_ptr<OpusStreamDecoder>(new OpusStreamDecoder(this, dec));
+}
+
+void OpusDecoderPool::Release(void *dec) {
+  opus_decoder_ctl(reinterpret_cast<OpusDecoder *>(dec), OPUS_RESET_STATE);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  free_.push_back(dec);
+}
+
+#else
+
+int32_t OpusStreamDecoder::Decode(const uint8_t * /*packet*/,
+                                  int32_t /*num_bytes*/, float * /*out*/,
+                                  int32_t /*max_samples*/) {
+  SHERPA_LOG(FATAL) << "This sherpa was not built with Opus support";
+  return -1;
+}
+
+OpusDecoderPool::OpusDecoderPool(int32_t sample_rate)
+    : sample_rate_(sample_rate) {}
+
+OpusDecoderPool::~OpusDecoderPool() = default;
+
+bool OpusDecoderPool::Available() { return false; }
+
+std::unique_ptr<OpusStreamDecoder> OpusDecoderPool::Acquire() {
+  SHERPA_LOG(FATAL) << "This sherpa was not built with Opus support. "
+                       "Rebuild with -DSHERPA_ENABLE_OPUS=ON";
+  return nullptr;
+}
+
+void OpusDecoderPool::Release(void * /*dec*/) {}
+
+#endif  // SHERPA_ENABLE_OPUS
+
+}  // namespace sherpa
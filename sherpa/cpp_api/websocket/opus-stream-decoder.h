@@ -0,0 +1,91 @@
+// sherpa/cpp_api/websocket/opus-stream-decoder.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_CPP_API_WEBSOCKET_OPUS_STREAM_DECODER_H_
+#define SHERPA_CPP_API_WEBSOCKET_OPUS_STREAM_DECODER_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
+
+namespace sherpa {
+
+class OpusDecoderPool;
+
+/** One stateful Opus decoding stream borrowed from an OpusDecoderPool.
+ *
+ * Opus decoding state is per audio stream, so a connection keeps its
+ * decoder for as long as it sends compressed audio. Destroying this
+ * object resets the underlying decoder and returns it to the pool.
+ */
+class OpusStreamDecoder {
+ public:
+  ~OpusStreamDecoder();
+
+  OpusStreamDecoder(const OpusStreamDecoder &) = delete;
+  OpusStreamDecoder &operator=(const OpusStreamDecoder &) = delete;
+
+  /** Decode one Opus packet into mono float samples in [-1, 1].
+   *
+   * @param packet  The packet, exactly as produced by the encoder.
+   * @param num_bytes  Size of the packet in bytes.
+   * @param out  Decoded samples are written here.
+   * @param max_samples  Capacity of `out` in samples.
+   *
+   * @return Return the number of decoded samples on success; return -1
+   *         if the packet is corrupt or does not fit into `out`.
+   */
+  int32_t Decode(const uint8_t *packet, int32_t num_bytes, float *out,
+                 int32_t max_samples);
+
+ private:
+  friend class OpusDecoderPool;
+  OpusStreamDecoder(OpusDecoderPool *pool, void *dec);
+
+  OpusDecoderPool *pool_;  // Not owned
+  void *dec_;              // An OpusDecoder*, owned by the pool
+};
+
+/** A pool of Opus decoders shared by all connections of a server.
+ *
+ * Creating an Opus decoder allocates and is not free; connections
+ * borrow one when they negotiate the opus codec and return it when
+ * they are done, so steady-state traffic creates no decoders.
+ *
+ * The pool is thread-safe. It requires a sherpa build with
+ * -DSHERPA_ENABLE_OPUS=ON; without it, Available() returns false and
+ * Acquire() dies.
+ */
+class OpusDecoderPool {
+ public:
+  /**
+   * @param sample_rate Sample rate to decode at; it must match the one
+   *        the recognizer expects and be one of the rates Opus
+   *        supports: 8000, 12000, 16000, 24000, or 48000 Hz.
+   */
+  explicit OpusDecoderPool(int32_t sample_rate);
+  ~OpusDecoderPool();
+
+  // True if sherpa was built with -DSHERPA_ENABLE_OPUS=ON.
+  static bool Available();
+
+  // Borrow a decoder, creating one only if the free list is empty.
+  std::unique_ptr<OpusStreamDecoder> Acquire();
+
+ private:
+  friend class OpusStreamDecoder;
+
+  // Reset the decoder state and put it back on the free list. Called by
+  // ~OpusStreamDecoder().
+  void Release(void *dec);
+
+  int32_t sample_rate_;
+
+  std::mutex mutex_;
+  std::vector<void *> free_;  // OpusDecoder*, owned
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CPP_API_WEBSOCKET_OPUS_STREAM_DECODER_H_
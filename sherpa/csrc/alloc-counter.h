@@ -0,0 +1,35 @@
+// sherpa/csrc/alloc-counter.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_ALLOC_COUNTER_H_
+#define SHERPA_CSRC_ALLOC_COUNTER_H_
+
+#include <cstdint>
+
+namespace sherpa {
+
+/** Per-thread counters of global-allocator traffic.
+ *
+ * They are fed by counting overrides of the global operator new/delete;
+ * the overrides live in sherpa-bench.cc, so only the benchmark binary
+ * pays for the interception and the library itself is never perturbed.
+ * In binaries without the overrides the counters simply stay at zero.
+ *
+ * To measure a region, snapshot the counters before it and subtract the
+ * snapshot from their values afterwards.
+ */
+struct AllocCounters {
+  int64_t num_allocations = 0;
+  int64_t num_bytes = 0;
+};
+
+/// Return the counters of the calling thread.
+inline AllocCounters &ThreadAllocCounters() {
+  static thread_local AllocCounters counters;
+  return counters;
+}
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_ALLOC_COUNTER_H_
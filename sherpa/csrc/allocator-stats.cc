@@ -0,0 +1,147 @@
+// sherpa/csrc/allocator-stats.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/allocator-stats.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "sherpa/csrc/metrics.h"
+
+namespace sherpa {
+
+namespace {
+
+// C interfaces of the two allocators. We look the symbols up with
+// dlsym() instead of including vendor headers, so sherpa builds the
+// same way whether or not tcmalloc/jemalloc development packages are
+// installed; whichever allocator is actually in the process answers.
+using TcGetNumericProperty = int (*)(const char *property, size_t *value);
+using JeMallctl = int (*)(const char *name, void *oldp, size_t *oldlenp,
+                          void *newp, size_t newlen);
+
+struct AllocatorProbe {
+  const char *name = "glibc";
+  TcGetNumericProperty tc_get = nullptr;
+  JeMallctl je_mallctl = nullptr;
+};
+
+const AllocatorProbe &Probe() {
+  static const AllocatorProbe probe = []() {
+    AllocatorProbe p;
+#ifndef _WIN32
+    void *sym = dlsym(RTLD_DEFAULT, "MallocExtension_GetNumericProperty");
+    if (sym != nullptr) {
+      p.name = "tcmalloc";
+      p.tc_get = reinterpret_cast<TcGetNumericProperty>(sym);
+      return p;
+    }
+
+    sym = dlsym(RTLD_DEFAULT, "mallctl");
+    if (sym != nullptr) {
+      p.name = "jemalloc";
+      p.je_mallctl = reinterpret_cast<JeMallctl>(sym);
+      return p;
+    }
+#endif
+    return p;
+  }();
+  return probe;
+}
+
+}  // namespace
+
+const char *AllocatorName() { return Probe().name; }
+
+void UpdateAllocatorMetrics() {
+  static Gauge *allocated = MetricsRegistry::Get().GetGauge(
+      "sherpa_malloc_allocated_bytes",
+      "Bytes currently allocated by the application, as reported by the "
+      "malloc implementation (see sherpa-*-websocket-server startup log "
+      "for which one is in use)");
+  static Gauge *heap = MetricsRegistry::Get().GetGauge(
+      "sherpa_malloc_heap_bytes",
+      "Bytes of heap the malloc implementation obtained from the OS");
+
+  const AllocatorProbe &probe = Probe();
+
+  if (probe.tc_get != nullptr) {
+    size_t value = 0;
+    if (probe.tc_get("generic.current_allocated_bytes", &value) != 0) {
+      allocated->Set(static_cast<int64_t>(value));
+    }
+    if (probe.tc_get("generic.heap_size", &value) != 0) {
+      heap->Set(static_cast<int64_t>(value));
+    }
+    return;
+  }
+
+  if (probe.je_mallctl != nullptr) {
+    // jemalloc caches its statistics; bumping the epoch refreshes them.
+    uint64_t epoch = 1;
+    size_t len = sizeof(epoch);
+    probe.je_mallctl("epoch", &epoch, &len, &epoch, sizeof(epoch));
+
+    size_t value = 0;
+    len = sizeof(value);
+    if (probe.je_mallctl("stats.allocated", &value, &len, nullptr, 0) == 0) {
+      allocated->Set(static_cast<int64_t>(value));
+    }
+    len = sizeof(value);
+    if (probe.je_mallctl("stats.mapped", &value, &len, nullptr, 0) == 0) {
+      heap->Set(static_cast<int64_t>(value));
+    }
+    return;
+  }
+
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 33)
+  struct mallinfo2 mi = mallinfo2();
+  allocated->Set(static_cast<int64_t>(mi.uordblks));
+  heap->Set(static_cast<int64_t>(mi.arena + mi.hblkhd));
+#endif
+#endif
+}
+
+int64_t AllocatedBytes() {
+  const AllocatorProbe &probe = Probe();
+
+  if (probe.tc_get != nullptr) {
+    size_t value = 0;
+    if (probe.tc_get("generic.current_allocated_bytes", &value) != 0) {
+      return static_cast<int64_t>(value);
+    }
+    return -1;
+  }
+
+  if (probe.je_mallctl != nullptr) {
+    uint64_t epoch = 1;
+    size_t len = sizeof(epoch);
+    probe.je_mallctl("epoch", &epoch, &len, &epoch, sizeof(epoch));
+
+    size_t value = 0;
+    len = sizeof(value);
+    if (probe.je_mallctl("stats.allocated", &value, &len, nullptr, 0) == 0) {
+      return static_cast<int64_t>(value);
+    }
+    return -1;
+  }
+
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 33)
+  return static_cast<int64_t>(mallinfo2().uordblks);
+#endif
+#endif
+  return -1;
+}
+
+}  // namespace sherpa
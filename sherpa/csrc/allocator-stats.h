@@ -0,0 +1,46 @@
+// sherpa/csrc/allocator-stats.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_ALLOCATOR_STATS_H_
+#define SHERPA_CSRC_ALLOCATOR_STATS_H_
+
+#include <cstdint>
+
+namespace sherpa {
+
+/** Name of the malloc implementation this process is running with:
+ * "tcmalloc", "jemalloc" or "glibc".
+ *
+ * The allocator is detected at runtime by probing for its exported
+ * symbols, so the answer is correct no matter whether the allocator was
+ * linked in through SHERPA_MALLOC or injected with LD_PRELOAD. Detected
+ * once on first use.
+ */
+const char *AllocatorName();
+
+/** Refresh the sherpa_malloc_* gauges from the malloc implementation.
+ *
+ * Exported gauges (see AllocatorName() for how the source is picked):
+ *
+ *   - sherpa_malloc_allocated_bytes: bytes currently handed out to the
+ *     application.
+ *   - sherpa_malloc_heap_bytes: bytes the allocator obtained from the
+ *     OS for the heap.
+ *
+ * Meant to be called from the /metrics handler so every scrape sees
+ * current numbers; querying the allocator is cheap but not free, so it
+ * is not done on a timer.
+ */
+void UpdateAllocatorMetrics();
+
+/** Bytes currently handed out to the application by the malloc
+ * implementation, or -1 when it cannot report them (e.g., pre-2.33
+ * glibc). Cheap enough to sample around a decode tick; the delta of
+ * two samples is the net allocation of the work in between.
+ */
+int64_t AllocatedBytes();
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_ALLOCATOR_STATS_H_
@@ -0,0 +1,111 @@
+// sherpa/csrc/context-graph.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/context-graph.h"
+
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "sherpa/csrc/log.h"
+
+namespace sherpa {
+
+ContextGraph::ContextGraph(const std::vector<std::vector<int32_t>> &phrases,
+                           float context_score)
+    : context_score_(context_score) {
+  states_.push_back({/*node_score*/ 0, /*output_score*/ 0, /*is_end*/ false,
+                     /*fail*/ 0,
+                     {}});
+
+  for (const auto &phrase : phrases) {
+    SHERPA_CHECK(!phrase.empty()) << "Empty context phrase";
+
+    int32_t cur = 0;
+    for (int32_t token : phrase) {
+      auto it = states_[cur].next.find(token);
+      if (it != states_[cur].next.end()) {
+        cur = it->second;
+        continue;
+      }
+
+      int32_t id = static_cast<int32_t>(states_.size());
+      states_[cur].next[token] = id;
+      states_.push_back({states_[cur].node_score + context_score,
+                         /*output_score*/ 0, /*is_end*/ false, /*fail*/ 0,
+                         {}});
+      cur = id;
+    }
+    states_[cur].is_end = true;
+  }
+
+  // Breadth-first traversal to fill in the fail links and output
+  // scores; a state's fail link is shallower than the state itself, so
+  // it is always finalized first.
+  std::deque<int32_t> queue;
+  for (const auto &p : states_[0].next) {
+    queue.push_back(p.second);
+  }
+
+  while (!queue.empty()) {
+    int32_t u = queue.front();
+    queue.pop_front();
+
+    for (const auto &p : states_[u].next) {
+      int32_t token = p.first;
+      int32_t c = p.second;
+
+      int32_t f = states_[u].fail;
+      while (f != 0 && states_[f].next.count(token) == 0) {
+        f = states_[f].fail;
+      }
+      auto it = states_[f].next.find(token);
+      states_[c].fail = (it != states_[f].next.end()) ? it->second : 0;
+
+      const State &fs = states_[states_[c].fail];
+      states_[c].output_score =
+          fs.output_score + (fs.is_end ? fs.node_score : 0);
+
+      queue.push_back(c);
+    }
+  }
+}
+
+std::pair<int32_t, float> ContextGraph::ForwardOneStep(int32_t state,
+                                                       int32_t token) const {
+  int32_t node;
+  float score;
+
+  auto it = states_[state].next.find(token);
+  if (it != states_[state].next.end()) {
+    node = it->second;
+    score = context_score_;
+  } else {
+    int32_t u = states_[state].fail;
+    while (u != 0 && states_[u].next.count(token) == 0) {
+      u = states_[u].fail;
+    }
+    auto it2 = states_[u].next.find(token);
+    node = (it2 != states_[u].next.end()) ? it2->second : 0;
+
+    // The bonus of the dead prefix is taken back; what survives is the
+    // score of the suffix that is still a partial match.
+    score = states_[node].node_score - states_[state].node_score;
+  }
+
+  score += states_[node].output_score;
+
+  if (states_[node].is_end) {
+    // A completed phrase keeps its boost; matching restarts at the root.
+    node = 0;
+  }
+
+  return {node, score};
+}
+
+float ContextGraph::FinalizeScore(int32_t state) const {
+  return -states_[state].node_score;
+}
+
+}  // namespace sherpa
@@ -0,0 +1,87 @@
+// sherpa/csrc/context-graph.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_CONTEXT_GRAPH_H_
+#define SHERPA_CSRC_CONTEXT_GRAPH_H_
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sherpa {
+
+/** An Aho-Corasick automaton over token IDs for contextual biasing.
+ *
+ * A list of context phrases (e.g., customer names as token sequences)
+ * is compiled once into this automaton; during beam search each
+ * hypothesis carries a single automaton-state ID and every predicted
+ * token costs one ForwardOneStep() call, so biasing is O(1) per token
+ * regardless of the number of phrases.
+ *
+ * Scoring: every token that extends a partial phrase match earns
+ * +context_score in log space. When a token breaks the match, the
+ * automaton falls back to the longest suffix that is still a partial
+ * match and the bonus of the dead prefix is taken back, so only
+ * completed phrases keep their full boost permanently. A phrase that
+ * ends on a proper suffix of the current match (via the output links)
+ * earns its full score when its last token arrives.
+ */
+class ContextGraph {
+ public:
+  /**
+   * @param phrases  The context phrases, each a non-empty sequence of
+   *                 token IDs.
+   * @param context_score  Per-token bonus in log space; see the class
+   *                       comment.
+   */
+  ContextGraph(const std::vector<std::vector<int32_t>> &phrases,
+               float context_score);
+
+  /** Advance one token.
+   *
+   * @param state  The current state ID; 0 (the root) for a hypothesis
+   *               that is not inside any phrase.
+   * @param token  The predicted token.
+   *
+   * @return Return a pair (next_state, score); score is the biasing
+   *         bonus (or claw-back, when negative) to add to the
+   *         hypothesis log-prob.
+   */
+  std::pair<int32_t, float> ForwardOneStep(int32_t state,
+                                           int32_t token) const;
+
+  /** Return the score adjustment for ending decoding in the given
+   * state: the bonus of an unfinished partial match is taken back.
+   */
+  float FinalizeScore(int32_t state) const;
+
+  int32_t NumStates() const { return static_cast<int32_t>(states_.size()); }
+
+ private:
+  struct State {
+    // Sum of per-token scores along the path from the root.
+    float node_score;
+
+    // Total score of phrases ending on a proper suffix of this state's
+    // path; added when this state is reached.
+    float output_score;
+
+    // True if a phrase ends exactly at this state.
+    bool is_end;
+
+    // The longest proper suffix of this state's path that is also a
+    // path in the trie.
+    int32_t fail;
+
+    std::unordered_map<int32_t, int32_t> next;
+  };
+
+  std::vector<State> states_;
+  float context_score_;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_CONTEXT_GRAPH_H_
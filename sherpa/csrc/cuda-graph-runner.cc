@@ -0,0 +1,124 @@
+// sherpa/csrc/cuda-graph-runner.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/cuda-graph-runner.h"
+
+#include <map>
+#include <mutex>  // NOLINT
+#include <utility>
+
+#include "sherpa/csrc/log.h"
+
+#ifdef SHERPA_WITH_CUDA
+#include "ATen/cuda/CUDAGraph.h"
+#include "c10/cuda/CUDAGuard.h"
+#include "c10/cuda/CUDAStream.h"
+#endif
+
+namespace sherpa {
+
+#ifdef SHERPA_WITH_CUDA
+
+class CudaGraphRunner::CudaGraphRunnerImpl {
+ public:
+  explicit CudaGraphRunnerImpl(Forward forward)
+      : forward_(std::move(forward)) {}
+
+  std::vector<torch::Tensor> Run(int32_t batch_size,
+                                 const std::vector<torch::Tensor> &inputs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = graphs_.find(batch_size);
+    if (it == graphs_.end()) {
+      it = Capture(batch_size, inputs);
+    }
+    Entry &entry = it->second;
+
+    SHERPA_CHECK_EQ(inputs.size(), entry.inputs.size());
+    for (size_t i = 0; i != inputs.size(); ++i) {
+      entry.inputs[i].copy_(inputs[i], /*non_blocking*/ true);
+    }
+
+    entry.graph->replay();
+
+    // Clone the outputs: the graph-owned buffers are overwritten by the
+    // next replay.
+    std::vector<torch::Tensor> ans;
+    ans.reserve(entry.outputs.size());
+    for (const auto &t : entry.outputs) {
+      ans.push_back(t.clone());
+    }
+    return ans;
+  }
+
+ private:
+  struct Entry {
+    std::unique_ptr<at::cuda::CUDAGraph> graph;
+    std::vector<torch::Tensor> inputs;
+    std::vector<torch::Tensor> outputs;
+  };
+
+  std::map<int32_t, Entry>::iterator Capture(
+      int32_t batch_size, const std::vector<torch::Tensor> &inputs) {
+    Entry entry;
+    entry.inputs.reserve(inputs.size());
+    for (const auto &t : inputs) {
+      entry.inputs.push_back(t.clone());
+    }
+
+    // Capture is not allowed on the default stream.
+    at::cuda::CUDAStream stream = at::cuda::getStreamFromPool();
+    at::cuda::CUDAStreamGuard guard(stream);
+
+    // Warm up: let the TorchScript profiling/optimization passes finish
+    // and the caching allocator reach steady state, so that none of them
+    // runs during capture.
+    for (int32_t i = 0; i != 3; ++i) {
+      forward_(entry.inputs);
+    }
+    stream.synchronize();
+
+    entry.graph = std::make_unique<at::cuda::CUDAGraph>();
+    entry.graph->capture_begin();
+    entry.outputs = forward_(entry.inputs);
+    entry.graph->capture_end();
+
+    SHERPA_LOG(INFO) << "Captured CUDA graph for batch size " << batch_size;
+
+    return graphs_.emplace(batch_size, std::move(entry)).first;
+  }
+
+  Forward forward_;
+  std::mutex mutex_;
+  std::map<int32_t, Entry> graphs_;
+};
+
+#else
+
+class CudaGraphRunner::CudaGraphRunnerImpl {
+ public:
+  explicit CudaGraphRunnerImpl(Forward /*forward*/) {
+    SHERPA_LOG(FATAL)
+        << "CUDA graphs require a version of sherpa built with CUDA support";
+  }
+
+  std::vector<torch::Tensor> Run(int32_t /*batch_size*/,
+                                 const std::vector<torch::Tensor> &inputs) {
+    return inputs;  // unreachable; the constructor aborts
+  }
+};
+
+#endif  // SHERPA_WITH_CUDA
+
+CudaGraphRunner::CudaGraphRunner(Forward forward)
+    : impl_(std::make_unique<CudaGraphRunnerImpl>(std::move(forward))) {}
+
+CudaGraphRunner::~CudaGraphRunner() = default;
+
+std::vector<torch::Tensor> CudaGraphRunner::Run(
+    int32_t batch_size, const std::vector<torch::Tensor> &inputs) {
+  return impl_->Run(batch_size, inputs);
+}
+
+}  // namespace sherpa
@@ -0,0 +1,78 @@
+// sherpa/csrc/cuda-graph-runner.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_CSRC_CUDA_GRAPH_RUNNER_H_
+#define SHERPA_CSRC_CUDA_GRAPH_RUNNER_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "torch/script.h"
+
+namespace sherpa {
+
+/** Capture a fixed-shape computation into a CUDA Graph and replay it.
+ *
+ * At steady state the streaming recognizer calls the encoder with
+ * identical tensor shapes on every tick: the chunk size is fixed and the
+ * batch size only takes a handful of values. For small batches the CPU
+ * cost of launching the several hundred kernels of one encoder forward
+ * dominates the tick. Replaying a captured graph issues all of them with
+ * a single launch.
+ *
+ * One graph is captured lazily per batch size and cached. The runner owns
+ * static input and output buffers for each graph; Run() copies the caller
+ * tensors into the input buffers, replays the graph and returns clones of
+ * the output buffers, since the buffers themselves are overwritten by the
+ * next replay. Calls are serialized with an internal mutex, so the runner
+ * is safe to share between the worker threads used with
+ * --num-cuda-streams.
+ *
+ * The wrapped computation must consist of CUDA kernels only and must not
+ * synchronize with the host; this holds for the TorchScript encoders of
+ * the streaming Zipformer models.
+ */
+class CudaGraphRunner {
+ public:
+  /** The computation to capture.
+   *
+   * @param inputs Flattened input tensors. All of them must be on the
+   *               CUDA device.
+   * @return Return the flattened output tensors.
+   */
+  using Forward = std::function<std::vector<torch::Tensor>(
+      const std::vector<torch::Tensor> &inputs)>;
+
+  /** Constructor.
+   *
+   * It aborts if sherpa was built without CUDA support.
+   *
+   * @param forward The computation to capture. It is invoked a few times
+   *                for warm up and once for capture the first time a
+   *                batch size is seen, and never again afterwards.
+   */
+  explicit CudaGraphRunner(Forward forward);
+  ~CudaGraphRunner();
+
+  /** Run the computation, capturing a graph for this batch size on first
+   * use.
+   *
+   * @param batch_size  The key of the graph cache. Inputs passed for the
+   *                    same batch size must always have the same shapes,
+   *                    dtypes and devices.
+   * @param inputs  Flattened input tensors.
+   * @return Return the flattened output tensors. They do not alias any
+   *         graph-owned memory.
+   */
+  std::vector<torch::Tensor> Run(int32_t batch_size,
+                                 const std::vector<torch::Tensor> &inputs);
+
+ private:
+  class CudaGraphRunnerImpl;
+  std::unique_ptr<CudaGraphRunnerImpl> impl_;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_CUDA_GRAPH_RUNNER_H_
@@ -0,0 +1,94 @@
+// sherpa/csrc/decoder-output-cache.cc
+//
+// Copyright (c)  2022  Xiaomi Corporation
+#include "sherpa/csrc/decoder-output-cache.h"
+
+#include <mutex>  // NOLINT
+#include <utility>
+#include <vector>
+
+namespace sherpa {
+
+// Hash of the context tokens of one decoder-input row. It uses the same
+// rolling hash as Hypothesis::Key(); collisions are negligible for
+// 64-bit keys.
+static uint64_t ContextKey(const int64_t *tokens, int32_t context_size) {
+  uint64_t key = 0;
+  for (int32_t i = 0; i != context_size; ++i) {
+    key = key * 6364136223846793005ULL + static_cast<uint64_t>(tokens[i]) + 1;
+  }
+  return key;
+}
+
+torch::Tensor DecoderOutputCache::Get(
+    torch::Tensor decoder_input,
+    const std::function<torch::Tensor(torch::Tensor)> &run_decoder) {
+  int32_t num = decoder_input.size(0);
+  int32_t context_size = decoder_input.size(1);
+  const int64_t *p = decoder_input.data_ptr<int64_t>();
+
+  std::vector<uint64_t> keys(num);
+  std::vector<torch::Tensor> rows(num);
+  std::vector<int64_t> miss_indexes;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int32_t i = 0; i != num; ++i) {
+      keys[i] = ContextKey(p + i * context_size, context_size);
+      ++num_queries_;
+
+      auto value = Find(keys[i]);
+      if (value.defined()) {
+        ++num_hits_;
+        rows[i] = value;
+      } else {
+        miss_indexes.push_back(i);
+      }
+    }
+  }
+
+  if (!miss_indexes.empty()) {
+    auto miss_index = torch::tensor(miss_indexes, torch::kLong);
+    auto miss_out = run_decoder(decoder_input.index_select(0, miss_index));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int32_t j = 0; j != static_cast<int32_t>(miss_indexes.size()); ++j) {
+      int32_t i = miss_indexes[j];
+      rows[i] = miss_out.index({j});
+      // Note: If the same context misses more than once in this batch,
+      // the second Insert() just refreshes the entry.
+      Insert(keys[i], rows[i]);
+    }
+  }
+
+  return torch::stack(rows, /*dim*/ 0);
+}
+
+torch::Tensor DecoderOutputCache::Find(uint64_t key) {
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    return {};
+  }
+
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return entries_.front().second;
+}
+
+void DecoderOutputCache::Insert(uint64_t key, torch::Tensor value) {
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    it->second->second = std::move(value);
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return;
+  }
+
+  entries_.emplace_front(key, std::move(value));
+  index_[key] = entries_.begin();
+
+  if (static_cast<int32_t>(entries_.size()) > capacity_) {
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+}
+
+}  // namespace sherpa
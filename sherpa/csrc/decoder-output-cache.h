@@ -0,0 +1,85 @@
+// sherpa/csrc/decoder-output-cache.h
+//
+// Copyright (c)  2022  Xiaomi Corporation
+#ifndef SHERPA_CSRC_DECODER_OUTPUT_CACHE_H_
+#define SHERPA_CSRC_DECODER_OUTPUT_CACHE_H_
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+#include <utility>
+
+#include "torch/all.h"
+
+namespace sherpa {
+
+// An LRU cache of stateless transducer decoder outputs.
+//
+// The decoder network is a pure function of the last `context_size`
+// (typically 2) tokens, and the token distribution is Zipfian, so the
+// same few contexts are decoded over and over. This cache keys a row of
+// decoder input by its context tokens and stores the corresponding
+// decoder output, which lives on whatever device the decoder runs on.
+class DecoderOutputCache {
+ public:
+  /** Constructor.
+   *
+   * @param capacity Maximum number of cached contexts. The least
+   *                 recently used entry is evicted when the cache is
+   *                 full.
+   */
+  explicit DecoderOutputCache(int32_t capacity = 4096)
+      : capacity_(capacity) {}
+
+  /** Get the decoder outputs for a batch of contexts.
+   *
+   * It is safe to call this method concurrently from multiple threads;
+   * the cache itself is locked, while `run_decoder` is invoked without
+   * holding the lock.
+   *
+   * @param decoder_input A CPU tensor of shape (num, context_size) and
+   *                      dtype torch.int64.
+   * @param run_decoder   Invoked at most once with the rows of
+   *                      decoder_input that are not in the cache; it
+   *                      returns their decoder outputs, a tensor whose
+   *                      dim 0 has as many entries as its input rows.
+   *
+   * @return Return a tensor of shape (num, *run_decoder output dims*)
+   *         that combines cached and freshly computed outputs.
+   */
+  torch::Tensor Get(
+      torch::Tensor decoder_input,
+      const std::function<torch::Tensor(torch::Tensor)> &run_decoder);
+
+  int64_t NumQueries() const { return num_queries_; }
+  int64_t NumHits() const { return num_hits_; }
+
+ private:
+  // Return the cached value for the given key, or an undefined tensor
+  // if it is not present. A hit moves the entry to the front.
+  //
+  // The caller is responsible for holding `mutex_`.
+  torch::Tensor Find(uint64_t key);
+
+  // The caller is responsible for holding `mutex_`.
+  void Insert(uint64_t key, torch::Tensor value);
+
+ private:
+  using Entry = std::pair<uint64_t, torch::Tensor>;
+
+  int32_t capacity_;
+
+  std::mutex mutex_;
+
+  // Most recently used entries are at the front.
+  std::list<Entry> entries_;
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+
+  int64_t num_queries_ = 0;
+  int64_t num_hits_ = 0;
+};
+
+}  // namespace sherpa
+#endif  // SHERPA_CSRC_DECODER_OUTPUT_CACHE_H_
@@ -47,7 +47,9 @@ std::pair<torch::Tensor, float> ReadWave(const std::string &filename,
 
 /** Compute features for a batch of audio samples in parallel.
  *
- * @param fbank  The Fbank computer.
+ * @param fbank  The Fbank computer. If it lives on a CUDA device, CPU
+ *               wave data is uploaded to it in one pinned batch and the
+ *               returned features are device-resident.
  * @param wave_data A list of 1-D tensor. Each tensor is of dtype torch.float32
  *                  containing audio samples normalized to the range [-1, 1).
  * @param num_frames If not NULL, on return it will contain the number of
@@ -55,6 +57,11 @@ std::pair<torch::Tensor, float> ReadWave(const std::string &filename,
  *                   get the same information after getting the return value,
  *                   it saves computation if you provides it when invoking this
  *                   function.
+ * @param num_threads If greater than 1 and the fbank computer lives on
+ *                    the CPU, the wave data is split into contiguous
+ *                    shards that are processed concurrently, each with
+ *                    its own Fbank computer. The output order is
+ *                    preserved.
  * @return It returns the computed features for each input wave data. Each
  *         returned tensor is a 2-D tensor. Its number of rows equals to the
  *         number of feature frames and the number of columns equals to the
@@ -63,7 +70,7 @@ std::pair<torch::Tensor, float> ReadWave(const std::string &filename,
 std::vector<torch::Tensor> ComputeFeatures(
     kaldifeat::Fbank &fbank,  // NOLINT
     const std::vector<torch::Tensor> &wave_data,
-    std::vector<int64_t> *num_frames = nullptr);
+    std::vector<int64_t> *num_frames = nullptr, int32_t num_threads = 1);
 }  // namespace sherpa
 
 #endif  // SHERPA_CSRC_FBANK_FEATURES_H_
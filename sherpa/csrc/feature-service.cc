@@ -0,0 +1,323 @@
+// sherpa/csrc/feature-service.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/feature-service.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>  // NOLINT
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "sherpa/csrc/fbank-features.h"
+#include "sherpa/csrc/log.h"
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sherpa {
+
+#ifndef _WIN32
+
+// A request record is a uint64_t sequence number followed by raw
+// float32 samples; a response record is the sequence number followed by
+// two int32_t (num_frames, feature_dim) and the raw float32 feature
+// matrix. Both sides run on the same host, so no byte-order or
+// alignment conversion is needed.
+
+// The counter keeps the suffix unique when one process creates several
+// clients, e.g., for different service prefixes.
+static std::string MakeRingSuffix() {
+  static std::atomic<int32_t> counter{0};
+
+  std::ostringstream os;
+  os << getpid() << "-" << counter.fetch_add(1);
+  return os.str();
+}
+
+static bool ShmExists(const std::string &name) {
+  int32_t fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  close(fd);
+  return true;
+}
+
+FeatureServiceClient::FeatureServiceClient(const std::string &name_prefix,
+                                           uint32_t ring_bytes /*= 1 << 24*/)
+    // The service derives the response ring name from the request ring
+    // name, so both must carry the same suffix; it is generated once
+    // and recovered from response_name_ for the request ring ("-resp-"
+    // is 6 characters).
+    : response_name_(name_prefix + "-resp-" + MakeRingSuffix()),
+      ring_bytes_(ring_bytes),
+      request_ring_(name_prefix + "-req-" +
+                        response_name_.substr(name_prefix.size() + 6),
+                    ring_bytes) {}
+
+torch::Tensor FeatureServiceClient::Compute(const torch::Tensor &samples) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  torch::Tensor t = samples.to(torch::kFloat).contiguous();
+
+  uint64_t seq = next_seq_++;
+  uint32_t payload =
+      sizeof(seq) + static_cast<uint32_t>(t.numel()) * sizeof(float);
+  if (payload + sizeof(uint32_t) > ring_bytes_) {
+    SHERPA_LOG(FATAL) << "Utterance of " << t.numel()
+                      << " samples does not fit the feature service ring "
+                         "of "
+                      << ring_bytes_ << " bytes";
+  }
+
+  std::vector<char> buf(payload);
+  std::memcpy(buf.data(), &seq, sizeof(seq));
+  std::memcpy(buf.data() + sizeof(seq), t.data_ptr<float>(),
+              t.numel() * sizeof(float));
+
+  // A full ring means the service has fallen behind; wait for it to
+  // drain rather than dropping the utterance.
+  while (!request_ring_.Write(buf.data(), payload)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  if (!response_ring_) {
+    // The service creates the response ring when it discovers our
+    // request ring on its next /dev/shm scan.
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!ShmExists(response_name_)) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        SHERPA_LOG(FATAL) << "No response ring " << response_name_
+                          << " after 10 seconds. Is sherpa-feature-service "
+                             "running on this host?";
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    response_ring_ = std::make_unique<ShmRingReader>(response_name_);
+  }
+
+  std::string out;
+  while (true) {
+    if (!response_ring_->Read(&out)) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+
+    uint64_t got_seq = 0;
+    int32_t num_frames = 0;
+    int32_t feature_dim = 0;
+    SHERPA_CHECK_GE(out.size(),
+                    sizeof(got_seq) + sizeof(num_frames) + sizeof(feature_dim));
+    std::memcpy(&got_seq, out.data(), sizeof(got_seq));
+    if (got_seq != seq) {
+      // Cannot happen with a strictly SPSC ring pair; be defensive
+      // anyway and keep waiting for our record.
+      SHERPA_LOG(WARNING) << "Discarding stale feature response " << got_seq
+                          << " (expected " << seq << ")";
+      continue;
+    }
+
+    std::memcpy(&num_frames, out.data() + sizeof(got_seq),
+                sizeof(num_frames));
+    std::memcpy(&feature_dim,
+                out.data() + sizeof(got_seq) + sizeof(num_frames),
+                sizeof(feature_dim));
+
+    return torch::from_blob(
+               const_cast<char *>(out.data()) + sizeof(got_seq) +
+                   sizeof(num_frames) + sizeof(feature_dim),
+               {num_frames, feature_dim}, torch::kFloat)
+        .clone();
+  }
+}
+
+FeatureService::FeatureService(const std::string &name_prefix,
+                               const kaldifeat::FbankOptions &fbank_opts,
+                               int32_t num_workers,
+                               uint32_t ring_bytes /*= 1 << 24*/)
+    : name_prefix_(name_prefix),
+      fbank_(fbank_opts),
+      num_workers_(num_workers),
+      ring_bytes_(ring_bytes) {
+  SHERPA_CHECK_GT(num_workers, 0);
+  SHERPA_CHECK_EQ(name_prefix.empty() ? '\0' : name_prefix[0], '/')
+      << "shm name prefixes look like /sherpa-features";
+}
+
+void FeatureService::ScanForClients() {
+  // Request rings live in /dev/shm under the prefix without its leading
+  // '/'; scanning the directory is how new clients announce themselves,
+  // so no extra (and necessarily multi-producer) control channel is
+  // needed.
+  std::string entry_prefix = name_prefix_.substr(1) + "-req-";
+
+  DIR *dir = opendir("/dev/shm");
+  if (dir == nullptr) {
+    SHERPA_LOG(FATAL) << "Failed to open /dev/shm: " << strerror(errno);
+  }
+
+  while (struct dirent *e = readdir(dir)) {
+    std::string name = e->d_name;
+    if (name.compare(0, entry_prefix.size(), entry_prefix) != 0) {
+      continue;
+    }
+
+    struct stat st;
+    if (stat(("/dev/shm/" + name).c_str(), &st) != 0) {
+      continue;  // the client went away mid-scan
+    }
+
+    auto it = clients_.find(name);
+    if (it != clients_.end() && it->second.inode == st.st_ino) {
+      continue;
+    }
+
+    if (it != clients_.end()) {
+      // Same name, different object: the client died and a new one
+      // reused its ring name. Drop the stale mapping and attach the
+      // fresh one below.
+      clients_.erase(it);
+    }
+
+    Client c;
+    c.request = std::make_unique<ShmRingReader>("/" + name);
+    // "<prefix>-req-<suffix>" -> "<prefix>-resp-<suffix>"
+    std::string response_name =
+        name_prefix_ + "-resp-" + name.substr(entry_prefix.size());
+    c.response = std::make_unique<ShmRingWriter>(response_name, ring_bytes_);
+    c.inode = st.st_ino;
+    clients_.emplace(name, std::move(c));
+
+    SHERPA_LOG(INFO) << "Feature service: attached client /" << name;
+  }
+  closedir(dir);
+
+  for (auto it = clients_.begin(); it != clients_.end();) {
+    struct stat st;
+    if (stat(("/dev/shm/" + it->first).c_str(), &st) != 0) {
+      SHERPA_LOG(INFO) << "Feature service: client /" << it->first
+                       << " left";
+      it = clients_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void FeatureService::Run() {
+  SHERPA_LOG(INFO) << "Feature service serving " << name_prefix_
+                   << "-req-* with " << num_workers_ << " worker(s)";
+
+  int32_t iterations_since_scan = 0;
+  std::string buf;
+
+  while (true) {
+    // Scanning costs a directory walk, so do it when idle and only
+    // periodically while busy.
+    if (iterations_since_scan == 0 || iterations_since_scan >= 256) {
+      ScanForClients();
+      iterations_since_scan = 1;
+    }
+
+    // Each client has at most one request in flight, so one Read() per
+    // client per iteration collects everything there is; the requests
+    // of concurrent clients become one batch for the worker pool.
+    std::vector<torch::Tensor> waves;
+    std::vector<std::string> names;
+    std::vector<uint64_t> seqs;
+    for (auto &p : clients_) {
+      if (!p.second.request->Read(&buf)) {
+        continue;
+      }
+
+      uint64_t seq = 0;
+      SHERPA_CHECK_GE(buf.size(), sizeof(seq));
+      std::memcpy(&seq, buf.data(), sizeof(seq));
+
+      int64_t num_samples = (buf.size() - sizeof(seq)) / sizeof(float);
+      waves.push_back(torch::from_blob(&buf[sizeof(seq)], {num_samples},
+                                       torch::kFloat)
+                          .clone());
+      names.push_back(p.first);
+      seqs.push_back(seq);
+    }
+
+    if (waves.empty()) {
+      iterations_since_scan = 0;
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+      continue;
+    }
+    ++iterations_since_scan;
+
+    auto features = ComputeFeatures(fbank_, waves, /*num_frames*/ nullptr,
+                                    num_workers_);
+
+    for (size_t i = 0; i != features.size(); ++i) {
+      auto f = features[i].contiguous();
+      int32_t num_frames = f.size(0);
+      int32_t feature_dim = f.size(1);
+
+      std::vector<char> record(sizeof(uint64_t) + 2 * sizeof(int32_t) +
+                               f.numel() * sizeof(float));
+      std::memcpy(record.data(), &seqs[i], sizeof(uint64_t));
+      std::memcpy(record.data() + sizeof(uint64_t), &num_frames,
+                  sizeof(int32_t));
+      std::memcpy(record.data() + sizeof(uint64_t) + sizeof(int32_t),
+                  &feature_dim, sizeof(int32_t));
+      std::memcpy(record.data() + sizeof(uint64_t) + 2 * sizeof(int32_t),
+                  f.data_ptr<float>(), f.numel() * sizeof(float));
+
+      auto it = clients_.find(names[i]);
+      if (it == clients_.end() ||
+          !it->second.response->Write(record.data(), record.size())) {
+        // The client is blocked waiting for exactly this record, so a
+        // full response ring means it only ever holds records too large
+        // for it; nothing to do but drop.
+        SHERPA_LOG(WARNING) << "Dropping feature response for /" << names[i];
+      }
+    }
+  }
+}
+
+#else
+
+FeatureServiceClient::FeatureServiceClient(const std::string &name_prefix,
+                                           uint32_t /*ring_bytes*/)
+    : ring_bytes_(0), request_ring_("", 0) {
+  SHERPA_LOG(FATAL) << "The feature service is not supported on Windows "
+                    << "(requested prefix: " << name_prefix << ")";
+}
+
+torch::Tensor FeatureServiceClient::Compute(
+    const torch::Tensor & /*samples*/) {
+  return {};
+}
+
+FeatureService::FeatureService(const std::string &name_prefix,
+                               const kaldifeat::FbankOptions &fbank_opts,
+                               int32_t /*num_workers*/,
+                               uint32_t /*ring_bytes*/)
+    : fbank_(fbank_opts) {
+  SHERPA_LOG(FATAL) << "The feature service is not supported on Windows "
+                    << "(requested prefix: " << name_prefix << ")";
+}
+
+void FeatureService::ScanForClients() {}
+
+void FeatureService::Run() {}
+
+#endif  // _WIN32
+
+}  // namespace sherpa
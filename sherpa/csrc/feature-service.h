@@ -0,0 +1,125 @@
+// sherpa/csrc/feature-service.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_FEATURE_SERVICE_H_
+#define SHERPA_CSRC_FEATURE_SERVICE_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+
+#include "kaldifeat/csrc/feature-fbank.h"
+#include "sherpa/csrc/shm-ring.h"
+#include "torch/script.h"
+
+namespace sherpa {
+
+/* A host-wide fbank computation service over shared memory.
+ *
+ * When several recognizer processes run on one host, e.g., one
+ * sherpa-offline process per GPU, each of them brings its own feature
+ * extraction threads and together they oversubscribe the cores. The
+ * service pools that work: one sherpa-feature-service process per host
+ * owns the worker pool, and the recognizer processes hand their wave
+ * samples to it instead of computing fbank themselves.
+ *
+ * The transport reuses the SPSC shm rings of shm-ring.h, one pair per
+ * client so every ring keeps a single producer and a single consumer:
+ *
+ *  - A client creates a request ring named
+ *    "<prefix>-req-<pid>-<counter>" and writes wave samples into it.
+ *  - The service discovers request rings by scanning /dev/shm for the
+ *    prefix, creates the matching "<prefix>-resp-..." ring and writes
+ *    the computed features back.
+ *
+ * A client has at most one request in flight; Compute() blocks until
+ * the features come back, just like the local ComputeFeatures() call it
+ * replaces. Rings of clients that exit (the writer unlinks its shm
+ * object on destruction) are detached on the next scan.
+ */
+
+class FeatureServiceClient {
+ public:
+  /** Create the request ring and announce this client.
+   *
+   * @param name_prefix Name prefix of the shm objects, e.g.,
+   *                    "/sherpa-features". It must match the prefix the
+   *                    service was started with.
+   * @param ring_bytes Capacity of the request ring; an utterance whose
+   *                   samples do not fit is a fatal error.
+   */
+  explicit FeatureServiceClient(const std::string &name_prefix,
+                                uint32_t ring_bytes = 1 << 24);
+
+  /** Compute the fbank features of one utterance.
+   *
+   * @param samples A 1-D float32 tensor of audio samples on the CPU,
+   *                scaled the way the service's feature options expect.
+   * @return Return a 2-D tensor of shape (num_frames, feature_dim).
+   *
+   * It blocks until the service responds and is safe to call from
+   * multiple threads; concurrent calls are serialized, the ring pair is
+   * strictly SPSC.
+   */
+  torch::Tensor Compute(const torch::Tensor &samples);
+
+ private:
+  std::mutex mutex_;
+  std::string response_name_;
+  uint32_t ring_bytes_;
+  ShmRingWriter request_ring_;
+  // Created by the service once it discovers our request ring; attached
+  // lazily by the first Compute() call.
+  std::unique_ptr<ShmRingReader> response_ring_;
+  uint64_t next_seq_ = 0;
+};
+
+class FeatureService {
+ public:
+  /**
+   * @param name_prefix Name prefix of the shm objects; clients must
+   *                    pass the same prefix.
+   * @param fbank_opts Feature options; they must match what the client
+   *                   models were trained with.
+   * @param num_workers Number of feature extraction threads used for
+   *                    each batch of requests; see ComputeFeatures().
+   * @param ring_bytes Capacity of each response ring.
+   */
+  FeatureService(const std::string &name_prefix,
+                 const kaldifeat::FbankOptions &fbank_opts,
+                 int32_t num_workers, uint32_t ring_bytes = 1 << 24);
+
+  FeatureService(const FeatureService &) = delete;
+  FeatureService &operator=(const FeatureService &) = delete;
+
+  /// Serve requests. It never returns.
+  void Run();
+
+ private:
+  // Attach request rings that appeared in /dev/shm since the last scan
+  // and drop clients whose rings are gone.
+  void ScanForClients();
+
+  struct Client {
+    std::unique_ptr<ShmRingReader> request;
+    std::unique_ptr<ShmRingWriter> response;
+    // Inode of the shm object, to catch a client that died and was
+    // replaced by one reusing the same ring name.
+    uint64_t inode;
+  };
+
+  std::string name_prefix_;
+  kaldifeat::Fbank fbank_;
+  int32_t num_workers_;
+  uint32_t ring_bytes_;
+  // Keyed by the request ring name without the leading '/', i.e., the
+  // /dev/shm entry name.
+  std::map<std::string, Client> clients_;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_FEATURE_SERVICE_H_
@@ -0,0 +1,43 @@
+// sherpa/csrc/graph-cache.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/graph-cache.h"
+
+#include <mutex>  // NOLINT
+#include <sstream>
+#include <unordered_map>
+
+#include "sherpa/csrc/log.h"
+
+namespace sherpa {
+
+k2::FsaClassPtr LoadCachedFsaClass(const std::string &path,
+                                   torch::Device device, float scale) {
+  // The mutex is held across the load on purpose: two decoders asking
+  // for the same graph concurrently must not both deserialize it.
+  static std::mutex mutex;
+  static std::unordered_map<std::string, k2::FsaClassPtr> cache;
+
+  std::ostringstream os;
+  os << path << "\n" << device << "\n" << scale;
+  std::string key = os.str();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    SHERPA_LOG(INFO) << "Reusing the already loaded " << path;
+    return it->second;
+  }
+
+  SHERPA_LOG(INFO) << "Loading " << path;
+  auto graph = k2::LoadFsaClass(path, device);
+  if (scale != 1) {
+    k2::ScaleTensorAttribute(graph, scale, "scores");
+  }
+
+  cache[key] = graph;
+  return graph;
+}
+
+}  // namespace sherpa
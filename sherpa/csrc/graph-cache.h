@@ -0,0 +1,44 @@
+// sherpa/csrc/graph-cache.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_GRAPH_CACHE_H_
+#define SHERPA_CSRC_GRAPH_CACHE_H_
+
+#include <string>
+
+#include "k2/torch_api.h"
+#include "torch/script.h"
+
+namespace sherpa {
+
+/** Load a decoding graph (HLG/LG), sharing one copy per process.
+ *
+ * Decoding graphs are large -- an HLG can run into gigabytes -- and
+ * immutable once their scores are scaled, yet every decoder constructed
+ * with the same graph used to deserialize its own private copy. This
+ * helper keeps a process-wide registry keyed by (path, device, scale):
+ * the first load deserializes and scales the graph, later loads -- e.g.,
+ * more recognizers on the same device -- return the shared instance
+ * without touching the disk.
+ *
+ * Note: sharing graph pages across processes would require k2 to build
+ * its arrays over a read-only mmap region, which its torch API does not
+ * expose. Within one host, prefer several recognizers in one process
+ * over several processes, so the graph exists once.
+ *
+ * Caution: the returned graph is shared. Callers must not mutate it; in
+ * particular, do not apply ScaleTensorAttribute() to it -- pass the
+ * scale here instead.
+ *
+ * @param path Path to a graph saved by k2.
+ * @param device The device to load the graph onto.
+ * @param scale Factor applied to the "scores" attribute of a freshly
+ *              loaded graph; 1 leaves the scores unchanged.
+ */
+k2::FsaClassPtr LoadCachedFsaClass(const std::string &path,
+                                   torch::Device device, float scale);
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_GRAPH_CACHE_H_
@@ -19,19 +19,209 @@
 #include "sherpa/csrc/hypothesis.h"
 
 #include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "sherpa/csrc/math.h"
+#include "sherpa/csrc/prof.h"
 namespace sherpa {
 
+namespace {
+
+// Backing store of the TokenNode pool; see AllocateTokenNodeChunk().
+// Chunks of each size class are carved out of larger blocks and
+// recycled through a per-size freelist.
+struct TokenNodePool {
+  std::mutex mutex;
+  std::unordered_map<std::size_t, std::vector<void *>> freelists;
+  std::vector<std::unique_ptr<char[]>> blocks;
+};
+
+TokenNodePool *GetTokenNodePool() {
+  // Intentionally leaked: hypotheses owned by static objects may
+  // release their nodes after static destruction has begun.
+  static TokenNodePool *pool = new TokenNodePool;
+  return pool;
+}
+
+}  // namespace
+
+void *AllocateTokenNodeChunk(std::size_t size) {
+  // 256 chunks per block amortizes the malloc; at ~48 bytes per node
+  // plus its control block a block is on the order of 20 KB.
+  constexpr std::size_t kChunksPerBlock = 256;
+
+  auto *pool = GetTokenNodePool();
+  std::lock_guard<std::mutex> lock(pool->mutex);
+
+  auto &freelist = pool->freelists[size];
+  if (freelist.empty()) {
+    // Keep every chunk maximally aligned; operator new[] already
+    // returns memory suitably aligned for the first one.
+    constexpr std::size_t kAlignment = alignof(std::max_align_t);
+    std::size_t stride = (size + kAlignment - 1) / kAlignment * kAlignment;
+
+    pool->blocks.emplace_back(new char[stride * kChunksPerBlock]);
+    char *base = pool->blocks.back().get();
+
+    freelist.reserve(kChunksPerBlock);
+    for (std::size_t i = 0; i != kChunksPerBlock; ++i) {
+      freelist.push_back(base + i * stride);
+    }
+  }
+
+  void *ans = freelist.back();
+  freelist.pop_back();
+  return ans;
+}
+
+void FreeTokenNodeChunk(void *p, std::size_t size) {
+  auto *pool = GetTokenNodePool();
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  pool->freelists[size].push_back(p);
+}
+
+// Two hypotheses with the same key carry the same token sequence, so
+// everything that is a function of the sequence (key, token count,
+// context and LM states) is already equal; only the scores and the
+// alignment -- the timestamps in the token chain and the trailing-blank
+// count -- can differ. Recombining keeps the alignment of the
+// higher-scoring path.
+static void AdoptAlignment(Hypothesis *dst, Hypothesis *src) {
+  dst->last = std::move(src->last);
+  dst->num_trailing_blanks = src->num_trailing_blanks;
+}
+
 void Hypotheses::Add(Hypothesis hyp) {
+  SHERPA_PROF_SCOPE(hypotheses_add);
+  ++num_candidates_;
+  if (score_gap_ > 0 && hyp.log_prob < best_log_prob_ - score_gap_) {
+    return;
+  }
+
   auto key = hyp.Key();
   auto it = hyps_dict_.find(key);
   if (it == hyps_dict_.end()) {
+    best_log_prob_ = std::max(best_log_prob_, hyp.log_prob);
     hyps_dict_[key] = std::move(hyp);
   } else {
+    if (hyp.log_prob > it->second.log_prob) {
+      AdoptAlignment(&it->second, &hyp);
+    }
     it->second.log_prob = LogAdd<double>()(it->second.log_prob, hyp.log_prob);
+    best_log_prob_ = std::max(best_log_prob_, it->second.log_prob);
+    ++num_merged_;
   }
+
+  EnforceMaxActive();
+}
+
+void Hypotheses::AddBatch(std::vector<Hypothesis> hyps) {
+  // Insert first-seen hyps right away and collect the colliding ones, so
+  // that all merges are done in one vectorized log-add pass instead of
+  // one scalar LogAdd per merged pair.
+  std::vector<Hypothesis *> merged;
+  std::vector<double> x;  // scores already in the dict
+  std::vector<double> y;  // scores of the colliding new hyps
+  // Score of the path whose alignment the merged entry currently
+  // carries; a later colliding path with a higher score takes over the
+  // alignment (see AdoptAlignment()).
+  std::vector<double> rep;
+  std::unordered_map<uint64_t, int32_t> pending;
+
+  num_candidates_ += static_cast<int64_t>(hyps.size());
+
+  for (auto &h : hyps) {
+    if (score_gap_ > 0 && h.log_prob < best_log_prob_ - score_gap_) {
+      continue;
+    }
+
+    uint64_t key = h.Key();
+    auto it = hyps_dict_.find(key);
+    if (it == hyps_dict_.end()) {
+      best_log_prob_ = std::max(best_log_prob_, h.log_prob);
+      hyps_dict_[key] = std::move(h);
+      continue;
+    }
+
+    ++num_merged_;
+    auto p = pending.find(key);
+    if (p == pending.end()) {
+      pending[key] = static_cast<int32_t>(merged.size());
+      // Note: pointers to unordered_map values stay valid on insertion.
+      merged.push_back(&it->second);
+      x.push_back(it->second.log_prob);
+      y.push_back(h.log_prob);
+      rep.push_back(it->second.log_prob);
+      if (h.log_prob > rep.back()) {
+        AdoptAlignment(merged.back(), &h);
+        rep.back() = h.log_prob;
+      }
+    } else {
+      // The same key collides more than once within this batch; fold the
+      // extra score into its pending entry.
+      y[p->second] = LogAdd<double>()(y[p->second], h.log_prob);
+      if (h.log_prob > rep[p->second]) {
+        AdoptAlignment(merged[p->second], &h);
+        rep[p->second] = h.log_prob;
+      }
+    }
+  }
+
+  int32_t n = static_cast<int32_t>(merged.size());
+  if (n != 0) {
+    std::vector<double> ans(n);
+    LogAddBatch(x.data(), y.data(), ans.data(), n);
+    for (int32_t i = 0; i != n; ++i) {
+      merged[i]->log_prob = ans[i];
+      best_log_prob_ = std::max(best_log_prob_, ans[i]);
+    }
+  }
+
+  EnforceMaxActive();
+}
+
+void Hypotheses::EnforceMaxActive() {
+  if (max_active_ <= 0) {
+    return;
+  }
+
+  while (static_cast<int32_t>(hyps_dict_.size()) > max_active_) {
+    auto worst = std::min_element(hyps_dict_.begin(), hyps_dict_.end(),
+                                  [](const auto &left, const auto &right) {
+                                    return left.second.log_prob <
+                                           right.second.log_prob;
+                                  });
+    hyps_dict_.erase(worst);
+  }
+}
+
+std::vector<const TokenNode *> Hypotheses::UniqueNodes() const {
+  std::vector<const TokenNode *> ans;
+  std::unordered_set<const TokenNode *> seen;
+
+  std::vector<const TokenNode *> chain;
+  for (const auto &p : hyps_dict_) {
+    // Walk this hypothesis back in time until we reach a node that an
+    // earlier hypothesis already contributed.
+    chain.clear();
+    for (const TokenNode *node = p.second.last.get();
+         node && seen.insert(node).second; node = node->prev.get()) {
+      chain.push_back(node);
+    }
+
+    // chain runs child -> parent; reverse it so that parents precede
+    // their children in ans. Parents outside of chain were appended in
+    // an earlier iteration.
+    ans.insert(ans.end(), chain.rbegin(), chain.rend());
+  }
+
+  return ans;
 }
 
 Hypothesis Hypotheses::GetMostProbable(bool length_norm) const {
@@ -47,11 +237,33 @@ Hypothesis Hypotheses::GetMostProbable(bool length_norm) const {
     return std::max_element(
                hyps_dict_.begin(), hyps_dict_.end(),
                [](const auto &left, const auto &right) -> bool {
-                 return left.second.log_prob / left.second.ys.size() <
-                        right.second.log_prob / right.second.ys.size();
+                 return left.second.log_prob / left.second.NumTokens() <
+                        right.second.log_prob / right.second.NumTokens();
                })
         ->second;
   }
 }
 
+Hypothesis Hypotheses::TakeMostProbable(bool length_norm) {
+  Map::iterator it;
+  if (length_norm == false) {
+    it = std::max_element(hyps_dict_.begin(), hyps_dict_.end(),
+                          [](const auto &left, const auto &right) -> bool {
+                            return left.second.log_prob <
+                                   right.second.log_prob;
+                          });
+  } else {
+    it = std::max_element(
+        hyps_dict_.begin(), hyps_dict_.end(),
+        [](const auto &left, const auto &right) -> bool {
+          return left.second.log_prob / left.second.NumTokens() <
+                 right.second.log_prob / right.second.NumTokens();
+        });
+  }
+
+  Hypothesis ans = std::move(it->second);
+  hyps_dict_.erase(it);
+  return ans;
+}
+
 }  // namespace sherpa
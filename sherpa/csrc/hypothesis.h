@@ -19,6 +19,11 @@
 #ifndef SHERPA_CSRC_HYPOTHESIS_H_
 #define SHERPA_CSRC_HYPOTHESIS_H_
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -28,33 +33,183 @@
 
 namespace sherpa {
 
+// TokenNode allocations dominate the beam-search allocation rate: one
+// node per predicted token per surviving hypothesis, every frame. The
+// nodes (together with their shared_ptr control blocks) are therefore
+// served from pooled blocks and recycled through a freelist, so at
+// steady state appending a token performs no malloc at all.
+void *AllocateTokenNodeChunk(std::size_t size);
+void FreeTokenNodeChunk(void *p, std::size_t size);
+
+// A minimal allocator front end to the chunk pool above, passed to
+// std::allocate_shared() in Hypothesis::AddToken() so a node and its
+// control block land in a single pooled chunk. All instances share the
+// one process-wide pool.
+template <typename T>
+struct TokenNodeAllocator {
+  using value_type = T;
+
+  TokenNodeAllocator() = default;
+
+  template <typename U>
+  TokenNodeAllocator(const TokenNodeAllocator<U> &) {}  // NOLINT
+
+  T *allocate(std::size_t n) {
+    return static_cast<T *>(AllocateTokenNodeChunk(n * sizeof(T)));
+  }
+
+  void deallocate(T *p, std::size_t n) {
+    FreeTokenNodeChunk(p, n * sizeof(T));
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const TokenNodeAllocator<T> & /*a*/,
+                const TokenNodeAllocator<U> & /*b*/) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const TokenNodeAllocator<T> & /*a*/,
+                const TokenNodeAllocator<U> & /*b*/) {
+  return false;
+}
+
+// A node in a singly linked token list that runs backwards in time.
+// Hypotheses extended from a common ancestor share their prefix through
+// this list, so extending a hypothesis is an O(1) append instead of an
+// O(len) vector copy.
+struct TokenNode {
+  int32_t token;
+
+  // The frame number (after subsampling) on which `token` is decoded,
+  // or -1 if the token has no timestamp, e.g., the context blanks.
+  int32_t timestamp;
+
+  std::shared_ptr<TokenNode> prev;
+
+  ~TokenNode() {
+    // Release the chain iteratively. The default recursive destruction
+    // overflows the stack for hypotheses of hour-long utterances.
+    auto p = std::move(prev);
+    while (p && p.use_count() == 1) {
+      auto next = std::move(p->prev);
+      p = std::move(next);
+    }
+  }
+};
+
 struct Hypothesis {
-  // The predicted tokens so far. Newly predicated tokens are appended.
-  std::vector<int32_t> ys;
+  // The most recently predicted token; it is the head of a linked list
+  // running backwards in time. nullptr for an empty hypothesis.
+  // Newly predicted tokens are appended via AddToken(), which also
+  // maintains `key`.
+  std::shared_ptr<TokenNode> last;
 
-  // timestamps[i] contains the frame number after subsampling
-  // on which ys[i] is decoded.
-  std::vector<int32_t> timestamps;
+  // Number of tokens in the list, including the context blanks.
+  int32_t num_tokens = 0;
 
-  // The total score of ys in log space.
+  // The total score of the token sequence in log space.
   double log_prob = 0;
 
   int32_t num_trailing_blanks = 0;
 
+  // Incremental 64-bit hash of the token sequence; see Key(). It is
+  // updated in O(1) when a token is appended, so looking up a hypothesis
+  // never materializes the whole token sequence.
+  uint64_t key = 0;
+
+  // State ID in the context graph used for hotword biasing; 0 (the
+  // root) when biasing is disabled or no phrase is partially matched.
+  // It is a deterministic function of the token sequence, so merging
+  // hypotheses by Key() keeps it consistent.
+  // See sherpa/csrc/context-graph.h.
+  int32_t context_state = 0;
+
+  // State ID in the n-gram LM used for shallow fusion; 0 (the empty
+  // context) when fusion is disabled. Like context_state, it is a
+  // deterministic function of the token sequence.
+  // See sherpa/csrc/ngram-lm.h.
+  int32_t lm_state = 0;
+
   Hypothesis() = default;
   Hypothesis(const std::vector<int32_t> &ys, double log_prob)
-      : ys(ys), log_prob(log_prob) {}
+      : log_prob(log_prob) {
+    for (auto token : ys) {
+      AddToken(token);
+    }
+  }
+
+  // Append a predicted token and update the incremental hash key.
+  //
+  // @param token  The predicted token.
+  // @param timestamp  The frame number (after subsampling) on which the
+  //                   token is decoded; -1 if it has none, e.g., for
+  //                   the context blanks.
+  void AddToken(int32_t token, int32_t timestamp = -1) {
+    last = std::allocate_shared<TokenNode>(TokenNodeAllocator<TokenNode>(),
+                                           TokenNode{token, timestamp, last});
+    ++num_tokens;
+    key = UpdateKey(key, token);
+  }
+
+  int32_t NumTokens() const { return num_tokens; }
+
+  // Materialize the token sequence, oldest token first.
+  std::vector<int32_t> Ys() const {
+    std::vector<int32_t> ys(num_tokens);
+    int32_t i = num_tokens;
+    for (const TokenNode *p = last.get(); p; p = p->prev.get()) {
+      ys[--i] = p->token;
+    }
+    return ys;
+  }
+
+  // Materialize the timestamps of the tokens that have one, in
+  // increasing order of time.
+  std::vector<int32_t> Timestamps() const {
+    std::vector<int32_t> timestamps;
+    timestamps.reserve(num_tokens);
+    for (const TokenNode *p = last.get(); p; p = p->prev.get()) {
+      if (p->timestamp != -1) {
+        timestamps.push_back(p->timestamp);
+      }
+    }
+    std::reverse(timestamps.begin(), timestamps.end());
+    return timestamps;
+  }
+
+  // Copy the last n tokens to out[0], out[1], ..., out[n-1], oldest
+  // token first. It is used to build the decoder input without
+  // materializing the whole token sequence.
+  //
+  // Caution: The hypothesis must contain at least n tokens.
+  void FillLastTokens(int32_t n, int64_t *out) const {
+    const TokenNode *p = last.get();
+    for (int32_t i = n - 1; i >= 0; --i) {
+      out[i] = p->token;
+      p = p->prev.get();
+    }
+  }
 
   // If two Hypotheses have the same `Key`, then they contain
-  // the same token sequence.
-  std::string Key() const { return torch::Join("-", ys); }
+  // the same token sequence (up to hash collisions, which are
+  // negligible for 64-bit keys at beam-search scales).
+  uint64_t Key() const { return key; }
 
   // For debugging
   std::string ToString() const {
     std::ostringstream os;
-    os << "(" << Key() << ", " << log_prob << ")";
+    os << "(" << torch::Join("-", Ys()) << ", " << log_prob << ")";
     return os.str();
   }
+
+ private:
+  static uint64_t UpdateKey(uint64_t key, int32_t token) {
+    // A multiplicative rolling hash; the multiplier is the one used by
+    // the PCG family of random number generators.
+    return key * 6364136223846793005ULL + static_cast<uint64_t>(token) + 1;
+  }
 };
 
 class Hypotheses {
@@ -67,22 +222,58 @@ class Hypotheses {
     }
   }
 
-  explicit Hypotheses(std::unordered_map<std::string, Hypothesis> hyps_dict)
+  explicit Hypotheses(std::unordered_map<uint64_t, Hypothesis> hyps_dict)
       : hyps_dict_(std::move(hyps_dict)) {}
 
+  // Configure insertion-time pruning, applied by Add() and AddBatch().
+  //
+  // At most max_active hypotheses are kept (<= 0 means unlimited), and
+  // a hypothesis whose log_prob is more than score_gap below the best
+  // one seen so far is rejected before it ever touches the hash map
+  // (score_gap <= 0 disables gap pruning).
+  void SetPruning(int32_t max_active, double score_gap) {
+    max_active_ = max_active;
+    score_gap_ = score_gap;
+  }
+
   // Add hyp to this object. If it already exists, its log_prob
-  // is updated with the given hyp using log-sum-exp.
+  // is updated with the given hyp using log-sum-exp, and the alignment
+  // metadata (timestamps, trailing-blank count) of the higher-scoring
+  // path is kept, so a merged hypothesis reports the alignment of its
+  // dominant path.
   void Add(Hypothesis hyp);
 
+  // Add a batch of hyps to this object. Equivalent to calling Add() on
+  // each of them, but all colliding hyps are merged with a single
+  // vectorized log-add pass; see LogAddBatch() in math.h.
+  void AddBatch(std::vector<Hypothesis> hyps);
+
   // Get the hyp that has the largest log_prob.
   // If length_norm is true, hyp's log_prob are divided by
-  // len(hyp.ys) before comparison.
+  // its number of tokens before comparison.
   Hypothesis GetMostProbable(bool length_norm) const;
 
+  // Like GetMostProbable(), but moves the winner out of this object
+  // instead of copying it; the winner is removed from this object.
+  // Use it when this object is dead afterwards, e.g., when a decoder
+  // drains the beam of a finished utterance.
+  Hypothesis TakeMostProbable(bool length_norm);
+
   // Remove the given hyp from this object.
   // It is *NOT* an error if hyp does not exist in this object.
   void Remove(const Hypothesis &hyp) { hyps_dict_.erase(hyp.Key()); }
 
+  // Return the unique token nodes of the trie formed by the hypotheses
+  // in this object, with a node's parent always appearing before the
+  // node itself. Since hypotheses extended from a common ancestor share
+  // their prefix, the result has O(unique tokens) entries rather than
+  // O(beam x len); it lets a rescorer, e.g., a neural LM, score each
+  // unique token extension exactly once.
+  //
+  // Caution: The returned pointers are owned by the hypotheses in this
+  // object and are valid only while it is alive and unmodified.
+  std::vector<const TokenNode *> UniqueNodes() const;
+
   // Return a list of hyps contained in this object.
   std::vector<Hypothesis> Vec() const {
     std::vector<Hypothesis> ans;
@@ -93,8 +284,28 @@ class Hypotheses {
     return ans;
   }
 
+  // Like Vec(), but moves the hyps out; this object is left empty.
+  std::vector<Hypothesis> TakeVec() {
+    std::vector<Hypothesis> ans;
+    ans.reserve(hyps_dict_.size());
+    for (auto &p : hyps_dict_) {
+      ans.push_back(std::move(p.second));
+    }
+    hyps_dict_.clear();
+    return ans;
+  }
+
   int32_t Size() const { return hyps_dict_.size(); }
 
+  // Merge-rate counters: of NumCandidates() hypotheses offered via
+  // Add()/AddBatch(), NumMerged() recombined with an already stored
+  // hypothesis carrying the same token sequence (e.g., paths that
+  // differ only in their blank alignment). The ratio measures how much
+  // wider the effective beam is than the stored one: every merge is a
+  // path explored without occupying a beam slot.
+  int64_t NumCandidates() const { return num_candidates_; }
+  int64_t NumMerged() const { return num_merged_; }
+
   std::string ToString() const {
     std::ostringstream os;
     for (const auto &p : hyps_dict_) {
@@ -110,8 +321,23 @@ class Hypotheses {
   const auto end() const { return hyps_dict_.end(); }
 
  private:
-  using Map = std ::unordered_map<std::string, Hypothesis>;
+  // Remove the worst hypotheses until at most max_active_ remain.
+  void EnforceMaxActive();
+
+ private:
+  using Map = std ::unordered_map<uint64_t, Hypothesis>;
   Map hyps_dict_;
+
+  // See SetPruning().
+  int32_t max_active_ = 0;
+  double score_gap_ = 0;
+
+  // The best log_prob ever inserted or merged; used for gap pruning.
+  double best_log_prob_ = std::numeric_limits<double>::lowest();
+
+  // See NumCandidates() and NumMerged().
+  int64_t num_candidates_ = 0;
+  int64_t num_merged_ = 0;
 };
 
 }  // namespace sherpa
@@ -0,0 +1,191 @@
+// sherpa/csrc/json-writer.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#include "sherpa/csrc/json-writer.h"
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace sherpa {
+
+void JsonWriter::MaybeComma() {
+  if (need_comma_) {
+    buf_.push_back(',');
+  }
+}
+
+void JsonWriter::StartObject() {
+  MaybeComma();
+  buf_.push_back('{');
+  need_comma_ = false;
+}
+
+void JsonWriter::EndObject() {
+  buf_.push_back('}');
+  need_comma_ = true;
+}
+
+void JsonWriter::StartArray() {
+  MaybeComma();
+  buf_.push_back('[');
+  need_comma_ = false;
+}
+
+void JsonWriter::EndArray() {
+  buf_.push_back(']');
+  need_comma_ = true;
+}
+
+void JsonWriter::Key(const char *key) {
+  MaybeComma();
+  buf_.push_back('"');
+  buf_.append(key);
+  buf_.append("\":");
+  need_comma_ = false;
+}
+
+void JsonWriter::Write(bool value) {
+  MaybeComma();
+  buf_.append(value ? "true" : "false");
+  need_comma_ = true;
+}
+
+void JsonWriter::Write(int32_t value) {
+  Write(static_cast<int64_t>(value));
+}
+
+void JsonWriter::Write(int64_t value) {
+  MaybeComma();
+  char tmp[24];
+  buf_.append(tmp, std::snprintf(tmp, sizeof(tmp), "%" PRId64, value));
+  need_comma_ = true;
+}
+
+void JsonWriter::Write(const char *value) {
+  Write(value, std::strlen(value));
+}
+
+void JsonWriter::Write(const char *value, std::size_t n) {
+  MaybeComma();
+  AppendEscaped(value, n);
+  need_comma_ = true;
+}
+
+void JsonWriter::Write(const std::string &value) {
+  Write(value.data(), value.size());
+}
+
+void JsonWriter::Write(float value, int32_t decimals) {
+  MaybeComma();
+  AppendFloat(value, decimals);
+  need_comma_ = true;
+}
+
+void JsonWriter::Write(const std::vector<std::string> &values) {
+  StartArray();
+  for (const auto &v : values) {
+    Write(v);
+  }
+  EndArray();
+}
+
+void JsonWriter::Write(const std::vector<float> &values, int32_t decimals) {
+  StartArray();
+  for (auto v : values) {
+    Write(v, decimals);
+  }
+  EndArray();
+}
+
+void JsonWriter::WriteQuoted(const std::vector<float> &values,
+                             int32_t decimals) {
+  MaybeComma();
+  buf_.append("\"[");
+  const char *sep = "";
+  for (auto v : values) {
+    buf_.append(sep);
+    AppendFloat(v, decimals);
+    sep = ",";
+  }
+  buf_.append("]\"");
+  need_comma_ = true;
+}
+
+void JsonWriter::AppendEscaped(const char *s, std::size_t n) {
+  buf_.push_back('"');
+  for (std::size_t i = 0; i != n; ++i) {
+    unsigned char c = s[i];
+    switch (c) {
+      case '"':
+        buf_.append("\\\"");
+        break;
+      case '\\':
+        buf_.append("\\\\");
+        break;
+      case '\b':
+        buf_.append("\\b");
+        break;
+      case '\f':
+        buf_.append("\\f");
+        break;
+      case '\n':
+        buf_.append("\\n");
+        break;
+      case '\r':
+        buf_.append("\\r");
+        break;
+      case '\t':
+        buf_.append("\\t");
+        break;
+      default:
+        if (c < 0x20) {
+          char tmp[8];
+          buf_.append(tmp, std::snprintf(tmp, sizeof(tmp), "\\u%04x", c));
+        } else {
+          // UTF-8 continuation bytes pass through untouched; JSON text
+          // is UTF-8.
+          buf_.push_back(static_cast<char>(c));
+        }
+    }
+  }
+  buf_.push_back('"');
+}
+
+void JsonWriter::AppendFloat(float value, int32_t decimals) {
+  if (!std::isfinite(value)) {
+    buf_.append("null");
+    return;
+  }
+
+  static const int64_t kPow10[] = {1,      10,      100,      1000,
+                                   10000,  100000,  1000000,  10000000,
+                                   100000000, 1000000000};
+  int64_t scale = kPow10[decimals];
+
+  // Round in the scaled integer domain, so 0.1254999... with two
+  // decimals becomes 0.13 exactly and the digits below are emitted with
+  // plain integer formatting.
+  int64_t scaled = std::llround(static_cast<double>(value) * scale);
+  if (scaled < 0) {
+    buf_.push_back('-');
+    scaled = -scaled;
+  }
+
+  char tmp[32];
+  buf_.append(tmp,
+              std::snprintf(tmp, sizeof(tmp), "%" PRId64, scaled / scale));
+  if (decimals > 0) {
+    buf_.append(tmp, std::snprintf(tmp, sizeof(tmp), ".%0*" PRId64, decimals,
+                                   scaled % scale));
+  }
+}
+
+JsonWriter *GetThreadLocalJsonWriter() {
+  static thread_local JsonWriter writer;
+  return &writer;
+}
+
+}  // namespace sherpa
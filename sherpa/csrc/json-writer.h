@@ -0,0 +1,85 @@
+// sherpa/csrc/json-writer.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_CSRC_JSON_WRITER_H_
+#define SHERPA_CSRC_JSON_WRITER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace sherpa {
+
+/** An append-only JSON serializer for the result messages of the
+ * websocket servers.
+ *
+ * It writes straight into one reusable string buffer: no intermediate
+ * std::string per field, no ostringstream, and fixed-point float
+ * formatting with a caller-chosen number of decimals instead of the
+ * locale-aware iostream machinery. Obtain a per-thread instance with
+ * GetThreadLocalJsonWriter(); its buffer capacity persists across
+ * messages, so steady-state serialization does not grow the buffer.
+ *
+ * The caller is responsible for well-formedness: keys only inside
+ * objects, exactly one value after each key. Strings are escaped as
+ * required by RFC 8259; non-finite floats are written as null, which
+ * matches what nlohmann::json emitted before.
+ */
+class JsonWriter {
+ public:
+  JsonWriter() { buf_.reserve(1024); }
+
+  /// Drop the contents, keep the capacity.
+  void Reset() {
+    buf_.clear();
+    need_comma_ = false;
+  }
+
+  const std::string &Str() const { return buf_; }
+
+  void StartObject();
+  void EndObject();
+  void StartArray();
+  void EndArray();
+
+  /// Write a key; the next Write*() call provides its value. Keys are
+  /// literals chosen by the caller and are not escaped.
+  void Key(const char *key);
+
+  void Write(bool value);
+  void Write(int32_t value);
+  void Write(int64_t value);
+  void Write(const char *value);
+  void Write(const char *value, std::size_t n);
+  void Write(const std::string &value);
+
+  /// Fixed-point float with `decimals` digits after the point;
+  /// 0 <= decimals <= 9.
+  void Write(float value, int32_t decimals);
+
+  void Write(const std::vector<std::string> &values);
+  void Write(const std::vector<float> &values, int32_t decimals);
+
+  /// Write a float array as a quoted string, e.g., "[0.12,0.34]". Kept
+  /// for the offline result format, whose clients expect these arrays
+  /// string-wrapped -- a leftover of forcing fixed decimals through
+  /// nlohmann::json.
+  void WriteQuoted(const std::vector<float> &values, int32_t decimals);
+
+ private:
+  void MaybeComma();
+  void AppendEscaped(const char *s, std::size_t n);
+  void AppendFloat(float value, int32_t decimals);
+
+  std::string buf_;
+  bool need_comma_ = false;
+};
+
+/// Return this thread's JsonWriter. Call Reset() before building a new
+/// message; the message stays valid until the next Reset() on the same
+/// thread.
+JsonWriter *GetThreadLocalJsonWriter();
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_JSON_WRITER_H_
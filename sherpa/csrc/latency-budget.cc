@@ -0,0 +1,53 @@
+// sherpa/csrc/latency-budget.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/latency-budget.h"
+
+#include <cstdlib>
+#include <string>
+
+#include "sherpa/csrc/log.h"
+#include "sherpa/csrc/metrics.h"
+
+namespace sherpa {
+
+LatencyBudgetSite::LatencyBudgetSite(const char *name, int64_t budget_us)
+    : name_(name), budget_us_(budget_us) {
+  violations_ = MetricsRegistry::Get().GetCounter(
+      std::string("sherpa_latency_budget_violations_") + name,
+      std::string("Number of times the ") + name +
+          " scope exceeded its latency budget of " +
+          std::to_string(budget_us) + " us");
+}
+
+void LatencyBudgetSite::ReportViolation(int64_t elapsed_us) {
+  violations_->Inc();
+
+  if (LatencyBudgetsAreFatal()) {
+    SHERPA_LOG(FATAL) << "Latency budget violated: " << name_ << " took "
+                      << elapsed_us << " us, budget is " << budget_us_
+                      << " us. Aborting because SHERPA_LATENCY_BUDGET_FATAL "
+                      << "is set.";
+  }
+
+  // The first few violations and every 100th after that are logged; a
+  // persistently slow scope must not flood the log. The metric carries
+  // the exact count.
+  int64_t n = num_logged_.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (n <= 5 || n % 100 == 0) {
+    SHERPA_LOG(WARNING) << "Latency budget violated: " << name_ << " took "
+                        << elapsed_us << " us, budget is " << budget_us_
+                        << " us (violation #" << n << ")";
+  }
+}
+
+bool LatencyBudgetsAreFatal() {
+  static const bool fatal = []() {
+    const char *p = std::getenv("SHERPA_LATENCY_BUDGET_FATAL");
+    return p != nullptr && p[0] == '1';
+  }();
+  return fatal;
+}
+
+}  // namespace sherpa
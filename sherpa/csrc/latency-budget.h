@@ -0,0 +1,99 @@
+// sherpa/csrc/latency-budget.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_LATENCY_BUDGET_H_
+#define SHERPA_CSRC_LATENCY_BUDGET_H_
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdint>
+
+namespace sherpa {
+
+class Counter;
+
+/** Per-annotation state of SHERPA_LATENCY_BUDGET.
+ *
+ * One instance exists per annotated scope (a function-local static), so
+ * registering the violation counter with the metrics registry happens
+ * once, on the first pass through the scope.
+ */
+class LatencyBudgetSite {
+ public:
+  LatencyBudgetSite(const char *name, int64_t budget_us);
+
+  /// Called by LatencyBudgetScope when the scope overran its budget.
+  /// Counts the violation, logs it rate limited, and aborts when
+  /// LatencyBudgetsAreFatal().
+  void ReportViolation(int64_t elapsed_us);
+
+  int64_t BudgetMicros() const { return budget_us_; }
+
+ private:
+  const char *name_;
+  int64_t budget_us_;
+  Counter *violations_;  // sherpa_latency_budget_violations_<name>
+
+  // Used only to rate limit the log lines; the metric above is the
+  // authoritative count.
+  std::atomic<int64_t> num_logged_{0};
+};
+
+/** Times the enclosing scope; see SHERPA_LATENCY_BUDGET. */
+class LatencyBudgetScope {
+ public:
+  explicit LatencyBudgetScope(LatencyBudgetSite *site)
+      : site_(site), begin_(std::chrono::steady_clock::now()) {}
+
+  ~LatencyBudgetScope() {
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - begin_)
+                          .count();
+    if (elapsed_us > site_->BudgetMicros()) {
+      site_->ReportViolation(elapsed_us);
+    }
+  }
+
+ private:
+  LatencyBudgetSite *site_;
+  std::chrono::steady_clock::time_point begin_;
+};
+
+/// True if the environment variable SHERPA_LATENCY_BUDGET_FATAL is set
+/// to 1. Read once on first use.
+bool LatencyBudgetsAreFatal();
+
+}  // namespace sherpa
+
+#ifdef SHERPA_ENABLE_LATENCY_BUDGETS
+
+/** Assert that the enclosing scope finishes within `budget_us`
+ * microseconds:
+ *
+ *   {
+ *     SHERPA_LATENCY_BUDGET(StackStates, 500);
+ *     ...
+ *   }
+ *
+ * A violation increments sherpa_latency_budget_violations_<name> on the
+ * metrics endpoint and logs a rate-limited warning. With the
+ * environment variable SHERPA_LATENCY_BUDGET_FATAL=1 -- meant for
+ * stress tests -- a violation aborts instead, so a slow-path regression
+ * (e.g., an accidental synchronizing .item() call) fails the test run
+ * rather than shipping. The whole facility compiles to nothing with
+ * -DSHERPA_ENABLE_LATENCY_BUDGETS=OFF.
+ */
+#define SHERPA_LATENCY_BUDGET(name, budget_us)                          \
+  static ::sherpa::LatencyBudgetSite sherpa_latency_site_##name(        \
+      #name, budget_us);                                                \
+  ::sherpa::LatencyBudgetScope sherpa_latency_scope_##name(             \
+      &sherpa_latency_site_##name)
+
+#else
+
+#define SHERPA_LATENCY_BUDGET(name, budget_us) static_cast<void>(0)
+
+#endif  // SHERPA_ENABLE_LATENCY_BUDGETS
+
+#endif  // SHERPA_CSRC_LATENCY_BUDGET_H_
@@ -33,13 +33,17 @@
 #endif  // SHERPA_HAVE_EXECINFO_H
 #include <stdlib.h>
 
+#include <array>
+#include <atomic>
 #include <chrono>  // NOLINT
 #include <cstdint>
 #include <ctime>
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <thread>  // NOLINT
 #include <type_traits>
+#include <utility>
 
 class log_watch {
  public:
@@ -71,6 +75,119 @@ std::string GetDateTimeStr() {
   return os.str();
 }
 
+namespace {
+
+// Capacity of the async log ring buffer. Must be a power of two; see
+// AsyncLogWriter.
+constexpr uint64_t kLogQueueSize = 1024;
+
+// One formatted log line in flight between a producer and the writer
+// thread.
+struct LogSlot {
+  std::atomic<uint64_t> seq;
+  std::string line;
+};
+
+/** The backend behind AsyncLogWrite().
+ *
+ * A bounded lock-free MPSC queue: each slot carries a sequence number
+ * (the classic Vyukov design), producers claim a slot with one
+ * compare-exchange, and the single writer thread drains the slots in
+ * order and writes them to stderr. Messages are formatted on the
+ * calling thread (by Logger) and only handed over here, so the cost a
+ * log site pays is one enqueue instead of terminal or pipe I/O.
+ *
+ * The writer thread starts on first use; the destructor of the
+ * function-local singleton in Get() drains the queue and joins the
+ * thread at program exit.
+ */
+class AsyncLogWriter {
+ public:
+  static AsyncLogWriter &Get() {
+    static AsyncLogWriter writer;
+    return writer;
+  }
+
+  void Write(std::string line) {
+    if (!TryEnqueue(&line)) {
+      // The ring is full, i.e., the writer thread is a whole buffer
+      // behind. Write synchronously instead of dropping the line; the
+      // stall applies backpressure to exactly the threads that log too
+      // fast.
+      fputs(line.c_str(), stderr);
+    }
+  }
+
+  ~AsyncLogWriter() {
+    done_.store(true, std::memory_order_release);
+    thread_.join();
+  }
+
+ private:
+  AsyncLogWriter() {
+    for (uint64_t i = 0; i != kLogQueueSize; ++i) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    thread_ = std::thread([this]() { Run(); });
+  }
+
+  bool TryEnqueue(std::string *line) {
+    uint64_t pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+      LogSlot &slot = slots_[pos & (kLogQueueSize - 1)];
+      uint64_t seq = slot.seq.load(std::memory_order_acquire);
+      auto diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+      if (diff == 0) {
+        // The slot is free; claim it. On failure `pos` has been
+        // reloaded by compare_exchange and we retry.
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          slot.line = std::move(*line);
+          slot.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void Run() {
+    uint64_t pos = 0;
+    while (true) {
+      LogSlot &slot = slots_[pos & (kLogQueueSize - 1)];
+      if (slot.seq.load(std::memory_order_acquire) == pos + 1) {
+        fputs(slot.line.c_str(), stderr);
+        slot.line.clear();
+        // Mark the slot free for the producer one ring ahead.
+        slot.seq.store(pos + kLogQueueSize, std::memory_order_release);
+        ++pos;
+        continue;
+      }
+
+      if (done_.load(std::memory_order_acquire) &&
+          head_.load(std::memory_order_acquire) == pos) {
+        return;  // drained
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  std::array<LogSlot, kLogQueueSize> slots_;
+  std::atomic<uint64_t> head_{0};
+  std::atomic<bool> done_{false};
+  std::thread thread_;
+};
+
+}  // namespace
+
+void AsyncLogWrite(std::string line) {
+  AsyncLogWriter::Get().Write(std::move(line));
+}
+
 static bool LocateSymbolRange(const std::string &trace_name, std::size_t *begin,
                               std::size_t *end) {
   // Find the first '_' with leading ' ' or '('.
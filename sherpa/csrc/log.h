@@ -141,39 +141,69 @@ inline bool EnableAbort() {
   return enable_abort;
 }
 
+/* Return true if the environment variable SHERPA_ASYNC_LOG is set.
+
+   With async logging, a complete log line is handed to a dedicated
+   writer thread through a lock-free ring buffer instead of being
+   written to stderr on the calling thread, so a burst of SHERPA_LOG
+   calls in, e.g., network handlers never stalls them on terminal or
+   pipe I/O. FATAL messages are always written synchronously.
+ */
+inline bool EnableAsyncLog() {
+  static std::once_flag init_flag;
+  static bool enable_async = false;
+  std::call_once(init_flag, []() {
+    enable_async = (std::getenv("SHERPA_ASYNC_LOG") != nullptr);
+  });
+  return enable_async;
+}
+
+/* Enqueue one formatted log line for the writer thread.
+
+   Implemented in log.cc with a bounded lock-free MPSC ring buffer; the
+   writer thread is started on first use and drained at program exit.
+   When the ring is full (the writer is a whole buffer behind), the line
+   is written synchronously instead of being dropped.
+ */
+void AsyncLogWrite(std::string line);
+
+// The message is accumulated in an internal buffer by the operator<<
+// overloads and written out as one complete line by the destructor:
+// synchronously to stderr by default, or through the writer thread of
+// AsyncLogWrite() when SHERPA_ASYNC_LOG is set. FATAL messages are
+// always synchronous, so they reach the terminal before the process
+// aborts or throws.
 class Logger {
  public:
   Logger(const char *filename, const char *func_name, uint32_t line_num,
          LogLevel level)
-      :
-
-        level_(level) {
+      : level_(level) {
     cur_level_ = GetCurrentLogLevel();
+    if (cur_level_ > level_) return;
+
     switch (level) {
       case TRACE:
-        if (cur_level_ <= TRACE) fprintf(stderr, "[T] ");
+        os_ << "[T] ";
         break;
       case DEBUG:
-        if (cur_level_ <= DEBUG) fprintf(stderr, "[D] ");
+        os_ << "[D] ";
         break;
       case INFO:
-        if (cur_level_ <= INFO) fprintf(stderr, "[I] ");
+        os_ << "[I] ";
         break;
       case WARNING:
-        if (cur_level_ <= WARNING) fprintf(stderr, "[W] ");
+        os_ << "[W] ";
         break;
       case ERROR:
-        if (cur_level_ <= ERROR) fprintf(stderr, "[E] ");
+        os_ << "[E] ";
         break;
       case FATAL:
-        if (cur_level_ <= FATAL) fprintf(stderr, "[F] ");
+        os_ << "[F] ";
         break;
     }
 
-    if (cur_level_ <= level_) {
-      fprintf(stderr, "%s:%u:%s %s ", filename, line_num, func_name,
-              GetDateTimeStr().c_str());
-    }
+    os_ << filename << ":" << line_num << ":" << func_name << " "
+        << GetDateTimeStr() << " ";
   }
 
   ~Logger() noexcept(false) {
@@ -190,7 +220,15 @@ class Logger {
 
       https://github.com/k2-fsa/sherpa/issues/new
     )";
-    fprintf(stderr, "\n");
+    if (cur_level_ <= level_) {
+      os_ << "\n";
+      if (level_ != FATAL && EnableAsyncLog()) {
+        AsyncLogWrite(os_.str());
+      } else {
+        fputs(os_.str().c_str(), stderr);
+      }
+    }
+
     if (level_ == FATAL) {
       std::string stack_trace = GetStackTrace();
       if (!stack_trace.empty()) {
@@ -211,50 +249,58 @@ class Logger {
 
   const Logger &operator<<(bool b) const {
     if (cur_level_ <= level_) {
-      fprintf(stderr, b ? "true" : "false");
+      os_ << (b ? "true" : "false");
     }
     return *this;
   }
 
   const Logger &operator<<(int8_t i) const {
-    if (cur_level_ <= level_) fprintf(stderr, "%d", i);
+    if (cur_level_ <= level_) os_ << static_cast<int32_t>(i);
     return *this;
   }
 
   const Logger &operator<<(const char *s) const {
-    if (cur_level_ <= level_) fprintf(stderr, "%s", s);
+    if (cur_level_ <= level_) os_ << s;
     return *this;
   }
 
   const Logger &operator<<(int32_t i) const {
-    if (cur_level_ <= level_) fprintf(stderr, "%d", i);
+    if (cur_level_ <= level_) os_ << i;
     return *this;
   }
 
   const Logger &operator<<(uint32_t i) const {
-    if (cur_level_ <= level_) fprintf(stderr, "%u", i);
+    if (cur_level_ <= level_) os_ << i;
     return *this;
   }
 
   const Logger &operator<<(uint64_t i) const {
-    if (cur_level_ <= level_)
-      fprintf(stderr, "%llu", (long long unsigned int)i);  // NOLINT
+    if (cur_level_ <= level_) os_ << i;
     return *this;
   }
 
   const Logger &operator<<(int64_t i) const {
-    if (cur_level_ <= level_)
-      fprintf(stderr, "%lli", (long long int)i);  // NOLINT
+    if (cur_level_ <= level_) os_ << i;
     return *this;
   }
 
   const Logger &operator<<(float f) const {
-    if (cur_level_ <= level_) fprintf(stderr, "%f", f);
+    if (cur_level_ <= level_) {
+      // Match the "%f" formatting of fprintf, which the logs used
+      // historically, instead of the default ostream formatting.
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%f", f);
+      os_ << buf;
+    }
     return *this;
   }
 
   const Logger &operator<<(double d) const {
-    if (cur_level_ <= level_) fprintf(stderr, "%f", d);
+    if (cur_level_ <= level_) {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%f", d);
+      os_ << buf;
+    }
     return *this;
   }
 
@@ -275,6 +321,7 @@ class Logger {
  private:
   LogLevel level_;
   LogLevel cur_level_;
+  mutable std::ostringstream os_;
 };
 
 class Voidifier {
@@ -332,9 +379,25 @@ class Voidifier {
 #define SHERPA_CHECK_GT(x, y) _SHERPA_CHECK_OP(x, y, >)
 #define SHERPA_CHECK_GE(x, y) _SHERPA_CHECK_OP(x, y, >=)
 
-#define SHERPA_LOG(x) \
+// Log sites below SHERPA_MIN_LOG_LEVEL are removed at compile time:
+// the condition is a constant expression, so the dead branch -- the
+// Logger and the evaluation of everything streamed into it -- is
+// discarded by the compiler. For instance, building with
+// -DSHERPA_MIN_LOG_LEVEL=2 strips all TRACE and DEBUG sites (see the
+// values of LogLevel). The default keeps every site and filtering is
+// purely runtime, as before.
+#ifndef SHERPA_MIN_LOG_LEVEL
+#define SHERPA_MIN_LOG_LEVEL 0
+#endif
+
+#define _SHERPA_LOG_IMPL(x) \
   ::sherpa::Logger(__FILE__, SHERPA_FUNC, __LINE__, ::sherpa::x)
 
+#define SHERPA_LOG(x)                                    \
+  (static_cast<int>(::sherpa::x) < SHERPA_MIN_LOG_LEVEL) \
+      ? (void)0                                          \
+      : ::sherpa::Voidifier() & _SHERPA_LOG_IMPL(x)
+
 // ------------------------------------------------------------
 //       For debug check
 // ------------------------------------------------------------
@@ -361,7 +424,10 @@ class Voidifier {
 #define SHERPA_DCHECK_GE(x, y) \
   ::sherpa::kDisableDebug ? (void)0 : SHERPA_CHECK_GE(x, y)
 
-#define SHERPA_DLOG(x) \
-  ::sherpa::kDisableDebug ? (void)0 : ::sherpa::Voidifier() & SHERPA_LOG(x)
+#define SHERPA_DLOG(x)                                    \
+  (::sherpa::kDisableDebug ||                             \
+   static_cast<int>(::sherpa::x) < SHERPA_MIN_LOG_LEVEL)  \
+      ? (void)0                                           \
+      : ::sherpa::Voidifier() & _SHERPA_LOG_IMPL(x)
 
 #endif  // SHERPA_CSRC_LOG_H_
@@ -19,7 +19,10 @@
 #ifndef SHERPA_CSRC_MATH_H_
 #define SHERPA_CSRC_MATH_H_
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <vector>
 
 namespace sherpa {
 
@@ -76,5 +79,72 @@ struct LogAdd<float> {
   }
 };
 
+/** Element-wise log-add over contiguous arrays.
+ *
+ * Computes ans[i] = LogAdd(x[i], y[i]) for i in [0, n). The loop body is
+ * branch-free so that compilers can auto-vectorize it (AVX2 on x86,
+ * NEON on aarch64) without per-platform intrinsics.
+ *
+ * It is fine for `ans` to alias `x` or `y`.
+ */
+template <typename T>
+void LogAddBatch(const T *x, const T *y, T *ans, int32_t n) {
+  for (int32_t i = 0; i != n; ++i) {
+    T max = std::max(x[i], y[i]);
+    T diff = std::min(x[i], y[i]) - max;
+    // log1p(exp(diff)) tends to 0 as diff -> -inf, so clamping diff only
+    // keeps exp() within range; it does not change the result.
+    diff = std::max(diff, static_cast<T>(SHERPA_MIN_LOG_DIFF_DOUBLE));
+    ans[i] = max + std::log1p(std::exp(diff));
+  }
+}
+
+/** Indexes of the k largest elements of [data, data + n), ordered by
+ * decreasing value; ties go to the smaller index.
+ *
+ * The selection keeps a bounded min-heap of the best k entries seen so
+ * far and never sorts the full candidate set, i.e., O(n log k) instead
+ * of the O(n log n) of a full sort. It is used by the modified
+ * beam-search decoders, where n is num_hyps * vocab_size and k is the
+ * beam size, so k << n.
+ *
+ * If k >= n, all n indexes are returned, still ordered by decreasing
+ * value.
+ */
+template <typename T>
+std::vector<int32_t> TopK(const T *data, int32_t n, int32_t k) {
+  std::vector<int32_t> indexes;
+  if (n <= 0 || k <= 0) {
+    return indexes;
+  }
+
+  k = std::min(k, n);
+  indexes.reserve(k);
+
+  // "a before b" in the final ordering: by decreasing value, then by
+  // increasing index. Used as the heap comparator it keeps the weakest
+  // of the selected k at the front, where it can be evicted cheaply.
+  auto before = [data](int32_t a, int32_t b) {
+    if (data[a] != data[b]) {
+      return data[a] > data[b];
+    }
+    return a < b;
+  };
+
+  for (int32_t i = 0; i != n; ++i) {
+    if (static_cast<int32_t>(indexes.size()) < k) {
+      indexes.push_back(i);
+      std::push_heap(indexes.begin(), indexes.end(), before);
+    } else if (before(i, indexes.front())) {
+      std::pop_heap(indexes.begin(), indexes.end(), before);
+      indexes.back() = i;
+      std::push_heap(indexes.begin(), indexes.end(), before);
+    }
+  }
+
+  std::sort_heap(indexes.begin(), indexes.end(), before);
+  return indexes;
+}
+
 }  // namespace sherpa
 #endif  // SHERPA_CSRC_MATH_H_
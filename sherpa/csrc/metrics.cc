@@ -0,0 +1,146 @@
+// sherpa/csrc/metrics.cc
+//
+// Copyright (c)  2022  Xiaomi Corporation
+
+#include "sherpa/csrc/metrics.h"
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+#include "sherpa/csrc/log.h"
+
+namespace sherpa {
+
+Histogram::Histogram(std::vector<double> bounds) : bounds_(std::move(bounds)) {
+  SHERPA_CHECK(std::is_sorted(bounds_.begin(), bounds_.end()))
+      << "Histogram bucket bounds must be ascending";
+
+  buckets_ = std::make_unique<std::atomic<int64_t>[]>(bounds_.size() + 1);
+  for (size_t i = 0; i != bounds_.size() + 1; ++i) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::Observe(double value) {
+  auto it = std::lower_bound(bounds_.begin(), bounds_.end(), value);
+  buckets_[it - bounds_.begin()].fetch_add(1, std::memory_order_relaxed);
+
+  count_.fetch_add(1, std::memory_order_relaxed);
+
+  // There is no fetch_add for atomic<double> before C++20, so use a CAS
+  // loop. Contention is low: one observation per batch, not per frame.
+  double cur = sum_.load(std::memory_order_relaxed);
+  while (!sum_.compare_exchange_weak(cur, cur + value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+void Histogram::Render(const std::string &name, std::string *os) const {
+  std::ostringstream s;
+
+  int64_t cumulative = 0;
+  for (size_t i = 0; i != bounds_.size(); ++i) {
+    cumulative += buckets_[i].load(std::memory_order_relaxed);
+    s << name << "_bucket{le=\"" << bounds_[i] << "\"} " << cumulative << "\n";
+  }
+  cumulative += buckets_[bounds_.size()].load(std::memory_order_relaxed);
+  s << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+
+  s << name << "_sum " << sum_.load(std::memory_order_relaxed) << "\n";
+  s << name << "_count " << count_.load(std::memory_order_relaxed) << "\n";
+
+  *os += s.str();
+}
+
+MetricsRegistry &MetricsRegistry::Get() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+MetricsRegistry::Entry *MetricsRegistry::Find(const std::string &name) {
+  for (auto &e : entries_) {
+    if (e->name == name) {
+      return e.get();
+    }
+  }
+  return nullptr;
+}
+
+Counter *MetricsRegistry::GetCounter(const std::string &name,
+                                     const std::string &help) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (Entry *e = Find(name)) {
+    SHERPA_CHECK_EQ(e->type, "counter");
+    return e->counter.get();
+  }
+
+  auto e = std::make_unique<Entry>();
+  e->name = name;
+  e->help = help;
+  e->type = "counter";
+  e->counter = std::make_unique<Counter>();
+
+  auto *ans = e->counter.get();
+  entries_.push_back(std::move(e));
+  return ans;
+}
+
+Gauge *MetricsRegistry::GetGauge(const std::string &name,
+                                 const std::string &help) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (Entry *e = Find(name)) {
+    SHERPA_CHECK_EQ(e->type, "gauge");
+    return e->gauge.get();
+  }
+
+  auto e = std::make_unique<Entry>();
+  e->name = name;
+  e->help = help;
+  e->type = "gauge";
+  e->gauge = std::make_unique<Gauge>();
+
+  auto *ans = e->gauge.get();
+  entries_.push_back(std::move(e));
+  return ans;
+}
+
+Histogram *MetricsRegistry::GetHistogram(const std::string &name,
+                                         const std::string &help,
+                                         std::vector<double> bounds) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (Entry *e = Find(name)) {
+    SHERPA_CHECK_EQ(e->type, "histogram");
+    return e->histogram.get();
+  }
+
+  auto e = std::make_unique<Entry>();
+  e->name = name;
+  e->help = help;
+  e->type = "histogram";
+  e->histogram = std::make_unique<Histogram>(std::move(bounds));
+
+  auto *ans = e->histogram.get();
+  entries_.push_back(std::move(e));
+  return ans;
+}
+
+std::string MetricsRegistry::Render() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::string ans;
+  for (const auto &e : entries_) {
+    ans += "# HELP " + e->name + " " + e->help + "\n";
+    ans += "# TYPE " + e->name + " " + e->type + "\n";
+    if (e->counter) {
+      ans += e->name + " " + std::to_string(e->counter->Value()) + "\n";
+    } else if (e->gauge) {
+      ans += e->name + " " + std::to_string(e->gauge->Value()) + "\n";
+    } else {
+      e->histogram->Render(e->name, &ans);
+    }
+  }
+  return ans;
+}
+
+}  // namespace sherpa
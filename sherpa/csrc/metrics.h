@@ -0,0 +1,133 @@
+// sherpa/csrc/metrics.h
+//
+// Copyright (c)  2022  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_METRICS_H_
+#define SHERPA_CSRC_METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+namespace sherpa {
+
+/** A monotonically increasing counter.
+ *
+ * Updates are a single relaxed atomic add, so it is safe (and cheap) to
+ * bump it from the decode workers and the network threads alike.
+ */
+class Counter {
+ public:
+  void Inc(int64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+
+  int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> value_{0};
+};
+
+/** A value that can go up and down, e.g., a queue depth. */
+class Gauge {
+ public:
+  void Set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+
+  int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> value_{0};
+};
+
+/** A histogram with fixed bucket bounds, chosen at registration time.
+ *
+ * Observations touch only relaxed atomics; there is no lock anywhere on
+ * the observation path. It renders in the Prometheus histogram format
+ * (cumulative buckets with `le` labels plus `_sum` and `_count`).
+ */
+class Histogram {
+ public:
+  /**
+   * @param bounds Upper bounds of the buckets, in ascending order. An
+   *               implicit +Inf bucket is always appended.
+   */
+  explicit Histogram(std::vector<double> bounds);
+
+  void Observe(double value);
+
+  /** Append the rendered samples of this histogram to `os`.
+   *
+   * @param name The metric name, used as the prefix of every sample.
+   * @param os The output to append to.
+   */
+  void Render(const std::string &name, std::string *os) const;
+
+ private:
+  std::vector<double> bounds_;
+
+  // bounds_.size() + 1 entries; the last one is the +Inf bucket.
+  // Buckets are non-cumulative internally; Render() accumulates them.
+  std::unique_ptr<std::atomic<int64_t>[]> buckets_;
+
+  std::atomic<int64_t> count_{0};
+  std::atomic<double> sum_{0};
+};
+
+/** A process-wide registry of named metrics.
+ *
+ * Metrics are registered once, normally at startup, and live for the
+ * lifetime of the process; updating a metric through the returned
+ * pointer is lock free. Render() produces the Prometheus text format
+ * and is meant to back a /metrics HTTP endpoint.
+ */
+class MetricsRegistry {
+ public:
+  /** Return the process-wide registry. */
+  static MetricsRegistry &Get();
+
+  /** Register (or look up) a counter with the given name.
+   *
+   * The returned pointer is valid for the lifetime of the process.
+   */
+  Counter *GetCounter(const std::string &name, const std::string &help);
+
+  /** Register (or look up) a gauge with the given name. */
+  Gauge *GetGauge(const std::string &name, const std::string &help);
+
+  /** Register (or look up) a histogram with the given name.
+   *
+   * @param bounds Upper bucket bounds; see Histogram. Ignored if a
+   *               histogram with this name already exists.
+   */
+  Histogram *GetHistogram(const std::string &name, const std::string &help,
+                          std::vector<double> bounds);
+
+  /** Render all registered metrics in the Prometheus text format. */
+  std::string Render() const;
+
+ private:
+  MetricsRegistry() = default;
+
+  struct Entry {
+    std::string name;
+    std::string help;
+    std::string type;  // "counter", "gauge" or "histogram"
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+  };
+
+  Entry *Find(const std::string &name);
+
+  // It protects `entries_`. It is taken only on registration and on
+  // Render(); metric updates never touch it.
+  mutable std::mutex mutex_;
+
+  // Kept in registration order so the rendered output is stable.
+  std::vector<std::unique_ptr<Entry>> entries_;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_METRICS_H_
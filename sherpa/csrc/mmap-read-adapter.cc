@@ -0,0 +1,95 @@
+// sherpa/csrc/mmap-read-adapter.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/mmap-read-adapter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "sherpa/csrc/log.h"
+
+namespace sherpa {
+
+#ifndef _WIN32
+
+namespace {
+
+// Presents a read-only memory mapping of a file to torch::jit::load().
+// The mapping is shared, so every process loading the same model reads
+// from the same page-cache pages.
+class MmapReadAdapter : public caffe2::serialize::ReadAdapterInterface {
+ public:
+  MmapReadAdapter(void *data, size_t size) : data_(data), size_(size) {}
+
+  MmapReadAdapter(const MmapReadAdapter &) = delete;
+  MmapReadAdapter &operator=(const MmapReadAdapter &) = delete;
+
+  ~MmapReadAdapter() override { munmap(data_, size_); }
+
+  size_t size() const override { return size_; }
+
+  size_t read(uint64_t pos, void *buf, size_t n,
+              const char *what = "") const override {
+    if (pos >= size_) {
+      return 0;
+    }
+    n = std::min<size_t>(n, size_ - pos);
+    std::memcpy(buf, static_cast<const char *>(data_) + pos, n);
+    return n;
+  }
+
+ private:
+  void *data_;
+  size_t size_;
+};
+
+}  // namespace
+
+torch::jit::Module LoadModule(const std::string &filename,
+                              torch::Device map_location) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    SHERPA_LOG(FATAL) << "Failed to open " << filename;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+    close(fd);
+    return torch::jit::load(filename, map_location);
+  }
+
+  void *data =
+      mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, /*offset*/ 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    SHERPA_LOG(WARNING) << "Failed to mmap " << filename
+                        << "; falling back to a buffered read";
+    return torch::jit::load(filename, map_location);
+  }
+
+  auto adapter = std::make_shared<MmapReadAdapter>(
+      data, static_cast<size_t>(info.st_size));
+  return torch::jit::load(std::move(adapter), map_location);
+}
+
+#else
+
+torch::jit::Module LoadModule(const std::string &filename,
+                              torch::Device map_location) {
+  return torch::jit::load(filename, map_location);
+}
+
+#endif
+
+}  // namespace sherpa
@@ -0,0 +1,35 @@
+// sherpa/csrc/mmap-read-adapter.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_MMAP_READ_ADAPTER_H_
+#define SHERPA_CSRC_MMAP_READ_ADAPTER_H_
+
+#include <string>
+
+#include "torch/script.h"
+
+namespace sherpa {
+
+/** Load a TorchScript model, memory-mapping the file when possible.
+ *
+ * Instead of reading the whole .pt file into a private buffer up front,
+ * the file is mapped read-only and handed to torch::jit::load() through a
+ * ReadAdapterInterface, so weight pages are faulted in lazily on first
+ * use and concurrent processes loading the same model share the kernel
+ * page cache rather than each materializing its own copy. This makes the
+ * cold start of short-lived processes (e.g., sherpa-offline batch jobs)
+ * much cheaper.
+ *
+ * On platforms without mmap, or if mapping the file fails, it falls back
+ * to a plain torch::jit::load().
+ *
+ * @param filename Path to the TorchScript model.
+ * @param map_location Device to load the model onto.
+ */
+torch::jit::Module LoadModule(const std::string &filename,
+                              torch::Device map_location);
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_MMAP_READ_ADAPTER_H_
@@ -0,0 +1,370 @@
+// sherpa/csrc/ngram-lm.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/ngram-lm.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "sherpa/csrc/log.h"
+#include "sherpa/csrc/symbol-table.h"
+
+namespace sherpa {
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'N', 'G', 'R', 'A', 'M', 'L', '1'};
+
+// ln(10); ARPA stores log10 probabilities.
+constexpr float kLn10 = 2.302585092994046f;
+
+// Natural-log probability of tokens unseen even as unigrams, when the
+// ARPA file has no <unk> entry.
+constexpr float kDefaultUnkLogProb = -23.0f;
+
+struct NgramLmFileHeader {
+  char magic[8];
+  int32_t order;
+  int32_t num_states;
+  int64_t num_arcs;
+  float unk_log_prob;
+  int32_t reserved;
+};
+
+static_assert(sizeof(NgramLmFileHeader) == 32, "");
+
+struct Gram {
+  float log_prob;
+  float backoff = 0;
+};
+
+}  // namespace
+
+NgramLm::NgramLm(const std::string &binary_filename) {
+#ifndef _MSC_VER
+  int fd = open(binary_filename.c_str(), O_RDONLY);
+  if (fd != -1) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= 0) {
+      size_ = st.st_size;
+      void *p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+      if (p != MAP_FAILED) {
+        data_ = reinterpret_cast<const char *>(p);
+        mmapped_ = true;
+      }
+    }
+    close(fd);
+  }
+#endif
+
+  if (!data_) {
+    // No mmap on this platform, or mapping failed; fall back to a
+    // private in-memory copy.
+    std::ifstream is(binary_filename, std::ios::binary | std::ios::ate);
+    SHERPA_CHECK(is.good()) << "Failed to open " << binary_filename;
+    size_ = is.tellg();
+    is.seekg(0);
+    char *buf = new char[size_];
+    is.read(buf, size_);
+    SHERPA_CHECK(is.good()) << "Failed to read " << binary_filename;
+    data_ = buf;
+  }
+
+  SHERPA_CHECK_GE(size_, sizeof(NgramLmFileHeader))
+      << binary_filename << " is not an n-gram LM binary";
+
+  NgramLmFileHeader header;
+  std::memcpy(&header, data_, sizeof(header));
+  SHERPA_CHECK_EQ(std::memcmp(header.magic, kMagic, sizeof(kMagic)), 0)
+      << binary_filename << " is not an n-gram LM binary";
+
+  order_ = header.order;
+  num_states_ = header.num_states;
+  num_arcs_ = header.num_arcs;
+  unk_log_prob_ = header.unk_log_prob;
+
+  const char *p = data_ + sizeof(header);
+  backoff_ = reinterpret_cast<const float *>(p);
+  p += sizeof(float) * num_states_;
+  backoff_state_ = reinterpret_cast<const int32_t *>(p);
+  p += sizeof(int32_t) * num_states_;
+  arc_begin_ = reinterpret_cast<const int64_t *>(p);
+  p += sizeof(int64_t) * (num_states_ + 1);
+  arc_token_ = reinterpret_cast<const int32_t *>(p);
+  p += sizeof(int32_t) * num_arcs_;
+  arc_next_state_ = reinterpret_cast<const int32_t *>(p);
+  p += sizeof(int32_t) * num_arcs_;
+  arc_log_prob_ = reinterpret_cast<const float *>(p);
+  p += sizeof(float) * num_arcs_;
+
+  SHERPA_CHECK_EQ(p - data_, static_cast<int64_t>(size_))
+      << binary_filename << " is truncated";
+}
+
+NgramLm::~NgramLm() {
+  if (mmapped_) {
+#ifndef _MSC_VER
+    munmap(const_cast<char *>(data_), size_);
+#endif
+  } else {
+    delete[] data_;
+  }
+}
+
+float NgramLm::Score(int32_t state, int32_t token,
+                     int32_t *next_state) const {
+  float backoff_sum = 0;
+
+  while (true) {
+    const int32_t *begin = arc_token_ + arc_begin_[state];
+    const int32_t *end = arc_token_ + arc_begin_[state + 1];
+    const int32_t *it = std::lower_bound(begin, end, token);
+    if (it != end && *it == token) {
+      int64_t i = arc_begin_[state] + (it - begin);
+      *next_state = arc_next_state_[i];
+      return backoff_sum + arc_log_prob_[i];
+    }
+
+    if (state == 0) {
+      *next_state = 0;
+      return backoff_sum + unk_log_prob_;
+    }
+
+    backoff_sum += backoff_[state];
+    state = backoff_state_[state];
+  }
+}
+
+void NgramLm::CompileArpa(const std::string &arpa_filename,
+                          const SymbolTable &symbol_table,
+                          const std::string &binary_filename) {
+  std::ifstream is(arpa_filename);
+  SHERPA_CHECK(is.good()) << "Failed to open " << arpa_filename;
+
+  std::string line;
+  while (std::getline(is, line) && line != "\\data\\") {
+  }
+  SHERPA_CHECK(is.good()) << "No \\data\\ section in " << arpa_filename;
+
+  int32_t order = 0;
+  while (std::getline(is, line) && !line.empty()) {
+    if (line.compare(0, 6, "ngram ") == 0) {
+      ++order;
+    }
+  }
+  SHERPA_CHECK_GT(order, 0) << "No n-gram counts in " << arpa_filename;
+
+  // Maps an n-gram, as a token-ID sequence, to its scores. std::map
+  // keeps the grams sorted, so a gram always precedes its extensions.
+  std::map<std::vector<int32_t>, Gram> grams;
+  float unk_log_prob = kDefaultUnkLogProb;
+  int64_t num_dropped = 0;
+
+  for (int32_t n = 1; n <= order; ++n) {
+    std::ostringstream section;
+    section << "\\" << n << "-grams:";
+    while (std::getline(is, line) && line != section.str()) {
+    }
+    SHERPA_CHECK(is.good()) << "No " << section.str() << " section in "
+                            << arpa_filename;
+
+    while (std::getline(is, line) && !line.empty()) {
+      std::istringstream iss(line);
+      float log10_prob;
+      if (!(iss >> log10_prob)) {
+        break;  // the \end\ marker or the next section header
+      }
+
+      std::vector<int32_t> gram;
+      gram.reserve(n);
+      bool ok = true;
+      for (int32_t i = 0; i != n; ++i) {
+        std::string word;
+        iss >> word;
+
+        if (!symbol_table.contains(word) && word.size() >= 3) {
+          // For BPE-based models, ▁ was replaced with a space when the
+          // symbol table was loaded.
+          // Unicode 9601, hex 0x2581, utf8 0xe29681
+          const uint8_t *p = reinterpret_cast<const uint8_t *>(word.c_str());
+          if (p[0] == 0xe2 && p[1] == 0x96 && p[2] == 0x81) {
+            word = word.replace(0, 3, " ");
+          }
+        }
+
+        if (!symbol_table.contains(word)) {
+          if (n == 1 && (word == "<unk>" || word == "<UNK>")) {
+            unk_log_prob = log10_prob * kLn10;
+          }
+          ok = false;
+          break;
+        }
+        gram.push_back(symbol_table[word]);
+      }
+
+      if (!ok) {
+        ++num_dropped;
+        continue;
+      }
+
+      Gram g;
+      g.log_prob = log10_prob * kLn10;
+      float backoff;
+      if (iss >> backoff) {
+        g.backoff = backoff * kLn10;
+      }
+      grams[std::move(gram)] = g;
+    }
+  }
+
+  if (num_dropped > 0) {
+    SHERPA_LOG(WARNING) << "Dropped " << num_dropped << " n-grams of "
+                        << arpa_filename
+                        << " containing words not in the symbol table, "
+                           "e.g., <s>, </s> and <unk>";
+  }
+
+  // Assign state IDs: 0 is the empty context; every gram shorter than
+  // the model order is a context state.
+  std::map<std::vector<int32_t>, int32_t> state_id;
+  state_id[{}] = 0;
+  for (const auto &p : grams) {
+    if (static_cast<int32_t>(p.first.size()) < order) {
+      int32_t id = static_cast<int32_t>(state_id.size());
+      state_id[p.first] = id;
+    }
+  }
+  int32_t num_states = static_cast<int32_t>(state_id.size());
+
+  // The longest suffix of the gram that is a context state.
+  auto SuffixState = [&state_id](const std::vector<int32_t> &gram,
+                                 size_t from) -> int32_t {
+    for (size_t i = from; i < gram.size(); ++i) {
+      auto it = state_id.find(
+          std::vector<int32_t>(gram.begin() + i, gram.end()));
+      if (it != state_id.end()) {
+        return it->second;
+      }
+    }
+    return 0;
+  };
+
+  std::vector<float> backoff(num_states, 0);
+  std::vector<int32_t> backoff_state(num_states, 0);
+  for (const auto &p : state_id) {
+    if (p.first.empty()) {
+      continue;
+    }
+    backoff[p.second] = grams[p.first].backoff;
+    backoff_state[p.second] = SuffixState(p.first, 1);
+  }
+
+  // One arc per gram, from the state of its leading (n-1) tokens.
+  std::vector<std::tuple<int32_t, int32_t, int32_t, float>> arcs;
+  arcs.reserve(grams.size());
+  for (const auto &p : grams) {
+    const auto &gram = p.first;
+    auto it = state_id.find(
+        std::vector<int32_t>(gram.begin(), gram.end() - 1));
+    if (it == state_id.end()) {
+      // The ARPA file lacks the prefix gram; unreachable, so drop it.
+      continue;
+    }
+
+    auto g = state_id.find(gram);
+    int32_t next =
+        (g != state_id.end()) ? g->second : SuffixState(gram, 1);
+
+    arcs.emplace_back(it->second, gram.back(), next, p.second.log_prob);
+  }
+  std::sort(arcs.begin(), arcs.end());
+  int64_t num_arcs = static_cast<int64_t>(arcs.size());
+
+  std::vector<int64_t> arc_begin(num_states + 1, 0);
+  std::vector<int32_t> arc_token(num_arcs);
+  std::vector<int32_t> arc_next_state(num_arcs);
+  std::vector<float> arc_log_prob(num_arcs);
+  for (int64_t i = 0; i != num_arcs; ++i) {
+    arc_begin[std::get<0>(arcs[i]) + 1] = i + 1;
+    arc_token[i] = std::get<1>(arcs[i]);
+    arc_next_state[i] = std::get<2>(arcs[i]);
+    arc_log_prob[i] = std::get<3>(arcs[i]);
+  }
+  for (int32_t s = 0; s != num_states; ++s) {
+    arc_begin[s + 1] = std::max(arc_begin[s + 1], arc_begin[s]);
+  }
+
+  NgramLmFileHeader header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.order = order;
+  header.num_states = num_states;
+  header.num_arcs = num_arcs;
+  header.unk_log_prob = unk_log_prob;
+
+  std::ofstream os(binary_filename, std::ios::binary);
+  SHERPA_CHECK(os.good()) << "Failed to create " << binary_filename;
+  os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  os.write(reinterpret_cast<const char *>(backoff.data()),
+           sizeof(float) * num_states);
+  os.write(reinterpret_cast<const char *>(backoff_state.data()),
+           sizeof(int32_t) * num_states);
+  os.write(reinterpret_cast<const char *>(arc_begin.data()),
+           sizeof(int64_t) * (num_states + 1));
+  os.write(reinterpret_cast<const char *>(arc_token.data()),
+           sizeof(int32_t) * num_arcs);
+  os.write(reinterpret_cast<const char *>(arc_next_state.data()),
+           sizeof(int32_t) * num_arcs);
+  os.write(reinterpret_cast<const char *>(arc_log_prob.data()),
+           sizeof(float) * num_arcs);
+  SHERPA_CHECK(os.good()) << "Failed to write " << binary_filename;
+}
+
+std::string NgramLm::CompileArpaCached(const std::string &arpa_filename,
+                                       const SymbolTable &symbol_table) {
+  std::string binary_filename = arpa_filename + ".bin";
+
+  struct stat arpa_stat;
+  SHERPA_CHECK_EQ(stat(arpa_filename.c_str(), &arpa_stat), 0)
+      << "Failed to stat " << arpa_filename;
+
+  struct stat bin_stat;
+  if (stat(binary_filename.c_str(), &bin_stat) == 0 &&
+      bin_stat.st_mtime >= arpa_stat.st_mtime) {
+    return binary_filename;
+  }
+
+  SHERPA_LOG(INFO) << "Compiling " << arpa_filename << " to "
+                   << binary_filename;
+
+  // Write to a temporary file and rename it into place, so concurrent
+  // processes never load a half-written LM.
+  std::ostringstream tmp;
+  tmp << binary_filename << ".tmp." << getpid();
+  CompileArpa(arpa_filename, symbol_table, tmp.str());
+  SHERPA_CHECK_EQ(std::rename(tmp.str().c_str(), binary_filename.c_str()), 0)
+      << "Failed to rename " << tmp.str() << " to " << binary_filename;
+
+  return binary_filename;
+}
+
+}  // namespace sherpa
@@ -0,0 +1,112 @@
+// sherpa/csrc/ngram-lm.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_NGRAM_LM_H_
+#define SHERPA_CSRC_NGRAM_LM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sherpa {
+
+class SymbolTable;
+
+/** A token-level n-gram LM in a memory-mapped trie, used for shallow
+ * fusion in the modified beam search decoders.
+ *
+ * The LM is compiled once from an ARPA file into a compact binary trie
+ * (see CompileArpa()) and then memory-mapped read-only, so all server
+ * processes on a machine share one page-cached image of the LM and a
+ * per-token query is a handful of pointer chases and binary searches --
+ * no I/O and no per-process copy.
+ *
+ * Each hypothesis carries a single LM-state ID (an index into the state
+ * array; 0 is the empty context). Score() advances the state by one
+ * token and returns the conditional log-probability, following the
+ * backoff chain when the n-gram is unseen.
+ *
+ * All scores are natural logarithms; the log10 values of the ARPA file
+ * are converted at compile time.
+ */
+class NgramLm {
+ public:
+  /// Load a binary LM produced by CompileArpa(). The file is mapped
+  /// read-only; on platforms without mmap it is read into memory.
+  explicit NgramLm(const std::string &binary_filename);
+  ~NgramLm();
+
+  NgramLm(const NgramLm &) = delete;
+  NgramLm &operator=(const NgramLm &) = delete;
+
+  /** Score one token and advance the LM state.
+   *
+   * @param state  The current state ID; 0 for the empty context.
+   * @param token  The predicted token.
+   * @param next_state  On return, the state after consuming the token.
+   *                    It may alias &state.
+   *
+   * @return Return log p(token | state) in natural log, including the
+   *         backoff penalties. Tokens absent even as unigrams get the
+   *         unknown-word log-probability.
+   */
+  float Score(int32_t state, int32_t token, int32_t *next_state) const;
+
+  int32_t Order() const { return order_; }
+  int32_t NumStates() const { return num_states_; }
+
+  /** Compile an ARPA file into the binary trie format.
+   *
+   * LM words are looked up in the given symbol table (the BPE word
+   * marker is accepted both in its original form and as the leading
+   * space it is replaced with at load time); n-grams containing words
+   * that are not in the table are dropped with a warning. The
+   * log-probability of `<unk>`, if present, is kept as the score of
+   * tokens unseen even as unigrams.
+   *
+   * @param arpa_filename  Path to the ARPA file.
+   * @param symbol_table  Maps LM words to token IDs.
+   * @param binary_filename  Output path.
+   */
+  static void CompileArpa(const std::string &arpa_filename,
+                          const SymbolTable &symbol_table,
+                          const std::string &binary_filename);
+
+  /** Return the path of the compiled binary for the given ARPA file,
+   * compiling it next to the ARPA file on first use.
+   *
+   * The binary is `<arpa_filename>.bin`; it is reused if it is newer
+   * than the ARPA file and recompiled otherwise. Compilation writes to
+   * a temporary file and renames it into place, so concurrent processes
+   * starting on the same machine never observe a half-written LM.
+   */
+  static std::string CompileArpaCached(const std::string &arpa_filename,
+                                       const SymbolTable &symbol_table);
+
+ private:
+  // The raw file image; pointers below point into it.
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  bool mmapped_ = false;
+
+  int32_t order_ = 0;
+  int32_t num_states_ = 0;
+  int64_t num_arcs_ = 0;
+  float unk_log_prob_ = 0;
+
+  // Per state: backoff penalty and the state of the next-shorter
+  // context; arcs of state s are [arc_begin_[s], arc_begin_[s + 1]),
+  // sorted by token.
+  const float *backoff_ = nullptr;
+  const int32_t *backoff_state_ = nullptr;
+  const int64_t *arc_begin_ = nullptr;
+
+  const int32_t *arc_token_ = nullptr;
+  const int32_t *arc_next_state_ = nullptr;
+  const float *arc_log_prob_ = nullptr;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_NGRAM_LM_H_
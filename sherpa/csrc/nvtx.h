@@ -0,0 +1,66 @@
+// sherpa/csrc/nvtx.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_NVTX_H_
+#define SHERPA_CSRC_NVTX_H_
+
+#include <cstdint>
+
+#ifdef SHERPA_ENABLE_NVTX
+#include <cstdio>
+
+#include "nvToolsExt.h"
+#endif
+
+namespace sherpa {
+
+/** An RAII NVTX range for profiling the decode pipeline with nsys.
+ *
+ * Unless the build enables -DSHERPA_ENABLE_NVTX (see the cmake option
+ * of the same name), every method is an empty inline function, so the
+ * annotations cost nothing in production builds.
+ *
+ * Usage:
+ *   {
+ *     ScopedNvtxRange range("RunEncoder", batch_size);
+ *     // ... the code to profile ...
+ *   }  // the range ends here
+ */
+class ScopedNvtxRange {
+ public:
+  explicit ScopedNvtxRange(const char *name) {
+#ifdef SHERPA_ENABLE_NVTX
+    nvtxRangePushA(name);
+#else
+    (void)name;
+#endif
+  }
+
+  /// Like the above, but the range is named "<name>/<batch_size>",
+  /// e.g., "RunEncoder/8", so ranges of different batch sizes can be
+  /// told apart in the timeline.
+  ScopedNvtxRange(const char *name, int32_t batch_size) {
+#ifdef SHERPA_ENABLE_NVTX
+    char buf[80];
+    std::snprintf(buf, sizeof(buf), "%s/%d", name, batch_size);
+    nvtxRangePushA(buf);
+#else
+    (void)name;
+    (void)batch_size;
+#endif
+  }
+
+  ~ScopedNvtxRange() {
+#ifdef SHERPA_ENABLE_NVTX
+    nvtxRangePop();
+#endif
+  }
+
+  ScopedNvtxRange(const ScopedNvtxRange &) = delete;
+  ScopedNvtxRange &operator=(const ScopedNvtxRange &) = delete;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_NVTX_H_
@@ -6,12 +6,14 @@
 #include <string>
 #include <vector>
 
+#include "sherpa/csrc/mmap-read-adapter.h"
+
 namespace sherpa {
 
 OfflineConformerCtcModel::OfflineConformerCtcModel(
     const std::string &filename, torch::Device device /*= torch::kCPU*/)
     : device_(device) {
-  model_ = torch::jit::load(filename, device);
+  model_ = LoadModule(filename, device);
   model_.eval();
 }
 
@@ -22,8 +24,16 @@ torch::IValue OfflineConformerCtcModel::Forward(torch::Tensor features,
   int32_t batch_size = features.size(0);
 
   torch::Dict<std::string, torch::Tensor> sup;
-  sup.insert("sequence_idx", torch::arange(batch_size, torch::kInt));
-  sup.insert("start_frame", torch::zeros({batch_size}, torch::kInt));
+  // sequence_idx and start_frame depend only on the batch size, so
+  // batches of one length bucket reuse them.
+  sup.insert("sequence_idx",
+             GetCachedBatchTensor("sequence_idx", batch_size, [](int32_t n) {
+               return torch::arange(n, torch::kInt);
+             }));
+  sup.insert("start_frame",
+             GetCachedBatchTensor("start_frame", batch_size, [](int32_t n) {
+               return torch::zeros({n}, torch::kInt);
+             }));
   sup.insert("num_frames", features_length.cpu().to(torch::kInt));
 
   torch::IValue supervisions(sup);
@@ -7,6 +7,9 @@
 #include <string>
 #include <utility>
 
+#include "sherpa/csrc/log.h"
+#include "sherpa/csrc/mmap-read-adapter.h"
+
 namespace sherpa {
 
 OfflineConformerTransducerModel::OfflineConformerTransducerModel(
@@ -20,7 +23,7 @@ OfflineConformerTransducerModel::OfflineConformerTransducerModel(
   // architecture. We use pruned_transducer_stateless2 as an exmaple here, but
   // it applies also to pruned_transducer_stateless3,
   // pruned_transducer_stateless4, etc.
-  model_ = torch::jit::load(filename, device);
+  model_ = LoadModule(filename, device);
   model_.eval();
 
   encoder_ = model_.attr("encoder").toModule();
@@ -29,21 +32,62 @@ OfflineConformerTransducerModel::OfflineConformerTransducerModel(
 
   encoder_proj_ = joiner_.attr("encoder_proj").toModule();
   decoder_proj_ = joiner_.attr("decoder_proj").toModule();
+  output_linear_ = joiner_.attr("output_linear").toModule();
+
+  context_size_ = decoder_.attr("context_size").toInt();
+}
+
+void OfflineConformerTransducerModel::LoadQuantizedDecoderJoiner(
+    const std::string &filename) {
+  if (device_.is_cuda()) {
+    SHERPA_LOG(FATAL)
+        << "A quantized decoder/joiner is supported only on CPU";
+  }
+
+  torch::jit::Module m = LoadModule(filename, device_);
+  m.eval();
+
+  decoder_ = m.attr("decoder").toModule();
+  joiner_ = m.attr("joiner").toModule();
+
+  // The projections are part of the joiner and are quantized with it
+  encoder_proj_ = joiner_.attr("encoder_proj").toModule();
+  decoder_proj_ = joiner_.attr("decoder_proj").toModule();
+  output_linear_ = joiner_.attr("output_linear").toModule();
 
   context_size_ = decoder_.attr("context_size").toInt();
 }
 
+void OfflineConformerTransducerModel::UseBf16() {
+  if (device_.is_cuda()) {
+    SHERPA_LOG(FATAL) << "--use-cpu-bf16 is supported only on CPU";
+  }
+
+  encoder_.to(torch::kBFloat16);
+  use_bf16_ = true;
+}
+
 std::pair<torch::Tensor, torch::Tensor>
 OfflineConformerTransducerModel::RunEncoder(
     const torch::Tensor &features, const torch::Tensor &features_length) {
   torch::NoGradGuard no_grad;
 
-  auto outputs =
-      encoder_.run_method("forward", features, features_length).toTuple();
+  torch::Tensor f = features;
+  if (use_bf16_) {
+    f = f.to(torch::kBFloat16);
+  }
+
+  auto outputs = encoder_.run_method("forward", f, features_length).toTuple();
 
   auto encoder_out = outputs->elements()[0];
   auto encoder_out_length = outputs->elements()[1].toTensor();
 
+  if (use_bf16_) {
+    // Cast back to fp32 before the projection so the decoder, joiner
+    // and search stay in fp32
+    encoder_out = encoder_out.toTensor().to(torch::kFloat);
+  }
+
   auto projected_encoder_out =
       encoder_proj_.run_method("forward", encoder_out).toTensor();
 
@@ -68,4 +112,12 @@ torch::Tensor OfflineConformerTransducerModel::RunJoiner(
       .toTensor();
 }
 
+torch::Tensor OfflineConformerTransducerModel::RunJoinerInPlace(
+    torch::Tensor encoder_out, const torch::Tensor &decoder_out) {
+  torch::NoGradGuard no_grad;
+  return output_linear_
+      .run_method("forward", encoder_out.add_(decoder_out).tanh_())
+      .toTensor();
+}
+
 }  // namespace sherpa
@@ -4,6 +4,9 @@
 #ifndef SHERPA_CSRC_OFFLINE_CTC_MODEL_H_
 #define SHERPA_CSRC_OFFLINE_CTC_MODEL_H_
 
+#include <functional>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "torch/script.h"
@@ -50,7 +53,32 @@ class OfflineCtcModel {
   }
 
  protected:
+  /** Return an auxiliary tensor that depends only on the batch size,
+   * building it with the given factory at most once per distinct
+   * (name, batch_size).
+   *
+   * Wrappers use it for the per-batch index/offset tensors they would
+   * otherwise rebuild on every Forward() call. With length bucketing
+   * upstream, production traffic cycles through a handful of batch
+   * sizes, so the cache stays tiny. Not thread-safe; an offline model
+   * is driven by one thread, like the rest of this class.
+   */
+  const torch::Tensor &GetCachedBatchTensor(
+      const std::string &name, int32_t batch_size,
+      const std::function<torch::Tensor(int32_t)> &factory) {
+    std::string key = name + ":" + std::to_string(batch_size);
+    auto it = batch_tensor_cache_.find(key);
+    if (it == batch_tensor_cache_.end()) {
+      it = batch_tensor_cache_.emplace(std::move(key), factory(batch_size))
+               .first;
+    }
+    return it->second;
+  }
+
   int32_t vocab_size_ = -1;
+
+ private:
+  std::unordered_map<std::string, torch::Tensor> batch_tensor_cache_;
 };
 
 }  // namespace sherpa
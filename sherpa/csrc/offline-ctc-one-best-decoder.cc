@@ -6,10 +6,32 @@
 
 #include <utility>
 
+#include "sherpa/csrc/graph-cache.h"
 #include "sherpa/csrc/log.h"
 
 namespace sherpa {
 
+// Keep the top_k largest entries of every frame (plus the blank, token
+// 0) and floor the rest. The tensor stays dense, since the k2 torch API
+// accepts only dense posteriors, but the floored entries sit so far
+// below every surviving token that the pruned intersection drops their
+// arcs immediately instead of tracking states for them. It runs as a
+// handful of batched kernels on the device holding log_prob.
+static torch::Tensor PruneLogProb(torch::Tensor log_prob, int32_t top_k) {
+  // The score of the k-th best token per frame: (N, T, 1)
+  auto threshold = std::get<0>(log_prob.topk(top_k, /*dim*/ -1))
+                       .narrow(/*dim*/ -1, /*start*/ top_k - 1, /*length*/ 1);
+
+  auto keep = log_prob >= threshold;
+  // The blank must survive: CTC paths thread through it between tokens.
+  keep.narrow(/*dim*/ -1, /*start*/ 0, /*length*/ 1).fill_(true);
+
+  // Any finite value far below the search beam does; -inf would
+  // propagate through the lattice scores.
+  return torch::where(keep, log_prob,
+                      torch::full({}, -1e10f, log_prob.options()));
+}
+
 OfflineCtcOneBestDecoder::OfflineCtcOneBestDecoder(
     const OfflineCtcDecoderConfig &config, torch::Device device,
     int32_t vocab_size)
@@ -20,9 +42,9 @@ OfflineCtcOneBestDecoder::OfflineCtcOneBestDecoder(
 
     decoding_graph_ = k2::GetCtcTopo(vocab_size - 1, config.modified, device);
   } else {
-    decoding_graph_ = k2::LoadFsaClass(config.hlg, device);
-
-    k2::ScaleTensorAttribute(decoding_graph_, config.lm_scale, "scores");
+    // The loaded graph is shared per process; the scale is applied once
+    // at load time, never to the shared instance.
+    decoding_graph_ = LoadCachedFsaClass(config.hlg, device, config.lm_scale);
   }
 }
 
@@ -35,6 +57,10 @@ std::vector<OfflineCtcDecoderResult> OfflineCtcOneBestDecoder::Decode(
 
   torch::NoGradGuard no_grad;
 
+  if (config_.top_k > 0 && config_.top_k < log_prob.size(2)) {
+    log_prob = PruneLogProb(log_prob, config_.top_k);
+  }
+
   auto lattice = k2::GetLattice(log_prob, log_prob_len.cpu(), decoding_graph_,
                                 config_.search_beam, config_.output_beam,
                                 config_.min_active_states,
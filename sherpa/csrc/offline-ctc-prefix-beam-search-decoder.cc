@@ -0,0 +1,189 @@
+// sherpa/csrc/offline-ctc-prefix-beam-search-decoder.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/offline-ctc-prefix-beam-search-decoder.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "sherpa/csrc/log.h"
+#include "sherpa/csrc/math.h"
+
+namespace sherpa {
+
+namespace {
+
+constexpr double kNegInf = -std::numeric_limits<double>::infinity();
+
+// Scores of one prefix, split by whether the prefix currently ends in
+// a blank; the split is what lets repeats be collapsed correctly.
+struct PrefixScore {
+  double log_prob_blank = kNegInf;
+  double log_prob_nonblank = kNegInf;
+
+  // timestamps[i] is the output frame on which the i-th token of the
+  // prefix was first emitted.
+  std::vector<int32_t> timestamps;
+
+  double TotalLogProb() const {
+    return LogAdd<double>()(log_prob_blank, log_prob_nonblank);
+  }
+};
+
+}  // namespace
+
+OfflineCtcPrefixBeamSearchDecoder::OfflineCtcPrefixBeamSearchDecoder(
+    int32_t max_active_paths)
+    : max_active_paths_(max_active_paths) {
+  SHERPA_CHECK_GT(max_active_paths, 0);
+}
+
+std::vector<OfflineCtcDecoderResult> OfflineCtcPrefixBeamSearchDecoder::Decode(
+    torch::Tensor log_prob, torch::Tensor log_prob_len,
+    int32_t subsampling_factor /*= 1*/) {
+  torch::NoGradGuard no_grad;
+
+  int32_t batch_size = log_prob.size(0);
+  int32_t vocab_size = log_prob.size(2);
+
+  // Per-frame candidate pruning for the whole batch in one vectorized
+  // call; the CPU beam loop below only ever looks at these candidates
+  // plus the blank.
+  int32_t num_candidates =
+      std::min(vocab_size, std::max(2 * max_active_paths_, 8));
+  torch::Tensor topk_values, topk_indexes;
+  std::tie(topk_values, topk_indexes) =
+      log_prob.topk(num_candidates, /*dim*/ 2);
+
+  topk_values = topk_values.cpu().to(torch::kFloat).contiguous();
+  topk_indexes = topk_indexes.cpu().to(torch::kLong).contiguous();
+  auto values_acc = topk_values.accessor<float, 3>();
+  auto indexes_acc = topk_indexes.accessor<int64_t, 3>();
+
+  auto blank_log_prob =
+      log_prob.index({torch::indexing::Slice(), torch::indexing::Slice(), 0})
+          .cpu()
+          .to(torch::kFloat)
+          .contiguous();
+  auto blank_acc = blank_log_prob.accessor<float, 2>();
+
+  log_prob_len = log_prob_len.cpu().to(torch::kLong);
+  auto len_acc = log_prob_len.accessor<int64_t, 1>();
+
+  std::vector<OfflineCtcDecoderResult> results(batch_size);
+
+  using PrefixMap = std::map<std::vector<int32_t>, PrefixScore>;
+
+  for (int32_t n = 0; n != batch_size; ++n) {
+    PrefixMap cur;
+    cur[{}].log_prob_blank = 0;
+
+    int32_t num_frames = len_acc[n];
+    for (int32_t t = 0; t != num_frames; ++t) {
+      PrefixMap next;
+
+      float p_blank = blank_acc[n][t];
+
+      for (const auto &kv : cur) {
+        const std::vector<int32_t> &prefix = kv.first;
+        const PrefixScore &score = kv.second;
+        double total = score.TotalLogProb();
+
+        // Case 1: the frame is a blank; the prefix is unchanged.
+        {
+          PrefixScore &e = next[prefix];
+          e.log_prob_blank =
+              LogAdd<double>()(e.log_prob_blank, total + p_blank);
+          e.timestamps = score.timestamps;
+        }
+
+        for (int32_t j = 0; j != num_candidates; ++j) {
+          int32_t token = indexes_acc[n][t][j];
+          if (token == 0) {
+            continue;  // the blank is handled above
+          }
+          float p = values_acc[n][t][j];
+
+          if (!prefix.empty() && token == prefix.back()) {
+            // Case 2: a repeat of the last token with no blank in
+            // between is collapsed; the prefix is unchanged.
+            {
+              PrefixScore &e = next[prefix];
+              e.log_prob_nonblank = LogAdd<double>()(
+                  e.log_prob_nonblank, score.log_prob_nonblank + p);
+            }
+
+            // Case 3: the same token after a blank starts a new run
+            // and extends the prefix.
+            auto new_prefix = prefix;
+            new_prefix.push_back(token);
+            PrefixScore &e = next[new_prefix];
+            if (e.timestamps.empty()) {
+              e.timestamps = score.timestamps;
+              e.timestamps.push_back(t);
+            }
+            e.log_prob_nonblank = LogAdd<double>()(e.log_prob_nonblank,
+                                                   score.log_prob_blank + p);
+          } else {
+            // Case 4: a different token always extends the prefix.
+            auto new_prefix = prefix;
+            new_prefix.push_back(token);
+            PrefixScore &e = next[new_prefix];
+            if (e.timestamps.empty()) {
+              e.timestamps = score.timestamps;
+              e.timestamps.push_back(t);
+            }
+            e.log_prob_nonblank =
+                LogAdd<double>()(e.log_prob_nonblank, total + p);
+          }
+        }
+      }
+
+      // Keep only the best max_active_paths_ prefixes.
+      if (static_cast<int32_t>(next.size()) > max_active_paths_) {
+        std::vector<std::pair<double, const std::vector<int32_t> *>> ranked;
+        ranked.reserve(next.size());
+        for (const auto &kv : next) {
+          ranked.emplace_back(kv.second.TotalLogProb(), &kv.first);
+        }
+        std::nth_element(
+            ranked.begin(), ranked.begin() + max_active_paths_, ranked.end(),
+            [](const auto &a, const auto &b) { return a.first > b.first; });
+
+        PrefixMap pruned;
+        for (int32_t i = 0; i != max_active_paths_; ++i) {
+          pruned[*ranked[i].second] = std::move(next[*ranked[i].second]);
+        }
+        next = std::move(pruned);
+      }
+
+      cur = std::move(next);
+    }
+
+    const std::vector<int32_t> *best_prefix = nullptr;
+    const PrefixScore *best_score = nullptr;
+    double best = kNegInf;
+    for (const auto &kv : cur) {
+      double total = kv.second.TotalLogProb();
+      if (total > best) {
+        best = total;
+        best_prefix = &kv.first;
+        best_score = &kv.second;
+      }
+    }
+
+    if (best_prefix) {
+      results[n].tokens = *best_prefix;
+      results[n].timestamps = best_score->timestamps;
+    }
+  }
+
+  return results;
+}
+
+}  // namespace sherpa
@@ -0,0 +1,40 @@
+// sherpa/csrc/offline-ctc-prefix-beam-search-decoder.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_CSRC_OFFLINE_CTC_PREFIX_BEAM_SEARCH_DECODER_H_
+#define SHERPA_CSRC_OFFLINE_CTC_PREFIX_BEAM_SEARCH_DECODER_H_
+
+#include <vector>
+
+#include "sherpa/csrc/offline-ctc-decoder.h"
+
+namespace sherpa {
+
+/** CTC prefix beam search operating directly on the log-probs tensor.
+ *
+ * Unlike OfflineCtcOneBestDecoder it involves no FSA machinery: the
+ * per-frame candidate tokens are pruned with one batched topk over the
+ * whole (N, T, vocab_size) tensor, and the beam is then advanced with a
+ * small CPU loop per utterance. For plain best-path needs (no HLG) this
+ * is much cheaper than FSA intersection, especially for models with
+ * large vocabularies such as wav2vec 2.0.
+ */
+class OfflineCtcPrefixBeamSearchDecoder : public OfflineCtcDecoder {
+ public:
+  /**
+   * @param max_active_paths  Beam size; at most this many prefixes are
+   *                          kept per utterance per frame.
+   */
+  explicit OfflineCtcPrefixBeamSearchDecoder(int32_t max_active_paths);
+
+  std::vector<OfflineCtcDecoderResult> Decode(
+      torch::Tensor log_prob, torch::Tensor log_prob_len,
+      int32_t subsampling_factor = 1) override;
+
+ private:
+  int32_t max_active_paths_;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_OFFLINE_CTC_PREFIX_BEAM_SEARCH_DECODER_H_
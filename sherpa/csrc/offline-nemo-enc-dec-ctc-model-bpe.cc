@@ -4,12 +4,14 @@
 
 #include "sherpa/csrc/offline-nemo-enc-dec-ctc-model-bpe.h"
 
+#include "sherpa/csrc/mmap-read-adapter.h"
+
 namespace sherpa {
 
 OfflineNeMoEncDecCTCModelBPE::OfflineNeMoEncDecCTCModelBPE(
     const std::string &filename, torch::Device device /*= torch::kCPU*/)
     : device_(device) {
-  model_ = torch::jit::load(filename, device);
+  model_ = LoadModule(filename, device);
   model_.eval();
 }
 
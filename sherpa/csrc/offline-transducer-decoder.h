@@ -16,6 +16,16 @@ struct OfflineTransducerDecoderResult {
 
   /// timestamps[i] contains the output frame index where tokens[i] is decoded.
   std::vector<int32_t> timestamps;
+
+  /// token_log_probs[i] is the log-probability of the arc that emitted
+  /// tokens[i] on the best path of the decoding lattice. Filled only by
+  /// fast_beam_search; empty otherwise. When decoding with an LG graph,
+  /// it includes the scaled LM scores.
+  std::vector<float> token_log_probs;
+
+  /// Total score of the best path, including the blank arcs. Filled
+  /// only by fast_beam_search; 0 otherwise.
+  float log_prob = 0;
 };
 
 class OfflineTransducerDecoder {
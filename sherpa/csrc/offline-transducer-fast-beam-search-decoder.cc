@@ -6,6 +6,7 @@
 #include <utility>
 
 #include "k2/torch_api.h"
+#include "sherpa/csrc/graph-cache.h"
 
 namespace sherpa {
 
@@ -16,8 +17,8 @@ OfflineTransducerFastBeamSearchDecoder::OfflineTransducerFastBeamSearchDecoder(
     // Use a trivial graph
     decoding_graph_ = k2::GetTrivialGraph(vocab_size_ - 1, model_->Device());
   } else {
-    decoding_graph_ = k2::LoadFsaClass(config.lg, model_->Device());
-    k2::ScaleTensorAttribute(decoding_graph_, config.ngram_lm_scale, "scores");
+    decoding_graph_ = LoadCachedFsaClass(config.lg, model_->Device(),
+                                         config.ngram_lm_scale);
   }
 }
 
@@ -63,7 +64,9 @@ OfflineTransducerFastBeamSearchDecoder::Decode(
     cur_encoder_out = cur_encoder_out.unsqueeze(1).unsqueeze(1);
     // cur_encoder_out.shape (num_hyps, 1, 1, joiner_dim)
 
-    auto logits = model_->RunJoiner(cur_encoder_out, decoder_out);
+    // cur_encoder_out is freshly allocated by index_select() above, so
+    // the joiner may consume it in place.
+    auto logits = model_->RunJoinerInPlace(cur_encoder_out, decoder_out);
     // logits.shape: (num_hyps, 1, 1, vocab_size)
 
     logits = logits.squeeze(1).squeeze(1);
@@ -87,14 +90,21 @@ OfflineTransducerFastBeamSearchDecoder::Decode(
 
   std::vector<OfflineTransducerDecoderResult> results(batch_size);
 
-  // Get tokens and timestamps from the lattice
+  // Get tokens, timestamps and arc scores from the lattice. The scores
+  // come for free from the same decoding pass; they back the token
+  // confidences of the result, so no second decoding run is needed to
+  // obtain them.
   auto labels = k2::GetTensorAttr(lattice, "labels").cpu().contiguous();
   auto acc = labels.accessor<int32_t, 1>();
 
+  auto scores = k2::GetTensorAttr(lattice, "scores").cpu().contiguous();
+  auto scores_acc = scores.accessor<float, 1>();
+
   OfflineTransducerDecoderResult *p = results.data();
 
   for (int32_t i = 0, t = 0; i != labels.numel(); ++i) {
     int32_t token = acc[i];
+    p->log_prob += scores_acc[i];
 
     if (token == -1) {
       // end of this utterance.
@@ -111,6 +121,7 @@ OfflineTransducerFastBeamSearchDecoder::Decode(
 
     p->tokens.push_back(token);
     p->timestamps.push_back(t);
+    p->token_log_probs.push_back(scores_acc[i]);
     ++t;
   }  // for (int32_t i = 0, t = 0; i != labels.numel(); ++i)
 
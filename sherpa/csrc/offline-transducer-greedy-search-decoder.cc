@@ -12,27 +12,6 @@
 
 namespace sherpa {
 
-/**
- * Construct the decoder input from the current hypothesis.
- *
- * @param hyps  A list-of-list of token IDs containing the current decoding
- *              results. Its length is `batch_size`
- * @param decoder_input A 2-D tensor of shape (batch_size, context_size).
- */
-static void BuildDecoderInput(
-    const std::vector<OfflineTransducerDecoderResult> &r,
-    torch::Tensor *decoder_input) {
-  int32_t batch_size = decoder_input->size(0);
-  int32_t context_size = decoder_input->size(1);
-  int64_t *p = decoder_input->data_ptr<int64_t>();
-  for (int32_t i = 0; i != batch_size; ++i) {
-    auto start = r[i].tokens.end() - context_size;
-    auto end = r[i].tokens.end();
-    std::copy(start, end, p);
-    p += context_size;
-  }
-}
-
 std::vector<OfflineTransducerDecoderResult>
 OfflineTransducerGreedySearchDecoder::Decode(torch::Tensor encoder_out,
                                              torch::Tensor encoder_out_length) {
@@ -77,8 +56,12 @@ OfflineTransducerGreedySearchDecoder::Decode(torch::Tensor encoder_out,
                   torch::dtype(torch::kLong)
                       .memory_format(torch::MemoryFormat::Contiguous));
 
+  auto run_decoder = [this, device](torch::Tensor miss_input) {
+    return model_->RunDecoder(miss_input.to(device));
+  };
+
   // its shape is (N, 1, joiner_dim)
-  auto decoder_out = model_->RunDecoder(decoder_input.to(device));
+  auto decoder_out = decoder_output_cache_.Get(decoder_input, run_decoder);
 
   using torch::indexing::Slice;
   auto batch_sizes_accessor = packed_seq.batch_sizes().accessor<int64_t, 1>();
@@ -99,7 +82,10 @@ OfflineTransducerGreedySearchDecoder::Decode(torch::Tensor encoder_out,
       decoder_out = decoder_out.index({Slice(0, cur_batch_size)});
     }
 
-    auto logits = model_->RunJoiner(cur_encoder_out, decoder_out.unsqueeze(1));
+    // cur_encoder_out views rows of the packed sequence that are never
+    // read again, so the joiner may consume them in place.
+    auto logits =
+        model_->RunJoinerInPlace(cur_encoder_out, decoder_out.unsqueeze(1));
     // logits' shape is (cur_batch_size, 1, 1, vocab_size)
     // logits is the output of nn.Linear. Since we are using greedy search
     // and only the magnitude matters, we don't invoke log_softmax here
@@ -107,19 +93,37 @@ OfflineTransducerGreedySearchDecoder::Decode(torch::Tensor encoder_out,
     logits = logits.squeeze(1).squeeze(1);
     auto max_indices = logits.argmax(/*dim*/ -1).cpu();
     auto max_indices_accessor = max_indices.accessor<int64_t, 1>();
-    bool emitted = false;
+    std::vector<int64_t> emitted;
     for (int32_t k = 0; k != cur_batch_size; ++k) {
       auto index = max_indices_accessor[k];
       if (index != blank_id) {
-        emitted = true;
+        emitted.push_back(k);
         results[k].tokens.push_back(index);
         results[k].timestamps.push_back(t);
       }
     }
 
-    if (emitted) {
-      BuildDecoderInput(results, &decoder_input);
-      decoder_out = model_->RunDecoder(decoder_input.to(device));
+    if (!emitted.empty()) {
+      // Re-run the decoder only for the live utterances that emitted a
+      // token; finished utterances no longer contribute rows to the
+      // batch.
+      auto emitted_input = torch::empty(
+          {static_cast<int64_t>(emitted.size()), context_size},
+          torch::dtype(torch::kLong)
+              .memory_format(torch::MemoryFormat::Contiguous));
+      int64_t *p = emitted_input.data_ptr<int64_t>();
+      for (auto k : emitted) {
+        const auto &tokens = results[k].tokens;
+        std::copy(tokens.end() - context_size, tokens.end(), p);
+        p += context_size;
+      }
+
+      auto fresh_rows = decoder_output_cache_.Get(emitted_input, run_decoder);
+      // fresh_rows has shape (emitted.size(), 1, joiner_dim)
+
+      auto emitted_index =
+          torch::tensor(emitted, torch::kLong).to(decoder_out.device());
+      decoder_out.index_copy_(/*dim*/ 0, emitted_index, fresh_rows);
     }
   }  // for (int32_t t = 0; t != max_T; ++t) {
 
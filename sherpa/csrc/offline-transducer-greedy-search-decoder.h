@@ -6,6 +6,7 @@
 
 #include <vector>
 
+#include "sherpa/csrc/decoder-output-cache.h"
 #include "sherpa/csrc/offline-transducer-decoder.h"
 #include "sherpa/csrc/offline-transducer-model.h"
 
@@ -21,6 +22,7 @@ class OfflineTransducerGreedySearchDecoder : public OfflineTransducerDecoder {
 
  private:
   OfflineTransducerModel *model_;  // Not owned
+  DecoderOutputCache decoder_output_cache_;
 };
 
 }  // namespace sherpa
@@ -6,6 +6,7 @@
 
 #include <utility>
 
+#include "sherpa/csrc/log.h"
 #include "torch/script.h"
 
 namespace sherpa {
@@ -53,6 +54,37 @@ class OfflineTransducerModel {
   virtual torch::Tensor RunJoiner(const torch::Tensor &encoder_out,
                                   const torch::Tensor &decoder_out) = 0;
 
+  /** Like RunJoiner(), but may overwrite `encoder_out` with scratch
+   * data.
+   *
+   * The joint network of pruned transducer models is
+   * output_linear(tanh(encoder_out + decoder_out)) on pre-projected
+   * inputs; models can implement this function with an in-place add and
+   * tanh, saving two temporaries of shape (N, joiner_dim) per frame.
+   * Decoders call it on encoder frames they consume exactly once and
+   * never on the cached decoder output.
+   *
+   * The default implementation forwards to RunJoiner() and leaves
+   * `encoder_out` untouched.
+   */
+  virtual torch::Tensor RunJoinerInPlace(torch::Tensor encoder_out,
+                                         const torch::Tensor &decoder_out) {
+    return RunJoiner(encoder_out, decoder_out);
+  }
+
+  /** Convert the encoder to bfloat16 for CPU execution.
+   *
+   * It must be called before any of the Run* functions. After the call,
+   * RunEncoder() converts the features to bf16 internally and still
+   * returns fp32 encoder output, so the decoder, joiner and search are
+   * unaffected.
+   *
+   * Supported only by some models; the default implementation aborts.
+   */
+  virtual void UseBf16() {
+    SHERPA_LOG(FATAL) << "--use-cpu-bf16 is not supported for this model type";
+  }
+
   /** Return the device where computation takes place.
    *
    * Note: We don't support moving the model to a different device
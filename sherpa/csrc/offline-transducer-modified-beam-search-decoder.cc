@@ -10,18 +10,10 @@
 
 #include "k2/torch_api.h"
 #include "sherpa/csrc/hypothesis.h"
+#include "sherpa/csrc/math.h"
 
 namespace sherpa {
 
-static torch::Tensor FloorDivide(torch::Tensor a, int32_t b) {
-#if SHERPA_TORCH_VERSION_MAJOR > 1 || \
-    (SHERPA_TORCH_VERSION_MAJOR == 1 && SHERPA_TORCH_VERSION_MINOR > 7)
-  return torch::div(a, b, /*rounding_mode*/ "trunc");
-#else
-  return torch::floor_divide(a, b);
-#endif
-}
-
 static torch::Tensor BuildDecoderInput(const std::vector<Hypothesis> &hyps,
                                        int32_t context_size) {
   int32_t num_hyps = hyps.size();
@@ -32,10 +24,7 @@ static torch::Tensor BuildDecoderInput(const std::vector<Hypothesis> &hyps,
 
   int64_t *p = decoder_input.data_ptr<int64_t>();
   for (const auto &h : hyps) {
-    auto start = h.ys.end() - context_size;
-    auto end = h.ys.end();
-
-    std::copy(start, end, p);
+    h.FillLastTokens(context_size, p);
     p += context_size;
   }
 
@@ -148,9 +137,12 @@ OfflineTransducerModifiedBeamSearchDecoder::Decode(
       ys_log_probs_acc[k][0] = prev[k].log_prob;
     }
 
-    auto decoder_input = BuildDecoderInput(prev, context_size).to(device);
+    auto decoder_input = BuildDecoderInput(prev, context_size);
 
-    auto decoder_out = model_->RunDecoder(decoder_input);
+    auto decoder_out = decoder_output_cache_.Get(
+        decoder_input, [this, device](torch::Tensor miss_input) {
+          return model_->RunDecoder(miss_input.to(device));
+        });
     // decoder_out is of shape (num_hyps, 1, joiner_dim)
 
     auto index = k2::RowIds(hyps_shape, 1).to(torch::kLong).to(device);
@@ -158,7 +150,10 @@ OfflineTransducerModifiedBeamSearchDecoder::Decode(
     cur_encoder_out = cur_encoder_out.index_select(/*dim*/ 0, /*index*/ index);
     // cur_encoder_out is of shape (num_hyps, 1, 1, joiner_dim)
 
-    auto logits = model_->RunJoiner(cur_encoder_out, decoder_out.unsqueeze(1));
+    // cur_encoder_out is freshly allocated by index_select() above, so
+    // the joiner may consume it in place.
+    auto logits =
+        model_->RunJoinerInPlace(cur_encoder_out, decoder_out.unsqueeze(1));
 
     // logits' shape is (num_hyps, 1, 1, vocab_size)
     logits = logits.squeeze(1).squeeze(1);
@@ -173,39 +168,46 @@ OfflineTransducerModifiedBeamSearchDecoder::Decode(
     auto row_splits = k2::RowSplits(hyps_shape, 1);
     auto row_splits_acc = row_splits.accessor<int32_t, 1>();
 
+    const float *log_probs_data = log_probs.data_ptr<float>();
+
     for (int32_t k = 0; k != cur_batch_size; ++k) {
       int32_t start = row_splits_acc[k];
       int32_t end = row_splits_acc[k + 1];
 
-      torch::Tensor values, indexes;
-      std::tie(values, indexes) =
-          log_probs.slice(/*dim*/ 0, start * vocab_size, end * vocab_size)
-              .topk(/*k*/ num_active_paths_, /*dim*/ 0,
-                    /*largest*/ true, /*sorted*/ true);
-
-      auto topk_hyp_indexes = FloorDivide(indexes, vocab_size);
-      auto topk_token_indexes = torch::remainder(indexes, vocab_size);
-
-      auto values_acc = values.accessor<float, 1>();
-      auto topk_hyp_indexes_acc = topk_hyp_indexes.accessor<int64_t, 1>();
-      auto topk_token_indexes_acc = topk_token_indexes.accessor<int64_t, 1>();
+      // Heap-based selection of the k best candidates of this stream;
+      // the candidate set is never fully sorted. See TopK() in math.h.
+      const float *cand = log_probs_data + start * vocab_size;
+      auto topk = TopK(cand, (end - start) * vocab_size, num_active_paths_);
 
-      Hypotheses hyps;
-      for (int32_t j = 0; j != values.numel(); ++j) {
-        int32_t hyp_idx = topk_hyp_indexes_acc[j];
+      std::vector<Hypothesis> new_hyps;
+      new_hyps.reserve(topk.size());
+      for (auto idx : topk) {
+        int32_t hyp_idx = idx / vocab_size;
         Hypothesis new_hyp = prev[start + hyp_idx];  // note: hyp_idx is 0 based
 
-        int32_t new_token = topk_token_indexes_acc[j];
+        // We already added log_prob of the path to log_probs before, so
+        // we use the candidate score here directly.
+        new_hyp.log_prob = cand[idx];
+
+        int32_t new_token = idx % vocab_size;
         if (new_token != blank_id) {
-          new_hyp.ys.push_back(new_token);
-          new_hyp.timestamps.push_back(t);
+          new_hyp.AddToken(new_token, t);
+
+          if (lm_) {
+            // Shallow fusion: the LM score enters the path score, so it
+            // keeps steering the beam on later frames.
+            new_hyp.log_prob +=
+                lm_scale_ *
+                lm_->Score(new_hyp.lm_state, new_token, &new_hyp.lm_state);
+          }
         }
 
-        // We already added log_prob of the path to log_probs before, so
-        // we use values_acc[j] here directly.
-        new_hyp.log_prob = values_acc[j];
-        hyps.Add(std::move(new_hyp));
+        new_hyps.push_back(std::move(new_hyp));
       }
+
+      Hypotheses hyps;
+      hyps.SetPruning(num_active_paths_, score_gap_);
+      hyps.AddBatch(std::move(new_hyps));
       cur.push_back(std::move(hyps));
     }
   }
@@ -220,10 +222,11 @@ OfflineTransducerModifiedBeamSearchDecoder::Decode(
   std::vector<OfflineTransducerDecoderResult> ans(batch_size);
   for (int32_t i = 0; i != batch_size; ++i) {
     int32_t k = unsorted_indices_accessor[i];
-    Hypothesis hyp = cur[k].GetMostProbable(true);
-    torch::ArrayRef<int32_t> arr(hyp.ys);
-    ans[i].tokens = arr.slice(context_size).vec();
-    ans[i].timestamps = std::move(hyp.timestamps);
+    // cur is dead after this loop, so the winners are moved out.
+    Hypothesis hyp = cur[k].TakeMostProbable(true);
+    auto ys = hyp.Ys();
+    ans[i].tokens = std::vector<int32_t>(ys.begin() + context_size, ys.end());
+    ans[i].timestamps = hyp.Timestamps();
   }
 
   return ans;
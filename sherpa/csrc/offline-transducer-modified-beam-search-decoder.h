@@ -6,6 +6,8 @@
 
 #include <vector>
 
+#include "sherpa/csrc/decoder-output-cache.h"
+#include "sherpa/csrc/ngram-lm.h"
 #include "sherpa/csrc/offline-transducer-decoder.h"
 #include "sherpa/csrc/offline-transducer-model.h"
 
@@ -14,9 +16,28 @@ namespace sherpa {
 class OfflineTransducerModifiedBeamSearchDecoder
     : public OfflineTransducerDecoder {
  public:
+  /**
+   * @param model  The transducer model. It is NOT owned.
+   * @param num_active_paths  Beam size; at most this many hypotheses
+   *                          are kept per utterance.
+   * @param score_gap  Hypotheses whose log-prob is more than this below
+   *                   the best one are pruned at insertion time.
+   *                   Values <= 0 disable gap pruning.
+   * @param lm  If not nullptr, an n-gram LM for shallow fusion; every
+   *            predicted token is scored with lm_scale * its LM
+   *            log-prob. It is NOT owned.
+   * @param lm_scale  Weight of the LM scores.
+   */
   OfflineTransducerModifiedBeamSearchDecoder(OfflineTransducerModel *model,
-                                             int32_t num_active_paths)
-      : model_(model), num_active_paths_(num_active_paths) {}
+                                             int32_t num_active_paths,
+                                             float score_gap = 0,
+                                             const NgramLm *lm = nullptr,
+                                             float lm_scale = 0)
+      : model_(model),
+        num_active_paths_(num_active_paths),
+        score_gap_(score_gap),
+        lm_(lm),
+        lm_scale_(lm_scale) {}
 
   /** Run greedy search given the output from the encoder model.
    *
@@ -33,6 +54,10 @@ class OfflineTransducerModifiedBeamSearchDecoder
   OfflineTransducerModel *model_;  // Not owned
 
   int32_t num_active_paths_;
+  float score_gap_;
+  const NgramLm *lm_;  // Not owned
+  float lm_scale_;
+  DecoderOutputCache decoder_output_cache_;
 };
 
 }  // namespace sherpa
@@ -0,0 +1,213 @@
+// sherpa/csrc/offline-trt-transducer-model.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/offline-trt-transducer-model.h"
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "NvInfer.h"
+#include "c10/cuda/CUDAStream.h"
+#include "sherpa/csrc/log.h"
+#include "sherpa/csrc/mmap-read-adapter.h"
+
+namespace sherpa {
+
+namespace {
+
+// Route TensorRT diagnostics into our log. The verbose per-layer
+// chatter is demoted to DEBUG.
+class TrtLogger : public nvinfer1::ILogger {
+ public:
+  void log(Severity severity, const char *msg) noexcept override {
+    switch (severity) {
+      case Severity::kINTERNAL_ERROR:
+      case Severity::kERROR:
+        SHERPA_LOG(ERROR) << "TensorRT: " << msg;
+        break;
+      case Severity::kWARNING:
+        SHERPA_LOG(WARNING) << "TensorRT: " << msg;
+        break;
+      default:
+        SHERPA_LOG(DEBUG) << "TensorRT: " << msg;
+        break;
+    }
+  }
+};
+
+// IO tensor names of the exported encoder; see
+// triton/tensorrt/tools/build.sh and triton/export_onnx.py.
+constexpr const char *kSpeech = "speech";
+constexpr const char *kSpeechLengths = "speech_lengths";
+constexpr const char *kEncoderOut = "encoder_out";
+constexpr const char *kEncoderOutLens = "encoder_out_lens";
+
+}  // namespace
+
+OfflineTrtTransducerModel::OfflineTrtTransducerModel(
+    const std::string &engine_filename, const std::string &nn_model,
+    torch::Device device)
+    : device_(device) {
+  if (!device.is_cuda()) {
+    SHERPA_LOG(FATAL) << "A TensorRT encoder requires --use-gpu=true";
+  }
+
+  // The decoder, the joiner and the joiner projections keep running as
+  // TorchScript; only the encoder moved into the engine.
+  model_ = LoadModule(nn_model, device);
+  model_.eval();
+
+  decoder_ = model_.attr("decoder").toModule();
+  joiner_ = model_.attr("joiner").toModule();
+
+  encoder_proj_ = joiner_.attr("encoder_proj").toModule();
+  decoder_proj_ = joiner_.attr("decoder_proj").toModule();
+  output_linear_ = joiner_.attr("output_linear").toModule();
+
+  context_size_ = decoder_.attr("context_size").toInt();
+
+  std::ifstream is(engine_filename, std::ios::binary);
+  if (!is) {
+    SHERPA_LOG(FATAL) << "Failed to open " << engine_filename;
+  }
+  std::ostringstream os;
+  os << is.rdbuf();
+  const std::string &blob = os.str();
+
+  logger_ = std::make_unique<TrtLogger>();
+
+  runtime_.reset(nvinfer1::createInferRuntime(*logger_));
+  SHERPA_CHECK(runtime_ != nullptr) << "Failed to create a TensorRT runtime";
+
+  engine_.reset(runtime_->deserializeCudaEngine(blob.data(), blob.size()));
+  SHERPA_CHECK(engine_ != nullptr)
+      << "Failed to deserialize the TensorRT engine " << engine_filename;
+
+  context_.reset(engine_->createExecutionContext());
+  SHERPA_CHECK(context_ != nullptr)
+      << "Failed to create an execution context for " << engine_filename;
+
+  SHERPA_LOG(INFO) << "Loaded TensorRT encoder " << engine_filename << " with "
+                   << engine_->getNbOptimizationProfiles()
+                   << " optimization profile(s)";
+}
+
+OfflineTrtTransducerModel::~OfflineTrtTransducerModel() = default;
+
+void OfflineTrtTransducerModel::SelectProfile(int64_t batch_size,
+                                              int64_t num_frames,
+                                              int64_t feature_dim) {
+  int32_t num_profiles = engine_->getNbOptimizationProfiles();
+  for (int32_t p = 0; p != num_profiles; ++p) {
+    auto min = engine_->getProfileShape(kSpeech, p,
+                                        nvinfer1::OptProfileSelector::kMIN);
+    auto max = engine_->getProfileShape(kSpeech, p,
+                                        nvinfer1::OptProfileSelector::kMAX);
+    if (batch_size < min.d[0] || batch_size > max.d[0] ||
+        num_frames < min.d[1] || num_frames > max.d[1]) {
+      continue;
+    }
+
+    if (p != profile_) {
+      // A profile switch costs a device-side reconfiguration, so it
+      // happens only when the batch leaves the current profile's range;
+      // with length-bucketed batches, batches of one bucket keep
+      // hitting the same profile.
+      auto stream = c10::cuda::getCurrentCUDAStream(device_.index());
+      context_->setOptimizationProfileAsync(p, stream.stream());
+      profile_ = p;
+    }
+
+    context_->setInputShape(
+        kSpeech,
+        nvinfer1::Dims3(static_cast<int32_t>(batch_size),
+                        static_cast<int32_t>(num_frames),
+                        static_cast<int32_t>(feature_dim)));
+
+    nvinfer1::Dims lengths_dims;
+    lengths_dims.nbDims = 1;
+    lengths_dims.d[0] = static_cast<int32_t>(batch_size);
+    context_->setInputShape(kSpeechLengths, lengths_dims);
+
+    return;
+  }
+
+  SHERPA_LOG(FATAL) << "No optimization profile of the TensorRT engine "
+                    << "accepts a batch of shape (" << batch_size << ", "
+                    << num_frames << "). Rebuild the engine with larger "
+                    << "--maxShapes; see triton/tensorrt/tools/build.sh";
+}
+
+std::pair<torch::Tensor, torch::Tensor> OfflineTrtTransducerModel::RunEncoder(
+    const torch::Tensor &features, const torch::Tensor &features_length) {
+  torch::NoGradGuard no_grad;
+
+  auto speech = features.to(device_).to(torch::kFloat).contiguous();
+  auto speech_lengths =
+      features_length.to(device_).to(torch::kInt).contiguous();
+
+  int64_t batch_size = speech.size(0);
+  SelectProfile(batch_size, speech.size(1), speech.size(2));
+
+  // With the input shapes set, the context knows the concrete output
+  // shapes of this batch.
+  auto out_dims = context_->getTensorShape(kEncoderOut);
+  std::vector<int64_t> out_shape(out_dims.d, out_dims.d + out_dims.nbDims);
+  auto encoder_out = torch::empty(
+      out_shape, torch::TensorOptions().dtype(torch::kFloat).device(device_));
+  auto encoder_out_lens = torch::empty(
+      {batch_size}, torch::TensorOptions().dtype(torch::kInt).device(device_));
+
+  context_->setTensorAddress(kSpeech, speech.data_ptr());
+  context_->setTensorAddress(kSpeechLengths, speech_lengths.data_ptr());
+  context_->setTensorAddress(kEncoderOut, encoder_out.data_ptr());
+  context_->setTensorAddress(kEncoderOutLens, encoder_out_lens.data_ptr());
+
+  // Enqueue on the CUDA stream libtorch is using, so the torch kernels
+  // reading encoder_out below are ordered after the engine without an
+  // explicit synchronization.
+  auto stream = c10::cuda::getCurrentCUDAStream(device_.index());
+  if (!context_->enqueueV3(stream.stream())) {
+    SHERPA_LOG(FATAL) << "Failed to run the TensorRT encoder";
+  }
+
+  // The exported encoder_out is unprojected; apply the joiner's encoder
+  // projection exactly as the TorchScript encoder path does.
+  auto projected_encoder_out =
+      encoder_proj_.run_method("forward", encoder_out).toTensor();
+
+  return {projected_encoder_out, encoder_out_lens.to(torch::kLong)};
+}
+
+torch::Tensor OfflineTrtTransducerModel::RunDecoder(
+    const torch::Tensor &decoder_input) {
+  torch::NoGradGuard no_grad;
+  auto decoder_out =
+      decoder_.run_method("forward", decoder_input, /*need_pad*/ false);
+
+  return decoder_proj_.run_method("forward", decoder_out).toTensor();
+}
+
+torch::Tensor OfflineTrtTransducerModel::RunJoiner(
+    const torch::Tensor &encoder_out, const torch::Tensor &decoder_out) {
+  torch::NoGradGuard no_grad;
+  return joiner_
+      .run_method("forward", encoder_out, decoder_out,
+                  /*project_input*/ false)
+      .toTensor();
+}
+
+torch::Tensor OfflineTrtTransducerModel::RunJoinerInPlace(
+    torch::Tensor encoder_out, const torch::Tensor &decoder_out) {
+  torch::NoGradGuard no_grad;
+  return output_linear_
+      .run_method("forward", encoder_out.add_(decoder_out).tanh_())
+      .toTensor();
+}
+
+}  // namespace sherpa
@@ -0,0 +1,103 @@
+// sherpa/csrc/offline-trt-transducer-model.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_CSRC_OFFLINE_TRT_TRANSDUCER_MODEL_H_
+#define SHERPA_CSRC_OFFLINE_TRT_TRANSDUCER_MODEL_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "sherpa/csrc/offline-transducer-model.h"
+
+namespace nvinfer1 {
+class ICudaEngine;
+class IExecutionContext;
+class ILogger;
+class IRuntime;
+}  // namespace nvinfer1
+
+namespace sherpa {
+
+/** Runs a pruned transducer model with the encoder executed by a
+ * TensorRT engine.
+ *
+ * The encoder dominates the offline decoding cost and is where a
+ * TensorRT build of the same network clearly beats TorchScript; the
+ * decoder and the joiner are small matmuls and keep running as
+ * TorchScript, so all decoding methods work unchanged.
+ *
+ * An engine holds a single network, so it replaces only the encoder
+ * and the TorchScript model is still required for the rest.
+ *
+ * Compiled only with -DSHERPA_ENABLE_TRT=ON.
+ */
+class OfflineTrtTransducerModel : public OfflineTransducerModel {
+ public:
+  /**
+   * @param engine_filename Path to a serialized TensorRT engine built
+   *        from the exported encoder.onnx, e.g., with
+   *        triton/tensorrt/tools/build.sh. Its IO tensors are
+   *        speech (N, T, feature_dim), speech_lengths (N,),
+   *        encoder_out (N, T', encoder_dim) and encoder_out_lens (N,).
+   * @param nn_model Path to the torchscript model the engine was
+   *        exported from; provides the decoder, the joiner and the
+   *        joiner projections.
+   * @param device The device to run on. It must be a CUDA device.
+   */
+  OfflineTrtTransducerModel(const std::string &engine_filename,
+                            const std::string &nn_model,
+                            torch::Device device);
+
+  ~OfflineTrtTransducerModel() override;
+
+  /** Run the engine and apply the joiner's encoder projection to its
+   * output, exactly as the TorchScript encoder path does.
+   */
+  std::pair<torch::Tensor, torch::Tensor> RunEncoder(
+      const torch::Tensor &features,
+      const torch::Tensor &features_length) override;
+
+  torch::Tensor RunDecoder(const torch::Tensor &decoder_input) override;
+
+  torch::Tensor RunJoiner(const torch::Tensor &encoder_out,
+                          const torch::Tensor &decoder_out) override;
+
+  torch::Tensor RunJoinerInPlace(torch::Tensor encoder_out,
+                                 const torch::Tensor &decoder_out) override;
+
+  torch::Device Device() const override { return device_; }
+
+  int32_t ContextSize() const override { return context_size_; }
+
+ private:
+  /** Select an optimization profile accommodating (batch_size,
+   * num_frames) and set the input shapes on the execution context.
+   * Engines built with one profile per bucket size only pay for a
+   * profile switch when the batch leaves the current profile's range.
+   */
+  void SelectProfile(int64_t batch_size, int64_t num_frames,
+                     int64_t feature_dim);
+
+  torch::Device device_;
+  int32_t context_size_;
+
+  std::unique_ptr<nvinfer1::ILogger> logger_;
+  // Destroyed in reverse declaration order: the context before the
+  // engine, the engine before the runtime.
+  std::unique_ptr<nvinfer1::IRuntime> runtime_;
+  std::unique_ptr<nvinfer1::ICudaEngine> engine_;
+  std::unique_ptr<nvinfer1::IExecutionContext> context_;
+  int32_t profile_ = -1;  // the currently selected optimization profile
+
+  torch::jit::Module model_;
+  torch::jit::Module decoder_;
+  torch::jit::Module joiner_;
+  torch::jit::Module encoder_proj_;
+  torch::jit::Module decoder_proj_;
+  torch::jit::Module output_linear_;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_OFFLINE_TRT_TRANSDUCER_MODEL_H_
@@ -3,12 +3,15 @@
 // Copyright (c)  2022  Xiaomi Corporation
 
 #include "sherpa/csrc/offline-wav2vec2-ctc-model.h"
+
+#include "sherpa/csrc/mmap-read-adapter.h"
+
 namespace sherpa {
 
 OfflineWav2Vec2CtcModel::OfflineWav2Vec2CtcModel(
     const std::string &filename, torch::Device device /*= torch::kCPU*/)
     : device_(device) {
-  model_ = torch::jit::load(filename, device);
+  model_ = LoadModule(filename, device);
   model_.eval();
 }
 
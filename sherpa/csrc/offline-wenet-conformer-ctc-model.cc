@@ -4,14 +4,19 @@
 
 #include "sherpa/csrc/offline-wenet-conformer-ctc-model.h"
 
+#include "sherpa/csrc/mmap-read-adapter.h"
+
 namespace sherpa {
 
 OfflineWenetConformerCtcModel::OfflineWenetConformerCtcModel(
     const std::string &filename, torch::Device device /*= torch::kCPU*/)
     : device_(device) {
-  model_ = torch::jit::load(filename, device);
+  model_ = LoadModule(filename, device);
   model_.eval();
 
+  encoder_ = model_.attr("encoder").toModule();
+  ctc_ = model_.attr("ctc").toModule();
+
   subsampling_factor_ = model_.run_method("subsampling_rate").toInt();
 }
 
@@ -19,8 +24,8 @@ torch::IValue OfflineWenetConformerCtcModel::Forward(
     torch::Tensor features, torch::Tensor features_length) {
   torch::NoGradGuard no_grad;
 
-  return model_.attr("encoder").toModule().run_method(
-      "forward", features.to(device_), features_length.to(device_));
+  return encoder_.run_method("forward", features.to(device_),
+                             features_length.to(device_));
 }
 
 torch::Tensor OfflineWenetConformerCtcModel::GetLogSoftmaxOut(
@@ -28,10 +33,10 @@ torch::Tensor OfflineWenetConformerCtcModel::GetLogSoftmaxOut(
   torch::NoGradGuard no_grad;
 
   auto logit = forward_out.toTuple()->elements()[0];
-  return model_.attr("ctc")
-      .toModule()
-      .run_method("log_softmax", logit)
-      .toTensor();
+
+  // Modules are cheap shared handles; the copy keeps this method const.
+  torch::jit::Module ctc = ctc_;
+  return ctc.run_method("log_softmax", logit).toTensor();
 }
 
 torch::Tensor OfflineWenetConformerCtcModel::GetLogSoftmaxOutLength(
@@ -45,6 +45,10 @@ class OfflineWenetConformerCtcModel : public OfflineCtcModel {
  private:
   torch::Device device_;
   torch::jit::Module model_;
+  // Submodules looked up once in the constructor, so Forward() and
+  // GetLogSoftmaxOut() do not repeat the attribute lookups per batch.
+  torch::jit::Module encoder_;
+  torch::jit::Module ctc_;
   int32_t subsampling_factor_;
 };
 
@@ -4,6 +4,7 @@
 
 #include "sherpa/csrc/online-conformer-transducer-model.h"
 
+#include <memory>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -58,6 +59,11 @@ OnlineConformerTransducerModel::StateFromIValue(torch::IValue ivalue) const {
 
 torch::IValue OnlineConformerTransducerModel::StackStates(
     const std::vector<torch::IValue> &states) const {
+  if (packed_state_converter_) {
+    torch::IValue buffer;
+    return packed_state_converter_->StackStates(states, &buffer);
+  }
+
   int32_t batch_size = states.size();
   std::vector<torch::Tensor> attn;
   std::vector<torch::Tensor> conv;
@@ -75,8 +81,21 @@ torch::IValue OnlineConformerTransducerModel::StackStates(
   return torch::List<torch::Tensor>({stacked_attn, stacked_conv});
 }
 
+torch::IValue OnlineConformerTransducerModel::StackStates(
+    const std::vector<torch::IValue> &states, torch::IValue *buffer) const {
+  if (packed_state_converter_) {
+    return packed_state_converter_->StackStates(states, buffer);
+  }
+
+  return OnlineTransducerModel::StackStates(states, buffer);
+}
+
 std::vector<torch::IValue> OnlineConformerTransducerModel::UnStackStates(
     torch::IValue ivalue) const {
+  if (packed_state_converter_) {
+    return packed_state_converter_->UnStackStates(ivalue);
+  }
+
   State states = StateFromIValue(ivalue);
   int32_t batch_size = states[0].size(2);
   std::vector<torch::IValue> ans;
@@ -96,7 +115,16 @@ std::vector<torch::IValue> OnlineConformerTransducerModel::UnStackStates(
 torch::IValue OnlineConformerTransducerModel::GetEncoderInitStates(
     int32_t /*unused=1*/) {
   torch::NoGradGuard no_grad;
-  return encoder_.run_method("get_init_state", left_context_, device_);
+  auto states = encoder_.run_method("get_init_state", left_context_, device_);
+
+  // The state is a list of two tensors, attn and conv, with no batch
+  // dimension; StackStates() inserts it as dim 2 of each.
+  if (!packed_state_converter_) {
+    packed_state_converter_ = std::make_unique<PackedStateConverter>(
+        states, std::vector<StateLeafSpec>{{2, true}, {2, true}});
+  }
+
+  return states;
 }
 
 std::tuple<torch::Tensor, torch::Tensor, torch::IValue>
@@ -4,11 +4,13 @@
 #ifndef SHERPA_CSRC_ONLINE_CONFORMER_TRANSDUCER_MODEL_H_
 #define SHERPA_CSRC_ONLINE_CONFORMER_TRANSDUCER_MODEL_H_
 
+#include <memory>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include "sherpa/csrc/online-transducer-model.h"
+#include "sherpa/csrc/packed-state.h"
 
 namespace sherpa {
 
@@ -42,6 +44,9 @@ class OnlineConformerTransducerModel : public OnlineTransducerModel {
   torch::IValue StackStates(
       const std::vector<torch::IValue> &states) const override;
 
+  torch::IValue StackStates(const std::vector<torch::IValue> &states,
+                            torch::IValue *buffer) const override;
+
   std::vector<torch::IValue> UnStackStates(torch::IValue states) const override;
 
   torch::IValue GetEncoderInitStates(int32_t unused = 1) override;
@@ -93,7 +98,11 @@ class OnlineConformerTransducerModel : public OnlineTransducerModel {
   int32_t chunk_size_;
   int32_t chunk_shift_;
 
- private:
+  // Created by the first call to GetEncoderInitStates(). When non-null,
+  // per-stream states are kept in the packed representation and
+  // StackStates()/UnStackStates() take the packed fast path; see
+  // sherpa/csrc/packed-state.h.
+  std::unique_ptr<PackedStateConverter> packed_state_converter_;
 };
 
 }  // namespace sherpa
@@ -4,6 +4,7 @@
 
 #include "sherpa/csrc/online-conv-emformer-transducer-model.h"
 
+#include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -72,6 +73,11 @@ OnlineConvEmformerTransducerModel::StateFromIValue(torch::IValue ivalue) const {
 
 torch::IValue OnlineConvEmformerTransducerModel::StackStates(
     const std::vector<torch::IValue> &states) const {
+  if (packed_state_converter_) {
+    torch::IValue buffer;
+    return packed_state_converter_->StackStates(states, &buffer);
+  }
+
   int32_t batch_size = states.size();
 
   // attn_caches.size() == num_layers
@@ -146,8 +152,21 @@ torch::IValue OnlineConvEmformerTransducerModel::StackStates(
   return torch::ivalue::Tuple::create(stacked_attn_caches, stacked_conv_caches);
 }
 
+torch::IValue OnlineConvEmformerTransducerModel::StackStates(
+    const std::vector<torch::IValue> &states, torch::IValue *buffer) const {
+  if (packed_state_converter_) {
+    return packed_state_converter_->StackStates(states, buffer);
+  }
+
+  return OnlineTransducerModel::StackStates(states, buffer);
+}
+
 std::vector<torch::IValue> OnlineConvEmformerTransducerModel::UnStackStates(
     torch::IValue states) const {
+  if (packed_state_converter_) {
+    return packed_state_converter_->UnStackStates(states);
+  }
+
   TORCH_CHECK(states.isTuple(), "Expect a tuple. Given ", states.tagKind());
 
   auto tuple_ptr = states.toTuple();
@@ -203,7 +222,25 @@ std::vector<torch::IValue> OnlineConvEmformerTransducerModel::UnStackStates(
 torch::IValue OnlineConvEmformerTransducerModel::GetEncoderInitStates(
     int32_t /*unused = 1*/) {
   torch::NoGradGuard no_grad;
-  return encoder_.run_method("init_states", device_);
+  auto states = encoder_.run_method("init_states", device_);
+
+  // The state is a tuple (attn_caches, conv_caches) of tensors without
+  // a batch dimension; StackStates() inserts it as dim 1 of every attn
+  // cache and as dim 0 of every conv cache.
+  if (!packed_state_converter_) {
+    std::vector<StateLeafSpec> leaf_specs;
+    const auto &elements = states.toTuple()->elements();
+    for (const auto &layer : elements[0].toListRef()) {
+      leaf_specs.insert(leaf_specs.end(), layer.toList().size(), {1, true});
+    }
+    leaf_specs.insert(leaf_specs.end(), elements[1].toList().size(),
+                      {0, true});
+
+    packed_state_converter_ =
+        std::make_unique<PackedStateConverter>(states, leaf_specs);
+  }
+
+  return states;
 }
 
 std::tuple<torch::Tensor, torch::Tensor, torch::IValue>
@@ -4,12 +4,14 @@
 #ifndef SHERPA_CSRC_ONLINE_CONV_EMFORMER_TRANSDUCER_MODEL_H_
 #define SHERPA_CSRC_ONLINE_CONV_EMFORMER_TRANSDUCER_MODEL_H_
 
+#include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
 
 #include "sherpa/csrc/online-transducer-model.h"
+#include "sherpa/csrc/packed-state.h"
 
 namespace sherpa {
 
@@ -38,6 +40,9 @@ class OnlineConvEmformerTransducerModel : public OnlineTransducerModel {
   torch::IValue StackStates(
       const std::vector<torch::IValue> &states) const override;
 
+  torch::IValue StackStates(const std::vector<torch::IValue> &states,
+                            torch::IValue *buffer) const override;
+
   std::vector<torch::IValue> UnStackStates(torch::IValue states) const override;
 
   torch::IValue GetEncoderInitStates(int32_t unused = 1) override;
@@ -84,6 +89,12 @@ class OnlineConvEmformerTransducerModel : public OnlineTransducerModel {
   int32_t context_size_;
   int32_t chunk_size_;
   int32_t chunk_shift_;
+
+  // Created by the first call to GetEncoderInitStates(). When non-null,
+  // per-stream states are kept in the packed representation and
+  // StackStates()/UnStackStates() take the packed fast path; see
+  // sherpa/csrc/packed-state.h.
+  std::unique_ptr<PackedStateConverter> packed_state_converter_;
 };
 
 }  // namespace sherpa
@@ -0,0 +1,59 @@
+// sherpa/csrc/online-ctc-greedy-search-decoder.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/online-ctc-greedy-search-decoder.h"
+
+namespace sherpa {
+
+OnlineTransducerDecoderResult OnlineCtcGreedySearchDecoder::GetEmptyResult() {
+  // Unlike the transducer decoders, no leading blanks are needed since
+  // there is no decoder network context to prime.
+  return {};
+}
+
+void OnlineCtcGreedySearchDecoder::Decode(
+    torch::Tensor log_prob,
+    std::vector<OnlineTransducerDecoderResult> *result) {
+  // One batched argmax over the whole chunk; only the per-frame indices
+  // are copied back to the host.
+  auto best = log_prob.argmax(/*dim*/ -1).cpu().to(torch::kLong).contiguous();
+  auto best_acc = best.accessor<int64_t, 2>();
+
+  int32_t batch_size = best.size(0);
+  int32_t num_frames = best.size(1);
+
+  for (int32_t i = 0; i != batch_size; ++i) {
+    auto &r = (*result)[i];
+
+    // Label of the frame right before this chunk, used to collapse a
+    // repeat spanning the chunk boundary. A non-blank frame always
+    // carries the last emitted token, so the label can be reconstructed
+    // from the result instead of being stored separately.
+    int32_t prev = (r.num_trailing_blanks > 0 || r.tokens.empty())
+                       ? 0
+                       : r.tokens.back();
+
+    for (int32_t t = 0; t != num_frames; ++t) {
+      int32_t token = best_acc[i][t];
+      if (token != 0 && token != prev) {
+        r.tokens.push_back(token);
+        if (r.track_timestamps) {
+          r.timestamps.push_back(r.frame_offset + t);
+        }
+      }
+
+      if (token == 0) {
+        ++r.num_trailing_blanks;
+      } else {
+        r.num_trailing_blanks = 0;
+      }
+
+      prev = token;
+    }
+
+    r.frame_offset += num_frames;
+  }
+}
+
+}  // namespace sherpa
@@ -0,0 +1,35 @@
+// sherpa/csrc/online-ctc-greedy-search-decoder.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_CSRC_ONLINE_CTC_GREEDY_SEARCH_DECODER_H_
+#define SHERPA_CSRC_ONLINE_CTC_GREEDY_SEARCH_DECODER_H_
+
+#include <vector>
+
+#include "sherpa/csrc/online-transducer-decoder.h"
+
+namespace sherpa {
+
+/** Incremental CTC greedy search.
+ *
+ * Each call consumes the log-probs of one chunk and appends the newly
+ * decoded tokens to the running result, collapsing repeats across the
+ * chunk boundary, so no per-stream state beyond the result itself is
+ * needed.
+ */
+class OnlineCtcGreedySearchDecoder : public OnlineTransducerDecoder {
+ public:
+  OnlineTransducerDecoderResult GetEmptyResult() override;
+
+  /**
+   * @param log_prob  The CTC log-probs of one chunk; a 3-D tensor of
+   *                  shape (N, T, vocab_size). See OnlineCtcModel for
+   *                  why it arrives through the encoder-output slot.
+   */
+  void Decode(torch::Tensor log_prob,
+              std::vector<OnlineTransducerDecoderResult> *result) override;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_ONLINE_CTC_GREEDY_SEARCH_DECODER_H_
@@ -0,0 +1,60 @@
+// sherpa/csrc/online-ctc-model.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_CSRC_ONLINE_CTC_MODEL_H_
+#define SHERPA_CSRC_ONLINE_CTC_MODEL_H_
+
+#include <vector>
+
+#include "sherpa/csrc/log.h"
+#include "sherpa/csrc/online-transducer-model.h"
+
+namespace sherpa {
+
+/** Base class for streaming CTC models.
+ *
+ * The streaming pipeline of OnlineRecognizer -- chunk batching, state
+ * stacking and the reusable device-side buffers -- does not care about
+ * the model type, so CTC models plug into it through the transducer
+ * interface: RunEncoder() returns the CTC log-probs in place of the
+ * encoder output and the search consumes them directly. The decoder and
+ * joiner entry points of the transducer interface are never called for
+ * CTC models.
+ */
+class OnlineCtcModel : public OnlineTransducerModel {
+ public:
+  // CTC models have no prediction network.
+  int32_t ContextSize() const override { return 0; }
+
+  torch::Tensor RunDecoder(const torch::Tensor & /*decoder_input*/) override {
+    SHERPA_LOG(FATAL) << "CTC models have no decoder network";
+    return {};
+  }
+
+  torch::Tensor RunJoiner(const torch::Tensor & /*encoder_out*/,
+                          const torch::Tensor & /*decoder_out*/) override {
+    SHERPA_LOG(FATAL) << "CTC models have no joiner network";
+    return {};
+  }
+
+  void WarmUp(torch::Tensor features, torch::Tensor features_length) override {
+    int32_t batch_size = features.size(0);
+    torch::IValue states = GetEncoderInitStates();
+    states = StackStates(std::vector<torch::IValue>(batch_size, states));
+    torch::Tensor num_processed_frames = torch::zeros_like(features_length);
+
+    torch::Tensor log_prob;
+    torch::Tensor log_prob_len;
+    torch::IValue next_states;
+
+    std::tie(log_prob, log_prob_len, next_states) =
+        RunEncoder(features, features_length, num_processed_frames, states);
+    // log_prob.shape: (N, T, vocab_size)
+
+    SetVocabSize(log_prob.size(-1));
+  }
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_ONLINE_CTC_MODEL_H_
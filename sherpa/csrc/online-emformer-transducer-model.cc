@@ -4,6 +4,7 @@
 
 #include "sherpa/csrc/online-emformer-transducer-model.h"
 
+#include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -58,6 +59,11 @@ OnlineEmformerTransducerModel::StateFromIValue(torch::IValue ivalue) const {
 
 torch::IValue OnlineEmformerTransducerModel::StackStates(
     const std::vector<torch::IValue> &ivalue) const {
+  if (packed_state_converter_) {
+    torch::IValue buffer;
+    return packed_state_converter_->StackStates(ivalue, &buffer);
+  }
+
   int32_t batch_size = ivalue.size();
   int32_t num_layers = 0;
   int32_t num_states = 0;
@@ -102,8 +108,21 @@ torch::IValue OnlineEmformerTransducerModel::StackStates(
   return StateToIValue(ans);
 }
 
+torch::IValue OnlineEmformerTransducerModel::StackStates(
+    const std::vector<torch::IValue> &states, torch::IValue *buffer) const {
+  if (packed_state_converter_) {
+    return packed_state_converter_->StackStates(states, buffer);
+  }
+
+  return OnlineTransducerModel::StackStates(states, buffer);
+}
+
 std::vector<torch::IValue> OnlineEmformerTransducerModel::UnStackStates(
     torch::IValue ivalue) const {
+  if (packed_state_converter_) {
+    return packed_state_converter_->UnStackStates(ivalue);
+  }
+
   auto states = StateFromIValue(ivalue);
   int32_t num_layers = states.size();
   int32_t batch_size = states[0][0].size(1);
@@ -139,9 +158,25 @@ std::vector<torch::IValue> OnlineEmformerTransducerModel::UnStackStates(
 torch::IValue OnlineEmformerTransducerModel::GetEncoderInitStates(
     int32_t /*unused=1*/) {
   torch::IValue ivalue = encoder_.run_method("get_init_state", device_);
+
+  if (packed_state_converter_) {
+    return packed_state_converter_->UnStackStates(ivalue)[0];
+  }
+
   // Remove batch dimension.
   // Note: This is for backward compatibility
-  return UnStackStates(ivalue)[0];
+  torch::IValue states = UnStackStates(ivalue)[0];
+
+  // The state is a list of num_layers lists of tensors, each without a
+  // batch dimension; StackStates() inserts it as dim 1 of every tensor.
+  size_t num_leaves = 0;
+  for (const auto &layer : states.toListRef()) {
+    num_leaves += layer.toList().size();
+  }
+  packed_state_converter_ = std::make_unique<PackedStateConverter>(
+      states, std::vector<StateLeafSpec>(num_leaves, {1, true}));
+
+  return states;
 }
 
 std::tuple<torch::Tensor, torch::Tensor, torch::IValue>
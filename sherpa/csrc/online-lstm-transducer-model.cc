@@ -4,6 +4,8 @@
 
 #include "sherpa/csrc/online-lstm-transducer-model.h"
 
+#include <future>  // NOLINT
+#include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -15,13 +17,22 @@ OnlineLstmTransducerModel::OnlineLstmTransducerModel(
     const std::string &encoder_filename, const std::string &decoder_filename,
     const std::string &joiner_filename, torch::Device device /*=torch::kCPU*/)
     : device_(device) {
+  // The three TorchScript files are independent, so deserialize them
+  // concurrently; the encoder dominates and is kept on this thread.
+  auto decoder_future = std::async(std::launch::async, [&]() {
+    return torch::jit::load(decoder_filename, device);
+  });
+  auto joiner_future = std::async(std::launch::async, [&]() {
+    return torch::jit::load(joiner_filename, device);
+  });
+
   encoder_ = torch::jit::load(encoder_filename, device);
   encoder_.eval();
 
-  decoder_ = torch::jit::load(decoder_filename, device);
-  encoder_.eval();
+  decoder_ = decoder_future.get();
+  decoder_.eval();
 
-  joiner_ = torch::jit::load(joiner_filename, device);
+  joiner_ = joiner_future.get();
   joiner_.eval();
 
   context_size_ =
@@ -51,6 +62,11 @@ OnlineLstmTransducerModel::State OnlineLstmTransducerModel::StateFromIValue(
 
 torch::IValue OnlineLstmTransducerModel::StackStates(
     const std::vector<torch::IValue> &states) const {
+  if (packed_state_converter_) {
+    torch::IValue buffer;
+    return packed_state_converter_->StackStates(states, &buffer);
+  }
+
   auto n = static_cast<int32_t>(states.size());
 
   std::vector<torch::Tensor> hx;
@@ -70,8 +86,21 @@ torch::IValue OnlineLstmTransducerModel::StackStates(
   return torch::ivalue::Tuple::create(cat_hx, cat_cx);
 }
 
+torch::IValue OnlineLstmTransducerModel::StackStates(
+    const std::vector<torch::IValue> &states, torch::IValue *buffer) const {
+  if (packed_state_converter_) {
+    return packed_state_converter_->StackStates(states, buffer);
+  }
+
+  return OnlineTransducerModel::StackStates(states, buffer);
+}
+
 std::vector<torch::IValue> OnlineLstmTransducerModel::UnStackStates(
     torch::IValue ivalue) const {
+  if (packed_state_converter_) {
+    return packed_state_converter_->UnStackStates(ivalue);
+  }
+
   auto states = StateFromIValue(ivalue);
 
   std::vector<torch::Tensor> hx = states.first.unbind(/*dim*/ 1);
@@ -91,7 +120,15 @@ std::vector<torch::IValue> OnlineLstmTransducerModel::UnStackStates(
 torch::IValue OnlineLstmTransducerModel::GetEncoderInitStates(
     int32_t batch_size /*=1*/) {
   torch::NoGradGuard no_grad;
-  return encoder_.run_method("get_init_states", batch_size, device_);
+  auto states = encoder_.run_method("get_init_states", batch_size, device_);
+
+  // The state is a tuple (hx, cx) with batch dim 1 in both tensors.
+  if (!packed_state_converter_ && batch_size == 1) {
+    packed_state_converter_ = std::make_unique<PackedStateConverter>(
+        states, std::vector<StateLeafSpec>{{1, false}, {1, false}});
+  }
+
+  return states;
 }
 
 std::tuple<torch::Tensor, torch::Tensor, torch::IValue>
@@ -3,12 +3,14 @@
 // Copyright (c)  2022  Xiaomi Corporation
 #ifndef SHERPA_CSRC_ONLINE_LSTM_TRANSDUCER_MODEL_H_
 #define SHERPA_CSRC_ONLINE_LSTM_TRANSDUCER_MODEL_H_
+#include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
 
 #include "sherpa/csrc/online-transducer-model.h"
+#include "sherpa/csrc/packed-state.h"
 
 namespace sherpa {
 /** This class implements models from lstm_transducer_stateless{,2,3}
@@ -38,6 +40,9 @@ class OnlineLstmTransducerModel : public OnlineTransducerModel {
   torch::IValue StackStates(
       const std::vector<torch::IValue> &states) const override;
 
+  torch::IValue StackStates(const std::vector<torch::IValue> &states,
+                            torch::IValue *buffer) const override;
+
   std::vector<torch::IValue> UnStackStates(torch::IValue states) const override;
 
   torch::IValue GetEncoderInitStates(int32_t batch_size = 1) override;
@@ -88,6 +93,12 @@ class OnlineLstmTransducerModel : public OnlineTransducerModel {
   int32_t context_size_;
   int32_t chunk_size_;
   int32_t chunk_shift_;
+
+  // Created by the first call to GetEncoderInitStates() with batch size
+  // 1. When non-null, per-stream states are kept in the packed
+  // representation and StackStates()/UnStackStates() take the packed
+  // fast path; see sherpa/csrc/packed-state.h.
+  std::unique_ptr<PackedStateConverter> packed_state_converter_;
 };
 
 }  // namespace sherpa
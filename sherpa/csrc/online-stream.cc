@@ -18,8 +18,11 @@
 
 #include "sherpa/cpp_api/online-stream.h"
 
+#include <condition_variable>  // NOLINT
+#include <deque>
 #include <memory>
 #include <mutex>  // NOLINT
+#include <thread>  // NOLINT
 #include <utility>
 #include <vector>
 
@@ -33,13 +36,229 @@
 
 namespace sherpa {
 
+// Recursively move every tensor contained in the given IValue to the
+// given device. Encoder states are tensors, tuples or lists of tensors
+// depending on the model type, so all three are handled.
+static torch::IValue IValueToDevice(torch::IValue ivalue,
+                                    torch::Device device) {
+  if (ivalue.isTensor()) {
+    return ivalue.toTensor().to(device);
+  }
+
+  if (ivalue.isTuple()) {
+    auto tuple = ivalue.toTuple();
+    std::vector<torch::IValue> elements;
+    elements.reserve(tuple->elements().size());
+    for (const auto &e : tuple->elements()) {
+      elements.push_back(IValueToDevice(e, device));
+    }
+    return torch::ivalue::Tuple::create(std::move(elements));
+  }
+
+  if (ivalue.isList()) {
+    auto list = ivalue.toList();
+    c10::impl::GenericList ans(list.elementType());
+    ans.reserve(list.size());
+    for (size_t i = 0; i != list.size(); ++i) {
+      ans.push_back(IValueToDevice(list.get(i), device));
+    }
+    return ans;
+  }
+
+  return ivalue;
+}
+
+// Like IValueToDevice(), but tensors of dtype `from` are cast to `to`
+// on the way (pass identical values to disable casting), and the
+// result is placed in pinned host memory when `pin_memory` is true, so
+// a later move back to the GPU is a fast asynchronous DMA copy. The
+// cast runs on whichever side of the copy is a GPU, so the PCIe
+// transfer always carries the narrow representation.
+static torch::IValue IValueTransfer(torch::IValue ivalue,
+                                    torch::Device device,
+                                    torch::ScalarType from,
+                                    torch::ScalarType to, bool pin_memory) {
+  if (ivalue.isTensor()) {
+    torch::Tensor t = ivalue.toTensor();
+    bool cast = from != to && t.scalar_type() == from;
+    if (cast && device.is_cpu()) {
+      t = t.to(to);
+    }
+    t = t.to(device);
+    if (cast && !device.is_cpu()) {
+      t = t.to(to);
+    }
+    if (pin_memory && device.is_cpu() && !t.is_pinned()) {
+      t = t.pin_memory();
+    }
+    return t;
+  }
+
+  if (ivalue.isTuple()) {
+    auto tuple = ivalue.toTuple();
+    std::vector<torch::IValue> elements;
+    elements.reserve(tuple->elements().size());
+    for (const auto &e : tuple->elements()) {
+      elements.push_back(IValueTransfer(e, device, from, to, pin_memory));
+    }
+    return torch::ivalue::Tuple::create(std::move(elements));
+  }
+
+  if (ivalue.isList()) {
+    auto list = ivalue.toList();
+    c10::impl::GenericList ans(list.elementType());
+    ans.reserve(list.size());
+    for (size_t i = 0; i != list.size(); ++i) {
+      ans.push_back(IValueTransfer(list.get(i), device, from, to, pin_memory));
+    }
+    return ans;
+  }
+
+  return ivalue;
+}
+
+// Copy the values of every tensor in `src` into the corresponding,
+// already-allocated tensor of `dst` in place. Returns false -- possibly
+// after copying a prefix -- if the two nests differ in structure or
+// tensor geometry; callers then fall back to adopting `src` wholesale.
+static bool CopyIValueInPlace(const torch::IValue &src,
+                              const torch::IValue &dst) {
+  if (src.isTensor() && dst.isTensor()) {
+    torch::Tensor s = src.toTensor();
+    torch::Tensor d = dst.toTensor();
+    if (s.sizes() != d.sizes() || s.scalar_type() != d.scalar_type()) {
+      return false;
+    }
+    d.copy_(s, /*non_blocking*/ true);
+    return true;
+  }
+
+  if (src.isTuple() && dst.isTuple()) {
+    const auto &s = src.toTuple()->elements();
+    const auto &d = dst.toTuple()->elements();
+    if (s.size() != d.size()) {
+      return false;
+    }
+    for (size_t i = 0; i != s.size(); ++i) {
+      if (!CopyIValueInPlace(s[i], d[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (src.isList() && dst.isList()) {
+    auto s = src.toList();
+    auto d = dst.toList();
+    if (s.size() != d.size()) {
+      return false;
+    }
+    for (size_t i = 0; i != s.size(); ++i) {
+      if (!CopyIValueInPlace(s.get(i), d.get(i))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  return false;
+}
+
+// Return the device of the first tensor contained in the given IValue,
+// or nullopt if it contains none.
+static c10::optional<torch::Device> FindTensorDevice(
+    const torch::IValue &ivalue) {
+  if (ivalue.isTensor()) {
+    return ivalue.toTensor().device();
+  }
+
+  if (ivalue.isTuple()) {
+    for (const auto &e : ivalue.toTuple()->elements()) {
+      if (auto device = FindTensorDevice(e)) {
+        return device;
+      }
+    }
+  }
+
+  if (ivalue.isList()) {
+    auto list = ivalue.toList();
+    for (size_t i = 0; i != list.size(); ++i) {
+      if (auto device = FindTensorDevice(list.get(i))) {
+        return device;
+      }
+    }
+  }
+
+  return c10::nullopt;
+}
+
+// Copy one feature frame out of the fbank computer into `dst`.
+//
+// The feature dim is a template parameter, so the inner loop has a
+// compile-time trip count the compiler can fully unroll and vectorize;
+// kDim == 0 is the generic variant with a runtime dim. Which variant a
+// stream uses is decided once at construction (see copy_frame_), so the
+// per-frame path itself stays branch-free.
+template <int32_t kDim>
+static void CopyFrame(kaldifeat::OnlineFbank *fbank, int32_t frame,
+                      float *dst, int32_t dim) {
+  torch::Tensor f = fbank->GetFrame(frame).contiguous();
+  const float *src = f.data_ptr<float>();
+
+  if (kDim != 0) {
+    dim = kDim;
+  }
+
+  for (int32_t i = 0; i != dim; ++i) {
+    dst[i] = src[i];
+  }
+}
+
 class OnlineStream::OnlineStreamImpl {
  public:
-  explicit OnlineStreamImpl(const kaldifeat::FbankOptions &opts) : opts_(opts) {
+  explicit OnlineStreamImpl(const kaldifeat::FbankOptions &opts,
+                            bool async_feature_computation)
+      : opts_(opts) {
     fbank_ = std::make_unique<kaldifeat::OnlineFbank>(opts);
+
+    // Every model we serve uses 80-dim fbank, so that dim gets the
+    // fixed-trip-count specialization; anything else falls back to the
+    // generic copy.
+    copy_frame_ =
+        (opts.mel_opts.num_bins == 80) ? &CopyFrame<80> : &CopyFrame<0>;
+
+    if (async_feature_computation) {
+      feat_worker_ = std::thread([this]() { FeatureWorkerLoop(); });
+    }
+  }
+
+  ~OnlineStreamImpl() {
+    if (feat_worker_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stop_feat_worker_ = true;
+      }
+      queue_cv_.notify_one();
+      feat_worker_.join();
+    }
   }
 
   void AcceptWaveform(int32_t sampling_rate, torch::Tensor waveform) {
+    if (feat_worker_.joinable()) {
+      // Hand the samples over to the feature worker; the caller never
+      // blocks on feature extraction.
+      {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        pending_.emplace_back(sampling_rate, std::move(waveform));
+      }
+      queue_cv_.notify_one();
+      return;
+    }
+
+    ComputeFeatures(sampling_rate, std::move(waveform));
+  }
+
+  void ComputeFeatures(int32_t sampling_rate, torch::Tensor waveform) {
     std::lock_guard<std::mutex> lock(feat_mutex_);
 
     if (resampler_) {
@@ -51,7 +270,9 @@ class OnlineStream::OnlineStreamImpl {
       }
 
       waveform = resampler_->Resample(waveform, false);
+      GateBlock(waveform);
       fbank_->AcceptWaveform(opts_.frame_opts.samp_freq, waveform);
+      PrefetchFrames();
       return;
     }
 
@@ -71,11 +292,26 @@ class OnlineStream::OnlineStreamImpl {
           lowpass_filter_width);
 
       waveform = resampler_->Resample(waveform, false);
+      GateBlock(waveform);
       fbank_->AcceptWaveform(opts_.frame_opts.samp_freq, waveform);
+      PrefetchFrames();
       return;
     }
 
+    GateBlock(waveform);
     fbank_->AcceptWaveform(sampling_rate, waveform);
+    PrefetchFrames();
+  }
+
+  void SetSilenceGateThreshold(float threshold) {
+    std::lock_guard<std::mutex> lock(feat_mutex_);
+    silence_gate_threshold_ = threshold;
+    trailing_silence_samples_ = 0;
+  }
+
+  float TrailingSilenceSeconds() const {
+    std::lock_guard<std::mutex> lock(feat_mutex_);
+    return trailing_silence_samples_ / opts_.frame_opts.samp_freq;
   }
 
   int32_t NumFramesReady() const {
@@ -89,29 +325,211 @@ class OnlineStream::OnlineStreamImpl {
   }
 
   void InputFinished() {
+    if (feat_worker_.joinable()) {
+      // Enqueue a sentinel so that InputFinished() takes effect only
+      // after all pending samples have been processed.
+      {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        pending_.emplace_back(0, torch::Tensor());
+      }
+      queue_cv_.notify_one();
+      return;
+    }
+
     std::lock_guard<std::mutex> lock(feat_mutex_);
     fbank_->InputFinished();
+    PrefetchFrames();
   }
 
   torch::Tensor GetFrame(int32_t frame) {
     std::lock_guard<std::mutex> lock(feat_mutex_);
-    return fbank_->GetFrame(frame);
+    // Served from the same contiguous buffer as GetFrames(), so a frame
+    // is copied out of the fbank computer exactly once no matter how it
+    // is consumed, and the returned tensor is a view.
+    return GetFramesImpl(frame, 1);
+  }
+
+  torch::Tensor GetFrames(int32_t first, int32_t n) {
+    std::lock_guard<std::mutex> lock(feat_mutex_);
+    return GetFramesImpl(first, n);
+  }
+
+  void SetChunkGeometry(int32_t chunk_size, int32_t chunk_shift) {
+    std::lock_guard<std::mutex> lock(feat_mutex_);
+    chunk_size_ = chunk_size;
+    chunk_shift_ = chunk_shift;
+  }
+
+  int32_t ChunkSize() const { return chunk_size_; }
+
+  int32_t ChunkShift() const { return chunk_shift_; }
+
+  bool IsChunkReady(int32_t chunk_index) const {
+    SHERPA_CHECK_GT(chunk_size_, 0) << "Call SetChunkGeometry() first";
+    std::lock_guard<std::mutex> lock(feat_mutex_);
+    return fbank_->NumFramesReady() >=
+           chunk_index * chunk_shift_ + chunk_size_;
+  }
+
+  torch::Tensor GetChunk(int32_t chunk_index) {
+    SHERPA_CHECK_GT(chunk_size_, 0) << "Call SetChunkGeometry() first";
+    std::lock_guard<std::mutex> lock(feat_mutex_);
+    return GetFramesImpl(chunk_index * chunk_shift_, chunk_size_);
   }
 
   torch::IValue GetState() const { return state_; }
 
-  void SetState(torch::IValue state) { state_ = std::move(state); }
+  void SetState(torch::IValue state) {
+    state_ = std::move(state);
+    // A freshly assigned state is at its native device and precision;
+    // any offload bookkeeping of the previous state is obsolete.
+    state_offloaded_ = false;
+  }
+
+  void OffloadState(bool use_fp16) {
+    if (state_offloaded_ || state_.isNone()) {
+      return;
+    }
 
-  void SetResult(const OnlineTransducerDecoderResult &r) { r_ = r; }
+    auto device = FindTensorDevice(state_);
+    if (!device || device->is_cpu()) {
+      // Host-resident states stay where they are: there is no device
+      // memory to reclaim and the fp16 saving alone does not justify
+      // the round-trip error.
+      return;
+    }
+
+    state_device_ = *device;
+    // With use_fp16, fp32 tensors travel and rest as fp16 (half the
+    // host memory and half the PCIe traffic); identical from/to values
+    // disable the cast.
+    state_ = IValueTransfer(state_, torch::Device(torch::kCPU),
+                            /*from*/ torch::kFloat,
+                            /*to*/ use_fp16 ? torch::kHalf : torch::kFloat,
+                            /*pin_memory*/ true);
+
+    if (decoder_out_.defined() && !decoder_out_.device().is_cpu()) {
+      // The cached decoder output feeds the search directly, so it is
+      // offloaded at full precision.
+      decoder_out_ = decoder_out_.to(torch::kCPU);
+      decoder_out_offloaded_ = true;
+    }
+
+    state_offloaded_ = true;
+  }
+
+  void OnloadState() {
+    if (!state_offloaded_) {
+      return;
+    }
+
+    state_ = IValueTransfer(state_, state_device_,
+                            /*from*/ torch::kHalf,
+                            /*to*/ torch::kFloat,
+                            /*pin_memory*/ false);
+
+    if (decoder_out_offloaded_ && decoder_out_.defined()) {
+      decoder_out_ = decoder_out_.to(state_device_);
+    }
+
+    state_offloaded_ = false;
+    decoder_out_offloaded_ = false;
+  }
+
+  bool IsStateOffloaded() const { return state_offloaded_; }
+
+  void MigrateStates(torch::Device device) {
+    if (!state_.isNone()) {
+      state_ = IValueToDevice(state_, device);
+    }
+
+    if (decoder_out_.defined()) {
+      decoder_out_ = decoder_out_.to(device);
+    }
+
+    if (cmvn_stats_.defined()) {
+      cmvn_stats_ = cmvn_stats_.to(device);
+    }
+  }
+
+  void ResetForNextUtterance(torch::IValue init_state) {
+    // Offloaded states live in pinned (possibly fp16) host memory with a
+    // different geometry; re-arming them in place is not worth the
+    // bookkeeping, so they adopt the fresh state directly.
+    if (state_offloaded_ || !CopyIValueInPlace(init_state, state_)) {
+      SetState(std::move(init_state));
+    }
+
+    hyps_.clear();
+    hypotheses_ = Hypotheses();
+    decoder_out_ = torch::Tensor();
+    num_trailing_blank_frames_ = 0;
+    segment_ += 1;
+    start_frame_ = num_processed_frames_;
+    r_ = OnlineTransducerDecoderResult();
+  }
+
+  void Reset() {
+    if (feat_worker_.joinable()) {
+      // Samples of the previous session that are still queued must not
+      // leak into the new one.
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      pending_.clear();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(feat_mutex_);
+      fbank_ = std::make_unique<kaldifeat::OnlineFbank>(opts_);
+      resampler_.reset();
+
+      // frame_buffer_ keeps its storage; only the bookkeeping is reset.
+      buffer_first_frame_ = 0;
+      num_buffered_ = 0;
+
+      // The gate configuration survives a reset like the chunk geometry
+      // does; only the per-session silence run is cleared.
+      trailing_silence_samples_ = 0;
+    }
+
+    state_ = torch::IValue();
+    hyps_.clear();
+    hypotheses_ = Hypotheses();
+    decoder_out_ = torch::Tensor();
+    cmvn_stats_ = torch::Tensor();
+    num_processed_frames_ = 0;
+    num_trailing_blank_frames_ = 0;
+    segment_ = 0;
+    start_frame_ = 0;
+    r_ = OnlineTransducerDecoderResult();
+    r_.track_timestamps = enable_timestamps_;
+  }
+
+  void SetResult(const OnlineTransducerDecoderResult &r) {
+    r_ = r;
+    // The flag belongs to the stream, not to the result: a fresh result
+    // installed on an endpoint or utterance reset keeps it.
+    r_.track_timestamps = enable_timestamps_;
+  }
+
+  void SetEnableTimestamps(bool enable) {
+    enable_timestamps_ = enable;
+    r_.track_timestamps = enable;
+  }
+
+  bool EnableTimestamps() const { return enable_timestamps_; }
 
   const OnlineTransducerDecoderResult &GetResult() const { return r_; }
 
+  OnlineTransducerDecoderResult &GetResult() { return r_; }
+
   int32_t &GetNumProcessedFrames() { return num_processed_frames_; }
 
   std::vector<int32_t> &GetHyps() { return hyps_; }
 
   torch::Tensor &GetDecoderOut() { return decoder_out_; }
 
+  torch::Tensor &GetCmvnStats() { return cmvn_stats_; }
+
   Hypotheses &GetHypotheses() { return hypotheses_; }
 
   int32_t &GetNumTrailingBlankFrames() { return num_trailing_blank_frames_; }
@@ -120,15 +538,190 @@ class OnlineStream::OnlineStreamImpl {
 
   int32_t &GetStartFrame() { return start_frame_; }
 
+ private:
+  // The caller must be holding feat_mutex_. Classify the block for the
+  // silence gate: a silent block extends the trailing silence run, a
+  // block containing speech ends it. The block has already been
+  // resampled to the model sampling rate at this point.
+  void GateBlock(const torch::Tensor &waveform) {
+    if (silence_gate_threshold_ <= 0 || waveform.numel() == 0) {
+      return;
+    }
+
+    float power = waveform.square().mean().item<float>();
+    if (power < silence_gate_threshold_) {
+      trailing_silence_samples_ += waveform.numel();
+    } else {
+      trailing_silence_samples_ = 0;
+    }
+  }
+
+  // The caller must be holding feat_mutex_.
+  torch::Tensor GetFramesImpl(int32_t first, int32_t n) {
+    if (!frame_buffer_.defined()) {
+      buffer_first_frame_ = first;
+    }
+
+    if (first < buffer_first_frame_) {
+      // Frames are normally consumed in order, so this should not happen.
+      // Fall back to per-frame fetching to stay correct.
+      std::vector<torch::Tensor> frames(n);
+      for (int32_t k = 0; k != n; ++k) {
+        frames[k] = fbank_->GetFrame(first + k);
+      }
+      return torch::cat(frames, /*dim*/ 0);
+    }
+
+    // Drop frames that have already been consumed once they occupy a
+    // sizable prefix of the buffer, so memory stays bounded for
+    // long-running streams.
+    if (frame_buffer_.defined() && first - buffer_first_frame_ >= 1024) {
+      int32_t keep = num_buffered_ - (first - buffer_first_frame_);
+      if (keep > 0) {
+        frame_buffer_.narrow(0, 0, keep)
+            .copy_(frame_buffer_.narrow(0, first - buffer_first_frame_, keep));
+      } else {
+        keep = 0;
+      }
+      num_buffered_ = keep;
+      buffer_first_frame_ = first;
+    }
+
+    BufferFramesUpTo(first + n);
+
+    return frame_buffer_.narrow(0, first - buffer_first_frame_, n);
+  }
+
+  // The caller must be holding feat_mutex_. Grows the buffer if needed
+  // and copies frames [buffer_first_frame_ + num_buffered_, end) out of
+  // the fbank computer into the contiguous buffer.
+  void BufferFramesUpTo(int32_t end) {
+    int32_t needed = end - buffer_first_frame_;
+    if (needed <= num_buffered_) {
+      return;
+    }
+
+    int32_t feature_dim = opts_.mel_opts.num_bins;
+    if (!frame_buffer_.defined()) {
+      frame_buffer_ = torch::empty({std::max<int32_t>(needed, 128),
+                                    feature_dim},
+                                   torch::kFloat);
+    }
+
+    if (needed > frame_buffer_.size(0)) {
+      int32_t new_capacity = frame_buffer_.size(0);
+      while (new_capacity < needed) {
+        new_capacity *= 2;
+      }
+      torch::Tensor new_buffer =
+          torch::empty({new_capacity, feature_dim}, torch::kFloat);
+      new_buffer.narrow(0, 0, num_buffered_)
+          .copy_(frame_buffer_.narrow(0, 0, num_buffered_));
+      frame_buffer_ = new_buffer;
+    }
+
+    // Raw pointer copies instead of one narrow().copy_() dispatch per
+    // frame; copy_frame_ carries the feature dim as a compile-time
+    // constant for the 80-dim fbank every production model uses.
+    float *dst = frame_buffer_.data_ptr<float>() +
+                 static_cast<int64_t>(num_buffered_) * feature_dim;
+    for (int32_t frame = buffer_first_frame_ + num_buffered_; frame != end;
+         ++frame, dst += feature_dim) {
+      copy_frame_(fbank_.get(), frame, dst, feature_dim);
+    }
+    num_buffered_ = needed;
+  }
+
+  // The caller must be holding feat_mutex_. Materialize every frame that
+  // is ready but not yet in the contiguous buffer, so a later GetChunk()
+  // is a single lock acquisition returning a view. Only active once the
+  // chunk geometry is known; until then frames are buffered on demand.
+  void PrefetchFrames() {
+    if (chunk_size_ == 0) {
+      return;
+    }
+    BufferFramesUpTo(fbank_->NumFramesReady());
+  }
+
+  // Drains pending_ on the feature worker thread. The queue is fully
+  // drained before the thread exits, so no samples are lost on
+  // destruction.
+  void FeatureWorkerLoop() {
+    while (true) {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      queue_cv_.wait(lock,
+                     [this] { return stop_feat_worker_ || !pending_.empty(); });
+      if (pending_.empty()) {
+        return;
+      }
+
+      auto task = std::move(pending_.front());
+      pending_.pop_front();
+      lock.unlock();
+
+      if (!task.second.defined()) {
+        // The sentinel enqueued by InputFinished().
+        std::lock_guard<std::mutex> feat_lock(feat_mutex_);
+        fbank_->InputFinished();
+        PrefetchFrames();
+      } else {
+        ComputeFeatures(task.first, std::move(task.second));
+      }
+    }
+  }
+
  private:
   kaldifeat::FbankOptions opts_;
   std::unique_ptr<kaldifeat::OnlineFbank> fbank_;
   mutable std::mutex feat_mutex_;
 
+  // Selected at construction: CopyFrame<80> when the feature dim is 80,
+  // the generic CopyFrame<0> otherwise.
+  void (*copy_frame_)(kaldifeat::OnlineFbank *, int32_t, float *,
+                      int32_t) = &CopyFrame<0>;
+
+  // Used only when the stream is created with async feature computation
+  // enabled. The caller thread pushes (sampling_rate, waveform) pairs
+  // and the feature worker pops them; an undefined tensor serves as the
+  // InputFinished() sentinel.
+  std::thread feat_worker_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  std::deque<std::pair<int32_t, torch::Tensor>> pending_;
+  bool stop_feat_worker_ = false;
+
+  // Contiguous 2-D buffer of shape (capacity, feature_dim) holding frames
+  // [buffer_first_frame_, buffer_first_frame_ + num_buffered_). It backs
+  // the views returned by GetFrames().
+  torch::Tensor frame_buffer_;
+  int32_t buffer_first_frame_ = 0;
+  int32_t num_buffered_ = 0;
+
+  // Chunk geometry used by IsChunkReady()/GetChunk(); 0 until
+  // SetChunkGeometry() is called.
+  int32_t chunk_size_ = 0;
+  int32_t chunk_shift_ = 0;
+
+  // Waveform-energy silence gate; see SetSilenceGateThreshold(). The
+  // gate is disabled while the threshold is <= 0. The trailing silence
+  // run is counted in samples at the model sampling rate and guarded by
+  // feat_mutex_.
+  float silence_gate_threshold_ = 0;
+  int64_t trailing_silence_samples_ = 0;
+
   torch::IValue state_;
+
+  // Offload bookkeeping; see OnlineStream::OffloadState(). state_device_
+  // is the device the state lived on before it was offloaded.
+  bool state_offloaded_ = false;
+  bool decoder_out_offloaded_ = false;
+  torch::Device state_device_{torch::kCPU};
+
   std::vector<int32_t> hyps_;
   Hypotheses hypotheses_;
   torch::Tensor decoder_out_;
+  // Streaming CMVN statistics; see OnlineStream::GetCmvnStats().
+  torch::Tensor cmvn_stats_;
   int32_t num_processed_frames_ = 0;       // before subsampling
   int32_t num_trailing_blank_frames_ = 0;  // after subsampling
   /// ID of this segment
@@ -136,12 +729,18 @@ class OnlineStream::OnlineStreamImpl {
 
   /// Starting frame of this segment.
   int32_t start_frame_ = 0;
+
+  /// See OnlineStream::SetEnableTimestamps().
+  bool enable_timestamps_ = true;
+
   OnlineTransducerDecoderResult r_;
   std::unique_ptr<LinearResample> resampler_;
 };
 
-OnlineStream::OnlineStream(const kaldifeat::FbankOptions &opts)
-    : impl_(std::make_unique<OnlineStreamImpl>(opts)) {}
+OnlineStream::OnlineStream(const kaldifeat::FbankOptions &opts,
+                           bool async_feature_computation /*= false*/)
+    : impl_(std::make_unique<OnlineStreamImpl>(opts,
+                                               async_feature_computation)) {}
 
 OnlineStream::~OnlineStream() = default;
 
@@ -162,10 +761,58 @@ torch::Tensor OnlineStream::GetFrame(int32_t frame) {
   return impl_->GetFrame(frame);
 }
 
+torch::Tensor OnlineStream::GetFrames(int32_t first, int32_t n) {
+  return impl_->GetFrames(first, n);
+}
+
+void OnlineStream::SetChunkGeometry(int32_t chunk_size, int32_t chunk_shift) {
+  impl_->SetChunkGeometry(chunk_size, chunk_shift);
+}
+
+int32_t OnlineStream::ChunkSize() const { return impl_->ChunkSize(); }
+
+int32_t OnlineStream::ChunkShift() const { return impl_->ChunkShift(); }
+
+bool OnlineStream::IsChunkReady(int32_t chunk_index) const {
+  return impl_->IsChunkReady(chunk_index);
+}
+
+torch::Tensor OnlineStream::GetChunk(int32_t chunk_index) {
+  return impl_->GetChunk(chunk_index);
+}
+
+void OnlineStream::SetSilenceGateThreshold(float threshold) {
+  impl_->SetSilenceGateThreshold(threshold);
+}
+
+float OnlineStream::TrailingSilenceSeconds() const {
+  return impl_->TrailingSilenceSeconds();
+}
+
 torch::IValue OnlineStream::GetState() const { return impl_->GetState(); }
 
 void OnlineStream::SetState(torch::IValue state) { impl_->SetState(state); }
 
+void OnlineStream::MigrateStates(torch::Device device) {
+  impl_->MigrateStates(device);
+}
+
+void OnlineStream::OffloadState(bool use_fp16) {
+  impl_->OffloadState(use_fp16);
+}
+
+void OnlineStream::OnloadState() { impl_->OnloadState(); }
+
+bool OnlineStream::IsStateOffloaded() const {
+  return impl_->IsStateOffloaded();
+}
+
+void OnlineStream::ResetForNextUtterance(torch::IValue init_state) {
+  impl_->ResetForNextUtterance(std::move(init_state));
+}
+
+void OnlineStream::Reset() { impl_->Reset(); }
+
 int32_t &OnlineStream::GetNumProcessedFrames() {
   return impl_->GetNumProcessedFrames();
 }
@@ -174,6 +821,8 @@ std::vector<int32_t> &OnlineStream::GetHyps() { return impl_->GetHyps(); }
 
 torch::Tensor &OnlineStream::GetDecoderOut() { return impl_->GetDecoderOut(); }
 
+torch::Tensor &OnlineStream::GetCmvnStats() { return impl_->GetCmvnStats(); }
+
 Hypotheses &OnlineStream::GetHypotheses() { return impl_->GetHypotheses(); }
 
 int32_t &OnlineStream::GetNumTrailingBlankFrames() {
@@ -188,8 +837,20 @@ void OnlineStream::SetResult(const OnlineTransducerDecoderResult &r) {
   impl_->SetResult(r);
 }
 
+void OnlineStream::SetEnableTimestamps(bool enable) {
+  impl_->SetEnableTimestamps(enable);
+}
+
+bool OnlineStream::EnableTimestamps() const {
+  return impl_->EnableTimestamps();
+}
+
 const OnlineTransducerDecoderResult &OnlineStream::GetResult() const {
   return impl_->GetResult();
 }
 
+OnlineTransducerDecoderResult &OnlineStream::GetResult() {
+  return impl_->GetResult();
+}
+
 }  // namespace sherpa
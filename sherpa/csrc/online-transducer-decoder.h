@@ -5,6 +5,7 @@
 #ifndef SHERPA_CSRC_ONLINE_TRANSDUCER_DECODER_H_
 #define SHERPA_CSRC_ONLINE_TRANSDUCER_DECODER_H_
 
+#include <string>
 #include <vector>
 
 #include "k2/torch_api.h"
@@ -26,6 +27,11 @@ struct OnlineTransducerDecoderResult {
   /// timestamps[i] contains the output frame index where tokens[i] is decoded.
   std::vector<int32_t> timestamps;
 
+  /// false to skip recording timestamps: the decoders do no timestamp
+  /// work for this stream and `timestamps` stays empty. Owned by the
+  /// stream; see OnlineStream::SetEnableTimestamps().
+  bool track_timestamps = true;
+
   // used only for modified_beam_search
   Hypotheses hyps;
 
@@ -33,6 +39,15 @@ struct OnlineTransducerDecoderResult {
 
   // Before subsampling. Used only for fast_beam_search
   int32_t num_processed_frames = 0;
+
+  /// Cache used by OnlineRecognizer::GetResult() for incremental
+  /// token-to-text conversion. converted_tokens is the prefix of the
+  /// stripped token sequence that has already been turned into text;
+  /// converted_text is the corresponding text. Beam search may switch to
+  /// a hypothesis that rewrites the prefix, so the converter validates
+  /// converted_tokens against the current tokens before reusing the text.
+  std::vector<int32_t> converted_tokens;
+  std::string converted_text;
 };
 
 class OnlineTransducerDecoder {
@@ -62,6 +77,18 @@ class OnlineTransducerDecoder {
    */
   virtual void Decode(torch::Tensor encoder_out,
                       std::vector<OnlineTransducerDecoderResult> *result) = 0;
+
+  /** Change the beam size used from the next Decode() call on.
+   *
+   * Servers use it to trade accuracy for throughput at runtime: under
+   * deadline pressure the beam is narrowed, when load drops it is
+   * widened again; see OnlineWebsocketDecoderConfig::adaptive_beam.
+   * The default implementation ignores the call, which is correct for
+   * search methods without a beam (greedy search).
+   *
+   * @param n The new beam size. Values < 1 are clamped to 1.
+   */
+  virtual void SetNumActivePaths(int32_t /*n*/) {}
 };
 }  // namespace sherpa
 
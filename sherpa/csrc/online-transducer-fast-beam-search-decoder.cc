@@ -7,6 +7,7 @@
 #include <utility>
 
 #include "k2/torch_api.h"
+#include "sherpa/csrc/graph-cache.h"
 #include "sherpa/csrc/online-transducer-decoder.h"
 
 namespace sherpa {
@@ -18,8 +19,8 @@ OnlineTransducerFastBeamSearchDecoder::OnlineTransducerFastBeamSearchDecoder(
     // Use a trivial graph
     decoding_graph_ = k2::GetTrivialGraph(vocab_size_ - 1, model_->Device());
   } else {
-    decoding_graph_ = k2::LoadFsaClass(config.lg, model_->Device());
-    k2::ScaleTensorAttribute(decoding_graph_, config.ngram_lm_scale, "scores");
+    decoding_graph_ = LoadCachedFsaClass(config.lg, model_->Device(),
+                                         config.ngram_lm_scale);
   }
 }
 
@@ -54,9 +55,6 @@ void OnlineTransducerFastBeamSearchDecoder::Decode(
     num_processed_frames_vec.push_back(r.num_processed_frames);
   }
 
-  torch::Tensor num_processed_frames =
-      torch::tensor(num_processed_frames_vec, torch::kInt);
-
   k2::RnntStreamsPtr streams =
       k2::CreateRnntStreams(stream_vec, vocab_size_, context_size, config_.beam,
                             config_.max_contexts, config_.max_states);
@@ -70,7 +68,17 @@ void OnlineTransducerFastBeamSearchDecoder::Decode(
     contexts = contexts.to(torch::kLong);
     // contexts.shape: (num_hyps, context_size)
 
-    auto decoder_out = model_->RunDecoder(contexts).squeeze(1);
+    // The decoder output is a pure function of the context tokens and
+    // the same few contexts recur on every chunk, so most rows hit the
+    // LRU cache instead of rerunning the decoder network; see
+    // decoder-output-cache.h.
+    auto decoder_out =
+        decoder_output_cache_
+            .Get(contexts.cpu(),
+                 [this, device](torch::Tensor miss_input) -> torch::Tensor {
+                   return model_->RunDecoder(miss_input.to(device));
+                 })
+            .squeeze(1);
     // decoder_out.shape: (num_hyps, joiner_dim)
 
     auto cur_encoder_out = encoder_out.index({torch::indexing::Slice(), t});
@@ -90,11 +98,10 @@ void OnlineTransducerFastBeamSearchDecoder::Decode(
   k2::TerminateAndFlushRnntStreams(streams);
 
   // TODO(fangjun): This assumes the subsampling factor is 4
-  num_processed_frames = (num_processed_frames / 4).to(torch::kInt) + T;
-
-  std::vector<int32_t> processed_frames_vec(
-      num_processed_frames.data_ptr<int32_t>(),
-      num_processed_frames.data_ptr<int32_t>() + num_processed_frames.numel());
+  std::vector<int32_t> processed_frames_vec(num_processed_frames_vec);
+  for (auto &f : processed_frames_vec) {
+    f = f / 4 + T;
+  }
 
   auto lattice =
       k2::FormatOutput(streams, processed_frames_vec, config_.allow_partial);
@@ -130,7 +137,9 @@ void OnlineTransducerFastBeamSearchDecoder::Decode(
     }
 
     p->tokens.push_back(token);
-    p->timestamps.push_back(t);
+    if (p->track_timestamps) {
+      p->timestamps.push_back(t);
+    }
     ++t;
   }  // for (int32_t i = 0, t = 0; i != labels.numel(); ++i)
 }
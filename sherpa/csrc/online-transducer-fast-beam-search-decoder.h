@@ -8,6 +8,7 @@
 
 #include "k2/torch_api.h"
 #include "sherpa/cpp_api/fast-beam-search-config.h"
+#include "sherpa/csrc/decoder-output-cache.h"
 #include "sherpa/csrc/online-transducer-decoder.h"
 #include "sherpa/csrc/online-transducer-model.h"
 
@@ -33,6 +34,7 @@ class OnlineTransducerFastBeamSearchDecoder : public OnlineTransducerDecoder {
 
   FastBeamSearchConfig config_;
   int32_t vocab_size_;
+  DecoderOutputCache decoder_output_cache_;
 };
 
 }  // namespace sherpa
@@ -7,6 +7,8 @@
 #include <algorithm>
 #include <vector>
 
+#include "sherpa/csrc/pinned-staging.h"
+
 namespace sherpa {
 
 static void BuildDecoderInput(
@@ -43,6 +45,34 @@ void OnlineTransducerGreedySearchDecoder::StripLeadingBlanks(
   r->tokens = std::vector<int32_t>(start, end);
 }
 
+torch::Tensor OnlineTransducerGreedySearchDecoder::ComputeSkipMask(
+    torch::Tensor encoder_out, torch::Tensor decoder_out) const {
+  if (blank_skip_threshold_ >= 1) {
+    return {};
+  }
+
+  int32_t blank_id = 0;  // always 0
+  int32_t N = encoder_out.size(0);
+  int32_t T = encoder_out.size(1);
+  int32_t joiner_dim = encoder_out.size(2);
+
+  auto logits = model_->RunJoiner(encoder_out.reshape({N * T, joiner_dim}),
+                                  decoder_out.unsqueeze(1)
+                                      .expand({N, T, joiner_dim})
+                                      .reshape({N * T, joiner_dim}));
+  // logits has shape (N * T, vocab_size)
+
+  auto blank_probs = logits.softmax(-1)
+                         .index({torch::indexing::Slice(), blank_id})
+                         .view({N, T});
+
+  // A frame is skipped only when every stream of the batch is
+  // blank-dominated on it. The mask is staged through pinned memory,
+  // so fetching it costs one async copy and one wait per chunk.
+  static thread_local PinnedStagingBuffer staging;
+  return staging.Stage((blank_probs > blank_skip_threshold_).all(/*dim*/ 0));
+}
+
 void OnlineTransducerGreedySearchDecoder::Decode(
     torch::Tensor encoder_out,
     std::vector<OnlineTransducerDecoderResult> *results) {
@@ -51,6 +81,11 @@ void OnlineTransducerGreedySearchDecoder::Decode(
   TORCH_CHECK(encoder_out.size(0) == static_cast<int32_t>(results->size()),
               encoder_out.size(0), " vs ", results->size());
 
+  if (encoder_out.is_cuda()) {
+    DecodeOnDevice(encoder_out, results);
+    return;
+  }
+
   auto device = model_->Device();
   int32_t blank_id = 0;  // always 0
   int32_t context_size = model_->ContextSize();
@@ -63,10 +98,26 @@ void OnlineTransducerGreedySearchDecoder::Decode(
                              .memory_format(torch::MemoryFormat::Contiguous));
   BuildDecoderInput(*results, &decoder_input);
 
-  auto decoder_out = model_->RunDecoder(decoder_input.to(device)).squeeze(1);
+  auto run_decoder = [this, device](torch::Tensor miss_input) {
+    return model_->RunDecoder(miss_input.to(device));
+  };
+
+  auto decoder_out =
+      decoder_output_cache_.Get(decoder_input, run_decoder).squeeze(1);
   // decoder_out has shape (N, joiner_dim)
 
+  auto skip_mask = ComputeSkipMask(encoder_out, decoder_out);
+  const bool *skip =
+      skip_mask.defined() ? skip_mask.data_ptr<bool>() : nullptr;
+
   for (int32_t t = 0; t != T; ++t) {
+    if (skip && skip[t]) {
+      for (auto &r : *results) {
+        ++r.num_trailing_blanks;
+      }
+      continue;
+    }
+
     auto cur_encoder_out = encoder_out.index({torch::indexing::Slice(), t});
     // cur_encoder_out has shape (N, joiner_dim)
 
@@ -75,24 +126,45 @@ void OnlineTransducerGreedySearchDecoder::Decode(
 
     auto max_indices = logits.argmax(/*dim*/ -1).cpu();
     auto max_indices_accessor = max_indices.accessor<int64_t, 1>();
-    bool emitted = false;
+    std::vector<int64_t> emitted;
     for (int32_t n = 0; n != N; ++n) {
       auto index = max_indices_accessor[n];
       auto &r = (*results)[n];
       if (index != blank_id) {
-        emitted = true;
+        emitted.push_back(n);
 
         r.tokens.push_back(index);
-        r.timestamps.push_back(t + r.frame_offset);
+        if (r.track_timestamps) {
+          r.timestamps.push_back(t + r.frame_offset);
+        }
         r.num_trailing_blanks = 0;
       } else {
         ++r.num_trailing_blanks;
       }
     }
 
-    if (emitted) {
-      BuildDecoderInput(*results, &decoder_input);
-      decoder_out = model_->RunDecoder(decoder_input.to(device)).squeeze(1);
+    if (!emitted.empty()) {
+      // Re-run the decoder only for the streams that emitted a token
+      // and scatter the fresh rows back, instead of recomputing the
+      // whole batch.
+      auto emitted_input = torch::empty(
+          {static_cast<int64_t>(emitted.size()), context_size},
+          torch::dtype(torch::kLong)
+              .memory_format(torch::MemoryFormat::Contiguous));
+      int64_t *p = emitted_input.data_ptr<int64_t>();
+      for (auto n : emitted) {
+        const auto &tokens = (*results)[n].tokens;
+        std::copy(tokens.end() - context_size, tokens.end(), p);
+        p += context_size;
+      }
+
+      auto fresh_rows =
+          decoder_output_cache_.Get(emitted_input, run_decoder).squeeze(1);
+      // fresh_rows has shape (emitted.size(), joiner_dim)
+
+      auto emitted_index =
+          torch::tensor(emitted, torch::kLong).to(decoder_out.device());
+      decoder_out.index_copy_(/*dim*/ 0, emitted_index, fresh_rows);
       // decoder_out has shape (N, joiner_dim)
     }
   }  // for (int32_t t = 0; t != T; ++t)
@@ -103,4 +175,90 @@ void OnlineTransducerGreedySearchDecoder::Decode(
   }
 }
 
+void OnlineTransducerGreedySearchDecoder::DecodeOnDevice(
+    torch::Tensor encoder_out,
+    std::vector<OnlineTransducerDecoderResult> *results) {
+  auto device = model_->Device();
+  int32_t blank_id = 0;  // always 0
+  int32_t context_size = model_->ContextSize();
+
+  int32_t N = encoder_out.size(0);
+  int32_t T = encoder_out.size(1);
+
+  auto decoder_input_cpu = torch::empty(
+      {N, context_size}, torch::dtype(torch::kLong)
+                             .memory_format(torch::MemoryFormat::Contiguous));
+  BuildDecoderInput(*results, &decoder_input_cpu);
+
+  torch::Tensor decoder_input = decoder_input_cpu.to(device);
+  torch::Tensor decoder_out = model_->RunDecoder(decoder_input).squeeze(1);
+  // decoder_out has shape (N, joiner_dim)
+
+  // Per-frame argmax indices of all streams; copied back to the host in
+  // one transfer after the frame loop.
+  torch::Tensor all_tokens =
+      torch::empty({T, N}, torch::dtype(torch::kLong).device(device));
+
+  auto skip_mask = ComputeSkipMask(encoder_out, decoder_out);
+  const bool *skip =
+      skip_mask.defined() ? skip_mask.data_ptr<bool>() : nullptr;
+
+  for (int32_t t = 0; t != T; ++t) {
+    if (skip && skip[t]) {
+      // Counted as a blank frame for every stream by the host loop
+      // below.
+      all_tokens.select(0, t).fill_(blank_id);
+      continue;
+    }
+
+    auto cur_encoder_out = encoder_out.index({torch::indexing::Slice(), t});
+    // cur_encoder_out has shape (N, joiner_dim)
+
+    auto logits = model_->RunJoiner(cur_encoder_out, decoder_out);
+    // logits has shape (N, vocab_size)
+
+    auto max_indices = logits.argmax(/*dim*/ -1);
+    // max_indices has shape (N,) and stays on the device
+
+    all_tokens.select(0, t).copy_(max_indices);
+
+    // Shift the context of the streams that emitted a token and re-run
+    // the decoder unconditionally. This trades a few cheap decoder calls
+    // for not synchronizing with the host to find out whether any stream
+    // emitted.
+    auto emitted = max_indices.ne(blank_id).unsqueeze(1);
+    // emitted has shape (N, 1)
+
+    auto shifted = torch::cat({decoder_input.narrow(1, 1, context_size - 1),
+                               max_indices.unsqueeze(1)},
+                              /*dim*/ 1);
+    decoder_input = torch::where(emitted, shifted, decoder_input);
+    decoder_out = model_->RunDecoder(decoder_input).squeeze(1);
+  }  // for (int32_t t = 0; t != T; ++t)
+
+  // The only D2H transfer of this chunk: one async copy into pinned
+  // memory and one wait, instead of .cpu()'s synchronous trip through
+  // pageable memory.
+  static thread_local PinnedStagingBuffer staging;
+  auto all_tokens_cpu = staging.Stage(all_tokens);
+  auto all_tokens_accessor = all_tokens_cpu.accessor<int64_t, 2>();
+
+  for (int32_t n = 0; n != N; ++n) {
+    auto &r = (*results)[n];
+    for (int32_t t = 0; t != T; ++t) {
+      auto index = all_tokens_accessor[t][n];
+      if (index != blank_id) {
+        r.tokens.push_back(index);
+        if (r.track_timestamps) {
+          r.timestamps.push_back(t + r.frame_offset);
+        }
+        r.num_trailing_blanks = 0;
+      } else {
+        ++r.num_trailing_blanks;
+      }
+    }
+    r.frame_offset += T;
+  }
+}
+
 }  // namespace sherpa
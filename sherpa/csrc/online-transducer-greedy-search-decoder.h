@@ -6,6 +6,7 @@
 
 #include <vector>
 
+#include "sherpa/csrc/decoder-output-cache.h"
 #include "sherpa/csrc/online-transducer-decoder.h"
 #include "sherpa/csrc/online-transducer-model.h"
 
@@ -13,8 +14,17 @@ namespace sherpa {
 
 class OnlineTransducerGreedySearchDecoder : public OnlineTransducerDecoder {
  public:
-  explicit OnlineTransducerGreedySearchDecoder(OnlineTransducerModel *model)
-      : model_(model) {}
+  /**
+   * @param model  The transducer model. It is NOT owned.
+   * @param blank_skip_threshold  Frames whose blank posterior exceeds
+   *                              this value for every stream of the
+   *                              batch are skipped without running the
+   *                              per-frame emit logic. Values >= 1
+   *                              disable skipping.
+   */
+  explicit OnlineTransducerGreedySearchDecoder(OnlineTransducerModel *model,
+                                               float blank_skip_threshold = 1)
+      : model_(model), blank_skip_threshold_(blank_skip_threshold) {}
 
   OnlineTransducerDecoderResult GetEmptyResult() override;
 
@@ -23,8 +33,39 @@ class OnlineTransducerGreedySearchDecoder : public OnlineTransducerDecoder {
   void Decode(torch::Tensor encoder_out,
               std::vector<OnlineTransducerDecoderResult> *result) override;
 
+ private:
+  /** GPU-resident variant of Decode().
+   *
+   * It keeps argmax, blank detection and the decoder-input update on the
+   * device and copies only the per-frame argmax indices back to the host,
+   * once per chunk, instead of synchronizing with the device on every
+   * frame.
+   */
+  void DecodeOnDevice(torch::Tensor encoder_out,
+                      std::vector<OnlineTransducerDecoderResult> *result);
+
+  /** Compute which frames of the chunk can be skipped.
+   *
+   * It runs one batched joiner call over the whole chunk using the
+   * decoder output at chunk start and marks a frame as skippable when
+   * the blank posterior of every stream exceeds blank_skip_threshold_.
+   * The posterior of frames after an in-chunk emission is approximated
+   * by the chunk-start context; skipped frames count as trailing
+   * blanks.
+   *
+   * @param encoder_out  A 3-D tensor of shape (N, T, joiner_dim).
+   * @param decoder_out  A 2-D tensor of shape (N, joiner_dim).
+   *
+   * @return Return an undefined tensor if skipping is disabled;
+   *         otherwise return a CPU bool tensor of shape (T,).
+   */
+  torch::Tensor ComputeSkipMask(torch::Tensor encoder_out,
+                                torch::Tensor decoder_out) const;
+
  private:
   OnlineTransducerModel *model_;  // Not owned
+  float blank_skip_threshold_;
+  DecoderOutputCache decoder_output_cache_;
 };
 
 }  // namespace sherpa
@@ -7,6 +7,7 @@
 #include <tuple>
 #include <vector>
 
+#include "sherpa/csrc/log.h"
 #include "torch/script.h"
 
 namespace sherpa {
@@ -25,6 +26,28 @@ class OnlineTransducerModel {
   virtual torch::IValue StackStates(
       const std::vector<torch::IValue> &states) const = 0;
 
+  /** Stack a list of individual states into a batch, reusing a
+   * preallocated output buffer when the model supports it.
+   *
+   * @param states states[i] contains the state for the i-th utterance.
+   * @param buffer On entry it is either an uninitialized IValue or the
+   *               value stored here by a previous call. On exit it holds
+   *               the batched state so the caller can pass it back on the
+   *               next call. A buffer created for a different batch size
+   *               is ignored and replaced.
+   * @return Return a single value representing the batched state. It may
+   *         alias `buffer`, so the caller must not recycle the buffer
+   *         until the returned state has been consumed.
+   *
+   * The default implementation forwards to StackStates() and allocates
+   * fresh output tensors on every call.
+   */
+  virtual torch::IValue StackStates(const std::vector<torch::IValue> &states,
+                                    torch::IValue *buffer) const {
+    *buffer = StackStates(states);
+    return *buffer;
+  }
+
   /** Unstack a batch state into a list of individual states.
    *
    * It is the inverse operation of `StackStates`.
@@ -116,13 +139,41 @@ class OnlineTransducerModel {
    */
   virtual int32_t ChunkShift() const = 0;
 
+  /** Convert the model to half precision (fp16).
+   *
+   * It must be called before any of the Run* functions and before
+   * GetEncoderInitStates(). After the call, features and states are
+   * expected/produced in half precision, while RunJoiner() still
+   * returns fp32 logits so that the search is unaffected.
+   *
+   * Supported only by some models; the default implementation aborts.
+   */
+  virtual void UseFp16() {
+    SHERPA_LOG(FATAL) << "--use-fp16 is not supported for this model type";
+  }
+
+  /** Capture the encoder forward into CUDA Graphs, one per batch size,
+   * and replay them on subsequent calls to RunEncoder().
+   *
+   * It must be called before any call to RunEncoder(). It eliminates the
+   * per-kernel launch overhead, which dominates the per-tick cost for
+   * small batches.
+   *
+   * Supported only by some models; the default implementation aborts.
+   */
+  virtual void UseCudaGraph() {
+    SHERPA_LOG(FATAL)
+        << "--use-cuda-graph is not supported for this model type";
+  }
+
   int32_t VocabSize() const { return vocab_size_; }
 
-  int32_t SubsamplingFactor() const { return 4; }
+  virtual int32_t SubsamplingFactor() const { return 4; }
 
-  void WarmUp(torch::Tensor features, torch::Tensor features_length) {
+  virtual void WarmUp(torch::Tensor features, torch::Tensor features_length) {
+    int32_t batch_size = features.size(0);
     torch::IValue states = GetEncoderInitStates();
-    states = StackStates({states});
+    states = StackStates(std::vector<torch::IValue>(batch_size, states));
     torch::Tensor num_processed_frames = torch::zeros_like(features_length);
 
     torch::Tensor encoder_out;
@@ -150,6 +201,30 @@ class OnlineTransducerModel {
     vocab_size_ = logits.size(-1);
   }
 
+ protected:
+  /** Set the vocabulary size. Used by WarmUp() overrides, e.g., for CTC
+   * models whose vocabulary size comes from the log-probs instead of the
+   * joiner output.
+   */
+  void SetVocabSize(int32_t vocab_size) { vocab_size_ = vocab_size; }
+
+  /** Cast every floating-point tensor of a state list to half precision.
+   *
+   * Integer tensors, e.g., cached_len of the Zipformer, are left
+   * untouched. Used by UseFp16() implementations on the initial states;
+   * subsequent states come out of the encoder already in fp16.
+   */
+  static torch::IValue StateListToHalf(torch::IValue states) {
+    auto list = states.toList();
+    std::vector<torch::Tensor> ans;
+    ans.reserve(list.size());
+    for (size_t i = 0; i != list.size(); ++i) {
+      torch::Tensor t = list.get(i).toTensor();
+      ans.push_back(t.is_floating_point() ? t.to(torch::kHalf) : t);
+    }
+    return ans;
+  }
+
  private:
   int32_t vocab_size_ = -1;
 };
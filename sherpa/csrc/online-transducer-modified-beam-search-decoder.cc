@@ -4,9 +4,13 @@
 #include "sherpa/csrc/online-transducer-modified-beam-search-decoder.h"
 
 #include <algorithm>
+#include <limits>
 #include <utility>
+#include <vector>
 
 #include "k2/torch_api.h"
+#include "sherpa/csrc/math.h"
+#include "sherpa/csrc/prof.h"
 
 namespace sherpa {
 
@@ -19,20 +23,59 @@ static torch::Tensor FloorDivide(torch::Tensor a, int32_t b) {
 #endif
 }
 
+/** Return a CPU tensor of shape `sizes` carved out of `*buf`.
+ *
+ * `*buf` is reallocated only when it is undefined or too small, and its
+ * leading dimension never shrinks, so across frames every buffer
+ * converges to its high-water mark and steady-state frames allocate
+ * nothing.
+ */
+static torch::Tensor GetScratch(torch::Tensor *buf, torch::IntArrayRef sizes,
+                                torch::ScalarType dtype) {
+  bool fits = buf->defined() && buf->scalar_type() == dtype &&
+              buf->dim() == static_cast<int64_t>(sizes.size()) &&
+              buf->size(0) >= sizes[0];
+  for (size_t i = 1; fits && i != sizes.size(); ++i) {
+    fits = buf->size(i) == sizes[i];
+  }
+
+  if (!fits) {
+    std::vector<int64_t> alloc(sizes.begin(), sizes.end());
+    if (buf->defined() && buf->scalar_type() == dtype &&
+        buf->dim() == static_cast<int64_t>(sizes.size())) {
+      alloc[0] = std::max(alloc[0], buf->size(0));
+    }
+    *buf = torch::empty(alloc, torch::dtype(dtype).memory_format(
+                                   torch::MemoryFormat::Contiguous));
+  }
+
+  return buf->narrow(/*dim*/ 0, /*start*/ 0, /*length*/ sizes[0]);
+}
+
+// Per-thread buffers reused across Decode() calls. The transient
+// tensors and hypothesis vectors the frame loop needs are small but are
+// created hundreds of times per second; pooling them removes that
+// allocator traffic. Everything here is scratch: no state is carried
+// between frames or calls.
+struct DecodeWorkspace {
+  torch::Tensor row_splits;     // (num_utt + 1,), kInt
+  torch::Tensor ys_log_probs;   // (num_hyps, 1), kFloat
+  torch::Tensor decoder_input;  // (num_hyps, context_size), kLong
+  torch::Tensor dest_index;     // (num_hyps,), kLong
+  std::vector<Hypothesis> prev;
+};
+
 static torch::Tensor BuildDecoderInput(const std::vector<Hypothesis> &hyps,
-                                       int32_t context_size) {
+                                       int32_t context_size,
+                                       DecodeWorkspace *ws) {
+  SHERPA_PROF_SCOPE(build_decoder_input);
   int32_t num_hyps = hyps.size();
-  torch::Tensor decoder_input =
-      torch::empty({num_hyps, context_size},
-                   torch::dtype(torch::kLong)
-                       .memory_format(torch::MemoryFormat::Contiguous));
+  torch::Tensor decoder_input = GetScratch(
+      &ws->decoder_input, {num_hyps, context_size}, torch::kLong);
 
   int64_t *p = decoder_input.data_ptr<int64_t>();
   for (const auto &h : hyps) {
-    auto start = h.ys.end() - context_size;
-    auto end = h.ys.end();
-
-    std::copy(start, end, p);
+    h.FillLastTokens(context_size, p);
     p += context_size;
   }
 
@@ -43,14 +86,17 @@ static torch::Tensor BuildDecoderInput(const std::vector<Hypothesis> &hyps,
  *
  * @param hyps hyps.size() == batch_size. Each entry contains the active
  *              hypotheses of an utterance.
+ * @param ws   Provides the buffer backing the row splits of the shape;
+ *             the shape stays valid only until the buffer is reused for
+ *             the next frame.
  * @return Return a ragged shape with 2 axes [utt][num_hyps]. Note that the
  *         shape is on CPU.
  */
-static k2::RaggedShapePtr GetHypsShape(const std::vector<Hypotheses> &hyps) {
+static k2::RaggedShapePtr GetHypsShape(const std::vector<Hypotheses> &hyps,
+                                       DecodeWorkspace *ws) {
   int32_t num_utt = hyps.size();
-  torch::Tensor row_splits = torch::empty(
-      {num_utt + 1},
-      torch::dtype(torch::kInt).memory_format(torch::MemoryFormat::Contiguous));
+  torch::Tensor row_splits =
+      GetScratch(&ws->row_splits, {num_utt + 1}, torch::kInt);
   auto row_splits_acc = row_splits.accessor<int32_t, 1>();
   for (int32_t i = 0; i != num_utt; ++i) {
     row_splits_acc[i] = hyps[i].Size();
@@ -78,13 +124,19 @@ OnlineTransducerModifiedBeamSearchDecoder::GetEmptyResult() {
 void OnlineTransducerModifiedBeamSearchDecoder::StripLeadingBlanks(
     OnlineTransducerDecoderResult *r) {
   int32_t context_size = model_->ContextSize();
-  auto hyp = r->hyps.GetMostProbable(true);
-
-  auto start = hyp.ys.begin() + context_size;
-  auto end = hyp.ys.end();
-
-  r->tokens = std::vector<int32_t>(start, end);
-  r->timestamps = std::move(hyp.timestamps);
+  // Callers pass a copy of the stream's result, so the winner can be
+  // moved out of the beam instead of copied; the stream keeps its own
+  // beam for the next chunk.
+  auto hyp = r->hyps.TakeMostProbable(true);
+
+  auto ys = hyp.Ys();
+  r->tokens = std::vector<int32_t>(ys.begin() + context_size, ys.end());
+  if (r->track_timestamps) {
+    // Timestamps live in the shared token list of the hypothesis, so
+    // tracking them costs nothing during the search; only this walk
+    // materializing the vector is skipped.
+    r->timestamps = hyp.Timestamps();
+  }
   r->num_trailing_blanks = hyp.num_trailing_blanks;
 }
 
@@ -100,16 +152,25 @@ void OnlineTransducerModifiedBeamSearchDecoder::Decode(
   int32_t blank_id = 0;  // always 0
   int32_t context_size = model_->ContextSize();
 
+  // Snapshot the beam size so a concurrent SetNumActivePaths() cannot
+  // change it in the middle of this batch.
+  int32_t num_active_paths = num_active_paths_;
+
   int32_t N = encoder_out.size(0);
   int32_t T = encoder_out.size(1);
 
+  // One workspace per thread: the same decoder may be driven from
+  // several worker threads, and the buffers are plain CPU scratch, so
+  // they can be shared across decoder instances.
+  static thread_local DecodeWorkspace ws;
+
   std::vector<Hypotheses> cur;
   cur.reserve(N);
   for (auto &r : *results) {
     cur.push_back(std::move(r.hyps));
   }
 
-  std::vector<Hypothesis> prev;
+  std::vector<Hypothesis> &prev = ws.prev;
 
   for (int32_t t = 0; t != T; ++t) {
     auto cur_encoder_out = encoder_out.index({torch::indexing::Slice(), t});
@@ -117,7 +178,7 @@ void OnlineTransducerModifiedBeamSearchDecoder::Decode(
 
     // Due to merging paths with identical token sequences,
     // not all utterances have "num_active_paths" paths.
-    auto hyps_shape = GetHypsShape(cur);
+    auto hyps_shape = GetHypsShape(cur, &ws);
     int32_t num_hyps = k2::TotSize(hyps_shape, 1);
 
     prev.clear();
@@ -130,71 +191,157 @@ void OnlineTransducerModifiedBeamSearchDecoder::Decode(
     cur.clear();
     cur.reserve(N);
 
-    auto ys_log_probs = torch::empty({num_hyps, 1}, torch::kFloat);
+    auto ys_log_probs =
+        GetScratch(&ws.ys_log_probs, {num_hyps, 1}, torch::kFloat);
 
     auto ys_log_probs_acc = ys_log_probs.accessor<float, 2>();
     for (int32_t k = 0; k != num_hyps; ++k) {
       ys_log_probs_acc[k][0] = prev[k].log_prob;
     }
 
-    auto decoder_input = BuildDecoderInput(prev, context_size).to(device);
-    auto decoder_out = model_->RunDecoder(decoder_input).squeeze(1);
+    auto decoder_input = BuildDecoderInput(prev, context_size, &ws);
+    auto decoder_out =
+        decoder_output_cache_
+            .Get(decoder_input,
+                 [this, device](torch::Tensor miss_input) -> torch::Tensor {
+                   return model_->RunDecoder(miss_input.to(device));
+                 })
+            .squeeze(1);
     // decoder_out is of shape (num_hyps, joiner_dim)
 
     auto index = k2::RowIds(hyps_shape, 1).to(torch::kLong).to(device);
     cur_encoder_out = cur_encoder_out.index_select(/*dim*/ 0, /*index*/ index);
     // cur_encoder_out is of shape (num_hyps, joiner_dim)
 
-    auto logits = model_->RunJoiner(cur_encoder_out, decoder_out);
+    torch::Tensor logits;
+    {
+      SHERPA_PROF_SCOPE(run_joiner);
+      logits = model_->RunJoiner(cur_encoder_out, decoder_out);
+    }
     // logits has shape (num_hyps, vocab_size)
 
-    auto log_probs = logits.log_softmax(-1).cpu();
+    auto log_probs = logits.log_softmax(-1);
 
-    log_probs.add_(ys_log_probs);
+    log_probs.add_(ys_log_probs.to(log_probs.device()));
 
     int32_t vocab_size = log_probs.size(1);
-    log_probs = log_probs.reshape(-1);
     auto row_splits = k2::RowSplits(hyps_shape, 1);
     auto row_splits_acc = row_splits.accessor<int32_t, 1>();
 
+    torch::Tensor topk_values, topk_indexes;
+    if (log_probs.is_cuda()) {
+      // Run the ragged per-stream top-k on the device and copy only the
+      // selected scores and indexes to the host, instead of copying the
+      // full (num_hyps, vocab_size) log-probs.
+      //
+      // Each stream's rows are scattered into a block of max_hyps rows
+      // padded with -inf, so that one batched topk covers all streams.
+      int32_t max_hyps = 0;
+      for (int32_t k = 0; k != N; ++k) {
+        max_hyps =
+            std::max(max_hyps, row_splits_acc[k + 1] - row_splits_acc[k]);
+      }
+
+      auto dest_index = GetScratch(&ws.dest_index, {num_hyps}, torch::kLong);
+      auto dest_index_acc = dest_index.accessor<int64_t, 1>();
+      for (int32_t k = 0; k != N; ++k) {
+        int32_t start = row_splits_acc[k];
+        int32_t end = row_splits_acc[k + 1];
+        for (int32_t i = start; i != end; ++i) {
+          dest_index_acc[i] = static_cast<int64_t>(k) * max_hyps + (i - start);
+        }
+      }
+
+      auto padded = torch::full({static_cast<int64_t>(N) * max_hyps,
+                                 static_cast<int64_t>(vocab_size)},
+                                -std::numeric_limits<float>::infinity(),
+                                log_probs.options());
+      padded.index_copy_(/*dim*/ 0, dest_index.to(device), log_probs);
+
+      // The -inf padding rows are never selected since each stream has
+      // at least vocab_size >= num_active_paths real entries.
+      std::tie(topk_values, topk_indexes) =
+          padded.view({N, static_cast<int64_t>(max_hyps) * vocab_size})
+              .topk(/*k*/ num_active_paths, /*dim*/ 1,
+                    /*largest*/ true, /*sorted*/ true);
+      topk_values = topk_values.cpu();
+      topk_indexes = topk_indexes.cpu();
+    } else {
+      log_probs = log_probs.reshape(-1);
+    }
+
+    const float *log_probs_data =
+        topk_values.defined() ? nullptr : log_probs.data_ptr<float>();
+
     for (int32_t k = 0; k != N; ++k) {
       int32_t frame_offset = (*results)[k].frame_offset;
 
       int32_t start = row_splits_acc[k];
       int32_t end = row_splits_acc[k + 1];
 
-      torch::Tensor values, indexes;
-      std::tie(values, indexes) =
-          log_probs.slice(/*dim*/ 0, start * vocab_size, end * vocab_size)
-              .topk(/*k*/ num_active_paths_, /*dim*/ 0,
-                    /*largest*/ true, /*sorted*/ true);
-
-      auto topk_hyp_indexes = FloorDivide(indexes, vocab_size);
-      auto topk_token_indexes = torch::remainder(indexes, vocab_size);
-
-      auto values_acc = values.accessor<float, 1>();
-      auto topk_hyp_indexes_acc = topk_hyp_indexes.accessor<int64_t, 1>();
-      auto topk_token_indexes_acc = topk_token_indexes.accessor<int64_t, 1>();
+      std::vector<Hypothesis> new_hyps;
 
-      Hypotheses hyps;
-      for (int32_t j = 0; j != values.numel(); ++j) {
-        int32_t hyp_idx = topk_hyp_indexes_acc[j];
+      // Extend one hypothesis of this stream with one token and collect
+      // the result; shared by the device and host top-k paths below.
+      auto extend = [&](int32_t hyp_idx, int32_t new_token, float log_prob) {
         Hypothesis new_hyp = prev[start + hyp_idx];  // note: hyp_idx is 0 based
 
-        int32_t new_token = topk_token_indexes_acc[j];
+        // We already added log_prob of the path to log_probs before, so
+        // we use the candidate score here directly.
+        new_hyp.log_prob = log_prob;
+
         if (new_token != blank_id) {
-          new_hyp.ys.push_back(new_token);
-          new_hyp.timestamps.push_back(t + frame_offset);
+          new_hyp.AddToken(new_token, t + frame_offset);
           new_hyp.num_trailing_blanks = 0;
+
+          if (context_graph_) {
+            auto next = context_graph_->ForwardOneStep(new_hyp.context_state,
+                                                       new_token);
+            new_hyp.context_state = next.first;
+            // The bonus enters the path score, so it keeps steering the
+            // beam on later frames like the acoustic scores do.
+            new_hyp.log_prob += next.second;
+          }
         } else {
           new_hyp.num_trailing_blanks += 1;
         }
 
-        // We already added log_prob of the path to log_probs before, so
-        // we use values_acc[j] here directly.
-        new_hyp.log_prob = values_acc[j];
-        hyps.Add(std::move(new_hyp));
+        new_hyps.push_back(std::move(new_hyp));
+      };
+
+      if (topk_values.defined()) {
+        auto values = topk_values.index({k});
+        auto indexes = topk_indexes.index({k});
+
+        auto topk_hyp_indexes = FloorDivide(indexes, vocab_size);
+        auto topk_token_indexes = torch::remainder(indexes, vocab_size);
+
+        auto values_acc = values.accessor<float, 1>();
+        auto topk_hyp_indexes_acc = topk_hyp_indexes.accessor<int64_t, 1>();
+        auto topk_token_indexes_acc = topk_token_indexes.accessor<int64_t, 1>();
+
+        new_hyps.reserve(values.numel());
+        for (int32_t j = 0; j != values.numel(); ++j) {
+          extend(topk_hyp_indexes_acc[j], topk_token_indexes_acc[j],
+                 values_acc[j]);
+        }
+      } else {
+        // Heap-based selection of the k best candidates of this stream;
+        // the candidate set is never fully sorted. See TopK() in math.h.
+        const float *cand = log_probs_data + start * vocab_size;
+        auto topk = TopK(cand, (end - start) * vocab_size, num_active_paths);
+
+        new_hyps.reserve(topk.size());
+        for (auto idx : topk) {
+          extend(idx / vocab_size, idx % vocab_size, cand[idx]);
+        }
       }
+
+      Hypotheses hyps;
+      hyps.SetPruning(num_active_paths, score_gap_);
+      hyps.AddBatch(std::move(new_hyps));
+      metric_candidates_->Inc(hyps.NumCandidates());
+      metric_merged_hyps_->Inc(hyps.NumMerged());
       cur.push_back(std::move(hyps));
     }  // for (int32_t k = 0; k != N; ++k)
   }    // for (int32_t t = 0; t != T; ++t)
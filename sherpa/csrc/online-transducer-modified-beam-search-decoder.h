@@ -4,8 +4,12 @@
 #ifndef SHERPA_CSRC_ONLINE_TRANSDUCER_MODIFIED_BEAM_SEARCH_DECODER_H_
 #define SHERPA_CSRC_ONLINE_TRANSDUCER_MODIFIED_BEAM_SEARCH_DECODER_H_
 
+#include <algorithm>
 #include <vector>
 
+#include "sherpa/csrc/context-graph.h"
+#include "sherpa/csrc/decoder-output-cache.h"
+#include "sherpa/csrc/metrics.h"
 #include "sherpa/csrc/online-transducer-decoder.h"
 #include "sherpa/csrc/online-transducer-model.h"
 
@@ -14,9 +18,36 @@ namespace sherpa {
 class OnlineTransducerModifiedBeamSearchDecoder
     : public OnlineTransducerDecoder {
  public:
+  /**
+   * @param model  The transducer model. It is NOT owned.
+   * @param num_active_paths  Beam size; at most this many hypotheses
+   *                          are kept per stream.
+   * @param score_gap  Hypotheses whose log-prob is more than this below
+   *                   the best one are pruned at insertion time.
+   *                   Values <= 0 disable gap pruning.
+   * @param context_graph  If not nullptr, hotword biasing scores from
+   *                       this graph are applied to every predicted
+   *                       token. It is NOT owned.
+   */
   explicit OnlineTransducerModifiedBeamSearchDecoder(
-      OnlineTransducerModel *model, int32_t num_active_paths)
-      : model_(model), num_active_paths_(num_active_paths) {}
+      OnlineTransducerModel *model, int32_t num_active_paths,
+      float score_gap = 0, const ContextGraph *context_graph = nullptr)
+      : model_(model),
+        num_active_paths_(num_active_paths),
+        score_gap_(score_gap),
+        context_graph_(context_graph) {
+    auto &metrics = MetricsRegistry::Get();
+    metric_candidates_ = metrics.GetCounter(
+        "sherpa_beam_candidates_total",
+        "Number of candidate hypotheses offered to the beam by "
+        "modified_beam_search.");
+    metric_merged_hyps_ = metrics.GetCounter(
+        "sherpa_beam_merged_hyps_total",
+        "Number of candidate hypotheses recombined into an already "
+        "stored hypothesis carrying the same token sequence. The merge "
+        "rate (merged / candidates) measures how much wider the "
+        "effective beam is than the stored one.");
+  }
 
   OnlineTransducerDecoderResult GetEmptyResult() override;
 
@@ -25,9 +56,23 @@ class OnlineTransducerModifiedBeamSearchDecoder
   void Decode(torch::Tensor encoder_out,
               std::vector<OnlineTransducerDecoderResult> *result) override;
 
+  void SetNumActivePaths(int32_t n) override {
+    // Decode() snapshots the value once per call, so a batch in flight
+    // on another thread finishes with the width it started with and the
+    // new width takes effect from the next batch.
+    num_active_paths_ = std::max<int32_t>(n, 1);
+  }
+
  private:
   OnlineTransducerModel *model_;  // Not owned
   int32_t num_active_paths_;
+  float score_gap_;
+  const ContextGraph *context_graph_;  // Not owned
+  DecoderOutputCache decoder_output_cache_;
+
+  // Merge-rate counters; see Hypotheses::NumCandidates()/NumMerged().
+  Counter *metric_candidates_ = nullptr;
+  Counter *metric_merged_hyps_ = nullptr;
 };
 
 }  // namespace sherpa
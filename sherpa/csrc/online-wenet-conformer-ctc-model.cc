@@ -0,0 +1,107 @@
+// sherpa/csrc/online-wenet-conformer-ctc-model.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/online-wenet-conformer-ctc-model.h"
+
+#include <utility>
+
+#include "sherpa/csrc/log.h"
+#include "sherpa/csrc/mmap-read-adapter.h"
+
+namespace sherpa {
+
+OnlineWenetConformerCtcModel::OnlineWenetConformerCtcModel(
+    const std::string &filename, int32_t chunk_size, int32_t num_left_chunks,
+    torch::Device device /*= torch::kCPU*/)
+    : device_(device),
+      out_chunk_size_(chunk_size),
+      num_left_chunks_(num_left_chunks) {
+  SHERPA_CHECK_GT(chunk_size, 0);
+
+  model_ = LoadModule(filename, device);
+  model_.eval();
+
+  subsampling_factor_ = model_.run_method("subsampling_rate").toInt();
+  right_context_ = model_.run_method("right_context").toInt();
+
+  // See the decoding window computation in
+  // https://github.com/wenet-e2e/wenet/blob/main/wenet/transformer/encoder.py
+  chunk_size_ =
+      (out_chunk_size_ - 1) * subsampling_factor_ + right_context_ + 1;
+  chunk_shift_ = out_chunk_size_ * subsampling_factor_;
+}
+
+torch::IValue OnlineWenetConformerCtcModel::StackStates(
+    const std::vector<torch::IValue> &states) const {
+  // forward_encoder_chunk() processes one utterance at a time, so the
+  // per-stream states are only bundled here; RunEncoder() loops over
+  // them.
+  return torch::ivalue::Tuple::create(states);
+}
+
+std::vector<torch::IValue> OnlineWenetConformerCtcModel::UnStackStates(
+    torch::IValue states) const {
+  auto tuple = states.toTuple();
+  return {tuple->elements().begin(), tuple->elements().end()};
+}
+
+torch::IValue OnlineWenetConformerCtcModel::GetEncoderInitStates(
+    int32_t /*unused = 1*/) {
+  // Zero-sized caches; forward_encoder_chunk() treats them as an empty
+  // history.
+  auto att_cache = torch::zeros({0, 0, 0, 0}, device_);
+  auto cnn_cache = torch::zeros({0, 0, 0, 0}, device_);
+  return torch::ivalue::Tuple::create({att_cache, cnn_cache});
+}
+
+std::tuple<torch::Tensor, torch::Tensor, torch::IValue>
+OnlineWenetConformerCtcModel::RunEncoder(
+    const torch::Tensor &features, const torch::Tensor &features_length,
+    const torch::Tensor &num_processed_frames, torch::IValue states) {
+  torch::NoGradGuard no_grad;
+
+  int32_t n = features.size(0);
+  auto stream_states = UnStackStates(std::move(states));
+
+  torch::Tensor processed = num_processed_frames.cpu().to(torch::kLong);
+  auto processed_acc = processed.accessor<int64_t, 1>();
+
+  int32_t required_cache_size =
+      num_left_chunks_ >= 0 ? num_left_chunks_ * out_chunk_size_ : -1;
+
+  std::vector<torch::Tensor> encoder_out_vec(n);
+  std::vector<torch::IValue> next_states(n);
+  for (int32_t i = 0; i != n; ++i) {
+    auto state = stream_states[i].toTuple();
+    torch::Tensor att_cache = state->elements()[0].toTensor();
+    torch::Tensor cnn_cache = state->elements()[1].toTensor();
+
+    // The offset counts output frames, i.e., frames after subsampling.
+    int64_t offset = processed_acc[i] / subsampling_factor_;
+
+    auto out = model_
+                   .run_method("forward_encoder_chunk",
+                               features.index({i}).unsqueeze(0), offset,
+                               required_cache_size, att_cache, cnn_cache)
+                   .toTuple();
+
+    encoder_out_vec[i] = out->elements()[0].toTensor().squeeze(0);
+    next_states[i] = torch::ivalue::Tuple::create(
+        {out->elements()[1], out->elements()[2]});
+  }
+
+  auto encoder_out = torch::stack(encoder_out_vec, /*dim*/ 0);
+
+  // The CTC activation runs batched over all streams.
+  torch::Tensor log_prob =
+      model_.run_method("ctc_activation", encoder_out).toTensor();
+
+  torch::Tensor log_prob_len =
+      torch::full({n}, log_prob.size(1), torch::kLong).to(device_);
+
+  return {log_prob, log_prob_len,
+          torch::ivalue::Tuple::create(std::move(next_states))};
+}
+
+}  // namespace sherpa
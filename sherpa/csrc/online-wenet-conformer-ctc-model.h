@@ -0,0 +1,85 @@
+// sherpa/csrc/online-wenet-conformer-ctc-model.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_CSRC_ONLINE_WENET_CONFORMER_CTC_MODEL_H_
+#define SHERPA_CSRC_ONLINE_WENET_CONFORMER_CTC_MODEL_H_
+
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "sherpa/csrc/online-ctc-model.h"
+
+namespace sherpa {
+
+/** Streaming Conformer CTC model from wenet.
+ *
+ * It uses the `forward_encoder_chunk` and `ctc_activation` methods
+ * exported by wenet; see
+ * https://github.com/wenet-e2e/wenet/blob/main/wenet/transformer/asr_model.py
+ *
+ * Each chunk is processed with cached attention and convolution states,
+ * so the whole utterance never needs to be buffered. Note that
+ * forward_encoder_chunk() handles a single utterance at a time, so the
+ * encoder below loops over the streams of a batch while the CTC
+ * activation runs batched.
+ */
+class OnlineWenetConformerCtcModel : public OnlineCtcModel {
+ public:
+  /**
+   * @param filename Path to the torchscript model exported by wenet.
+   * @param chunk_size Number of output frames, i.e., frames after
+   *                   subsampling, each chunk advances by.
+   * @param num_left_chunks Number of previous chunks the attention may
+   *                        attend to. -1 means unlimited left context.
+   * @param device The model will be moved to this device.
+   */
+  OnlineWenetConformerCtcModel(const std::string &filename,
+                               int32_t chunk_size, int32_t num_left_chunks,
+                               torch::Device device = torch::kCPU);
+
+  torch::IValue StackStates(
+      const std::vector<torch::IValue> &states) const override;
+
+  std::vector<torch::IValue> UnStackStates(torch::IValue states) const override;
+
+  torch::IValue GetEncoderInitStates(int32_t unused = 1) override;
+
+  /** Run one chunk through the encoder and the CTC activation.
+   *
+   * The returned "encoder output" is the CTC log-probs of shape
+   * (N, chunk_size, vocab_size); see OnlineCtcModel.
+   */
+  std::tuple<torch::Tensor, torch::Tensor, torch::IValue> RunEncoder(
+      const torch::Tensor &features, const torch::Tensor &features_length,
+      const torch::Tensor &num_processed_frames, torch::IValue states) override;
+
+  torch::Device Device() const override { return device_; }
+
+  int32_t SubsamplingFactor() const override { return subsampling_factor_; }
+
+  int32_t ChunkSize() const override { return chunk_size_; }
+
+  int32_t ChunkShift() const override { return chunk_shift_; }
+
+ private:
+  torch::Device device_;
+  torch::jit::Module model_;
+
+  int32_t subsampling_factor_;
+  int32_t right_context_;
+
+  // Number of output frames per chunk; what wenet calls
+  // decoding_chunk_size.
+  int32_t out_chunk_size_;
+  int32_t num_left_chunks_;
+
+  // Chunk geometry in input feature frames; derived from the above in
+  // the constructor.
+  int32_t chunk_size_;
+  int32_t chunk_shift_;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_ONLINE_WENET_CONFORMER_CTC_MODEL_H_
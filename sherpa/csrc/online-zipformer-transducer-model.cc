@@ -4,6 +4,8 @@
 
 #include "sherpa/csrc/online-zipformer-transducer-model.h"
 
+#include <future>  // NOLINT
+#include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -15,13 +17,22 @@ OnlineZipformerTransducerModel::OnlineZipformerTransducerModel(
     const std::string &encoder_filename, const std::string &decoder_filename,
     const std::string &joiner_filename, torch::Device device /*=torch::kCPU*/)
     : device_(device) {
+  // The three TorchScript files are independent, so deserialize them
+  // concurrently; the encoder dominates and is kept on this thread.
+  auto decoder_future = std::async(std::launch::async, [&]() {
+    return torch::jit::load(decoder_filename, device);
+  });
+  auto joiner_future = std::async(std::launch::async, [&]() {
+    return torch::jit::load(joiner_filename, device);
+  });
+
   encoder_ = torch::jit::load(encoder_filename, device);
   encoder_.eval();
 
-  decoder_ = torch::jit::load(decoder_filename, device);
-  encoder_.eval();
+  decoder_ = decoder_future.get();
+  decoder_.eval();
 
-  joiner_ = torch::jit::load(joiner_filename, device);
+  joiner_ = joiner_future.get();
   joiner_.eval();
 
   context_size_ =
@@ -57,8 +68,31 @@ OnlineZipformerTransducerModel::OnlineZipformerTransducerModel(
   from_torch_jit_trace_ = false;
 }
 
+// Return leaf_specs[i], describing the dimension along which
+// StackStates() batches the i-th state tensor; see the layout comments
+// in StackStates(). All tensors are concatenated along an existing
+// dimension.
+static std::vector<StateLeafSpec> GetZipformerStateLeafSpecs(
+    int32_t num_elements) {
+  std::vector<StateLeafSpec> ans(num_elements, {1, false});
+  int32_t num_encoders = num_elements / 7;
+
+  // cached_key, cached_val and cached_val2 are batched along dim 2; the
+  // other four groups along dim 1.
+  for (int32_t i = 2 * num_encoders; i != 5 * num_encoders; ++i) {
+    ans[i].batch_dim = 2;
+  }
+
+  return ans;
+}
+
 torch::IValue OnlineZipformerTransducerModel::StackStates(
     const std::vector<torch::IValue> &states) const {
+  if (packed_state_converter_) {
+    torch::IValue buffer;
+    return packed_state_converter_->StackStates(states, &buffer);
+  }
+
   int32_t batch_size = states.size();
 
   // mod_states.size() == num_elements == 7 * num_encoders
@@ -121,8 +155,100 @@ torch::IValue OnlineZipformerTransducerModel::StackStates(
   return stacked_states;
 }
 
+torch::IValue OnlineZipformerTransducerModel::StackStates(
+    const std::vector<torch::IValue> &states, torch::IValue *buffer) const {
+  if (packed_state_converter_) {
+    return packed_state_converter_->StackStates(states, buffer);
+  }
+
+  int32_t batch_size = states.size();
+
+  // mod_states.size() == num_elements == 7 * num_encoders
+  // mod_states[i].size() == batch_size
+  std::vector<std::vector<torch::Tensor>> mod_states;
+  int32_t num_elements = 0;
+
+  for (auto &s : states) {
+    torch::List<torch::Tensor> s_list =
+        c10::impl::toTypedList<torch::Tensor>(s.toList());
+
+    num_elements = s_list.size();
+    if (mod_states.empty()) {
+      mod_states.resize(num_elements);
+    }
+
+    for (int32_t i = 0; i != num_elements; ++i) {
+      mod_states[i].push_back(s_list[i]);
+    }
+  }
+
+  // Reuse the output tensors in `buffer` only if it was produced by a
+  // previous call with the same batch size; element 0 is cached_len with
+  // shape (num_layers, batch_size).
+  std::vector<torch::Tensor> stacked_states;
+  if (buffer->isList() &&
+      static_cast<int32_t>(buffer->toList().size()) == num_elements) {
+    torch::List<torch::Tensor> buf_list =
+        c10::impl::toTypedList<torch::Tensor>(buffer->toList());
+    if (static_cast<torch::Tensor>(buf_list[0]).size(1) == batch_size) {
+      stacked_states.reserve(num_elements);
+      for (int32_t i = 0; i != num_elements; ++i) {
+        stacked_states.push_back(buf_list[i]);
+      }
+    }
+  }
+
+  if (stacked_states.empty()) {
+    *buffer = StackStates(states);
+    return *buffer;
+  }
+
+  int32_t num_encoders = num_elements / 7;
+
+  for (int32_t i = 0; i != num_encoders; ++i) {
+    // cached_len: (num_layers, batch_size)
+    torch::cat_out(stacked_states[i], mod_states[i], /*dim*/ 1);
+  }
+
+  for (int32_t i = num_encoders; i != 2 * num_encoders; ++i) {
+    // cached_avg: (num_layers, batch_size, D)
+    torch::cat_out(stacked_states[i], mod_states[i], /*dim*/ 1);
+  }
+
+  for (int32_t i = 2 * num_encoders; i != 3 * num_encoders; ++i) {
+    // cached_key: (num_layers, left_context_size, batch_size, D)
+    torch::cat_out(stacked_states[i], mod_states[i], /*dim*/ 2);
+  }
+
+  for (int32_t i = 3 * num_encoders; i != 4 * num_encoders; ++i) {
+    // cached_val: (num_layers, left_context_size, batch_size, D)
+    torch::cat_out(stacked_states[i], mod_states[i], /*dim*/ 2);
+  }
+
+  for (int32_t i = 4 * num_encoders; i != 5 * num_encoders; ++i) {
+    // cached_val2: (num_layers, left_context_size, batch_size, D)
+    torch::cat_out(stacked_states[i], mod_states[i], /*dim*/ 2);
+  }
+
+  for (int32_t i = 5 * num_encoders; i != 6 * num_encoders; ++i) {
+    // cached_conv1: (num_layers, batch_size, D, kernel-1)
+    torch::cat_out(stacked_states[i], mod_states[i], /*dim*/ 1);
+  }
+
+  for (int32_t i = 6 * num_encoders; i != 7 * num_encoders; ++i) {
+    // cached_conv2: (num_layers, batch_size, D, kernel-1)
+    torch::cat_out(stacked_states[i], mod_states[i], /*dim*/ 1);
+  }
+
+  return stacked_states;
+}
+
 std::vector<torch::IValue> OnlineZipformerTransducerModel::UnStackStates(
     torch::IValue ivalue) const {
+  if (packed_state_converter_) {
+    return packed_state_converter_->UnStackStates(ivalue);
+  }
+
   // ivalue is a list
   auto list_ptr = ivalue.toList();
   int32_t num_elements = list_ptr.size();
@@ -216,7 +342,61 @@ std::vector<torch::IValue> OnlineZipformerTransducerModel::UnStackStates(
 torch::IValue OnlineZipformerTransducerModel::GetEncoderInitStates(
     int32_t batch_size /*=1*/) {
   torch::NoGradGuard no_grad;
-  return encoder_.run_method("get_init_state", device_);
+  auto states = encoder_.run_method("get_init_state", device_);
+  if (use_fp16_) {
+    // get_init_state creates fp32 tensors; later states come out of the
+    // encoder already in fp16.
+    states = StateListToHalf(states);
+  }
+
+  if (!packed_state_converter_) {
+    packed_state_converter_ = std::make_unique<PackedStateConverter>(
+        states, GetZipformerStateLeafSpecs(
+                    static_cast<int32_t>(states.toList().size())));
+  }
+
+  return states;
+}
+
+void OnlineZipformerTransducerModel::UseFp16() {
+  if (!device_.is_cuda()) {
+    SHERPA_LOG(FATAL) << "--use-fp16 requires a GPU";
+  }
+
+  encoder_.to(torch::kHalf);
+  decoder_.to(torch::kHalf);
+  joiner_.to(torch::kHalf);
+  use_fp16_ = true;
+
+  // The packed layout depends on the state dtypes; rebuild it on the
+  // next call to GetEncoderInitStates().
+  packed_state_converter_.reset();
+}
+
+void OnlineZipformerTransducerModel::UseCudaGraph() {
+  if (!device_.is_cuda()) {
+    SHERPA_LOG(FATAL) << "--use-cuda-graph requires a GPU";
+  }
+
+  // inputs[0] is features, inputs[1] is features_length and the rest are
+  // the state tensors; the outputs use the same layout with encoder_out
+  // and encoder_out_length first.
+  graph_runner_ = std::make_unique<CudaGraphRunner>(
+      [this](const std::vector<torch::Tensor> &inputs) {
+        torch::NoGradGuard no_grad;
+        std::vector<torch::Tensor> states(inputs.begin() + 2, inputs.end());
+        torch::IValue ivalue = encoder_.run_method(
+            "forward", inputs[0], inputs[1], torch::IValue(states));
+        auto tuple_ptr = ivalue.toTuple();
+        std::vector<torch::Tensor> outputs;
+        outputs.push_back(tuple_ptr->elements()[0].toTensor());
+        outputs.push_back(tuple_ptr->elements()[1].toTensor());
+        auto next_states = tuple_ptr->elements()[2].toList();
+        for (size_t i = 0; i != next_states.size(); ++i) {
+          outputs.push_back(next_states.get(i).toTensor());
+        }
+        return outputs;
+      });
 }
 
 std::tuple<torch::Tensor, torch::Tensor, torch::IValue>
@@ -233,8 +413,26 @@ OnlineZipformerTransducerModel::RunEncoder(
   // We can figure out `encoder_out_len` from `encoder_out`.
   torch::List<torch::Tensor> s_list =
       c10::impl::toTypedList<torch::Tensor>(states.toList());
-  torch::IValue ivalue =
-      encoder_.run_method("forward", features, features_length, states);
+
+  if (graph_runner_) {
+    std::vector<torch::Tensor> inputs;
+    inputs.reserve(s_list.size() + 2);
+    inputs.push_back(use_fp16_ ? features.to(torch::kHalf) : features);
+    inputs.push_back(features_length);
+    for (size_t i = 0; i != s_list.size(); ++i) {
+      inputs.push_back(s_list.get(i));
+    }
+
+    auto outputs = graph_runner_->Run(features.size(0), inputs);
+
+    std::vector<torch::Tensor> next_states(outputs.begin() + 2, outputs.end());
+    return std::make_tuple(outputs[0], outputs[1],
+                           torch::IValue(std::move(next_states)));
+  }
+
+  torch::IValue ivalue = encoder_.run_method(
+      "forward", use_fp16_ ? features.to(torch::kHalf) : features,
+      features_length, states);
   auto tuple_ptr = ivalue.toTuple();
   torch::Tensor encoder_out = tuple_ptr->elements()[0].toTensor();
 
@@ -264,7 +462,13 @@ torch::Tensor OnlineZipformerTransducerModel::RunDecoder(
 torch::Tensor OnlineZipformerTransducerModel::RunJoiner(
     const torch::Tensor &encoder_out, const torch::Tensor &decoder_out) {
   torch::NoGradGuard no_grad;
-  return joiner_.run_method("forward", encoder_out, decoder_out).toTensor();
+  auto logits =
+      joiner_.run_method("forward", encoder_out, decoder_out).toTensor();
+  if (use_fp16_) {
+    // The search works with fp32 log-probs
+    logits = logits.to(torch::kFloat);
+  }
+  return logits;
 }
 
 }  // namespace sherpa
@@ -3,12 +3,15 @@
 // Copyright (c)  2022  Xiaomi Corporation
 #ifndef SHERPA_CSRC_ONLINE_ZIPFORMER_TRANSDUCER_MODEL_H_
 #define SHERPA_CSRC_ONLINE_ZIPFORMER_TRANSDUCER_MODEL_H_
+#include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include "sherpa/csrc/cuda-graph-runner.h"
 #include "sherpa/csrc/online-transducer-model.h"
+#include "sherpa/csrc/packed-state.h"
 
 namespace sherpa {
 /** This class implements models from pruned_transducer_stateless7_streaming
@@ -42,10 +45,17 @@ class OnlineZipformerTransducerModel : public OnlineTransducerModel {
   torch::IValue StackStates(
       const std::vector<torch::IValue> &states) const override;
 
+  torch::IValue StackStates(const std::vector<torch::IValue> &states,
+                            torch::IValue *buffer) const override;
+
   std::vector<torch::IValue> UnStackStates(torch::IValue states) const override;
 
   torch::IValue GetEncoderInitStates(int32_t batch_size = 1) override;
 
+  void UseFp16() override;
+
+  void UseCudaGraph() override;
+
   std::tuple<torch::Tensor, torch::Tensor, torch::IValue> RunEncoder(
       const torch::Tensor &features, const torch::Tensor &features_length,
       const torch::Tensor &num_processed_frames, torch::IValue states) override;
@@ -76,8 +86,18 @@ class OnlineZipformerTransducerModel : public OnlineTransducerModel {
   int32_t context_size_;
   int32_t chunk_size_;
   int32_t chunk_shift_;
+  // Created by the first call to GetEncoderInitStates(). When non-null,
+  // per-stream states are kept in the packed representation and
+  // StackStates()/UnStackStates() take the packed fast path; see
+  // sherpa/csrc/packed-state.h.
+  std::unique_ptr<PackedStateConverter> packed_state_converter_;
+
   // true if the model is from torch.jit.trace()
   bool from_torch_jit_trace_;
+  // true if UseFp16() has been called
+  bool use_fp16_ = false;
+  // non-null if UseCudaGraph() has been called
+  std::unique_ptr<CudaGraphRunner> graph_runner_;
 };
 
 }  // namespace sherpa
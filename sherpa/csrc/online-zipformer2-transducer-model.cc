@@ -4,6 +4,7 @@
 #include "sherpa/csrc/online-zipformer2-transducer-model.h"
 
 #include <array>
+#include <memory>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -11,6 +12,26 @@
 
 namespace sherpa {
 
+// Return leaf_specs[i], describing the dimension along which
+// StackStates() batches the i-th state tensor; see the layout comment
+// in GetEncoderInitStates(). All tensors are concatenated along an
+// existing dimension.
+static std::vector<StateLeafSpec> GetZipformer2StateLeafSpecs(
+    int32_t num_elements) {
+  std::vector<StateLeafSpec> ans(num_elements, {0, false});
+  int32_t num_layers = (num_elements - 2) / 6;
+
+  std::array<int64_t, 6> batch_dim = {1, 1, 1, 1, 0, 0};
+  for (int32_t i = 0; i != num_layers; ++i) {
+    for (int32_t s = 0; s != 6; ++s) {
+      ans[i * 6 + s].batch_dim = batch_dim[s];
+    }
+  }
+
+  // the last two tensors are batched along dim 0
+  return ans;
+}
+
 OnlineZipformer2TransducerModel::OnlineZipformer2TransducerModel(
     const std::string &filename, torch::Device device /*= torch::kCPU*/)
     : device_(device) {
@@ -34,6 +55,11 @@ torch::IValue OnlineZipformer2TransducerModel::StackStates(
     const std::vector<torch::IValue> &_states) const {
   torch::NoGradGuard no_grad;
 
+  if (packed_state_converter_) {
+    torch::IValue buffer;
+    return packed_state_converter_->StackStates(_states, &buffer);
+  }
+
   std::vector<torch::List<torch::Tensor>> states;
   states.reserve(_states.size());
   for (const auto &s : _states) {
@@ -76,9 +102,25 @@ torch::IValue OnlineZipformer2TransducerModel::StackStates(
   return stacked_states;
 }
 
+torch::IValue OnlineZipformer2TransducerModel::StackStates(
+    const std::vector<torch::IValue> &states, torch::IValue *buffer) const {
+  torch::NoGradGuard no_grad;
+
+  if (packed_state_converter_) {
+    return packed_state_converter_->StackStates(states, buffer);
+  }
+
+  return OnlineTransducerModel::StackStates(states, buffer);
+}
+
 std::vector<torch::IValue> OnlineZipformer2TransducerModel::UnStackStates(
     torch::IValue ivalue) const {
   torch::NoGradGuard no_grad;
+
+  if (packed_state_converter_) {
+    return packed_state_converter_->UnStackStates(ivalue);
+  }
+
   // ivalue is a list
   auto list_ptr = ivalue.toList();
   int32_t num_elements = list_ptr.size();
@@ -158,9 +200,62 @@ torch::IValue OnlineZipformer2TransducerModel::GetEncoderInitStates(
   https://github.com/k2-fsa/icefall/blob/master/egs/librispeech/ASR/zipformer/export.py#L363
   https://github.com/k2-fsa/icefall/blob/master/egs/librispeech/ASR/zipformer/streaming_decode.py#L220
    */
+  if (use_fp16_) {
+    // get_init_states creates fp32 tensors; later states come out of the
+    // encoder already in fp16.
+    states = StateListToHalf(states);
+  }
+
+  if (!packed_state_converter_ && batch_size == 1) {
+    packed_state_converter_ = std::make_unique<PackedStateConverter>(
+        states, GetZipformer2StateLeafSpecs(
+                    static_cast<int32_t>(states.toList().size())));
+  }
+
   return states;
 }
 
+void OnlineZipformer2TransducerModel::UseFp16() {
+  if (!device_.is_cuda()) {
+    SHERPA_LOG(FATAL) << "--use-fp16 requires a GPU";
+  }
+
+  encoder_.to(torch::kHalf);
+  decoder_.to(torch::kHalf);
+  joiner_.to(torch::kHalf);
+  use_fp16_ = true;
+
+  // The packed layout depends on the state dtypes; rebuild it on the
+  // next call to GetEncoderInitStates().
+  packed_state_converter_.reset();
+}
+
+void OnlineZipformer2TransducerModel::UseCudaGraph() {
+  if (!device_.is_cuda()) {
+    SHERPA_LOG(FATAL) << "--use-cuda-graph requires a GPU";
+  }
+
+  // inputs[0] is features, inputs[1] is features_length and the rest are
+  // the state tensors; the outputs use the same layout with encoder_out
+  // and encoder_out_length first.
+  graph_runner_ = std::make_unique<CudaGraphRunner>(
+      [this](const std::vector<torch::Tensor> &inputs) {
+        torch::NoGradGuard no_grad;
+        std::vector<torch::Tensor> states(inputs.begin() + 2, inputs.end());
+        torch::IValue ivalue = encoder_.run_method(
+            "forward", inputs[0], inputs[1], torch::IValue(states));
+        auto tuple_ptr = ivalue.toTuple();
+        std::vector<torch::Tensor> outputs;
+        outputs.push_back(tuple_ptr->elements()[0].toTensor());
+        outputs.push_back(tuple_ptr->elements()[1].toTensor());
+        auto next_states = tuple_ptr->elements()[2].toList();
+        for (size_t i = 0; i != next_states.size(); ++i) {
+          outputs.push_back(next_states.get(i).toTensor());
+        }
+        return outputs;
+      });
+}
+
 std::tuple<torch::Tensor, torch::Tensor, torch::IValue>
 OnlineZipformer2TransducerModel::RunEncoder(
     const torch::Tensor &features, const torch::Tensor &features_length,
@@ -169,8 +264,26 @@ OnlineZipformer2TransducerModel::RunEncoder(
 
   torch::List<torch::Tensor> s_list =
       c10::impl::toTypedList<torch::Tensor>(states.toList());
-  torch::IValue ivalue =
-      encoder_.run_method("forward", features, features_length, states);
+
+  if (graph_runner_) {
+    std::vector<torch::Tensor> inputs;
+    inputs.reserve(s_list.size() + 2);
+    inputs.push_back(use_fp16_ ? features.to(torch::kHalf) : features);
+    inputs.push_back(features_length);
+    for (size_t i = 0; i != s_list.size(); ++i) {
+      inputs.push_back(s_list.get(i));
+    }
+
+    auto outputs = graph_runner_->Run(features.size(0), inputs);
+
+    std::vector<torch::Tensor> next_states(outputs.begin() + 2, outputs.end());
+    return std::make_tuple(outputs[0], outputs[1],
+                           torch::IValue(std::move(next_states)));
+  }
+
+  torch::IValue ivalue = encoder_.run_method(
+      "forward", use_fp16_ ? features.to(torch::kHalf) : features,
+      features_length, states);
 
   auto tuple_ptr = ivalue.toTuple();
   torch::Tensor encoder_out = tuple_ptr->elements()[0].toTensor();
@@ -194,9 +307,16 @@ torch::Tensor OnlineZipformer2TransducerModel::RunDecoder(
 torch::Tensor OnlineZipformer2TransducerModel::RunJoiner(
     const torch::Tensor &encoder_out, const torch::Tensor &decoder_out) {
   torch::NoGradGuard no_grad;
-  return joiner_
-      .run_method("forward", encoder_out, decoder_out, /*project_input*/ true)
-      .toTensor();
+  auto logits =
+      joiner_
+          .run_method("forward", encoder_out, decoder_out,
+                      /*project_input*/ true)
+          .toTensor();
+  if (use_fp16_) {
+    // The search works with fp32 log-probs
+    logits = logits.to(torch::kFloat);
+  }
+  return logits;
 }
 
 }  // namespace sherpa
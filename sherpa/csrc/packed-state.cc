@@ -0,0 +1,409 @@
+// sherpa/csrc/packed-state.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#include "sherpa/csrc/packed-state.h"
+
+#include <utility>
+#include <vector>
+
+namespace sherpa {
+
+// Append the tensor leaves of `v` to `leaves` in depth-first order.
+static void FlattenTensors(const torch::IValue &v,
+                           std::vector<torch::Tensor> *leaves) {
+  if (v.isTensor()) {
+    leaves->push_back(v.toTensor());
+    return;
+  }
+
+  if (v.isTuple()) {
+    for (const auto &c : v.toTuple()->elements()) {
+      FlattenTensors(c, leaves);
+    }
+    return;
+  }
+
+  if (v.isList()) {
+    auto list = v.toList();
+    for (size_t i = 0; i != list.size(); ++i) {
+      FlattenTensors(list.get(i), leaves);
+    }
+    return;
+  }
+
+  TORCH_CHECK(false, "Unsupported state component: ", v.tagKind());
+}
+
+PackedStateConverter::PackedStateConverter(
+    const torch::IValue &prototype,
+    const std::vector<StateLeafSpec> &leaf_specs) {
+  BuildNode(prototype, leaf_specs, &root_);
+
+  TORCH_CHECK(elements_.size() == leaf_specs.size(), "Expect ",
+              leaf_specs.size(), " state tensors. Given ", elements_.size());
+}
+
+void PackedStateConverter::BuildNode(
+    const torch::IValue &v, const std::vector<StateLeafSpec> &leaf_specs,
+    Node *node) {
+  if (v.isTensor()) {
+    node->kind = Node::Kind::kTensor;
+    node->leaf = static_cast<int32_t>(elements_.size());
+
+    TORCH_CHECK(node->leaf < static_cast<int32_t>(leaf_specs.size()),
+                "More state tensors than leaf specs: ", leaf_specs.size());
+
+    torch::Tensor t = v.toTensor();
+    const StateLeafSpec &spec = leaf_specs[node->leaf];
+
+    Element e;
+    e.batch_dim = spec.batch_dim;
+    e.inserts_batch_dim = spec.inserts_batch_dim;
+
+    if (spec.inserts_batch_dim) {
+      // The batch dim does not exist in the per-stream tensor; keep all
+      // of its dims.
+      TORCH_CHECK(spec.batch_dim >= 0 && spec.batch_dim <= t.dim(),
+                  "Invalid batch dim ", spec.batch_dim, " for tensor ",
+                  node->leaf, " of shape ", t.sizes());
+      e.sizes = t.sizes().vec();
+    } else {
+      TORCH_CHECK(t.size(spec.batch_dim) == 1,
+                  "Expect batch size 1 in the prototype. Given tensor ",
+                  node->leaf, " of shape ", t.sizes(), " with batch dim ",
+                  spec.batch_dim);
+      for (int64_t d = 0; d != t.dim(); ++d) {
+        if (d != spec.batch_dim) {
+          e.sizes.push_back(t.size(d));
+        }
+      }
+    }
+
+    torch::ScalarType dtype = t.scalar_type();
+    int32_t group = -1;
+    for (size_t g = 0; g != group_dtypes_.size(); ++g) {
+      if (group_dtypes_[g] == dtype) {
+        group = static_cast<int32_t>(g);
+        break;
+      }
+    }
+    if (group == -1) {
+      group = static_cast<int32_t>(group_dtypes_.size());
+      group_dtypes_.push_back(dtype);
+      group_numels_.push_back(0);
+    }
+
+    e.group = group;
+    e.offset = group_numels_[group];
+    e.numel = t.numel();
+
+    group_numels_[group] += e.numel;
+    elements_.push_back(std::move(e));
+    return;
+  }
+
+  if (v.isTuple()) {
+    node->kind = Node::Kind::kTuple;
+    const auto &children = v.toTuple()->elements();
+    node->children.resize(children.size());
+    for (size_t i = 0; i != children.size(); ++i) {
+      BuildNode(children[i], leaf_specs, &node->children[i]);
+    }
+    return;
+  }
+
+  if (v.isList()) {
+    node->kind = Node::Kind::kList;
+    auto list = v.toList();
+    node->children.resize(list.size());
+    for (size_t i = 0; i != list.size(); ++i) {
+      BuildNode(list.get(i), leaf_specs, &node->children[i]);
+
+      // Rebuild() produces typed lists, so a list may hold tensors or
+      // lists of tensors, but nothing deeper and nothing mixed.
+      TORCH_CHECK(node->children[i].kind == node->children[0].kind &&
+                      node->children[i].kind != Node::Kind::kTuple,
+                  "A list in the state may contain only tensors or lists "
+                  "of tensors");
+      if (node->children[i].kind == Node::Kind::kList) {
+        for (const auto &grandchild : node->children[i].children) {
+          TORCH_CHECK(grandchild.kind == Node::Kind::kTensor,
+                      "A list in the state may contain only tensors or "
+                      "lists of tensors");
+        }
+      }
+    }
+    return;
+  }
+
+  TORCH_CHECK(false, "Unsupported state component: ", v.tagKind());
+}
+
+torch::IValue PackedStateConverter::Rebuild(
+    const Node &node, const std::vector<torch::Tensor> &leaves) const {
+  switch (node.kind) {
+    case Node::Kind::kTensor:
+      return leaves[node.leaf];
+    case Node::Kind::kTuple: {
+      std::vector<torch::IValue> children;
+      children.reserve(node.children.size());
+      for (const auto &c : node.children) {
+        children.push_back(Rebuild(c, leaves));
+      }
+      return c10::ivalue::Tuple::create(std::move(children));
+    }
+    case Node::Kind::kList:
+      // The scripted encoder type-checks its arguments, so lists have
+      // to be rebuilt with their element type.
+      if (!node.children.empty() &&
+          node.children[0].kind == Node::Kind::kList) {
+        c10::List<c10::List<torch::Tensor>> ans;
+        ans.reserve(node.children.size());
+        for (const auto &c : node.children) {
+          ans.push_back(Rebuild(c, leaves).toTensorList());
+        }
+        return ans;
+      } else {
+        c10::List<torch::Tensor> ans;
+        ans.reserve(node.children.size());
+        for (const auto &c : node.children) {
+          ans.push_back(Rebuild(c, leaves).toTensor());
+        }
+        return ans;
+      }
+  }
+
+  TORCH_CHECK(false, "Unreachable");
+  return {};
+}
+
+bool PackedStateConverter::IsPacked(const torch::IValue &state) const {
+  if (!state.isTuple()) {
+    return false;
+  }
+
+  const auto &groups = state.toTuple()->elements();
+  if (groups.size() != group_dtypes_.size()) {
+    return false;
+  }
+
+  for (size_t g = 0; g != groups.size(); ++g) {
+    if (!groups[g].isTensor()) {
+      return false;
+    }
+
+    const torch::Tensor &t = groups[g].toTensor();
+    if (t.dim() != 1 || t.numel() != group_numels_[g]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+torch::IValue PackedStateConverter::Pack(const torch::IValue &state) const {
+  if (IsPacked(state)) {
+    return state;
+  }
+
+  std::vector<torch::Tensor> leaves;
+  leaves.reserve(elements_.size());
+  FlattenTensors(state, &leaves);
+
+  TORCH_CHECK(leaves.size() == elements_.size(), "Expect ", elements_.size(),
+              " state tensors. Given ", leaves.size());
+
+  std::vector<std::vector<torch::Tensor>> pieces(group_dtypes_.size());
+  for (size_t i = 0; i != elements_.size(); ++i) {
+    pieces[elements_[i].group].push_back(leaves[i].reshape({-1}));
+  }
+
+  std::vector<torch::IValue> groups;
+  groups.reserve(pieces.size());
+  for (auto &p : pieces) {
+    groups.push_back(torch::cat(p, /*dim*/ 0));
+  }
+
+  return c10::ivalue::Tuple::create(std::move(groups));
+}
+
+torch::IValue PackedStateConverter::Unpack(const torch::IValue &packed) const {
+  const auto &groups = packed.toTuple()->elements();
+
+  std::vector<torch::Tensor> leaves;
+  leaves.reserve(elements_.size());
+
+  for (const auto &e : elements_) {
+    torch::Tensor flat =
+        groups[e.group].toTensor().narrow(0, e.offset, e.numel);
+
+    std::vector<int64_t> shape = e.sizes;
+    if (!e.inserts_batch_dim) {
+      shape.insert(shape.begin() + e.batch_dim, 1);
+    }
+    leaves.push_back(flat.view(shape));
+  }
+
+  return Rebuild(root_, leaves);
+}
+
+torch::IValue PackedStateConverter::StackStates(
+    const std::vector<torch::IValue> &states, torch::IValue *buffer) const {
+  int32_t batch_size = static_cast<int32_t>(states.size());
+  int32_t num_groups = static_cast<int32_t>(group_dtypes_.size());
+
+  if (batch_size == 1) {
+    // Single-stream batch: every batched tensor is the per-stream
+    // tensor with a size-1 batch dim inserted, so the whole batched
+    // state is built from views of the packed buffers without copying
+    // anything. The buffer is left alone; it only pays off for batches
+    // that need the torch::cat.
+    torch::IValue p = Pack(states[0]);
+    const auto &groups = p.toTuple()->elements();
+
+    std::vector<torch::Tensor> leaves;
+    leaves.reserve(elements_.size());
+    for (const auto &e : elements_) {
+      torch::Tensor flat =
+          groups[e.group].toTensor().narrow(0, e.offset, e.numel);
+
+      std::vector<int64_t> shape = e.sizes;
+      shape.insert(shape.begin() + e.batch_dim, 1);
+      leaves.push_back(flat.view(shape));
+    }
+
+    return Rebuild(root_, leaves);
+  }
+
+  // rows[g][n] is the flat tensor of stream n for group g, viewed as
+  // (1, group_numels_[g]) so that torch::cat below stacks streams along
+  // dim 0.
+  std::vector<std::vector<torch::Tensor>> rows(num_groups);
+  for (auto &r : rows) {
+    r.reserve(batch_size);
+  }
+
+  for (const auto &s : states) {
+    torch::IValue p = Pack(s);
+    const auto &groups = p.toTuple()->elements();
+    for (int32_t g = 0; g != num_groups; ++g) {
+      rows[g].push_back(groups[g].toTensor().unsqueeze(0));
+    }
+  }
+
+  // Reuse the stacked buffers in `buffer` only if it was produced by a
+  // previous call with the same batch size on the same device.
+  std::vector<torch::Tensor> stacked(num_groups);
+  bool reuse = buffer->isTuple() &&
+               static_cast<int32_t>(buffer->toTuple()->elements().size()) ==
+                   num_groups;
+  if (reuse) {
+    const auto &buf = buffer->toTuple()->elements();
+    for (int32_t g = 0; g != num_groups; ++g) {
+      const torch::Tensor &t = buf[g].toTensor();
+      if (t.size(0) != batch_size || t.size(1) != group_numels_[g] ||
+          t.scalar_type() != group_dtypes_[g] ||
+          t.device() != rows[g][0].device()) {
+        reuse = false;
+        break;
+      }
+    }
+  }
+
+  if (reuse) {
+    const auto &buf = buffer->toTuple()->elements();
+    for (int32_t g = 0; g != num_groups; ++g) {
+      stacked[g] = buf[g].toTensor();
+      torch::cat_out(stacked[g], rows[g], /*dim*/ 0);
+    }
+  } else {
+    std::vector<torch::IValue> buf;
+    buf.reserve(num_groups);
+    for (int32_t g = 0; g != num_groups; ++g) {
+      stacked[g] = torch::cat(rows[g], /*dim*/ 0);
+      buf.push_back(stacked[g]);
+    }
+    *buffer = c10::ivalue::Tuple::create(std::move(buf));
+  }
+
+  // Materialize each batched state tensor from its view of the stacked
+  // buffer: one batched kernel per tensor instead of a torch::cat or
+  // torch::stack over batch_size per-stream tensors.
+  std::vector<torch::Tensor> leaves;
+  leaves.reserve(elements_.size());
+
+  for (const auto &e : elements_) {
+    torch::Tensor piece = stacked[e.group].narrow(1, e.offset, e.numel);
+
+    std::vector<int64_t> shape;
+    shape.reserve(e.sizes.size() + 1);
+    shape.push_back(batch_size);
+    shape.insert(shape.end(), e.sizes.begin(), e.sizes.end());
+
+    leaves.push_back(piece.view(shape).movedim(0, e.batch_dim).contiguous());
+  }
+
+  return Rebuild(root_, leaves);
+}
+
+std::vector<torch::IValue> PackedStateConverter::UnStackStates(
+    torch::IValue states) const {
+  std::vector<torch::Tensor> leaves;
+  leaves.reserve(elements_.size());
+  FlattenTensors(states, &leaves);
+
+  TORCH_CHECK(leaves.size() == elements_.size(), "Expect ", elements_.size(),
+              " state tensors. Given ", leaves.size());
+
+  int32_t num_groups = static_cast<int32_t>(group_dtypes_.size());
+  int64_t batch_size = leaves[0].size(elements_[0].batch_dim);
+
+  if (batch_size == 1) {
+    // Single-stream batch: removing a size-1 batch dim does not reorder
+    // elements, so no movedim is needed, and the torch::cat below
+    // already gives the stream fresh buffers, so no clone either.
+    std::vector<std::vector<torch::Tensor>> pieces(num_groups);
+    for (size_t i = 0; i != elements_.size(); ++i) {
+      pieces[elements_[i].group].push_back(leaves[i].reshape({-1}));
+    }
+
+    std::vector<torch::IValue> groups;
+    groups.reserve(num_groups);
+    for (auto &p : pieces) {
+      groups.push_back(torch::cat(p, /*dim*/ 0));
+    }
+
+    return {c10::ivalue::Tuple::create(std::move(groups))};
+  }
+
+  // Flatten each batched state tensor to (batch_size, numel); one kernel
+  // per tensor, independent of the batch size.
+  std::vector<std::vector<torch::Tensor>> pieces(num_groups);
+  for (size_t i = 0; i != elements_.size(); ++i) {
+    const auto &e = elements_[i];
+    pieces[e.group].push_back(
+        leaves[i].movedim(e.batch_dim, 0).reshape({batch_size, -1}));
+  }
+
+  std::vector<torch::Tensor> flats(num_groups);
+  for (int32_t g = 0; g != num_groups; ++g) {
+    flats[g] = torch::cat(pieces[g], /*dim*/ 1);
+    // (batch_size, group_numels_[g])
+  }
+
+  std::vector<torch::IValue> ans(batch_size);
+  for (int64_t n = 0; n != batch_size; ++n) {
+    std::vector<torch::IValue> groups;
+    groups.reserve(num_groups);
+    for (int32_t g = 0; g != num_groups; ++g) {
+      // Copy the row out of the batched buffer so that this stream does
+      // not keep the states of the whole batch alive through a view.
+      groups.push_back(flats[g].select(0, n).clone());
+    }
+    ans[n] = c10::ivalue::Tuple::create(std::move(groups));
+  }
+
+  return ans;
+}
+
+}  // namespace sherpa
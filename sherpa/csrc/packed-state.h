@@ -0,0 +1,171 @@
+// sherpa/csrc/packed-state.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_CSRC_PACKED_STATE_H_
+#define SHERPA_CSRC_PACKED_STATE_H_
+
+#include <vector>
+
+#include "torch/script.h"
+
+namespace sherpa {
+
+/** Describes how one tensor of the nested per-stream state is batched
+ * by StackStates(). Specs are given in depth-first traversal order of
+ * the state structure.
+ */
+struct StateLeafSpec {
+  // The batch dimension in the batched tensor.
+  int64_t batch_dim;
+
+  // True if StackStates() inserts batch_dim as a new dimension
+  // (torch::stack); false if it concatenates along an existing
+  // dimension, which then must have size 1 in the per-stream tensor
+  // (torch::cat).
+  bool inserts_batch_dim = false;
+};
+
+/** Packed per-stream encoder states.
+ *
+ * Models keep their encoder state as a nest of tuples/lists with tensor
+ * leaves and pay a per-tensor price in StackStates()/UnStackStates():
+ * with L state tensors and N streams, stacking launches one torch::cat
+ * or torch::stack over N small tensors per state tensor, i.e., O(L * N)
+ * tiny kernels per decoding tick. For the Zipformer this is the biggest
+ * non-network CPU cost of the online servers.
+ *
+ * This class replaces the nested representation with a packed one: the
+ * whole per-stream state becomes one flat 1-D tensor per distinct dtype
+ * (most models need one or two), plus a descriptor table -- recorded
+ * once from a prototype state -- holding the offset, shape and batch
+ * dimension of every state tensor and the nesting structure around
+ * them. With packed states,
+ *
+ *  - StackStates() first stacks the N flat tensors into one contiguous
+ *    (N, numel) buffer -- a single batched copy per dtype -- and then
+ *    materializes each batched state tensor from a view of that buffer
+ *    with one batched kernel, independent of N, before rebuilding the
+ *    nesting the encoder expects;
+ *
+ *  - UnStackStates() flattens each batched state tensor once -- again
+ *    one kernel per tensor, independent of N -- and hands each stream a
+ *    flat copy of its row.
+ *
+ * A single-stream batch degenerates further: StackStates() then builds
+ * the batched state purely from views of the packed buffers, so callers
+ * that mostly decode one stream at a time -- e.g., edge deployments --
+ * pay almost nothing for the batching machinery.
+ *
+ * The descriptor table is a runtime structure rather than a per-model
+ * compile-time schema on purpose: the schema (number of layers, cache
+ * shapes, dtypes) is a property of the loaded torchscript model, not of
+ * the C++ model class, so it can only be recorded at
+ * GetEncoderInitStates() time. One loop over the table replaces the
+ * per-model IValue plumbing all the same.
+ *
+ * A packed state is a tuple of flat tensors, so it survives everything
+ * a nested state survives: device moves, dtype casts and pickling all
+ * recurse into tuples. StackStates() accepts both forms and packs
+ * nested states on the fly, so freshly created streams whose state
+ * comes from GetEncoderInitStates() need no special handling.
+ */
+class PackedStateConverter {
+ public:
+  /** Record the descriptor table from a prototype state.
+   *
+   * @param prototype A per-stream state (batch size 1): a nest of
+   *                  tuples/lists with tensor leaves, e.g., from
+   *                  GetEncoderInitStates(). Lists may contain tensors
+   *                  or lists of tensors; tuples may contain anything.
+   * @param leaf_specs leaf_specs[i] describes how the i-th tensor, in
+   *                   depth-first traversal order, is batched.
+   */
+  PackedStateConverter(const torch::IValue &prototype,
+                       const std::vector<StateLeafSpec> &leaf_specs);
+
+  /** Return true if `state` is a packed per-stream state produced by
+   * Pack() or UnStackStates() of this converter.
+   */
+  bool IsPacked(const torch::IValue &state) const;
+
+  /** Convert a nested per-stream state into its packed form: a tuple
+   * with one flat 1-D tensor per distinct dtype. Returns `state`
+   * unchanged if it is already packed.
+   */
+  torch::IValue Pack(const torch::IValue &state) const;
+
+  /** Inverse of Pack(): rebuild the nested per-stream state. The
+   * returned tensors are views into the packed buffers.
+   */
+  torch::IValue Unpack(const torch::IValue &packed) const;
+
+  /** Stack per-stream states into the batched state the encoder
+   * expects.
+   *
+   * @param states states[i] is the (packed or nested) state of the i-th
+   *               stream.
+   * @param buffer Same contract as
+   *               OnlineTransducerModel::StackStates(states, buffer):
+   *               holds the stacked flat buffers across calls so they
+   *               are reused when the batch size is unchanged.
+   * @return Return the batched state. Each tensor is freshly
+   *         materialized from the stacked buffer, so it does not alias
+   *         `buffer`. For a single-stream batch the tensors are views
+   *         of the stream's packed state instead and `buffer` is not
+   *         touched.
+   */
+  torch::IValue StackStates(const std::vector<torch::IValue> &states,
+                            torch::IValue *buffer) const;
+
+  /** Split a batched state into per-stream packed states.
+   *
+   * Each stream gets a copy of its rows of the flattened batch rather
+   * than a view, so a stream that stays out of the batch for a long
+   * time -- parked in silence, say -- does not keep the state of the
+   * whole batch alive.
+   */
+  std::vector<torch::IValue> UnStackStates(torch::IValue states) const;
+
+ private:
+  // Describes one tensor of the nested per-stream state.
+  struct Element {
+    int32_t group;      // index into group_dtypes_/group_numels_
+    int64_t offset;     // element offset inside the group's flat tensor
+    int64_t numel;
+    int64_t batch_dim;  // where StackStates() batches this tensor
+    bool inserts_batch_dim;
+    std::vector<int64_t> sizes;  // per-stream sizes; for concatenated
+                                 // leaves the batch dim is removed
+  };
+
+  // The nesting structure around the tensors, so batched and unpacked
+  // states are rebuilt with the exact list/tuple types the encoder
+  // expects.
+  struct Node {
+    enum class Kind { kTensor, kList, kTuple };
+    Kind kind = Kind::kTensor;
+    int32_t leaf = -1;  // index into elements_ when kind == kTensor
+    std::vector<Node> children;
+  };
+
+  // Record `v` into `node`, appending its tensor leaves to elements_.
+  void BuildNode(const torch::IValue &v,
+                 const std::vector<StateLeafSpec> &leaf_specs, Node *node);
+
+  // Rebuild the structure of `node` with leaves[e] standing in for
+  // element e.
+  torch::IValue Rebuild(const Node &node,
+                        const std::vector<torch::Tensor> &leaves) const;
+
+  Node root_;
+  std::vector<Element> elements_;
+
+  // One flat tensor per distinct dtype; group g holds group_numels_[g]
+  // elements of dtype group_dtypes_[g].
+  std::vector<torch::ScalarType> group_dtypes_;
+  std::vector<int64_t> group_numels_;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_PACKED_STATE_H_
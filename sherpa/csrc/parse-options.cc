@@ -32,6 +32,7 @@
 #include <limits>
 #include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 #include "sherpa/cpp_api/parse-options.h"
 #include "sherpa/csrc/log.h"
@@ -248,7 +249,7 @@ void ParseOptions::RegisterStandard(const std::string &name, T *ptr,
 void ParseOptions::RegisterSpecific(const std::string &name,
                                     const std::string &idx, bool *b,
                                     const std::string &doc, bool is_standard) {
-  bool_map_[idx] = b;
+  registry_[idx] = {OptionType::kBool, b};
   doc_map_[idx] =
       DocInfo(name, doc + " (bool, default = " + ((*b) ? "true)" : "false)"),
               is_standard);
@@ -257,7 +258,7 @@ void ParseOptions::RegisterSpecific(const std::string &name,
 void ParseOptions::RegisterSpecific(const std::string &name,
                                     const std::string &idx, int32_t *i,
                                     const std::string &doc, bool is_standard) {
-  int_map_[idx] = i;
+  registry_[idx] = {OptionType::kInt, i};
   std::ostringstream ss;
   ss << doc << " (int, default = " << *i << ")";
   doc_map_[idx] = DocInfo(name, ss.str(), is_standard);
@@ -266,7 +267,7 @@ void ParseOptions::RegisterSpecific(const std::string &name,
 void ParseOptions::RegisterSpecific(const std::string &name,
                                     const std::string &idx, uint32_t *u,
                                     const std::string &doc, bool is_standard) {
-  uint_map_[idx] = u;
+  registry_[idx] = {OptionType::kUint, u};
   std::ostringstream ss;
   ss << doc << " (uint, default = " << *u << ")";
   doc_map_[idx] = DocInfo(name, ss.str(), is_standard);
@@ -275,7 +276,7 @@ void ParseOptions::RegisterSpecific(const std::string &name,
 void ParseOptions::RegisterSpecific(const std::string &name,
                                     const std::string &idx, float *f,
                                     const std::string &doc, bool is_standard) {
-  float_map_[idx] = f;
+  registry_[idx] = {OptionType::kFloat, f};
   std::ostringstream ss;
   ss << doc << " (float, default = " << *f << ")";
   doc_map_[idx] = DocInfo(name, ss.str(), is_standard);
@@ -284,7 +285,7 @@ void ParseOptions::RegisterSpecific(const std::string &name,
 void ParseOptions::RegisterSpecific(const std::string &name,
                                     const std::string &idx, double *f,
                                     const std::string &doc, bool is_standard) {
-  double_map_[idx] = f;
+  registry_[idx] = {OptionType::kDouble, f};
   std::ostringstream ss;
   ss << doc << " (double, default = " << *f << ")";
   doc_map_[idx] = DocInfo(name, ss.str(), is_standard);
@@ -293,7 +294,7 @@ void ParseOptions::RegisterSpecific(const std::string &name,
 void ParseOptions::RegisterSpecific(const std::string &name,
                                     const std::string &idx, std::string *s,
                                     const std::string &doc, bool is_standard) {
-  string_map_[idx] = s;
+  registry_[idx] = {OptionType::kString, s};
   doc_map_[idx] =
       DocInfo(name, doc + " (string, default = \"" + *s + "\")", is_standard);
 }
@@ -307,12 +308,7 @@ void ParseOptions::DisableOption(const std::string &name) {
     SHERPA_LOG(FATAL) << "Option " << name
                       << " was not registered so cannot be disabled: ";
   }
-  bool_map_.erase(name);
-  int_map_.erase(name);
-  uint_map_.erase(name);
-  float_map_.erase(name);
-  double_map_.erase(name);
-  string_map_.erase(name);
+  registry_.erase(name);
 }
 
 int ParseOptions::NumArgs() const { return positional_args_.size(); }
@@ -500,16 +496,29 @@ int ParseOptions::Read(int argc, const char *const argv[]) {
 void ParseOptions::PrintUsage(bool print_command_line /*=false*/) const {
   std::ostringstream os;
   os << '\n' << usage_ << '\n';
+
+  // doc_map_ is a hash map, so sort the options once here to get a
+  // stable, alphabetical --help listing.
+  std::vector<const DocInfo *> docs;
+  docs.reserve(doc_map_.size());
+  for (auto it = doc_map_.begin(); it != doc_map_.end(); ++it) {
+    docs.push_back(&it->second);
+  }
+  std::sort(docs.begin(), docs.end(),
+            [](const DocInfo *a, const DocInfo *b) {
+              return a->name_ < b->name_;
+            });
+
   // first we print application-specific options
   bool app_specific_header_printed = false;
-  for (auto it = doc_map_.begin(); it != doc_map_.end(); ++it) {
-    if (it->second.is_standard_ == false) {  // application-specific option
+  for (const auto *doc : docs) {
+    if (doc->is_standard_ == false) {  // application-specific option
       if (app_specific_header_printed == false) {  // header was not yet printed
         os << "Options:" << '\n';
         app_specific_header_printed = true;
       }
-      os << "  --" << std::setw(25) << std::left << it->second.name_ << " : "
-         << it->second.use_msg_ << '\n';
+      os << "  --" << std::setw(25) << std::left << doc->name_ << " : "
+         << doc->use_msg_ << '\n';
     }
   }
   if (app_specific_header_printed == true) {
@@ -518,10 +527,10 @@ void ParseOptions::PrintUsage(bool print_command_line /*=false*/) const {
 
   // then the standard options
   os << "Standard options:" << '\n';
-  for (auto it = doc_map_.begin(); it != doc_map_.end(); ++it) {
-    if (it->second.is_standard_ == true) {  // we have standard option
-      os << "  --" << std::setw(25) << std::left << it->second.name_ << " : "
-         << it->second.use_msg_ << '\n';
+  for (const auto *doc : docs) {
+    if (doc->is_standard_ == true) {  // we have standard option
+      os << "  --" << std::setw(25) << std::left << doc->name_ << " : "
+         << doc->use_msg_ << '\n';
     }
   }
   os << '\n';
@@ -538,26 +547,35 @@ void ParseOptions::PrintUsage(bool print_command_line /*=false*/) const {
 
 void ParseOptions::PrintConfig(std::ostream &os) const {
   os << '\n' << "[[ Configuration of UI-Registered options ]]" << '\n';
-  std::string key;
   for (auto it = doc_map_.begin(); it != doc_map_.end(); ++it) {
-    key = it->first;
-    os << it->second.name_ << " = ";
-    if (bool_map_.end() != bool_map_.find(key)) {
-      os << (*bool_map_.at(key) ? "true" : "false");
-    } else if (int_map_.end() != int_map_.find(key)) {
-      os << (*int_map_.at(key));
-    } else if (uint_map_.end() != uint_map_.find(key)) {
-      os << (*uint_map_.at(key));
-    } else if (float_map_.end() != float_map_.find(key)) {
-      os << (*float_map_.at(key));
-    } else if (double_map_.end() != double_map_.find(key)) {
-      os << (*double_map_.at(key));
-    } else if (string_map_.end() != string_map_.find(key)) {
-      os << "'" << *string_map_.at(key) << "'";
-    } else {
-      SHERPA_LOG(FATAL) << "PrintConfig: unrecognized option " << key
+    auto opt = registry_.find(it->first);
+    if (opt == registry_.end()) {
+      SHERPA_LOG(FATAL) << "PrintConfig: unrecognized option " << it->first
                         << "[code error]";
     }
+    os << it->second.name_ << " = ";
+
+    void *ptr = opt->second.ptr;
+    switch (opt->second.type) {
+      case OptionType::kBool:
+        os << (*reinterpret_cast<bool *>(ptr) ? "true" : "false");
+        break;
+      case OptionType::kInt:
+        os << *reinterpret_cast<int32_t *>(ptr);
+        break;
+      case OptionType::kUint:
+        os << *reinterpret_cast<uint32_t *>(ptr);
+        break;
+      case OptionType::kFloat:
+        os << *reinterpret_cast<float *>(ptr);
+        break;
+      case OptionType::kDouble:
+        os << *reinterpret_cast<double *>(ptr);
+        break;
+      case OptionType::kString:
+        os << "'" << *reinterpret_cast<std::string *>(ptr) << "'";
+        break;
+    }
     os << '\n';
   }
   os << '\n';
@@ -570,6 +588,7 @@ void ParseOptions::ReadConfigFile(const std::string &filename) {
   }
 
   std::string line, key, value;
+  std::string section;  // current INI [section] prefix, may be empty
   int32_t line_number = 0;
   while (std::getline(is, line)) {
     ++line_number;
@@ -582,18 +601,35 @@ void ParseOptions::ReadConfigFile(const std::string &filename) {
     Trim(&line);
     if (line.length() == 0) continue;
 
-    if (line.substr(0, 2) != "--") {
+    bool has_equal_sign;
+    if (line.substr(0, 2) == "--") {
+      // traditional Kaldi form: --x=y
+      SplitLongArg(line, &key, &value, &has_equal_sign);
+    } else if (line.front() == '[' && line.back() == ']') {
+      // INI section header; it prefixes the following keys, matching
+      // options registered with a prefix, e.g., [mfcc] + frame-shift=10
+      // sets --mfcc.frame-shift=10
+      section = line.substr(1, line.size() - 2);
+      Trim(&section);
+      if (!section.empty()) {
+        section += '.';
+      }
+      continue;
+    } else if ((pos = line.find_first_of('=')) != std::string::npos &&
+               pos != 0) {
+      // INI form: x = y
+      key = section + line.substr(0, pos);
+      value = line.substr(pos + 1);
+      Trim(&key);
+      has_equal_sign = true;
+    } else {
       SHERPA_LOG(FATAL)
           << "Reading config file " << filename << ": line " << line_number
-          << " does not look like a line "
-          << "from a Kaldi command-line program's config file: should "
-          << "be of the form --x=y.  Note: config files intended to "
-          << "be sourced by shell scripts lack the '--'.";
+          << " does not look like a config file line: should be of the "
+          << "form --x=y, x=y, or [section].  Note: config files "
+          << "intended to be sourced by shell scripts lack the '--'.";
     }
 
-    // parse option
-    bool has_equal_sign;
-    SplitLongArg(line, &key, &value, &has_equal_sign);
     NormalizeArgName(&key);
     Trim(&value);
     if (!SetOption(key, value, has_equal_sign)) {
@@ -655,28 +691,39 @@ void ParseOptions::Trim(std::string *str) const {
 
 bool ParseOptions::SetOption(const std::string &key, const std::string &value,
                              bool has_equal_sign) {
-  if (bool_map_.end() != bool_map_.find(key)) {
-    if (has_equal_sign && value == "") {
-      SHERPA_LOG(FATAL) << "Invalid option --" << key << "=";
-    }
-    *(bool_map_[key]) = ToBool(value);
-  } else if (int_map_.end() != int_map_.find(key)) {
-    *(int_map_[key]) = ToInt(value);
-  } else if (uint_map_.end() != uint_map_.find(key)) {
-    *(uint_map_[key]) = ToUint(value);
-  } else if (float_map_.end() != float_map_.find(key)) {
-    *(float_map_[key]) = ToFloat(value);
-  } else if (double_map_.end() != double_map_.find(key)) {
-    *(double_map_[key]) = ToDouble(value);
-  } else if (string_map_.end() != string_map_.find(key)) {
-    if (!has_equal_sign) {
-      SHERPA_LOG(FATAL) << "Invalid option --" << key
-                        << " (option format is --x=y).";
-    }
-    *(string_map_[key]) = value;
-  } else {
+  auto it = registry_.find(key);
+  if (it == registry_.end()) {
     return false;
   }
+
+  void *ptr = it->second.ptr;
+  switch (it->second.type) {
+    case OptionType::kBool:
+      if (has_equal_sign && value == "") {
+        SHERPA_LOG(FATAL) << "Invalid option --" << key << "=";
+      }
+      *reinterpret_cast<bool *>(ptr) = ToBool(value);
+      break;
+    case OptionType::kInt:
+      *reinterpret_cast<int32_t *>(ptr) = ToInt(value);
+      break;
+    case OptionType::kUint:
+      *reinterpret_cast<uint32_t *>(ptr) = ToUint(value);
+      break;
+    case OptionType::kFloat:
+      *reinterpret_cast<float *>(ptr) = ToFloat(value);
+      break;
+    case OptionType::kDouble:
+      *reinterpret_cast<double *>(ptr) = ToDouble(value);
+      break;
+    case OptionType::kString:
+      if (!has_equal_sign) {
+        SHERPA_LOG(FATAL) << "Invalid option --" << key
+                          << " (option format is --x=y).";
+      }
+      *reinterpret_cast<std::string *>(ptr) = value;
+      break;
+  }
   return true;
 }
 
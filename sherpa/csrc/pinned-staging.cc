@@ -0,0 +1,36 @@
+// sherpa/csrc/pinned-staging.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/pinned-staging.h"
+
+#ifdef SHERPA_WITH_CUDA
+#include "c10/cuda/CUDAStream.h"
+#endif
+
+namespace sherpa {
+
+torch::Tensor PinnedStagingBuffer::Stage(const torch::Tensor &src) {
+#ifdef SHERPA_WITH_CUDA
+  if (src.is_cuda()) {
+    int64_t numel = src.numel();
+    if (!buf_.defined() || buf_.scalar_type() != src.scalar_type() ||
+        buf_.numel() < numel) {
+      buf_ = torch::empty({numel}, torch::TensorOptions()
+                                       .dtype(src.scalar_type())
+                                       .pinned_memory(true));
+    }
+
+    auto dst = buf_.narrow(0, 0, numel).view(src.sizes());
+    dst.copy_(src, /*non_blocking*/ true);
+
+    // The copy is the last operation queued on the stream, so the wait
+    // covers exactly the transfer.
+    c10::cuda::getCurrentCUDAStream(src.device().index()).synchronize();
+    return dst;
+  }
+#endif
+  return src.cpu();
+}
+
+}  // namespace sherpa
@@ -0,0 +1,46 @@
+// sherpa/csrc/pinned-staging.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_PINNED_STAGING_H_
+#define SHERPA_CSRC_PINNED_STAGING_H_
+
+#include "torch/script.h"
+
+namespace sherpa {
+
+/** A growable pinned host buffer for small device-to-host transfers.
+ *
+ * Small per-batch tensors (encoder output lengths, argmax results) used
+ * to reach the host via .cpu(), which stages through pageable memory
+ * and synchronizes with the device on every call. Staging them through
+ * a reusable pinned buffer turns each transfer into one asynchronous
+ * copy plus one wait on the issuing stream.
+ *
+ * The buffer grows to the largest tensor staged and is never shrunk, so
+ * steady-state transfers allocate nothing. Instances are not
+ * thread-safe; give each call site its own, e.g.
+ *
+ *   static thread_local PinnedStagingBuffer staging;
+ *   auto lens_cpu = staging.Stage(lens);
+ *
+ * The returned tensor aliases the buffer, so it is valid only until the
+ * next Stage() call on the same instance.
+ */
+class PinnedStagingBuffer {
+ public:
+  /** Copy `src` to the host and return the host copy.
+   *
+   * For CUDA tensors this is one non-blocking copy into the pinned
+   * buffer followed by one wait on the current stream. CPU tensors, and
+   * every tensor in a non-CUDA build, fall back to src.cpu().
+   */
+  torch::Tensor Stage(const torch::Tensor &src);
+
+ private:
+  torch::Tensor buf_;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_PINNED_STAGING_H_
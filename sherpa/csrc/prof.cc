@@ -0,0 +1,181 @@
+// sherpa/csrc/prof.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/prof.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdlib>
+#include <mutex>  // NOLINT
+#include <sstream>
+
+#include "sherpa/csrc/log.h"
+
+namespace sherpa {
+
+namespace {
+
+// Enough for the handful of fixed sites; bumping it is a one-line
+// change. Registration past the limit fails loudly (see ProfSite).
+constexpr int32_t kMaxSites = 32;
+
+// Bucket i holds deltas in [2^i, 2^(i + 1)); i.e., the bucket index is
+// the bit width of the delta minus one.
+constexpr int32_t kNumBuckets = 64;
+
+std::atomic<bool> g_enabled{false};
+
+std::once_flag g_env_once;
+
+struct SiteRegistry {
+  std::atomic<int32_t> num_sites{0};
+  const char *names[kMaxSites] = {};
+};
+
+SiteRegistry g_sites;
+
+// One histogram block per thread that ever recorded, linked into a
+// global list for RenderProfSites(). Blocks are never freed: the decode
+// workers live as long as the process, and rendering must stay safe
+// even if a thread has exited.
+struct ThreadBuckets {
+  ThreadBuckets() {
+    for (int32_t i = 0; i != kMaxSites; ++i) {
+      sums[i].store(0, std::memory_order_relaxed);
+      for (int32_t j = 0; j != kNumBuckets; ++j) {
+        counts[i][j].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  std::atomic<uint64_t> counts[kMaxSites][kNumBuckets];
+  std::atomic<uint64_t> sums[kMaxSites];
+  ThreadBuckets *next = nullptr;
+};
+
+std::mutex g_threads_mutex;
+ThreadBuckets *g_threads = nullptr;
+
+ThreadBuckets *GetThreadBuckets() {
+  thread_local ThreadBuckets *buckets = []() {
+    auto *b = new ThreadBuckets();
+    std::lock_guard<std::mutex> lock(g_threads_mutex);
+    b->next = g_threads;
+    g_threads = b;
+    return b;
+  }();
+  return buckets;
+}
+
+int32_t BucketOf(uint64_t ticks) {
+  return 63 - __builtin_clzll(ticks | 1);
+}
+
+}  // namespace
+
+bool ProfilingEnabled() {
+  std::call_once(g_env_once, []() {
+    const char *p = std::getenv("SHERPA_PROF");
+    if (p != nullptr && p[0] == '1') {
+      g_enabled.store(true, std::memory_order_relaxed);
+    }
+  });
+  return g_enabled.load(std::memory_order_relaxed);
+}
+
+void SetProfilingEnabled(bool enabled) {
+  ProfilingEnabled();  // so a later env check cannot overwrite this
+  g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+ProfSite::ProfSite(const char *name) {
+  index_ = g_sites.num_sites.fetch_add(1, std::memory_order_relaxed);
+  SHERPA_CHECK_LT(index_, kMaxSites)
+      << "Too many SHERPA_PROF_SCOPE sites; bump kMaxSites in prof.cc";
+  g_sites.names[index_] = name;
+}
+
+namespace prof_internal {
+
+uint64_t Ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t value;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+  return value;
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+void Record(int32_t site_index, uint64_t ticks) {
+  ThreadBuckets *buckets = GetThreadBuckets();
+  // Relaxed is enough: this thread is the only writer, the reader in
+  // RenderProfSites() only needs eventually-consistent totals.
+  buckets->counts[site_index][BucketOf(ticks)].fetch_add(
+      1, std::memory_order_relaxed);
+  buckets->sums[site_index].fetch_add(ticks, std::memory_order_relaxed);
+}
+
+}  // namespace prof_internal
+
+std::string RenderProfSites() {
+  int32_t num_sites = g_sites.num_sites.load(std::memory_order_relaxed);
+  if (num_sites > kMaxSites) {
+    num_sites = kMaxSites;
+  }
+
+  std::ostringstream os;
+  std::lock_guard<std::mutex> lock(g_threads_mutex);
+
+  for (int32_t i = 0; i != num_sites; ++i) {
+    uint64_t counts[kNumBuckets] = {};
+    uint64_t sum = 0;
+    for (ThreadBuckets *t = g_threads; t != nullptr; t = t->next) {
+      for (int32_t j = 0; j != kNumBuckets; ++j) {
+        counts[j] += t->counts[i][j].load(std::memory_order_relaxed);
+      }
+      sum += t->sums[i].load(std::memory_order_relaxed);
+    }
+
+    int32_t last_used = -1;
+    uint64_t total = 0;
+    for (int32_t j = 0; j != kNumBuckets; ++j) {
+      if (counts[j] != 0) {
+        last_used = j;
+      }
+      total += counts[j];
+    }
+    if (total == 0) {
+      continue;
+    }
+
+    std::string name = std::string("sherpa_prof_") + g_sites.names[i] +
+                       "_ticks";
+    os << "# HELP " << name
+       << " Timestamp-counter deltas of the scope, log2 buckets\n";
+    os << "# TYPE " << name << " histogram\n";
+
+    uint64_t cumulative = 0;
+    for (int32_t j = 0; j <= last_used && j < kNumBuckets - 1; ++j) {
+      cumulative += counts[j];
+      os << name << "_bucket{le=\"" << (uint64_t{1} << (j + 1)) << "\"} "
+         << cumulative << "\n";
+    }
+    os << name << "_bucket{le=\"+Inf\"} " << total << "\n";
+    os << name << "_sum " << sum << "\n";
+    os << name << "_count " << total << "\n";
+  }
+
+  return os.str();
+}
+
+}  // namespace sherpa
@@ -0,0 +1,96 @@
+// sherpa/csrc/prof.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_PROF_H_
+#define SHERPA_CSRC_PROF_H_
+
+#include <cstdint>
+#include <string>
+
+namespace sherpa {
+
+/** Ultra-light sampling points for the search inner loops.
+ *
+ * perf-based profiles of the beam search are hard to read: the loops
+ * are inlined and drowned in torch dispatch frames, and external
+ * profilers are often not allowed on customer machines at all. A
+ * SHERPA_PROF_SCOPE reads the CPU timestamp counter on entry and exit
+ * and accumulates the delta into a per-thread log2 histogram, so the
+ * hooks can stay in production builds: when profiling is off the cost
+ * is one relaxed atomic load and a branch.
+ *
+ * Profiling is enabled at runtime, either with SHERPA_PROF=1 in the
+ * environment or with SetProfilingEnabled(). The histograms of all
+ * sites are appended to the /metrics output of the websocket servers
+ * (sherpa_prof_<site>_ticks); values are raw timestamp-counter units.
+ */
+
+/// True if the profiling points record; see SetProfilingEnabled() and
+/// the SHERPA_PROF environment variable.
+bool ProfilingEnabled();
+
+void SetProfilingEnabled(bool enabled);
+
+/// Render the histograms of all profiling sites in the Prometheus text
+/// format, aggregated over threads. Empty when nothing was recorded.
+std::string RenderProfSites();
+
+/** Per-annotation state of SHERPA_PROF_SCOPE; one function-local static
+ * instance per annotated scope.
+ */
+class ProfSite {
+ public:
+  explicit ProfSite(const char *name);
+
+  int32_t Index() const { return index_; }
+
+ private:
+  int32_t index_;
+};
+
+namespace prof_internal {
+
+/// Current value of the per-CPU timestamp counter (or a chrono fallback
+/// on architectures without one).
+uint64_t Ticks();
+
+/// Accumulate one delta into this thread's histogram of the site.
+void Record(int32_t site_index, uint64_t ticks);
+
+}  // namespace prof_internal
+
+/** Times the enclosing scope when profiling is enabled; see
+ * SHERPA_PROF_SCOPE.
+ */
+class ProfScope {
+ public:
+  explicit ProfScope(const ProfSite &site) {
+    if (ProfilingEnabled()) {
+      index_ = site.Index();
+      begin_ = prof_internal::Ticks();
+    }
+  }
+
+  ~ProfScope() {
+    if (index_ >= 0) {
+      prof_internal::Record(index_, prof_internal::Ticks() - begin_);
+    }
+  }
+
+ private:
+  int32_t index_ = -1;
+  uint64_t begin_ = 0;
+};
+
+/// Accumulate the wall time of the enclosing scope into the per-thread
+/// histogram of the site `name` (a plain identifier, used both as the
+/// variable suffix and as the metric name).
+#define SHERPA_PROF_SCOPE(name)                            \
+  static const ::sherpa::ProfSite sherpa_prof_site_##name( \
+      #name);                                              \
+  ::sherpa::ProfScope sherpa_prof_scope_##name(sherpa_prof_site_##name)
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_PROF_H_
@@ -28,8 +28,16 @@
 #include <math.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <tuple>
 #include <type_traits>
+#include <vector>
 
 #ifndef M_2PI
 #define M_2PI 6.283185307179586476925286766559005
@@ -74,83 +82,130 @@ I Lcm(I m, I n) {
 }
 
 static float DotProduct(const float *a, const float *b, int32_t n) {
-  float sum = 0;
-  for (int32_t i = 0; i != n; ++i) {
+  // Four independent accumulators make the reassociation explicit in
+  // the source, so the compiler can emit SIMD FMA code for this loop
+  // without needing -ffast-math.
+  float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  int32_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    s0 += a[i] * b[i];
+    s1 += a[i + 1] * b[i + 1];
+    s2 += a[i + 2] * b[i + 2];
+    s3 += a[i + 3] * b[i + 3];
+  }
+  float sum = (s0 + s1) + (s2 + s3);
+  for (; i != n; ++i) {
     sum += a[i] * b[i];
   }
   return sum;
 }
 
-LinearResample::LinearResample(int32_t samp_rate_in_hz,
-                               int32_t samp_rate_out_hz, float filter_cutoff_hz,
-                               int32_t num_zeros)
-    : samp_rate_in_(samp_rate_in_hz),
-      samp_rate_out_(samp_rate_out_hz),
-      filter_cutoff_(filter_cutoff_hz),
-      num_zeros_(num_zeros) {
-  assert(samp_rate_in_hz > 0.0 && samp_rate_out_hz > 0.0 &&
-         filter_cutoff_hz > 0.0 && filter_cutoff_hz * 2 <= samp_rate_in_hz &&
-         filter_cutoff_hz * 2 <= samp_rate_out_hz && num_zeros > 0);
-
-  // base_freq is the frequency of the repeating unit, which is the gcd
-  // of the input frequencies.
-  int32_t base_freq = Gcd(samp_rate_in_, samp_rate_out_);
-  input_samples_in_unit_ = samp_rate_in_ / base_freq;
-  output_samples_in_unit_ = samp_rate_out_ / base_freq;
-
-  SetIndexesAndWeights();
-  Reset();
+/** Here, t is a time in seconds representing an offset from
+    the center of the windowed filter function, and FilterFunc(t)
+    returns the windowed filter function, described
+    in the header as h(t) = f(t)g(t), evaluated at t.
+*/
+static float FilterFunc(float t, float filter_cutoff, int32_t num_zeros) {
+  float window,  // raised-cosine (Hanning) window of width
+                 // num_zeros/2*filter_cutoff
+      filter;    // sinc filter function
+  if (fabs(t) < num_zeros / (2.0 * filter_cutoff))
+    window = 0.5 * (1 + cos(M_2PI * filter_cutoff / num_zeros * t));
+  else
+    window = 0.0;  // outside support of window function
+  if (t != 0)
+    filter = sin(M_2PI * filter_cutoff * t) / (M_PI * t);
+  else
+    filter = 2 * filter_cutoff;  // limit of the function at t = 0
+  return filter * window;
 }
 
-void LinearResample::SetIndexesAndWeights() {
-  first_index_.resize(output_samples_in_unit_);
-  weights_.resize(output_samples_in_unit_);
+static void SetIndexesAndWeights(int32_t samp_rate_in, int32_t samp_rate_out,
+                                 float filter_cutoff, int32_t num_zeros,
+                                 LinearResampleTables *tables) {
+  tables->first_index.resize(tables->output_samples_in_unit);
+  tables->weights.resize(tables->output_samples_in_unit);
 
-  double window_width = num_zeros_ / (2.0 * filter_cutoff_);
+  double window_width = num_zeros / (2.0 * filter_cutoff);
 
-  for (int32_t i = 0; i < output_samples_in_unit_; i++) {
-    double output_t = i / static_cast<double>(samp_rate_out_);
+  for (int32_t i = 0; i < tables->output_samples_in_unit; i++) {
+    double output_t = i / static_cast<double>(samp_rate_out);
     double min_t = output_t - window_width, max_t = output_t + window_width;
     // we do ceil on the min and floor on the max, because if we did it
     // the other way around we would unnecessarily include indexes just
     // outside the window, with zero coefficients.  It's possible
     // if the arguments to the ceil and floor expressions are integers
-    // (e.g. if filter_cutoff_ has an exact ratio with the sample rates),
+    // (e.g. if filter_cutoff has an exact ratio with the sample rates),
     // that we unnecessarily include something with a zero coefficient,
     // but this is only a slight efficiency issue.
-    int32_t min_input_index = ceil(min_t * samp_rate_in_),
-            max_input_index = floor(max_t * samp_rate_in_),
+    int32_t min_input_index = ceil(min_t * samp_rate_in),
+            max_input_index = floor(max_t * samp_rate_in),
             num_indices = max_input_index - min_input_index + 1;
-    first_index_[i] = min_input_index;
-    weights_[i].resize(num_indices);
+    tables->first_index[i] = min_input_index;
+    tables->weights[i].resize(num_indices);
     for (int32_t j = 0; j < num_indices; j++) {
       int32_t input_index = min_input_index + j;
-      double input_t = input_index / static_cast<double>(samp_rate_in_),
+      double input_t = input_index / static_cast<double>(samp_rate_in),
              delta_t = input_t - output_t;
       // sign of delta_t doesn't matter.
-      weights_[i][j] = FilterFunc(delta_t) / samp_rate_in_;
+      tables->weights[i][j] =
+          FilterFunc(delta_t, filter_cutoff, num_zeros) / samp_rate_in;
     }
   }
 }
 
-/** Here, t is a time in seconds representing an offset from
-    the center of the windowed filter function, and FilterFunction(t)
-    returns the windowed filter function, described
-    in the header as h(t) = f(t)g(t), evaluated at t.
-*/
-float LinearResample::FilterFunc(float t) const {
-  float window,  // raised-cosine (Hanning) window of width
-                 // num_zeros_/2*filter_cutoff_
-      filter;    // sinc filter function
-  if (fabs(t) < num_zeros_ / (2.0 * filter_cutoff_))
-    window = 0.5 * (1 + cos(M_2PI * filter_cutoff_ / num_zeros_ * t));
-  else
-    window = 0.0;  // outside support of window function
-  if (t != 0)
-    filter = sin(M_2PI * filter_cutoff_ * t) / (M_PI * t);
-  else
-    filter = 2 * filter_cutoff_;  // limit of the function at t = 0
-  return filter * window;
+/** Return the filter tables for the given resampling parameters.
+ *
+ * The tables are immutable once computed, so they are cached process
+ * wide and shared by all LinearResample instances with the same
+ * parameters. Front-ends that churn through many short-lived streams
+ * with the same sample-rate pair thus pay for the sinc table
+ * computation only once.
+ */
+static std::shared_ptr<const LinearResampleTables> GetResampleTables(
+    int32_t samp_rate_in, int32_t samp_rate_out, float filter_cutoff,
+    int32_t num_zeros) {
+  using Key = std::tuple<int32_t, int32_t, float, int32_t>;
+  static std::mutex mutex;
+  static std::map<Key, std::shared_ptr<const LinearResampleTables>> cache;
+
+  Key key{samp_rate_in, samp_rate_out, filter_cutoff, num_zeros};
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    return it->second;
+  }
+
+  auto tables = std::make_shared<LinearResampleTables>();
+
+  // base_freq is the frequency of the repeating unit, which is the gcd
+  // of the input frequencies.
+  int32_t base_freq = Gcd(samp_rate_in, samp_rate_out);
+  tables->input_samples_in_unit = samp_rate_in / base_freq;
+  tables->output_samples_in_unit = samp_rate_out / base_freq;
+
+  SetIndexesAndWeights(samp_rate_in, samp_rate_out, filter_cutoff, num_zeros,
+                       tables.get());
+
+  cache[key] = tables;
+  return tables;
+}
+
+LinearResample::LinearResample(int32_t samp_rate_in_hz,
+                               int32_t samp_rate_out_hz, float filter_cutoff_hz,
+                               int32_t num_zeros)
+    : samp_rate_in_(samp_rate_in_hz),
+      samp_rate_out_(samp_rate_out_hz),
+      filter_cutoff_(filter_cutoff_hz),
+      num_zeros_(num_zeros) {
+  assert(samp_rate_in_hz > 0.0 && samp_rate_out_hz > 0.0 &&
+         filter_cutoff_hz > 0.0 && filter_cutoff_hz * 2 <= samp_rate_in_hz &&
+         filter_cutoff_hz * 2 <= samp_rate_out_hz && num_zeros > 0);
+
+  tables_ = GetResampleTables(samp_rate_in_, samp_rate_out_, filter_cutoff_,
+                              num_zeros_);
+  Reset();
 }
 
 void LinearResample::Reset() {
@@ -172,45 +227,66 @@ torch::Tensor LinearResample::Resample(torch::Tensor input_tensor, bool flush) {
       torch::zeros({tot_output_samp - output_sample_offset_}, torch::kFloat);
   float *p_output = output.data_ptr<float>();
 
+  int32_t out_unit = tables_->output_samples_in_unit;
+
+  // Process the output one weight row at a time: all output samples with
+  // the same wrapped index share the same weight row (the input window
+  // just shifts by a whole unit), so iterating per row keeps that row
+  // hot in cache across all the output samples that reuse it.
+  //
   // samp_out is the index into the total output signal, not just the part
   // of it we are producing here.
-  for (int64_t samp_out = output_sample_offset_; samp_out < tot_output_samp;
-       samp_out++) {
-    int64_t first_samp_in;
-    int32_t samp_out_wrapped;
-    GetIndexes(samp_out, &first_samp_in, &samp_out_wrapped);
-    const std::vector<float> &weights = weights_[samp_out_wrapped];
-    // first_input_index is the first index into "input" that we have a weight
-    // for.
-    int32_t first_input_index =
-        static_cast<int32_t>(first_samp_in - input_sample_offset_);
-    float this_output;
-    if (first_input_index >= 0 &&
-        first_input_index + static_cast<int32_t>(weights.size()) <= input_dim) {
-      this_output =
-          DotProduct(input + first_input_index, weights.data(), weights.size());
-    } else {  // Handle edge cases.
-      this_output = 0.0;
-      for (int32_t i = 0; i < static_cast<int32_t>(weights.size()); i++) {
-        float weight = weights[i];
-        int32_t input_index = first_input_index + i;
-        if (input_index < 0 &&
-            static_cast<int32_t>(input_remainder_.size()) + input_index >= 0) {
-          this_output +=
-              weight * input_remainder_[input_remainder_.size() + input_index];
-        } else if (input_index >= 0 && input_index < input_dim) {
-          this_output += weight * input[input_index];
-        } else if (input_index >= input_dim) {
-          // We're past the end of the input and are adding zero; should only
-          // happen if the user specified flush == true, or else we would not
-          // be trying to output this sample.
-          assert(flush);
+  for (int32_t samp_out_wrapped = 0; samp_out_wrapped != out_unit;
+       ++samp_out_wrapped) {
+    // The first output sample >= output_sample_offset_ whose wrapped
+    // index is samp_out_wrapped.
+    int64_t first_samp_out =
+        output_sample_offset_ +
+        ((samp_out_wrapped - output_sample_offset_) % out_unit + out_unit) %
+            out_unit;
+
+    const std::vector<float> &weights = tables_->weights[samp_out_wrapped];
+
+    for (int64_t samp_out = first_samp_out; samp_out < tot_output_samp;
+         samp_out += out_unit) {
+      int64_t unit_index = samp_out / out_unit;
+      int64_t first_samp_in = tables_->first_index[samp_out_wrapped] +
+                              unit_index * tables_->input_samples_in_unit;
+      // first_input_index is the first index into "input" that we have a
+      // weight for.
+      int32_t first_input_index =
+          static_cast<int32_t>(first_samp_in - input_sample_offset_);
+      float this_output;
+      if (first_input_index >= 0 &&
+          first_input_index + static_cast<int32_t>(weights.size()) <=
+              input_dim) {
+        this_output = DotProduct(input + first_input_index, weights.data(),
+                                 weights.size());
+      } else {  // Handle edge cases.
+        this_output = 0.0;
+        for (int32_t i = 0; i < static_cast<int32_t>(weights.size()); i++) {
+          float weight = weights[i];
+          int32_t input_index = first_input_index + i;
+          if (input_index < 0 && static_cast<int32_t>(input_remainder_.size()) +
+                                         input_index >=
+                                     0) {
+            this_output +=
+                weight *
+                input_remainder_[input_remainder_.size() + input_index];
+          } else if (input_index >= 0 && input_index < input_dim) {
+            this_output += weight * input[input_index];
+          } else if (input_index >= input_dim) {
+            // We're past the end of the input and are adding zero; should only
+            // happen if the user specified flush == true, or else we would not
+            // be trying to output this sample.
+            assert(flush);
+          }
         }
       }
+      int32_t output_index =
+          static_cast<int32_t>(samp_out - output_sample_offset_);
+      p_output[output_index] = this_output;
     }
-    int32_t output_index =
-        static_cast<int32_t>(samp_out - output_sample_offset_);
-    p_output[output_index] = this_output;
   }
 
   if (flush) {
@@ -271,18 +347,66 @@ int64_t LinearResample::GetNumOutputSamples(int64_t input_num_samp,
   return num_output_samp;
 }
 
-// inline
-void LinearResample::GetIndexes(int64_t samp_out, int64_t *first_samp_in,
-                                int32_t *samp_out_wrapped) const {
-  // A unit is the smallest nonzero amount of time that is an exact
-  // multiple of the input and output sample periods.  The unit index
-  // is the answer to "which numbered unit we are in".
-  int64_t unit_index = samp_out / output_samples_in_unit_;
-  // samp_out_wrapped is equal to samp_out % output_samples_in_unit_
-  *samp_out_wrapped =
-      static_cast<int32_t>(samp_out - unit_index * output_samples_in_unit_);
-  *first_samp_in =
-      first_index_[*samp_out_wrapped] + unit_index * input_samples_in_unit_;
+std::vector<torch::Tensor> ResampleBatch(
+    const std::vector<torch::Tensor> &waves,
+    const std::vector<int32_t> &sample_rates, int32_t target_sample_rate,
+    int32_t num_threads /*= 1*/) {
+  assert(waves.size() == sample_rates.size());
+
+  std::vector<torch::Tensor> ans(waves.size());
+
+  // Group the waves by input sample rate so that each group uses one set
+  // of (cached) filter tables and one resampler per worker.
+  std::map<int32_t, std::vector<size_t>> groups;
+  for (size_t i = 0; i != waves.size(); ++i) {
+    if (sample_rates[i] == target_sample_rate) {
+      ans[i] = waves[i];
+    } else {
+      groups[sample_rates[i]].push_back(i);
+    }
+  }
+
+  auto process_shard = [&ans, &waves, target_sample_rate](
+                           int32_t rate_in,
+                           const std::vector<size_t> &indexes, size_t begin,
+                           size_t end) {
+    float min_freq = std::min<int32_t>(rate_in, target_sample_rate);
+    float lowpass_cutoff = 0.99 * 0.5 * min_freq;
+    int32_t lowpass_filter_width = 6;
+
+    LinearResample resampler(rate_in, target_sample_rate, lowpass_cutoff,
+                             lowpass_filter_width);
+    for (size_t k = begin; k != end; ++k) {
+      // flush == true also resets the internal state, so one resampler
+      // can process the waves of a shard back to back.
+      ans[indexes[k]] = resampler.Resample(waves[indexes[k]], /*flush*/ true);
+    }
+  };
+
+  for (const auto &group : groups) {
+    int32_t rate_in = group.first;
+    const auto &indexes = group.second;
+
+    int32_t n = std::min<int32_t>(num_threads, indexes.size());
+    if (n <= 1) {
+      process_shard(rate_in, indexes, 0, indexes.size());
+      continue;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(n);
+    for (int32_t i = 0; i != n; ++i) {
+      size_t begin = indexes.size() * i / n;
+      size_t end = indexes.size() * (i + 1) / n;
+      threads.emplace_back(process_shard, rate_in, std::cref(indexes), begin,
+                           end);
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+  }
+
+  return ans;
 }
 
 void LinearResample::SetRemainder(const float *input, int32_t input_dim) {
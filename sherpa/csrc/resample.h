@@ -25,6 +25,7 @@
 #define SHERPA_CSRC_RESAMPLE_H_
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 #include "torch/script.h"
@@ -36,6 +37,31 @@ namespace sherpa {
    integers, as this is an easy way to specify that their ratio be rational.
 */
 
+/// Immutable sinc filter tables of a LinearResample. They depend only on
+/// (samp_rate_in, samp_rate_out, filter_cutoff, num_zeros), so all
+/// resampler instances constructed with the same parameters share one
+/// copy via a process-wide cache; see GetResampleTables() in resample.cc.
+struct LinearResampleTables {
+  int32_t input_samples_in_unit;  ///< The number of input samples in the
+                                  ///< smallest repeating unit: num_samp_in_ =
+                                  ///< samp_rate_in_hz / Gcd(samp_rate_in_hz,
+                                  ///< samp_rate_out_hz)
+
+  int32_t output_samples_in_unit;  ///< The number of output samples in the
+                                   ///< smallest repeating unit: num_samp_out_
+                                   ///< = samp_rate_out_hz /
+                                   ///< Gcd(samp_rate_in_hz, samp_rate_out_hz)
+
+  /// The first input-sample index that we sum over, for this output-sample
+  /// index.  May be negative; any truncation at the beginning is handled
+  /// separately.  This is just for the first few output samples, but we can
+  /// extrapolate the correct input-sample index for arbitrary output samples.
+  std::vector<int32_t> first_index;
+
+  /// Weights on the input samples, for this output-sample index.
+  std::vector<std::vector<float>> weights;
+};
+
 class LinearResample {
  public:
   /// Constructor.  We make the input and output sample rates integers, because
@@ -81,10 +107,6 @@ class LinearResample {
   int32_t GetOutputSamplingRate() const { return samp_rate_out_; }
 
  private:
-  void SetIndexesAndWeights();
-
-  float FilterFunc(float) const;
-
   /// This function outputs the number of output samples we will output
   /// for a signal with "input_num_samp" input samples.  If flush == true,
   /// we return the largest n such that
@@ -95,13 +117,6 @@ class LinearResample {
   /// [ 0, input_num_samp/samp_rate_in_ - window_width ).
   int64_t GetNumOutputSamples(int64_t input_num_samp, bool flush) const;
 
-  /// Given an output-sample index, this function outputs to *first_samp_in the
-  /// first input-sample index that we have a weight on (may be negative),
-  /// and to *samp_out_wrapped the index into weights_ where we can get the
-  /// corresponding weights on the input.
-  inline void GetIndexes(int64_t samp_out, int64_t *first_samp_in,
-                         int32_t *samp_out_wrapped) const;
-
   void SetRemainder(const float *input, int32_t input_dim);
 
  private:
@@ -111,24 +126,10 @@ class LinearResample {
   float filter_cutoff_;
   int32_t num_zeros_;
 
-  int32_t input_samples_in_unit_;  ///< The number of input samples in the
-                                   ///< smallest repeating unit: num_samp_in_ =
-                                   ///< samp_rate_in_hz / Gcd(samp_rate_in_hz,
-                                   ///< samp_rate_out_hz)
-
-  int32_t output_samples_in_unit_;  ///< The number of output samples in the
-                                    ///< smallest repeating unit: num_samp_out_
-                                    ///< = samp_rate_out_hz /
-                                    ///< Gcd(samp_rate_in_hz, samp_rate_out_hz)
-
-  /// The first input-sample index that we sum over, for this output-sample
-  /// index.  May be negative; any truncation at the beginning is handled
-  /// separately.  This is just for the first few output samples, but we can
-  /// extrapolate the correct input-sample index for arbitrary output samples.
-  std::vector<int32_t> first_index_;
-
-  /// Weights on the input samples, for this output-sample index.
-  std::vector<std::vector<float>> weights_;
+  /// Shared immutable filter tables; computed once per parameter set and
+  /// cached process wide, so constructing a resampler for an already seen
+  /// sample-rate pair costs no table computation.
+  std::shared_ptr<const LinearResampleTables> tables_;
 
   // the following variables keep track of where we are in a particular signal,
   // if it is being provided over multiple calls to Resample().
@@ -142,6 +143,26 @@ class LinearResample {
                                         ///< previously seen input signal.
 };
 
+/** Resample a batch of waves to a common sample rate.
+ *
+ * Waves are grouped by their input sample rate; each group shares one
+ * set of cached filter tables and the groups are processed across
+ * num_threads worker threads. Waves that are already at the target
+ * sample rate are returned unchanged.
+ *
+ * @param waves 1-D float32 tensors containing the waves.
+ * @param sample_rates Input sample rate of each wave;
+ *                     sample_rates.size() == waves.size().
+ * @param target_sample_rate The sample rate to resample to.
+ * @param num_threads Number of worker threads to use.
+ *
+ * @return Return the resampled waves, in the same order as the input.
+ */
+std::vector<torch::Tensor> ResampleBatch(
+    const std::vector<torch::Tensor> &waves,
+    const std::vector<int32_t> &sample_rates, int32_t target_sample_rate,
+    int32_t num_threads = 1);
+
 }  // namespace sherpa
 
 #endif  // SHERPA_CSRC_RESAMPLE_H_
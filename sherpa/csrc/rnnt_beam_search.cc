@@ -70,10 +70,7 @@ static torch::Tensor BuildDecoderInput(const std::vector<Hypothesis> &hyps,
 
   int64_t *p = decoder_input.data_ptr<int64_t>();
   for (const auto &h : hyps) {
-    auto start = h.ys.end() - context_size;
-    auto end = h.ys.end();
-
-    std::copy(start, end, p);
+    h.FillLastTokens(context_size, p);
     p += context_size;
   }
 
@@ -394,21 +391,25 @@ std::vector<std::vector<int32_t>> ModifiedBeamSearch(
       auto topk_hyp_indexes_acc = topk_hyp_indexes.accessor<int64_t, 1>();
       auto topk_token_indexes_acc = topk_token_indexes.accessor<int64_t, 1>();
 
-      Hypotheses hyps;
+      std::vector<Hypothesis> new_hyps;
+      new_hyps.reserve(values.numel());
       for (int32_t j = 0; j != values.numel(); ++j) {
         int32_t hyp_idx = topk_hyp_indexes_acc[j];
         Hypothesis new_hyp = prev[start + hyp_idx];  // note: hyp_idx is 0 based
 
         int32_t new_token = topk_token_indexes_acc[j];
         if (new_token != blank_id && new_token != unk_id) {
-          new_hyp.ys.push_back(new_token);
+          new_hyp.AddToken(new_token);
         }
 
         // We already added log_prob of the path to log_probs before, so
         // we use values_acc[j] here directly.
         new_hyp.log_prob = values_acc[j];
-        hyps.Add(std::move(new_hyp));
+        new_hyps.push_back(std::move(new_hyp));
       }
+
+      Hypotheses hyps;
+      hyps.AddBatch(std::move(new_hyps));
       cur.push_back(std::move(hyps));
     }
   }
@@ -423,8 +424,8 @@ std::vector<std::vector<int32_t>> ModifiedBeamSearch(
   std::vector<std::vector<int32_t>> ans(batch_size);
   for (int32_t i = 0; i != batch_size; ++i) {
     Hypothesis hyp = cur[unsorted_indices_accessor[i]].GetMostProbable(true);
-    torch::ArrayRef<int32_t> arr(hyp.ys);
-    ans[i] = arr.slice(context_size).vec();
+    auto ys = hyp.Ys();
+    ans[i] = std::vector<int32_t>(ys.begin() + context_size, ys.end());
   }
 
   return ans;
@@ -518,15 +519,15 @@ std::vector<Hypotheses> StreamingModifiedBeamSearch(
       auto topk_hyp_indexes_acc = topk_hyp_indexes.accessor<int64_t, 1>();
       auto topk_token_indexes_acc = topk_token_indexes.accessor<int64_t, 1>();
 
-      Hypotheses hyps;
+      std::vector<Hypothesis> new_hyps;
+      new_hyps.reserve(values.numel());
       for (int32_t j = 0; j != values.numel(); ++j) {
         int32_t hyp_idx = topk_hyp_indexes_acc[j];
         Hypothesis new_hyp = prev[start + hyp_idx];  // note: hyp_idx is 0 based
 
         int32_t new_token = topk_token_indexes_acc[j];
         if (new_token != blank_id && new_token != unk_id) {
-          new_hyp.ys.push_back(new_token);
-          new_hyp.timestamps.push_back(t + frame_offset[k]);
+          new_hyp.AddToken(new_token, t + frame_offset[k]);
           new_hyp.num_trailing_blanks = 0;
         } else {
           new_hyp.num_trailing_blanks += 1;
@@ -535,8 +536,11 @@ std::vector<Hypotheses> StreamingModifiedBeamSearch(
         // We already added log_prob of the path to log_probs before, so
         // we use values_acc[j] here directly.
         new_hyp.log_prob = values_acc[j];
-        hyps.Add(std::move(new_hyp));
+        new_hyps.push_back(std::move(new_hyp));
       }
+
+      Hypotheses hyps;
+      hyps.AddBatch(std::move(new_hyps));
       cur.push_back(std::move(hyps));
     }  // for (int32_t k = 0; k != N; ++k)
   }    // for (int32_t t = 0; t != T; ++t)
@@ -0,0 +1,452 @@
+// sherpa/csrc/sherpa-bench.cc
+//
+// Copyright (c)  2022  Xiaomi Corporation
+//
+// Microbenchmarks for the hot helpers of the decoders. All inputs are
+// generated from fixed seeds, so numbers are comparable across runs and
+// machines of the same type; a perf regression in, e.g., state stacking
+// shows up here without loading a model.
+//
+// Build with -DSHERPA_ENABLE_BENCHMARKS=ON and run ./bin/sherpa-bench.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "kaldifeat/csrc/feature-fbank.h"
+#include "sherpa/csrc/alloc-counter.h"
+#include "sherpa/csrc/fbank-features.h"
+#include "sherpa/csrc/hypothesis.h"
+#include "sherpa/csrc/resample.h"
+#include "sherpa/csrc/rnnt_conformer_model.h"
+#include "sherpa/csrc/rnnt_emformer_model.h"
+#include "sherpa/csrc/rnnt_lstm_model.h"
+
+// Counting overrides of the global allocator. They exist only in this
+// binary, so the interception never perturbs the library; the counters
+// they feed are read through sherpa/csrc/alloc-counter.h. Note that
+// they see every allocation of the thread, including the ones of the
+// benchmark harness itself, which is why measurements snapshot the
+// counters around the timed region only.
+
+void *operator new(std::size_t size) {
+  auto &counters = sherpa::ThreadAllocCounters();
+  counters.num_allocations += 1;
+  counters.num_bytes += static_cast<int64_t>(size);
+
+  void *p = std::malloc(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t /*size*/) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t /*size*/) noexcept {
+  std::free(p);
+}
+
+namespace sherpa {
+
+static constexpr int32_t kSeed = 20230101;
+
+// Attach the allocator traffic since `begin` to the benchmark report as
+// per-iteration counters, so "allocs" and "alloc_bytes" show up next to
+// the wall time of every run. Call it after the measurement loop with a
+// snapshot of ThreadAllocCounters() taken right before it.
+static void ReportAllocs(benchmark::State &state,  // NOLINT
+                         const AllocCounters &begin) {
+  const auto &end = ThreadAllocCounters();
+  state.counters["allocs"] =
+      benchmark::Counter(end.num_allocations - begin.num_allocations,
+                         benchmark::Counter::kAvgIterations);
+  state.counters["alloc_bytes"] = benchmark::Counter(
+      end.num_bytes - begin.num_bytes, benchmark::Counter::kAvgIterations);
+}
+
+static std::vector<Hypothesis> MakeHypotheses(int32_t num_hyps, int32_t len) {
+  std::mt19937 gen(kSeed);
+  std::uniform_int_distribution<int32_t> token(1, 499);
+  std::normal_distribution<double> score(0, 1);
+
+  std::vector<Hypothesis> ans;
+  ans.reserve(num_hyps);
+  for (int32_t i = 0; i != num_hyps; ++i) {
+    Hypothesis h({0, 0}, score(gen));
+    for (int32_t t = 0; t != len; ++t) {
+      h.AddToken(token(gen), t);
+    }
+    ans.push_back(std::move(h));
+  }
+  return ans;
+}
+
+static void BM_HypothesesAdd(benchmark::State &state) {
+  auto hyps = MakeHypotheses(state.range(0), state.range(1));
+
+  auto allocs_begin = ThreadAllocCounters();
+  for (auto _ : state) {
+    Hypotheses dict;
+    for (const auto &h : hyps) {
+      dict.Add(h);
+    }
+    benchmark::DoNotOptimize(dict);
+  }
+  // The per-iteration allocation volume over the {tokens per hyp} sweep
+  // shows directly whether it scales superlinearly with utterance
+  // length.
+  ReportAllocs(state, allocs_begin);
+}
+// {num hyps} x {tokens per hyp}
+BENCHMARK(BM_HypothesesAdd)->ArgsProduct({{4, 16, 64}, {10, 100, 1000}});
+
+static void BM_HypothesesGetMostProbable(benchmark::State &state) {
+  Hypotheses dict(MakeHypotheses(state.range(0), /*len*/ 100));
+
+  auto allocs_begin = ThreadAllocCounters();
+  for (auto _ : state) {
+    auto best = dict.GetMostProbable(/*length_norm*/ true);
+    benchmark::DoNotOptimize(best);
+  }
+  ReportAllocs(state, allocs_begin);
+}
+BENCHMARK(BM_HypothesesGetMostProbable)->Arg(4)->Arg(16)->Arg(64);
+
+// Simulate the per-frame hypothesis bookkeeping of the modified beam
+// search for an utterance of range(0) frames with 4 active paths: every
+// frame extends each hypothesis with a couple of candidate tokens and
+// re-inserts the results into a pruned Hypotheses. The allocs and
+// alloc_bytes counters show, per utterance length, whether the
+// allocation volume of the search scales superlinearly.
+static void BM_BeamSearchHypothesisGrowth(benchmark::State &state) {
+  int32_t num_frames = state.range(0);
+  constexpr int32_t kNumActivePaths = 4;
+  constexpr int32_t kCandidatesPerHyp = 2;
+
+  std::mt19937 gen(kSeed);
+  std::uniform_int_distribution<int32_t> token(1, 499);
+  std::normal_distribution<double> score(0, 1);
+
+  auto allocs_begin = ThreadAllocCounters();
+  for (auto _ : state) {
+    Hypotheses cur;
+    cur.SetPruning(kNumActivePaths, /*score_gap*/ 0);
+    cur.Add(Hypothesis({0, 0}, 0));
+
+    for (int32_t t = 0; t != num_frames; ++t) {
+      Hypotheses next;
+      next.SetPruning(kNumActivePaths, /*score_gap*/ 0);
+      for (const auto &h : cur.Vec()) {
+        for (int32_t k = 0; k != kCandidatesPerHyp; ++k) {
+          Hypothesis extended = h;
+          extended.AddToken(token(gen), t);
+          extended.log_prob += score(gen);
+          next.Add(std::move(extended));
+        }
+      }
+      cur = std::move(next);
+    }
+    benchmark::DoNotOptimize(cur);
+  }
+  ReportAllocs(state, allocs_begin);
+}
+BENCHMARK(BM_BeamSearchHypothesisGrowth)->Arg(100)->Arg(500)->Arg(2000);
+
+// Sample token ids 1..vocab_size with probability proportional to
+// 1 / rank^s. Real beam-search traffic is heavily skewed towards a few
+// frequent tokens -- which is what makes hypothesis merges common --
+// and a Zipf distribution reproduces that skew; the uniform generators
+// above underestimate the merge rate badly. Replace this with trace
+// replay if recorded production traces ever land in the tree.
+class ZipfTokenSampler {
+ public:
+  ZipfTokenSampler(int32_t vocab_size, double s) : cdf_(vocab_size) {
+    double sum = 0;
+    for (int32_t k = 0; k != vocab_size; ++k) {
+      sum += 1.0 / std::pow(k + 1, s);
+      cdf_[k] = sum;
+    }
+    for (auto &c : cdf_) {
+      c /= sum;
+    }
+  }
+
+  template <class Generator>
+  int32_t operator()(Generator &gen) {  // NOLINT
+    double u = uniform_(gen);
+    auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+    return static_cast<int32_t>(it - cdf_.begin()) + 1;
+  }
+
+ private:
+  std::vector<double> cdf_;
+  std::uniform_real_distribution<double> uniform_;
+};
+
+// The per-frame bookkeeping of BM_BeamSearchHypothesisGrowth, but with
+// Zipfian candidate tokens: hypotheses then frequently propose the same
+// extension and take the merge path of Hypotheses::Add() at a rate
+// close to production traffic, so optimizations of the container are
+// validated against realistic key collisions, not just insertions.
+static void BM_BeamSearchZipfianTokens(benchmark::State &state) {
+  int32_t num_frames = state.range(0);
+  constexpr int32_t kNumActivePaths = 4;
+  constexpr int32_t kCandidatesPerHyp = 2;
+  constexpr int32_t kVocabSize = 500;
+
+  std::mt19937 gen(kSeed);
+  ZipfTokenSampler token(kVocabSize, /*s*/ 1.0);
+  std::normal_distribution<double> score(0, 1);
+
+  int64_t num_added = 0;
+  int64_t num_merged = 0;
+
+  auto allocs_begin = ThreadAllocCounters();
+  for (auto _ : state) {
+    Hypotheses cur;
+    cur.SetPruning(kNumActivePaths, /*score_gap*/ 0);
+    cur.Add(Hypothesis({0, 0}, 0));
+
+    for (int32_t t = 0; t != num_frames; ++t) {
+      Hypotheses next;
+      next.SetPruning(kNumActivePaths, /*score_gap*/ 0);
+      for (const auto &h : cur.Vec()) {
+        for (int32_t k = 0; k != kCandidatesPerHyp; ++k) {
+          Hypothesis extended = h;
+          extended.AddToken(token(gen), t);
+          extended.log_prob += score(gen);
+          int32_t before = next.Size();
+          next.Add(std::move(extended));
+          num_added += 1;
+          num_merged += (next.Size() == before);
+        }
+      }
+      cur = std::move(next);
+    }
+    benchmark::DoNotOptimize(cur);
+  }
+  ReportAllocs(state, allocs_begin);
+
+  // Fraction of insertions that hit an existing hypothesis; with the
+  // Zipfian tokens this should be well above zero, confirming the merge
+  // path really is exercised.
+  state.counters["merge_rate"] =
+      benchmark::Counter(num_added ? static_cast<double>(num_merged) /
+                                         static_cast<double>(num_added)
+                                   : 0);
+}
+BENCHMARK(BM_BeamSearchZipfianTokens)->Arg(100)->Arg(500)->Arg(2000);
+
+static std::vector<torch::IValue> MakeLstmStates(RnntLstmModel &model,  // NOLINT
+                                                 int32_t batch_size) {
+  torch::manual_seed(kSeed);
+  std::vector<torch::IValue> states;
+  states.reserve(batch_size);
+  for (int32_t i = 0; i != batch_size; ++i) {
+    states.push_back(model.StateToIValue(
+        {torch::rand({12, 1, 512}), torch::rand({12, 1, 512})}));
+  }
+  return states;
+}
+
+static void BM_LstmStackStates(benchmark::State &state) {
+  torch::NoGradGuard no_grad;
+  RnntLstmModel model;
+  auto states = MakeLstmStates(model, state.range(0));
+
+  for (auto _ : state) {
+    auto stacked = model.StackStates(states);
+    benchmark::DoNotOptimize(stacked);
+  }
+}
+BENCHMARK(BM_LstmStackStates)->Arg(1)->Arg(8)->Arg(32);
+
+static void BM_LstmUnStackStates(benchmark::State &state) {
+  torch::NoGradGuard no_grad;
+  RnntLstmModel model;
+  auto stacked = model.StackStates(MakeLstmStates(model, state.range(0)));
+
+  for (auto _ : state) {
+    auto unstacked = model.UnStackStates(stacked);
+    benchmark::DoNotOptimize(unstacked);
+  }
+}
+BENCHMARK(BM_LstmUnStackStates)->Arg(1)->Arg(8)->Arg(32);
+
+static std::vector<torch::IValue> MakeConformerStates(
+    RnntConformerModel &model,  // NOLINT
+    int32_t batch_size) {
+  torch::manual_seed(kSeed);
+  std::vector<torch::IValue> states;
+  states.reserve(batch_size);
+  for (int32_t i = 0; i != batch_size; ++i) {
+    torch::Tensor attn = torch::rand({12, 32, 512});
+    torch::Tensor conv = torch::rand({12, 30, 512});
+    states.push_back(model.StateToIValue({attn, conv}));
+  }
+  return states;
+}
+
+static void BM_ConformerStackStates(benchmark::State &state) {
+  torch::NoGradGuard no_grad;
+  RnntConformerModel model;
+  auto states = MakeConformerStates(model, state.range(0));
+
+  for (auto _ : state) {
+    auto stacked = model.StackStates(states);
+    benchmark::DoNotOptimize(stacked);
+  }
+}
+BENCHMARK(BM_ConformerStackStates)->Arg(1)->Arg(8)->Arg(32);
+
+static void BM_ConformerUnStackStates(benchmark::State &state) {
+  torch::NoGradGuard no_grad;
+  RnntConformerModel model;
+  auto stacked = model.StackStates(MakeConformerStates(model, state.range(0)));
+
+  for (auto _ : state) {
+    auto unstacked = model.UnStackStates(stacked);
+    benchmark::DoNotOptimize(unstacked);
+  }
+}
+BENCHMARK(BM_ConformerUnStackStates)->Arg(1)->Arg(8)->Arg(32);
+
+static std::vector<torch::IValue> MakeEmformerStates(
+    RnntEmformerModel &model,  // NOLINT
+    int32_t batch_size) {
+  torch::manual_seed(kSeed);
+  int32_t num_layers = 12;
+  int32_t memory_size = 4;
+  int32_t input_dim = 512;
+
+  std::vector<torch::IValue> states;
+  states.reserve(batch_size);
+  for (int32_t b = 0; b != batch_size; ++b) {
+    std::vector<std::vector<torch::Tensor>> s(num_layers);
+    for (int32_t layer = 0; layer != num_layers; ++layer) {
+      auto &layer_states = s[layer];
+      layer_states.push_back(torch::rand({memory_size, input_dim}));  // memory
+      layer_states.push_back(torch::rand({memory_size, input_dim}));  // key
+      layer_states.push_back(torch::rand({memory_size, input_dim}));  // value
+      layer_states.push_back(torch::rand({1}));  // past length
+    }
+    states.push_back(model.StateToIValue(s));
+  }
+  return states;
+}
+
+static void BM_EmformerStackStates(benchmark::State &state) {
+  torch::NoGradGuard no_grad;
+  RnntEmformerModel model;
+  auto states = MakeEmformerStates(model, state.range(0));
+
+  for (auto _ : state) {
+    auto stacked = model.StackStates(states);
+    benchmark::DoNotOptimize(stacked);
+  }
+}
+BENCHMARK(BM_EmformerStackStates)->Arg(1)->Arg(8)->Arg(32);
+
+static void BM_EmformerUnStackStates(benchmark::State &state) {
+  torch::NoGradGuard no_grad;
+  RnntEmformerModel model;
+  auto stacked = model.StackStates(MakeEmformerStates(model, state.range(0)));
+
+  for (auto _ : state) {
+    auto unstacked = model.UnStackStates(stacked);
+    benchmark::DoNotOptimize(unstacked);
+  }
+}
+BENCHMARK(BM_EmformerUnStackStates)->Arg(1)->Arg(8)->Arg(32);
+
+static void BM_ComputeFeatures(benchmark::State &state) {
+  torch::NoGradGuard no_grad;
+
+  kaldifeat::FbankOptions opts;
+  opts.frame_opts.dither = 0;
+  opts.frame_opts.samp_freq = 16000;
+  opts.mel_opts.num_bins = 80;
+  kaldifeat::Fbank fbank(opts);
+
+  torch::manual_seed(kSeed);
+  int64_t num_samples = state.range(0) * 16000;  // range(0) is in seconds
+  torch::Tensor wave = torch::rand({num_samples}) - 0.5;
+
+  for (auto _ : state) {
+    auto features = ComputeFeatures(fbank, {wave});
+    benchmark::DoNotOptimize(features);
+  }
+}
+BENCHMARK(BM_ComputeFeatures)->Arg(1)->Arg(5)->Arg(20);
+
+// Fbank throughput scaling: {thread count} x {wave seconds} x {0/1 to
+// resample from 48 kHz first}. One wave per thread, so every shard of
+// ComputeFeatures() stays busy; resampling runs per wave on the calling
+// thread, as it does in the streams. bytes_per_second is the raw
+// float32 audio volume and items_per_second is waves per second, whose
+// inverse is the per-wave latency. The sweep is the data for sizing
+// --num-io-threads on a given machine type; it is slow in full, so
+// consider --benchmark_filter to run a slice.
+static void BM_ComputeFeaturesScaling(benchmark::State &state) {
+  torch::NoGradGuard no_grad;
+
+  int32_t num_threads = state.range(0);
+  int32_t wave_seconds = state.range(1);
+  bool resample = state.range(2) != 0;
+
+  kaldifeat::FbankOptions opts;
+  opts.frame_opts.dither = 0;
+  opts.frame_opts.samp_freq = 16000;
+  opts.mel_opts.num_bins = 80;
+  kaldifeat::Fbank fbank(opts);
+
+  int32_t in_rate = resample ? 48000 : 16000;
+
+  torch::manual_seed(kSeed);
+  std::vector<torch::Tensor> waves(num_threads);
+  for (auto &wave : waves) {
+    wave = torch::rand({static_cast<int64_t>(in_rate) * wave_seconds}) - 0.5;
+  }
+
+  // The same cutoff the streams use when they create a resampler.
+  LinearResample resampler(in_rate, 16000,
+                           /*filter_cutoff_hz*/ 0.99 * 0.5 * 16000,
+                           /*num_zeros*/ 6);
+
+  for (auto _ : state) {
+    std::vector<torch::Tensor> batch(waves.size());
+    for (size_t i = 0; i != waves.size(); ++i) {
+      if (resample) {
+        resampler.Reset();
+        batch[i] = resampler.Resample(waves[i], /*flush*/ true);
+      } else {
+        batch[i] = waves[i];
+      }
+    }
+
+    auto features = ComputeFeatures(fbank, batch, /*num_frames*/ nullptr,
+                                    num_threads);
+    benchmark::DoNotOptimize(features);
+  }
+
+  int64_t bytes_per_batch = static_cast<int64_t>(num_threads) * in_rate *
+                            wave_seconds * sizeof(float);
+  state.SetBytesProcessed(state.iterations() * bytes_per_batch);
+  state.SetItemsProcessed(state.iterations() * num_threads);
+}
+BENCHMARK(BM_ComputeFeaturesScaling)
+    ->ArgsProduct({{1, 2, 4, 8, 16, 32}, {1, 10, 60, 300}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace sherpa
+
+BENCHMARK_MAIN();
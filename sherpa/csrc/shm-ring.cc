@@ -0,0 +1,191 @@
+// sherpa/csrc/shm-ring.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/shm-ring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include "sherpa/csrc/log.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sherpa {
+
+#ifndef _WIN32
+
+// Copy `n` bytes into the ring at logical position `pos`, wrapping at
+// the end of the data region.
+static void CopyIn(char *data, uint32_t capacity, uint64_t pos,
+                   const void *src, uint32_t n) {
+  uint32_t offset = static_cast<uint32_t>(pos % capacity);
+  uint32_t first = std::min(n, capacity - offset);
+  std::memcpy(data + offset, src, first);
+  std::memcpy(data, static_cast<const char *>(src) + first, n - first);
+}
+
+static void CopyOut(const char *data, uint32_t capacity, uint64_t pos,
+                    void *dst, uint32_t n) {
+  uint32_t offset = static_cast<uint32_t>(pos % capacity);
+  uint32_t first = std::min(n, capacity - offset);
+  std::memcpy(dst, data + offset, first);
+  std::memcpy(static_cast<char *>(dst) + first, data, n - first);
+}
+
+ShmRingWriter::ShmRingWriter(const std::string &name, uint32_t capacity)
+    : name_(name) {
+  // Replace a leftover object from a previous run, so stale cursors
+  // never confuse a fresh reader.
+  shm_unlink(name.c_str());
+
+  fd_ = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd_ < 0) {
+    SHERPA_LOG(FATAL) << "shm_open failed for " << name << ": "
+                      << strerror(errno);
+  }
+
+  size_t total = sizeof(ShmRingHeader) + capacity;
+  if (ftruncate(fd_, total) != 0) {
+    SHERPA_LOG(FATAL) << "ftruncate failed for " << name << ": "
+                      << strerror(errno);
+  }
+
+  void *p = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) {
+    SHERPA_LOG(FATAL) << "mmap failed for " << name << ": "
+                      << strerror(errno);
+  }
+
+  header_ = new (p) ShmRingHeader;
+  header_->capacity = capacity;
+  header_->head.store(0, std::memory_order_relaxed);
+  header_->tail.store(0, std::memory_order_relaxed);
+  // The magic goes last, so a reader that attaches mid-construction
+  // sees junk, not a half-initialized header.
+  header_->magic = kShmRingMagic;
+
+  data_ = reinterpret_cast<char *>(header_ + 1);
+}
+
+ShmRingWriter::~ShmRingWriter() {
+  if (header_) {
+    munmap(header_, sizeof(ShmRingHeader) + header_->capacity);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  shm_unlink(name_.c_str());
+}
+
+bool ShmRingWriter::Write(const void *data, uint32_t size) {
+  uint32_t capacity = header_->capacity;
+  uint64_t head = header_->head.load(std::memory_order_relaxed);
+  uint64_t tail = header_->tail.load(std::memory_order_acquire);
+
+  uint64_t needed = sizeof(uint32_t) + size;
+  if (capacity - (head - tail) < needed) {
+    return false;
+  }
+
+  CopyIn(data_, capacity, head, &size, sizeof(uint32_t));
+  CopyIn(data_, capacity, head + sizeof(uint32_t), data, size);
+
+  // Publish the record; the release pairs with the acquire in Read().
+  header_->head.store(head + needed, std::memory_order_release);
+  return true;
+}
+
+ShmRingReader::ShmRingReader(const std::string &name) {
+  fd_ = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd_ < 0) {
+    SHERPA_LOG(FATAL) << "shm_open failed for " << name
+                      << " (is the writer running?): " << strerror(errno);
+  }
+
+  struct stat st;
+  if (fstat(fd_, &st) != 0 ||
+      static_cast<size_t>(st.st_size) <= sizeof(ShmRingHeader)) {
+    SHERPA_LOG(FATAL) << "Invalid shm object " << name;
+  }
+
+  void *p =
+      mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) {
+    SHERPA_LOG(FATAL) << "mmap failed for " << name << ": "
+                      << strerror(errno);
+  }
+
+  header_ = reinterpret_cast<ShmRingHeader *>(p);
+  if (header_->magic != kShmRingMagic ||
+      sizeof(ShmRingHeader) + header_->capacity !=
+          static_cast<size_t>(st.st_size)) {
+    SHERPA_LOG(FATAL) << name << " is not a sherpa result ring";
+  }
+
+  data_ = reinterpret_cast<char *>(header_ + 1);
+}
+
+ShmRingReader::~ShmRingReader() {
+  if (header_) {
+    munmap(header_, sizeof(ShmRingHeader) + header_->capacity);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool ShmRingReader::Read(std::string *out) {
+  uint32_t capacity = header_->capacity;
+  uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+  uint64_t head = header_->head.load(std::memory_order_acquire);
+
+  if (head == tail) {
+    return false;
+  }
+
+  uint32_t size = 0;
+  CopyOut(data_, capacity, tail, &size, sizeof(uint32_t));
+
+  out->resize(size);
+  CopyOut(data_, capacity, tail + sizeof(uint32_t), &(*out)[0], size);
+
+  // Free the slot; the release pairs with the acquire in Write().
+  header_->tail.store(tail + sizeof(uint32_t) + size,
+                      std::memory_order_release);
+  return true;
+}
+
+#else
+
+ShmRingWriter::ShmRingWriter(const std::string &name,
+                             uint32_t /*capacity*/) {
+  SHERPA_LOG(FATAL) << "Shared-memory result transport is not supported "
+                    << "on Windows (requested ring: " << name << ")";
+}
+
+ShmRingWriter::~ShmRingWriter() = default;
+
+bool ShmRingWriter::Write(const void * /*data*/, uint32_t /*size*/) {
+  return false;
+}
+
+ShmRingReader::ShmRingReader(const std::string &name) {
+  SHERPA_LOG(FATAL) << "Shared-memory result transport is not supported "
+                    << "on Windows (requested ring: " << name << ")";
+}
+
+ShmRingReader::~ShmRingReader() = default;
+
+bool ShmRingReader::Read(std::string * /*out*/) { return false; }
+
+#endif  // _WIN32
+
+}  // namespace sherpa
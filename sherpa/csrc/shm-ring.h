@@ -0,0 +1,104 @@
+// sherpa/csrc/shm-ring.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_SHM_RING_H_
+#define SHERPA_CSRC_SHM_RING_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace sherpa {
+
+/* A single-producer single-consumer byte ring in POSIX shared memory.
+ *
+ * It carries length-prefixed records (serialized recognition results)
+ * from a C++ server to a colocated consumer, e.g., a Python
+ * post-processing worker, without sockets or re-serialization: the
+ * producer memcpys each record into the mapping and the consumer reads
+ * it straight out of the same pages. Producer and consumer only share
+ * two atomic cursors, so a handoff costs two memcpys and no syscalls.
+ *
+ * The writer creates (and on destruction unlinks) the shm object; the
+ * reader attaches to an existing one by name. Names follow shm_open(),
+ * e.g., "/sherpa-results".
+ */
+
+// The layout at the start of the shared mapping, followed by
+// `capacity` bytes of record data. Both sides run on the same host and
+// map the same pages, so the atomics synchronize them like they would
+// threads of one process.
+struct ShmRingHeader {
+  uint32_t magic;     // kShmRingMagic, to catch attaching to junk
+  uint32_t capacity;  // number of bytes of the data region
+  std::atomic<uint64_t> head;  // bytes ever written; owned by the producer
+  std::atomic<uint64_t> tail;  // bytes ever consumed; owned by the consumer
+};
+
+constexpr uint32_t kShmRingMagic = 0x53524e47;  // "SRNG"
+
+class ShmRingWriter {
+ public:
+  /** Create the shm object and map the ring.
+   *
+   * @param name Name of the shm object, e.g., "/sherpa-results". An
+   *             existing object of this name is replaced.
+   * @param capacity Number of payload bytes the ring can hold.
+   */
+  ShmRingWriter(const std::string &name, uint32_t capacity);
+
+  /// Unmap and unlink the shm object.
+  ~ShmRingWriter();
+
+  ShmRingWriter(const ShmRingWriter &) = delete;
+  ShmRingWriter &operator=(const ShmRingWriter &) = delete;
+
+  /** Append one record.
+   *
+   * @param data The record payload; it is copied.
+   * @param size Number of bytes in `data`.
+   * @return Return true on success; return false if the ring does not
+   *         have room, i.e., the consumer has fallen a whole ring
+   *         behind. The record is dropped in that case; the producer
+   *         never blocks.
+   */
+  bool Write(const void *data, uint32_t size);
+
+ private:
+  std::string name_;
+  ShmRingHeader *header_ = nullptr;
+  char *data_ = nullptr;  // the ring region, right after the header
+  int32_t fd_ = -1;
+};
+
+class ShmRingReader {
+ public:
+  /// Attach to the ring created by a ShmRingWriter of the same name.
+  explicit ShmRingReader(const std::string &name);
+
+  /// Unmap the ring. The shm object itself stays until the writer
+  /// unlinks it.
+  ~ShmRingReader();
+
+  ShmRingReader(const ShmRingReader &) = delete;
+  ShmRingReader &operator=(const ShmRingReader &) = delete;
+
+  /** Pop the oldest record, if any.
+   *
+   * @param out On success it is filled with the record payload.
+   * @return Return true if a record was read; return false if the ring
+   *         is empty. It never blocks, so a consumer polls (or sleeps
+   *         between empty reads).
+   */
+  bool Read(std::string *out);
+
+ private:
+  ShmRingHeader *header_ = nullptr;
+  char *data_ = nullptr;
+  int32_t fd_ = -1;
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_SHM_RING_H_
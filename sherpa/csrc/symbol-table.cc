@@ -18,14 +18,64 @@
 
 #include "sherpa/csrc/symbol-table.h"
 
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <sstream>
+#include <utility>
 
 #include "sherpa/csrc/log.h"
 
 namespace sherpa {
 
+namespace {
+
+// Layout of the compiled cache, all fields little endian:
+//
+//   uint32 magic, int32 version, int32 num_ids, int32 pool_bytes
+//   int32 offsets[num_ids + 1]   // into the char pool
+//   char pool[pool_bytes]        // symbol bytes, no separators
+//
+// The symbol of ID i is pool[offsets[i]..offsets[i + 1]); an empty
+// range marks an ID that is not in the table. Symbols are stored after
+// the BPE space replacement, so loading is a single pass with no
+// per-symbol processing.
+constexpr uint32_t kBinaryMagic = 0x5348544b;  // "SHTK"
+constexpr int32_t kBinaryVersion = 1;
+constexpr size_t kHeaderBytes = 16;
+
+bool GetMtime(const std::string &path, int64_t *mtime) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return false;
+  }
+  *mtime = static_cast<int64_t>(st.st_mtime);
+  return true;
+}
+
+}  // namespace
+
 SymbolTable::SymbolTable(const std::string &filename) {
+  // Use the compiled cache when it is at least as new as the text file;
+  // any problem with it (stale version, truncation) just means parsing
+  // the text file below.
+  std::string binary = filename + ".bin";
+  int64_t text_mtime = 0;
+  int64_t binary_mtime = 0;
+  if (GetMtime(filename, &text_mtime) && GetMtime(binary, &binary_mtime) &&
+      binary_mtime >= text_mtime && LoadBinary(binary)) {
+    return;
+  }
+
   std::ifstream is(filename);
   std::string sym;
   int32_t id;
@@ -40,13 +90,148 @@ SymbolTable::SymbolTable(const std::string &filename) {
     }
 
     SHERPA_CHECK(!sym.empty());
+    SHERPA_CHECK_GE(id, 0);
     SHERPA_CHECK_EQ(sym2id_.count(sym), 0) << "Duplicated symbol: " << sym;
-    SHERPA_CHECK_EQ(id2sym_.count(id), 0) << "Duplicated ID: " << id;
+    SHERPA_CHECK(!contains(id)) << "Duplicated ID: " << id;
 
     sym2id_.insert({sym, id});
-    id2sym_.insert({id, sym});
+    if (static_cast<int32_t>(id2sym_.size()) <= id) {
+      id2sym_.resize(id + 1);
+    }
+    id2sym_[id] = sym;
   }
   SHERPA_CHECK(is.eof());
+
+  SaveBinary(binary);
+}
+
+bool SymbolTable::LoadBinary(const std::string &filename) {
+#ifndef _WIN32
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  auto size = static_cast<size_t>(st.st_size);
+
+  void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+
+  bool ok = ParseBinary(static_cast<const char *>(p), size);
+  munmap(p, size);
+  return ok;
+#else
+  std::ifstream is(filename, std::ios::binary);
+  if (!is) {
+    return false;
+  }
+  std::ostringstream os;
+  os << is.rdbuf();
+  std::string data = os.str();
+  return ParseBinary(data.data(), data.size());
+#endif
+}
+
+bool SymbolTable::ParseBinary(const char *data, size_t size) {
+  if (size < kHeaderBytes) {
+    return false;
+  }
+
+  uint32_t magic;
+  int32_t version;
+  int32_t num_ids;
+  int32_t pool_bytes;
+  std::memcpy(&magic, data, 4);
+  std::memcpy(&version, data + 4, 4);
+  std::memcpy(&num_ids, data + 8, 4);
+  std::memcpy(&pool_bytes, data + 12, 4);
+
+  if (magic != kBinaryMagic || version != kBinaryVersion || num_ids < 0 ||
+      pool_bytes < 0) {
+    return false;
+  }
+
+  size_t offsets_bytes = static_cast<size_t>(num_ids + 1) * 4;
+  if (size != kHeaderBytes + offsets_bytes + pool_bytes) {
+    return false;
+  }
+
+  // The mapping is page aligned, so data + kHeaderBytes is aligned for
+  // int32 access.
+  const int32_t *offsets =
+      reinterpret_cast<const int32_t *>(data + kHeaderBytes);
+  const char *pool = data + kHeaderBytes + offsets_bytes;
+
+  id2sym_.resize(num_ids);
+  sym2id_.reserve(num_ids);
+  for (int32_t i = 0; i != num_ids; ++i) {
+    int32_t begin = offsets[i];
+    int32_t end = offsets[i + 1];
+    if (begin < 0 || end < begin || end > pool_bytes) {
+      id2sym_.clear();
+      sym2id_.clear();
+      return false;
+    }
+    if (end > begin) {
+      id2sym_[i].assign(pool + begin, end - begin);
+      sym2id_.emplace(id2sym_[i], i);
+    }
+  }
+
+  return true;
+}
+
+void SymbolTable::SaveBinary(const std::string &filename) const {
+  // Best effort: a read-only model directory or a concurrent writer is
+  // not an error, the next process just parses the text file again. The
+  // rename makes the cache appear atomically, so readers never see a
+  // half-written file.
+  std::string tmp = filename + ".tmp";
+  {
+    std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+    if (!os) {
+      return;
+    }
+
+    auto num_ids = static_cast<int32_t>(id2sym_.size());
+    std::vector<int32_t> offsets(num_ids + 1);
+    std::string pool;
+    for (int32_t i = 0; i != num_ids; ++i) {
+      offsets[i] = static_cast<int32_t>(pool.size());
+      pool.append(id2sym_[i]);
+    }
+    offsets[num_ids] = static_cast<int32_t>(pool.size());
+    auto pool_bytes = static_cast<int32_t>(pool.size());
+
+    os.write(reinterpret_cast<const char *>(&kBinaryMagic), 4);
+    os.write(reinterpret_cast<const char *>(&kBinaryVersion), 4);
+    os.write(reinterpret_cast<const char *>(&num_ids), 4);
+    os.write(reinterpret_cast<const char *>(&pool_bytes), 4);
+    os.write(reinterpret_cast<const char *>(offsets.data()),
+             offsets.size() * 4);
+    os.write(pool.data(), pool.size());
+
+    if (!os) {
+      os.close();
+      std::remove(tmp.c_str());
+      return;
+    }
+  }
+
+  if (std::rename(tmp.c_str(), filename.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    return;
+  }
+
+  SHERPA_LOG(INFO) << "Compiled symbol table cache " << filename;
 }
 
 std::string SymbolTable::ToString() const {
@@ -66,7 +251,10 @@ int32_t SymbolTable::operator[](const std::string &sym) const {
   return sym2id_.at(sym);
 }
 
-bool SymbolTable::contains(int32_t id) const { return id2sym_.count(id) != 0; }
+bool SymbolTable::contains(int32_t id) const {
+  return id >= 0 && id < static_cast<int32_t>(id2sym_.size()) &&
+         !id2sym_[id].empty();
+}
 
 bool SymbolTable::contains(const std::string &sym) const {
   return sym2id_.count(sym) != 0;
@@ -19,8 +19,10 @@
 #ifndef SHERPA_CSRC_SYMBOL_TABLE_H_
 #define SHERPA_CSRC_SYMBOL_TABLE_H_
 
+#include <cstddef>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace sherpa {
 
@@ -34,6 +36,13 @@ class SymbolTable {
   ///    sym ID
   ///
   /// Fields are separated by space(s).
+  ///
+  /// Parsing a large BPE vocabulary line by line is slow, so the parsed
+  /// table is compiled into a binary cache `<filename>.bin` next to the
+  /// text file on first use (best effort; a read-only directory just
+  /// skips the cache). Later constructions memory-map the cache when it
+  /// is at least as new as the text file, which loads in one pass and
+  /// shares the file pages with other processes through the page cache.
   explicit SymbolTable(const std::string &filename);
 
   /// Return a string representation of this symbol table
@@ -55,8 +64,21 @@ class SymbolTable {
   bool contains(const std::string &sym) const;
 
  private:
+  // The compiled binary cache; see the constructor doc. LoadBinary()
+  // and ParseBinary() return false on any mismatch (bad magic, stale
+  // version, truncated file), in which case the constructor falls back
+  // to parsing the text file.
+  bool LoadBinary(const std::string &filename);
+  bool ParseBinary(const char *data, size_t size);
+  void SaveBinary(const std::string &filename) const;
+
   std::unordered_map<std::string, int32_t> sym2id_;
-  std::unordered_map<int32_t, std::string> id2sym_;
+
+  // Token IDs are dense (0 to vocab-1), so ID-to-symbol is a vector
+  // indexed by ID instead of a hash map: the result builders of the
+  // decoders look up every emitted token of every partial result. An
+  // empty slot marks an ID that is not in the table.
+  std::vector<std::string> id2sym_;
 };
 
 std::ostream &operator<<(std::ostream &os, const SymbolTable &symbol_table);
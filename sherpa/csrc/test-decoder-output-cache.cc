@@ -0,0 +1,47 @@
+// sherpa/csrc/test-decoder-output-cache.cc
+//
+// Copyright (c)  2022  Xiaomi Corporation
+
+#include "sherpa/csrc/decoder-output-cache.h"
+
+#include "gtest/gtest.h"
+
+namespace sherpa {
+
+// A stand-in for the decoder network: doubles each context row.
+static torch::Tensor FakeRunDecoder(torch::Tensor decoder_input) {
+  return decoder_input.to(torch::kFloat) * 2;
+}
+
+TEST(DecoderOutputCache, HitsAndMisses) {
+  DecoderOutputCache cache(/*capacity*/ 16);
+
+  auto input = torch::tensor({{0, 1}, {2, 3}, {0, 1}}, torch::kLong);
+  auto out = cache.Get(input, FakeRunDecoder);
+
+  EXPECT_TRUE(out.allclose(FakeRunDecoder(input)));
+  EXPECT_EQ(cache.NumQueries(), 3);
+  // Rows 0 and 2 have the same context, but both miss since row 0 is
+  // inserted only after the whole batch is looked up.
+  EXPECT_EQ(cache.NumHits(), 0);
+
+  out = cache.Get(input, FakeRunDecoder);
+  EXPECT_TRUE(out.allclose(FakeRunDecoder(input)));
+  EXPECT_EQ(cache.NumQueries(), 6);
+  EXPECT_EQ(cache.NumHits(), 3);
+}
+
+TEST(DecoderOutputCache, Eviction) {
+  DecoderOutputCache cache(/*capacity*/ 2);
+
+  auto input = torch::tensor({{0, 1}, {2, 3}, {4, 5}}, torch::kLong);
+  cache.Get(input, FakeRunDecoder);
+
+  // {0, 1} is the least recently used entry and has been evicted;
+  // {2, 3} and {4, 5} are still cached.
+  auto out = cache.Get(input, FakeRunDecoder);
+  EXPECT_TRUE(out.allclose(FakeRunDecoder(input)));
+  EXPECT_EQ(cache.NumHits(), 2);
+}
+
+}  // namespace sherpa
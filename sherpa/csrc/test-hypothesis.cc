@@ -16,6 +16,10 @@
  * limitations under the License.
  */
 
+#include <cmath>
+#include <unordered_set>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "sherpa/csrc/hypothesis.h"
 
@@ -23,20 +27,169 @@ namespace sherpa {
 
 TEST(Hypothesis, DefaultConstructor) {
   Hypothesis hyp;
-  EXPECT_TRUE(hyp.ys.empty());
+  EXPECT_TRUE(hyp.Ys().empty());
+  EXPECT_EQ(hyp.NumTokens(), 0);
   EXPECT_EQ(hyp.log_prob, 0);
 }
 
 TEST(Hypothesis, Constructor) {
   Hypothesis hyp({1, 2, 3}, 0.5);
-  EXPECT_EQ(hyp.ys, (std::vector<int32_t>{1, 2, 3}));
+  EXPECT_EQ(hyp.Ys(), (std::vector<int32_t>{1, 2, 3}));
+  EXPECT_EQ(hyp.NumTokens(), 3);
   EXPECT_EQ(hyp.log_prob, 0.5);
 }
 
+TEST(Hypothesis, PrefixSharing) {
+  Hypothesis hyp({0, 0}, 0);
+  hyp.AddToken(1, /*timestamp*/ 3);
+
+  // Extending a copy shares the prefix with the original.
+  Hypothesis extended = hyp;
+  extended.AddToken(2, /*timestamp*/ 5);
+
+  EXPECT_EQ(hyp.Ys(), (std::vector<int32_t>{0, 0, 1}));
+  EXPECT_EQ(extended.Ys(), (std::vector<int32_t>{0, 0, 1, 2}));
+  EXPECT_EQ(extended.last->prev, hyp.last);
+
+  // Context blanks have no timestamp.
+  EXPECT_EQ(extended.Timestamps(), (std::vector<int32_t>{3, 5}));
+
+  std::vector<int64_t> last_tokens(2);
+  extended.FillLastTokens(2, last_tokens.data());
+  EXPECT_EQ(last_tokens, (std::vector<int64_t>{1, 2}));
+}
+
+TEST(Hypothesis, TokenNodePoolRecyclesChunks) {
+  const void *released = nullptr;
+  {
+    Hypothesis hyp;
+    hyp.AddToken(1);
+    released = hyp.last.get();
+  }
+
+  // The freelist is LIFO, so the chunk released above is handed out
+  // again for the next node of the same size.
+  Hypothesis hyp;
+  hyp.AddToken(2);
+  EXPECT_EQ(static_cast<const void *>(hyp.last.get()), released);
+}
+
 TEST(Hypothesis, Key) {
   Hypothesis hyp;
-  hyp.ys = {1, 2, 3};
-  EXPECT_EQ(hyp.Key(), "1-2-3");
+  hyp.AddToken(1);
+  hyp.AddToken(2);
+  hyp.AddToken(3);
+
+  // The key only depends on the token sequence.
+  EXPECT_EQ(hyp.Key(), Hypothesis({1, 2, 3}, 0.5).Key());
+
+  EXPECT_NE(hyp.Key(), Hypothesis({1, 2}, 0.5).Key());
+  EXPECT_NE(hyp.Key(), Hypothesis({1, 2, 4}, 0.5).Key());
+  EXPECT_NE(hyp.Key(), Hypothesis({3, 2, 1}, 0.5).Key());
+}
+
+TEST(Hypotheses, UniqueNodes) {
+  Hypothesis base({0, 0}, 0);
+
+  Hypothesis a = base;
+  a.AddToken(1);
+
+  Hypothesis b = a;
+  b.AddToken(2);
+
+  Hypothesis c = a;
+  c.AddToken(3);
+
+  Hypotheses hyps(std::vector<Hypothesis>{b, c});
+
+  // b and c share {0, 0, 1}; only the last tokens differ:
+  // 0-0-1-2 and 0-0-1-3 give 5 unique nodes in total.
+  auto nodes = hyps.UniqueNodes();
+  EXPECT_EQ(nodes.size(), 5);
+
+  // Parents always precede their children.
+  std::unordered_set<const TokenNode *> seen;
+  for (auto node : nodes) {
+    if (node->prev) {
+      EXPECT_TRUE(seen.count(node->prev.get()));
+    }
+    seen.insert(node);
+  }
+}
+
+TEST(Hypotheses, InsertionTimePruning) {
+  Hypotheses hyps;
+  hyps.SetPruning(/*max_active*/ 2, /*score_gap*/ 5);
+
+  hyps.Add(Hypothesis({1}, 0));
+  hyps.Add(Hypothesis({2}, -10));  // more than 5 below the best: rejected
+  EXPECT_EQ(hyps.Size(), 1);
+
+  hyps.Add(Hypothesis({3}, -1));
+  hyps.Add(Hypothesis({4}, -2));  // within the gap, but over the cap
+  EXPECT_EQ(hyps.Size(), 2);
+  EXPECT_EQ(hyps.GetMostProbable(false).Ys(), std::vector<int32_t>{1});
+}
+
+TEST(Hypotheses, RecombinationKeepsDominantAlignment) {
+  Hypothesis a;
+  a.AddToken(1, /*timestamp*/ 2);
+  a.log_prob = -3;
+
+  // The same token sequence with a different (blank) alignment and a
+  // higher score.
+  Hypothesis b;
+  b.AddToken(1, /*timestamp*/ 4);
+  b.log_prob = -1;
+  b.num_trailing_blanks = 2;
+
+  Hypotheses hyps;
+  hyps.Add(a);
+  hyps.Add(b);
+  EXPECT_EQ(hyps.Size(), 1);
+
+  // The scores add in log space; the alignment is the dominant path's.
+  auto best = hyps.GetMostProbable(false);
+  EXPECT_NEAR(best.log_prob, std::log(std::exp(-3.0) + std::exp(-1.0)),
+              1e-10);
+  EXPECT_EQ(best.Timestamps(), std::vector<int32_t>{4});
+  EXPECT_EQ(best.num_trailing_blanks, 2);
+
+  EXPECT_EQ(hyps.NumCandidates(), 2);
+  EXPECT_EQ(hyps.NumMerged(), 1);
+
+  // AddBatch() recombines the same way, including collisions within
+  // one batch.
+  Hypotheses batched;
+  batched.AddBatch({a, b, a});
+  EXPECT_EQ(batched.Size(), 1);
+  EXPECT_EQ(batched.GetMostProbable(false).Timestamps(),
+            std::vector<int32_t>{4});
+  EXPECT_EQ(batched.NumCandidates(), 3);
+  EXPECT_EQ(batched.NumMerged(), 2);
+}
+
+TEST(Hypotheses, TakeMostProbable) {
+  Hypotheses hyps;
+  hyps.Add(Hypothesis({1}, -2));
+  hyps.Add(Hypothesis({2}, -1));
+
+  // The winner is moved out and removed; the rest stay.
+  auto best = hyps.TakeMostProbable(/*length_norm*/ false);
+  EXPECT_EQ(best.Ys(), std::vector<int32_t>{2});
+  EXPECT_EQ(hyps.Size(), 1);
+  EXPECT_EQ(hyps.TakeMostProbable(false).Ys(), std::vector<int32_t>{1});
+  EXPECT_EQ(hyps.Size(), 0);
+}
+
+TEST(Hypotheses, TakeVec) {
+  Hypotheses hyps;
+  hyps.Add(Hypothesis({1}, -2));
+  hyps.Add(Hypothesis({2}, -1));
+
+  auto vec = hyps.TakeVec();
+  EXPECT_EQ(vec.size(), 2u);
+  EXPECT_EQ(hyps.Size(), 0);
 }
 
 TEST(Hypotheses, ConstructorFromVector) {
@@ -44,8 +197,8 @@ TEST(Hypotheses, ConstructorFromVector) {
   hyp_vec.emplace_back(Hypothesis({1, 2, 3}, -1.5));
   hyp_vec.emplace_back(Hypothesis({30}, -2.5));
 
-  EXPECT_EQ(hyp_vec[0].ys.size(), 3);
-  EXPECT_EQ(hyp_vec[1].ys.size(), 1);
+  EXPECT_EQ(hyp_vec[0].NumTokens(), 3);
+  EXPECT_EQ(hyp_vec[1].NumTokens(), 1);
 
   Hypotheses hyps(std::move(hyp_vec));
   EXPECT_EQ(hyps.Size(), 2);
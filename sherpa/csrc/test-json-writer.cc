@@ -0,0 +1,79 @@
+// sherpa/csrc/test-json-writer.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/json-writer.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace sherpa {
+
+TEST(JsonWriter, Object) {
+  JsonWriter w;
+  w.StartObject();
+  w.Key("text");
+  w.Write(std::string("hello world"));
+  w.Key("segment");
+  w.Write(static_cast<int32_t>(3));
+  w.Key("final");
+  w.Write(true);
+  w.EndObject();
+
+  EXPECT_EQ(w.Str(), R"({"text":"hello world","segment":3,"final":true})");
+}
+
+TEST(JsonWriter, StringEscaping) {
+  JsonWriter w;
+  w.StartObject();
+  w.Key("s");
+  w.Write(std::string("a\"b\\c\nd\x01"));
+  w.EndObject();
+
+  EXPECT_EQ(w.Str(), "{\"s\":\"a\\\"b\\\\c\\nd\\u0001\"}");
+}
+
+TEST(JsonWriter, FixedPointFloats) {
+  JsonWriter w;
+  w.StartArray();
+  w.Write(1.2344f, 3);
+  w.Write(-0.5f, 2);
+  w.Write(2.0f, 0);
+  w.Write(0.0049f, 2);  // rounds to 0.00
+  w.EndArray();
+
+  EXPECT_EQ(w.Str(), "[1.234,-0.50,2,0.00]");
+}
+
+TEST(JsonWriter, Arrays) {
+  JsonWriter w;
+  w.StartObject();
+  w.Key("tokens");
+  w.Write(std::vector<std::string>{"a", "b"});
+  w.Key("timestamps");
+  w.Write(std::vector<float>{0.1f, 0.25f}, 2);
+  w.Key("quoted");
+  w.WriteQuoted(std::vector<float>{0.1f, 0.25f}, 2);
+  w.EndObject();
+
+  EXPECT_EQ(w.Str(),
+            R"({"tokens":["a","b"],"timestamps":[0.10,0.25],)"
+            R"("quoted":"[0.10,0.25]"})");
+}
+
+TEST(JsonWriter, ResetKeepsCapacity) {
+  JsonWriter w;
+  w.StartObject();
+  w.Key("k");
+  w.Write(std::string(2000, 'x'));
+  w.EndObject();
+
+  auto capacity = w.Str().capacity();
+  w.Reset();
+  EXPECT_TRUE(w.Str().empty());
+  EXPECT_EQ(w.Str().capacity(), capacity);
+}
+
+}  // namespace sherpa
@@ -0,0 +1,44 @@
+// sherpa/csrc/test-latency-budget.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/latency-budget.h"
+
+#include <chrono>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+
+#include "gtest/gtest.h"
+#include "sherpa/csrc/metrics.h"
+
+namespace sherpa {
+
+static Counter *GetViolationCounter(const char *name) {
+  // GetCounter() returns the already-registered counter when the site
+  // has been constructed, so tests can read what the scope recorded.
+  return MetricsRegistry::Get().GetCounter(
+      std::string("sherpa_latency_budget_violations_") + name, "");
+}
+
+TEST(LatencyBudget, ScopeWithinBudgetIsNotCounted) {
+  static LatencyBudgetSite site("TestWithinBudget", /*budget_us*/ 1000000);
+  { LatencyBudgetScope scope(&site); }
+
+  EXPECT_EQ(GetViolationCounter("TestWithinBudget")->Value(), 0);
+}
+
+TEST(LatencyBudget, ScopeOverBudgetIsCounted) {
+  static LatencyBudgetSite site("TestOverBudget", /*budget_us*/ 1);
+  {
+    LatencyBudgetScope scope(&site);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  {
+    LatencyBudgetScope scope(&site);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+
+  EXPECT_EQ(GetViolationCounter("TestOverBudget")->Value(), 2);
+}
+
+}  // namespace sherpa
@@ -0,0 +1,69 @@
+/**
+ * Copyright      2022  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sherpa/csrc/math.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace sherpa {
+
+TEST(Math, LogAddBatch) {
+  std::vector<double> x = {0.0, -1.5, -100.0, -3.0, -0.25};
+  std::vector<double> y = {-0.5, -1.5, 0.0, -80.0, -0.75};
+
+  std::vector<double> ans(x.size());
+  LogAddBatch(x.data(), y.data(), ans.data(), static_cast<int32_t>(x.size()));
+
+  for (size_t i = 0; i != x.size(); ++i) {
+    EXPECT_NEAR(ans[i], LogAdd<double>()(x[i], y[i]), 1e-10);
+  }
+}
+
+TEST(Math, LogAddBatchAliasing) {
+  std::vector<float> x = {-0.5f, -2.0f, -4.0f};
+  std::vector<float> y = {-1.0f, -2.0f, -0.5f};
+  std::vector<float> expected(x.size());
+  for (size_t i = 0; i != x.size(); ++i) {
+    expected[i] = LogAdd<float>()(x[i], y[i]);
+  }
+
+  // The output may alias one of the inputs.
+  LogAddBatch(x.data(), y.data(), x.data(), static_cast<int32_t>(x.size()));
+  for (size_t i = 0; i != x.size(); ++i) {
+    EXPECT_NEAR(x[i], expected[i], 1e-6);
+  }
+}
+
+TEST(Math, TopK) {
+  std::vector<float> data = {-1.0f, 3.0f, 0.5f, 3.0f, -2.0f, 2.0f};
+
+  // Ordered by decreasing value; ties go to the smaller index.
+  EXPECT_EQ(TopK(data.data(), static_cast<int32_t>(data.size()), 3),
+            (std::vector<int32_t>{1, 3, 5}));
+
+  // k >= n returns all indexes, still ordered.
+  EXPECT_EQ(TopK(data.data(), static_cast<int32_t>(data.size()), 10),
+            (std::vector<int32_t>{1, 3, 5, 2, 0, 4}));
+
+  EXPECT_TRUE(TopK(data.data(), static_cast<int32_t>(data.size()), 0).empty());
+  EXPECT_TRUE(TopK(data.data(), 0, 3).empty());
+}
+
+}  // namespace sherpa
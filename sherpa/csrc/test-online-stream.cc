@@ -16,7 +16,9 @@
  * limitations under the License.
  */
 
+#include <chrono>  // NOLINT
 #include <fstream>
+#include <thread>  // NOLINT
 
 #include "gtest/gtest.h"
 #include "sherpa/cpp_api/feature-config.h"
@@ -50,4 +52,50 @@ TEST(OnlineStream, Test) {
   EXPECT_TRUE(s.IsLastFrame(0));
 }
 
+TEST(OnlineStream, ChunkApi) {
+  float sampling_rate = 16000;
+  FeatureConfig feat_config;
+  feat_config.fbank_opts.mel_opts.num_bins = 80;
+
+  OnlineStream s(feat_config.fbank_opts);
+  s.SetChunkGeometry(/*chunk_size*/ 4, /*chunk_shift*/ 2);
+
+  auto a = torch::rand({8000}, torch::kFloat);
+  s.AcceptWaveform(sampling_rate, a);
+
+  EXPECT_TRUE(s.IsChunkReady(0));
+  auto chunk0 = s.GetChunk(0);
+  EXPECT_EQ(chunk0.size(0), 4);
+  EXPECT_EQ(chunk0.size(1), 80);
+
+  // Consecutive chunks overlap by chunk_size - chunk_shift frames.
+  auto chunk1 = s.GetChunk(1);
+  EXPECT_TRUE(chunk0.narrow(0, 2, 2).allclose(chunk1.narrow(0, 0, 2)));
+
+  int32_t last = (s.NumFramesReady() - 4) / 2;
+  EXPECT_TRUE(s.IsChunkReady(last));
+  EXPECT_FALSE(s.IsChunkReady(last + 1));
+}
+
+TEST(OnlineStream, AsyncFeatureComputation) {
+  float sampling_rate = 16000;
+  FeatureConfig feat_config;
+  feat_config.fbank_opts.mel_opts.num_bins = 80;
+
+  OnlineStream s(feat_config.fbank_opts, /*async_feature_computation*/ true);
+  auto a = torch::rand({500}, torch::kFloat);
+  s.AcceptWaveform(sampling_rate, a);
+  s.InputFinished();
+
+  // The features are computed on a background thread; wait until the
+  // sentinel enqueued by InputFinished() has been processed.
+  while (!s.IsLastFrame(0)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  EXPECT_EQ(s.NumFramesReady(), 1);
+  auto frame = s.GetFrame(0);
+  EXPECT_EQ(frame.size(1), 80);
+}
+
 }  // namespace sherpa
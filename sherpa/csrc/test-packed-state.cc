@@ -0,0 +1,173 @@
+// sherpa/csrc/test-packed-state.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#include "sherpa/csrc/packed-state.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace sherpa {
+
+// Mimic the zipformer2 layout: tensors batched along different dims and
+// mixed dtypes (a float cache plus an integer counter).
+static std::vector<torch::Tensor> MakeState() {
+  return {
+      torch::rand({3, 1, 4}, torch::kFloat),   // batched along dim 1
+      torch::rand({1, 2, 5}, torch::kFloat),   // batched along dim 0
+      torch::zeros({1}, torch::kLong) + 10,    // batched along dim 0
+  };
+}
+
+static const std::vector<StateLeafSpec> kLeafSpecs = {
+    {1, false}, {0, false}, {0, false}};
+
+TEST(PackedStateConverter, PackUnpackRoundTrip) {
+  auto s = MakeState();
+  PackedStateConverter converter(torch::IValue(s), kLeafSpecs);
+
+  torch::IValue packed = converter.Pack(torch::IValue(s));
+  EXPECT_TRUE(converter.IsPacked(packed));
+  EXPECT_FALSE(converter.IsPacked(torch::IValue(s)));
+
+  // Pack() of a packed state is the identity
+  EXPECT_TRUE(converter.Pack(packed).isTuple());
+
+  auto unpacked = converter.Unpack(packed).toList();
+  ASSERT_EQ(unpacked.size(), s.size());
+  for (size_t i = 0; i != s.size(); ++i) {
+    torch::Tensor t = unpacked.get(i).toTensor();
+    EXPECT_EQ(t.sizes(), s[i].sizes());
+    EXPECT_TRUE(torch::equal(t, s[i]));
+  }
+}
+
+TEST(PackedStateConverter, StackUnstackStates) {
+  auto s0 = MakeState();
+  auto s1 = MakeState();
+  auto s2 = MakeState();
+
+  PackedStateConverter converter(torch::IValue(s0), kLeafSpecs);
+
+  // StackStates() accepts nested states and packs them on the fly
+  torch::IValue buffer;
+  auto stacked = converter
+                     .StackStates({torch::IValue(s0), torch::IValue(s1),
+                                   torch::IValue(s2)},
+                                  &buffer)
+                     .toList();
+
+  ASSERT_EQ(stacked.size(), s0.size());
+  EXPECT_TRUE(torch::equal(stacked.get(0).toTensor(),
+                           torch::cat({s0[0], s1[0], s2[0]}, /*dim*/ 1)));
+  EXPECT_TRUE(torch::equal(stacked.get(1).toTensor(),
+                           torch::cat({s0[1], s1[1], s2[1]}, /*dim*/ 0)));
+  EXPECT_TRUE(torch::equal(stacked.get(2).toTensor(),
+                           torch::cat({s0[2], s1[2], s2[2]}, /*dim*/ 0)));
+
+  // UnStackStates() returns per-stream packed states
+  auto unstacked = converter.UnStackStates(torch::IValue(stacked));
+  ASSERT_EQ(unstacked.size(), 3);
+  for (const auto &u : unstacked) {
+    EXPECT_TRUE(converter.IsPacked(u));
+  }
+
+  auto nested = converter.Unpack(unstacked[1]).toList();
+  for (size_t i = 0; i != s1.size(); ++i) {
+    EXPECT_TRUE(torch::equal(nested.get(i).toTensor(), s1[i]));
+  }
+
+  // Re-stacking the packed states reuses the buffer and reproduces the
+  // batched state
+  auto restacked = converter.StackStates(unstacked, &buffer).toList();
+  for (size_t i = 0; i != s0.size(); ++i) {
+    EXPECT_TRUE(
+        torch::equal(restacked.get(i).toTensor(), stacked.get(i).toTensor()));
+  }
+}
+
+TEST(PackedStateConverter, SingleStreamBatch) {
+  auto s = MakeState();
+  PackedStateConverter converter(torch::IValue(s), kLeafSpecs);
+
+  // A single-stream batch is built from views and must be identical to
+  // the per-stream state up to the size-1 batch dim.
+  torch::IValue buffer;
+  auto stacked = converter.StackStates({torch::IValue(s)}, &buffer).toList();
+  EXPECT_TRUE(buffer.isNone());
+
+  ASSERT_EQ(stacked.size(), s.size());
+  for (size_t i = 0; i != s.size(); ++i) {
+    EXPECT_TRUE(torch::equal(stacked.get(i).toTensor(), s[i]));
+  }
+
+  auto unstacked = converter.UnStackStates(torch::IValue(stacked));
+  ASSERT_EQ(unstacked.size(), 1);
+  EXPECT_TRUE(converter.IsPacked(unstacked[0]));
+
+  auto nested = converter.Unpack(unstacked[0]).toList();
+  for (size_t i = 0; i != s.size(); ++i) {
+    EXPECT_TRUE(torch::equal(nested.get(i).toTensor(), s[i]));
+  }
+}
+
+// Mimic the conv-emformer layout: a tuple of a list of lists and a
+// list, with StackStates() inserting the batch dimension.
+static torch::IValue MakeNestedState() {
+  c10::List<c10::List<torch::Tensor>> attn;
+  for (int32_t i = 0; i != 2; ++i) {
+    attn.push_back(c10::List<torch::Tensor>{torch::rand({3, 4}),
+                                            torch::rand({2, 4})});
+  }
+
+  c10::List<torch::Tensor> conv{torch::rand({4, 5}), torch::rand({4, 5})};
+
+  return c10::ivalue::Tuple::create(attn, conv);
+}
+
+static const std::vector<StateLeafSpec> kNestedLeafSpecs = {
+    {1, true}, {1, true}, {1, true}, {1, true}, {0, true}, {0, true}};
+
+TEST(PackedStateConverter, NestedStateWithInsertedBatchDim) {
+  auto s0 = MakeNestedState();
+  auto s1 = MakeNestedState();
+
+  PackedStateConverter converter(s0, kNestedLeafSpecs);
+
+  torch::IValue buffer;
+  auto stacked = converter.StackStates({s0, s1}, &buffer);
+
+  // The nesting and list types of the prototype are reproduced
+  ASSERT_TRUE(stacked.isTuple());
+  auto attn = stacked.toTuple()->elements()[0].toList();
+  auto conv = stacked.toTuple()->elements()[1].toTensorList();
+
+  torch::Tensor a00 =
+      s0.toTuple()->elements()[0].toList().get(0).toList().get(0).toTensor();
+  torch::Tensor a10 =
+      s1.toTuple()->elements()[0].toList().get(0).toList().get(0).toTensor();
+  EXPECT_TRUE(torch::equal(attn.get(0).toTensorList().get(0),
+                           torch::stack({a00, a10}, /*dim*/ 1)));
+
+  torch::Tensor c01 = s0.toTuple()->elements()[1].toList().get(1).toTensor();
+  torch::Tensor c11 = s1.toTuple()->elements()[1].toList().get(1).toTensor();
+  EXPECT_TRUE(
+      torch::equal(conv.get(1), torch::stack({c01, c11}, /*dim*/ 0)));
+
+  // Unpack() of an unstacked state reproduces the per-stream nesting
+  auto unstacked = converter.UnStackStates(stacked);
+  ASSERT_EQ(unstacked.size(), 2);
+  EXPECT_TRUE(converter.IsPacked(unstacked[1]));
+
+  auto nested = converter.Unpack(unstacked[1]);
+  torch::Tensor b10 = nested.toTuple()
+                          ->elements()[0]
+                          .toList()
+                          .get(0)
+                          .toList()
+                          .get(0)
+                          .toTensor();
+  EXPECT_TRUE(torch::equal(b10, a10));
+}
+
+}  // namespace sherpa
@@ -242,6 +242,44 @@ TEST(ParseOptions, ParseFromMultipleFiles) {
   remove(filename2.c_str());
 }
 
+TEST(ParseOptions, ParseFromIniFile) {
+  std::string filename = "my-options-for-parse-options-ini.txt";
+  {
+    std::ofstream of(filename);
+
+    of << "# a comment\n";
+    of << "my-bool = true\n";
+    of << "my-i32=-100\n";      // spaces around '=' are optional
+    of << "--my-f=0.5\n";       // the --x=y form can be mixed in
+    of << "\n";
+    of << "[prefix]\n";         // sets the following keys to prefix.*
+    of << "my-s = hello\n";
+  }
+
+  const char *const argv[] = {"./a.out",
+                              "--config=my-options-for-parse-options-ini.txt",
+                              "--my-i32=7", "--print-args"};
+
+  int32_t argc = sizeof(argv) / sizeof(argv[0]);
+  ParseOptions po("Test parsing INI style config files");
+
+  MyOptions opts;
+  opts.Register(&po);
+
+  std::string prefixed_s;
+  ParseOptions po_prefix("prefix", &po);
+  po_prefix.Register("my-s", &prefixed_s, "A string variable with a prefix");
+
+  po.Read(argc, argv);
+
+  EXPECT_EQ(opts.b, true);
+  EXPECT_EQ(opts.i32, 7);  // commandline options have a higher priority
+  EXPECT_EQ(opts.f, 0.5);
+  EXPECT_EQ(prefixed_s, "hello");
+
+  remove(filename.c_str());
+}
+
 TEST(ParseOptions, Duplicates) {
   int32_t a = 10;
   int32_t b = 20;
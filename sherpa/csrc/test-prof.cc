@@ -0,0 +1,38 @@
+// sherpa/csrc/test-prof.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/prof.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace sherpa {
+
+TEST(Prof, DisabledScopeRecordsNothing) {
+  SetProfilingEnabled(false);
+  {
+    SHERPA_PROF_SCOPE(test_disabled_site);
+  }
+
+  std::string rendered = RenderProfSites();
+  EXPECT_EQ(rendered.find("test_disabled_site"), std::string::npos);
+}
+
+TEST(Prof, EnabledScopeShowsUpInRender) {
+  SetProfilingEnabled(true);
+  for (int32_t i = 0; i != 3; ++i) {
+    SHERPA_PROF_SCOPE(test_enabled_site);
+  }
+  SetProfilingEnabled(false);
+
+  std::string rendered = RenderProfSites();
+  EXPECT_NE(rendered.find("sherpa_prof_test_enabled_site_ticks_count 3"),
+            std::string::npos);
+  EXPECT_NE(rendered.find("# TYPE sherpa_prof_test_enabled_site_ticks "
+                          "histogram"),
+            std::string::npos);
+}
+
+}  // namespace sherpa
@@ -0,0 +1,88 @@
+// sherpa/csrc/test-resample.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/resample.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace sherpa {
+
+TEST(LinearResample, DownsampleSine) {
+  int32_t rate_in = 48000;
+  int32_t rate_out = 16000;
+  float cutoff = 0.99f * 0.5f * rate_out;
+
+  LinearResample resampler(rate_in, rate_out, cutoff, /*num_zeros*/ 6);
+
+  // A 100 Hz sine, well below the cutoff, should pass through almost
+  // unchanged apart from the rate change.
+  auto t_in = torch::arange(rate_in, torch::kFloat) / rate_in;
+  auto input = (2 * M_PI * 100 * t_in).sin();
+
+  auto output = resampler.Resample(input, /*flush*/ true);
+
+  auto t_out = torch::arange(output.numel(), torch::kFloat) / rate_out;
+  auto expected = (2 * M_PI * 100 * t_out).sin();
+
+  // Ignore the edges, where the filter window is truncated.
+  int32_t skip = 100;
+  auto err = (output - expected)
+                 .slice(0, skip, output.numel() - skip)
+                 .abs()
+                 .max()
+                 .item<float>();
+  EXPECT_LT(err, 0.01);
+}
+
+TEST(LinearResample, ChunkedMatchesWhole) {
+  int32_t rate_in = 44100;
+  int32_t rate_out = 16000;
+  float cutoff = 0.99f * 0.5f * rate_out;
+
+  auto input = torch::rand({8000}, torch::kFloat) * 2 - 1;
+
+  LinearResample whole(rate_in, rate_out, cutoff, /*num_zeros*/ 6);
+  auto expected = whole.Resample(input, /*flush*/ true);
+
+  // Feeding the same signal piece by piece must produce the same output.
+  LinearResample chunked(rate_in, rate_out, cutoff, /*num_zeros*/ 6);
+  auto a = chunked.Resample(input.slice(0, 0, 3000), /*flush*/ false);
+  auto b = chunked.Resample(input.slice(0, 3000, 7000), /*flush*/ false);
+  auto c = chunked.Resample(input.slice(0, 7000, 8000), /*flush*/ true);
+
+  auto actual = torch::cat({a, b, c});
+  EXPECT_EQ(actual.numel(), expected.numel());
+  EXPECT_TRUE(actual.allclose(expected, /*rtol*/ 1e-5, /*atol*/ 1e-6));
+}
+
+TEST(ResampleBatch, MixedRates) {
+  int32_t target = 16000;
+
+  std::vector<torch::Tensor> waves = {
+      torch::rand({4410}, torch::kFloat) * 2 - 1,
+      torch::rand({1600}, torch::kFloat) * 2 - 1,
+      torch::rand({4800}, torch::kFloat) * 2 - 1,
+      torch::rand({8820}, torch::kFloat) * 2 - 1,
+  };
+  std::vector<int32_t> rates = {44100, 16000, 48000, 44100};
+
+  auto ans = ResampleBatch(waves, rates, target, /*num_threads*/ 2);
+  ASSERT_EQ(ans.size(), waves.size());
+
+  // A wave already at the target rate is passed through unchanged.
+  EXPECT_TRUE(ans[1].equal(waves[1]));
+
+  // The others must match resampling each wave individually.
+  for (size_t i : {0u, 2u, 3u}) {
+    float cutoff = 0.99f * 0.5f * std::min<int32_t>(rates[i], target);
+    LinearResample resampler(rates[i], target, cutoff, /*num_zeros*/ 6);
+    auto expected = resampler.Resample(waves[i], /*flush*/ true);
+    EXPECT_TRUE(ans[i].equal(expected));
+  }
+}
+
+}  // namespace sherpa
@@ -0,0 +1,77 @@
+// sherpa/csrc/test-symbol-table.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/symbol-table.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace sherpa {
+
+static constexpr const char *kTokensFile = "symbol-table-for-test.txt";
+
+static void WriteTokensFile() {
+  std::ofstream os(kTokensFile);
+  os << "<blk> 0\n";
+  os << "a 1\n";
+  // ▁hello: the leading BPE mark is replaced with a space on load
+  os << "\xe2\x96\x81hello 2\n";
+  os << "world 5\n";  // IDs 3 and 4 are not in the table
+}
+
+static void CheckTable(const SymbolTable &table) {
+  EXPECT_EQ(table[0], "<blk>");
+  EXPECT_EQ(table[1], "a");
+  EXPECT_EQ(table[2], " hello");
+  EXPECT_EQ(table[5], "world");
+
+  EXPECT_EQ(table[" hello"], 2);
+  EXPECT_TRUE(table.contains("world"));
+
+  EXPECT_FALSE(table.contains(3));
+  EXPECT_FALSE(table.contains(4));
+  EXPECT_FALSE(table.contains(6));
+}
+
+TEST(SymbolTable, BinaryCacheRoundTrip) {
+  std::string binary = std::string(kTokensFile) + ".bin";
+  WriteTokensFile();
+  std::remove(binary.c_str());
+
+  // First construction parses the text file and compiles the cache.
+  SymbolTable from_text(kTokensFile);
+  CheckTable(from_text);
+
+  std::ifstream is(binary, std::ios::binary);
+  ASSERT_TRUE(is.good()) << "The binary cache was not written";
+  is.close();
+
+  // Second construction loads the cache; it must be indistinguishable.
+  SymbolTable from_binary(kTokensFile);
+  CheckTable(from_binary);
+
+  std::remove(binary.c_str());
+  std::remove(kTokensFile);
+}
+
+TEST(SymbolTable, CorruptBinaryCacheFallsBackToText) {
+  std::string binary = std::string(kTokensFile) + ".bin";
+  WriteTokensFile();
+
+  {
+    std::ofstream os(binary, std::ios::binary | std::ios::trunc);
+    os << "not a symbol table cache";
+  }
+
+  SymbolTable table(kTokensFile);
+  CheckTable(table);
+
+  std::remove(binary.c_str());
+  std::remove(kTokensFile);
+}
+
+}  // namespace sherpa
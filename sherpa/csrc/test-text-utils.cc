@@ -0,0 +1,29 @@
+// sherpa/csrc/test-text-utils.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/text-utils.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace sherpa {
+
+TEST(SplitStringToIntegers, Basic) {
+  std::vector<int32_t> expected = {1, 8, 16, 32};
+  EXPECT_EQ(SplitStringToIntegers("1,8,16,32"), expected);
+}
+
+TEST(SplitStringToIntegers, SingleValue) {
+  std::vector<int32_t> expected = {1};
+  EXPECT_EQ(SplitStringToIntegers("1"), expected);
+}
+
+TEST(SplitStringToIntegers, EmptyFieldsAreSkipped) {
+  std::vector<int32_t> expected = {1, 2};
+  EXPECT_EQ(SplitStringToIntegers(",1,,2,"), expected);
+  EXPECT_TRUE(SplitStringToIntegers("").empty());
+}
+
+}  // namespace sherpa
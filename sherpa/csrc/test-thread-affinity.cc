@@ -0,0 +1,38 @@
+// sherpa/csrc/test-thread-affinity.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/thread-affinity.h"
+
+#include "gtest/gtest.h"
+
+namespace sherpa {
+
+TEST(ParseCpuList, Empty) {
+  auto cpus = ParseCpuList("");
+  EXPECT_TRUE(cpus.empty());
+}
+
+TEST(ParseCpuList, SingleCpu) {
+  auto cpus = ParseCpuList("3");
+  ASSERT_EQ(cpus.size(), 1u);
+  EXPECT_EQ(cpus[0], 3);
+}
+
+TEST(ParseCpuList, RangesAndSingles) {
+  auto cpus = ParseCpuList("0-3,8,10-11");
+  std::vector<int32_t> expected = {0, 1, 2, 3, 8, 10, 11};
+  EXPECT_EQ(cpus, expected);
+}
+
+TEST(ParseCpuList, OverlappingRangesAreDeduplicated) {
+  auto cpus = ParseCpuList("2-4,3,0-2");
+  std::vector<int32_t> expected = {0, 1, 2, 3, 4};
+  EXPECT_EQ(cpus, expected);
+}
+
+TEST(SetCurrentThreadAffinity, EmptyListIsNoOp) {
+  SetCurrentThreadAffinity({});  // must not crash
+}
+
+}  // namespace sherpa
@@ -0,0 +1,94 @@
+// sherpa/csrc/test-wave-reader.cc
+//
+// Copyright (c)  2022  Xiaomi Corporation
+
+#include "sherpa/csrc/wave-reader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace sherpa {
+
+// Write a 16-bit PCM wave file containing the given interleaved
+// samples.
+static void WriteTestWave(const std::string &filename, float sample_rate,
+                          int16_t num_channels,
+                          const std::vector<int16_t> &samples) {
+  uint32_t data_size = samples.size() * sizeof(int16_t);
+  uint32_t byte_rate = sample_rate * num_channels * sizeof(int16_t);
+  uint16_t block_align = num_channels * sizeof(int16_t);
+
+  std::ofstream os(filename, std::ios::binary);
+  auto put16 = [&os](uint16_t v) {
+    os.write(reinterpret_cast<const char *>(&v), 2);
+  };
+  auto put32 = [&os](uint32_t v) {
+    os.write(reinterpret_cast<const char *>(&v), 4);
+  };
+
+  os.write("RIFF", 4);
+  put32(36 + data_size);
+  os.write("WAVE", 4);
+
+  os.write("fmt ", 4);
+  put32(16);
+  put16(1);  // PCM
+  put16(num_channels);
+  put32(sample_rate);
+  put32(byte_rate);
+  put16(block_align);
+  put16(16);  // bits per sample
+
+  os.write("data", 4);
+  put32(data_size);
+  os.write(reinterpret_cast<const char *>(samples.data()), data_size);
+}
+
+TEST(WaveReader, ReadInChunks) {
+  std::string filename = "test-wave-reader-mono.wav";
+  std::vector<int16_t> samples = {0, 16384, -16384, 32767, -32768};
+  WriteTestWave(filename, 16000, /*num_channels*/ 1, samples);
+
+  WaveReader reader(filename, 16000);
+  EXPECT_EQ(reader.NumSamples(), 5);
+  EXPECT_EQ(reader.SampleRate(), 16000);
+
+  auto chunk = reader.ReadChunk(3);
+  EXPECT_EQ(chunk.numel(), 3);
+  EXPECT_FALSE(reader.Done());
+
+  auto rest = reader.ReadChunk(3);
+  EXPECT_EQ(rest.numel(), 2);
+  EXPECT_TRUE(reader.Done());
+  EXPECT_EQ(reader.ReadChunk(3).numel(), 0);
+
+  auto all = torch::cat({chunk, rest});
+  auto expected =
+      torch::tensor({0.f, 16384.f, -16384.f, 32767.f, -32768.f}) / 32768.f;
+  EXPECT_TRUE(all.allclose(expected));
+
+  std::remove(filename.c_str());
+}
+
+TEST(WaveReader, FirstChannelOfStereo) {
+  std::string filename = "test-wave-reader-stereo.wav";
+  // Interleaved: left channel is 1, 2, 3; right channel is -1, -2, -3.
+  std::vector<int16_t> samples = {1, -1, 2, -2, 3, -3};
+  WriteTestWave(filename, 8000, /*num_channels*/ 2, samples);
+
+  WaveReader reader(filename, 8000);
+  EXPECT_EQ(reader.NumSamples(), 3);
+
+  auto chunk = reader.ReadChunk(16);
+  EXPECT_EQ(chunk.numel(), 3);
+  EXPECT_TRUE(chunk.allclose(torch::tensor({1.f, 2.f, 3.f}) / 32768.f));
+
+  std::remove(filename.c_str());
+}
+
+}  // namespace sherpa
@@ -0,0 +1,43 @@
+// sherpa/csrc/text-utils.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/text-utils.h"
+
+#include <sstream>
+
+#include "sherpa/csrc/log.h"
+
+namespace sherpa {
+
+std::vector<int32_t> SplitStringToIntegers(const std::string &s,
+                                           char delim /*= ','*/) {
+  std::vector<int32_t> ans;
+
+  std::istringstream is(s);
+  std::string field;
+  while (std::getline(is, field, delim)) {
+    if (field.empty()) {
+      continue;
+    }
+
+    std::size_t pos = 0;
+    int32_t value = 0;
+    try {
+      value = std::stoi(field, &pos);
+    } catch (const std::exception &) {
+      pos = 0;
+    }
+
+    if (pos != field.size()) {
+      SHERPA_LOG(FATAL) << "Invalid integer '" << field << "' in '" << s
+                        << "'";
+    }
+
+    ans.push_back(value);
+  }
+
+  return ans;
+}
+
+}  // namespace sherpa
@@ -0,0 +1,26 @@
+// sherpa/csrc/text-utils.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_CSRC_TEXT_UTILS_H_
+#define SHERPA_CSRC_TEXT_UTILS_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sherpa {
+
+/** Split a string of delimiter-separated integers, e.g., "1,8,16,32".
+ *
+ * Empty fields are skipped. It aborts on malformed input.
+ *
+ * @param s The string to split.
+ * @param delim The delimiter between two integers.
+ * @return Return the parsed integers.
+ */
+std::vector<int32_t> SplitStringToIntegers(const std::string &s,
+                                           char delim = ',');
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_TEXT_UTILS_H_
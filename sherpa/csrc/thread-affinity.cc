@@ -0,0 +1,96 @@
+// sherpa/csrc/thread-affinity.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#include "sherpa/csrc/thread-affinity.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "sherpa/csrc/log.h"
+
+namespace sherpa {
+
+std::vector<int32_t> ParseCpuList(const std::string &s) {
+  std::vector<int32_t> cpus;
+
+  std::istringstream is(s);
+  std::string item;
+  while (std::getline(is, item, ',')) {
+    if (item.empty()) {
+      continue;
+    }
+
+    int32_t first = 0;
+    int32_t last = 0;
+    char dash = '\0';
+    std::istringstream range(item);
+    if (!(range >> first)) {
+      SHERPA_LOG(FATAL) << "Invalid CPU list: '" << s << "'";
+    }
+    if (range >> dash) {
+      if (dash != '-' || !(range >> last) || last < first) {
+        SHERPA_LOG(FATAL) << "Invalid CPU list: '" << s << "'";
+      }
+    } else {
+      last = first;
+    }
+
+    for (int32_t c = first; c <= last; ++c) {
+      cpus.push_back(c);
+    }
+  }
+
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+std::vector<int32_t> CpusOfNumaNode(int32_t node) {
+  std::ostringstream path;
+  path << "/sys/devices/system/node/node" << node << "/cpulist";
+
+  std::ifstream is(path.str());
+  if (!is) {
+    SHERPA_LOG(WARNING) << "Failed to open " << path.str()
+                        << ". Is NUMA node " << node
+                        << " present on this machine?";
+    return {};
+  }
+
+  std::string cpulist;
+  std::getline(is, cpulist);
+  return ParseCpuList(cpulist);
+}
+
+void SetCurrentThreadAffinity(const std::vector<int32_t> &cpus) {
+  if (cpus.empty()) {
+    return;
+  }
+
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto c : cpus) {
+    CPU_SET(c, &set);
+  }
+
+  int32_t ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (ret != 0) {
+    SHERPA_LOG(WARNING) << "Failed to set the thread affinity. Error code: "
+                        << ret;
+  }
+#else
+  SHERPA_LOG(WARNING)
+      << "Thread affinity is only supported on Linux; ignoring it.";
+#endif
+}
+
+}  // namespace sherpa
@@ -0,0 +1,50 @@
+// sherpa/csrc/thread-affinity.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_CSRC_THREAD_AFFINITY_H_
+#define SHERPA_CSRC_THREAD_AFFINITY_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sherpa {
+
+/** Parse a CPU list in the kernel cpulist format, e.g., "0-3,8,10-11".
+ *
+ * An empty string yields an empty list. It is a fatal error if the
+ * string is malformed.
+ *
+ * @param s The CPU list.
+ * @return The CPU IDs, in ascending order and without duplicates.
+ */
+std::vector<int32_t> ParseCpuList(const std::string &s);
+
+/** Return the CPUs belonging to the given NUMA node.
+ *
+ * It reads /sys/devices/system/node/node<N>/cpulist, so it needs no
+ * libnuma dependency. On platforms without that sysfs layout, or if
+ * the node does not exist, it logs a warning and returns an empty
+ * list.
+ *
+ * @param node The NUMA node ID.
+ */
+std::vector<int32_t> CpusOfNumaNode(int32_t node);
+
+/** Pin the calling thread to the given CPUs.
+ *
+ * Memory the thread allocates and first touches afterwards is placed
+ * on the node(s) of these CPUs by the kernel's first-touch policy, so
+ * pinning a pool before it allocates its buffers also makes the
+ * buffers node-local.
+ *
+ * An empty list is a no-op. On platforms without
+ * pthread_setaffinity_np it logs a warning and does nothing.
+ *
+ * @param cpus The CPU IDs to pin to.
+ */
+void SetCurrentThreadAffinity(const std::vector<int32_t> &cpus);
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_THREAD_AFFINITY_H_
@@ -0,0 +1,60 @@
+// sherpa/csrc/trace.cc
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#include "sherpa/csrc/trace.h"
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <sstream>
+
+namespace sherpa {
+
+TraceRing &TraceRing::Get() {
+  static TraceRing ring;
+  return ring;
+}
+
+int64_t TraceRing::NowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void TraceRing::AddEvent(const char *name, int64_t tid, int64_t ts_us,
+                         int64_t dur_us /*= 0*/) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (events_.empty()) {
+    events_.resize(kCapacity);
+  }
+  events_[next_ % kCapacity] = {name, tid, ts_us, dur_us};
+  ++next_;
+}
+
+std::string TraceRing::RenderChromeTrace() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::ostringstream os;
+  os << "{\"traceEvents\":[";
+
+  // Oldest first; once the ring has wrapped, the oldest live event is
+  // at `next_`.
+  int64_t num_events = std::min<int64_t>(next_, kCapacity);
+  int64_t begin = next_ - num_events;
+  for (int64_t i = 0; i != num_events; ++i) {
+    const Event &e = events_[(begin + i) % kCapacity];
+    if (i != 0) {
+      os << ",";
+    }
+    // "X" is a complete event; a zero duration renders as an instant
+    // tick on the row. Event names are literals from our own call
+    // sites, so no JSON escaping is needed.
+    os << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":"
+       << e.tid << ",\"ts\":" << e.ts_us << ",\"dur\":" << e.dur_us << "}";
+  }
+
+  os << "]}";
+  return os.str();
+}
+
+}  // namespace sherpa
@@ -0,0 +1,82 @@
+// sherpa/csrc/trace.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+
+#ifndef SHERPA_CSRC_TRACE_H_
+#define SHERPA_CSRC_TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+namespace sherpa {
+
+/** A process-wide ring buffer of trace events for tail-latency
+ * forensics.
+ *
+ * Servers record events for a sampled subset of streams (see
+ * --trace-sample-rate of the online websocket server); the newest
+ * events overwrite the oldest, so memory use is bounded and the buffer
+ * always holds the recent past. RenderChromeTrace() dumps the content
+ * in the Chrome trace JSON format, which chrome://tracing and Perfetto
+ * open directly; each traced stream shows up as one timeline row.
+ *
+ * Recording takes a short critical section; only events of sampled
+ * streams reach it, so the hot path of unsampled streams pays nothing
+ * beyond one integer check.
+ */
+class TraceRing {
+ public:
+  /** Return the process-wide ring. */
+  static TraceRing &Get();
+
+  /// True once any sampling is configured; callers use it to skip
+  /// event bookkeeping entirely when tracing is off.
+  bool Enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  void Enable() { enabled_.store(true, std::memory_order_relaxed); }
+
+  /** Append one event.
+   *
+   * @param name Event name. It must be a string literal (or otherwise
+   *             outlive the process); only the pointer is stored.
+   * @param tid Timeline row of the event, e.g., a stream's trace id.
+   * @param ts_us Start of the event, from NowMicros().
+   * @param dur_us Duration in microseconds; 0 renders as an instant.
+   */
+  void AddEvent(const char *name, int64_t tid, int64_t ts_us,
+                int64_t dur_us = 0);
+
+  /// Return the current time in microseconds on the clock AddEvent()
+  /// timestamps are expected on.
+  static int64_t NowMicros();
+
+  /** Render the buffered events as Chrome trace JSON. */
+  std::string RenderChromeTrace() const;
+
+ private:
+  TraceRing() = default;
+
+  struct Event {
+    const char *name;
+    int64_t tid;
+    int64_t ts_us;
+    int64_t dur_us;
+  };
+
+  static constexpr int32_t kCapacity = 65536;
+
+  // It protects `events_` and `next_`.
+  mutable std::mutex mutex_;
+
+  std::vector<Event> events_;  // the ring; sized lazily to kCapacity
+  int64_t next_ = 0;           // number of events ever added
+
+  std::atomic<bool> enabled_{false};
+};
+
+}  // namespace sherpa
+
+#endif  // SHERPA_CSRC_TRACE_H_
@@ -0,0 +1,77 @@
+// sherpa/csrc/wave-reader.h
+//
+// Copyright (c)  2022  Xiaomi Corporation
+#ifndef SHERPA_CSRC_WAVE_READER_H_
+#define SHERPA_CSRC_WAVE_READER_H_
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "torch/script.h"
+
+namespace sherpa {
+
+/** A streaming reader for "*.wav" files.
+ *
+ * Unlike ReadWave(), which loads the whole file into memory eagerly,
+ * this class parses the header once and then yields fixed-size chunks
+ * of samples, converting int16 to normalized float lazily per chunk.
+ * Peak memory is O(chunk) instead of O(file), which matters for
+ * multi-hour offline transcription jobs. The chunks can be fed
+ * incrementally into OnlineStream::AcceptWaveform() or accumulated for
+ * OfflineStream::AcceptSamples().
+ *
+ * Only 16-bit PCM data is supported; if the file has multiple channels,
+ * only the first channel is returned.
+ */
+class WaveReader {
+ public:
+  /**
+   * @param filename Path to the wave file.
+   * @param expected_sample_rate  Expected sample rate of the wave file.
+   *                              It aborts if the sample rate of the
+   *                              given file is not equal to this value.
+   */
+  WaveReader(const std::string &filename, float expected_sample_rate);
+
+  /** Read the next chunk of samples of the first channel.
+   *
+   * @param n Maximum number of samples to read.
+   *
+   * @return Return a 1-D torch.float32 tensor with entries in the range
+   *         [-1, 1). It contains fewer than n samples for the last
+   *         chunk and 0 samples once the file is exhausted.
+   */
+  torch::Tensor ReadChunk(int32_t n);
+
+  /// Return true if all samples have been read.
+  bool Done() const { return num_read_ >= num_samples_; }
+
+  float SampleRate() const { return sample_rate_; }
+
+  /// Total number of samples per channel in the file.
+  int64_t NumSamples() const { return num_samples_; }
+
+  /// Duration in seconds of the file.
+  float Duration() const { return num_samples_ / sample_rate_; }
+
+ private:
+  // Parse the RIFF/WAVE header and position the stream at the start of
+  // the sample data. It aborts on malformed or unsupported files.
+  void ReadHeader(const std::string &filename, float expected_sample_rate);
+
+ private:
+  std::ifstream is_;
+  float sample_rate_ = 0;
+  int32_t num_channels_ = 0;
+  int64_t num_samples_ = 0;  // per channel
+  int64_t num_read_ = 0;     // per channel
+
+  // Interleaved int16 samples of the chunk being converted.
+  std::vector<int16_t> buffer_;
+};
+
+}  // namespace sherpa
+#endif  // SHERPA_CSRC_WAVE_READER_H_
@@ -37,12 +37,13 @@ void PybindHypothesis(py::module &m) {  // NOLINT
         .def_property_readonly(
             "log_prob",
             [](const PyClass &self) -> double { return self.log_prob; })
-        .def_property_readonly(
-            "ys",
-            [](const PyClass &self) -> std::vector<int32_t> { return self.ys; })
+        .def_property_readonly("ys",
+                               [](const PyClass &self) -> std::vector<int32_t> {
+                                 return self.Ys();
+                               })
         .def_property_readonly("timestamps",
                                [](const PyClass &self) -> std::vector<int32_t> {
-                                 return self.timestamps;
+                                 return self.Timestamps();
                                })
         .def_property_readonly("num_trailing_blanks",
                                [](const PyClass &self) -> int32_t {
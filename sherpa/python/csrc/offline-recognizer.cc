@@ -4,8 +4,11 @@
 
 #include "sherpa/cpp_api/offline-recognizer.h"
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
+#include <thread>  // NOLINT
 #include <vector>
 
 #include "sherpa/python/csrc/offline-recognizer.h"
@@ -107,6 +110,27 @@ Args:
     ``fast_beam_search``.
 )doc";
 
+static constexpr const char *kOfflineRecognizerDecodeFilesDoc = R"doc(
+Decode a batch of wave files in one call.
+
+The files are read, resampled, and converted to features by an internal
+thread pool with the GIL released, so a Python batch job pays one call
+across the binding instead of one serial ``accept_wave_file`` per file.
+The resulting streams are decoded together like ``decode_streams``.
+
+Args:
+  paths:
+    Paths of the wave files to decode. Each file must contain mono
+    audio; it is resampled if its sampling rate differs from the one
+    expected by the feature extractor.
+  num_io_threads:
+    Number of threads used to read and feature-ize the files.
+
+Returns:
+  Return a list of recognition results, one per entry of ``paths``,
+  in the same order.
+)doc";
+
 static void PybindOfflineCtcDecoderConfig(py::module &m) {  // NOLINT
   using PyClass = OfflineCtcDecoderConfig;
   py::class_<PyClass>(m, "OfflineCtcDecoderConfig")
@@ -206,7 +230,63 @@ void PybindOfflineRecognizer(py::module &m) {  // NOLINT
           [](PyClass &self, std::vector<OfflineStream *> &ss) {
             self.DecodeStreams(ss.data(), ss.size());
           },
-          py::arg("ss"), py::call_guard<py::gil_scoped_release>());
+          py::arg("ss"), py::call_guard<py::gil_scoped_release>())
+      .def(
+          "decode_files",
+          [](PyClass &self, const std::vector<std::string> &paths,
+             int32_t num_io_threads) {
+            int32_t num_files = static_cast<int32_t>(paths.size());
+
+            std::vector<OfflineRecognitionResult> ans;
+            if (num_files == 0) {
+              return ans;
+            }
+
+            std::vector<std::unique_ptr<OfflineStream>> streams(num_files);
+
+            // Each worker claims the next unread file. The fbank
+            // computer behind the streams is shared, but computing
+            // features only reads its precomputed tables, so the
+            // workers can feature-ize concurrently.
+            std::atomic<int32_t> next{0};
+            auto worker = [&self, &paths, &streams, &next, num_files]() {
+              while (true) {
+                int32_t i = next.fetch_add(1, std::memory_order_relaxed);
+                if (i >= num_files) {
+                  return;
+                }
+                streams[i] = self.CreateStream();
+                streams[i]->AcceptWaveFile(paths[i]);
+              }
+            };
+
+            int32_t num_workers =
+                std::min(std::max<int32_t>(num_io_threads, 1), num_files);
+            std::vector<std::thread> threads;
+            threads.reserve(num_workers);
+            for (int32_t i = 0; i != num_workers; ++i) {
+              threads.emplace_back(worker);
+            }
+            for (auto &t : threads) {
+              t.join();
+            }
+
+            std::vector<OfflineStream *> ss;
+            ss.reserve(num_files);
+            for (auto &s : streams) {
+              ss.push_back(s.get());
+            }
+            self.DecodeStreams(ss.data(), num_files);
+
+            ans.reserve(num_files);
+            for (auto &s : streams) {
+              ans.push_back(s->GetResult());
+            }
+            return ans;
+          },
+          py::arg("paths"), py::arg("num_io_threads") = 4,
+          py::call_guard<py::gil_scoped_release>(),
+          kOfflineRecognizerDecodeFilesDoc);
 }
 
 }  // namespace sherpa
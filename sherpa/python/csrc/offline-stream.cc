@@ -33,15 +33,34 @@ Args:
 
 static void PybindOfflineRecognitionResult(py::module &m) {  // NOLINT
   using PyClass = OfflineRecognitionResult;
+  // The string accessors materialize lazily decoded results on first
+  // access (a no-op for results decoded with lazy_text=False), so a
+  // Python pipeline that reads only token_ids never pays for the
+  // symbol-table lookups and string construction.
   py::class_<PyClass>(m, "OfflineRecognitionResult")
       .def_property_readonly("text",
-                             [](const PyClass &self) { return self.text; })
+                             [](PyClass &self) {
+                               self.MaterializeText();
+                               return self.text;
+                             })
       .def_property_readonly("tokens",
-                             [](const PyClass &self) { return self.tokens; })
+                             [](PyClass &self) {
+                               self.MaterializeText();
+                               return self.tokens;
+                             })
+      .def_property_readonly(
+          "token_ids", [](const PyClass &self) { return self.token_ids; })
       .def_property_readonly(
           "timestamps", [](const PyClass &self) { return self.timestamps; })
-      .def("__str__", &PyClass::AsJsonString)
-      .def("as_json_string", &PyClass::AsJsonString);
+      .def("__str__",
+           [](PyClass &self) {
+             self.MaterializeText();
+             return self.AsJsonString();
+           })
+      .def("as_json_string", [](PyClass &self) {
+        self.MaterializeText();
+        return self.AsJsonString();
+      });
 }
 
 void PybindOfflineStream(py::module &m) {  // NOLINT
@@ -67,7 +86,11 @@ void PybindOfflineStream(py::module &m) {  // NOLINT
           },
           py::arg("samples"), py::call_guard<py::gil_scoped_release>(),
           kOfflineStreamAcceptSamplesTensorDoc)
-      .def_property_readonly("result", &PyClass::GetResult);
+      .def_property_readonly(
+          "result",
+          [](const PyClass &self) -> const OfflineRecognitionResult & {
+            return self.GetResult();
+          });
 
   // alias
   stream.attr("accept_waveform") = stream.attr("accept_samples");
@@ -3,14 +3,142 @@
 // Copyright (c)  2022  Xiaomi Corporation
 #include "sherpa/cpp_api/online-recognizer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
 #include <memory>
+#include <mutex>  // NOLINT
 #include <string>
+#include <thread>  // NOLINT
+#include <utility>
 #include <vector>
 
 #include "sherpa/python/csrc/online-recognizer.h"
 
 namespace sherpa {
 
+namespace {
+
+/** A C++-driven decode loop for Python streaming clients.
+ *
+ * It replaces the Python-side is_ready()/decode_streams()/get_result()
+ * polling loop, whose every step bounces the GIL: a worker thread scans
+ * the registered streams on a fixed interval (like ProcessConnections()
+ * of OnlineWebsocketDecoder), batches the ready ones, decodes them with
+ * the GIL released and acquires the GIL only to deliver results through
+ * the user callback. Python code therefore wakes on actual results
+ * only, e.g., by having the callback post into an asyncio queue with
+ * loop.call_soon_threadsafe().
+ */
+class OnlineDecodeLoop {
+ public:
+  OnlineDecodeLoop(OnlineRecognizer *recognizer, py::function callback,
+                   int32_t loop_interval_ms, int32_t max_batch_size)
+      : recognizer_(recognizer),
+        callback_(std::move(callback)),
+        loop_interval_ms_(loop_interval_ms),
+        max_batch_size_(max_batch_size) {
+    thread_ = std::thread([this]() { Run(); });
+  }
+
+  // Called with the GIL released; see the call_guard of the bindings.
+  void AddStream(OnlineStream *s) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streams_.push_back(s);
+  }
+
+  void RemoveStream(OnlineStream *s) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streams_.erase(std::remove(streams_.begin(), streams_.end(), s),
+                   streams_.end());
+  }
+
+  void Stop() {
+    done_.store(true);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  ~OnlineDecodeLoop() {
+    // The worker may be waiting for the GIL to deliver a result, so it
+    // must be released while joining.
+    py::gil_scoped_release release;
+    Stop();
+  }
+
+ private:
+  void Run() {
+    while (!done_.load()) {
+      std::vector<OnlineStream *> batch;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto s : streams_) {
+          if (recognizer_->IsReady(s)) {
+            batch.push_back(s);
+            if (static_cast<int32_t>(batch.size()) >= max_batch_size_) {
+              break;
+            }
+          }
+        }
+      }
+
+      if (batch.empty()) {
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(loop_interval_ms_));
+        continue;
+      }
+
+      recognizer_->DecodeStreams(batch.data(), batch.size());
+
+      py::gil_scoped_acquire acquire;
+      for (auto s : batch) {
+        try {
+          callback_(s, recognizer_->GetResult(s));
+        } catch (py::error_already_set &e) {
+          // A broken callback must not kill the decode loop; report it
+          // the way an unraisable exception in a Python thread is.
+          e.restore();
+          PyErr_Print();
+        }
+      }
+    }
+  }
+
+  OnlineRecognizer *recognizer_;  // not owned; kept alive by the binding
+  py::function callback_;
+  int32_t loop_interval_ms_;
+  int32_t max_batch_size_;
+
+  // It protects `streams_`. The entries are kept alive by the
+  // keep_alive of add_stream().
+  std::mutex mutex_;
+  std::vector<OnlineStream *> streams_;
+
+  std::atomic<bool> done_{false};
+  std::thread thread_;
+};
+
+}  // namespace
+
+static constexpr const char *kOnlineDecodeLoopInitDoc = R"doc(
+Start a decode loop that drives the given streams from a C++ thread.
+
+Args:
+  recognizer:
+    The recognizer used for decoding. It is kept alive by the loop.
+  callback:
+    Called as ``callback(stream, result)`` for every stream of every
+    decoded batch, from the loop's thread with the GIL held. Keep it
+    cheap; from asyncio, post into a queue with
+    ``loop.call_soon_threadsafe()`` instead of processing inline.
+  loop_interval_ms:
+    How long the loop sleeps when no stream is ready.
+  max_batch_size:
+    Maximum number of streams decoded together.
+)doc";
+
+
 static void PybindOnlineRecognizerConfig(py::module &m) {  // NOLINT
   using PyClass = OnlineRecognizerConfig;
   py::class_<PyClass>(m, "OnlineRecognizerConfig")
@@ -100,6 +228,18 @@ void PybindOnlineRecognizer(py::module &m) {  // NOLINT
            py::call_guard<py::gil_scoped_release>())
       .def_property_readonly("config", &PyClass::GetConfig,
                              py::call_guard<py::gil_scoped_release>());
+
+  py::class_<OnlineDecodeLoop>(m, "OnlineDecodeLoop")
+      .def(py::init<OnlineRecognizer *, py::function, int32_t, int32_t>(),
+           py::arg("recognizer"), py::arg("callback"),
+           py::arg("loop_interval_ms") = 10, py::arg("max_batch_size") = 50,
+           py::keep_alive<1, 2>(), kOnlineDecodeLoopInitDoc)
+      .def("add_stream", &OnlineDecodeLoop::AddStream, py::arg("s"),
+           py::keep_alive<1, 2>(), py::call_guard<py::gil_scoped_release>())
+      .def("remove_stream", &OnlineDecodeLoop::RemoveStream, py::arg("s"),
+           py::call_guard<py::gil_scoped_release>())
+      .def("stop", &OnlineDecodeLoop::Stop,
+           py::call_guard<py::gil_scoped_release>());
 }
 
 }  // namespace sherpa
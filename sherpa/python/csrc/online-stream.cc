@@ -3,13 +3,66 @@
 // Copyright (c)  2022  Xiaomi Corporation
 #include "sherpa/cpp_api/online-stream.h"
 
+#include <utility>
 #include <vector>
 
+#include "pybind11/numpy.h"
 #include "sherpa/python/csrc/online-stream.h"
 #include "torch/torch.h"
 
 namespace sherpa {
 
+static constexpr const char *kOnlineStreamAcceptWaveformNumpyDoc = R"doc(
+Accept samples from a 1-D float32 numpy array without copying them.
+
+The array buffer is wrapped, not copied; the array is kept alive until
+the feature extractor has consumed the samples, so the caller may drop
+its reference right away but must not mutate the buffer afterwards.
+Arrays of another dtype or with strides are converted first (one copy),
+so passing contiguous float32 arrays is what makes this path free.
+
+Args:
+  sampling_rate:
+    Sampling rate of the samples.
+  waveform:
+    A 1-D numpy array with samples normalized to the range ``[-1, 1]``.
+)doc";
+
+static constexpr const char *kAcceptWaveformManyDoc = R"doc(
+Feed one chunk of samples to each of the given streams in one call.
+
+This crosses the Python/C++ boundary once per tick instead of once per
+stream and releases the GIL for all of the feeding, which matters for
+clients driving hundreds of streams from Python. The arrays are
+ingested without copying, like ``OnlineStream.accept_waveform``.
+
+Args:
+  sampling_rate:
+    Sampling rate of the samples; it must be the same for all streams.
+  streams:
+    The streams to feed.
+  waveforms:
+    A list of 1-D numpy arrays with samples normalized to the range
+    ``[-1, 1]``, one per entry of ``streams``.
+)doc";
+
+// Wrap the buffer of `array` in a tensor instead of copying it. The
+// deleter keeps the array alive until the tensor is destroyed; that can
+// happen on the feature worker thread of the stream, which does not
+// hold the GIL, hence the acquisition.
+static torch::Tensor TensorFromNumpy(
+    py::array_t<float, py::array::c_style | py::array::forcecast> array) {
+  auto *keep_alive = new py::array_t<float>(std::move(array));
+  return torch::from_blob(
+      const_cast<float *>(keep_alive->data()),
+      {static_cast<int64_t>(keep_alive->size())},
+      [keep_alive](void *) {
+        py::gil_scoped_acquire acquire;
+        delete keep_alive;
+      },
+      torch::kFloat);
+}
+
 static void PybindOnlineRecognitionResult(py::module &m) {  // NOLINT
   using PyClass = OnlineRecognitionResult;
   py::class_<PyClass>(m, "OnlineRecognitionResult")
@@ -44,8 +97,44 @@ void PybindOnlineStream(py::module &m) {  // NOLINT
       .def("accept_waveform", &PyClass::AcceptWaveform,
            py::arg("sampling_rate"), py::arg("waveform"),
            py::call_guard<py::gil_scoped_release>())
+      .def(
+          "accept_waveform",
+          [](PyClass &self, int32_t sampling_rate,
+             py::array_t<float, py::array::c_style | py::array::forcecast>
+                 waveform) {
+            torch::Tensor tensor = TensorFromNumpy(std::move(waveform));
+            // The wrapping above needs the GIL; the feeding does not.
+            py::gil_scoped_release release;
+            self.AcceptWaveform(sampling_rate, std::move(tensor));
+          },
+          py::arg("sampling_rate"), py::arg("waveform"),
+          kOnlineStreamAcceptWaveformNumpyDoc)
       .def("input_finished", &PyClass::InputFinished,
            py::call_guard<py::gil_scoped_release>());
+
+  m.def(
+      "accept_waveform_many",
+      [](int32_t sampling_rate, std::vector<PyClass *> &streams,
+         std::vector<
+             py::array_t<float, py::array::c_style | py::array::forcecast>>
+             &waveforms) {
+        if (streams.size() != waveforms.size()) {
+          throw py::value_error("len(streams) must match len(waveforms)");
+        }
+
+        std::vector<torch::Tensor> tensors;
+        tensors.reserve(waveforms.size());
+        for (auto &w : waveforms) {
+          tensors.push_back(TensorFromNumpy(std::move(w)));
+        }
+
+        py::gil_scoped_release release;
+        for (size_t i = 0; i != streams.size(); ++i) {
+          streams[i]->AcceptWaveform(sampling_rate, std::move(tensors[i]));
+        }
+      },
+      py::arg("sampling_rate"), py::arg("streams"), py::arg("waveforms"),
+      kAcceptWaveformManyDoc);
 }
 
 }  // namespace sherpa
@@ -17,15 +17,45 @@
  */
 #include "sherpa/python/csrc/rnnt_beam_search.h"
 
+#include <cstring>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include "pybind11/numpy.h"
 #include "sherpa/csrc/rnnt_beam_search.h"
 #include "torch/torch.h"
 
 namespace sherpa {
 
+// Pack a list of token rows into one int32 array plus row offsets, so
+// the crossing into Python is two buffer copies instead of one Python
+// int per token. Row i of `rows` occupies values[row_splits[i]:
+// row_splits[i + 1]].
+//
+// Caution: It must be called with the GIL held since it creates numpy
+// arrays.
+static std::pair<py::array_t<int32_t>, py::array_t<int32_t>> PackRows(
+    const std::vector<std::vector<int32_t>> &rows) {
+  int32_t num_rows = static_cast<int32_t>(rows.size());
+
+  py::array_t<int32_t> row_splits(num_rows + 1);
+  int32_t *splits = row_splits.mutable_data();
+  splits[0] = 0;
+  for (int32_t i = 0; i != num_rows; ++i) {
+    splits[i + 1] = splits[i] + static_cast<int32_t>(rows[i].size());
+  }
+
+  py::array_t<int32_t> values(splits[num_rows]);
+  int32_t *data = values.mutable_data();
+  for (int32_t i = 0; i != num_rows; ++i) {
+    std::memcpy(data + splits[i], rows[i].data(),
+                rows[i].size() * sizeof(int32_t));
+  }
+
+  return {std::move(values), std::move(row_splits)};
+}
+
 static constexpr const char *kGreedySearchDoc = R"doc(
 RNN-T greedy search decoding by limiting the max symbol per frame to one.
 
@@ -139,6 +169,25 @@ Returns:
   Decoded results for the next chunk.
 )doc";
 
+static constexpr const char *kGreedySearchPackedDoc = R"doc(
+Like :func:`greedy_search`, but the decoded tokens are returned as one
+packed int32 numpy array plus row offsets instead of a list of lists,
+so the conversion to Python is two buffer copies rather than one Python
+object per token. Use it for large batches where the per-element
+conversion of :func:`greedy_search` shows up while holding the GIL.
+
+Returns:
+  Return a tuple ``(values, row_splits)`` of 1-D int32 numpy arrays.
+  The tokens of utterance ``i`` are ``values[row_splits[i]:
+  row_splits[i + 1]]``.
+)doc";
+
+static constexpr const char *kModifiedBeamSearchPackedDoc = R"doc(
+Like :func:`modified_beam_search`, but the decoded tokens are returned
+as one packed int32 numpy array plus row offsets instead of a list of
+lists; see :func:`greedy_search_packed` for the layout.
+)doc";
+
 void PybindRnntBeamSearch(py::module &m) {  // NOLINT
   m.def("greedy_search", &GreedySearch, py::arg("model"),
         py::arg("encoder_out"), py::arg("encoder_out_length"),
@@ -175,6 +224,35 @@ void PybindRnntBeamSearch(py::module &m) {  // NOLINT
         py::arg("frame_offset"), py::arg("num_active_paths") = 4,
         py::call_guard<py::gil_scoped_release>(),
         kStreamingModifiedBeamSearchDoc);
+
+  m.def(
+      "greedy_search_packed",
+      [](RnntModel &model, torch::Tensor encoder_out,
+         torch::Tensor encoder_out_length) {
+        std::vector<std::vector<int32_t>> hyps;
+        {
+          py::gil_scoped_release release;
+          hyps = GreedySearch(model, encoder_out, encoder_out_length);
+        }
+        return PackRows(hyps);
+      },
+      py::arg("model"), py::arg("encoder_out"), py::arg("encoder_out_length"),
+      kGreedySearchPackedDoc);
+
+  m.def(
+      "modified_beam_search_packed",
+      [](RnntModel &model, torch::Tensor encoder_out,
+         torch::Tensor encoder_out_length, int32_t num_active_paths) {
+        std::vector<std::vector<int32_t>> hyps;
+        {
+          py::gil_scoped_release release;
+          hyps = ModifiedBeamSearch(model, encoder_out, encoder_out_length,
+                                    num_active_paths);
+        }
+        return PackRows(hyps);
+      },
+      py::arg("model"), py::arg("encoder_out"), py::arg("encoder_out_length"),
+      py::arg("num_active_paths") = 4, kModifiedBeamSearchPackedDoc);
 }
 
 }  // namespace sherpa
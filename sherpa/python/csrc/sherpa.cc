@@ -38,6 +38,7 @@
 #include "sherpa/python/csrc/offline-stream.h"
 #include "sherpa/python/csrc/online-recognizer.h"
 #include "sherpa/python/csrc/online-stream.h"
+#include "sherpa/python/csrc/shm-ring.h"
 
 namespace sherpa {
 
@@ -64,6 +65,7 @@ PYBIND11_MODULE(_sherpa, m) {
   PybindEndpoint(m);
   PybindOnlineStream(m);
   PybindOnlineRecognizer(m);
+  PybindShmRing(m);
 }
 
 }  // namespace sherpa
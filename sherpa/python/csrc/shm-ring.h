@@ -0,0 +1,15 @@
+// sherpa/python/csrc/shm-ring.h
+//
+// Copyright (c)  2023  Xiaomi Corporation
+#ifndef SHERPA_PYTHON_CSRC_SHM_RING_H_
+#define SHERPA_PYTHON_CSRC_SHM_RING_H_
+
+#include "sherpa/python/csrc/sherpa.h"
+
+namespace sherpa {
+
+void PybindShmRing(py::module &m);  // NOLINT
+
+}
+
+#endif  // SHERPA_PYTHON_CSRC_SHM_RING_H_
@@ -35,7 +35,13 @@ class TestHypothesis(unittest.TestCase):
         hyp = sherpa.Hypothesis(ys=[1, 2, 3], log_prob=0.5)
         assert hyp.ys == [1, 2, 3], hyp.ys
         assert hyp.log_prob == 0.5, hyp.log_prob
-        assert hyp.key == "-".join(map(str, hyp.ys)) == "1-2-3"
+
+        # The key is a 64-bit hash that depends only on the token sequence
+        hyp2 = sherpa.Hypothesis(ys=[1, 2, 3], log_prob=-0.5)
+        assert hyp.key == hyp2.key, (hyp.key, hyp2.key)
+
+        hyp3 = sherpa.Hypothesis(ys=[3, 2, 1], log_prob=0.5)
+        assert hyp.key != hyp3.key, (hyp.key, hyp3.key)
 
 
 if __name__ == "__main__":
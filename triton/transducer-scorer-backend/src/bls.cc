@@ -107,6 +107,14 @@ torch::Tensor BLSExecutor::Execute(std::vector<torch::Tensor>& input_tensors,
                                    std::vector<const char*>& input_names,
                                    std::vector<const char*>& output_names,
                                    std::string model_name) {
+  return Wait(
+      ExecuteAsync(input_tensors, input_names, output_names, model_name));
+}
+
+std::future<TRITONSERVER_InferenceResponse*> BLSExecutor::ExecuteAsync(
+    std::vector<torch::Tensor>& input_tensors,
+    std::vector<const char*>& input_names,
+    std::vector<const char*>& output_names, std::string model_name) {
   // Check if both models are valid before executing request.
   // Check if the model is ready.
   bool is_ready = false;
@@ -120,7 +128,7 @@ torch::Tensor BLSExecutor::Execute(std::vector<torch::Tensor>& input_tensors,
   }
 
   // Prepare std::future for model.
-  std::vector<std::future<TRITONSERVER_InferenceResponse*>> futures(1);
+  std::future<TRITONSERVER_InferenceResponse*> future;
 
   // The inference request object for sending internal requests.
   TRITONSERVER_InferenceRequest* irequest = nullptr;
@@ -132,17 +140,21 @@ torch::Tensor BLSExecutor::Execute(std::vector<torch::Tensor>& input_tensors,
     THROW_IF_TRITON_ERROR(PrepareInferenceOutput(output_names, irequest));
 
     // Execute inference request.
-    THROW_IF_TRITON_ERROR(model_executor_.AsyncExecute(irequest, &futures[0]));
+    THROW_IF_TRITON_ERROR(model_executor_.AsyncExecute(irequest, &future));
   } catch (const BLSBackendException& bls_exception) {
     LOG_MESSAGE(TRITONSERVER_LOG_ERROR, bls_exception.what());
     LOG_IF_ERROR(TRITONSERVER_InferenceRequestDelete(irequest),
                  "Failed to delete inference request.");
   }
 
-  // If both internal requests are sent successfully, retrieve the output from
-  // each request and construct the final response.
-  torch::Tensor r = ConstructFinalResponse(std::move(futures));
-  return r;
+  return future;
+}
+
+torch::Tensor BLSExecutor::Wait(
+    std::future<TRITONSERVER_InferenceResponse*> future) {
+  std::vector<std::future<TRITONSERVER_InferenceResponse*>> futures;
+  futures.push_back(std::move(future));
+  return ConstructFinalResponse(std::move(futures));
 }
 
 torch::Tensor BLSExecutor::ConstructFinalResponse(
@@ -69,6 +69,20 @@ class BLSExecutor {
                         std::vector<const char*>& output_names,
                         std::string model_name);
 
+  // Submits the inference request and returns without waiting for the
+  // response, so the caller can overlap its own work (e.g., preparing
+  // the inputs of the next invocation) with the model execution. The
+  // input tensors must stay alive until Wait() returns. Pass the
+  // returned future to Wait() to obtain the output tensor.
+  std::future<TRITONSERVER_InferenceResponse*> ExecuteAsync(
+      std::vector<torch::Tensor>& input_tensors,
+      std::vector<const char*>& input_names,
+      std::vector<const char*>& output_names, std::string model_name);
+
+  // Blocks until the request submitted by ExecuteAsync() completes and
+  // returns its output tensor.
+  torch::Tensor Wait(std::future<TRITONSERVER_InferenceResponse*> future);
+
   // Constructs the final response.
   torch::Tensor ConstructFinalResponse(
       std::vector<std::future<TRITONSERVER_InferenceResponse*>> futures);
@@ -170,7 +170,8 @@ class ModelInstanceState : public BackendModelInstance {
       BackendInputCollector* collector, std::vector<const char*>* input_names,
       std::vector<torch::jit::IValue>* input_tensors,
       std::vector<BackendMemory*>* input_memories, bool* cuda_copy);
-  void SetOutputBuffer(const std::string& out_bytes,
+  void SetOutputBuffer(const std::vector<int32_t>& tokens,
+                       const sherpa::SymbolTable* symbol_table,
                        TRITONBACKEND_Response* response,
                        TRITONBACKEND_Output* response_output);
   TRITONSERVER_Error* RecordBackendTimestamp(uint64_t* timestamp,
@@ -368,13 +369,8 @@ void ModelInstanceState::ProcessRequests(TRITONBACKEND_Request** requests,
     ans = Search(&input_tensors);
   }
 
-  std::vector<std::string> ans_str;
   const sherpa::SymbolTable* symbol_table = model_state_->getSymbolTable();
 
-  for (auto& utt : ans) {
-    ans_str.push_back(Convert(utt, symbol_table));
-  }
-
   uint64_t compute_end_ns = 0;
   RESPOND_ALL_AND_SET_TRUE_IF_ERROR(
       responses, request_count, all_response_failed,
@@ -393,7 +389,7 @@ void ModelInstanceState::ProcessRequests(TRITONBACKEND_Request** requests,
           TRITONBACKEND_ResponseOutput(response, &response_output, "OUTPUT0",
                                        TRITONSERVER_TYPE_BYTES,
                                        &output_shape[0], dims_count));
-      SetOutputBuffer(ans_str[i], response, response_output);
+      SetOutputBuffer(ans[i], symbol_table, response, response_output);
 
       LOG_IF_ERROR(TRITONBACKEND_ResponseSend(
                        response, TRITONSERVER_RESPONSE_COMPLETE_FINAL, nullptr),
@@ -467,22 +463,38 @@ void ModelInstanceState::ProcessRequests(TRITONBACKEND_Request** requests,
 }
 
 void ModelInstanceState::SetOutputBuffer(
-    const std::string& out_bytes, TRITONBACKEND_Response* response,
-    TRITONBACKEND_Output* response_output) {
+    const std::vector<int32_t>& tokens, const sherpa::SymbolTable* symbol_table,
+    TRITONBACKEND_Response* response, TRITONBACKEND_Output* response_output) {
   TRITONSERVER_MemoryType actual_memory_type = TRITONSERVER_MEMORY_CPU;
   int64_t actual_memory_type_id = 0;
-  uint32_t byte_size_with_size_int = out_bytes.size() + sizeof(int32_t);
+
+  // Two passes over the tokens: the first sizes the payload, so the
+  // output buffer is requested at its final size and the text is built
+  // directly in it, with no intermediate std::string per request.
+  size_t text_size = 0;
+  for (auto i : tokens) {
+    text_size += (*symbol_table)[i].size();
+  }
+
+  uint32_t byte_size_with_size_int = text_size + sizeof(int32_t);
   void* obuffer;
   auto err = TRITONBACKEND_OutputBuffer(
       response_output, &obuffer, byte_size_with_size_int, &actual_memory_type,
       &actual_memory_type_id);
   if (err != nullptr) {
     RESPOND_AND_SET_NULL_IF_ERROR(&response, err);
+    return;
   }
 
   int32_t* buffer_as_int = reinterpret_cast<int32_t*>(obuffer);
-  buffer_as_int[0] = out_bytes.size();
-  memcpy(&buffer_as_int[1], out_bytes.data(), out_bytes.size());
+  buffer_as_int[0] = text_size;
+
+  char* p = reinterpret_cast<char*>(&buffer_as_int[1]);
+  for (auto i : tokens) {
+    const std::string& sym = (*symbol_table)[i];
+    memcpy(p, sym.data(), sym.size());
+    p += sym.size();
+  }
 }
 
 /////////////
@@ -546,13 +558,19 @@ std::vector<std::vector<int32_t>> ModelInstanceState::Search(
   int32_t max_T = packed_seq.batch_sizes().numel();
 
   int32_t offset = 0;
+  torch::Tensor cur_encoder_out;
+  if (max_T > 0) {
+    // The slice of the first frame; inside the loop the slice of the
+    // next frame is gathered while the joiner of the current one is in
+    // flight.
+    int32_t first_batch_size = batch_sizes_accessor[0];
+    cur_encoder_out = packed_seq.data().index({Slice(0, first_batch_size)});
+    offset = first_batch_size;
+  }
+
   for (int32_t t = 0; t != max_T; ++t) {
     int32_t cur_batch_size = batch_sizes_accessor[t];
-    int32_t start = offset;
-    int32_t end = start + cur_batch_size;
-    auto cur_encoder_out = packed_seq.data().index({Slice(start, end)});
     // Now cur_encoder_out is of shape (cur_batch_size, joiner_dim)
-    offset = end;
 
     if (cur_batch_size < decoder_out.size(0)) {
       decoder_out = decoder_out.index({Slice(0, cur_batch_size)});
@@ -560,8 +578,21 @@ std::vector<std::vector<int32_t>> ModelInstanceState::Search(
     std::vector<torch::Tensor> joiner_input_tensors{
         cur_encoder_out, decoder_out.squeeze(1).to(device_)};
 
-    auto logits = bls_executor_.Execute(joiner_input_tensors, joiner_input_name,
-                                        joiner_output_name, joiner_name);
+    auto logits_future =
+        bls_executor_.ExecuteAsync(joiner_input_tensors, joiner_input_name,
+                                   joiner_output_name, joiner_name);
+
+    // Overlap the gather of the next frame's encoder-output slice with
+    // the joiner execution of this frame.
+    torch::Tensor next_encoder_out;
+    if (t + 1 != max_T) {
+      int32_t next_batch_size = batch_sizes_accessor[t + 1];
+      next_encoder_out =
+          packed_seq.data().index({Slice(offset, offset + next_batch_size)});
+      offset += next_batch_size;
+    }
+
+    auto logits = bls_executor_.Wait(std::move(logits_future));
 
     // logits' shape is (cur_batch_size, vocab_size)
     // logits is the output of nn.Linear. Since we are using greedy search
@@ -581,13 +612,21 @@ std::vector<std::vector<int32_t>> ModelInstanceState::Search(
     }
 
     if (emitted) {
-      BuildDecoderInput(results, &decoder_input);
-      std::vector<torch::Tensor> decoder_input_tensors{
-          decoder_input.to(device_)};
-      decoder_out =
-          bls_executor_.Execute(decoder_input_tensors, decoder_input_name,
-                                decoder_output_name, decoder_name);
+      // Only the first cur_batch_size rows are still being decoded (the
+      // packed sequence is sorted by length), so rebuild the decoder
+      // input and re-run the decoder for those rows only instead of the
+      // full padded batch.
+      auto active_decoder_input =
+          decoder_input.index({Slice(0, cur_batch_size)});
+      BuildDecoderInput(results, &active_decoder_input);
+      std::vector<torch::Tensor> active_decoder_input_tensors{
+          active_decoder_input.to(device_)};
+      decoder_out = bls_executor_.Execute(active_decoder_input_tensors,
+                                          decoder_input_name,
+                                          decoder_output_name, decoder_name);
     }
+
+    cur_encoder_out = next_encoder_out;
   }  // for (int32_t t = 0; t != max_T; ++t) {
 
   auto unsorted_indices = packed_seq.unsorted_indices().cpu();
@@ -12,16 +12,6 @@ namespace triton {
 namespace backend {
 namespace scorer {
 
-static std::string Convert(const std::vector<int32_t>& src,
-                           const sherpa::SymbolTable* sym_table) {
-  std::string text;
-  for (auto i : src) {
-    auto sym = (*sym_table)[i];
-    text.append(sym);
-  }
-  return text;
-}
-
 static void BuildDecoderInput(const std::vector<std::vector<int32_t>>& r,
                               torch::Tensor* decoder_input) {
   int32_t batch_size = decoder_input->size(0);
@@ -38,7 +38,10 @@ SymbolTable::SymbolTable(const std::string &filename) {
     }
 
     sym2id_.insert({sym, id});
-    id2sym_.insert({id, sym});
+    if (static_cast<int32_t>(id2sym_.size()) <= id) {
+      id2sym_.resize(id + 1);
+    }
+    id2sym_[id] = sym;
   }
 }
 
@@ -59,7 +62,10 @@ int32_t SymbolTable::operator[](const std::string &sym) const {
   return sym2id_.at(sym);
 }
 
-bool SymbolTable::contains(int32_t id) const { return id2sym_.count(id) != 0; }
+bool SymbolTable::contains(int32_t id) const {
+  return id >= 0 && id < static_cast<int32_t>(id2sym_.size()) &&
+         !id2sym_[id].empty();
+}
 
 bool SymbolTable::contains(const std::string &sym) const {
   return sym2id_.count(sym) != 0;
@@ -21,6 +21,7 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace sherpa {
 
@@ -56,7 +57,12 @@ class SymbolTable {
 
  private:
   std::unordered_map<std::string, int32_t> sym2id_;
-  std::unordered_map<int32_t, std::string> id2sym_;
+
+  // Token IDs are dense (0 to vocab-1), so ID-to-symbol is a vector
+  // indexed by ID instead of a hash map: the result builders of the
+  // decoders look up every emitted token of every partial result. An
+  // empty slot marks an ID that is not in the table.
+  std::vector<std::string> id2sym_;
 };
 
 std::ostream &operator<<(std::ostream &os, const SymbolTable &symbol_table);